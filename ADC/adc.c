@@ -7,7 +7,93 @@
  */
 
 #include "adc.h"
+#include "coro.h"
 #include "SysTick.h"
+#include "time.h"
+#include "dma.h"
+#include "dwt.h"
+
+static uint16_t *adc_scan_buf;                            // Start of the circular DMA buffer
+static uint16_t adc_scan_half_len;                        // Samples per half (frames * channels)
+static uint8_t adc_scan_channels[ADC_SCAN_MAX_CHANNELS];  // Channel of every rank
+static uint8_t adc_scan_nbr;                              // Ranks per frame
+static ADC_Block_Callback adc_scan_half_cb;               // Called when the first half is filled
+static ADC_Block_Callback adc_scan_full_cb;               // Called when the second half is filled
+static const uint16_t *volatile adc_scan_latest;          // Most recently completed half
+static volatile uint32_t adc_scan_seq;                    // Number of completed halves since ADC_Scan_Init
+static uint8_t adc_scan_timer;                            // 1 while TIM3 paces the scan
+static uint8_t adc_scan_dma;                              // 1 while DMA1 Channel1 is allocated to the scan
+static DMA_Desc_TypeDef adc_scan_desc;                    // Circular transfer from ADC1->DR into the buffer
+
+static uint16_t adc_awd_low;                  // Lower limit of the normal range; in rank mode the hardware window
+static uint16_t adc_awd_high;                 // Upper limit of the normal range; in rank mode the hardware window
+static uint16_t adc_awd_hyst;                 // Distance to move back inside before leaving a tripped state
+static uint8_t adc_awd_ch;                    // Guarded channel, or ADC_AWD_ALL_CHANNELS
+static ADC_AWD_Callback adc_awd_cb;           // Called on every state change
+static volatile ADC_AWD_State adc_awd_state;  // Current state of the guarded input
+
+static uint8_t adc_awd_ranks;                                             // 1 while every scan rank is tracked
+static uint16_t adc_awd_rank_low[ADC_SCAN_MAX_CHANNELS];                  // Lower limit of every rank
+static uint16_t adc_awd_rank_high[ADC_SCAN_MAX_CHANNELS];                 // Upper limit of every rank
+static volatile ADC_AWD_State adc_awd_rank_state[ADC_SCAN_MAX_CHANNELS];  // Current state of every rank
+static volatile uint8_t adc_awd_follow;  // 1 while the interrupt is masked and the scan buffer is followed
+static uint32_t adc_awd_next;            // Next scan buffer index to classify while following
+
+static Coro_TypeDef *adc_async_owner;  // Context of the ADC_Read_Async() in flight, NULL if none
+static uint32_t adc_async_sum;         // Sum of its conversions so far
+
+static void ADC_Scan_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event);
+static void ADC_AWD_Track(void);
+
+/**
+ * @brief Configures the GPIO pin that belongs to an ADC1 channel as analog input.
+ *
+ * Channels 0-7 are PA0-PA7, channels 8-9 are PB0-PB1 and channels 10-15 are PC0-PC5.
+ * Channels 16 and 17 are internal and have no pin.
+ *
+ * @param ch The ADC channel whose pin should be configured.
+ * @return void
+ */
+static void ADC_GPIO_Config(uint8_t ch) {
+    GPIO_InitTypeDef GPIO_InitStructure;
+    GPIO_TypeDef *port;
+
+    if (ch < 8) {
+        port = GPIOA;
+        RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
+    } else if (ch < 10) {
+        port = GPIOB;
+        ch -= 8;
+        RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB, ENABLE);
+    } else if (ch < 16) {
+        port = GPIOC;
+        ch -= 10;
+        RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
+    } else {
+        return;  // Internal channel, no pin
+    }
+
+    GPIO_InitStructure.GPIO_Pin = (uint16_t)(1 << ch);
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AIN;  // Analog input
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_Init(port, &GPIO_InitStructure);
+}
+
+/**
+ * @brief Resets and runs the ADC1 self-calibration, waiting until both steps are done.
+ *
+ * @param void
+ * @return void
+ */
+static void ADC_Calibrate(void) {
+    ADC_ResetCalibration(ADC1);  // Reset the calibration register of the specified ADC
+    while (ADC_GetResetCalibrationStatus(ADC1)) {
+    }  // Get the status of the ADC reset calibration register
+
+    ADC_StartCalibration(ADC1);  // Start the calibration status of the specified ADC
+    while (ADC_GetCalibrationStatus(ADC1)) {
+    }  // Get the calibration status of the specified ADC
+}
 
 /**
  * @brief Initializes the ADC peripheral and GPIO for analog input.
@@ -24,18 +110,14 @@
  * @return void
  */
 void ADCx_Init(void) {
-    GPIO_InitTypeDef GPIO_InitStructure;  // Define structure variable
     ADC_InitTypeDef ADC_InitStructure;
 
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA | RCC_APB2Periph_ADC1, ENABLE);
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
 
     RCC_ADCCLKConfig(
         RCC_PCLK2_Div6);  // Set ADC clock division factor to 6, 72M/6=12, ADC maximum time should not exceed 14M
 
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1;      // ADC
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AIN;  // Analog input
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_Init(GPIOA, &GPIO_InitStructure);
+    ADC_GPIO_Config(ADC_Channel_1);  // PA1
 
     ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;
     ADC_InitStructure.ADC_ScanConvMode = DISABLE;        // Non-scan mode
@@ -48,13 +130,7 @@ void ADCx_Init(void) {
 
     ADC_Cmd(ADC1, ENABLE);  // Enable ADC
 
-    ADC_ResetCalibration(ADC1);  // Reset the calibration register of the specified ADC
-    while (ADC_GetResetCalibrationStatus(ADC1)) {
-    }  // Get the status of the ADC reset calibration register
-
-    ADC_StartCalibration(ADC1);  // Start the calibration status of the specified ADC
-    while (ADC_GetCalibrationStatus(ADC1)) {
-    }  // Get the calibration status of the specified ADC
+    ADC_Calibrate();
 
     // Enable or disable the software conversion start function of the specified
     ADC_SoftwareStartConvCmd(ADC1, ENABLE);
@@ -85,3 +161,681 @@ uint16_t Get_ADC_Value(unit8_t ch, unit8_t times) {
     }
     return temp_val / times;
 }
+
+/**
+ * @brief Awaitable version of Get_ADC_Value(): averages several conversions of a channel without blocking.
+ *
+ * Each call returns at once; the coroutine waits for the end of every conversion and for the 5 ms between
+ * conversions instead of spinning. ADC1 serves one read at a time, so a read started while another one is in
+ * flight waits for it to finish first. ADC1 must be set up with ADCx_Init() and no scan may be running.
+ *
+ * @param c The coroutine context of this read.
+ * @param ch The ADC channel to be converted.
+ * @param times The number of conversions to average, at least 1.
+ * @param val Receives the average ADC value when the read is done.
+ * @return CORO_WAITING while the read is in progress, CORO_DONE when val is valid.
+ */
+uint8_t ADC_Read_Async(Coro_TypeDef *c, uint8_t ch, uint8_t times, uint16_t *val) {
+    CORO_BEGIN(c);
+    CORO_WAIT_UNTIL(c, adc_async_owner == 0);
+    adc_async_owner = c;
+    adc_async_sum = 0;
+    ADC_RegularChannelConfig(ADC1, ch, 1, ADC_SampleTime_239Cycles5);  // ADC1, ADC channel, 239.5 cycles
+
+    for (c->n = 0; c->n < times; ++c->n) {
+        if (c->n) {
+            CORO_DELAY_MS(c, 5);
+        }
+        ADC_SoftwareStartConvCmd(ADC1, ENABLE);
+        CORO_WAIT_UNTIL(c, ADC_GetFlagStatus(ADC1, ADC_FLAG_EOC));  // Wait for the conversion to end
+        adc_async_sum += ADC_GetConversionValue(ADC1);
+    }
+    *val = adc_async_sum / times;
+    adc_async_owner = 0;
+    CORO_END(c);
+}
+
+/**
+ * @brief Configures ADC1 in scan mode with DMA1 Channel1 filling a circular double buffer, without starting it.
+ *
+ * With no external trigger the ADC runs in continuous mode; with an external trigger every trigger event
+ * converts the whole sequence once. DMA1 Channel1 is taken from the DMA manager and kept until ADC_Scan_Stop().
+ *
+ * @param channels The ADC channels to convert, in rank order.
+ * @param nbr The number of channels, 1 to ADC_SCAN_MAX_CHANNELS.
+ * @param buf The sample buffer, which must hold 2 * frames * nbr samples.
+ * @param frames The number of frames per half buffer.
+ * @param trig The regular external trigger, ADC_ExternalTrigConv_None for continuous conversion.
+ * @param sample_time The sampling time applied to every channel.
+ * @return 1 on success, 0 if the arguments are invalid or DMA1 Channel1 is owned by another driver.
+ */
+static uint8_t ADC_Scan_Config(const uint8_t *channels, uint8_t nbr, uint16_t *buf, uint16_t frames, uint32_t trig,
+                            uint8_t sample_time) {
+    ADC_InitTypeDef ADC_InitStructure;
+    DMA_InitTypeDef *DMA_InitStructure = &adc_scan_desc.init;
+    uint8_t i;
+
+    if (nbr < 1 || nbr > ADC_SCAN_MAX_CHANNELS || frames < 1 || (uint32_t)frames * nbr > ADC_SCAN_MAX_HALF) {
+        return 0;
+    }
+
+    // Power down first: setting ADON while it is already set would start a conversion during the setup
+    ADC_Cmd(ADC1, DISABLE);
+    ADC_DMACmd(ADC1, DISABLE);
+    if (adc_awd_ranks) {
+        ADC_AWD_Disable();  // Tracks the ranks through the scan buffer, which is released now
+    }
+    if (adc_scan_dma) {
+        DMA_Mgr_Free(1);  // Drop the transfer of the previous scan
+    }
+    adc_scan_dma = DMA_Mgr_Alloc(1, 1, 1);
+    if (!adc_scan_dma) {
+        return 0;
+    }
+
+    adc_scan_buf = buf;
+    adc_scan_half_len = (uint16_t)(frames * nbr);
+    adc_scan_nbr = nbr;
+    for (i = 0; i < nbr; ++i) {
+        adc_scan_channels[i] = channels[i];
+    }
+    adc_scan_latest = 0;
+    adc_scan_seq = 0;
+
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+    RCC_ADCCLKConfig(RCC_PCLK2_Div6);  // 72M/6=12M
+
+    for (i = 0; i < nbr; ++i) {
+        ADC_GPIO_Config(channels[i]);
+    }
+
+    DMA_InitStructure->DMA_PeripheralBaseAddr = (uint32_t)&ADC1->DR;  // ADC1 regular data register
+    DMA_InitStructure->DMA_MemoryBaseAddr = (uint32_t)buf;
+    DMA_InitStructure->DMA_DIR = DMA_DIR_PeripheralSRC;         // Peripheral to memory mode
+    DMA_InitStructure->DMA_BufferSize = 2 * adc_scan_half_len;  // Both halves
+    DMA_InitStructure->DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure->DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure->DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;  // 16 bits
+    DMA_InitStructure->DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure->DMA_Mode = DMA_Mode_Circular;  // Wrap around to the first half
+    DMA_InitStructure->DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure->DMA_M2M = DMA_M2M_Disable;
+    adc_scan_desc.half = 1;  // Half and full buffer events
+    adc_scan_desc.cb = ADC_Scan_DMA_Event;
+
+    ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;
+    ADC_InitStructure.ADC_ScanConvMode = ENABLE;  // Scan mode, convert every rank in turn
+    // Restart the sequence after the last rank unless an external trigger paces it
+    ADC_InitStructure.ADC_ContinuousConvMode = trig == ADC_ExternalTrigConv_None ? ENABLE : DISABLE;
+    ADC_InitStructure.ADC_ExternalTrigConv = trig;
+    ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+    ADC_InitStructure.ADC_NbrOfChannel = nbr;
+    ADC_Init(ADC1, &ADC_InitStructure);
+
+    for (i = 0; i < nbr; ++i) {
+        ADC_RegularChannelConfig(ADC1, channels[i], i + 1, sample_time);
+    }
+
+    ADC_Cmd(ADC1, ENABLE);  // Power up only, ADON was clear
+    ADC_Calibrate();
+
+    // Arm the DMA last, so the first sample in buf is rank 1 of the first frame
+    DMA_Mgr_Submit(1, &adc_scan_desc);
+    ADC_DMACmd(ADC1, ENABLE);  // Every end of conversion issues a DMA request
+    return 1;
+}
+
+/**
+ * @brief Starts continuous scan conversion of several channels into a circular double buffer.
+ *
+ * ADC1 converts the channels in the given order in scan + continuous mode, and DMA1 Channel1 moves every
+ * result into buf in circular mode. buf is split into two halves of frames * nbr samples each; a frame is one
+ * sample of every channel in rank order, so channel k of frame f is at block[f * nbr + k].
+ * The DMA half-transfer and transfer-complete events hand each half over to the application
+ * (see ADC_Scan_Set_Callback() and ADC_Scan_Get_Latest()) while the other half is being filled.
+ *
+ * @param channels The ADC channels to convert, in rank order.
+ * @param nbr The number of channels, 1 to ADC_SCAN_MAX_CHANNELS.
+ * @param buf The sample buffer, which must hold 2 * frames * nbr samples.
+ * @param frames The number of frames per half buffer, with frames * nbr at most ADC_SCAN_MAX_HALF.
+ * @return 1 if the scan is running, 0 if the arguments are invalid or DMA1 Channel1 is owned by another driver.
+ */
+uint8_t ADC_Scan_Init(const uint8_t *channels, uint8_t nbr, uint16_t *buf, uint16_t frames) {
+    if (!ADC_Scan_Config(channels, nbr, buf, frames, ADC_ExternalTrigConv_None, ADC_SampleTime_239Cycles5)) {
+        return 0;
+    }
+    ADC_SoftwareStartConvCmd(ADC1, ENABLE);
+    return 1;
+}
+
+/**
+ * @brief Starts scan conversion paced by TIM3 at a fixed frame rate, with results going to memory through DMA.
+ *
+ * TIM3 emits TRGO on every update event and each trigger converts the whole channel sequence once, so frames are
+ * exactly 1 / rate apart regardless of what the CPU is doing. The buffer layout, callbacks and
+ * ADC_Scan_Get_Latest() are the same as for ADC_Scan_Init(). Channels are sampled for 55.5 ADC cycles, so a frame
+ * takes 68 * nbr ADC cycles and the rate must not exceed ADCCLK / (68 * nbr), about 176 kHz / nbr at 12 MHz.
+ * See TIM_Rate_Calc() for the accuracy of the generated rate. TIM3 belongs to the scan until ADC_Scan_Stop(), so
+ * the matrix keypad (Matrix_Key_Init()) and the TIM3 channels of the PWM generator (PWM_Init()) cannot run at the
+ * same time; starting either of them reprograms TIM3 and breaks the frame rate.
+ *
+ * @param channels The ADC channels to convert, in rank order.
+ * @param nbr The number of channels, 1 to ADC_SCAN_MAX_CHANNELS.
+ * @param buf The sample buffer, which must hold 2 * frames * nbr samples.
+ * @param frames The number of frames per half buffer, with frames * nbr at most ADC_SCAN_MAX_HALF.
+ * @param rate The frame rate in Hz.
+ * @return The achieved frame rate in Hz, or 0 if the arguments are invalid, the rate is not achievable or DMA1
+ *         Channel1 is owned by another driver (nothing is started).
+ */
+uint32_t ADC_Scan_Timer_Init(const uint8_t *channels, uint8_t nbr, uint16_t *buf, uint16_t frames, uint32_t rate) {
+    RCC_ClocksTypeDef clocks;
+    uint16_t per;
+    uint16_t psc;
+
+    RCC_ADCCLKConfig(RCC_PCLK2_Div6);  // 72M/6=12M
+    RCC_GetClocksFreq(&clocks);
+    if (nbr < 1 || rate == 0 || rate > clocks.ADCCLK_Frequency / (68 * (uint32_t)nbr) ||
+        TIM_Rate_Calc(TIM_APB1_Clock(), rate, &per, &psc) == 0) {
+        return 0;
+    }
+
+    if (!ADC_Scan_Config(channels, nbr, buf, frames, ADC_ExternalTrigConv_T3_TRGO, ADC_SampleTime_55Cycles5)) {
+        return 0;
+    }
+    ADC_ExternalTrigConvCmd(ADC1, ENABLE);  // Start a sequence on every TIM3 TRGO
+    adc_scan_timer = 1;
+
+    return TIM3_TRGO_Init(rate);
+}
+
+/**
+ * @brief Stops the scan started by ADC_Scan_Init() or ADC_Scan_Timer_Init().
+ *
+ * @param void
+ * @return void
+ */
+void ADC_Scan_Stop(void) {
+    if (adc_scan_timer) {
+        TIM_Cmd(TIM3, DISABLE);
+        adc_scan_timer = 0;
+    }
+    ADC_Cmd(ADC1, DISABLE);
+    ADC_DMACmd(ADC1, DISABLE);
+    if (adc_awd_ranks) {
+        ADC_AWD_Disable();  // Tracks the ranks through the scan buffer, which is released now
+    }
+    if (adc_scan_dma) {
+        DMA_Mgr_Free(1);
+        adc_scan_dma = 0;
+    }
+}
+
+/**
+ * @brief Registers the callbacks called from the DMA interrupt when a half buffer is complete.
+ *
+ * The callbacks run in interrupt context and must finish before the DMA wraps around to the half
+ * they were given. Either callback may be NULL.
+ *
+ * @param half_cb Called with the first half after the half-transfer interrupt.
+ * @param full_cb Called with the second half after the transfer-complete interrupt.
+ * @return void
+ */
+void ADC_Scan_Set_Callback(ADC_Block_Callback half_cb, ADC_Block_Callback full_cb) {
+    adc_scan_half_cb = half_cb;
+    adc_scan_full_cb = full_cb;
+}
+
+/**
+ * @brief Returns the most recently completed half buffer without blocking.
+ *
+ * The block stays valid until the DMA wraps around to it again, i.e. for one half-buffer period.
+ * Comparing seq between calls tells whether a new block arrived (difference 1) or blocks were missed (> 1).
+ *
+ * @param seq Receives the number of halves completed so far; may be NULL.
+ * @return The latest block of frames * nbr samples, or NULL if no half has completed yet.
+ */
+const uint16_t *ADC_Scan_Get_Latest(uint32_t *seq) {
+    const uint16_t *block;
+    uint32_t s;
+
+    do {  // Re-read if the interrupt completed another half in between
+        s = adc_scan_seq;
+        block = adc_scan_latest;
+    } while (s != adc_scan_seq);
+
+    if (seq) {
+        *seq = s;
+    }
+    return block;
+}
+
+/**
+ * @brief Publishes a completed half buffer and calls its callback.
+ *
+ * While the analog watchdog follows the scan buffer (see ADC_AWD_Track()), the new samples are classified first.
+ *
+ * @param block The half that has just been filled.
+ * @param cb The callback registered for this half.
+ * @return void
+ */
+static void ADC_Scan_Block_Done(const uint16_t *block, ADC_Block_Callback cb) {
+    adc_scan_latest = block;
+    adc_scan_seq++;
+    if (adc_awd_follow) {
+        ADC_AWD_Track();
+    }
+    if (cb) {
+        cb(block, adc_scan_half_len);
+    }
+}
+
+/**
+ * @brief DMA manager callback for DMA1 Channel1, which serves the ADC1 scan.
+ *
+ * The half-transfer event means the first half is complete and the DMA is filling the second one;
+ * the transfer-complete event means the second half is complete and the DMA has wrapped to the first.
+ *
+ * @param desc The scan descriptor.
+ * @param event DMA_EVT_HT or DMA_EVT_TC.
+ * @return void
+ */
+static void ADC_Scan_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event) {
+    (void)desc;
+    if (event == DMA_EVT_HT) {
+        ADC_Scan_Block_Done(adc_scan_buf, adc_scan_half_cb);
+    } else if (event == DMA_EVT_TC) {
+        ADC_Scan_Block_Done(adc_scan_buf + adc_scan_half_len, adc_scan_full_cb);
+    }
+}
+
+/**
+ * @brief Programs the watchdog window that ends the current state.
+ *
+ * In the normal state the window is the normal range. After a high trip the window becomes
+ * [high - hyst, 4095] so the next interrupt only fires once the input has dropped back by the hysteresis,
+ * and after a low trip it becomes [0, low + hyst]. The input therefore never interrupts while it stays
+ * in one state.
+ *
+ * @param void
+ * @return void
+ */
+static void ADC_AWD_Arm(void) {
+    uint16_t low = adc_awd_low;
+    uint16_t high = adc_awd_high;
+
+    if (adc_awd_state == ADC_AWD_High) {
+        low = adc_awd_high > adc_awd_hyst ? adc_awd_high - adc_awd_hyst : 0;
+        high = 0xfff;
+    } else if (adc_awd_state == ADC_AWD_Low) {
+        low = 0;
+        high = adc_awd_low + adc_awd_hyst < 0xfff ? adc_awd_low + adc_awd_hyst : 0xfff;
+    }
+    ADC_AnalogWatchdogThresholdsConfig(ADC1, high, low);
+}
+
+/**
+ * @brief Finds the conversion result that tripped the watchdog.
+ *
+ * Without a scan the tripping conversion was the last one, so it is still in the data register. During a scan
+ * the ADC keeps converting and the data register already holds a later rank when the interrupt runs, so the
+ * newest frame in the DMA buffer is searched instead: for one guarded channel its newest sample, for all
+ * channels the newest sample above the range, else below it, else the newest sample.
+ *
+ * @param void
+ * @return The result, 0 to 4095.
+ */
+static uint16_t ADC_AWD_Sample(void) {
+    uint32_t total = 2 * (uint32_t)adc_scan_half_len;
+    uint32_t next;
+    uint32_t i;
+    uint16_t v;
+    uint16_t pick = 0xffff;
+    uint8_t k;
+
+    if (!adc_scan_dma) {
+        return (uint16_t)(ADC1->DR & 0xfff);
+    }
+    next = total - DMA_GetCurrDataCounter(DMA_Mgr_Channel(1));  // Next sample the DMA writes
+    for (k = 0; k < adc_scan_nbr; ++k) {
+        if (adc_scan_seq == 0 && k >= next) {
+            break;  // Not written yet in the first half
+        }
+        i = (next + total - 1 - k) % total;  // Newest first; a half holds whole frames, so i % nbr is the rank
+        if (adc_awd_ch != ADC_AWD_ALL_CHANNELS && adc_scan_channels[i % adc_scan_nbr] != adc_awd_ch) {
+            continue;
+        }
+        v = adc_scan_buf[i] & 0xfff;
+        if (adc_awd_ch != ADC_AWD_ALL_CHANNELS || v > adc_awd_high) {
+            return v;
+        }
+        if (pick == 0xffff || (v < adc_awd_low && pick >= adc_awd_low)) {
+            pick = v;  // Newest sample, or newest one below the range
+        }
+    }
+    return pick != 0xffff ? pick : (uint16_t)(ADC1->DR & 0xfff);
+}
+
+/**
+ * @brief Applies one result to the hysteresis state machine of a tracked rank.
+ *
+ * A result outside [low, high] trips the state; a tripped state returns to normal only once the result is inside
+ * the range by more than the hysteresis, the same rule ADC_AWD_Arm() programs into the hardware window.
+ *
+ * @param state The current state.
+ * @param v The result, 0 to 4095.
+ * @param low Lower limit of the normal range.
+ * @param high Upper limit of the normal range.
+ * @return The new state.
+ */
+static ADC_AWD_State ADC_AWD_Next(ADC_AWD_State state, uint16_t v, uint16_t low, uint16_t high) {
+    if (v > high) {
+        return ADC_AWD_High;
+    }
+    if (v < low) {
+        return ADC_AWD_Low;
+    }
+    if (state == ADC_AWD_High && high - v <= adc_awd_hyst) {
+        return ADC_AWD_High;
+    }
+    if (state == ADC_AWD_Low && v - low <= adc_awd_hyst) {
+        return ADC_AWD_Low;
+    }
+    return ADC_AWD_Normal;
+}
+
+/**
+ * @brief Programs the intersection of all rank ranges as the hardware window.
+ *
+ * A result outside the intersection may still be normal for its own rank, so the interrupt only wakes the
+ * software, which then decides per rank.
+ *
+ * @param void
+ * @return void
+ */
+static void ADC_AWD_Window(void) {
+    uint8_t r;
+
+    adc_awd_low = 0;
+    adc_awd_high = 0xfff;
+    for (r = 0; r < adc_scan_nbr; ++r) {
+        if (adc_awd_rank_low[r] > adc_awd_low) {
+            adc_awd_low = adc_awd_rank_low[r];
+        }
+        if (adc_awd_rank_high[r] < adc_awd_high) {
+            adc_awd_high = adc_awd_rank_high[r];
+        }
+    }
+    ADC_AnalogWatchdogThresholdsConfig(ADC1, adc_awd_high, adc_awd_low);  // Disjoint ranges trip on every result
+}
+
+/**
+ * @brief Classifies the scan buffer from the last classified sample up to the one the DMA writes next.
+ *
+ * A half buffer holds whole frames, so the buffer index modulo the number of ranks is the rank of a sample.
+ * The callback is called for every rank whose state changes.
+ *
+ * @param void
+ * @return The number of samples that leave the hardware window or keep their rank out of the normal state, i.e.
+ *         that the hardware interrupt alone would not follow.
+ */
+static uint32_t ADC_AWD_Follow(void) {
+    uint32_t total = 2 * (uint32_t)adc_scan_half_len;
+    uint32_t next = (total - DMA_GetCurrDataCounter(DMA_Mgr_Channel(1))) % total;
+    uint32_t unsettled = 0;
+    ADC_AWD_State state;
+    uint16_t v;
+    uint8_t r;
+
+    while (adc_awd_next != next) {
+        r = (uint8_t)(adc_awd_next % adc_scan_nbr);
+        v = adc_scan_buf[adc_awd_next] & 0xfff;
+        state = ADC_AWD_Next(adc_awd_rank_state[r], v, adc_awd_rank_low[r], adc_awd_rank_high[r]);
+        if (state != adc_awd_rank_state[r]) {
+            adc_awd_rank_state[r] = state;
+            if (adc_awd_cb) {
+                adc_awd_cb(adc_scan_channels[r], state, v);
+            }
+        }
+        if (state != ADC_AWD_Normal || v < adc_awd_low || v > adc_awd_high) {
+            unsettled++;
+        }
+        adc_awd_next = (adc_awd_next + 1) % total;
+    }
+    return unsettled;
+}
+
+/**
+ * @brief Follows the scan buffer in software until every rank is back under the hardware window.
+ *
+ * While a rank is outside the window or tripped, the hardware would flag every frame, so its interrupt stays
+ * masked and the new samples are classified as each half buffer completes, at no cost beyond the DMA interrupt
+ * that runs anyway. Once a stretch of samples is all normal and inside the window, the flag is cleared, the
+ * samples converted meanwhile are checked once more, and the interrupt is unmasked again.
+ *
+ * @param void
+ * @return void
+ */
+static void ADC_AWD_Track(void) {
+    if (ADC_AWD_Follow() == 0) {
+        ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+        if (ADC_AWD_Follow() == 0) {  // A result converted after the clear sets the flag again
+            adc_awd_follow = 0;
+            ADC_ITConfig(ADC1, ADC_IT_AWD, ENABLE);
+        }
+    }
+}
+
+/**
+ * @brief Masks the watchdog interrupt and starts following the scan buffer from its newest frame.
+ *
+ * @param void
+ * @return void
+ */
+static void ADC_AWD_Follow_Start(void) {
+    uint32_t total = 2 * (uint32_t)adc_scan_half_len;
+    uint32_t next = (total - DMA_GetCurrDataCounter(DMA_Mgr_Channel(1))) % total;
+
+    ADC_ITConfig(ADC1, ADC_IT_AWD, DISABLE);
+    ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+    if (adc_scan_seq == 0 && next < adc_scan_nbr) {
+        adc_awd_next = 0;  // The first frame is still being written
+    } else {
+        adc_awd_next = (next + total - adc_scan_nbr) % total;  // Every rank once; older samples are superseded
+    }
+    adc_awd_follow = 1;
+    ADC_AWD_Track();
+}
+
+/**
+ * @brief Enables the ADC1 analog watchdog with a software hysteresis layer.
+ *
+ * The hardware compares every conversion of the guarded channel against a window and raises the ADC interrupt
+ * only when a result falls outside it, so the core can sleep (e.g. __WFI()) while the input stays in range.
+ * The STM32F1 has a single watchdog window, which guards either one channel or all regular channels. The watchdog
+ * only observes conversions, so the ADC must be running, for example through ADC_Scan_Init() or
+ * ADC_Scan_Timer_Init(); call this function after starting it. With all channels of a scan guarded, every rank
+ * has its own state and limits (see ADC_AWD_Set_Channel_Limits()): the hardware window stays at the intersection
+ * of the ranges, and once it trips the scan buffer is followed in software until all ranks are normal again.
+ *
+ * @param ch The guarded ADC channel, or ADC_AWD_ALL_CHANNELS for every regular channel.
+ * @param low Results below low are reported as ADC_AWD_Low.
+ * @param high Results above high are reported as ADC_AWD_High.
+ * @param hyst How far the input must move back inside the range before ADC_AWD_Normal is reported; 0 for none.
+ * @param cb Called from the ADC or scan DMA interrupt on every state change of a channel; may be NULL to only
+ *        poll ADC_AWD_Get_State().
+ * @return void
+ */
+void ADC_AWD_Init(uint8_t ch, uint16_t low, uint16_t high, uint16_t hyst, ADC_AWD_Callback cb) {
+    NVIC_InitTypeDef NVIC_InitStructure;
+    uint8_t r;
+
+    adc_awd_low = low;
+    adc_awd_high = high;
+    adc_awd_hyst = hyst;
+    adc_awd_ch = ch;
+    adc_awd_cb = cb;
+    adc_awd_state = ADC_AWD_Normal;
+    adc_awd_ranks = ch == ADC_AWD_ALL_CHANNELS && adc_scan_dma;
+    adc_awd_follow = 0;
+
+    if (adc_awd_ranks) {
+        for (r = 0; r < adc_scan_nbr; ++r) {
+            adc_awd_rank_low[r] = low;
+            adc_awd_rank_high[r] = high;
+            adc_awd_rank_state[r] = ADC_AWD_Normal;
+        }
+        ADC_AWD_Window();
+    } else {
+        ADC_AWD_Arm();
+    }
+    if (ch == ADC_AWD_ALL_CHANNELS) {
+        ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_AllRegEnable);  // Guard every regular channel
+    } else {
+        ADC_AnalogWatchdogSingleChannelConfig(ADC1, ch);
+        ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_SingleRegEnable);  // Guard one regular channel
+    }
+
+    ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+    ADC_ITConfig(ADC1, ADC_IT_AWD, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = ADC1_2_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;  // Preemption priority
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;         // Subpriority
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+/**
+ * @brief Disables the analog watchdog and its interrupt.
+ *
+ * @param void
+ * @return void
+ */
+void ADC_AWD_Disable(void) {
+    ADC_ITConfig(ADC1, ADC_IT_AWD, DISABLE);
+    ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_None);
+    adc_awd_follow = 0;
+    adc_awd_ranks = 0;
+}
+
+/**
+ * @brief Sets the normal range of one channel when all channels of a scan are guarded.
+ *
+ * The new range applies from the newest frame on: the channel's state is decided again against it right away,
+ * and the callback is called if it changes.
+ *
+ * @param ch The ADC channel; every rank that converts it gets the range.
+ * @param low Results below low are reported as ADC_AWD_Low.
+ * @param high Results above high are reported as ADC_AWD_High.
+ * @return 1 on success, 0 if the watchdog does not guard all channels of a scan or ch is not scanned.
+ */
+uint8_t ADC_AWD_Set_Channel_Limits(uint8_t ch, uint16_t low, uint16_t high) {
+    uint32_t primask;
+    uint8_t found = 0;
+    uint8_t r;
+
+    if (!adc_awd_ranks) {
+        return 0;
+    }
+    primask = __get_PRIMASK();
+    __disable_irq();  // The ranks are classified from the ADC and DMA interrupts
+    for (r = 0; r < adc_scan_nbr; ++r) {
+        if (adc_scan_channels[r] == ch) {
+            adc_awd_rank_low[r] = low;
+            adc_awd_rank_high[r] = high;
+            found = 1;
+        }
+    }
+    if (found) {
+        ADC_AWD_Window();
+        ADC_AWD_Follow_Start();  // A result may now be outside its range without tripping the hardware
+    }
+    __set_PRIMASK(primask);
+    return found;
+}
+
+/**
+ * @brief Returns the current state of the guarded input.
+ *
+ * With all channels of a scan guarded this is the worst state over all channels: ADC_AWD_High if any channel is
+ * high, else ADC_AWD_Low if any is low.
+ *
+ * @param void
+ * @return ADC_AWD_Normal, ADC_AWD_Low or ADC_AWD_High.
+ */
+ADC_AWD_State ADC_AWD_Get_State(void) {
+    ADC_AWD_State state = ADC_AWD_Normal;
+    uint8_t r;
+
+    if (!adc_awd_ranks) {
+        return adc_awd_state;
+    }
+    for (r = 0; r < adc_scan_nbr; ++r) {
+        if (adc_awd_rank_state[r] == ADC_AWD_High) {
+            return ADC_AWD_High;
+        }
+        if (adc_awd_rank_state[r] == ADC_AWD_Low) {
+            state = ADC_AWD_Low;
+        }
+    }
+    return state;
+}
+
+/**
+ * @brief Returns the current state of one guarded channel.
+ *
+ * @param ch The ADC channel.
+ * @return Its state when all channels of a scan are guarded, otherwise the same as ADC_AWD_Get_State().
+ */
+ADC_AWD_State ADC_AWD_Get_Channel_State(uint8_t ch) {
+    uint8_t r;
+
+    if (adc_awd_ranks) {
+        for (r = 0; r < adc_scan_nbr; ++r) {
+            if (adc_scan_channels[r] == ch) {
+                return adc_awd_rank_state[r];
+            }
+        }
+    }
+    return ADC_AWD_Get_State();
+}
+
+/**
+ * @brief Interrupt handler for ADC1 and ADC2, which serves the analog watchdog.
+ *
+ * The result that tripped the window (see ADC_AWD_Sample()) is classified against the normal range and the window
+ * is re-armed for the new state; the callback is called if the state changed. With all channels of a scan
+ * guarded, the interrupt instead hands over to following the scan buffer (see ADC_AWD_Track()).
+ *
+ * @param void
+ * @return void
+ */
+void ADC1_2_IRQHandler(void) {
+    ADC_AWD_State state;
+    uint16_t value;
+    uint8_t changed;
+    uint8_t ch;
+    DWT_PROF_BEGIN(adc1_2_irq);
+
+    if (ADC_GetITStatus(ADC1, ADC_IT_AWD) && adc_awd_ranks) {
+        ADC_AWD_Follow_Start();
+    } else if (ADC_GetITStatus(ADC1, ADC_IT_AWD)) {
+        value = ADC_AWD_Sample();
+        if (value > adc_awd_high) {
+            state = ADC_AWD_High;
+        } else if (value < adc_awd_low) {
+            state = ADC_AWD_Low;
+        } else {
+            state = ADC_AWD_Normal;  // Moved back inside by at least the hysteresis
+        }
+        changed = state != adc_awd_state;
+        adc_awd_state = state;
+        ADC_AWD_Arm();
+        ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+        if (changed && adc_awd_cb) {
+            ch = adc_awd_ch != ADC_AWD_ALL_CHANNELS ? adc_awd_ch : (uint8_t)(ADC1->SQR3 & 0x1f);  // Rank 1 alone
+            adc_awd_cb(ch, state, value);
+        }
+    }
+    DWT_PROF_END(adc1_2_irq);
+}
@@ -11,6 +11,39 @@
 
 #include "system.h"
 
+struct Coro_TypeDef;  // Coroutine context, see coro.h
+
+#define ADC_SCAN_MAX_CHANNELS 16  // Length of the ADC1 regular sequence
+#define ADC_SCAN_MAX_HALF 32767   // Samples per half buffer, so both halves fit one DMA transfer
+
+/**
+ * @brief Callback type for a completed half of the scan buffer.
+ *
+ * @param block The completed half, frames * nbr samples in frame order.
+ * @param len The number of samples in block.
+ */
+typedef void (*ADC_Block_Callback)(const uint16_t *block, uint16_t len);
+
+#define ADC_AWD_ALL_CHANNELS 0xff  // Guard every regular channel, each with its own state
+
+/**
+ * @brief State of the input guarded by the analog watchdog.
+ */
+typedef enum {
+    ADC_AWD_Normal = 0,  // Inside the normal range
+    ADC_AWD_Low,         // Below the lower limit
+    ADC_AWD_High         // Above the upper limit
+} ADC_AWD_State;
+
+/**
+ * @brief Callback type for analog watchdog state changes.
+ *
+ * @param ch The ADC channel whose state changed.
+ * @param state The new state.
+ * @param value The conversion result that caused the change.
+ */
+typedef void (*ADC_AWD_Callback)(uint8_t ch, ADC_AWD_State state, uint16_t value);
+
 /**
  * @brief Initializes the ADC peripheral and GPIO for analog input.
  *
@@ -40,4 +73,155 @@ void ADCx_Init(void);
  */
 uint16_t Get_ADC_Value(unit8_t ch, unit8_t times);
 
+/**
+ * @brief Awaitable version of Get_ADC_Value(): averages several conversions of a channel without blocking.
+ *
+ * Each call returns at once; the coroutine waits for the end of every conversion and for the 5 ms between
+ * conversions instead of spinning. ADC1 serves one read at a time, so a read started while another one is in
+ * flight waits for it to finish first. ADC1 must be set up with ADCx_Init() and no scan may be running.
+ *
+ * @param c The coroutine context of this read.
+ * @param ch The ADC channel to be converted.
+ * @param times The number of conversions to average, at least 1.
+ * @param val Receives the average ADC value when the read is done.
+ * @return CORO_WAITING while the read is in progress, CORO_DONE when val is valid.
+ */
+uint8_t ADC_Read_Async(struct Coro_TypeDef *c, uint8_t ch, uint8_t times, uint16_t *val);
+
+/**
+ * @brief Starts continuous scan conversion of several channels into a circular double buffer.
+ *
+ * ADC1 converts the channels in the given order in scan + continuous mode, and DMA1 Channel1 moves every
+ * result into buf in circular mode. buf is split into two halves of frames * nbr samples each; a frame is one
+ * sample of every channel in rank order, so channel k of frame f is at block[f * nbr + k].
+ * The DMA half-transfer and transfer-complete events hand each half over to the application
+ * (see ADC_Scan_Set_Callback() and ADC_Scan_Get_Latest()) while the other half is being filled.
+ *
+ * @param channels The ADC channels to convert, in rank order.
+ * @param nbr The number of channels, 1 to ADC_SCAN_MAX_CHANNELS.
+ * @param buf The sample buffer, which must hold 2 * frames * nbr samples.
+ * @param frames The number of frames per half buffer, with frames * nbr at most ADC_SCAN_MAX_HALF.
+ * @return 1 if the scan is running, 0 if the arguments are invalid or DMA1 Channel1 is owned by another driver.
+ */
+uint8_t ADC_Scan_Init(const uint8_t *channels, uint8_t nbr, uint16_t *buf, uint16_t frames);
+
+/**
+ * @brief Starts scan conversion paced by TIM3 at a fixed frame rate, with results going to memory through DMA.
+ *
+ * TIM3 emits TRGO on every update event and each trigger converts the whole channel sequence once, so frames are
+ * exactly 1 / rate apart regardless of what the CPU is doing. The buffer layout, callbacks and
+ * ADC_Scan_Get_Latest() are the same as for ADC_Scan_Init(). Channels are sampled for 55.5 ADC cycles, so a frame
+ * takes 68 * nbr ADC cycles and the rate must not exceed ADCCLK / (68 * nbr), about 176 kHz / nbr at 12 MHz.
+ * See TIM_Rate_Calc() for the accuracy of the generated rate. TIM3 belongs to the scan until ADC_Scan_Stop(), so
+ * the matrix keypad (Matrix_Key_Init()) and the TIM3 channels of the PWM generator (PWM_Init()) cannot run at the
+ * same time; starting either of them reprograms TIM3 and breaks the frame rate.
+ *
+ * @param channels The ADC channels to convert, in rank order.
+ * @param nbr The number of channels, 1 to ADC_SCAN_MAX_CHANNELS.
+ * @param buf The sample buffer, which must hold 2 * frames * nbr samples.
+ * @param frames The number of frames per half buffer, with frames * nbr at most ADC_SCAN_MAX_HALF.
+ * @param rate The frame rate in Hz.
+ * @return The achieved frame rate in Hz, or 0 if the arguments are invalid, the rate is not achievable or DMA1
+ *         Channel1 is owned by another driver (nothing is started).
+ */
+uint32_t ADC_Scan_Timer_Init(const uint8_t *channels, uint8_t nbr, uint16_t *buf, uint16_t frames, uint32_t rate);
+
+/**
+ * @brief Stops the scan started by ADC_Scan_Init() or ADC_Scan_Timer_Init().
+ *
+ * @param void
+ * @return void
+ */
+void ADC_Scan_Stop(void);
+
+/**
+ * @brief Registers the callbacks called from the DMA interrupt when a half buffer is complete.
+ *
+ * The callbacks run in interrupt context and must finish before the DMA wraps around to the half
+ * they were given. Either callback may be NULL.
+ *
+ * @param half_cb Called with the first half after the half-transfer interrupt.
+ * @param full_cb Called with the second half after the transfer-complete interrupt.
+ * @return void
+ */
+void ADC_Scan_Set_Callback(ADC_Block_Callback half_cb, ADC_Block_Callback full_cb);
+
+/**
+ * @brief Returns the most recently completed half buffer without blocking.
+ *
+ * The block stays valid until the DMA wraps around to it again, i.e. for one half-buffer period.
+ * Comparing seq between calls tells whether a new block arrived (difference 1) or blocks were missed (> 1).
+ *
+ * @param seq Receives the number of halves completed so far; may be NULL.
+ * @return The latest block of frames * nbr samples, or NULL if no half has completed yet.
+ */
+const uint16_t *ADC_Scan_Get_Latest(uint32_t *seq);
+
+/**
+ * @brief Enables the ADC1 analog watchdog with a software hysteresis layer.
+ *
+ * The hardware compares every conversion of the guarded channel against a window and raises the ADC interrupt
+ * only when a result falls outside it, so the core can sleep (e.g. __WFI()) while the input stays in range.
+ * The STM32F1 has a single watchdog window, which guards either one channel or all regular channels. The watchdog
+ * only observes conversions, so the ADC must be running, for example through ADC_Scan_Init() or
+ * ADC_Scan_Timer_Init(); call this function after starting it. During a scan the state is decided from the
+ * guarded channel's newest sample in the scan buffer, since the data register already holds a later rank when
+ * the interrupt runs.
+ *
+ * With all channels of a scan guarded, every channel has its own state, hysteresis and, through
+ * ADC_AWD_Set_Channel_Limits(), range. The hardware window stays at the intersection of the ranges; once a result
+ * leaves it, the interrupt is masked and the scan buffer is classified in software as each half buffer completes,
+ * until every channel is normal and inside the window again. A channel that stays out of range therefore costs
+ * no interrupts beyond the scan's own DMA interrupts, and the callback only runs when a channel changes state.
+ *
+ * @param ch The guarded ADC channel, or ADC_AWD_ALL_CHANNELS for every regular channel.
+ * @param low Results below low are reported as ADC_AWD_Low.
+ * @param high Results above high are reported as ADC_AWD_High.
+ * @param hyst How far the input must move back inside the range before ADC_AWD_Normal is reported; 0 for none.
+ * @param cb Called from the ADC or scan DMA interrupt on every state change of a channel; may be NULL to only
+ *        poll ADC_AWD_Get_State().
+ * @return void
+ */
+void ADC_AWD_Init(uint8_t ch, uint16_t low, uint16_t high, uint16_t hyst, ADC_AWD_Callback cb);
+
+/**
+ * @brief Disables the analog watchdog and its interrupt.
+ *
+ * @param void
+ * @return void
+ */
+void ADC_AWD_Disable(void);
+
+/**
+ * @brief Sets the normal range of one channel when all channels of a scan are guarded.
+ *
+ * The new range applies from the newest frame on: the channel's state is decided again against it right away,
+ * and the callback is called if it changes.
+ *
+ * @param ch The ADC channel; every rank that converts it gets the range.
+ * @param low Results below low are reported as ADC_AWD_Low.
+ * @param high Results above high are reported as ADC_AWD_High.
+ * @return 1 on success, 0 if the watchdog does not guard all channels of a scan or ch is not scanned.
+ */
+uint8_t ADC_AWD_Set_Channel_Limits(uint8_t ch, uint16_t low, uint16_t high);
+
+/**
+ * @brief Returns the current state of the guarded input.
+ *
+ * With all channels of a scan guarded this is the worst state over all channels: ADC_AWD_High if any channel is
+ * high, else ADC_AWD_Low if any is low.
+ *
+ * @param void
+ * @return ADC_AWD_Normal, ADC_AWD_Low or ADC_AWD_High.
+ */
+ADC_AWD_State ADC_AWD_Get_State(void);
+
+/**
+ * @brief Returns the current state of one guarded channel.
+ *
+ * @param ch The ADC channel.
+ * @return Its state when all channels of a scan are guarded, otherwise the same as ADC_AWD_Get_State().
+ */
+ADC_AWD_State ADC_AWD_Get_Channel_State(uint8_t ch);
+
 #endif  // ADC_ADC_H_
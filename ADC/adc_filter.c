@@ -0,0 +1,219 @@
+/**
+ * @file adc_filter.c
+ * @brief Source file for the fixed-point ADC sample filters.
+ * @author Yixiang Fan
+ * @date 2024-08-08
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "adc_filter.h"
+
+/**
+ * @brief Initializes an oversampling + decimation filter.
+ *
+ * @param f The filter state.
+ * @param bits Extra bits of resolution, 1-4. One output is produced for every 4^bits inputs.
+ * @return void
+ */
+void ADC_Oversample_Init(ADC_Oversample_TypeDef *f, uint8_t bits) {
+    f->bits = bits;
+    f->count = 0;
+    f->acc = 0;
+}
+
+/**
+ * @brief Feeds a block of samples to an oversampling filter.
+ *
+ * Gaining n bits takes 4^n samples: their sum has 2n extra bits, of which n are dropped by the shift.
+ * The partial sum is kept between calls, so block sizes need not be multiples of 4^bits.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives the (12 + bits)-bit results; must hold len / 4^bits + 1 values.
+ * @return The number of results written to out.
+ */
+uint16_t ADC_Oversample_Process(ADC_Oversample_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride,
+                                uint16_t *out) {
+    uint16_t n = 1 << (2 * f->bits);  // Samples per output
+    uint16_t count = f->count;
+    uint32_t acc = f->acc;
+    uint16_t nout = 0;
+
+    while (len--) {
+        acc += *in;
+        in += stride;
+        if (++count == n) {
+            out[nout++] = (uint16_t)(acc >> f->bits);
+            acc = 0;
+            count = 0;
+        }
+    }
+
+    f->count = count;
+    f->acc = acc;
+    return nout;
+}
+
+/**
+ * @brief Initializes a moving average, pre-filling the window with an initial value.
+ *
+ * @param f The filter state.
+ * @param shift log2 of the window length, 0 to ADC_FILTER_MAVG_MAX_SHIFT.
+ * @param init The value the window starts with.
+ * @return void
+ */
+void ADC_MovAvg_Init(ADC_MovAvg_TypeDef *f, uint8_t shift, uint16_t init) {
+    uint8_t i;
+
+    f->shift = shift;
+    f->pos = 0;
+    for (i = 0; i < (1 << shift); ++i) {
+        f->ring[i] = init;
+    }
+    f->sum = (uint32_t)init << shift;
+}
+
+/**
+ * @brief Feeds a block of samples to a moving average and writes one output per input.
+ *
+ * Each sample replaces the oldest one in the ring and the running sum is corrected by their difference,
+ * so the cost per sample does not depend on the window length.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives len averages; may be NULL if only the final value is needed.
+ * @return The average after the last sample.
+ */
+uint16_t ADC_MovAvg_Process(ADC_MovAvg_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride,
+                            uint16_t *out) {
+    uint8_t mask = (uint8_t)((1 << f->shift) - 1);
+    uint8_t pos = f->pos;
+    uint32_t sum = f->sum;
+
+    while (len--) {
+        sum += *in;
+        sum -= f->ring[pos];
+        f->ring[pos] = *in;
+        pos = (pos + 1) & mask;
+        in += stride;
+        if (out) {
+            *out++ = (uint16_t)(sum >> f->shift);
+        }
+    }
+
+    f->pos = pos;
+    f->sum = sum;
+    return (uint16_t)(sum >> f->shift);
+}
+
+/**
+ * @brief Initializes a single-pole IIR low-pass filter.
+ *
+ * @param f The filter state.
+ * @param alpha The Q15 coefficient; smaller values smooth more. The time constant is about 32768 / alpha samples.
+ * @param init The initial output value.
+ * @return void
+ */
+void ADC_IIR_Init(ADC_IIR_TypeDef *f, int16_t alpha, uint16_t init) {
+    f->alpha = alpha;
+    f->y = (int32_t)init << 16;
+}
+
+/**
+ * @brief Feeds a block of samples to a single-pole IIR filter and writes one output per input.
+ *
+ * The output is kept with 16 fractional bits so that small alpha values still move it.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives len rounded outputs; may be NULL if only the final value is needed.
+ * @return The rounded output after the last sample.
+ */
+uint16_t ADC_IIR_Process(ADC_IIR_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride, uint16_t *out) {
+    int32_t alpha = f->alpha;
+    int32_t y = f->y;
+
+    while (len--) {
+        // y += alpha * (x - y), the product needs 64 bits (one SMULL on Cortex-M3)
+        y += (int32_t)((((int64_t)((int32_t)*in << 16) - y) * alpha) >> 15);
+        in += stride;
+        if (out) {
+            *out++ = (uint16_t)((y + 0x8000) >> 16);
+        }
+    }
+
+    f->y = y;
+    return (uint16_t)((y + 0x8000) >> 16);
+}
+
+/**
+ * @brief Initializes a median-of-N filter.
+ *
+ * @param f The filter state.
+ * @param n The window length, odd, 3 to ADC_FILTER_MEDIAN_MAX_N.
+ * @return void
+ */
+void ADC_Median_Init(ADC_Median_TypeDef *f, uint8_t n) {
+    f->n = n;
+    f->pos = 0;
+    f->fill = 0;
+}
+
+/**
+ * @brief Feeds a block of samples to a median filter and writes one output per input.
+ *
+ * The window is also kept sorted: every sample removes the oldest value from the sorted copy and inserts itself,
+ * which costs at most two passes over N values instead of a full sort.
+ * Until the window is full the median of the samples seen so far is returned.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives len medians; may be NULL if only the final value is needed.
+ * @return The median after the last sample.
+ */
+uint16_t ADC_Median_Process(ADC_Median_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride,
+                            uint16_t *out) {
+    uint16_t *s = f->sorted;
+    uint16_t x;
+    uint16_t med = 0;
+    uint8_t i;
+
+    while (len--) {
+        x = *in;
+        in += stride;
+
+        if (f->fill == f->n) {  // Window full, remove the oldest sample from the sorted copy
+            for (i = 0; s[i] != f->win[f->pos]; ++i) {
+            }
+            for (; i + 1 < f->n; ++i) {
+                s[i] = s[i + 1];
+            }
+        } else {
+            f->fill++;
+        }
+
+        for (i = f->fill - 1; i > 0 && s[i - 1] > x; --i) {  // Insert the new sample
+            s[i] = s[i - 1];
+        }
+        s[i] = x;
+
+        f->win[f->pos] = x;
+        if (++f->pos == f->n) {
+            f->pos = 0;
+        }
+
+        med = s[f->fill >> 1];
+        if (out) {
+            *out++ = med;
+        }
+    }
+    return med;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file adc_filter.h
+ * @brief Header file for the fixed-point ADC sample filters.
+ * @author Yixiang Fan
+ * @date 2024-08-08
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * All filters work on raw 12-bit right-aligned ADC samples and process a whole block per call, so they can be fed
+ * directly from the blocks of ADC_Scan_Init(). The stride parameter selects one channel out of an interleaved block:
+ * pass the channel count as stride and &block[rank] as input. No filter divides on the sample path; every scale
+ * factor is a power of two or a Q15 coefficient.
+ */
+
+#ifndef ADC_ADC_FILTER_H_
+#define ADC_ADC_FILTER_H_
+
+#include "system.h"
+
+#define ADC_FILTER_Q15_ONE 32768                    // 1.0 in Q15
+#define ADC_FILTER_TO_Q15(x) ((int16_t)((x) << 3))  // 12-bit sample to Q15 fraction of full scale
+#define ADC_FILTER_MAVG_MAX_SHIFT 6                 // Moving average of up to 2^6 = 64 samples
+#define ADC_FILTER_MEDIAN_MAX_N 9                   // Largest median window
+
+/**
+ * @brief Oversampling + decimation state: 4^bits samples are summed and shifted right by bits.
+ */
+typedef struct {
+    uint8_t bits;    // Extra resolution bits, 1-4, giving 13-16 bit results
+    uint16_t count;  // Samples accumulated so far in the current output
+    uint32_t acc;    // Running sum of the current output
+} ADC_Oversample_TypeDef;
+
+/**
+ * @brief Running-sum moving average over a ring of 2^shift samples.
+ */
+typedef struct {
+    uint8_t shift;                                  // log2 of the window length
+    uint8_t pos;                                    // Next ring slot to overwrite
+    uint32_t sum;                                   // Sum of the samples in the ring
+    uint16_t ring[1 << ADC_FILTER_MAVG_MAX_SHIFT];  // Window samples
+} ADC_MovAvg_TypeDef;
+
+/**
+ * @brief Single-pole IIR low-pass state, y += alpha * (x - y).
+ */
+typedef struct {
+    int16_t alpha;  // Q15 smoothing coefficient, 0 < alpha <= ADC_FILTER_Q15_ONE - 1
+    int32_t y;      // Filter output as sample << 16
+} ADC_IIR_TypeDef;
+
+/**
+ * @brief Median-of-N state over a sliding window.
+ */
+typedef struct {
+    uint8_t n;                                 // Window length, odd, 3 to ADC_FILTER_MEDIAN_MAX_N
+    uint8_t pos;                               // Next window slot to overwrite
+    uint8_t fill;                              // Valid samples in the window
+    uint16_t win[ADC_FILTER_MEDIAN_MAX_N];     // Window samples in arrival order
+    uint16_t sorted[ADC_FILTER_MEDIAN_MAX_N];  // The same samples in ascending order
+} ADC_Median_TypeDef;
+
+/**
+ * @brief Initializes an oversampling + decimation filter.
+ *
+ * @param f The filter state.
+ * @param bits Extra bits of resolution, 1-4. One output is produced for every 4^bits inputs.
+ * @return void
+ */
+void ADC_Oversample_Init(ADC_Oversample_TypeDef *f, uint8_t bits);
+
+/**
+ * @brief Feeds a block of samples to an oversampling filter.
+ *
+ * The partial sum is kept between calls, so block sizes need not be multiples of 4^bits.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives the (12 + bits)-bit results; must hold len / 4^bits + 1 values.
+ * @return The number of results written to out.
+ */
+uint16_t ADC_Oversample_Process(ADC_Oversample_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride,
+                                uint16_t *out);
+
+/**
+ * @brief Initializes a moving average, pre-filling the window with an initial value.
+ *
+ * @param f The filter state.
+ * @param shift log2 of the window length, 0 to ADC_FILTER_MAVG_MAX_SHIFT.
+ * @param init The value the window starts with.
+ * @return void
+ */
+void ADC_MovAvg_Init(ADC_MovAvg_TypeDef *f, uint8_t shift, uint16_t init);
+
+/**
+ * @brief Feeds a block of samples to a moving average and writes one output per input.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives len averages; may be NULL if only the final value is needed.
+ * @return The average after the last sample.
+ */
+uint16_t ADC_MovAvg_Process(ADC_MovAvg_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride,
+                            uint16_t *out);
+
+/**
+ * @brief Initializes a single-pole IIR low-pass filter.
+ *
+ * @param f The filter state.
+ * @param alpha The Q15 coefficient; smaller values smooth more. The time constant is about 32768 / alpha samples.
+ * @param init The initial output value.
+ * @return void
+ */
+void ADC_IIR_Init(ADC_IIR_TypeDef *f, int16_t alpha, uint16_t init);
+
+/**
+ * @brief Feeds a block of samples to a single-pole IIR filter and writes one output per input.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives len rounded outputs; may be NULL if only the final value is needed.
+ * @return The rounded output after the last sample.
+ */
+uint16_t ADC_IIR_Process(ADC_IIR_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride, uint16_t *out);
+
+/**
+ * @brief Initializes a median-of-N filter.
+ *
+ * @param f The filter state.
+ * @param n The window length, odd, 3 to ADC_FILTER_MEDIAN_MAX_N.
+ * @return void
+ */
+void ADC_Median_Init(ADC_Median_TypeDef *f, uint8_t n);
+
+/**
+ * @brief Feeds a block of samples to a median filter and writes one output per input.
+ *
+ * Until the window is full the median of the samples seen so far is returned.
+ *
+ * @param f The filter state.
+ * @param in The first input sample.
+ * @param len The number of input samples.
+ * @param stride The distance between consecutive input samples.
+ * @param out Receives len medians; may be NULL if only the final value is needed.
+ * @return The median after the last sample.
+ */
+uint16_t ADC_Median_Process(ADC_Median_TypeDef *f, const uint16_t *in, uint16_t len, uint16_t stride,
+                            uint16_t *out);
+
+#endif  // ADC_ADC_FILTER_H_
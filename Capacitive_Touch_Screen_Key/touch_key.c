@@ -7,6 +7,7 @@
  */
 
 #include "touch_key.h"
+#include "coro.h"
 #include "SysTick.h"
 #include "usart.h"
 
@@ -55,13 +56,15 @@ void TIM5_CH2_Input_Init(uint16_t arr, uint16_t psc) {
 }
 
 /**
- * @brief Resets the touch key by discharging the capacitor, then recharging it and reset the timer.
+ * @brief Starts discharging the capacitor by driving the touch pin low.
+ *
+ * The capacitor needs about 5 ms before Touch_Charge_Start() is called.
  *
  * @param None.
  *
  * @return None.
  */
-void Touch_Reset(void) {
+void Touch_Discharge(void) {
     GPIO_InitTypeDef GPIO_InitStructure;
 
     GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1;
@@ -70,15 +73,59 @@ void Touch_Reset(void) {
     GPIO_Init(GPIOA, &GPIO_InitStructure);
 
     GPIO_ResetBits(GPIOA, GPIO_Pin_0);  // Output 0 to discharge the capacitor
+}
+
+/**
+ * @brief Resets the timer and releases the touch pin so the capacitor starts charging.
+ *
+ * @param None.
+ *
+ * @return None.
+ */
+void Touch_Charge_Start(void) {
+    GPIO_InitTypeDef GPIO_InitStructure;
 
-    delay_ms(5);
     TIM_ClearFlag(TIM5, TIM_FLAG_CC2 | TIM_FLAG_Update);  // Clear the flag
     TIM_SetCounter(TIM5, 0);                              // Reset the counter
 
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1;
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;  // Floating input mode
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
     GPIO_Init(GPIOA, &GPIO_InitStructure);
 }
 
+/**
+ * @brief Checks without waiting whether the charge started by Touch_Charge_Start() has completed.
+ *
+ * @param val Receives the charging time, TIM5->CC2, or the counter value on timeout.
+ *
+ * @return 1 if the capacitor is charged or the timeout occurred, 0 if it is still charging.
+ */
+unit8_t Touch_Charge_Done(uint16_t *val) {
+    if (TIM_GetFlagStatus(TIM5, TIM_FLAG_CC2)) {  // Vcc captured, charging completed
+        *val = TIM_GetCapture2(TIM5);
+        return 1;
+    }
+    if (TIM_GetCounter(TIM5) > TOUCH_ARR_MAX_VAL - 500) {  // Timeout, return the counter value directly
+        *val = TIM_GetCounter(TIM5);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Resets the touch key by discharging the capacitor, then recharging it and reset the timer.
+ *
+ * @param None.
+ *
+ * @return None.
+ */
+void Touch_Reset(void) {
+    Touch_Discharge();
+    delay_ms(5);
+    Touch_Charge_Start();
+}
+
 /**
  * @brief Returns the captured high-level value after a touch event.
  *
@@ -92,15 +139,42 @@ void Touch_Reset(void) {
  * @return The captured high-level value after a touch event.
  */
 uint16_t Touch_Get_Val(void) {
+    uint16_t val;
+
     Touch_Reset();
-    // Wait for the capture of the Vcc meaning completing charging capacitor.
-    while (TIM_GetFlagStatus(TIM5, TIM_FLAG_CC2) == 0) {
-        // If the timeout occurs, return the current counter value directly.
-        if (TIM_GetCounter(TIM5) > TOUCH_ARR_MAX_VAL - 500) {
-            return TIM_GetCounter(TIM5);
-        }
+    while (!Touch_Charge_Done(&val)) {  // Wait for the capture of the Vcc meaning completing charging capacitor.
     }
-    return TIM_GetCapture2(TIM5);  // Return the captured high-level value
+    return val;
+}
+
+/**
+ * @brief Awaitable version of Touch_Get_Val(): measures the charging time without blocking.
+ *
+ * The 5 ms discharge and the charging itself are waited for by the coroutine instead of spinning.
+ *
+ * @param c The coroutine context of this measurement.
+ * @param val Receives the charging time, or the counter value on timeout, when the measurement is done.
+ *
+ * @return CORO_WAITING while measuring, CORO_DONE when val is valid.
+ */
+unit8_t Touch_Get_Val_Async(Coro_TypeDef *c, uint16_t *val) {
+    CORO_BEGIN(c);
+    Touch_Discharge();
+    CORO_DELAY_MS(c, 5);
+    Touch_Charge_Start();
+    CORO_WAIT_UNTIL(c, Touch_Charge_Done(val));
+    CORO_END(c);
+}
+
+/**
+ * @brief Returns whether a charging time counts as a touch.
+ *
+ * @param val The charging time.
+ *
+ * @return 1 if val is above touch_default_val + TOUCH_GATE_VAL and below 10 times touch_default_val, 0 otherwise.
+ */
+unit8_t Touch_Is_Touched(uint16_t val) {
+    return val > (touch_default_val + TOUCH_GATE_VAL) && val < (10 * touch_default_val);
 }
 
 /**
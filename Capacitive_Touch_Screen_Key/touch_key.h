@@ -11,13 +11,20 @@
 
 #include "system.h"
 
+struct Coro_TypeDef;  // Coroutine context, see coro.h
+
 extern uint16_t touch_default_val;  // Value of the touch key when it is not pressed
 
 void TIM2_CH1_Input_Init(unit32_t arr, uint16_t psc);
+void Touch_Discharge(void);
+void Touch_Charge_Start(void);
+unit8_t Touch_Charge_Done(uint16_t *val);
 void Touch_Reset(void);
 uint16_t Touch_Get_Val(void);
+unit8_t Touch_Get_Val_Async(struct Coro_TypeDef *c, uint16_t *val);
 unit8_t Touch_Key_Init(unit8_t psc);
 uint16_t Touch_Get_MaxVal(unit8_t n);
+unit8_t Touch_Is_Touched(uint16_t val);
 unit8_t Touch_Key_Scan(unit8_t mode);
 
 #endif  // CAPACITIVE_TOUCH_SCREEN_KEY_TOUCH_KEY_H_
@@ -0,0 +1,530 @@
+/**
+ * @file capture.c
+ * @brief Source file for the four-channel TIM5 input capture engine.
+ * @author Yixiang Fan
+ * @date 2024-08-13
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * A raw value is turned into a 32-bit timestamp by bracketing it. Every conversion reads the DMA write indexes and
+ * then the extended counter ("now"), so the values below the indexes were captured at or before now, and the
+ * values it leaves behind were captured at most a few cycles (the slack) before that now, which makes it the floor
+ * of the next conversion. If the previous timestamp of the ring is less than a counter period before now, only the
+ * 16-bit difference to it is added. Otherwise the timestamp is the earliest time at or after the floor with the
+ * same low 16 bits. Both are exact while the bracket is shorter than a counter period: the TIM5 update interrupt
+ * converts at the start of every period and the TIM7 update interrupt, which counts in step with TIM5 half a
+ * period behind, converts in the middle, so every bracket is half a period plus the interrupt latency long. No
+ * capture channel is spent on the extension, so all four can capture.
+ */
+
+#include "capture.h"
+#include "time.h"
+#include "dwt.h"
+
+#define CAPTURE_RAW_MASK (CAPTURE_RAW_SIZE - 1)
+#define CAPTURE_EDGE_MASK (CAPTURE_EDGE_SIZE - 1)
+#define CAPTURE_PARTNER 4          // Mode of a channel lent to the other channel of its pair for CAPTURE_BOTH
+#define CAPTURE_STARTING 5         // Mode of a channel being set up, not converted yet
+#define CAPTURE_SLACK_CYCLES 64    // Timer clocks from a capture to the counter read of a conversion that missed it
+#define CAPTURE_MID_PERIOD 0x8000  // TIM7 counter value while TIM5 starts, so TIM7 wraps mid-period
+
+typedef char capture_raw_size_must_be_a_power_of_two[(CAPTURE_RAW_SIZE & CAPTURE_RAW_MASK) == 0 ? 1 : -1];
+typedef char capture_edge_size_must_be_a_power_of_two[(CAPTURE_EDGE_SIZE & CAPTURE_EDGE_MASK) == 0 ? 1 : -1];
+
+/**
+ * @brief Rings and conversion state of one channel.
+ */
+typedef struct {
+    uint16_t raw[CAPTURE_RAW_SIZE];                // CCR values written by DMA, circular
+    uint16_t raw_tail;                             // Next raw value to convert
+    uint8_t primed;                                // 1 once last holds a timestamp
+    uint32_t last;                                 // Timestamp of the previous raw value
+    Capture_Edge_TypeDef edge[CAPTURE_EDGE_SIZE];  // The newest timestamps
+    uint32_t head;                                 // Edges written since the start
+    uint32_t tail;                                 // Edges read since the start
+    uint32_t dropped;                              // Edges lost before they were read
+    uint8_t mode;                                  // CAPTURE_* edges, CAPTURE_PARTNER, CAPTURE_STARTING, or 0 if off
+    uint8_t level;                                 // CAPTURE_BOTH: pin level after the latest edge
+} Capture_Channel_TypeDef;
+
+static DMA_Channel_TypeDef *const capture_dma[CAPTURE_CHANNELS] = {DMA2_Channel5, DMA2_Channel4, DMA2_Channel2,
+                                                                   DMA2_Channel1};
+static const uint16_t capture_tim_ch[CAPTURE_CHANNELS] = {TIM_Channel_1, TIM_Channel_2, TIM_Channel_3,
+                                                          TIM_Channel_4};
+static const uint16_t capture_dma_req[CAPTURE_CHANNELS] = {TIM_DMA_CC1, TIM_DMA_CC2, TIM_DMA_CC3, TIM_DMA_CC4};
+
+static Capture_Channel_TypeDef capture_ch[CAPTURE_CHANNELS];
+static volatile uint32_t capture_overflows;  // Counter periods since Capture_Init(), the high half of the time
+static uint32_t capture_floor;               // Extended counter value read by the latest conversion
+static uint16_t capture_slack;               // CAPTURE_SLACK_CYCLES in ticks, rounded up
+static uint32_t capture_tick_hz;             // Counter rate
+
+/**
+ * @brief Disables the DMA request, the capture and the DMA channel of a channel.
+ *
+ * @param i The channel index, 0-3.
+ * @return void
+ */
+static void Capture_Channel_Off(uint8_t i) {
+    TIM_DMACmd(TIM5, capture_dma_req[i], DISABLE);
+    TIM_CCxCmd(TIM5, capture_tim_ch[i], TIM_CCx_Disable);
+    DMA_Cmd(capture_dma[i], DISABLE);
+    capture_ch[i].mode = 0;
+}
+
+/**
+ * @brief Starts the DMA ring and the capture of a channel.
+ *
+ * @param i The channel index, 0-3.
+ * @param polarity TIM_ICPolarity_Rising or TIM_ICPolarity_Falling.
+ * @param selection TIM_ICSelection_DirectTI or TIM_ICSelection_IndirectTI.
+ * @param filter The input filter.
+ * @return void
+ */
+static void Capture_Channel_Setup(uint8_t i, uint16_t polarity, uint16_t selection, uint8_t filter) {
+    Capture_Channel_TypeDef *c = &capture_ch[i];
+    DMA_InitTypeDef DMA_InitStructure;
+    TIM_ICInitTypeDef TIM_ICInitStructure;
+
+    c->raw_tail = 0;
+    c->primed = 0;
+    c->head = 0;
+    c->tail = 0;
+    c->dropped = 0;
+
+    DMA_Cmd(capture_dma[i], DISABLE);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&TIM5->CCR1 + 4 * i;  // CCR1-CCR4 are consecutive
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)c->raw;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;  // Peripheral to memory
+    DMA_InitStructure.DMA_BufferSize = CAPTURE_RAW_SIZE;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;  // The ring never stops, the write index is size - CNDTR
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(capture_dma[i], &DMA_InitStructure);
+    DMA_Cmd(capture_dma[i], ENABLE);
+
+    TIM_ICInitStructure.TIM_Channel = capture_tim_ch[i];
+    TIM_ICInitStructure.TIM_ICFilter = filter;
+    TIM_ICInitStructure.TIM_ICPolarity = polarity;
+    TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;  // Every edge
+    TIM_ICInitStructure.TIM_ICSelection = selection;
+    TIM_ICInit(TIM5, &TIM_ICInitStructure);
+    TIM_DMACmd(TIM5, capture_dma_req[i], ENABLE);  // Every capture requests one transfer
+}
+
+/**
+ * @brief Starts TIM5 as the free-running capture time base.
+ *
+ * The counter runs over the full 16-bit range and its update interrupt extends it to 32 bits. TIM7 counts in step
+ * with it, half a period behind; both update interrupts convert the DMA rings, so the 32-bit timestamps are exact
+ * as long as neither interrupt runs more than about half a counter period late. A ring only overruns when more
+ * than CAPTURE_RAW_SIZE edges arrive within half a counter period between two reads.
+ *
+ * @param tick_hz The counter rate in Hz, from TIM_APB1_Clock() / 65536 up to TIM_APB1_Clock().
+ * @param preempt The preemption priority of the TIM5 and TIM7 interrupts.
+ * @param sub The subpriority of the TIM5 and TIM7 interrupts.
+ * @return The achieved counter rate in Hz, or 0 if the rate cannot be generated.
+ */
+uint32_t Capture_Init(uint32_t tick_hz, uint8_t preempt, uint8_t sub) {
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+    uint32_t clk = TIM_APB1_Clock();
+    uint32_t div;
+    uint8_t i;
+
+    if (tick_hz == 0 || tick_hz > clk) {
+        return 0;
+    }
+    div = (clk + tick_hz / 2) / tick_hz;  // Prescaler + 1, rounded
+    if (div > 0x10000) {
+        return 0;
+    }
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM5 | RCC_APB1Periph_TIM7, ENABLE);  // Enable TIM5 and TIM7 clocks
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);                          // Enable DMA2 clock
+
+    TIM_Cmd(TIM5, DISABLE);
+    TIM_Cmd(TIM7, DISABLE);
+    for (i = 0; i < CAPTURE_CHANNELS; ++i) {
+        Capture_Channel_Off(i);
+    }
+
+    TIM_TimeBaseInitStructure.TIM_Period = 0xffff;  // Full range, so values wrap like a uint16_t
+    TIM_TimeBaseInitStructure.TIM_Prescaler = div - 1;
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;  // Set up count mode
+    TIM_TimeBaseInit(TIM5, &TIM_TimeBaseInitStructure);
+    TIM_TimeBaseInit(TIM7, &TIM_TimeBaseInitStructure);  // Same period, so it stays half a period behind
+    TIM_SetCounter(TIM5, 0);
+    TIM_SetCounter(TIM7, CAPTURE_MID_PERIOD);
+    capture_overflows = 0;
+    capture_floor = 0;
+    capture_slack = CAPTURE_SLACK_CYCLES / div + 1;
+    capture_tick_hz = (clk + div / 2) / div;
+
+    TIM_ClearITPendingBit(TIM5, TIM_IT_Update);  // Set by the update event that loaded the prescaler
+    TIM_ClearITPendingBit(TIM7, TIM_IT_Update);
+    TIM_ITConfig(TIM5, TIM_IT_Update, ENABLE);
+    TIM_ITConfig(TIM7, TIM_IT_Update, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = TIM5_IRQn;                  // Interrupt channel
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = preempt;  // Preemption priority
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = sub;             // Subpriority
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;                  // Enable IRQ channel
+    NVIC_Init(&NVIC_InitStructure);
+    NVIC_InitStructure.NVIC_IRQChannel = TIM7_IRQn;  // Same priority, so the two never preempt each other
+    NVIC_Init(&NVIC_InitStructure);
+
+    TIM_Cmd(TIM5, ENABLE);  // Enable timers
+    TIM_Cmd(TIM7, ENABLE);
+    return capture_tick_hz;
+}
+
+/**
+ * @brief Starts capturing on a channel.
+ *
+ * The pin is configured as an input with pull-down. With CAPTURE_BOTH, the other channel of the pair must be
+ * free and stays busy until this channel is stopped.
+ *
+ * @param ch The channel, 1-4.
+ * @param edges CAPTURE_RISING, CAPTURE_FALLING or CAPTURE_BOTH.
+ * @param filter The input filter, 0x0-0xf as for TIM_ICFilter.
+ * @return 1 if capturing, 0 if the channel or its pair partner is busy or the arguments are invalid.
+ */
+uint8_t Capture_Start(uint8_t ch, uint8_t edges, uint8_t filter) {
+    GPIO_InitTypeDef GPIO_InitStructure;
+    uint8_t i = ch - 1;
+    uint32_t primask;
+
+    if (ch < 1 || ch > CAPTURE_CHANNELS || edges < CAPTURE_RISING || edges > CAPTURE_BOTH || filter > 0xf) {
+        return 0;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (capture_ch[i].mode || (edges == CAPTURE_BOTH && capture_ch[i ^ 1].mode)) {
+        __set_PRIMASK(primask);
+        return 0;  // Busy
+    }
+    capture_ch[i].mode = CAPTURE_STARTING;
+    if (edges == CAPTURE_BOTH) {
+        capture_ch[i ^ 1].mode = CAPTURE_STARTING;
+    }
+    __set_PRIMASK(primask);
+
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_0 << i;  // TIM5_CHx is on PAx-1
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IPD;   // Set pull-down input mode
+    GPIO_Init(GPIOA, &GPIO_InitStructure);
+
+    if (edges == CAPTURE_BOTH) {
+        capture_ch[i].level = GPIO_ReadInputDataBit(GPIOA, GPIO_Pin_0 << i);  // Before capturing starts
+        Capture_Channel_Setup(i ^ 1, TIM_ICPolarity_Falling, TIM_ICSelection_IndirectTI, filter);
+        Capture_Channel_Setup(i, TIM_ICPolarity_Rising, TIM_ICSelection_DirectTI, filter);
+    } else {
+        Capture_Channel_Setup(i, edges == CAPTURE_RISING ? TIM_ICPolarity_Rising : TIM_ICPolarity_Falling,
+                              TIM_ICSelection_DirectTI, filter);
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (edges == CAPTURE_BOTH) {
+        capture_ch[i ^ 1].mode = CAPTURE_PARTNER;
+    }
+    capture_ch[i].mode = edges;  // The update interrupt converts the ring from now on
+    __set_PRIMASK(primask);
+    return 1;
+}
+
+/**
+ * @brief Stops capturing on a channel and frees its pair partner if it was borrowed. Timestamps not read yet are
+ *        dropped.
+ *
+ * @param ch The channel, 1-4.
+ * @return void
+ */
+void Capture_Stop(uint8_t ch) {
+    uint8_t i = ch - 1;
+    uint32_t primask;
+
+    if (ch < 1 || ch > CAPTURE_CHANNELS || !capture_ch[i].mode || capture_ch[i].mode == CAPTURE_PARTNER) {
+        return;
+    }
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (capture_ch[i].mode == CAPTURE_BOTH) {
+        Capture_Channel_Off(i ^ 1);
+    }
+    Capture_Channel_Off(i);
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Returns the extended counter value.
+ *
+ * If the counter has wrapped but the update interrupt has not run yet, the pending period is added.
+ *
+ * @param void
+ * @return The 32-bit tick count since Capture_Init(), which wraps after 2^32 ticks.
+ */
+uint32_t Capture_Now(void) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t high;
+    uint16_t cnt;
+
+    __disable_irq();
+    high = capture_overflows;
+    cnt = TIM_GetCounter(TIM5);
+    if (TIM_GetFlagStatus(TIM5, TIM_FLAG_Update)) {  // Wrapped before or just after cnt was read
+        cnt = TIM_GetCounter(TIM5);
+        high++;
+    }
+    __set_PRIMASK(primask);
+    return high << 16 | cnt;
+}
+
+/**
+ * @brief Converts the next raw value of a ring into a timestamp.
+ *
+ * @param c The channel that owns the ring.
+ * @param now The extended counter value read after the write index.
+ * @param floor The earliest time the value can have been captured at.
+ * @return The timestamp.
+ */
+static uint32_t Capture_Extend(Capture_Channel_TypeDef *c, uint32_t now, uint32_t floor) {
+    uint16_t v = c->raw[c->raw_tail];
+    uint32_t stamp;
+
+    c->raw_tail = (c->raw_tail + 1) & CAPTURE_RAW_MASK;
+    if (c->primed && now - c->last <= 0xffff) {
+        stamp = c->last + (uint16_t)(v - (uint16_t)c->last);  // Within a counter period after the previous one
+    } else {
+        stamp = floor + (uint16_t)(v - (uint16_t)floor);  // Earliest time at or after the floor with these low bits
+    }
+    c->last = stamp;
+    c->primed = 1;
+    return stamp;
+}
+
+/**
+ * @brief Stores a timestamp, overwriting the oldest one when the ring is full.
+ *
+ * @param c The channel.
+ * @param stamp The timestamp.
+ * @param level The pin level after the edge.
+ * @return void
+ */
+static void Capture_Push(Capture_Channel_TypeDef *c, uint32_t stamp, uint8_t level) {
+    Capture_Edge_TypeDef *e = &c->edge[c->head & CAPTURE_EDGE_MASK];
+
+    e->stamp = stamp;
+    e->level = level;
+    c->head++;
+}
+
+/**
+ * @brief Converts everything the DMA has written so far into timestamps.
+ *
+ * Called from the update interrupt and, with interrupts disabled, from the API functions.
+ *
+ * @param void
+ * @return void
+ */
+static void Capture_Convert(void) {
+    uint16_t widx[CAPTURE_CHANNELS];
+    Capture_Channel_TypeDef *c;
+    Capture_Channel_TypeDef *src;
+    Capture_Channel_TypeDef *alt;
+    uint32_t now;
+    uint32_t floor = capture_floor - capture_slack;
+    uint8_t i;
+
+    for (i = 0; i < CAPTURE_CHANNELS; ++i) {
+        widx[i] = (CAPTURE_RAW_SIZE - DMA_GetCurrDataCounter(capture_dma[i])) & CAPTURE_RAW_MASK;
+    }
+    now = Capture_Now();  // After the indexes, so it bounds every value below them
+
+    for (i = 0; i < CAPTURE_CHANNELS; ++i) {
+        c = &capture_ch[i];
+        if (c->mode == CAPTURE_RISING || c->mode == CAPTURE_FALLING) {
+            while (c->raw_tail != widx[i]) {
+                Capture_Push(c, Capture_Extend(c, now, floor), c->mode == CAPTURE_RISING);
+            }
+        } else if (c->mode == CAPTURE_BOTH) {
+            // Edges alternate, so take them alternately from the rising ring and the falling ring of the partner.
+            // Stopping at the first missing one also keeps the order when an edge came in between the two
+            // index reads.
+            for (;;) {
+                src = c->level ? &capture_ch[i ^ 1] : c;
+                alt = c->level ? c : &capture_ch[i ^ 1];
+                if (src->raw_tail == widx[src - capture_ch]) {
+                    if (((widx[alt - capture_ch] - alt->raw_tail) & CAPTURE_RAW_MASK) < 2) {
+                        break;
+                    }
+                    c->level = !c->level;  // Two edges of one kind in a row: one edge was lost, resynchronize
+                    c->dropped++;
+                    continue;
+                }
+                c->level = !c->level;
+                Capture_Push(c, Capture_Extend(src, now, floor), c->level);
+            }
+        }
+    }
+    capture_floor = now;
+}
+
+/**
+ * @brief TIM5 interrupt handler: counts a counter period and converts the DMA rings.
+ *
+ * @param void
+ * @return void
+ */
+void TIM5_IRQHandler(void) {
+    DWT_PROF_BEGIN(tim5_irq);
+    if (TIM_GetITStatus(TIM5, TIM_IT_Update)) {
+        TIM_ClearITPendingBit(TIM5, TIM_IT_Update);  // Before counting, so Capture_Now() sees no pending period
+        capture_overflows++;
+        Capture_Convert();
+    }
+    DWT_PROF_END(tim5_irq);
+}
+
+/**
+ * @brief TIM7 interrupt handler: converts the DMA rings in the middle of every TIM5 period.
+ *
+ * This moves the floor half a period past the update conversion, so the next bracket stays shorter than a counter
+ * period even if the next update interrupt comes almost half a period late.
+ *
+ * @param void
+ * @return void
+ */
+void TIM7_IRQHandler(void) {
+    DWT_PROF_BEGIN(tim7_irq);
+    if (TIM_GetITStatus(TIM7, TIM_IT_Update)) {
+        TIM_ClearITPendingBit(TIM7, TIM_IT_Update);
+        Capture_Convert();
+    }
+    DWT_PROF_END(tim7_irq);
+}
+
+/**
+ * @brief Takes the oldest edges of a channel that have not been read yet.
+ *
+ * Only the newest CAPTURE_EDGE_SIZE edges are kept; older unread ones are counted by Capture_Dropped().
+ *
+ * @param ch The channel, 1-4.
+ * @param edges Receives up to max edges, oldest first.
+ * @param max The size of edges.
+ * @return The number of edges taken.
+ */
+uint16_t Capture_Read(uint8_t ch, Capture_Edge_TypeDef *edges, uint16_t max) {
+    Capture_Channel_TypeDef *c;
+    uint32_t primask;
+    uint16_t n = 0;
+
+    if (ch < 1 || ch > CAPTURE_CHANNELS) {
+        return 0;
+    }
+    c = &capture_ch[ch - 1];
+    primask = __get_PRIMASK();
+    __disable_irq();
+    Capture_Convert();
+    if (c->head - c->tail > CAPTURE_EDGE_SIZE) {
+        c->dropped += c->head - c->tail - CAPTURE_EDGE_SIZE;  // Overwritten before they were read
+        c->tail = c->head - CAPTURE_EDGE_SIZE;
+    }
+    while (n < max && c->tail != c->head) {
+        edges[n++] = c->edge[c->tail++ & CAPTURE_EDGE_MASK];
+    }
+    __set_PRIMASK(primask);
+    return n;
+}
+
+/**
+ * @brief Measures the signal on a channel over its newest periods, without taking any edges.
+ *
+ * The period and frequency come from the span of the window, so jitter averages out as the window grows. With
+ * CAPTURE_BOTH the window ends at the newest rising edge and the width and duty cycle cover the same periods.
+ *
+ * @param ch The channel, 1-4.
+ * @param window The number of periods to measure, 1 to CAPTURE_EDGE_SIZE / 2 with CAPTURE_BOTH, or to
+ *        CAPTURE_EDGE_SIZE - 1 otherwise; larger windows are clipped to the edges available.
+ * @param res Receives the measurement.
+ * @return 1 if at least one period was measured, 0 if not enough edges have been captured yet.
+ */
+uint8_t Capture_Measure(uint8_t ch, uint16_t window, Capture_Result_TypeDef *res) {
+    Capture_Edge_TypeDef e[CAPTURE_EDGE_SIZE];
+    Capture_Channel_TypeDef *c;
+    uint32_t primask;
+    uint32_t span;
+    uint32_t high = 0;
+    uint16_t n;
+    uint16_t k;
+    uint16_t first;
+    uint16_t end;
+    uint16_t periods;
+    uint8_t both;
+
+    if (ch < 1 || ch > CAPTURE_CHANNELS || window == 0) {
+        return 0;
+    }
+    c = &capture_ch[ch - 1];
+    primask = __get_PRIMASK();
+    __disable_irq();
+    Capture_Convert();
+    n = c->head < CAPTURE_EDGE_SIZE ? c->head : CAPTURE_EDGE_SIZE;
+    for (k = 0; k < n; ++k) {
+        e[k] = c->edge[(c->head - n + k) & CAPTURE_EDGE_MASK];  // Oldest first
+    }
+    both = c->mode == CAPTURE_BOTH;
+    __set_PRIMASK(primask);
+
+    end = n;  // One past the edge the window ends at
+    if (both) {
+        while (end && !e[end - 1].level) {
+            end--;  // End at the newest rising edge
+        }
+        periods = end ? (end - 1) / 2 : 0;
+    } else {
+        periods = n ? n - 1 : 0;
+    }
+    if (periods > window) {
+        periods = window;
+    }
+    if (periods == 0) {
+        return 0;
+    }
+    first = end - 1 - (both ? 2 * periods : periods);
+    span = e[end - 1].stamp - e[first].stamp;
+    if (span == 0) {
+        return 0;
+    }
+    if (both) {
+        for (k = first; k < end - 1; k += 2) {
+            high += e[k + 1].stamp - e[k].stamp;  // Rising edge to the following falling edge
+        }
+    }
+
+    res->period = (span + periods / 2) / periods;
+    res->width = (high + periods / 2) / periods;
+    res->duty = (uint16_t)(((uint64_t)high * 10000 + span / 2) / span);
+    res->freq_mhz = (uint32_t)(((uint64_t)periods * capture_tick_hz * 1000 + span / 2) / span);
+    res->periods = periods;
+    return 1;
+}
+
+/**
+ * @brief Returns the number of edges of a channel that were dropped before they were read.
+ *
+ * @param ch The channel, 1-4.
+ * @return The count since the channel was started.
+ */
+uint32_t Capture_Dropped(uint8_t ch) {
+    if (ch < 1 || ch > CAPTURE_CHANNELS) {
+        return 0;
+    }
+    return capture_ch[ch - 1].dropped;
+}
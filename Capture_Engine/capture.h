@@ -0,0 +1,134 @@
+/**
+ * @file capture.h
+ * @brief Header file for the four-channel TIM5 input capture engine.
+ * @author Yixiang Fan
+ * @date 2024-08-13
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * TIM5 counts freely over its full 16-bit range and every capture channel has a DMA2 channel in circular mode
+ * that copies each CCR value into a ring as soon as it is captured (CH1 -> Channel5, CH2 -> Channel4,
+ * CH3 -> Channel2, CH4 -> Channel1), so no edge costs an interrupt. The TIM5 update interrupt extends the counter
+ * to 32 bits; it and the TIM7 update interrupt, which counts in step half a period behind, convert the raw values
+ * into 32-bit timestamps twice per counter period, and the API functions convert the rest on demand. Timestamps,
+ * pulse widths, periods, duty cycles and frequencies are then read without polling any status bits.
+ *
+ * The STM32F1 timers cannot capture both edges on one channel, so CAPTURE_BOTH borrows the other channel of the
+ * pair (CH1 with CH2, CH3 with CH4), which captures the falling edges of the same pin.
+ *
+ * The engine owns TIM5, TIM7 and their interrupts, so it has its own directory: Input_Capture/input.c defines the
+ * same TIM5 interrupt handler, and a project builds one of the two.
+ */
+
+#ifndef CAPTURE_ENGINE_CAPTURE_H_
+#define CAPTURE_ENGINE_CAPTURE_H_
+
+#include "system.h"
+
+#define CAPTURE_CHANNELS 4    // TIM5 CH1-CH4 on PA0-PA3
+#define CAPTURE_RAW_SIZE 64   // DMA ring per channel, must be a power of two
+#define CAPTURE_EDGE_SIZE 32  // Timestamps kept per channel, must be a power of two
+
+// Edges passed to Capture_Start()
+#define CAPTURE_RISING 1
+#define CAPTURE_FALLING 2
+#define CAPTURE_BOTH 3  // Also uses the other channel of the pair
+
+/**
+ * @brief A captured edge.
+ */
+typedef struct {
+    uint32_t stamp;  // Extended counter value at the edge, in ticks
+    uint8_t level;   // Pin level after the edge, 1 for a rising edge
+} Capture_Edge_TypeDef;
+
+/**
+ * @brief Signal measurement over a window of periods.
+ */
+typedef struct {
+    uint32_t period;    // Mean period in ticks
+    uint32_t width;     // Mean high time in ticks, 0 unless both edges are captured
+    uint16_t duty;      // High time per period in 0.01 % steps, 0 unless both edges are captured
+    uint32_t freq_mhz;  // Frequency in millihertz
+    uint16_t periods;   // Number of periods measured, at most the requested window
+} Capture_Result_TypeDef;
+
+/**
+ * @brief Starts TIM5 as the free-running capture time base.
+ *
+ * The counter runs over the full 16-bit range and its update interrupt extends it to 32 bits. TIM7 counts in step
+ * with it, half a period behind; both update interrupts convert the DMA rings, so the 32-bit timestamps are exact
+ * as long as neither interrupt runs more than about half a counter period late. A ring only overruns when more
+ * than CAPTURE_RAW_SIZE edges arrive within half a counter period between two reads.
+ *
+ * @param tick_hz The counter rate in Hz, from TIM_APB1_Clock() / 65536 up to TIM_APB1_Clock().
+ * @param preempt The preemption priority of the TIM5 and TIM7 interrupts.
+ * @param sub The subpriority of the TIM5 and TIM7 interrupts.
+ * @return The achieved counter rate in Hz, or 0 if the rate cannot be generated.
+ */
+uint32_t Capture_Init(uint32_t tick_hz, uint8_t preempt, uint8_t sub);
+
+/**
+ * @brief Starts capturing on a channel.
+ *
+ * The pin is configured as an input with pull-down. With CAPTURE_BOTH, the other channel of the pair must be
+ * free and stays busy until this channel is stopped.
+ *
+ * @param ch The channel, 1-4.
+ * @param edges CAPTURE_RISING, CAPTURE_FALLING or CAPTURE_BOTH.
+ * @param filter The input filter, 0x0-0xf as for TIM_ICFilter.
+ * @return 1 if capturing, 0 if the channel or its pair partner is busy or the arguments are invalid.
+ */
+uint8_t Capture_Start(uint8_t ch, uint8_t edges, uint8_t filter);
+
+/**
+ * @brief Stops capturing on a channel and frees its pair partner if it was borrowed. Timestamps not read yet are
+ *        dropped.
+ *
+ * @param ch The channel, 1-4.
+ * @return void
+ */
+void Capture_Stop(uint8_t ch);
+
+/**
+ * @brief Returns the extended counter value.
+ *
+ * @param void
+ * @return The 32-bit tick count since Capture_Init(), which wraps after 2^32 ticks.
+ */
+uint32_t Capture_Now(void);
+
+/**
+ * @brief Takes the oldest edges of a channel that have not been read yet.
+ *
+ * Only the newest CAPTURE_EDGE_SIZE edges are kept; older unread ones are counted by Capture_Dropped().
+ *
+ * @param ch The channel, 1-4.
+ * @param edges Receives up to max edges, oldest first.
+ * @param max The size of edges.
+ * @return The number of edges taken.
+ */
+uint16_t Capture_Read(uint8_t ch, Capture_Edge_TypeDef *edges, uint16_t max);
+
+/**
+ * @brief Measures the signal on a channel over its newest periods, without taking any edges.
+ *
+ * The period and frequency come from the span of the window, so jitter averages out as the window grows. With
+ * CAPTURE_BOTH the window ends at the newest rising edge and the width and duty cycle cover the same periods.
+ *
+ * @param ch The channel, 1-4.
+ * @param window The number of periods to measure, 1 to CAPTURE_EDGE_SIZE / 2 with CAPTURE_BOTH, or to
+ *        CAPTURE_EDGE_SIZE - 1 otherwise; larger windows are clipped to the edges available.
+ * @param res Receives the measurement.
+ * @return 1 if at least one period was measured, 0 if not enough edges have been captured yet.
+ */
+uint8_t Capture_Measure(uint8_t ch, uint16_t window, Capture_Result_TypeDef *res);
+
+/**
+ * @brief Returns the number of edges of a channel that were dropped before they were read.
+ *
+ * @param ch The channel, 1-4.
+ * @return The count since the channel was started.
+ */
+uint32_t Capture_Dropped(uint8_t ch);
+
+#endif  // CAPTURE_ENGINE_CAPTURE_H_
@@ -1,4 +1,31 @@
+/**
+ * @file dma.c
+ * @brief Source file for the DMA1 channel manager and the single-transfer helpers.
+ * @author Yixiang Fan
+ * @date 2024-08-04
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
 #include "dma.h"
+#include "dwt.h"
+
+/**
+ * @brief State of one DMA1 channel.
+ */
+typedef struct {
+    uint8_t owned;           // 1 once allocated
+    DMA_Desc_TypeDef *head;  // Running descriptor, NULL if idle
+    DMA_Desc_TypeDef *tail;  // Last queued descriptor
+} DMA_Mgr_TypeDef;
+
+static DMA_Mgr_TypeDef dma_mgr[DMA_MGR_CHANNELS];
+
+static DMA_Channel_TypeDef *const dma_mgr_regs[DMA_MGR_CHANNELS] = {
+    DMA1_Channel1, DMA1_Channel2, DMA1_Channel3, DMA1_Channel4, DMA1_Channel5, DMA1_Channel6, DMA1_Channel7};
+
+static const uint8_t dma_mgr_irqn[DMA_MGR_CHANNELS] = {DMA1_Channel1_IRQn, DMA1_Channel2_IRQn, DMA1_Channel3_IRQn,
+                                                        DMA1_Channel4_IRQn, DMA1_Channel5_IRQn, DMA1_Channel6_IRQn,
+                                                        DMA1_Channel7_IRQn};
 
 void DMAx_Init(DMA_Channel_TypeDef* DMAy_Channelx, unit32_t par, unit32_t mar, uint16_t ndtr) {
     DMA_InitTypeDef  DMA_InitStructure;
@@ -25,3 +52,266 @@ void DMAx_Enable(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t ndtr) {
     DMA_SetCurrDataCounter(DMAy_Channelx, ndtr);
     DMA_Cmd(DMAy_Channelx, ENABLE);
 }
+
+/**
+ * @brief Claims a DMA1 channel and sets the priority of its interrupt.
+ *
+ * @param ch The channel, 1 to 7.
+ * @param preempt The preemption priority of the channel interrupt.
+ * @param sub The subpriority of the channel interrupt.
+ *
+ * @return 1 if the channel was free and is now owned by the caller, 0 if it is already in use.
+ */
+uint8_t DMA_Mgr_Alloc(uint8_t ch, uint8_t preempt, uint8_t sub) {
+    NVIC_InitTypeDef NVIC_InitStructure;
+    uint32_t primask;
+    uint8_t ok;
+
+    if (ch < 1 || ch > DMA_MGR_CHANNELS) {
+        return 0;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    ok = !dma_mgr[ch - 1].owned;
+    dma_mgr[ch - 1].owned = 1;
+    __set_PRIMASK(primask);
+    if (!ok) {
+        return 0;
+    }
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);  // Enable DMA1 clock
+    DMA_DeInit(dma_mgr_regs[ch - 1]);
+    dma_mgr[ch - 1].head = 0;
+    dma_mgr[ch - 1].tail = 0;
+
+    NVIC_InitStructure.NVIC_IRQChannel = dma_mgr_irqn[ch - 1];
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = preempt;  // Preemption priority
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = sub;             // Subpriority
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    return 1;
+}
+
+/**
+ * @brief Claims any free DMA1 channel, trying channel 7 first.
+ *
+ * Meant for memory-to-memory transfers, which can run on any channel.
+ *
+ * @param preempt The preemption priority of the channel interrupt.
+ * @param sub The subpriority of the channel interrupt.
+ *
+ * @return The channel number, or 0 if every channel is in use.
+ */
+uint8_t DMA_Mgr_Alloc_Any(uint8_t preempt, uint8_t sub) {
+    uint8_t ch;
+
+    for (ch = DMA_MGR_CHANNELS; ch >= 1; --ch) {
+        if (DMA_Mgr_Alloc(ch, preempt, sub)) {
+            return ch;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Stops a channel, drops its queue without callbacks and releases it.
+ *
+ * @param ch The channel, 1 to 7.
+ *
+ * @return void
+ */
+void DMA_Mgr_Free(uint8_t ch) {
+    uint32_t primask;
+
+    if (ch < 1 || ch > DMA_MGR_CHANNELS) {
+        return;
+    }
+
+    NVIC_DisableIRQ(dma_mgr_irqn[ch - 1]);
+    DMA_DeInit(dma_mgr_regs[ch - 1]);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    dma_mgr[ch - 1].head = 0;
+    dma_mgr[ch - 1].tail = 0;
+    dma_mgr[ch - 1].owned = 0;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Programs and enables the channel for a descriptor.
+ *
+ * @param ch The channel, 1 to 7.
+ * @param desc The descriptor.
+ *
+ * @return void
+ */
+static void DMA_Mgr_Start(uint8_t ch, DMA_Desc_TypeDef *desc) {
+    DMA_Channel_TypeDef *regs = dma_mgr_regs[ch - 1];
+
+    DMA_Cmd(regs, DISABLE);
+    DMA_Init(regs, &desc->init);
+    DMA_ITConfig(regs, DMA_IT_TC | DMA_IT_HT | DMA_IT_TE, DISABLE);  // DMA_Init() keeps the previous enables
+    DMA_ITConfig(regs, desc->half ? DMA_IT_TC | DMA_IT_TE | DMA_IT_HT : DMA_IT_TC | DMA_IT_TE, ENABLE);
+    DMA_Cmd(regs, ENABLE);
+}
+
+/**
+ * @brief Queues a descriptor on a channel, starting it at once if the channel is idle.
+ *
+ * May be called from thread or interrupt context, including from a callback of the same channel.
+ *
+ * @param ch The channel, 1 to 7, owned by the caller; other values are ignored.
+ * @param desc The descriptor.
+ *
+ * @return void
+ */
+void DMA_Mgr_Submit(uint8_t ch, DMA_Desc_TypeDef *desc) {
+    DMA_Mgr_TypeDef *m;
+    uint32_t primask;
+
+    if (ch < 1 || ch > DMA_MGR_CHANNELS) {
+        return;
+    }
+
+    m = &dma_mgr[ch - 1];
+    desc->next = 0;
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (m->head) {
+        m->tail->next = desc;
+        m->tail = desc;
+    } else {
+        m->head = desc;
+        m->tail = desc;
+        DMA_Mgr_Start(ch, desc);
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Returns whether a channel still has a running or queued descriptor.
+ *
+ * @param ch The channel, 1 to 7.
+ *
+ * @return 1 if busy, 0 if idle or the channel is invalid.
+ */
+uint8_t DMA_Mgr_Busy(uint8_t ch) {
+    if (ch < 1 || ch > DMA_MGR_CHANNELS) {
+        return 0;
+    }
+    return dma_mgr[ch - 1].head != 0;
+}
+
+/**
+ * @brief Returns the DMA1 channel registers for a channel number.
+ *
+ * @param ch The channel, 1 to 7.
+ *
+ * @return The channel registers, or NULL if the channel is invalid.
+ */
+DMA_Channel_TypeDef *DMA_Mgr_Channel(uint8_t ch) {
+    if (ch < 1 || ch > DMA_MGR_CHANNELS) {
+        return 0;
+    }
+    return dma_mgr_regs[ch - 1];
+}
+
+/**
+ * @brief Handles the interrupt of one channel.
+ *
+ * A finished or failed descriptor is removed and the next one is started before its callback runs, so the
+ * channel is idle only for the time it takes to reprogram it. Circular descriptors stay at the head of the queue
+ * and report DMA_EVT_TC at the end of every cycle. An interrupt that runs so late that both halves have ended
+ * reports DMA_EVT_HT before DMA_EVT_TC.
+ *
+ * @param ch The channel, 1 to 7.
+ *
+ * @return void
+ */
+static void DMA_Mgr_IRQ(uint8_t ch) {
+    DMA_Mgr_TypeDef *m = &dma_mgr[ch - 1];
+    DMA_Desc_TypeDef *d = m->head;
+    uint32_t shift = 4 * (ch - 1);
+    uint32_t isr = (DMA1->ISR >> shift) & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1 | DMA_ISR_TEIF1);
+    uint8_t done = 0;
+
+    DMA1->IFCR = (isr | DMA_ISR_GIF1) << shift;  // Clear the flags that are handled here
+    if (!d) {
+        return;
+    }
+
+    if (isr & DMA_ISR_TEIF1) {
+        done = DMA_EVT_TE;
+    } else if ((isr & DMA_ISR_TCIF1) && d->init.DMA_Mode != DMA_Mode_Circular) {
+        done = DMA_EVT_TC;
+    }
+
+    if (done) {
+        m->head = d->next;
+        if (m->head) {
+            DMA_Mgr_Start(ch, m->head);
+        } else {
+            DMA_Cmd(dma_mgr_regs[ch - 1], DISABLE);
+        }
+        if (d->cb && done == DMA_EVT_TC && d->half && (isr & DMA_ISR_HTIF1)) {
+            d->cb(d, DMA_EVT_HT);  // Both halves ended before the interrupt ran
+        }
+        if (d->cb) {
+            d->cb(d, done);
+        }
+        return;
+    }
+
+    if (d->cb) {
+        if (isr & DMA_ISR_HTIF1) {
+            d->cb(d, DMA_EVT_HT);
+        }
+        if (isr & DMA_ISR_TCIF1) {
+            d->cb(d, DMA_EVT_TC);  // End of a circular cycle
+        }
+    }
+}
+
+void DMA1_Channel1_IRQHandler(void) {
+    DWT_PROF_BEGIN(dma1_ch1_irq);
+    DMA_Mgr_IRQ(1);
+    DWT_PROF_END(dma1_ch1_irq);
+}
+
+void DMA1_Channel2_IRQHandler(void) {
+    DWT_PROF_BEGIN(dma1_ch2_irq);
+    DMA_Mgr_IRQ(2);
+    DWT_PROF_END(dma1_ch2_irq);
+}
+
+void DMA1_Channel3_IRQHandler(void) {
+    DWT_PROF_BEGIN(dma1_ch3_irq);
+    DMA_Mgr_IRQ(3);
+    DWT_PROF_END(dma1_ch3_irq);
+}
+
+void DMA1_Channel4_IRQHandler(void) {
+    DWT_PROF_BEGIN(dma1_ch4_irq);
+    DMA_Mgr_IRQ(4);
+    DWT_PROF_END(dma1_ch4_irq);
+}
+
+void DMA1_Channel5_IRQHandler(void) {
+    DWT_PROF_BEGIN(dma1_ch5_irq);
+    DMA_Mgr_IRQ(5);
+    DWT_PROF_END(dma1_ch5_irq);
+}
+
+void DMA1_Channel6_IRQHandler(void) {
+    DWT_PROF_BEGIN(dma1_ch6_irq);
+    DMA_Mgr_IRQ(6);
+    DWT_PROF_END(dma1_ch6_irq);
+}
+
+void DMA1_Channel7_IRQHandler(void) {
+    DWT_PROF_BEGIN(dma1_ch7_irq);
+    DMA_Mgr_IRQ(7);
+    DWT_PROF_END(dma1_ch7_irq);
+}
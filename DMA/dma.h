@@ -1,8 +1,52 @@
+/**
+ * @file dma.h
+ * @brief Header file for the DMA1 channel manager and the single-transfer helpers.
+ * @author Yixiang Fan
+ * @date 2024-08-04
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Drivers allocate a DMA1 channel with DMA_Mgr_Alloc() and queue transfer descriptors on it with
+ * DMA_Mgr_Submit(). The manager owns every DMA1 channel interrupt: it starts the next queued descriptor from the
+ * transfer-complete interrupt and reports completion through the descriptor's callback, so no driver polls
+ * DMA_GetFlagStatus() or defines its own DMA1 interrupt handler.
+ */
+
 #ifndef DMA_DMA_H_
 #define DMA_DMA_H_
 
 #include "system.h"
 
+#define DMA_MGR_CHANNELS 7  // DMA1 channels 1-7
+
+// Events passed to DMA_Callback
+#define DMA_EVT_HT 0x01  // First half transferred (only for descriptors with half = 1)
+#define DMA_EVT_TC 0x02  // Transfer complete; for circular descriptors, end of every cycle
+#define DMA_EVT_TE 0x04  // Transfer error, the descriptor is dropped
+
+typedef struct DMA_Desc_TypeDef DMA_Desc_TypeDef;
+
+/**
+ * @brief Callback type for descriptor events, called from the DMA interrupt.
+ *
+ * @param desc The descriptor the event belongs to.
+ * @param event DMA_EVT_HT, DMA_EVT_TC or DMA_EVT_TE.
+ */
+typedef void (*DMA_Callback)(DMA_Desc_TypeDef *desc, uint8_t event);
+
+/**
+ * @brief A queued transfer.
+ *
+ * init holds the direction, widths, increments, priority, mode (DMA_Mode_Circular for a transfer that never
+ * completes) and M2M setting exactly as for DMA_Init(). The descriptor belongs to the manager from
+ * DMA_Mgr_Submit() until its DMA_EVT_TC or DMA_EVT_TE callback and must stay valid until then.
+ */
+struct DMA_Desc_TypeDef {
+    DMA_InitTypeDef init;    // Transfer setup
+    uint8_t half;            // 1 to also call back at half transfer
+    DMA_Callback cb;         // Event callback, may be NULL
+    void *arg;               // User data for the callback
+    DMA_Desc_TypeDef *next;  // Queue link, owned by the manager
+};
 
 /**
  * @brief DMA initialization function.
@@ -30,4 +74,66 @@ void DMAx_Init(DMA_Channel_TypeDef* DMAy_Channelx, unit32_t par, unit32_t mar, u
  */
 void DMAx_Enable(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t ndtr);
 
+/**
+ * @brief Claims a DMA1 channel and sets the priority of its interrupt.
+ *
+ * @param ch The channel, 1 to 7.
+ * @param preempt The preemption priority of the channel interrupt.
+ * @param sub The subpriority of the channel interrupt.
+ *
+ * @return 1 if the channel was free and is now owned by the caller, 0 if it is already in use.
+ */
+uint8_t DMA_Mgr_Alloc(uint8_t ch, uint8_t preempt, uint8_t sub);
+
+/**
+ * @brief Claims any free DMA1 channel, trying channel 7 first.
+ *
+ * Meant for memory-to-memory transfers, which can run on any channel.
+ *
+ * @param preempt The preemption priority of the channel interrupt.
+ * @param sub The subpriority of the channel interrupt.
+ *
+ * @return The channel number, or 0 if every channel is in use.
+ */
+uint8_t DMA_Mgr_Alloc_Any(uint8_t preempt, uint8_t sub);
+
+/**
+ * @brief Stops a channel, drops its queue without callbacks and releases it.
+ *
+ * @param ch The channel, 1 to 7.
+ *
+ * @return void
+ */
+void DMA_Mgr_Free(uint8_t ch);
+
+/**
+ * @brief Queues a descriptor on a channel, starting it at once if the channel is idle.
+ *
+ * May be called from thread or interrupt context, including from a callback of the same channel.
+ *
+ * @param ch The channel, 1 to 7, owned by the caller; other values are ignored.
+ * @param desc The descriptor.
+ *
+ * @return void
+ */
+void DMA_Mgr_Submit(uint8_t ch, DMA_Desc_TypeDef *desc);
+
+/**
+ * @brief Returns whether a channel still has a running or queued descriptor.
+ *
+ * @param ch The channel, 1 to 7.
+ *
+ * @return 1 if busy, 0 if idle or the channel is invalid.
+ */
+uint8_t DMA_Mgr_Busy(uint8_t ch);
+
+/**
+ * @brief Returns the DMA1 channel registers for a channel number.
+ *
+ * @param ch The channel, 1 to 7.
+ *
+ * @return The channel registers, or NULL if the channel is invalid.
+ */
+DMA_Channel_TypeDef *DMA_Mgr_Channel(uint8_t ch);
+
 #endif  // DMA_DMA_H_
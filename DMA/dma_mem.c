@@ -0,0 +1,410 @@
+/**
+ * @file dma_mem.c
+ * @brief Source file for memory copy and fill through DMA1 memory-to-memory transfers.
+ * @author Yixiang Fan
+ * @date 2024-08-04
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "dma_mem.h"
+#include "dwt.h"
+
+#define DMA_MEM_MAX_ITEMS 0xffff  // Largest CNDTR value, longer operations are split into chunks
+
+static uint8_t dma_mem_ch;                              // DMA1 channel used, 0 for none
+static uint32_t dma_mem_threshold = DMA_MEM_THRESHOLD;  // Smallest size handled by the DMA
+
+/**
+ * @brief Copies bytes with the CPU, a word at a time when source and destination share their word alignment.
+ *
+ * @param d The destination.
+ * @param s The source.
+ * @param n The number of bytes.
+ *
+ * @return void
+ */
+static void DMA_Mem_CPU_Copy(uint8_t *d, const uint8_t *s, uint32_t n) {
+    uint32_t *dw;
+    const uint32_t *sw;
+
+    if ((((uint32_t)d ^ (uint32_t)s) & 3) == 0) {
+        while (((uint32_t)d & 3) && n) {
+            *d++ = *s++;
+            n--;
+        }
+        dw = (uint32_t *)d;
+        sw = (const uint32_t *)s;
+        for (; n >= 16; n -= 16) {  // Unrolled to keep loop overhead small
+            dw[0] = sw[0];
+            dw[1] = sw[1];
+            dw[2] = sw[2];
+            dw[3] = sw[3];
+            dw += 4;
+            sw += 4;
+        }
+        for (; n >= 4; n -= 4) {
+            *dw++ = *sw++;
+        }
+        d = (uint8_t *)dw;
+        s = (const uint8_t *)sw;
+    }
+    while (n--) {
+        *d++ = *s++;
+    }
+}
+
+/**
+ * @brief Fills bytes with the CPU, a word at a time once the destination is word aligned.
+ *
+ * @param d The destination.
+ * @param c The fill byte.
+ * @param n The number of bytes.
+ *
+ * @return void
+ */
+static void DMA_Mem_CPU_Fill(uint8_t *d, uint8_t c, uint32_t n) {
+    uint32_t w = c * 0x01010101u;
+    uint32_t *dw;
+
+    while (((uint32_t)d & 3) && n) {
+        *d++ = c;
+        n--;
+    }
+    dw = (uint32_t *)d;
+    for (; n >= 16; n -= 16) {
+        dw[0] = w;
+        dw[1] = w;
+        dw[2] = w;
+        dw[3] = w;
+        dw += 4;
+    }
+    for (; n >= 4; n -= 4) {
+        *dw++ = w;
+    }
+    d = (uint8_t *)dw;
+    while (n--) {
+        *d++ = c;
+    }
+}
+
+/**
+ * @brief Finishes an operation and calls its callback.
+ *
+ * @param h The handle of the operation.
+ *
+ * @return void
+ */
+static void DMA_Mem_Finish(DMA_Mem_TypeDef *h) {
+    h->busy = 0;
+    if (h->cb) {
+        h->cb(h);
+    }
+}
+
+/**
+ * @brief Queues the next chunk of at most DMA_MEM_MAX_ITEMS items.
+ *
+ * @param h The handle of the operation.
+ *
+ * @return void
+ */
+static void DMA_Mem_Next(DMA_Mem_TypeDef *h) {
+    uint32_t items = h->left > DMA_MEM_MAX_ITEMS ? DMA_MEM_MAX_ITEMS : h->left;
+
+    h->desc.init.DMA_PeripheralBaseAddr = h->src;  // In M2M mode the "peripheral" side is the source
+    h->desc.init.DMA_MemoryBaseAddr = h->dst;
+    h->desc.init.DMA_BufferSize = items;
+    h->left -= items;
+    h->dst += items * h->width;
+    if (h->desc.init.DMA_PeripheralInc == DMA_PeripheralInc_Enable) {
+        h->src += items * h->width;
+    }
+    DMA_Mgr_Submit(dma_mem_ch, &h->desc);
+}
+
+/**
+ * @brief DMA manager callback, queues the next chunk or finishes the operation.
+ *
+ * @param desc The descriptor of the chunk that ended.
+ * @param event DMA_EVT_TC or DMA_EVT_TE.
+ *
+ * @return void
+ */
+static void DMA_Mem_Event(DMA_Desc_TypeDef *desc, uint8_t event) {
+    DMA_Mem_TypeDef *h = (DMA_Mem_TypeDef *)desc->arg;
+
+    if (event == DMA_EVT_TC && h->left) {
+        DMA_Mem_Next(h);
+    } else {
+        h->left = 0;  // Done, or a bus error that ends the operation early
+        DMA_Mem_Finish(h);
+    }
+}
+
+/**
+ * @brief Sets up the descriptor of an operation whose src, dst, left and width are set, and starts it.
+ *
+ * @param h The handle of the operation.
+ * @param src_inc DMA_PeripheralInc_Enable for a copy, DMA_PeripheralInc_Disable for a fill.
+ *
+ * @return void
+ */
+static void DMA_Mem_Start(DMA_Mem_TypeDef *h, uint32_t src_inc) {
+    static const uint32_t psize[5] = {0, DMA_PeripheralDataSize_Byte, DMA_PeripheralDataSize_HalfWord, 0,
+                                      DMA_PeripheralDataSize_Word};
+    static const uint32_t msize[5] = {0, DMA_MemoryDataSize_Byte, DMA_MemoryDataSize_HalfWord, 0,
+                                      DMA_MemoryDataSize_Word};
+
+    if (h->left == 0) {
+        DMA_Mem_Finish(h);
+        return;
+    }
+    h->desc.init.DMA_DIR = DMA_DIR_PeripheralSRC;
+    h->desc.init.DMA_PeripheralInc = src_inc;
+    h->desc.init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    h->desc.init.DMA_PeripheralDataSize = psize[h->width];
+    h->desc.init.DMA_MemoryDataSize = msize[h->width];
+    h->desc.init.DMA_Mode = DMA_Mode_Normal;
+    h->desc.init.DMA_Priority = DMA_Priority_Low;  // Peripheral streams go first
+    h->desc.init.DMA_M2M = DMA_M2M_Enable;
+    h->desc.half = 0;
+    h->desc.cb = DMA_Mem_Event;
+    h->desc.arg = h;
+    DMA_Mem_Next(h);
+}
+
+/**
+ * @brief Starts a copy through the DMA regardless of the threshold.
+ *
+ * The widest item size the common alignment allows is used; the bytes before the first aligned address and the
+ * bytes that do not fill a last item are copied by the CPU at once.
+ *
+ * @param h The handle of the operation.
+ * @param d The destination.
+ * @param s The source.
+ * @param len The number of bytes.
+ *
+ * @return void
+ */
+static void DMA_Mem_Copy_DMA(DMA_Mem_TypeDef *h, uint8_t *d, const uint8_t *s, uint32_t len) {
+    uint32_t mis = (uint32_t)d ^ (uint32_t)s;
+    uint8_t w = (mis & 3) == 0 ? 4 : (mis & 1) == 0 ? 2 : 1;
+    uint32_t head = (w - ((uint32_t)d & (w - 1))) & (w - 1);
+    uint32_t tail;
+
+    if (head > len) {
+        head = len;
+    }
+    DMA_Mem_CPU_Copy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+    tail = len & (w - 1);
+    DMA_Mem_CPU_Copy(d + len - tail, s + len - tail, tail);
+
+    h->busy = 1;
+    h->src = (uint32_t)s;
+    h->dst = (uint32_t)d;
+    h->left = len / w;
+    h->width = w;
+    DMA_Mem_Start(h, DMA_PeripheralInc_Enable);
+}
+
+/**
+ * @brief Takes a DMA1 channel for memory transfers.
+ *
+ * Without this call, or if every channel is in use, all operations fall back to the CPU.
+ *
+ * @return The channel taken, or 0 if none is free.
+ */
+uint8_t DMA_Mem_Init(void) {
+    if (!dma_mem_ch) {
+        dma_mem_ch = DMA_Mgr_Alloc_Any(3, 3);  // Lowest priority, completion is never urgent
+    }
+    return dma_mem_ch;
+}
+
+/**
+ * @brief Sets the size from which the DMA is used instead of the CPU.
+ *
+ * @param bytes The threshold in bytes; see DMA_Mem_Calibrate() to measure it.
+ *
+ * @return void
+ */
+void DMA_Mem_Set_Threshold(uint32_t bytes) {
+    dma_mem_threshold = bytes;
+}
+
+/**
+ * @brief Starts copying len bytes from src to dst and returns at once.
+ *
+ * The areas must not overlap. Below the threshold the copy is done by the CPU before returning and cb is
+ * called from this function.
+ *
+ * @param h The handle of the operation.
+ * @param dst The destination.
+ * @param src The source.
+ * @param len The number of bytes.
+ * @param cb Called when the copy is done, may be NULL.
+ *
+ * @return void
+ */
+void DMA_Memcpy_Async(DMA_Mem_TypeDef *h, void *dst, const void *src, uint32_t len, DMA_Mem_Callback cb) {
+    h->cb = cb;
+    if (!dma_mem_ch || len < dma_mem_threshold) {
+        DMA_Mem_CPU_Copy((uint8_t *)dst, (const uint8_t *)src, len);
+        h->left = 0;
+        DMA_Mem_Finish(h);
+        return;
+    }
+    DMA_Mem_Copy_DMA(h, (uint8_t *)dst, (const uint8_t *)src, len);
+}
+
+/**
+ * @brief Starts filling len bytes at dst with c and returns at once.
+ *
+ * Below the threshold the fill is done by the CPU before returning and cb is called from this function.
+ *
+ * @param h The handle of the operation.
+ * @param dst The destination.
+ * @param c The fill byte.
+ * @param len The number of bytes.
+ * @param cb Called when the fill is done, may be NULL.
+ *
+ * @return void
+ */
+void DMA_Memset_Async(DMA_Mem_TypeDef *h, void *dst, uint8_t c, uint32_t len, DMA_Mem_Callback cb) {
+    uint8_t *d = (uint8_t *)dst;
+    uint32_t head = (4 - ((uint32_t)d & 3)) & 3;
+    uint32_t tail;
+
+    h->cb = cb;
+    if (!dma_mem_ch || len < dma_mem_threshold) {
+        DMA_Mem_CPU_Fill(d, c, len);
+        h->left = 0;
+        DMA_Mem_Finish(h);
+        return;
+    }
+
+    if (head > len) {
+        head = len;
+    }
+    DMA_Mem_CPU_Fill(d, c, head);
+    d += head;
+    len -= head;
+    tail = len & 3;
+    DMA_Mem_CPU_Fill(d + len - tail, c, tail);
+
+    h->busy = 1;
+    h->fill = c * 0x01010101u;
+    h->src = (uint32_t)&h->fill;  // Fixed source word
+    h->dst = (uint32_t)d;
+    h->left = len / 4;
+    h->width = 4;
+    DMA_Mem_Start(h, DMA_PeripheralInc_Disable);
+}
+
+/**
+ * @brief Returns whether an asynchronous operation is done.
+ *
+ * @param h The handle of the operation.
+ *
+ * @return 1 if done, 0 if still running.
+ */
+uint8_t DMA_Mem_Done(const DMA_Mem_TypeDef *h) {
+    return !h->busy;
+}
+
+/**
+ * @brief Waits for an asynchronous operation to finish.
+ *
+ * @param h The handle of the operation.
+ *
+ * @return void
+ */
+void DMA_Mem_Wait(const DMA_Mem_TypeDef *h) {
+    while (h->busy) {
+    }
+}
+
+/**
+ * @brief Copies len bytes from src to dst and waits for the end of the copy.
+ *
+ * @param dst The destination.
+ * @param src The source.
+ * @param len The number of bytes.
+ *
+ * @return dst
+ */
+void *DMA_Memcpy(void *dst, const void *src, uint32_t len) {
+    DMA_Mem_TypeDef h;
+
+    DMA_Memcpy_Async(&h, dst, src, len, 0);
+    DMA_Mem_Wait(&h);
+    return dst;
+}
+
+/**
+ * @brief Fills len bytes at dst with c and waits for the end of the fill.
+ *
+ * @param dst The destination.
+ * @param c The fill byte.
+ * @param len The number of bytes.
+ *
+ * @return dst
+ */
+void *DMA_Memset(void *dst, uint8_t c, uint32_t len) {
+    DMA_Mem_TypeDef h;
+
+    DMA_Memset_Async(&h, dst, c, len, 0);
+    DMA_Mem_Wait(&h);
+    return dst;
+}
+
+/**
+ * @brief Measures the CPU and the DMA copy time for growing sizes and sets the threshold to the crossover.
+ *
+ * Sizes from 8 bytes up to max_len are tried, doubling each time; the threshold becomes the first size at which
+ * the DMA copy, including its setup and completion interrupt, is faster than the CPU copy. Times are taken with
+ * the DWT cycle counter, which DWT_Init() enables.
+ *
+ * @param dst A word-aligned scratch buffer of max_len bytes.
+ * @param src A word-aligned buffer of max_len bytes.
+ * @param max_len The largest size to try.
+ *
+ * @return The new threshold in bytes, or 0 if the DMA never wins or cannot be timed (the threshold is then left
+ *         unchanged).
+ */
+uint32_t DMA_Mem_Calibrate(void *dst, const void *src, uint32_t max_len) {
+    DMA_Mem_TypeDef h;
+    uint32_t len;
+    uint32_t t0;
+    uint32_t cpu;
+    uint32_t dma;
+    uint32_t found = 0;
+
+    if (!dma_mem_ch || !DWT_Init()) {
+        return 0;
+    }
+    h.cb = 0;
+
+    for (len = 8; len <= max_len && !found; len <<= 1) {
+        t0 = DWT_CYCCNT();
+        DMA_Mem_CPU_Copy((uint8_t *)dst, (const uint8_t *)src, len);
+        cpu = DWT_CYCCNT() - t0;
+
+        t0 = DWT_CYCCNT();
+        DMA_Mem_Copy_DMA(&h, (uint8_t *)dst, (const uint8_t *)src, len);
+        DMA_Mem_Wait(&h);
+        dma = DWT_CYCCNT() - t0;
+
+        if (dma < cpu) {
+            found = len;
+        }
+    }
+
+    if (found) {
+        dma_mem_threshold = found;
+    }
+    return found;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file dma_mem.h
+ * @brief Header file for memory copy and fill through DMA1 memory-to-memory transfers.
+ * @author Yixiang Fan
+ * @date 2024-08-04
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Blocks at or above the threshold are moved by a DMA1 channel in M2M mode, 32 bits at a time when source and
+ * destination share their word alignment, so the CPU is free while an asynchronous operation runs. Smaller blocks,
+ * or every block when no channel is available, are copied by the CPU.
+ */
+
+#ifndef DMA_DMA_MEM_H_
+#define DMA_DMA_MEM_H_
+
+#include "dma.h"
+
+#define DMA_MEM_THRESHOLD 64  // Default size in bytes from which the DMA is used
+
+typedef struct DMA_Mem_TypeDef DMA_Mem_TypeDef;
+
+/**
+ * @brief Callback type for the end of an asynchronous operation, called from the DMA interrupt.
+ *
+ * @param h The finished operation.
+ */
+typedef void (*DMA_Mem_Callback)(DMA_Mem_TypeDef *h);
+
+/**
+ * @brief Handle of an asynchronous copy or fill. It must stay valid until the operation is done.
+ */
+struct DMA_Mem_TypeDef {
+    DMA_Desc_TypeDef desc;  // Descriptor of the running chunk
+    uint32_t src;           // Source of the next chunk
+    uint32_t dst;           // Destination of the next chunk
+    uint32_t left;          // Items still to queue
+    uint32_t fill;          // Fill pattern, the source of a fill
+    uint8_t width;          // Item size in bytes: 1, 2 or 4
+    volatile uint8_t busy;  // 1 until the last chunk is done
+    DMA_Mem_Callback cb;    // Called when done, may be NULL
+};
+
+/**
+ * @brief Takes a DMA1 channel for memory transfers.
+ *
+ * Without this call, or if every channel is in use, all operations fall back to the CPU.
+ *
+ * @return The channel taken, or 0 if none is free.
+ */
+uint8_t DMA_Mem_Init(void);
+
+/**
+ * @brief Sets the size from which the DMA is used instead of the CPU.
+ *
+ * @param bytes The threshold in bytes; see DMA_Mem_Calibrate() to measure it.
+ *
+ * @return void
+ */
+void DMA_Mem_Set_Threshold(uint32_t bytes);
+
+/**
+ * @brief Starts copying len bytes from src to dst and returns at once.
+ *
+ * The areas must not overlap. Below the threshold the copy is done by the CPU before returning and cb is
+ * called from this function.
+ *
+ * @param h The handle of the operation.
+ * @param dst The destination.
+ * @param src The source.
+ * @param len The number of bytes.
+ * @param cb Called when the copy is done, may be NULL.
+ *
+ * @return void
+ */
+void DMA_Memcpy_Async(DMA_Mem_TypeDef *h, void *dst, const void *src, uint32_t len, DMA_Mem_Callback cb);
+
+/**
+ * @brief Starts filling len bytes at dst with c and returns at once.
+ *
+ * Below the threshold the fill is done by the CPU before returning and cb is called from this function.
+ *
+ * @param h The handle of the operation.
+ * @param dst The destination.
+ * @param c The fill byte.
+ * @param len The number of bytes.
+ * @param cb Called when the fill is done, may be NULL.
+ *
+ * @return void
+ */
+void DMA_Memset_Async(DMA_Mem_TypeDef *h, void *dst, uint8_t c, uint32_t len, DMA_Mem_Callback cb);
+
+/**
+ * @brief Returns whether an asynchronous operation is done.
+ *
+ * @param h The handle of the operation.
+ *
+ * @return 1 if done, 0 if still running.
+ */
+uint8_t DMA_Mem_Done(const DMA_Mem_TypeDef *h);
+
+/**
+ * @brief Waits for an asynchronous operation to finish.
+ *
+ * @param h The handle of the operation.
+ *
+ * @return void
+ */
+void DMA_Mem_Wait(const DMA_Mem_TypeDef *h);
+
+/**
+ * @brief Copies len bytes from src to dst and waits for the end of the copy.
+ *
+ * @param dst The destination.
+ * @param src The source.
+ * @param len The number of bytes.
+ *
+ * @return dst
+ */
+void *DMA_Memcpy(void *dst, const void *src, uint32_t len);
+
+/**
+ * @brief Fills len bytes at dst with c and waits for the end of the fill.
+ *
+ * @param dst The destination.
+ * @param c The fill byte.
+ * @param len The number of bytes.
+ *
+ * @return dst
+ */
+void *DMA_Memset(void *dst, uint8_t c, uint32_t len);
+
+/**
+ * @brief Measures the CPU and the DMA copy time for growing sizes and sets the threshold to the crossover.
+ *
+ * Sizes from 8 bytes up to max_len are tried, doubling each time; the threshold becomes the first size at which
+ * the DMA copy, including its setup and completion interrupt, is faster than the CPU copy. Times are taken with
+ * the DWT cycle counter, which DWT_Init() enables.
+ *
+ * @param dst A word-aligned scratch buffer of max_len bytes.
+ * @param src A word-aligned buffer of max_len bytes.
+ * @param max_len The largest size to try.
+ *
+ * @return The new threshold in bytes, or 0 if the DMA never wins or cannot be timed (the threshold is then left
+ *         unchanged).
+ */
+uint32_t DMA_Mem_Calibrate(void *dst, const void *src, uint32_t max_len);
+
+#endif  // DMA_DMA_MEM_H_
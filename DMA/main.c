@@ -1,54 +1,96 @@
 #include "SysTick.h"
 #include "dma.h"
+#include "dma_mem.h"
 #include "key.h"
 #include "led.h"
+#include "sched.h"
+#include "sched_src.h"
 #include "system.h"
 #include "usart.h"
 
 #define send_buf_len 5000
 
-unit8_t send_buf[send_buf_len];
+unit8_t send_buf[send_buf_len] __attribute__((aligned(4)));
+DMA_Desc_TypeDef send_desc;
+unit8_t send_dma;  // 1 if DMA1 Channel4 (USART1_TX) is ours
+
+enum { SIG_KEY = 1, SIG_SENT, SIG_BLINK, SIG_BUSY_BLINK };
+
+unit8_t app_task;
+Sched_Timer_TypeDef blink_timer;
+Sched_Timer_TypeDef busy_timer;
+
+void Send_Done(DMA_Desc_TypeDef *desc, uint8_t event) {
+    (void)desc;
+    (void)event;
+    Sched_Post(app_task, SIG_SENT, 0);
+}
+
 void Send_Data(unit8_t *p) {
-    uint16_t i;
-    for (i = 0; i < send_buf_len; i++) {
-        *p = '5';
-        p++;
+    DMA_Memset(p, '5', send_buf_len);
+}
+
+void App_Handler(const Sched_Event_TypeDef *ev) {
+    switch (ev->sig) {
+        case SIG_KEY:
+            if (ev->data == KEY_UP && send_dma && !Sched_Timer_Active(&busy_timer)) {
+                // The DMA writes USART1->DR directly, so the TX ring must be empty and nothing may printf
+                // until SIG_SENT
+                USART1_TX_Flush();
+                USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
+                DMA_Mgr_Submit(4, &send_desc);
+                Sched_Timer_Start(&busy_timer, app_task, SIG_BUSY_BLINK, 1, 300);
+            }
+            break;
+        case SIG_SENT:
+            USART_DMACmd(USART1, USART_DMAReq_Tx, DISABLE);  // DR belongs to the TX ring again
+            Sched_Timer_Stop(&busy_timer);
+            break;
+        case SIG_BLINK:
+            led1 = !led1;
+            break;
+        case SIG_BUSY_BLINK:
+            led2 = !led2;
+            break;
     }
 }
 
 int main() {
-    unit8_t i = 0;
-    unit8_t key;
+    uint32_t crossover;
 
     SysTick_Init(72);
     NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
     LED_Init();
     USART1_Init(9600);
     KEY_Init();
-    DMAx_Init(DMA1_Channel4, (unit32_t)&USART1->DR, (unit32_t)send_buf, send_buf_len);
+    send_dma = DMA_Mgr_Alloc(4, 3, 2);
+    if (!send_dma) {
+        printf("DMA1 Channel4 is in use, KEY_UP send disabled\r\n");
+    }
+    DMA_Mem_Init();
+    crossover = DMA_Mem_Calibrate(send_buf, send_buf + 2048, 2048);
+    if (crossover) {
+        printf("DMA copy crossover: %lu bytes\r\n", (unsigned long)crossover);
+    } else {
+        printf("DMA copy never faster than the CPU up to 2048 bytes\r\n");
+    }
+    send_desc.init.DMA_PeripheralBaseAddr = (unit32_t)&USART1->DR;
+    send_desc.init.DMA_MemoryBaseAddr = (unit32_t)send_buf;
+    send_desc.init.DMA_DIR = DMA_DIR_PeripheralDST;  // Memory to peripheral mode
+    send_desc.init.DMA_BufferSize = send_buf_len;
+    send_desc.init.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    send_desc.init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    send_desc.init.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    send_desc.init.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    send_desc.init.DMA_Mode = DMA_Mode_Normal;
+    send_desc.init.DMA_Priority = DMA_Priority_Medium;
+    send_desc.init.DMA_M2M = DMA_M2M_Disable;
+    send_desc.cb = Send_Done;
     Send_Data(send_buf);
 
-    while (1) {
-        key = KEY_Scan(0);
-        if (key == KEY_UP) {
-            USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
-            DMAx_Enable(DMA1_Channel4, send_buf_len);
-
-            while (1) {
-                if (DMA_GetFlagStatus(DMA1_FLAG_TC4) != 0) {
-                    DMA_ClearFlag(DMA1_FLAG_TC4);
-                    break;
-                }
-                led2 = !led2;
-                delay_ms(300);
-            }
-        }
-
-        i++;
-        if (i % 20 == 0) {
-            led1 = !led1;
-        }
-
-        delay_ms(10);
-    }
+    Sched_Init();
+    app_task = Sched_Task_Add(App_Handler, 1);
+    Sched_Src_Key(app_task, SIG_KEY);
+    Sched_Timer_Start(&blink_timer, app_task, SIG_BLINK, 200, 200);
+    Sched_Run();
 }
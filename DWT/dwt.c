@@ -0,0 +1,171 @@
+/**
+ * @file dwt.c
+ * @brief Source file for cycle-accurate delays and code profiling with the DWT cycle counter.
+ * @author Yixiang Fan
+ * @date 2024-08-09
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "dwt.h"
+#include <stdio.h>
+
+static uint32_t dwt_hclk = 72000000;     // Core clock in Hz
+static uint32_t dwt_ns_mul;              // Cycles per nanosecond in Q32
+static uint32_t dwt_overhead;            // Cycles taken by two counter reads
+static DWT_Prof_TypeDef *dwt_prof_list;  // Regions that have samples
+
+/**
+ * @brief Enables the DWT cycle counter.
+ *
+ * Safe to call from every module that needs the counter: it is cleared only when it is first enabled, so
+ * timestamps and delays already running elsewhere are not disturbed.
+ *
+ * @return 1 if the counter runs, 0 if the core has no cycle counter.
+ */
+uint8_t DWT_Init(void) {
+    RCC_ClocksTypeDef clocks;
+    uint32_t t0;
+
+    RCC_GetClocksFreq(&clocks);
+    dwt_hclk = clocks.HCLK_Frequency;
+    dwt_ns_mul = (uint32_t)(((uint64_t)dwt_hclk << 32) / 1000000000u);
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;  // Enable the trace and debug blocks, including DWT
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;  // Start the cycle counter
+    }
+
+    t0 = DWT_CYCCNT();
+    dwt_overhead = DWT_CYCCNT() - t0;
+    return DWT_CYCCNT() != t0;
+}
+
+/**
+ * @brief Busy-waits for a number of core clock cycles.
+ *
+ * @param cycles The number of cycles, up to 2^31.
+ *
+ * @return void
+ */
+void DWT_Delay_Cycles(uint32_t cycles) {
+    uint32_t start = DWT_CYCCNT();
+
+    while (DWT_CYCCNT() - start < cycles) {  // Unsigned difference handles the counter wrap
+    }
+}
+
+/**
+ * @brief Converts nanoseconds to core clock cycles, rounding up.
+ *
+ * @param ns The time in nanoseconds.
+ *
+ * @return The number of cycles.
+ */
+uint32_t DWT_Ns_To_Cycles(uint32_t ns) {
+    return (uint32_t)(((uint64_t)ns * dwt_ns_mul + 0xffffffffu) >> 32);  // One multiply, no division
+}
+
+/**
+ * @brief Busy-waits for a number of nanoseconds.
+ *
+ * The wait is rounded up to whole cycles; the call itself takes a few tens of cycles, so very short waits last
+ * longer than asked.
+ *
+ * @param ns The time in nanoseconds.
+ *
+ * @return void
+ */
+void DWT_Delay_Ns(uint32_t ns) {
+    DWT_Delay_Cycles(DWT_Ns_To_Cycles(ns));
+}
+
+/**
+ * @brief Busy-waits for a number of microseconds.
+ *
+ * @param us The time in microseconds, up to 2^31 cycles (about 29 s at 72 MHz).
+ *
+ * @return void
+ */
+void DWT_Delay_Us(uint32_t us) {
+    DWT_Delay_Cycles(us * (dwt_hclk / 1000000));
+}
+
+/**
+ * @brief Adds a sample to a profiled region, linking the region into the dump table on its first sample.
+ *
+ * The cost of reading the counter twice, measured by DWT_Init(), is subtracted. Safe to call from interrupts.
+ *
+ * @param prof The region.
+ * @param cycles The measured cycles.
+ *
+ * @return void
+ */
+void DWT_Prof_Record(DWT_Prof_TypeDef *prof, uint32_t cycles) {
+    uint32_t primask = __get_PRIMASK();
+
+    cycles = cycles > dwt_overhead ? cycles - dwt_overhead : 0;
+
+    __disable_irq();
+    if (!prof->linked) {
+        prof->next = dwt_prof_list;
+        dwt_prof_list = prof;
+        prof->linked = 1;
+    }
+    prof->count++;
+    prof->total += cycles;
+    if (cycles < prof->min) {
+        prof->min = cycles;
+    }
+    if (cycles > prof->max) {
+        prof->max = cycles;
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Clears the statistics of every region in the dump table.
+ *
+ * @return void
+ */
+void DWT_Prof_Reset(void) {
+    DWT_Prof_TypeDef *p;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    for (p = dwt_prof_list; p; p = p->next) {
+        p->count = 0;
+        p->min = 0xffffffff;
+        p->max = 0;
+        p->total = 0;
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Prints the statistics of every region that has samples with printf, i.e. over USART1.
+ *
+ * Each region is copied with interrupts masked, so a line is always consistent even if the region is an
+ * interrupt handler that fires during the dump.
+ *
+ * @return void
+ */
+void DWT_Prof_Dump(void) {
+    DWT_Prof_TypeDef *p;
+    DWT_Prof_TypeDef s;
+    uint32_t primask;
+
+    printf("%-20s %10s %10s %10s %10s  (cycles at %lu MHz)\r\n", "region", "count", "min", "mean", "max",
+           (unsigned long)(dwt_hclk / 1000000));
+    for (p = dwt_prof_list; p; p = p->next) {
+        primask = __get_PRIMASK();
+        __disable_irq();
+        s = *p;
+        __set_PRIMASK(primask);
+        if (s.count == 0) {
+            continue;
+        }
+        printf("%-20s %10lu %10lu %10lu %10lu\r\n", s.name, (unsigned long)s.count, (unsigned long)s.min,
+               (unsigned long)(s.total / s.count), (unsigned long)s.max);
+    }
+}
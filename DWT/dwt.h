@@ -0,0 +1,134 @@
+/**
+ * @file dwt.h
+ * @brief Header file for cycle-accurate delays and code profiling with the DWT cycle counter.
+ * @author Yixiang Fan
+ * @date 2024-08-09
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The Cortex-M3 DWT unit counts every core clock cycle in the 32-bit CYCCNT register. It is used here for delays
+ * with cycle resolution that leave SysTick alone, and for profiling: a region between DWT_PROF_BEGIN(name) and
+ * DWT_PROF_END(name) records the count, minimum, maximum and mean of its cycle counts in a table that
+ * DWT_Prof_Dump() prints over USART1. Profiling compiles to nothing unless DWT_PROFILE is defined, so library
+ * interrupt handlers can carry the macros at no cost.
+ *
+ * DWT_CYCCNT() reads the counter; define it before including this file to read another source (for example a
+ * fake counter when the statistics are run off target).
+ */
+
+#ifndef DWT_DWT_H_
+#define DWT_DWT_H_
+
+#include "system.h"
+
+#ifndef DWT_CYCCNT
+#define DWT_CYCCNT() (DWT->CYCCNT)
+#endif
+
+typedef struct DWT_Prof_TypeDef DWT_Prof_TypeDef;
+
+/**
+ * @brief Statistics of one profiled region.
+ */
+struct DWT_Prof_TypeDef {
+    const char *name;        // Region name
+    uint32_t count;          // Number of samples
+    uint32_t min;            // Shortest sample in cycles
+    uint32_t max;            // Longest sample in cycles
+    uint64_t total;          // Sum of all samples in cycles
+    DWT_Prof_TypeDef *next;  // Next region in the dump table
+    uint8_t linked;          // 1 once the region is in the dump table
+};
+
+#ifdef DWT_PROFILE
+/**
+ * @brief Starts timing the region name; must come after the declarations of the enclosing block.
+ */
+#define DWT_PROF_BEGIN(name)                                                      \
+    static DWT_Prof_TypeDef dwt_prof_##name = {#name, 0, 0xffffffff, 0, 0, 0, 0}; \
+    uint32_t dwt_prof_start_##name = DWT_CYCCNT()
+
+/**
+ * @brief Ends timing the region name and records the sample. Every path out of the region must pass here.
+ */
+#define DWT_PROF_END(name) DWT_Prof_Record(&dwt_prof_##name, DWT_CYCCNT() - dwt_prof_start_##name)
+#else
+#define DWT_PROF_BEGIN(name)
+#define DWT_PROF_END(name)
+#endif
+
+/**
+ * @brief Enables the DWT cycle counter.
+ *
+ * Safe to call from every module that needs the counter: it is cleared only when it is first enabled, so
+ * timestamps and delays already running elsewhere are not disturbed.
+ *
+ * @return 1 if the counter runs, 0 if the core has no cycle counter.
+ */
+uint8_t DWT_Init(void);
+
+/**
+ * @brief Busy-waits for a number of core clock cycles.
+ *
+ * @param cycles The number of cycles, up to 2^31.
+ *
+ * @return void
+ */
+void DWT_Delay_Cycles(uint32_t cycles);
+
+/**
+ * @brief Busy-waits for a number of nanoseconds.
+ *
+ * The wait is rounded up to whole cycles; the call itself takes a few tens of cycles, so very short waits last
+ * longer than asked.
+ *
+ * @param ns The time in nanoseconds.
+ *
+ * @return void
+ */
+void DWT_Delay_Ns(uint32_t ns);
+
+/**
+ * @brief Busy-waits for a number of microseconds.
+ *
+ * @param us The time in microseconds, up to 2^31 cycles (about 29 s at 72 MHz).
+ *
+ * @return void
+ */
+void DWT_Delay_Us(uint32_t us);
+
+/**
+ * @brief Converts nanoseconds to core clock cycles, rounding up.
+ *
+ * @param ns The time in nanoseconds.
+ *
+ * @return The number of cycles.
+ */
+uint32_t DWT_Ns_To_Cycles(uint32_t ns);
+
+/**
+ * @brief Adds a sample to a profiled region, linking the region into the dump table on its first sample.
+ *
+ * The cost of reading the counter twice, measured by DWT_Init(), is subtracted. Safe to call from interrupts.
+ *
+ * @param prof The region.
+ * @param cycles The measured cycles.
+ *
+ * @return void
+ */
+void DWT_Prof_Record(DWT_Prof_TypeDef *prof, uint32_t cycles);
+
+/**
+ * @brief Clears the statistics of every region in the dump table.
+ *
+ * @return void
+ */
+void DWT_Prof_Reset(void);
+
+/**
+ * @brief Prints the statistics of every region that has samples with printf, i.e. over USART1.
+ *
+ * @return void
+ */
+void DWT_Prof_Dump(void);
+
+#endif  // DWT_DWT_H_
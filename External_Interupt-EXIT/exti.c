@@ -4,154 +4,552 @@
  * @author Yixiang Fan
  * @date 2024-08-01
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The EXTI dispatcher serves lines 0-15 through all seven EXTI vectors, including the shared EXTI9_5 and
+ * EXTI15_10 ones. The interrupt handlers only acknowledge the pending lines and queue one (line, DWT timestamp)
+ * record per edge, which takes a few dozen cycles. EXTI_Process(), called from the main loop, drains the queue,
+ * waits for each line to be quiet for its debounce time without blocking, reads the settled pin level and calls
+ * the line's callback in thread context.
+ *
+ * A line can instead be put in capture mode with EXTI_Capture_Start(): its handler then stores the cycle count
+ * taken at interrupt entry into the line's own ring, which gives edge timing to within the interrupt latency
+ * without a timer channel.
  */
 
 #include "exti.h"
 #include "led.h"
 #include "SysTick.h"
 #include "key.h"
+#include "dwt.h"
 
 /**
- * @brief Initializes external interrupt lines and NVIC.
+ * @brief Registration and debounce state of one line.
+ */
+typedef struct {
+    EXTI_Callback cb;           // Called with the settled level, NULL if the line is not registered
+    GPIO_TypeDef *port;         // Port the line is mapped to
+    uint32_t debounce;          // Quiet time in DWT cycles before the level is read
+    uint32_t last;              // Timestamp of the latest edge
+    uint8_t trigger;            // EXTI_EDGE_* bits the callback wants
+    uint8_t level;              // Last settled level
+    EXTI_Capture_TypeDef *cap;  // Timestamp ring in capture mode, NULL otherwise
+} EXTI_Line_TypeDef;
+
+/**
+ * @brief One edge recorded by an interrupt handler.
+ */
+typedef struct {
+    uint8_t line;    // EXTI line, 0-15
+    uint32_t stamp;  // DWT_CYCCNT() in the interrupt handler
+} EXTI_Event_TypeDef;
+
+static GPIO_TypeDef *const exti_ports[7] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG};
+static EXTI_Line_TypeDef exti_lines[EXTI_LINES];
+static EXTI_Event_TypeDef exti_queue[EXTI_QUEUE_SIZE];  // Edges waiting for EXTI_Process()
+static volatile uint8_t exti_queue_head;                // Next free slot, written by the interrupt handlers
+static volatile uint8_t exti_queue_tail;                // Next edge to take, written by EXTI_Process()
+static volatile uint32_t exti_queue_dropped;            // Edges lost to a full queue
+static uint16_t exti_settling;                          // Lines with edges whose quiet time has not passed yet
+
+typedef char exti_queue_size_must_be_a_power_of_two[(EXTI_QUEUE_SIZE & (EXTI_QUEUE_SIZE - 1)) ? -1 : 1];
+
+/**
+ * @brief Returns the NVIC channel that serves an EXTI line.
  *
- * This function configures the GPIO pins for external interrupt lines, sets up the NVIC for the
- * corresponding EXTI interrupt channels, and initializes the EXTI registers. It enables the
- * specified GPIO pins as inputs with pull-up or pull-down resistors, and configures the EXTI
- * lines to trigger on rising or falling edges.
+ * @param line The EXTI line, 0-15.
+ * @return The interrupt channel.
+ */
+static uint8_t EXTI_Line_IRQn(uint8_t line) {
+    if (line <= 4) {
+        return EXTI0_IRQn + line;
+    }
+    return line <= 9 ? EXTI9_5_IRQn : EXTI15_10_IRQn;
+}
+
+/**
+ * @brief Maps a pin to its EXTI line and enables the line and its interrupt.
  *
- * @param void
+ * @param port_source The port of the pin.
+ * @param line The EXTI line.
+ * @param trigger The hardware trigger.
+ * @param preempt The preemption priority of the line's interrupt.
+ * @param sub The subpriority of the line's interrupt.
  * @return void
- * @note This function should be called before using any external interrupt features in the application.
- * @warning Make sure to configure the GPIO pins and clocks properly before calling this function.
  */
-void My_EXTI_Init(void) {
+static void EXTI_Line_Setup(uint8_t port_source, uint8_t line, EXTITrigger_TypeDef trigger, uint8_t preempt,
+                            uint8_t sub) {
     NVIC_InitTypeDef NVIC_InitStructure;
     EXTI_InitTypeDef EXTI_InitStructure;
 
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
+    GPIO_EXTILineConfig(port_source, line);  // Select GPIO pin for external interrupt line
 
-    GPIO_EXTILineConfig(GPIO_PortSourceGPIOE, GPIO_PinSource2);  // Select GPIO pin for external interrupt line
-    GPIO_EXTILineConfig(GPIO_PortSourceGPIOE, GPIO_PinSource3);  // Select GPIO pin for external interrupt line
-    GPIO_EXTILineConfig(GPIO_PortSourceGPIOE, GPIO_PinSource4);  // Select GPIO pin for external interrupt line
-    GPIO_EXTILineConfig(GPIO_PortSourceGPIOA, GPIO_PinSource0);  // Select GPIO pin for external interrupt line
-
-    // EXTI0 NVIC configuration
-    NVIC_InitStructure.NVIC_IRQChannel = EXTI0_IRQn;  // EXTI0 interrupt channel
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;  // Preemption priority
-    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;  // Subpriority
-    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;  // Enable IRQ channel
-    NVIC_Init(&NVIC_InitStructure);  // Initialize VIC registers based on the specified parameters
-
-    // EXTI2 NVIC configuration
-    NVIC_InitStructure.NVIC_IRQChannel = EXTI2_IRQn;  // EXTI2 interrupt channel
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;  // Preemption priority
-    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 2;  // Subpriority
+    NVIC_InitStructure.NVIC_IRQChannel = EXTI_Line_IRQn(line);  // EXTI interrupt channel
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = preempt;  // Preemption priority
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = sub;  // Subpriority
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;  // Enable IRQ channel
     NVIC_Init(&NVIC_InitStructure);  // Initialize VIC registers based on the specified parameters
 
-    // EXTI3 NVIC configuration
-    NVIC_InitStructure.NVIC_IRQChannel = EXTI3_IRQn;  // EXTI3 interrupt channel
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;  // Preemption priority
-    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;  // Subpriority
-    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;  // Enable IRQ channel
-    NVIC_Init(&NVIC_InitStructure);  // Initialize VIC registers based on the specified parameters
-
-    // EXTI4 NVIC configuration
-    NVIC_InitStructure.NVIC_IRQChannel = EXTI4_IRQn;  // EXTI4 interrupt channel
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;  // Preemption priority
-    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;  // Subpriority
-    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;  // Enable IRQ channel
-    NVIC_Init(&NVIC_InitStructure);  // Initialize VIC registers based on the specified parameters
-
-    EXTI_InitStructure.EXTI_Line = EXTI_Line0;
+    EXTI_InitStructure.EXTI_Line = 1u << line;
     EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
-    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+    EXTI_InitStructure.EXTI_Trigger = trigger;
     EXTI_InitStructure.EXTI_LineCmd = ENABLE;
     EXTI_Init(&EXTI_InitStructure);
+}
 
-    EXTI_InitStructure.EXTI_Line = EXTI_Line2 | EXTI_Line3 | EXTI_Line4;
-    EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
-    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Falling;
-    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
-    EXTI_Init(&EXTI_InitStructure);
+/**
+ * @brief Registers a callback for an EXTI line and enables the line.
+ *
+ * The pin must already be configured as an input. Lines 5-9 and 10-15 share one interrupt each, so the last
+ * registration sets the priority of the shared vector. The edges are timestamped with the cycle counter, so the
+ * registration calls DWT_Init(), which leaves a running counter alone.
+ *
+ * @param port_source The port of the pin, GPIO_PortSourceGPIOA ... GPIO_PortSourceGPIOG.
+ * @param line The EXTI line, which is also the pin number, 0-15.
+ * @param trigger EXTI_Trigger_Rising, EXTI_Trigger_Falling or EXTI_Trigger_Rising_Falling; the callback is only
+ *        called for settled levels that match it.
+ * @param debounce_ms How long the line must be quiet before its level counts, 0 to take the level at once; at most
+ *        2^31 cycles (about 29 s at 72 MHz), longer times are clamped.
+ * @param cb Called from EXTI_Process() with the settled level.
+ * @param preempt The preemption priority of the line's interrupt.
+ * @param sub The subpriority of the line's interrupt.
+ * @return 1 if registered, 0 if the port or line is invalid.
+ */
+uint8_t EXTI_Line_Register(uint8_t port_source, uint8_t line, EXTITrigger_TypeDef trigger, uint16_t debounce_ms,
+                           EXTI_Callback cb, uint8_t preempt, uint8_t sub) {
+    EXTI_Line_TypeDef *l;
+    uint32_t ms_cycles;
+
+    if (port_source >= 7 || line >= EXTI_LINES || !cb) {
+        return 0;
+    }
+
+    DWT_Init();  // A stopped counter would make every debounce time and timestamp 0
+    ms_cycles = DWT_Ns_To_Cycles(1000000);
+    l = &exti_lines[line];
+    EXTI->IMR &= ~(1u << line);  // Keep the line quiet while its state changes
+    l->port = exti_ports[port_source];
+    l->debounce = ms_cycles && debounce_ms > 0x7fffffffu / ms_cycles ? 0x7fffffffu : debounce_ms * ms_cycles;
+    l->trigger = trigger == EXTI_Trigger_Rising ? EXTI_EDGE_RISING :
+                 trigger == EXTI_Trigger_Falling ? EXTI_EDGE_FALLING : EXTI_EDGE_RISING | EXTI_EDGE_FALLING;
+    l->level = (l->port->IDR >> line) & 1;
+    l->cap = 0;
+    l->cb = cb;
+
+    EXTI_Line_Setup(port_source, line, debounce_ms ? EXTI_Trigger_Rising_Falling : trigger, preempt,
+                    sub);  // Bounces need both edges
+    return 1;
 }
 
 /**
- * @brief Interrupt handler for EXTI0 line.
+ * @brief Disables an EXTI line and drops its callback. Edges already queued for it are ignored.
  *
- * This function handles the interrupt generated by the EXTI0 line. It checks if the interrupt
- * flag is set, waits for 10 milliseconds to debounce the button, and toggles LED2 if the button
- * is pressed.
+ * @param line The EXTI line, 0-15.
+ * @return void
+ */
+void EXTI_Line_Unregister(uint8_t line) {
+    if (line >= EXTI_LINES) {
+        return;
+    }
+    EXTI->IMR &= ~(1u << line);
+    EXTI->PR = 1u << line;
+    exti_lines[line].cb = 0;
+    exti_lines[line].cap = 0;
+}
+
+/**
+ * @brief Puts an EXTI line in capture mode: every edge is timestamped at interrupt entry into a ring.
  *
- * @param void
+ * The pin must already be configured as an input; DWT_Init() is called for the timestamps. With
+ * EXTI_Trigger_Rising_Falling the handler also reads the pin, so edge pairs that came too fast for the interrupt
+ * can be counted as missed; with a single edge the hardware merges such edges without a trace.
+ * EXTI_Line_Unregister() stops the capture.
+ *
+ * @param cap The capture handle, which must stay valid while capturing.
+ * @param port_source The port of the pin, GPIO_PortSourceGPIOA ... GPIO_PortSourceGPIOG.
+ * @param line The EXTI line, which is also the pin number, 0-15.
+ * @param trigger EXTI_Trigger_Rising, EXTI_Trigger_Falling or EXTI_Trigger_Rising_Falling.
+ * @param buf The timestamp ring.
+ * @param size The number of timestamps in buf, a power of two.
+ * @param preempt The preemption priority of the line's interrupt.
+ * @param sub The subpriority of the line's interrupt.
+ * @return 1 if capturing, 0 if the port, line or size is invalid.
+ */
+uint8_t EXTI_Capture_Start(EXTI_Capture_TypeDef *cap, uint8_t port_source, uint8_t line,
+                           EXTITrigger_TypeDef trigger, uint32_t *buf, uint16_t size, uint8_t preempt, uint8_t sub) {
+    EXTI_Line_TypeDef *l;
+
+    if (port_source >= 7 || line >= EXTI_LINES || size < 2 || (size & (size - 1))) {
+        return 0;
+    }
+
+    DWT_Init();  // A stopped counter would make every timestamp 0
+    l = &exti_lines[line];
+    EXTI->IMR &= ~(1u << line);  // Keep the line quiet while its state changes
+    l->port = exti_ports[port_source];
+    l->cb = 0;
+
+    cap->buf = buf;
+    cap->mask = size - 1;
+    cap->head = 0;
+    cap->tail = 0;
+    cap->both = trigger == EXTI_Trigger_Rising_Falling;
+    cap->level = (l->port->IDR >> line) & 1;
+    cap->edges = 0;
+    cap->dropped = 0;
+    cap->missed = 0;
+    cap->prev_valid = 0;
+    l->cap = cap;
+
+    EXTI_Line_Setup(port_source, line, trigger, preempt, sub);
+    return 1;
+}
+
+/**
+ * @brief Records one edge of a line in capture mode. Only the line's own vector writes the ring.
+ *
+ * @param l The line.
+ * @param line The EXTI line.
+ * @param stamp The cycle count at interrupt entry.
  * @return void
  */
-void EXTI0_IRQHandler(void) {
-    if (EXTI_GetITStatus(EXTI_Line0) == 1) {
-        delay_ms(10);
-        if (K_UP == 1) {
-            led2 = 0;
+static void EXTI_Capture_Edge(EXTI_Line_TypeDef *l, uint8_t line, uint32_t stamp) {
+    EXTI_Capture_TypeDef *cap = l->cap;
+    uint16_t head = cap->head;
+    uint8_t level;
+
+    if (cap->both) {
+        level = (l->port->IDR >> line) & 1;
+        if (level == cap->level) {
+            cap->missed++;  // At least one opposite edge was merged into this interrupt
         }
+        cap->level = level;
     }
-    EXTI_ClearITPendingBit(EXTI_Line0);
+    cap->edges++;
+    if ((uint16_t)(head - cap->tail) > cap->mask) {
+        cap->dropped++;
+        return;
+    }
+    cap->buf[head & cap->mask] = stamp;
+    cap->head = head + 1;
 }
 
 /**
- * @brief Interrupt handler for EXTI3 line.
+ * @brief Takes the oldest captured timestamps.
  *
- * This function handles the interrupt generated by the EXTI3 line. It checks if the interrupt
- * flag is set, waits for 10 milliseconds to debounce the button, and toggles LED2 if the button
- * is pressed.
+ * @param cap The capture handle.
+ * @param stamps Receives up to max timestamps in DWT cycles, oldest first.
+ * @param max The size of stamps.
+ * @return The number of timestamps taken.
+ */
+uint16_t EXTI_Capture_Read(EXTI_Capture_TypeDef *cap, uint32_t *stamps, uint16_t max) {
+    uint16_t tail = cap->tail;
+    uint16_t n = 0;
+
+    while (n < max && tail != cap->head) {
+        stamps[n++] = cap->buf[tail & cap->mask];
+        tail++;
+    }
+    if (n) {
+        cap->prev = stamps[n - 1];
+        cap->prev_valid = 1;
+    }
+    cap->tail = tail;
+    return n;
+}
+
+/**
+ * @brief Takes the next inter-edge interval.
  *
- * @param void
+ * The interval is measured from the previously taken timestamp, so the first edge after the start only sets
+ * the reference. Intervals must be shorter than the cycle counter period, about 59 s at 72 MHz.
+ *
+ * @param cap The capture handle.
+ * @param cycles Receives the interval in DWT cycles.
+ * @return 1 if an interval was taken, 0 if no complete interval is waiting.
+ */
+uint8_t EXTI_Capture_Interval(EXTI_Capture_TypeDef *cap, uint32_t *cycles) {
+    uint32_t ref = cap->prev;
+    uint8_t valid = cap->prev_valid;
+    uint32_t stamp;
+
+    while (EXTI_Capture_Read(cap, &stamp, 1) == 1) {
+        if (valid) {
+            *cycles = stamp - ref;
+            return 1;
+        }
+        ref = stamp;  // First edge: reference only
+        valid = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the edge rate over the timestamps waiting in the ring, without taking them.
+ *
+ * @param cap The capture handle.
+ * @return The rate in edges per second, 0 if fewer than two timestamps are waiting.
+ */
+uint32_t EXTI_Capture_Rate(const EXTI_Capture_TypeDef *cap) {
+    RCC_ClocksTypeDef clocks;
+    uint16_t tail = cap->tail;
+    uint16_t head = cap->head;
+    uint32_t span;
+
+    if ((uint16_t)(head - tail) < 2) {
+        return 0;
+    }
+    span = cap->buf[(head - 1) & cap->mask] - cap->buf[tail & cap->mask];
+    if (!span) {
+        return 0;
+    }
+    RCC_GetClocksFreq(&clocks);  // DWT counts HCLK cycles
+    return (uint32_t)(((uint64_t)(uint16_t)(head - tail - 1) * clocks.HCLK_Frequency + span / 2) / span);
+}
+
+/**
+ * @brief Acknowledges the pending lines of one vector and queues a timestamped record per line.
+ *
+ * This is the whole interrupt path: one read of PR, one write to clear it and a short critical section per
+ * line to claim a queue slot, since vectors of different priorities may preempt each other.
+ *
+ * @param mask The lines served by the vector.
  * @return void
  */
-void EXTI3_IRQHandler(void) {
-    if (EXTI_GetITStatus(EXTI_Line3) == 1) {
-        delay_ms(10);
-        if (K_DOWN == 0) {
-            led2 = 1;
+static void EXTI_Dispatch(uint32_t mask) {
+    uint32_t stamp = DWT_CYCCNT();
+    uint32_t pending = EXTI->PR & mask;
+    uint32_t primask;
+    uint8_t head;
+    uint8_t line;
+
+    EXTI->PR = pending;  // Acknowledge, written as 1 to clear
+    while (pending) {
+        line = 31 - __CLZ(pending);
+        pending &= ~(1u << line);
+        if (exti_lines[line].cap) {
+            EXTI_Capture_Edge(&exti_lines[line], line, stamp);
+            continue;
+        }
+
+        primask = __get_PRIMASK();
+        __disable_irq();
+        head = exti_queue_head;
+        if ((uint8_t)(head - exti_queue_tail) < EXTI_QUEUE_SIZE) {
+            exti_queue[head & (EXTI_QUEUE_SIZE - 1)].line = line;
+            exti_queue[head & (EXTI_QUEUE_SIZE - 1)].stamp = stamp;
+            exti_queue_head = head + 1;
+        } else {
+            exti_queue_dropped++;
         }
+        __set_PRIMASK(primask);
     }
-    EXTI_ClearITPendingBit(EXTI_Line3);
 }
 
 /**
- * @brief Interrupt handler for EXTI2 line.
+ * @brief Handles the queued edges in thread context; call it from the main loop.
  *
- * This function handles the interrupt generated by the EXTI2 line. It checks if the interrupt
- * flag is set, waits for 10 milliseconds to debounce the button, and toggles LED3 if the button
- * is pressed.
+ * Each edge restarts the quiet time of its line. Once a line has been quiet for its debounce time its pin is
+ * read, and if the settled level differs from the previous one and matches the line's trigger the callback is
+ * called. Lines without debouncing get one callback per queued edge, in queue order. Lines still settling are
+ * checked again on the next call, so nothing waits. A line must not stay unprocessed for longer than the cycle
+ * counter takes to wrap, about 59 s at 72 MHz.
  *
- * @param void
  * @return void
  */
-void EXTI2_IRQHandler(void) {
-    if (EXTI_GetITStatus(EXTI_Line2) == 1) {
-        delay_ms(10);
-        if (K_LEFT == 0) {
-            led3 = 1;
+void EXTI_Process(void) {
+    EXTI_Event_TypeDef ev;
+    EXTI_Line_TypeDef *l;
+    uint32_t now;
+    uint8_t tail;
+    uint8_t level;
+    uint8_t line;
+
+    for (tail = exti_queue_tail; tail != exti_queue_head; ++tail) {
+        ev = exti_queue[tail & (EXTI_QUEUE_SIZE - 1)];
+        exti_queue_tail = tail + 1;
+        l = &exti_lines[ev.line];
+        if (!l->cb) {
+            continue;
+        }
+        if (!l->debounce) {  // The hardware only reports the wanted edges, pass each one on
+            l->level = (l->port->IDR >> ev.line) & 1;
+            l->cb(ev.line, l->level, ev.stamp);
+        } else {
+            l->last = ev.stamp;
+            exti_settling |= 1u << ev.line;
+        }
+    }
+
+    now = DWT_CYCCNT();
+    for (line = 0; line < EXTI_LINES; ++line) {
+        l = &exti_lines[line];
+        if (!(exti_settling & (1u << line)) || now - l->last < l->debounce) {
+            continue;
+        }
+        exti_settling &= ~(1u << line);
+        if (!l->cb) {
+            continue;
+        }
+        level = (l->port->IDR >> line) & 1;
+        if (level != l->level) {
+            l->level = level;
+            if (l->trigger & (level ? EXTI_EDGE_RISING : EXTI_EDGE_FALLING)) {
+                l->cb(line, level, l->last);
+            }
         }
     }
-    EXTI_ClearITPendingBit(EXTI_Line2);
 }
 
 /**
- * @brief Interrupt handler for EXTI4 line.
+ * @brief Returns the number of edges lost because the queue was full.
+ *
+ * @return The number of dropped edges.
+ */
+uint32_t EXTI_Dropped(void) {
+    return exti_queue_dropped;
+}
+
+/**
+ * @brief K_UP callback, turns LED2 on when the key is pressed.
+ */
+static void EXTI_K_Up(uint8_t line, uint8_t level, uint32_t stamp) {
+    (void)line;
+    (void)level;
+    (void)stamp;
+    led2 = 0;
+}
+
+/**
+ * @brief K_DOWN callback, turns LED2 off when the key is pressed.
+ */
+static void EXTI_K_Down(uint8_t line, uint8_t level, uint32_t stamp) {
+    (void)line;
+    (void)level;
+    (void)stamp;
+    led2 = 1;
+}
+
+/**
+ * @brief K_LEFT callback, turns LED3 off when the key is pressed.
+ */
+static void EXTI_K_Left(uint8_t line, uint8_t level, uint32_t stamp) {
+    (void)line;
+    (void)level;
+    (void)stamp;
+    led3 = 1;
+}
+
+/**
+ * @brief K_RIGHT callback, turns LED3 on when the key is pressed.
+ */
+static void EXTI_K_Right(uint8_t line, uint8_t level, uint32_t stamp) {
+    (void)line;
+    (void)level;
+    (void)stamp;
+    led3 = 0;
+}
+
+/**
+ * @brief Initializes external interrupt lines and NVIC.
+ *
+ * This function registers the four keys with the EXTI dispatcher: K_UP (PA0) reacts to the rising edge and
+ * K_LEFT, K_DOWN, K_RIGHT (PE2-PE4) to the falling edge, each debounced for 10 ms in EXTI_Process() instead of
+ * in the interrupt handler. The LED actions run in the callbacks.
+ *
+ * @param void
+ * @return void
+ * @note This function should be called before using any external interrupt features in the application.
+ *       EXTI_Process() must then be called from the main loop.
+ * @warning Make sure to configure the GPIO pins and clocks properly before calling this function.
+ */
+void My_EXTI_Init(void) {
+    EXTI_Line_Register(GPIO_PortSourceGPIOA, 0, EXTI_Trigger_Rising, 10, EXTI_K_Up, 2, 3);
+    EXTI_Line_Register(GPIO_PortSourceGPIOE, 2, EXTI_Trigger_Falling, 10, EXTI_K_Left, 2, 2);
+    EXTI_Line_Register(GPIO_PortSourceGPIOE, 3, EXTI_Trigger_Falling, 10, EXTI_K_Down, 2, 1);
+    EXTI_Line_Register(GPIO_PortSourceGPIOE, 4, EXTI_Trigger_Falling, 10, EXTI_K_Right, 2, 0);
+}
+
+/**
+ * @brief Interrupt handler for EXTI0 line.
+ *
+ * @param void
+ * @return void
+ */
+void EXTI0_IRQHandler(void) {
+    DWT_PROF_BEGIN(exti0_irq);
+    EXTI_Dispatch(1u << 0);
+    DWT_PROF_END(exti0_irq);
+}
+
+/**
+ * @brief Interrupt handler for EXTI1 line.
+ *
+ * @param void
+ * @return void
+ */
+void EXTI1_IRQHandler(void) {
+    DWT_PROF_BEGIN(exti1_irq);
+    EXTI_Dispatch(1u << 1);
+    DWT_PROF_END(exti1_irq);
+}
+
+/**
+ * @brief Interrupt handler for EXTI2 line.
  *
- * This function handles the interrupt generated by the EXTI4 line. It checks if the interrupt
- * flag is set, waits for 10 milliseconds to debounce the button, and toggles LED3 if the button
- * is pressed.
+ * @param void
+ * @return void
+ */
+void EXTI2_IRQHandler(void) {
+    DWT_PROF_BEGIN(exti2_irq);
+    EXTI_Dispatch(1u << 2);
+    DWT_PROF_END(exti2_irq);
+}
+
+/**
+ * @brief Interrupt handler for EXTI3 line.
+ *
+ * @param void
+ * @return void
+ */
+void EXTI3_IRQHandler(void) {
+    DWT_PROF_BEGIN(exti3_irq);
+    EXTI_Dispatch(1u << 3);
+    DWT_PROF_END(exti3_irq);
+}
+
+/**
+ * @brief Interrupt handler for EXTI4 line.
  *
  * @param void
  * @return void
  */
 void EXTI4_IRQHandler(void) {
-    if (EXTI_GetITStatus(EXTI_Line4) == 1) {
-        delay_ms(10);
-        if (K_RIGHT == 0) {
-            led3 = 0;
-        }
-    }
-    EXTI_ClearITPendingBit(EXTI_Line4);
+    DWT_PROF_BEGIN(exti4_irq);
+    EXTI_Dispatch(1u << 4);
+    DWT_PROF_END(exti4_irq);
+}
+
+/**
+ * @brief Interrupt handler for the shared EXTI5-EXTI9 lines.
+ *
+ * @param void
+ * @return void
+ */
+void EXTI9_5_IRQHandler(void) {
+    DWT_PROF_BEGIN(exti9_5_irq);
+    EXTI_Dispatch(0x03e0);
+    DWT_PROF_END(exti9_5_irq);
+}
+
+/**
+ * @brief Interrupt handler for the shared EXTI10-EXTI15 lines.
+ *
+ * @param void
+ * @return void
+ */
+void EXTI15_10_IRQHandler(void) {
+    DWT_PROF_BEGIN(exti15_10_irq);
+    EXTI_Dispatch(0xfc00);
+    DWT_PROF_END(exti15_10_irq);
 }
@@ -11,6 +11,38 @@
 
 #include "system.h"
 
+#define EXTI_LINES 16       // GPIO lines 0-15
+#define EXTI_QUEUE_SIZE 32  // Edges that can wait for EXTI_Process(), must be a power of two
+
+#define EXTI_EDGE_RISING 0x01   // Settled high
+#define EXTI_EDGE_FALLING 0x02  // Settled low
+
+/**
+ * @brief Callback type for a settled EXTI line, called from EXTI_Process() in thread context.
+ *
+ * @param line The EXTI line, 0-15.
+ * @param level The settled pin level.
+ * @param stamp DWT_CYCCNT() at the interrupt of the latest edge.
+ */
+typedef void (*EXTI_Callback)(uint8_t line, uint8_t level, uint32_t stamp);
+
+/**
+ * @brief Timestamp ring and counters of a line in capture mode.
+ */
+typedef struct {
+    uint32_t *buf;              // Timestamp ring, DWT cycles at interrupt entry
+    uint16_t mask;              // Ring size - 1
+    volatile uint16_t head;     // Next free slot, written only by the interrupt handler
+    volatile uint16_t tail;     // Next timestamp to take, written only by the reader
+    uint8_t both;               // 1 when both edges are captured
+    uint8_t level;              // Pin level at the previous edge, for missed-edge detection
+    uint8_t prev_valid;         // 1 once prev holds a taken timestamp
+    uint32_t prev;              // Last taken timestamp, the reference of the next interval
+    volatile uint32_t edges;    // Edge interrupts seen
+    volatile uint32_t dropped;  // Edges lost to a full ring
+    volatile uint32_t missed;   // Edges merged by the hardware before the interrupt could run (both-edge mode)
+} EXTI_Capture_TypeDef;
+
 /**
  * @brief Initializes external interrupt lines and NVIC.
  *
@@ -26,4 +58,103 @@
  */
 void My_EXTI_Init(void);
 
+/**
+ * @brief Registers a callback for an EXTI line and enables the line.
+ *
+ * The pin must already be configured as an input. Lines 5-9 and 10-15 share one interrupt each, so the last
+ * registration sets the priority of the shared vector. The edges are timestamped with the cycle counter, so the
+ * registration calls DWT_Init(), which leaves a running counter alone.
+ *
+ * @param port_source The port of the pin, GPIO_PortSourceGPIOA ... GPIO_PortSourceGPIOG.
+ * @param line The EXTI line, which is also the pin number, 0-15.
+ * @param trigger EXTI_Trigger_Rising, EXTI_Trigger_Falling or EXTI_Trigger_Rising_Falling; the callback is only
+ *        called for settled levels that match it.
+ * @param debounce_ms How long the line must be quiet before its level counts, 0 to take the level at once; at most
+ *        2^31 cycles (about 29 s at 72 MHz), longer times are clamped.
+ * @param cb Called from EXTI_Process() with the settled level.
+ * @param preempt The preemption priority of the line's interrupt.
+ * @param sub The subpriority of the line's interrupt.
+ * @return 1 if registered, 0 if the port or line is invalid.
+ */
+uint8_t EXTI_Line_Register(uint8_t port_source, uint8_t line, EXTITrigger_TypeDef trigger, uint16_t debounce_ms,
+                           EXTI_Callback cb, uint8_t preempt, uint8_t sub);
+
+/**
+ * @brief Disables an EXTI line and drops its callback. Edges already queued for it are ignored.
+ *
+ * @param line The EXTI line, 0-15.
+ * @return void
+ */
+void EXTI_Line_Unregister(uint8_t line);
+
+/**
+ * @brief Handles the queued edges in thread context; call it from the main loop.
+ *
+ * Each edge restarts the quiet time of its line. Once a line has been quiet for its debounce time its pin is
+ * read, and if the settled level differs from the previous one and matches the line's trigger the callback is
+ * called. Lines without debouncing get one callback per queued edge, in queue order. Lines still settling are
+ * checked again on the next call, so nothing waits.
+ *
+ * @return void
+ */
+void EXTI_Process(void);
+
+/**
+ * @brief Returns the number of edges lost because the queue was full.
+ *
+ * @return The number of dropped edges.
+ */
+uint32_t EXTI_Dropped(void);
+
+/**
+ * @brief Puts an EXTI line in capture mode: every edge is timestamped at interrupt entry into a ring.
+ *
+ * The pin must already be configured as an input; DWT_Init() is called for the timestamps. With
+ * EXTI_Trigger_Rising_Falling the handler also reads the pin, so edge pairs that came too fast for the interrupt
+ * can be counted as missed; with a single edge the hardware merges such edges without a trace.
+ * EXTI_Line_Unregister() stops the capture.
+ *
+ * @param cap The capture handle, which must stay valid while capturing.
+ * @param port_source The port of the pin, GPIO_PortSourceGPIOA ... GPIO_PortSourceGPIOG.
+ * @param line The EXTI line, which is also the pin number, 0-15.
+ * @param trigger EXTI_Trigger_Rising, EXTI_Trigger_Falling or EXTI_Trigger_Rising_Falling.
+ * @param buf The timestamp ring.
+ * @param size The number of timestamps in buf, a power of two.
+ * @param preempt The preemption priority of the line's interrupt.
+ * @param sub The subpriority of the line's interrupt.
+ * @return 1 if capturing, 0 if the port, line or size is invalid.
+ */
+uint8_t EXTI_Capture_Start(EXTI_Capture_TypeDef *cap, uint8_t port_source, uint8_t line,
+                           EXTITrigger_TypeDef trigger, uint32_t *buf, uint16_t size, uint8_t preempt, uint8_t sub);
+
+/**
+ * @brief Takes the oldest captured timestamps.
+ *
+ * @param cap The capture handle.
+ * @param stamps Receives up to max timestamps in DWT cycles, oldest first.
+ * @param max The size of stamps.
+ * @return The number of timestamps taken.
+ */
+uint16_t EXTI_Capture_Read(EXTI_Capture_TypeDef *cap, uint32_t *stamps, uint16_t max);
+
+/**
+ * @brief Takes the next inter-edge interval.
+ *
+ * The interval is measured from the previously taken timestamp, so the first edge after the start only sets
+ * the reference. Intervals must be shorter than the cycle counter period, about 59 s at 72 MHz.
+ *
+ * @param cap The capture handle.
+ * @param cycles Receives the interval in DWT cycles.
+ * @return 1 if an interval was taken, 0 if no complete interval is waiting.
+ */
+uint8_t EXTI_Capture_Interval(EXTI_Capture_TypeDef *cap, uint32_t *cycles);
+
+/**
+ * @brief Returns the edge rate over the timestamps waiting in the ring, without taking them.
+ *
+ * @param cap The capture handle.
+ * @return The rate in edges per second, 0 if fewer than two timestamps are waiting.
+ */
+uint32_t EXTI_Capture_Rate(const EXTI_Capture_TypeDef *cap);
+
 #endif  // EXTERNAL_INTERUPT_EXIT_EXTI_H_
@@ -7,8 +7,12 @@
  *
  * This file contains the implementation of the RCC_HSE_Config function, which configures the HSE clock,
  * divides it, and sets the PLL. It allows the user to customize the system time by modifying the clock.
+ * RCC_HSE_Config_Async() does the same as a coroutine, without blocking while the oscillators start.
  */
 
+#include "hse.h"
+#include "coro.h"
+
 /**
  * @brief Configures the High Speed External (HSE) clock, divides it, and sets the PLL.
  *
@@ -43,3 +47,39 @@ void RCC_HSE_Config(uint32_t div, uint32_t pllm) {  // Customize system time (ca
         while (RCC_GetSYSCLKSource() != 0x08) {}
     }
 }
+
+/**
+ * @brief Awaitable version of RCC_HSE_Config(): switches the system clock to the HSE PLL without blocking.
+ *
+ * The coroutine waits for the HSE, the PLL and the clock switch instead of spinning, and gives up after
+ * HSE_STARTUP_TICKS if the HSE does not start. The SysTick clock must be running. RCC_DeInit() drops the system
+ * clock to the HSI first, so ticks run slower until SysTick_Init() is called again after the switch.
+ *
+ * @param c The coroutine context of this operation.
+ * @param div Division factor for the HSE clock (RCC_PLLSource_HSE_Div1 or RCC_PLLSource_HSE_Div2).
+ * @param pllm PLL multiplication factor (RCC_PLLMul_2 ... RCC_PLLMul_16).
+ * @param ok Receives 1 if the system clock now runs from the PLL, 0 if the HSE did not start.
+ *
+ * @return CORO_WAITING while switching, CORO_DONE when ok is valid.
+ */
+uint8_t RCC_HSE_Config_Async(Coro_TypeDef *c, uint32_t div, uint32_t pllm, uint8_t *ok) {
+    CORO_BEGIN(c);
+    *ok = 0;
+    RCC_DeInit();  // Reset the peripheral RCC registers to their default values
+    RCC_HSEConfig(RCC_HSE_ON);  // Set the external high-speed oscillator (HSE)
+    CORO_TIMEOUT(c, HSE_STARTUP_TICKS);
+    CORO_WAIT_UNTIL(c, RCC_GetFlagStatus(RCC_FLAG_HSERDY) == SET || CORO_TIMED_OUT(c));  // Wait for HSE to start up
+    if (RCC_GetFlagStatus(RCC_FLAG_HSERDY) == RESET) {
+        CORO_EXIT(c);  // The system clock stays on the HSI
+    }
+    RCC_HCLKConfig(RCC_SYSCLK_Div1);  // Set the AHB clock (HCLK)
+    RCC_PCLK1Config(RCC_HCLK_Div2);  // Set the low-speed AHB clock (PCLK1)
+    RCC_PCLK2Config(RCC_HCLK_Div1);  // Set the high-speed AHB clock (PCLK2)
+    RCC_PLLConfig(div, pllm);  // Set the PLL clock source and multiplication factor
+    RCC_PLLCmd(ENABLE);  // Enable or disable the PLL
+    CORO_WAIT_UNTIL(c, RCC_GetFlagStatus(RCC_FLAG_PLLRDY) == SET);  // PLL ready
+    RCC_SYSCLKConfig(RCC_SYSCLKSource_PLLCLK);  // Set the system clock (SYSCLK)
+    CORO_WAIT_UNTIL(c, RCC_GetSYSCLKSource() == 0x08);  // 0x08: PLL as the system clock
+    *ok = 1;
+    CORO_END(c);
+}
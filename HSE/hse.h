@@ -0,0 +1,44 @@
+/**
+ * @file hse.h
+ * @brief Header file for the High Speed External (HSE) clock and PLL configuration.
+ * @author Yixiang Fan
+ * @date 2024-07-29
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#ifndef HSE_HSE_H_
+#define HSE_HSE_H_
+
+#include "system.h"
+
+struct Coro_TypeDef;  // Coroutine context, see coro.h
+
+#define HSE_STARTUP_TICKS 100  // SysTick ticks RCC_HSE_Config_Async() waits for the HSE to start
+
+/**
+ * @brief Configures the High Speed External (HSE) clock, divides it, and sets the PLL.
+ *
+ * @param div Division factor for the HSE clock (RCC_PLLSource_HSE_Div1 or RCC_PLLSource_HSE_Div2).
+ * @param pllm PLL multiplication factor (RCC_PLLMul_2 ... RCC_PLLMul_16).
+ *
+ * @return None
+ */
+void RCC_HSE_Config(uint32_t div, uint32_t pllm);
+
+/**
+ * @brief Awaitable version of RCC_HSE_Config(): switches the system clock to the HSE PLL without blocking.
+ *
+ * The coroutine waits for the HSE, the PLL and the clock switch instead of spinning, and gives up after
+ * HSE_STARTUP_TICKS if the HSE does not start. The SysTick clock must be running. RCC_DeInit() drops the system
+ * clock to the HSI first, so ticks run slower until SysTick_Init() is called again after the switch.
+ *
+ * @param c The coroutine context of this operation.
+ * @param div Division factor for the HSE clock (RCC_PLLSource_HSE_Div1 or RCC_PLLSource_HSE_Div2).
+ * @param pllm PLL multiplication factor (RCC_PLLMul_2 ... RCC_PLLMul_16).
+ * @param ok Receives 1 if the system clock now runs from the PLL, 0 if the HSE did not start.
+ *
+ * @return CORO_WAITING while switching, CORO_DONE when ok is valid.
+ */
+uint8_t RCC_HSE_Config_Async(struct Coro_TypeDef *c, uint32_t div, uint32_t pllm, uint8_t *ok);
+
+#endif  // HSE_HSE_H_
@@ -7,10 +7,13 @@
  */
 
 #include "input.h"
+#include "dwt.h"
 
 unit8_t TIM5_CH1_CAPTURE_STA;   // Input capture status
 uint16_t TIM5_CH1_CAPTURE_VAL;  // Input capture value
 
+static Input_Capture_Callback tim5_ch1_capture_cb;  // Called on every completed capture, NULL to poll
+
 /**
  * @brief Initializes the TIM5 timer for input capture.
  *
@@ -58,6 +61,18 @@ void TIM5_CH1_Input_Init(uint16_t arr, uint16_t psc) {
     TIM_Cmd(TIM5, ENABLE);  // Enable timer
 }
 
+/**
+ * @brief Registers a callback for completed captures.
+ *
+ * With a callback, the TIM5 interrupt hands every completed high-level time to it and starts the next capture
+ * itself; TIM5_CH1_CAPTURE_STA then no longer needs to be polled.
+ *
+ * @param cb Called from the TIM5 interrupt with the high-level time in timer counts; NULL to poll instead.
+ */
+void TIM5_CH1_Set_Callback(Input_Capture_Callback cb) {
+    tim5_ch1_capture_cb = cb;
+}
+
 /**
  * @brief Interrupt handler for TIM5.
  *
@@ -65,6 +80,7 @@ void TIM5_CH1_Input_Init(uint16_t arr, uint16_t psc) {
  * and updates the capture status and value accordingly.
  */
 void TIM5_IRQHandler(void) {
+    DWT_PROF_BEGIN(tim5_irq);
     if ((TIM5_CH1_CAPTURE_STA & 0x80) == 0) {                 // Not yet successfully captured
         if (TIM_GetITStatus(TIM5, TIM_IT_Update)) {           // Update interrupt occurred
             if (TIM5_CH1_CAPTURE_STA & 0x40) {                // Captured high level
@@ -93,4 +109,12 @@ void TIM5_IRQHandler(void) {
         }
     }
     TIM_ClearITPendingBit(TIM5, TIM_IT_CC1 | TIM_IT_Update);
+
+    if ((TIM5_CH1_CAPTURE_STA & 0x80) && tim5_ch1_capture_cb) {
+        unit32_t ticks = (TIM5_CH1_CAPTURE_STA & 0x3f) * 0xffff + TIM5_CH1_CAPTURE_VAL;  // Overflows + last count
+
+        TIM5_CH1_CAPTURE_STA = 0;  // Start the next capture
+        tim5_ch1_capture_cb(ticks);
+    }
+    DWT_PROF_END(tim5_irq);
 }
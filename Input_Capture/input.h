@@ -14,6 +14,13 @@
 extern unit8_t TIM5_CH1_CAPTURE_STA;   // Input capture status
 extern uint16_t TIM5_CH1_CAPTURE_VAL;  // Input capture value
 
+/**
+ * @brief Callback type for a completed capture.
+ *
+ * @param ticks The high-level time in timer counts.
+ */
+typedef void (*Input_Capture_Callback)(unit32_t ticks);
+
 /**
  * @brief Initializes the TIM5 timer for input capture.
  *
@@ -27,4 +34,14 @@ extern uint16_t TIM5_CH1_CAPTURE_VAL;  // Input capture value
  */
 void TIM5_CH1_Input_Init(uint16_t arr, uint16_t psc);
 
+/**
+ * @brief Registers a callback for completed captures.
+ *
+ * With a callback, the TIM5 interrupt hands every completed high-level time to it and starts the next capture
+ * itself; TIM5_CH1_CAPTURE_STA then no longer needs to be polled.
+ *
+ * @param cb Called from the TIM5 interrupt with the high-level time in timer counts; NULL to poll instead.
+ */
+void TIM5_CH1_Set_Callback(Input_Capture_Callback cb);
+
 #endif  // INPUT_CAPTURE_INPUT_H_
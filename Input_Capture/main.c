@@ -9,12 +9,32 @@
 #include "SysTick.h"
 #include "input.h"
 #include "led.h"
+#include "sched.h"
+#include "sched_src.h"
 #include "system.h"
 #include "usart.h"
 
+enum { SIG_CAPTURE = 1, SIG_BLINK };
+
+/**
+ * @brief Application task: prints every captured high-level time and blinks LED1.
+ *
+ * @param ev The event.
+ */
+void App_Handler(const Sched_Event_TypeDef *ev) {
+    switch (ev->sig) {
+        case SIG_CAPTURE:
+            printf("High-level duration: %d us\r\n", (int)ev->data);  // Display the total high-level time
+            break;
+        case SIG_BLINK:
+            led1 = !led1;
+            break;
+    }
+}
+
 int main() {
-    unit8_t i = 0;
-    unit32_t indata = 0;
+    static Sched_Timer_TypeDef blink_timer;
+    unit8_t app;
 
     SysTick_Init(72);
     NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);  // Configure interrupt priority groups
@@ -22,19 +42,9 @@ int main() {
     USART1_Init(9600);
     TIM5_CH1_Input_Init(0xffff, 71);  // Initialize input capture with 1 MHz frequency
 
-    while (1) {
-        if (TIM5_CH1_CAPTURE_STA & 0x80) {  // Successful capture
-            indata = TIM5_CH1_CAPTURE_STA & 0x3f;
-            indata *= 0xffff;                // Multiply overflow times by the count time of a single count
-            indata += TIM5_CH1_CAPTURE_VAL;  // Accumulate the time of high-level capture
-            printf("High-level duration: %d us\r\n", indata);  // Display the total high-level time
-            TIM5_CH1_CAPTURE_STA = 0;                          // Start the next capture
-        }
-
-        i++;
-        if (i % 20 == 0) {
-            led1 = !led1;  // Toggle LED1 every 20 iterations
-        }
-        delay_ms(10);
-    }
+    Sched_Init();
+    app = Sched_Task_Add(App_Handler, 1);
+    Sched_Src_Capture(app, SIG_CAPTURE);                        // Captures arrive as events, no polling
+    Sched_Timer_Start(&blink_timer, app, SIG_BLINK, 200, 200);  // Toggle LED1 every 200 ms
+    Sched_Run();
 }
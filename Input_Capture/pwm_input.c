@@ -0,0 +1,178 @@
+/**
+ * @file pwm_input.c
+ * @brief Source file for the TIM5 PWM-input frequency and duty cycle meter.
+ * @author Yixiang Fan
+ * @date 2024-08-13
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "pwm_input.h"
+#include "time.h"
+
+#define PWMI_MASK (PWMI_RING - 1)
+
+typedef char pwmi_ring_must_be_a_power_of_two[(PWMI_RING & PWMI_MASK) == 0 ? 1 : -1];
+
+static uint16_t pwmi_ring[2 * PWMI_RING];  // CCR1 (period) and CCR2 (high time) pairs written by the DMA burst
+static uint32_t pwmi_clock;                // Timer clock in Hz
+static uint32_t pwmi_div;                  // Timer clock cycles per tick, psc + 1
+
+/**
+ * @brief (Re)starts the DMA ring from its first pair, with the transfer flags cleared.
+ *
+ * The first pair after a start holds the time from the start to the first edge rather than a period, so the read
+ * side never uses slot 0 before the ring has wrapped.
+ *
+ * @param void
+ * @return void
+ */
+static void PWMI_Ring_Start(void) {
+    DMA_InitTypeDef DMA_InitStructure;
+
+    DMA_Cmd(DMA2_Channel5, DISABLE);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&TIM5->DMAR;  // Each access moves the next burst register
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)pwmi_ring;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;  // Peripheral to memory
+    DMA_InitStructure.DMA_BufferSize = 2 * PWMI_RING;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA2_Channel5, &DMA_InitStructure);
+    DMA_ClearFlag(DMA2_FLAG_GL5);  // The transfer-complete flag tells whether the ring has wrapped
+    DMA_Cmd(DMA2_Channel5, ENABLE);
+}
+
+/**
+ * @brief Starts measuring the signal on PA0.
+ *
+ * Periods are measured in ticks of TIM_APB1_Clock() / (psc + 1) and must be at most arr ticks long; a longer
+ * period, or a signal that stops, lets the counter overflow and reads as no signal. Choose psc so that the slowest
+ * expected period fits into arr ticks: the finer the tick, the better the resolution. The hardware delays both
+ * edges by the same input filter and resynchronization, so the width and duty cycle are not biased by them.
+ *
+ * @param arr The longest period in ticks, 2 to 0xffff.
+ * @param psc The prescaler value.
+ * @param filter The input filter, 0x0-0xf as for TIM_ICFilter.
+ * @return The tick rate in Hz, or 0 if arr or filter is invalid.
+ */
+uint32_t PWMI_Init(uint16_t arr, uint16_t psc, uint8_t filter) {
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    TIM_ICInitTypeDef TIM_ICInitStructure;
+    GPIO_InitTypeDef GPIO_InitStructure;
+
+    if (arr < 2 || filter > 0xf) {
+        return 0;
+    }
+
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM5, ENABLE);  // Enable TIM5 clock
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);    // Enable DMA2 clock
+
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_0;      // TIM5_CH1
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IPD;  // Set pull-down input mode
+    GPIO_Init(GPIOA, &GPIO_InitStructure);
+
+    TIM_DeInit(TIM5);  // Drop whatever mode another driver left TIM5 in
+    TIM_TimeBaseInitStructure.TIM_Period = arr;     // Auto-reload value
+    TIM_TimeBaseInitStructure.TIM_Prescaler = psc;  // Prescaler
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;  // Set up count mode
+    TIM_TimeBaseInit(TIM5, &TIM_TimeBaseInitStructure);
+    TIM_UpdateRequestConfig(TIM5, TIM_UpdateSource_Regular);  // Only overflows set the update flag, not edge resets
+
+    TIM_ICInitStructure.TIM_Channel = TIM_Channel_1;                 // CH2 gets the opposite edge, indirect
+    TIM_ICInitStructure.TIM_ICFilter = filter;                       // Filter
+    TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_Rising;      // The period runs from rising edge to rising edge
+    TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;            // Every edge
+    TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;  // Direct mapping to TI1
+    TIM_PWMIConfig(TIM5, &TIM_ICInitStructure);
+
+    TIM_SelectInputTrigger(TIM5, TIM_TS_TI1FP1);
+    TIM_SelectSlaveMode(TIM5, TIM_SlaveMode_Reset);  // Every rising edge captures CCR1, then restarts the count
+
+    TIM_DMAConfig(TIM5, TIM_DMABase_CCR1, TIM_DMABurstLength_2Transfers);  // CCR1 then CCR2 on every request
+    PWMI_Ring_Start();
+    TIM_DMACmd(TIM5, TIM_DMA_CC1, ENABLE);
+
+    TIM_ClearFlag(TIM5, TIM_FLAG_Update);  // Set by the update event that loaded the prescaler
+    TIM_Cmd(TIM5, ENABLE);                 // Enable timer
+    pwmi_clock = TIM_APB1_Clock();
+    pwmi_div = (uint32_t)psc + 1;
+    return (pwmi_clock + pwmi_div / 2) / pwmi_div;
+}
+
+/**
+ * @brief Stops the measurement and releases TIM5 and DMA2 Channel5.
+ *
+ * @param void
+ * @return void
+ */
+void PWMI_Stop(void) {
+    TIM_DMACmd(TIM5, TIM_DMA_CC1, DISABLE);
+    TIM_Cmd(TIM5, DISABLE);
+    DMA_Cmd(DMA2_Channel5, DISABLE);
+}
+
+/**
+ * @brief Averages the newest periods of the signal.
+ *
+ * Nothing is consumed, so it can be called as often as needed. If the counter overflowed since the previous call,
+ * the signal stopped or slowed down beyond arr ticks at some point; the ring is then restarted and the call
+ * returns 0.
+ *
+ * @param n The number of periods to average, 1 to PWMI_RING - 1; clipped to the periods captured so far.
+ * @param res Receives the mean period and high time in ticks, the duty cycle, the frequency and the number of
+ *        periods averaged.
+ * @return 1 if at least one period was averaged, 0 if there is no signal (yet).
+ */
+uint8_t PWMI_Read(uint16_t n, Capture_Result_TypeDef *res) {
+    uint32_t period = 0;
+    uint32_t high = 0;
+    uint64_t cycles;
+    uint64_t mhz;
+    uint16_t next;
+    uint16_t avail;
+    uint16_t slot;
+    uint16_t k;
+    uint8_t wrapped;
+
+    if (TIM_GetFlagStatus(TIM5, TIM_FLAG_Update)) {
+        TIM_ClearFlag(TIM5, TIM_FLAG_Update);
+        PWMI_Ring_Start();  // The pair after the overflow holds a wrapped count, not a period
+        return 0;
+    }
+
+    // The flag is read before the index: if the ring wraps in between, fewer pairs are used, never a stale slot 0
+    wrapped = DMA_GetFlagStatus(DMA2_FLAG_TC5);
+    next = ((2 * PWMI_RING - DMA_GetCurrDataCounter(DMA2_Channel5)) / 2) & PWMI_MASK;  // A half-done burst is next
+    if (wrapped) {
+        avail = PWMI_RING - 1;  // Every pair but the one being written next
+    } else {
+        avail = next ? next - 1 : 0;  // Slots 1 to next - 1
+    }
+    if (n > avail) {
+        n = avail;
+    }
+
+    for (k = 1; k <= n; ++k) {
+        slot = (next - k) & PWMI_MASK;  // Newest first, away from the slot the DMA writes next
+        period += pwmi_ring[2 * slot];
+        high += pwmi_ring[2 * slot + 1];
+    }
+    if (period == 0) {
+        return 0;
+    }
+
+    res->period = (period + n / 2) / n;
+    res->width = (high + n / 2) / n;
+    res->duty = (uint16_t)(((uint64_t)high * 10000 + period / 2) / period);
+    cycles = (uint64_t)period * pwmi_div;  // From the timer clock, exact where the rounded tick rate is not
+    mhz = ((uint64_t)n * pwmi_clock * 1000 + cycles / 2) / cycles;
+    res->freq_mhz = mhz > 0xffffffff ? 0xffffffff : (uint32_t)mhz;  // Saturates above about 4.29 MHz
+    res->periods = n;
+    return 1;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file pwm_input.h
+ * @brief Header file for the TIM5 PWM-input frequency and duty cycle meter.
+ * @author Yixiang Fan
+ * @date 2024-08-13
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The signal on PA0 drives both TIM5 CH1 (rising edges, direct) and CH2 (falling edges, indirect), and every
+ * rising edge resets the counter through the slave controller (reset mode on TI1FP1). The hardware then leaves
+ * the period in CCR1 and the high time in CCR2 on its own. Each CH1 capture also requests a two-transfer DMA burst
+ * through TIM5_DMAR, which copies CCR1 and CCR2 into a circular ring on DMA2 Channel5, so no edge costs CPU time and
+ * PWMI_Read() averages the newest periods straight from memory.
+ *
+ * This mode resets the TIM5 counter, so it cannot run together with the capture engine of
+ * Capture_Engine/capture.h, whose result type it shares.
+ */
+
+#ifndef INPUT_CAPTURE_PWM_INPUT_H_
+#define INPUT_CAPTURE_PWM_INPUT_H_
+
+#include "system.h"
+#include "capture.h"
+
+#define PWMI_RING 32  // Periods kept in the DMA ring; up to PWMI_RING - 1 can be averaged
+
+/**
+ * @brief Starts measuring the signal on PA0.
+ *
+ * Periods are measured in ticks of TIM_APB1_Clock() / (psc + 1) and must be at most arr ticks long; a longer
+ * period, or a signal that stops, lets the counter overflow and reads as no signal. Choose psc so that the slowest
+ * expected period fits into arr ticks: the finer the tick, the better the resolution. The hardware delays both
+ * edges by the same input filter and resynchronization, so the width and duty cycle are not biased by them.
+ *
+ * @param arr The longest period in ticks, 2 to 0xffff.
+ * @param psc The prescaler value.
+ * @param filter The input filter, 0x0-0xf as for TIM_ICFilter.
+ * @return The tick rate in Hz, or 0 if arr or filter is invalid.
+ */
+uint32_t PWMI_Init(uint16_t arr, uint16_t psc, uint8_t filter);
+
+/**
+ * @brief Stops the measurement and releases TIM5 and DMA2 Channel5.
+ *
+ * @param void
+ * @return void
+ */
+void PWMI_Stop(void);
+
+/**
+ * @brief Averages the newest periods of the signal.
+ *
+ * Nothing is consumed, so it can be called as often as needed. If the counter overflowed since the previous call,
+ * the signal stopped or slowed down beyond arr ticks at some point; the ring is then restarted and the call
+ * returns 0.
+ *
+ * @param n The number of periods to average, 1 to PWMI_RING - 1; clipped to the periods captured so far.
+ * @param res Receives the mean period and high time in ticks, the duty cycle, the frequency and the number of
+ *        periods averaged.
+ * @return 1 if at least one period was averaged, 0 if there is no signal (yet).
+ */
+uint8_t PWMI_Read(uint16_t n, Capture_Result_TypeDef *res);
+
+#endif  // INPUT_CAPTURE_PWM_INPUT_H_
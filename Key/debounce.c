@@ -0,0 +1,135 @@
+/**
+ * @file debounce.c
+ * @brief Source file for the bitwise debouncer of whole GPIO input ports.
+ * @author Yixiang Fan
+ * @date 2024-08-12
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "debounce.h"
+
+/**
+ * @brief Returns the 16-bit half of a bank word that belongs to a port.
+ *
+ * @param w The bank words.
+ * @param i The port index.
+ *
+ * @return The port's bits.
+ */
+static uint16_t Debounce_Half(const uint32_t *w, uint8_t i) {
+    return (uint16_t)(w[i >> 1] >> ((i & 1) * 16));
+}
+
+/**
+ * @brief Initializes a bank. The pins must already be configured as inputs.
+ *
+ * @param d The bank.
+ * @param ports The ports to sample, up to DEBOUNCE_MAX_PORTS; NULL if samples only come from Debounce_Process().
+ * @param invert Per port, the pins that read 0 when pressed; NULL if all pins are active high.
+ * @param nports The number of ports.
+ *
+ * @return void
+ */
+void Debounce_Init(Debounce_TypeDef *d, GPIO_TypeDef *const *ports, const uint16_t *invert, uint8_t nports) {
+    uint8_t i;
+
+    if (nports > DEBOUNCE_MAX_PORTS) {
+        nports = DEBOUNCE_MAX_PORTS;
+    }
+    d->nports = nports;
+    for (i = 0; i < DEBOUNCE_MAX_PORTS; ++i) {
+        d->port[i] = i < nports && ports ? ports[i] : 0;
+        d->invert[i] = i < nports && invert ? invert[i] : 0;
+    }
+    for (i = 0; i < DEBOUNCE_WORDS; ++i) {
+        d->state[i] = 0;  // Everything starts released
+        d->cnt0[i] = 0;
+        d->cnt1[i] = 0;
+        d->pressed[i] = 0;
+        d->released[i] = 0;
+    }
+}
+
+/**
+ * @brief Samples every port of the bank once and debounces the samples; call it at a fixed period.
+ *
+ * @param d The bank.
+ *
+ * @return void
+ */
+void Debounce_Update(Debounce_TypeDef *d) {
+    uint16_t raw[DEBOUNCE_MAX_PORTS];
+    uint8_t i;
+
+    for (i = 0; i < d->nports; ++i) {
+        raw[i] = (uint16_t)d->port[i]->IDR;
+    }
+    Debounce_Process(d, raw);
+}
+
+/**
+ * @brief Debounces one set of raw port samples.
+ *
+ * @param d The bank.
+ * @param raw The raw IDR value of every port of the bank, before inversion.
+ *
+ * @return void
+ */
+void Debounce_Process(Debounce_TypeDef *d, const uint16_t *raw) {
+    uint32_t sample;
+    uint32_t delta;
+    uint32_t toggle;
+    uint8_t w;
+    uint8_t i;
+
+    for (w = 0, i = 0; i < d->nports; ++w, i += 2) {
+        sample = (uint16_t)(raw[i] ^ d->invert[i]);
+        if (i + 1 < d->nports) {
+            sample |= (uint32_t)(uint16_t)(raw[i + 1] ^ d->invert[i + 1]) << 16;
+        }
+
+        delta = sample ^ d->state[w];                    // Pins that disagree with the debounced state
+        d->cnt1[w] = (d->cnt1[w] ^ d->cnt0[w]) & delta;  // Count up where they disagree, clear where they agree
+        d->cnt0[w] = ~d->cnt0[w] & delta;
+        toggle = delta & ~(d->cnt0[w] | d->cnt1[w]);  // Counters that wrapped: DEBOUNCE_SAMPLES in a row
+        d->state[w] ^= toggle;
+        d->pressed[w] = toggle & d->state[w];
+        d->released[w] = toggle & ~d->state[w];
+    }
+}
+
+/**
+ * @brief Returns the debounced pins of a port.
+ *
+ * @param d The bank.
+ * @param i The port index in the bank.
+ *
+ * @return The pins that are pressed.
+ */
+uint16_t Debounce_Get_State(const Debounce_TypeDef *d, uint8_t i) {
+    return Debounce_Half(d->state, i);
+}
+
+/**
+ * @brief Returns the pins of a port that became pressed in the last update.
+ *
+ * @param d The bank.
+ * @param i The port index in the bank.
+ *
+ * @return The rising edges of the debounced pins.
+ */
+uint16_t Debounce_Get_Pressed(const Debounce_TypeDef *d, uint8_t i) {
+    return Debounce_Half(d->pressed, i);
+}
+
+/**
+ * @brief Returns the pins of a port that became released in the last update.
+ *
+ * @param d The bank.
+ * @param i The port index in the bank.
+ *
+ * @return The falling edges of the debounced pins.
+ */
+uint16_t Debounce_Get_Released(const Debounce_TypeDef *d, uint8_t i) {
+    return Debounce_Half(d->released, i);
+}
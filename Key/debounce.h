@@ -0,0 +1,99 @@
+/**
+ * @file debounce.h
+ * @brief Header file for the bitwise debouncer of whole GPIO input ports.
+ * @author Yixiang Fan
+ * @date 2024-08-12
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Every pin has a 2-bit counter, stored "vertically": bit 0 of all counters is one word and bit 1 another, so a
+ * single sequence of word operations advances the counters of all pins at once. A counter runs while its pin
+ * differs from the debounced state and is cleared as soon as it agrees again; after DEBOUNCE_SAMPLES differing
+ * samples in a row the debounced bit flips. Two 16-bit IDR words are packed into each 32-bit word, so a whole
+ * bank of DEBOUNCE_MAX_PORTS ports (64 pins) costs a few instructions per two ports and has no per-pin branches.
+ */
+
+#ifndef KEY_DEBOUNCE_H_
+#define KEY_DEBOUNCE_H_
+
+#include "system.h"
+
+#define DEBOUNCE_MAX_PORTS 4                           // Ports per bank, 16 pins each
+#define DEBOUNCE_WORDS ((DEBOUNCE_MAX_PORTS + 1) / 2)  // 32-bit words per bank
+#define DEBOUNCE_SAMPLES 4                             // Samples in a row needed for a change (2-bit counters)
+
+/**
+ * @brief A bank of debounced GPIO ports.
+ */
+typedef struct {
+    GPIO_TypeDef *port[DEBOUNCE_MAX_PORTS];  // Sampled ports
+    uint16_t invert[DEBOUNCE_MAX_PORTS];     // Pins that are active low, so that 1 always means pressed
+    uint8_t nports;                          // Number of ports in use
+    uint32_t state[DEBOUNCE_WORDS];          // Debounced pins, 1 = pressed
+    uint32_t cnt0[DEBOUNCE_WORDS];           // Bit 0 of the per-pin counters
+    uint32_t cnt1[DEBOUNCE_WORDS];           // Bit 1 of the per-pin counters
+    uint32_t pressed[DEBOUNCE_WORDS];        // Pins that became pressed in the last update
+    uint32_t released[DEBOUNCE_WORDS];       // Pins that became released in the last update
+} Debounce_TypeDef;
+
+/**
+ * @brief Initializes a bank. The pins must already be configured as inputs.
+ *
+ * @param d The bank.
+ * @param ports The ports to sample, up to DEBOUNCE_MAX_PORTS; NULL if samples only come from Debounce_Process().
+ * @param invert Per port, the pins that read 0 when pressed; NULL if all pins are active high.
+ * @param nports The number of ports.
+ *
+ * @return void
+ */
+void Debounce_Init(Debounce_TypeDef *d, GPIO_TypeDef *const *ports, const uint16_t *invert, uint8_t nports);
+
+/**
+ * @brief Samples every port of the bank once and debounces the samples; call it at a fixed period.
+ *
+ * @param d The bank.
+ *
+ * @return void
+ */
+void Debounce_Update(Debounce_TypeDef *d);
+
+/**
+ * @brief Debounces one set of raw port samples.
+ *
+ * @param d The bank.
+ * @param raw The raw IDR value of every port of the bank, before inversion.
+ *
+ * @return void
+ */
+void Debounce_Process(Debounce_TypeDef *d, const uint16_t *raw);
+
+/**
+ * @brief Returns the debounced pins of a port.
+ *
+ * @param d The bank.
+ * @param i The port index in the bank.
+ *
+ * @return The pins that are pressed.
+ */
+uint16_t Debounce_Get_State(const Debounce_TypeDef *d, uint8_t i);
+
+/**
+ * @brief Returns the pins of a port that became pressed in the last update.
+ *
+ * @param d The bank.
+ * @param i The port index in the bank.
+ *
+ * @return The rising edges of the debounced pins.
+ */
+uint16_t Debounce_Get_Pressed(const Debounce_TypeDef *d, uint8_t i);
+
+/**
+ * @brief Returns the pins of a port that became released in the last update.
+ *
+ * @param d The bank.
+ * @param i The port index in the bank.
+ *
+ * @return The falling edges of the debounced pins.
+ */
+uint16_t Debounce_Get_Released(const Debounce_TypeDef *d, uint8_t i);
+
+#endif  // KEY_DEBOUNCE_H_
@@ -8,7 +8,8 @@
  * The key.c file provides functions for initializing the key input pins using GPIO and
  * scanning the key inputs to detect the pressed key. The KEY_Init() function configures
  * the GPIO pins for the key inputs, and the KEY_Scan() function continuously scans the
- * key inputs and returns the pressed key.
+ * key inputs and returns the pressed key. KEY_Read() samples the keys once without delay,
+ * for callers that debounce by sampling periodically.
  */
 
 #include "key.h"
@@ -84,3 +85,25 @@ unit8_t KEY_Scan(unit8_t mode) {
     }
     return 0;
 }
+
+/**
+ * @brief Samples the key inputs once and returns the pressed key, without debouncing or delay.
+ *
+ * When several keys are pressed, the one KEY_Scan() would report is returned.
+ *
+ * @param void No parameters are required for this function.
+ *
+ * @return An unit8_t value representing the pressed key, 0 if none, as for KEY_Scan().
+ */
+unit8_t KEY_Read(void) {
+    if (K_UP == 1) {
+        return KEY_UP;
+    } else if (K_DOWN == 0) {
+        return KEY_DOWN;
+    } else if (K_LEFT == 0) {
+        return KEY_LEFT;
+    } else if (K_RIGHT == 0) {
+        return KEY_RIGHT;
+    }
+    return 0;
+}
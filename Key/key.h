@@ -77,4 +77,15 @@ void KEY_Init(void);
  */
 uint8_t KEY_Scan(uint8_t mode);
 
+/**
+ * @brief Samples the key inputs once and returns the pressed key, without debouncing or delay.
+ *
+ * When several keys are pressed, the one KEY_Scan() would report is returned.
+ *
+ * @param void No parameters are required for this function.
+ *
+ * @return An unit8_t value representing the pressed key, 0 if none, as for KEY_Scan().
+ */
+uint8_t KEY_Read(void);
+
 #endif  // KEY_CONTROL_KEY_H_
@@ -0,0 +1,223 @@
+/**
+ * @file key_scan.c
+ * @brief Source file for the timer-driven, non-blocking key scanner.
+ * @author Yixiang Fan
+ * @date 2024-08-12
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "key_scan.h"
+#include "time.h"
+#include "dwt.h"
+
+#define KEY_INTEGRATOR_MAX (KEY_DEBOUNCE_MS / KEY_SCAN_TICK_MS)  // Integrator top
+#define KEY_LONG_TICKS (KEY_LONG_MS / KEY_SCAN_TICK_MS)
+#define KEY_REPEAT_TICKS (KEY_REPEAT_MS / KEY_SCAN_TICK_MS)
+
+static uint8_t key_integrator[KEY_SCAN_KEYS];  // Per-key integrator, 0 to KEY_INTEGRATOR_MAX
+static uint16_t key_hold[KEY_SCAN_KEYS];       // Ticks since press, held at KEY_LONG_TICKS after the long press
+static volatile uint8_t key_state;             // Debounced keys down
+
+static KEY_Event_TypeDef key_queue[KEY_EVENT_QUEUE];  // Event ring
+static volatile uint8_t key_queue_head;               // Next free slot, written only by the scanner
+static volatile uint8_t key_queue_tail;               // Next event to take, written only by the application
+static volatile uint32_t key_queue_dropped;           // Events lost to a full queue
+
+typedef char key_event_queue_must_be_a_power_of_two[(KEY_EVENT_QUEUE & (KEY_EVENT_QUEUE - 1)) ? -1 : 1];
+
+/**
+ * @brief Queues one event, dropping it if the queue is full.
+ *
+ * @param type The event type.
+ * @param key The key value, 0 for a chord.
+ *
+ * @return void
+ */
+static void KEY_Push_Event(uint8_t type, uint8_t key) {
+    uint8_t head = key_queue_head;
+    KEY_Event_TypeDef *ev;
+
+    if ((uint8_t)(head - key_queue_tail) >= KEY_EVENT_QUEUE) {
+        key_queue_dropped++;
+        return;
+    }
+    ev = &key_queue[head & (KEY_EVENT_QUEUE - 1)];
+    ev->type = type;
+    ev->key = key;
+    ev->mask = key_state;
+    __DMB();  // The event must be stored before the application can see the new head
+    key_queue_head = head + 1;
+}
+
+/**
+ * @brief Initializes the keys and starts scanning them from the TIM6 interrupt.
+ *
+ * @param void
+ *
+ * @return void
+ */
+void KEY_Scan_Init(void) {
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+    uint16_t per;
+    uint16_t psc;
+    uint8_t k;
+
+    KEY_Init();
+    for (k = 0; k < KEY_SCAN_KEYS; ++k) {
+        key_integrator[k] = 0;
+        key_hold[k] = 0;
+    }
+    key_state = 0;
+    key_queue_head = key_queue_tail;
+
+    TIM_Rate_Calc(TIM_APB1_Clock(), 1000 / KEY_SCAN_TICK_MS, &per, &psc);
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM6, ENABLE);  // Enable TIM6 clock
+
+    TIM_TimeBaseInitStructure.TIM_Period = per;     // Auto-reload value
+    TIM_TimeBaseInitStructure.TIM_Prescaler = psc;  // Prescaler factor
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;  // Set up count mode
+    TIM_TimeBaseInit(TIM6, &TIM_TimeBaseInitStructure);
+
+    TIM_ITConfig(TIM6, TIM_IT_Update, ENABLE);  // Enable timer interrupt
+    TIM_ClearITPendingBit(TIM6, TIM_IT_Update);
+
+    NVIC_InitStructure.NVIC_IRQChannel = TIM6_IRQn;            // Timer interrupt channel
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3;  // Preemption priority
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;         // Sub-priority
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;            // Enable IRQ channel
+    NVIC_Init(&NVIC_InitStructure);
+
+    TIM_Cmd(TIM6, ENABLE);  // Enable timer
+}
+
+/**
+ * @brief Reads all keys at once.
+ *
+ * @param void
+ *
+ * @return The raw pressed keys as KEY_MASK() bits.
+ */
+uint8_t KEY_Scan_Read(void) {
+    uint32_t a = KEY_UP_Port->IDR;  // One read per port, so all keys are sampled together
+    uint32_t e = KEY_Port->IDR;
+    uint8_t raw = 0;
+
+    if (a & KEY_UP_Pin) {  // K_UP is active high
+        raw |= KEY_MASK(KEY_UP);
+    }
+    if (!(e & KEY_DOWN_Pin)) {  // The others are active low
+        raw |= KEY_MASK(KEY_DOWN);
+    }
+    if (!(e & KEY_LEFT_Pin)) {
+        raw |= KEY_MASK(KEY_LEFT);
+    }
+    if (!(e & KEY_RIGHT_Pin)) {
+        raw |= KEY_MASK(KEY_RIGHT);
+    }
+    return raw;
+}
+
+/**
+ * @brief Runs one debounce tick on a raw key sample and queues the resulting events.
+ *
+ * Called by the TIM6 interrupt with KEY_Scan_Read(); it can also be fed samples from another source.
+ *
+ * @param raw The raw pressed keys as KEY_MASK() bits.
+ *
+ * @return void
+ */
+void KEY_Scan_Process(uint8_t raw) {
+    uint8_t pressed = 0;
+    uint8_t k;
+    uint8_t bit;
+
+    for (k = 0; k < KEY_SCAN_KEYS; ++k) {
+        bit = 1u << k;
+        if (raw & bit) {
+            if (key_integrator[k] < KEY_INTEGRATOR_MAX) {
+                key_integrator[k]++;
+            }
+        } else if (key_integrator[k]) {
+            key_integrator[k]--;
+        }
+
+        if (!(key_state & bit)) {
+            if (key_integrator[k] == KEY_INTEGRATOR_MAX) {
+                key_state |= bit;
+                key_hold[k] = 0;
+                pressed |= bit;
+                KEY_Push_Event(KEY_EVT_PRESS, k + 1);
+            }
+        } else if (key_integrator[k] == 0) {
+            key_state &= ~bit;
+            KEY_Push_Event(KEY_EVT_RELEASE, k + 1);
+        } else if (++key_hold[k] == KEY_LONG_TICKS) {
+            KEY_Push_Event(KEY_EVT_LONG, k + 1);
+        } else if (key_hold[k] == KEY_LONG_TICKS + KEY_REPEAT_TICKS) {
+            key_hold[k] = KEY_LONG_TICKS;
+            KEY_Push_Event(KEY_EVT_REPEAT, k + 1);
+        }
+    }
+
+    if (pressed && (key_state & (key_state - 1))) {  // A press left more than one key down
+        KEY_Push_Event(KEY_EVT_CHORD, 0);
+    }
+}
+
+/**
+ * @brief Takes the oldest key event without waiting.
+ *
+ * @param ev Receives the event.
+ *
+ * @return 1 if an event was taken, 0 if the queue is empty.
+ */
+uint8_t KEY_Get_Event(KEY_Event_TypeDef *ev) {
+    uint8_t tail = key_queue_tail;
+
+    if (tail == key_queue_head) {
+        return 0;
+    }
+    __DMB();
+    *ev = key_queue[tail & (KEY_EVENT_QUEUE - 1)];
+    __DMB();  // Read the event before the slot can be reused
+    key_queue_tail = tail + 1;
+    return 1;
+}
+
+/**
+ * @brief Returns the debounced keys that are down.
+ *
+ * @param void
+ *
+ * @return The keys as KEY_MASK() bits.
+ */
+uint8_t KEY_Get_State(void) {
+    return key_state;
+}
+
+/**
+ * @brief Returns the number of events lost because the queue was full.
+ *
+ * @param void
+ *
+ * @return The number of dropped events.
+ */
+uint32_t KEY_Events_Dropped(void) {
+    return key_queue_dropped;
+}
+
+/**
+ * @brief Interrupt handler for TIM6, runs one scan tick.
+ *
+ * @return void
+ */
+void TIM6_IRQHandler(void) {
+    DWT_PROF_BEGIN(tim6_irq);
+    if (TIM_GetITStatus(TIM6, TIM_IT_Update)) {
+        KEY_Scan_Process(KEY_Scan_Read());
+    }
+    TIM_ClearITPendingBit(TIM6, TIM_IT_Update);
+    DWT_PROF_END(tim6_irq);
+}
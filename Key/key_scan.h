@@ -0,0 +1,106 @@
+/**
+ * @file key_scan.h
+ * @brief Header file for the timer-driven, non-blocking key scanner.
+ * @author Yixiang Fan
+ * @date 2024-08-12
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * TIM6 interrupts every KEY_SCAN_TICK_MS. Each tick reads GPIOA and GPIOE once, packs the four keys into one
+ * bit mask and runs an integrator debounce per key: the integrator counts up while the key reads pressed and down
+ * while it reads released, and the debounced state only flips when it reaches the top or zero. Press, release,
+ * long-press, repeat and chord events go into a queue that the application drains with KEY_Get_Event(), so
+ * nothing ever waits.
+ */
+
+#ifndef KEY_KEY_SCAN_H_
+#define KEY_KEY_SCAN_H_
+
+#include "system.h"
+#include "key.h"
+
+#define KEY_SCAN_KEYS 4     // Number of keys, KEY_UP ... KEY_RIGHT
+#define KEY_SCAN_TICK_MS 5  // Scan period
+#define KEY_DEBOUNCE_MS 20  // Integrator range; a change must hold this long to count
+#define KEY_LONG_MS 1000    // Hold time before KEY_EVT_LONG
+#define KEY_REPEAT_MS 100   // Period of KEY_EVT_REPEAT after KEY_EVT_LONG
+#define KEY_EVENT_QUEUE 16  // Event queue size, must be a power of two
+
+#define KEY_MASK(key) (1u << ((key) - 1))  // Bit of a key value in a key mask
+
+/**
+ * @brief Key event types.
+ */
+typedef enum {
+    KEY_EVT_PRESS = 1,  // A key went down
+    KEY_EVT_RELEASE,    // A key went up
+    KEY_EVT_LONG,       // A key has been held for KEY_LONG_MS
+    KEY_EVT_REPEAT,     // A key is still held, every KEY_REPEAT_MS after KEY_EVT_LONG
+    KEY_EVT_CHORD       // A press left two or more keys down; key is 0, mask holds the keys
+} KEY_Event_Type;
+
+/**
+ * @brief A key event.
+ */
+typedef struct {
+    uint8_t type;  // KEY_Event_Type
+    uint8_t key;   // KEY_UP ... KEY_RIGHT, 0 for KEY_EVT_CHORD
+    uint8_t mask;  // Debounced keys down after the event, KEY_MASK() bits
+} KEY_Event_TypeDef;
+
+/**
+ * @brief Initializes the keys and starts scanning them from the TIM6 interrupt.
+ *
+ * @param void
+ *
+ * @return void
+ */
+void KEY_Scan_Init(void);
+
+/**
+ * @brief Reads all keys at once.
+ *
+ * @param void
+ *
+ * @return The raw pressed keys as KEY_MASK() bits.
+ */
+uint8_t KEY_Scan_Read(void);
+
+/**
+ * @brief Runs one debounce tick on a raw key sample and queues the resulting events.
+ *
+ * Called by the TIM6 interrupt with KEY_Scan_Read(); it can also be fed samples from another source.
+ *
+ * @param raw The raw pressed keys as KEY_MASK() bits.
+ *
+ * @return void
+ */
+void KEY_Scan_Process(uint8_t raw);
+
+/**
+ * @brief Takes the oldest key event without waiting.
+ *
+ * @param ev Receives the event.
+ *
+ * @return 1 if an event was taken, 0 if the queue is empty.
+ */
+uint8_t KEY_Get_Event(KEY_Event_TypeDef *ev);
+
+/**
+ * @brief Returns the debounced keys that are down.
+ *
+ * @param void
+ *
+ * @return The keys as KEY_MASK() bits.
+ */
+uint8_t KEY_Get_State(void);
+
+/**
+ * @brief Returns the number of events lost because the queue was full.
+ *
+ * @param void
+ *
+ * @return The number of dropped events.
+ */
+uint32_t KEY_Events_Dropped(void);
+
+#endif  // KEY_KEY_SCAN_H_
@@ -0,0 +1,289 @@
+/**
+ * @file matrix_key.c
+ * @brief Source file for the DMA-scanned matrix keypad.
+ * @author Yixiang Fan
+ * @date 2024-08-13
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Ghosting: without diodes, three keys at three corners of a rectangle also pull the fourth corner's row and
+ * column together, so that key reads pressed as well. Any two rows that share two or more pressed columns form
+ * such a rectangle and cannot be told apart, so the batch step feeds the debouncer the debounced state of those rows
+ * until the ambiguity goes away; new presses there are only reported once they can be resolved. Holding the raw
+ * reading of the last frame instead would latch a ghost that slipped through while a contact bounced, since rows
+ * are sampled at different times and a bouncing contact can read closed for one row and open for the next.
+ */
+
+#include "matrix_key.h"
+#include "debounce.h"
+#include "dma.h"
+#include "time.h"
+
+static Matrix_Key_Config_TypeDef matrix_cfg;       // Wiring
+static Matrix_Key_Callback matrix_cb;              // Called on debounced key changes
+static uint32_t matrix_bsrr[MATRIX_KEY_MAX_ROWS];  // Row patterns written to BSRR by DMA1 Channel3
+static uint32_t matrix_idr[MATRIX_KEY_MAX_ROWS];   // Column samples written by DMA1 Channel6
+static DMA_Desc_TypeDef matrix_row_desc;           // Circular transfer of the row patterns
+static DMA_Desc_TypeDef matrix_col_desc;           // Circular transfer of the column samples
+static Debounce_TypeDef matrix_debounce;           // 8 rows x 8 columns as four 16-bit words
+static uint32_t matrix_ghost_frames;               // Frames with ambiguous rows
+
+static void Matrix_Key_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event);
+
+/**
+ * @brief Returns the number of set bits of a byte.
+ *
+ * @param v The byte.
+ *
+ * @return The number of set bits.
+ */
+static uint8_t Matrix_Key_Bits(uint8_t v) {
+    uint8_t n = 0;
+
+    while (v) {
+        v &= v - 1;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Returns the APB2 clock enable bit of a GPIO port.
+ *
+ * The ports are 0x400 apart from GPIOA on, and their enable bits are consecutive from RCC_APB2Periph_GPIOA.
+ *
+ * @param port The port, GPIOA ... GPIOG.
+ *
+ * @return The RCC_APB2Periph_GPIOx bit.
+ */
+static uint32_t Matrix_Key_Port_Clock(GPIO_TypeDef *port) {
+    return RCC_APB2Periph_GPIOA << (((uint32_t)port - GPIOA_BASE) / 0x400);
+}
+
+/**
+ * @brief Configures the pins, TIM3 and DMA1 Channels 3 and 6, and starts scanning.
+ *
+ * @param cfg The wiring and scan rate; copied.
+ * @param cb Called on every debounced key change; may be NULL to poll Matrix_Key_Is_Down().
+ *
+ * @return 1 if scanning, 0 if the configuration is invalid, the rate cannot be generated or a DMA channel is
+ *         owned by another driver.
+ */
+uint8_t Matrix_Key_Init(const Matrix_Key_Config_TypeDef *cfg, Matrix_Key_Callback cb) {
+    GPIO_InitTypeDef GPIO_InitStructure;
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+    uint16_t row_mask = 0;
+    uint16_t col_mask = 0;
+    uint16_t per;
+    uint16_t psc;
+    uint8_t r;
+
+    if (cfg->rows < 1 || cfg->rows > MATRIX_KEY_MAX_ROWS || cfg->cols < 1 || cfg->cols > MATRIX_KEY_MAX_COLS ||
+        !TIM_Rate_Calc(TIM_APB1_Clock(), cfg->row_rate, &per, &psc)) {
+        return 0;
+    }
+    if (!DMA_Mgr_Alloc(3, 3, 3)) {
+        return 0;
+    }
+    if (!DMA_Mgr_Alloc(6, 3, 3)) {
+        DMA_Mgr_Free(3);
+        return 0;
+    }
+
+    matrix_cfg = *cfg;
+    matrix_cb = cb;
+    matrix_ghost_frames = 0;
+    Debounce_Init(&matrix_debounce, 0, 0, 4);
+    for (r = 0; r < cfg->rows; ++r) {
+        row_mask |= cfg->row_pins[r];
+    }
+    for (r = 0; r < cfg->cols; ++r) {
+        col_mask |= cfg->col_pins[r];
+    }
+
+    // Pattern k drives row k + 1 low and releases the others. The first compare samples before the first
+    // update, with the pattern of row 0 written below, so sample k always belongs to row k.
+    for (r = 0; r < cfg->rows; ++r) {
+        uint16_t pin = cfg->row_pins[(r + 1) % cfg->rows];
+
+        matrix_bsrr[r] = ((uint32_t)pin << 16) | (row_mask & ~pin);
+    }
+    RCC_APB2PeriphClockCmd(Matrix_Key_Port_Clock(cfg->row_port) | Matrix_Key_Port_Clock(cfg->col_port), ENABLE);
+    cfg->row_port->BSRR = ((uint32_t)cfg->row_pins[0] << 16) | (row_mask & ~cfg->row_pins[0]);
+
+    GPIO_InitStructure.GPIO_Pin = row_mask;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_OD;  // Open drain, two pressed rows never fight
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_2MHz;
+    GPIO_Init(cfg->row_port, &GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin = col_mask;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IPU;  // Pull-up input, a pressed key reads 0 on its driven row
+    GPIO_Init(cfg->col_port, &GPIO_InitStructure);
+
+    matrix_row_desc.init.DMA_PeripheralBaseAddr = (uint32_t)&cfg->row_port->BSRR;
+    matrix_row_desc.init.DMA_MemoryBaseAddr = (uint32_t)matrix_bsrr;
+    matrix_row_desc.init.DMA_DIR = DMA_DIR_PeripheralDST;  // Memory to peripheral
+    matrix_row_desc.init.DMA_BufferSize = cfg->rows;
+    matrix_row_desc.init.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    matrix_row_desc.init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    matrix_row_desc.init.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    matrix_row_desc.init.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+    matrix_row_desc.init.DMA_Mode = DMA_Mode_Circular;
+    matrix_row_desc.init.DMA_Priority = DMA_Priority_High;
+    matrix_row_desc.init.DMA_M2M = DMA_M2M_Disable;
+    matrix_row_desc.half = 0;
+    matrix_row_desc.cb = 0;
+
+    matrix_col_desc.init = matrix_row_desc.init;
+    matrix_col_desc.init.DMA_PeripheralBaseAddr = (uint32_t)&cfg->col_port->IDR;
+    matrix_col_desc.init.DMA_MemoryBaseAddr = (uint32_t)matrix_idr;
+    matrix_col_desc.init.DMA_DIR = DMA_DIR_PeripheralSRC;  // Peripheral to memory
+    matrix_col_desc.half = 0;
+    matrix_col_desc.cb = Matrix_Key_DMA_Event;  // Once per frame
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);  // Enable TIM3 clock
+    TIM_Cmd(TIM3, DISABLE);
+    TIM_TimeBaseInitStructure.TIM_Period = per;     // Auto-reload value
+    TIM_TimeBaseInitStructure.TIM_Prescaler = psc;  // Prescaler factor
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;  // Set up count mode
+    TIM_TimeBaseInit(TIM3, &TIM_TimeBaseInitStructure);
+
+    TIM_OCStructInit(&TIM_OCInitStructure);  // Complementary output and idle state fields off
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;  // Compare only, no pin
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Disable;
+    TIM_OCInitStructure.TIM_Pulse = per / 2;  // Sample half a row period after the row switched
+    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+    TIM_OC1Init(TIM3, &TIM_OCInitStructure);
+
+    DMA_Mgr_Submit(3, &matrix_row_desc);
+    DMA_Mgr_Submit(6, &matrix_col_desc);
+    TIM_SetCounter(TIM3, 0);
+    TIM_DMACmd(TIM3, TIM_DMA_Update | TIM_DMA_CC1, ENABLE);  // TIM3_UP -> Channel3, TIM3_CH1 -> Channel6
+    TIM_Cmd(TIM3, ENABLE);
+    return 1;
+}
+
+/**
+ * @brief Stops scanning and releases TIM3 and the DMA channels. The rows are left released.
+ *
+ * @return void
+ */
+void Matrix_Key_Stop(void) {
+    uint16_t row_mask = 0;
+    uint8_t r;
+
+    TIM_Cmd(TIM3, DISABLE);
+    TIM_DMACmd(TIM3, TIM_DMA_Update | TIM_DMA_CC1, DISABLE);
+    DMA_Mgr_Free(3);
+    DMA_Mgr_Free(6);
+    for (r = 0; r < matrix_cfg.rows; ++r) {
+        row_mask |= matrix_cfg.row_pins[r];
+    }
+    if (matrix_cfg.row_port) {
+        matrix_cfg.row_port->BSRR = row_mask;
+    }
+}
+
+/**
+ * @brief Runs the batch step on one frame of column samples.
+ *
+ * Called by the DMA interrupt with the sample buffer; it can also be fed frames from another source.
+ *
+ * @param idr The column port IDR sampled while each row was driven, one per row.
+ *
+ * @return void
+ */
+void Matrix_Key_Process(const uint32_t *idr) {
+    uint8_t row[MATRIX_KEY_MAX_ROWS] = {0};
+    uint8_t ghost = 0;
+    uint16_t raw[4] = {0};
+    uint16_t pressed;
+    uint16_t released;
+    uint8_t r;
+    uint8_t s;
+    uint8_t c;
+
+    for (r = 0; r < matrix_cfg.rows; ++r) {  // Pack the pressed (low) columns of every row into a byte
+        for (c = 0; c < matrix_cfg.cols; ++c) {
+            if (!(idr[r] & matrix_cfg.col_pins[c])) {
+                row[r] |= 1u << c;
+            }
+        }
+    }
+
+    for (r = 0; r < matrix_cfg.rows; ++r) {  // Rows sharing two pressed columns are ambiguous
+        for (s = r + 1; s < matrix_cfg.rows; ++s) {
+            if (Matrix_Key_Bits(row[r] & row[s]) >= 2) {
+                ghost |= (1u << r) | (1u << s);
+            }
+        }
+    }
+    if (ghost) {
+        matrix_ghost_frames++;
+    }
+
+    for (r = 0; r < matrix_cfg.rows; ++r) {
+        if (ghost & (1u << r)) {  // No change until it can be resolved
+            row[r] = (uint8_t)(Debounce_Get_State(&matrix_debounce, r >> 1) >> ((r & 1) * 8));
+        }
+        raw[r >> 1] |= (uint16_t)row[r] << ((r & 1) * 8);
+    }
+    Debounce_Process(&matrix_debounce, raw);
+
+    if (!matrix_cb) {
+        return;
+    }
+    for (r = 0; r < matrix_cfg.rows; ++r) {
+        pressed = Debounce_Get_Pressed(&matrix_debounce, r >> 1) >> ((r & 1) * 8);
+        released = Debounce_Get_Released(&matrix_debounce, r >> 1) >> ((r & 1) * 8);
+        for (c = 0; c < matrix_cfg.cols; ++c) {
+            if (pressed & (1u << c)) {
+                matrix_cb(r, c, 1);
+            } else if (released & (1u << c)) {
+                matrix_cb(r, c, 0);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Returns whether a key is down after debouncing.
+ *
+ * @param row The row of the key.
+ * @param col The column of the key.
+ *
+ * @return 1 if down, 0 if not.
+ */
+uint8_t Matrix_Key_Is_Down(uint8_t row, uint8_t col) {
+    if (row >= MATRIX_KEY_MAX_ROWS || col >= MATRIX_KEY_MAX_COLS) {
+        return 0;
+    }
+    return (Debounce_Get_State(&matrix_debounce, row >> 1) >> ((row & 1) * 8 + col)) & 1;
+}
+
+/**
+ * @brief Returns the number of frames in which ghosting hid part of the keypad.
+ *
+ * @return The number of ghosted frames.
+ */
+uint32_t Matrix_Key_Ghost_Frames(void) {
+    return matrix_ghost_frames;
+}
+
+/**
+ * @brief DMA manager callback for DMA1 Channel6, called when a whole frame has been sampled.
+ *
+ * The next frame overwrites the buffer from the start one row period later, which is ample time for the batch
+ * step.
+ *
+ * @param desc The column descriptor.
+ * @param event DMA_EVT_TC.
+ *
+ * @return void
+ */
+static void Matrix_Key_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event) {
+    (void)desc;
+    if (event == DMA_EVT_TC) {
+        Matrix_Key_Process(matrix_idr);
+    }
+}
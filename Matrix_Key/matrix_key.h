@@ -0,0 +1,93 @@
+/**
+ * @file matrix_key.h
+ * @brief Header file for the DMA-scanned matrix keypad.
+ * @author Yixiang Fan
+ * @date 2024-08-13
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The rows are open-drain outputs on one port and the columns are pulled-up inputs on one port. TIM3 paces the
+ * scan with no CPU work per row: every update event makes DMA1 Channel3 write the next row pattern into the row
+ * port's BSRR, and compare 1, half a period later when the row has settled, makes DMA1 Channel6 copy the column
+ * port's IDR into a sample buffer. When a whole frame (one sample per row) is in, the transfer-complete interrupt
+ * runs the batch step once: it masks out ghost keys and debounces all keys with the vertical-counter debouncer.
+ * TIM3 cannot pace the ADC scan (ADC_Scan_Timer_Init(), which programs it through TIM3_TRGO_Init()) or drive the
+ * TIM3 channels of the PWM generator (PWM_Init()) at the same time; Matrix_Key_Init() reprograms TIM3 for the scan.
+ */
+
+#ifndef MATRIX_KEY_MATRIX_KEY_H_
+#define MATRIX_KEY_MATRIX_KEY_H_
+
+#include "system.h"
+
+#define MATRIX_KEY_MAX_ROWS 8  // Rows, at most
+#define MATRIX_KEY_MAX_COLS 8  // Columns, at most
+
+/**
+ * @brief Keypad wiring and scan rate.
+ */
+typedef struct {
+    GPIO_TypeDef *row_port;                  // Port of all row pins
+    uint16_t row_pins[MATRIX_KEY_MAX_ROWS];  // Row pins, GPIO_Pin_x
+    uint8_t rows;                            // Number of rows
+    GPIO_TypeDef *col_port;                  // Port of all column pins
+    uint16_t col_pins[MATRIX_KEY_MAX_COLS];  // Column pins, GPIO_Pin_x
+    uint8_t cols;                            // Number of columns
+    uint32_t row_rate;                       // Rows scanned per second; frames per second is row_rate / rows
+} Matrix_Key_Config_TypeDef;
+
+/**
+ * @brief Callback type for debounced key changes, called from the DMA interrupt.
+ *
+ * @param row The row of the key.
+ * @param col The column of the key.
+ * @param pressed 1 when the key went down, 0 when it went up.
+ */
+typedef void (*Matrix_Key_Callback)(uint8_t row, uint8_t col, uint8_t pressed);
+
+/**
+ * @brief Configures the pins, TIM3 and DMA1 Channels 3 and 6, and starts scanning.
+ *
+ * @param cfg The wiring and scan rate; copied.
+ * @param cb Called on every debounced key change; may be NULL to poll Matrix_Key_Is_Down().
+ *
+ * @return 1 if scanning, 0 if the configuration is invalid, the rate cannot be generated or a DMA channel is
+ *         owned by another driver.
+ */
+uint8_t Matrix_Key_Init(const Matrix_Key_Config_TypeDef *cfg, Matrix_Key_Callback cb);
+
+/**
+ * @brief Stops scanning and releases TIM3 and the DMA channels. The rows are left released.
+ *
+ * @return void
+ */
+void Matrix_Key_Stop(void);
+
+/**
+ * @brief Runs the batch step on one frame of column samples.
+ *
+ * Called by the DMA interrupt with the sample buffer; it can also be fed frames from another source.
+ *
+ * @param idr The column port IDR sampled while each row was driven, one per row.
+ *
+ * @return void
+ */
+void Matrix_Key_Process(const uint32_t *idr);
+
+/**
+ * @brief Returns whether a key is down after debouncing.
+ *
+ * @param row The row of the key.
+ * @param col The column of the key.
+ *
+ * @return 1 if down, 0 if not.
+ */
+uint8_t Matrix_Key_Is_Down(uint8_t row, uint8_t col);
+
+/**
+ * @brief Returns the number of frames in which ghosting hid part of the keypad.
+ *
+ * @return The number of ghosted frames.
+ */
+uint32_t Matrix_Key_Ghost_Frames(void);
+
+#endif  // MATRIX_KEY_MATRIX_KEY_H_
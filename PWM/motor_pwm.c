@@ -0,0 +1,323 @@
+/**
+ * @file motor_pwm.c
+ * @brief Source file for the three-phase complementary PWM on the advanced timers TIM1 and TIM8.
+ * @author Yixiang Fan
+ * @date 2024-08-14
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "motor_pwm.h"
+#include "pwm.h"
+#include "time.h"
+
+#define MOTOR_PWM_SQRT3_2_Q15 28378    // sqrt(3) / 2 in Q15
+#define MOTOR_PWM_INV_SQRT3_Q15 18919  // 1 / sqrt(3) in Q15
+
+/**
+ * @brief A pin of a timer.
+ */
+typedef struct {
+    GPIO_TypeDef *port;  // Port
+    uint16_t pin;        // Pin mask
+} Motor_PWM_Pin_TypeDef;
+
+/**
+ * @brief Hardware of one timer.
+ */
+typedef struct {
+    TIM_TypeDef *tim;                              // Timer registers
+    uint32_t rcc;                                  // RCC_APB2Periph_TIMx
+    Motor_PWM_Pin_TypeDef high[MOTOR_PWM_PHASES];  // CH1-CH3
+    Motor_PWM_Pin_TypeDef low[MOTOR_PWM_PHASES];   // CH1N-CH3N
+    Motor_PWM_Pin_TypeDef bkin;                    // Break input
+} Motor_PWM_Timer_TypeDef;
+
+static const Motor_PWM_Timer_TypeDef motor_pwm_timer[2] = {
+    {TIM1,
+     RCC_APB2Periph_TIM1,
+     {{GPIOA, GPIO_Pin_8}, {GPIOA, GPIO_Pin_9}, {GPIOA, GPIO_Pin_10}},
+     {{GPIOB, GPIO_Pin_13}, {GPIOB, GPIO_Pin_14}, {GPIOB, GPIO_Pin_15}},
+     {GPIOB, GPIO_Pin_12}},
+    {TIM8,
+     RCC_APB2Periph_TIM8,
+     {{GPIOC, GPIO_Pin_6}, {GPIOC, GPIO_Pin_7}, {GPIOC, GPIO_Pin_8}},
+     {{GPIOA, GPIO_Pin_7}, {GPIOB, GPIO_Pin_0}, {GPIOB, GPIO_Pin_1}},
+     {GPIOA, GPIO_Pin_6}},
+};
+static void (*const motor_pwm_oc_init[MOTOR_PWM_PHASES])(TIM_TypeDef *, TIM_OCInitTypeDef *) = {
+    TIM_OC1Init, TIM_OC2Init, TIM_OC3Init};
+static void (*const motor_pwm_oc_preload[MOTOR_PWM_PHASES])(TIM_TypeDef *, uint16_t) = {
+    TIM_OC1PreloadConfig, TIM_OC2PreloadConfig, TIM_OC3PreloadConfig};
+
+static uint16_t motor_pwm_arr[2];  // Ticks per half period, or 0 before Motor_PWM_Init()
+
+/**
+ * @brief Looks up a timer.
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return The timer, or NULL if tim is invalid.
+ */
+static const Motor_PWM_Timer_TypeDef *Motor_PWM_Get(uint8_t tim) {
+    if (tim == 1) {
+        return &motor_pwm_timer[0];
+    }
+    if (tim == 8) {
+        return &motor_pwm_timer[1];
+    }
+    return 0;
+}
+
+/**
+ * @brief Encodes a dead time for the DTG field of TIMx_BDTR, with the dead-time clock equal to the timer clock.
+ *
+ * The dead time is rounded up to the next one the encoding can represent, so it is never shorter than asked.
+ *
+ * @param clk The timer clock in Hz.
+ * @param ns The dead time in ns.
+ * @param dtg Receives the DTG value.
+ *
+ * @return 1 if encoded, 0 if the dead time exceeds 1008 timer clocks.
+ */
+uint8_t Motor_PWM_Dead_Time(uint32_t clk, uint16_t ns, uint8_t *dtg) {
+    uint32_t ticks = (uint32_t)(((uint64_t)ns * clk + 999999999) / 1000000000);  // Rounded up
+
+    if (ticks <= 127) {
+        *dtg = (uint8_t)ticks;  // DTG[7] = 0: ticks
+    } else if (ticks <= 254) {
+        *dtg = (uint8_t)(0x80 | ((ticks + 1) / 2 - 64));  // DTG[7:6] = 10: (64 + DTG[5:0]) * 2
+    } else if (ticks <= 504) {
+        *dtg = (uint8_t)(0xc0 | ((ticks + 7) / 8 - 32));  // DTG[7:5] = 110: (32 + DTG[4:0]) * 8
+    } else if (ticks <= 1008) {
+        *dtg = (uint8_t)(0xe0 | ((ticks + 15) / 16 - 32));  // DTG[7:5] = 111: (32 + DTG[4:0]) * 16
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Configures the pins and the timer and starts the counter with all duty cycles at 50 %.
+ *
+ * The outputs stay at their idle (off) levels until Motor_PWM_Enable(). The half period has as many ticks as
+ * the frequency allows, up to 65535.
+ *
+ * @param tim The timer, 1 or 8.
+ * @param cfg The setup; copied.
+ *
+ * @return The achieved frequency in Hz, or 0 if the timer or setup is invalid (the timer is then left untouched).
+ */
+uint32_t Motor_PWM_Init(uint8_t tim, const Motor_PWM_Config_TypeDef *cfg) {
+    const Motor_PWM_Timer_TypeDef *t = Motor_PWM_Get(tim);
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+    TIM_BDTRInitTypeDef TIM_BDTRInitStructure;
+    GPIO_InitTypeDef GPIO_InitStructure;
+    uint32_t clk = TIM_APB2_Clock();
+    uint16_t arr;
+    uint16_t psc;
+    uint8_t dtg;
+    uint8_t i;
+
+    // A center-aligned period counts up and down, 2 * ARR ticks, so the half period is timed like a PWM period
+    if (!t || cfg->freq == 0 || cfg->freq > clk / 4 || cfg->brk > MOTOR_PWM_BREAK_HIGH ||
+        !PWM_Timing(clk, 2 * cfg->freq, &arr, &psc) || cfg->adc_lead >= arr ||
+        !Motor_PWM_Dead_Time(clk, cfg->dead_ns, &dtg)) {
+        return 0;
+    }
+
+    RCC_APB2PeriphClockCmd(t->rcc | RCC_APB2Periph_GPIOA | RCC_APB2Periph_GPIOB | RCC_APB2Periph_GPIOC |
+                               RCC_APB2Periph_AFIO,
+                           ENABLE);
+
+    TIM_Cmd(t->tim, DISABLE);
+    TIM_CtrlPWMOutputs(t->tim, DISABLE);  // Idle levels until Motor_PWM_Enable()
+
+    TIM_TimeBaseInitStructure.TIM_Period = arr;     // Auto-reload value, the counter peak
+    TIM_TimeBaseInitStructure.TIM_Prescaler = psc;  // Prescaler factor
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;  // Dead-time clock = timer clock
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_CenterAligned1;  // Up to ARR, then down to 0
+    TIM_TimeBaseInitStructure.TIM_RepetitionCounter = 1;  // One update per period, at the underflow
+    TIM_TimeBaseInit(t->tim, &TIM_TimeBaseInitStructure);
+    TIM_ARRPreloadConfig(t->tim, ENABLE);  // Enable preload register
+
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;  // High side on while the counter is below the compare value
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+    TIM_OCInitStructure.TIM_OutputNState = TIM_OutputNState_Enable;
+    TIM_OCInitStructure.TIM_Pulse = arr / 2;  // 50 %, no voltage across the phases
+    TIM_OCInitStructure.TIM_OCPolarity = cfg->high_active_low ? TIM_OCPolarity_Low : TIM_OCPolarity_High;
+    TIM_OCInitStructure.TIM_OCNPolarity = cfg->low_active_low ? TIM_OCNPolarity_Low : TIM_OCNPolarity_High;
+    TIM_OCInitStructure.TIM_OCIdleState = cfg->high_active_low ? TIM_OCIdleState_Set : TIM_OCIdleState_Reset;
+    TIM_OCInitStructure.TIM_OCNIdleState = cfg->low_active_low ? TIM_OCNIdleState_Set : TIM_OCNIdleState_Reset;
+    for (i = 0; i < MOTOR_PWM_PHASES; ++i) {
+        motor_pwm_oc_init[i](t->tim, &TIM_OCInitStructure);
+        motor_pwm_oc_preload[i](t->tim, TIM_OCPreload_Enable);  // New values load at the underflow, no glitch
+    }
+
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;               // Rises when the up-count reaches the compare
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Disable;  // Internal only, no pin
+    TIM_OCInitStructure.TIM_OutputNState = TIM_OutputNState_Disable;
+    TIM_OCInitStructure.TIM_Pulse = arr - cfg->adc_lead;
+    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+    TIM_OC4Init(t->tim, &TIM_OCInitStructure);
+    TIM_SelectOutputTrigger(t->tim, TIM_TRGOSource_OC4Ref);  // ADC trigger once per period
+
+    TIM_BDTRInitStructure.TIM_OSSRState = TIM_OSSRState_Enable;  // Drive the inactive levels while running
+    TIM_BDTRInitStructure.TIM_OSSIState = TIM_OSSIState_Enable;  // Drive the idle levels while off
+    TIM_BDTRInitStructure.TIM_LOCKLevel = TIM_LOCKLevel_OFF;     // Motor_PWM_Init() may be called again
+    TIM_BDTRInitStructure.TIM_DeadTime = dtg;
+    TIM_BDTRInitStructure.TIM_Break = cfg->brk ? TIM_Break_Enable : TIM_Break_Disable;
+    TIM_BDTRInitStructure.TIM_BreakPolarity =
+        cfg->brk == MOTOR_PWM_BREAK_HIGH ? TIM_BreakPolarity_High : TIM_BreakPolarity_Low;
+    TIM_BDTRInitStructure.TIM_AutomaticOutput = TIM_AutomaticOutput_Disable;  // A break needs Motor_PWM_Enable()
+    TIM_BDTRConfig(t->tim, &TIM_BDTRInitStructure);
+
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;  // Alternate push-pull output
+    for (i = 0; i < MOTOR_PWM_PHASES; ++i) {
+        GPIO_InitStructure.GPIO_Pin = t->high[i].pin;
+        GPIO_Init(t->high[i].port, &GPIO_InitStructure);
+        GPIO_InitStructure.GPIO_Pin = t->low[i].pin;
+        GPIO_Init(t->low[i].port, &GPIO_InitStructure);
+    }
+    if (cfg->brk) {
+        GPIO_InitStructure.GPIO_Pin = t->bkin.pin;
+        // Pulled to the inactive level, so an unconnected input does not trip
+        GPIO_InitStructure.GPIO_Mode = cfg->brk == MOTOR_PWM_BREAK_LOW ? GPIO_Mode_IPU : GPIO_Mode_IPD;
+        GPIO_Init(t->bkin.port, &GPIO_InitStructure);
+    }
+
+    motor_pwm_arr[t - motor_pwm_timer] = arr;
+    TIM_GenerateEvent(t->tim, TIM_EventSource_Update);  // Load the compare values and the repetition counter
+    TIM_ClearFlag(t->tim, TIM_FLAG_Break);
+    TIM_Cmd(t->tim, ENABLE);  // Enable timer
+    return (clk + (uint32_t)(psc + 1) * arr) / (2 * (uint32_t)(psc + 1) * arr);
+}
+
+/**
+ * @brief Stops the counter and switches the outputs to their idle (off) levels.
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return void
+ */
+void Motor_PWM_Stop(uint8_t tim) {
+    const Motor_PWM_Timer_TypeDef *t = Motor_PWM_Get(tim);
+
+    if (!t) {
+        return;
+    }
+    TIM_CtrlPWMOutputs(t->tim, DISABLE);
+    TIM_Cmd(t->tim, DISABLE);
+}
+
+/**
+ * @brief Connects the outputs to the PWM, after Motor_PWM_Init() or a break.
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return 1 if the outputs are on, 0 if the timer is invalid or the break input is still active.
+ */
+uint8_t Motor_PWM_Enable(uint8_t tim) {
+    const Motor_PWM_Timer_TypeDef *t = Motor_PWM_Get(tim);
+
+    if (!t || !motor_pwm_arr[t - motor_pwm_timer]) {
+        return 0;
+    }
+    TIM_ClearFlag(t->tim, TIM_FLAG_Break);
+    TIM_CtrlPWMOutputs(t->tim, ENABLE);
+    return (t->tim->BDTR & TIM_BDTR_MOE) != 0;  // An active break input holds MOE cleared
+}
+
+/**
+ * @brief Switches the outputs to their idle (off) levels; the counter and the ADC trigger keep running.
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return void
+ */
+void Motor_PWM_Disable(uint8_t tim) {
+    const Motor_PWM_Timer_TypeDef *t = Motor_PWM_Get(tim);
+
+    if (t) {
+        TIM_CtrlPWMOutputs(t->tim, DISABLE);
+    }
+}
+
+/**
+ * @brief Returns whether the break input has tripped the outputs since the last Motor_PWM_Enable().
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return 1 if tripped, 0 otherwise.
+ */
+uint8_t Motor_PWM_Tripped(uint8_t tim) {
+    const Motor_PWM_Timer_TypeDef *t = Motor_PWM_Get(tim);
+
+    return t && TIM_GetFlagStatus(t->tim, TIM_FLAG_Break) != RESET;
+}
+
+/**
+ * @brief Sets the duty cycles of the three phases; they take effect at the start of the next period.
+ *
+ * @param tim The timer, 1 or 8.
+ * @param duty The high-side duty cycles of CH1-CH3 in Q15, 0 to MOTOR_PWM_DUTY_ONE; larger values are clipped.
+ *
+ * @return void
+ */
+void Motor_PWM_Set(uint8_t tim, const uint16_t duty[MOTOR_PWM_PHASES]) {
+    const Motor_PWM_Timer_TypeDef *t = Motor_PWM_Get(tim);
+    uint32_t arr;
+    uint32_t d;
+    uint8_t i;
+
+    if (!t) {
+        return;
+    }
+    arr = motor_pwm_arr[t - motor_pwm_timer];
+    for (i = 0; i < MOTOR_PWM_PHASES; ++i) {
+        d = duty[i] < MOTOR_PWM_DUTY_ONE ? duty[i] : MOTOR_PWM_DUTY_ONE;
+        *(__IO uint16_t *)((uint32_t)&t->tim->CCR1 + 4 * i) = (uint16_t)((d * arr + 0x4000) >> 15);  // CCR1-CCR3
+    }
+}
+
+/**
+ * @brief Computes the space-vector duty cycles for a voltage vector.
+ *
+ * Uses the min-max zero-sequence injection, which gives the same duty cycles as the sector-based space-vector
+ * modulation with the zero vectors split evenly, in a fixed number of steps: four multiplications and a few
+ * comparisons, with no division, table or sector decision. Vectors outside the hexagon are clipped per phase.
+ *
+ * @param alpha The alpha component in Q15, where 1.0 is the radius of the circle inscribed in the hexagon
+ *        (Vdc / sqrt(3)), the largest amplitude without distortion.
+ * @param beta The beta component in Q15, on the same scale.
+ * @param duty Receives the duty cycles of the three phases in Q15, 0 to MOTOR_PWM_DUTY_ONE.
+ *
+ * @return void
+ */
+void Motor_PWM_SVM(int16_t alpha, int16_t beta, uint16_t duty[MOTOR_PWM_PHASES]) {
+    int32_t b = (int32_t)beta * MOTOR_PWM_SQRT3_2_Q15;  // Q30
+    int32_t v[MOTOR_PWM_PHASES];
+    int32_t max;
+    int32_t min;
+    int32_t mid;
+    int32_t d;
+    uint8_t i;
+
+    // Inverse Clarke transform to the phase voltages, in Q30
+    v[0] = (int32_t)alpha << 15;
+    v[1] = -((int32_t)alpha << 14) + b;
+    v[2] = -((int32_t)alpha << 14) - b;
+
+    max = v[0] > v[1] ? v[0] : v[1];
+    max = max > v[2] ? max : v[2];
+    min = v[0] < v[1] ? v[0] : v[1];
+    min = min < v[2] ? min : v[2];
+    mid = (max >> 1) + (min >> 1);  // Shifting the phases by -mid centers them between the rails
+
+    for (i = 0; i < MOTOR_PWM_PHASES; ++i) {
+        // A phase voltage of Vdc / 2 above the center is 100 %; 1.0 in the input scale is Vdc / sqrt(3)
+        d = MOTOR_PWM_DUTY_ONE / 2 + (int32_t)(((int64_t)(v[i] - mid) * MOTOR_PWM_INV_SQRT3_Q15 + (1 << 29)) >> 30);
+        duty[i] = (uint16_t)(d < 0 ? 0 : d > MOTOR_PWM_DUTY_ONE ? MOTOR_PWM_DUTY_ONE : d);
+    }
+}
@@ -0,0 +1,141 @@
+/**
+ * @file motor_pwm.h
+ * @brief Header file for the three-phase complementary PWM on the advanced timers TIM1 and TIM8.
+ * @author Yixiang Fan
+ * @date 2024-08-14
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * CH1-CH3 drive the high-side and CH1N-CH3N the low-side switches of three half bridges, with hardware dead time
+ * between the two switches of a leg. The counter runs center-aligned, so the pulses of the three phases are
+ * centered on the middle of the period, and the repetition counter lets the preloaded duty cycles take effect
+ * once per period, at the counter underflow.
+ *
+ * CH4 has no pin; in PWM mode 2 its reference rises once per period, adc_lead ticks before the counter peak in
+ * the middle of the period, when all low-side switches are on. TIM1 routes it to TRGO for
+ * ADC_ExternalTrigInjecConv_T1_TRGO; on TIM8 use ADC_ExternalTrigInjecConv_Ext_IT15_TIM8_CC4 with
+ * GPIO_Remap_ADC1_ETRGINJ. The injected conversions then sample the shunt currents at the same point of every
+ * period.
+ *
+ * The break input switches all six outputs to their idle (off) levels in hardware, without the CPU. They stay
+ * off until Motor_PWM_Enable() is called again.
+ *
+ * Pins:
+ * - TIM1: CH1-CH3 PA8-PA10, CH1N-CH3N PB13-PB15, BKIN PB12 (PA9/PA10 are shared with USART1)
+ * - TIM8: CH1-CH3 PC6-PC8, CH1N PA7, CH2N PB0, CH3N PB1, BKIN PA6 (PC6-PC8 are shared with the TIM3 remap)
+ */
+
+#ifndef PWM_MOTOR_PWM_H_
+#define PWM_MOTOR_PWM_H_
+
+#include "system.h"
+
+#define MOTOR_PWM_PHASES 3  // Half bridges on CH1-CH3
+
+// Break input modes
+#define MOTOR_PWM_BREAK_OFF 0   // No break input
+#define MOTOR_PWM_BREAK_LOW 1   // BKIN low trips the outputs, pulled up
+#define MOTOR_PWM_BREAK_HIGH 2  // BKIN high trips the outputs, pulled down
+
+#define MOTOR_PWM_DUTY_ONE 32768  // Duty cycle of 100 % in Q15
+
+/**
+ * @brief Motor PWM setup.
+ */
+typedef struct {
+    uint32_t freq;            // PWM frequency in Hz
+    uint16_t dead_ns;         // Dead time between the two switches of a leg, in ns
+    uint16_t adc_lead;        // Ticks between the ADC trigger and the counter peak, less than the half period
+    uint8_t high_active_low;  // 1 if the high-side gate inputs (CHx) are active low
+    uint8_t low_active_low;   // 1 if the low-side gate inputs (CHxN) are active low
+    uint8_t brk;              // MOTOR_PWM_BREAK_OFF, MOTOR_PWM_BREAK_LOW or MOTOR_PWM_BREAK_HIGH
+} Motor_PWM_Config_TypeDef;
+
+/**
+ * @brief Encodes a dead time for the DTG field of TIMx_BDTR, with the dead-time clock equal to the timer clock.
+ *
+ * The dead time is rounded up to the next one the encoding can represent, so it is never shorter than asked.
+ *
+ * @param clk The timer clock in Hz.
+ * @param ns The dead time in ns.
+ * @param dtg Receives the DTG value.
+ *
+ * @return 1 if encoded, 0 if the dead time exceeds 1008 timer clocks.
+ */
+uint8_t Motor_PWM_Dead_Time(uint32_t clk, uint16_t ns, uint8_t *dtg);
+
+/**
+ * @brief Configures the pins and the timer and starts the counter with all duty cycles at 50 %.
+ *
+ * The outputs stay at their idle (off) levels until Motor_PWM_Enable(). The half period has as many ticks as
+ * the frequency allows, up to 65535.
+ *
+ * @param tim The timer, 1 or 8.
+ * @param cfg The setup; copied.
+ *
+ * @return The achieved frequency in Hz, or 0 if the timer or setup is invalid (the timer is then left untouched).
+ */
+uint32_t Motor_PWM_Init(uint8_t tim, const Motor_PWM_Config_TypeDef *cfg);
+
+/**
+ * @brief Stops the counter and switches the outputs to their idle (off) levels.
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return void
+ */
+void Motor_PWM_Stop(uint8_t tim);
+
+/**
+ * @brief Connects the outputs to the PWM, after Motor_PWM_Init() or a break.
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return 1 if the outputs are on, 0 if the timer is invalid or the break input is still active.
+ */
+uint8_t Motor_PWM_Enable(uint8_t tim);
+
+/**
+ * @brief Switches the outputs to their idle (off) levels; the counter and the ADC trigger keep running.
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return void
+ */
+void Motor_PWM_Disable(uint8_t tim);
+
+/**
+ * @brief Returns whether the break input has tripped the outputs since the last Motor_PWM_Enable().
+ *
+ * @param tim The timer, 1 or 8.
+ *
+ * @return 1 if tripped, 0 otherwise.
+ */
+uint8_t Motor_PWM_Tripped(uint8_t tim);
+
+/**
+ * @brief Sets the duty cycles of the three phases; they take effect at the start of the next period.
+ *
+ * @param tim The timer, 1 or 8.
+ * @param duty The high-side duty cycles of CH1-CH3 in Q15, 0 to MOTOR_PWM_DUTY_ONE; larger values are clipped.
+ *
+ * @return void
+ */
+void Motor_PWM_Set(uint8_t tim, const uint16_t duty[MOTOR_PWM_PHASES]);
+
+/**
+ * @brief Computes the space-vector duty cycles for a voltage vector.
+ *
+ * Uses the min-max zero-sequence injection, which gives the same duty cycles as the sector-based space-vector
+ * modulation with the zero vectors split evenly, in a fixed number of steps: four multiplications and a few
+ * comparisons, with no division, table or sector decision. Vectors outside the hexagon are clipped per phase.
+ *
+ * @param alpha The alpha component in Q15, where 1.0 is the radius of the circle inscribed in the hexagon
+ *        (Vdc / sqrt(3)), the largest amplitude without distortion.
+ * @param beta The beta component in Q15, on the same scale.
+ * @param duty Receives the duty cycles of the three phases in Q15, 0 to MOTOR_PWM_DUTY_ONE.
+ *
+ * @return void
+ */
+void Motor_PWM_SVM(int16_t alpha, int16_t beta, uint16_t duty[MOTOR_PWM_PHASES]);
+
+#endif  // PWM_MOTOR_PWM_H_
@@ -1,12 +1,14 @@
 /**
  * @file pwm.c
- * @brief This file contains the implementation of the PWM initialization function for TIM3 channel 1.
+ * @brief This file contains the implementation of the PWM initialization function for TIM3 channel 1 and the
+ *        multi-channel PWM generator on TIM2-TIM4.
  * @author Yixiang Fan
  * @date 2024-08-02
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
  */
 
 #include "pwm.h"
+#include "time.h"
 
 /**
  * @brief Initializes the PWM for TIM3 channel 1 using the provided period and prescaler values.
@@ -44,6 +46,7 @@ void TIM3_CH1_PWM_Init(uint16_t per, uint16_t psc) {
     TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;  // Set up count mode
     TIM_TimeBaseInit(TIM3, &TIM_TimeBaseInitStructure);
 
+    TIM_OCStructInit(&TIM_OCInitStructure);  // Complementary output and idle state fields off
     TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
     TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_Low;
     TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
@@ -54,3 +57,456 @@ void TIM3_CH1_PWM_Init(uint16_t per, uint16_t psc) {
 
     TIM_Cmd(TIM3, ENABLE);  // Enable timer
 }
+
+/**
+ * @brief Q15 sine of the first quarter turn in 64 segments, sin(i * pi / 128) * 32767.
+ */
+static const int16_t pwm_sin_q15[65] = {
+    0,     804,   1608,  2410,  3212,  4011,  4808,  5602,  6393,  7179,  7962,  8739,  9512,
+    10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868,
+    19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811, 25329, 25832, 26319,
+    26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956, 30273, 30571, 30852, 31113,
+    31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757, 32767,
+};
+
+/**
+ * @brief Hardware of one timer.
+ */
+typedef struct {
+    TIM_TypeDef *tim;             // Timer registers
+    uint32_t rcc;                 // RCC_APB1Periph_TIMx
+    GPIO_TypeDef *port;           // Port of CH1-CH4
+    uint32_t port_rcc;            // RCC_APB2Periph_GPIOx
+    uint16_t pins[PWM_CHANNELS];  // Pins of CH1-CH4
+    uint32_t remap;               // GPIO_PinRemapConfig() value, 0 for the default pins
+    uint8_t dma;                  // DMA1 channel of TIMx_UP
+} PWM_Timer_TypeDef;
+
+/**
+ * @brief Run state of one timer.
+ */
+typedef struct {
+    uint16_t steps;               // ARR + 1, or 0 before PWM_Init()
+    uint16_t duty[PWM_CHANNELS];  // Duty cycles in 0.01 % steps
+    uint8_t dma_owned;            // 1 while a playback owns the DMA channel
+    DMA_Desc_TypeDef desc;        // Playback transfer
+    PWM_Callback done;            // End of a one-shot playback
+} PWM_State_TypeDef;
+
+static const PWM_Timer_TypeDef pwm_timer[3] = {
+    {TIM2, RCC_APB1Periph_TIM2, GPIOA, RCC_APB2Periph_GPIOA, {GPIO_Pin_0, GPIO_Pin_1, GPIO_Pin_2, GPIO_Pin_3}, 0, 2},
+    {TIM3, RCC_APB1Periph_TIM3, GPIOC, RCC_APB2Periph_GPIOC, {GPIO_Pin_6, GPIO_Pin_7, GPIO_Pin_8, GPIO_Pin_9},
+     GPIO_FullRemap_TIM3, 3},
+    {TIM4, RCC_APB1Periph_TIM4, GPIOB, RCC_APB2Periph_GPIOB, {GPIO_Pin_6, GPIO_Pin_7, GPIO_Pin_8, GPIO_Pin_9}, 0, 7},
+};
+static const uint16_t pwm_tim_ch[PWM_CHANNELS] = {TIM_Channel_1, TIM_Channel_2, TIM_Channel_3, TIM_Channel_4};
+static const uint16_t pwm_dma_base[PWM_CHANNELS] = {TIM_DMABase_CCR1, TIM_DMABase_CCR2, TIM_DMABase_CCR3,
+                                                    TIM_DMABase_CCR4};
+static const uint16_t pwm_dma_burst[PWM_CHANNELS] = {TIM_DMABurstLength_1Transfer, TIM_DMABurstLength_2Transfers,
+                                                     TIM_DMABurstLength_3Transfers, TIM_DMABurstLength_4Transfers};
+static void (*const pwm_oc_init[PWM_CHANNELS])(TIM_TypeDef *, TIM_OCInitTypeDef *) = {TIM_OC1Init, TIM_OC2Init,
+                                                                                     TIM_OC3Init, TIM_OC4Init};
+static void (*const pwm_oc_preload[PWM_CHANNELS])(TIM_TypeDef *, uint16_t) = {
+    TIM_OC1PreloadConfig, TIM_OC2PreloadConfig, TIM_OC3PreloadConfig, TIM_OC4PreloadConfig};
+
+static PWM_State_TypeDef pwm_state[3];
+
+/**
+ * @brief Converts a duty cycle into a compare value, rounded to the nearest step.
+ *
+ * @param steps The counter steps per period.
+ * @param duty The duty cycle in 0.01 % steps, 0 to PWM_DUTY_MAX.
+ *
+ * @return The compare value, 0 to steps.
+ */
+static uint16_t PWM_Compare(uint16_t steps, uint16_t duty) {
+    return (uint16_t)(((uint32_t)steps * duty + PWM_DUTY_MAX / 2) / PWM_DUTY_MAX);
+}
+
+/**
+ * @brief Writes the compare register of a channel.
+ *
+ * @param t The timer.
+ * @param ch The channel, 1-4.
+ * @param v The compare value.
+ *
+ * @return void
+ */
+static void PWM_Write_Compare(const PWM_Timer_TypeDef *t, uint8_t ch, uint16_t v) {
+    *(__IO uint16_t *)((uint32_t)&t->tim->CCR1 + 4 * (ch - 1)) = v;  // CCR1-CCR4 are consecutive
+}
+
+/**
+ * @brief Computes the prescaler and period for a PWM frequency with the most counter steps per period.
+ *
+ * The prescaler is the smallest one that fits the period into at most 65535 steps, so that a compare value of
+ * steps (100 %) still fits the 16-bit compare registers. The steps are rounded to the nearest integer.
+ *
+ * @param clk The timer clock in Hz.
+ * @param freq The wanted PWM frequency in Hz, from clk / 2^32 up to clk / 2.
+ * @param steps Receives the counter steps per period (ARR + 1), 2 to 65535.
+ * @param psc Receives the prescaler value (PSC).
+ *
+ * @return The achieved frequency in Hz, rounded to the nearest integer, or 0 if the frequency is out of range.
+ */
+uint32_t PWM_Timing(uint32_t clk, uint32_t freq, uint16_t *steps, uint16_t *psc) {
+    uint32_t n;
+    uint32_t div;
+    uint32_t arr;
+
+    if (freq == 0 || freq > clk / 2) {
+        return 0;
+    }
+    n = (clk + freq / 2) / freq;                  // Total divider, rounded
+    div = (n + 0xfffe) / 0xffff;                  // Smallest prescaler so that the steps fit 0xffff
+    arr = (clk + freq * div / 2) / (freq * div);  // Steps, rounded from the exact ratio
+    if (arr > 0xffff) {
+        div++;  // Rounding went past the limit
+        arr = (clk + freq * div / 2) / (freq * div);
+    }
+    if (div > 0x10000 || arr < 2 || arr > 0xffff) {
+        return 0;
+    }
+    *psc = (uint16_t)(div - 1);
+    *steps = (uint16_t)arr;
+    return (clk + div * arr / 2) / (div * arr);
+}
+
+/**
+ * @brief Starts the counter of a timer at the given PWM frequency.
+ *
+ * May be called again to change the frequency: the counter restarts and the running channels keep their duty
+ * cycles. Stop a playback first, since its table holds compare values for the old period.
+ *
+ * @param tim The timer, 2-4.
+ * @param freq The PWM frequency in Hz.
+ *
+ * @return The achieved frequency in Hz, or 0 if the timer or frequency is invalid (the timer is then left
+ *         untouched).
+ */
+uint32_t PWM_Init(uint8_t tim, uint32_t freq) {
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    const PWM_Timer_TypeDef *t;
+    PWM_State_TypeDef *s;
+    uint16_t steps;
+    uint16_t psc;
+    uint32_t actual;
+    uint8_t ch;
+
+    if (tim < 2 || tim > 4) {
+        return 0;
+    }
+    t = &pwm_timer[tim - 2];
+    s = &pwm_state[tim - 2];
+    actual = PWM_Timing(TIM_APB1_Clock(), freq, &steps, &psc);
+    if (actual == 0) {
+        return 0;
+    }
+
+    RCC_APB1PeriphClockCmd(t->rcc, ENABLE);
+    RCC_APB2PeriphClockCmd(t->port_rcc | RCC_APB2Periph_AFIO, ENABLE);
+    if (t->remap) {
+        GPIO_PinRemapConfig(t->remap, ENABLE);  // Change pin mapping
+    }
+
+    TIM_TimeBaseInitStructure.TIM_Period = steps - 1;  // Auto-reload value
+    TIM_TimeBaseInitStructure.TIM_Prescaler = psc;     // Prescaler factor
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;  // Set up count mode
+    TIM_TimeBaseInit(t->tim, &TIM_TimeBaseInitStructure);
+    TIM_ARRPreloadConfig(t->tim, ENABLE);  // Enable preload register
+
+    s->steps = steps;
+    for (ch = 1; ch <= PWM_CHANNELS; ++ch) {
+        PWM_Write_Compare(t, ch, PWM_Compare(steps, s->duty[ch - 1]));  // Same duty cycles for the new period
+    }
+    TIM_GenerateEvent(t->tim, TIM_EventSource_Update);  // Load the compare values at once
+    TIM_Cmd(t->tim, ENABLE);                            // Enable timer
+    return actual;
+}
+
+/**
+ * @brief Returns the counter steps per period of a timer, the compare value for a duty cycle of 100 %.
+ *
+ * The duty cycle resolution is one step, and PWM_Play() tables hold compare values from 0 to this value.
+ *
+ * @param tim The timer, 2-4.
+ *
+ * @return The steps, or 0 if the timer is invalid or not initialized.
+ */
+uint16_t PWM_Steps(uint8_t tim) {
+    if (tim < 2 || tim > 4) {
+        return 0;
+    }
+    return pwm_state[tim - 2].steps;
+}
+
+/**
+ * @brief Configures the pin of a channel and starts its output.
+ *
+ * @param tim The timer, 2-4, started with PWM_Init().
+ * @param ch The channel, 1-4.
+ * @param duty The duty cycle in 0.01 % steps, 0 to PWM_DUTY_MAX.
+ * @param active_low 1 to drive the pin low during the duty cycle, 0 to drive it high.
+ *
+ * @return 1 if running, 0 if the arguments are invalid or the timer is not initialized.
+ */
+uint8_t PWM_Channel_Start(uint8_t tim, uint8_t ch, uint16_t duty, uint8_t active_low) {
+    GPIO_InitTypeDef GPIO_InitStructure;
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+    const PWM_Timer_TypeDef *t;
+    PWM_State_TypeDef *s;
+
+    if (tim < 2 || tim > 4 || ch < 1 || ch > PWM_CHANNELS || duty > PWM_DUTY_MAX || !pwm_state[tim - 2].steps) {
+        return 0;
+    }
+    t = &pwm_timer[tim - 2];
+    s = &pwm_state[tim - 2];
+    s->duty[ch - 1] = duty;
+
+    TIM_OCStructInit(&TIM_OCInitStructure);            // Complementary output and idle state fields off
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;  // Active while the counter is below the compare value
+    TIM_OCInitStructure.TIM_OCPolarity = active_low ? TIM_OCPolarity_Low : TIM_OCPolarity_High;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+    TIM_OCInitStructure.TIM_Pulse = PWM_Compare(s->steps, duty);
+    pwm_oc_init[ch - 1](t->tim, &TIM_OCInitStructure);     // Output compare channel initialization
+    pwm_oc_preload[ch - 1](t->tim, TIM_OCPreload_Enable);  // New values load at the next update, no glitch
+
+    GPIO_InitStructure.GPIO_Pin = t->pins[ch - 1];
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;  // Alternate push-pull output
+    GPIO_Init(t->port, &GPIO_InitStructure);
+    return 1;
+}
+
+/**
+ * @brief Stops the output of a channel and releases its pin as a floating input.
+ *
+ * @param tim The timer, 2-4.
+ * @param ch The channel, 1-4.
+ *
+ * @return void
+ */
+void PWM_Channel_Stop(uint8_t tim, uint8_t ch) {
+    GPIO_InitTypeDef GPIO_InitStructure;
+    const PWM_Timer_TypeDef *t;
+
+    if (tim < 2 || tim > 4 || ch < 1 || ch > PWM_CHANNELS) {
+        return;
+    }
+    t = &pwm_timer[tim - 2];
+    TIM_CCxCmd(t->tim, pwm_tim_ch[ch - 1], TIM_CCx_Disable);
+
+    GPIO_InitStructure.GPIO_Pin = t->pins[ch - 1];
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+    GPIO_Init(t->port, &GPIO_InitStructure);
+}
+
+/**
+ * @brief Sets the duty cycle of a channel; it takes effect at the start of the next period.
+ *
+ * @param tim The timer, 2-4.
+ * @param ch The channel, 1-4.
+ * @param duty The duty cycle in 0.01 % steps; values above PWM_DUTY_MAX are clipped.
+ *
+ * @return void
+ */
+void PWM_Set_Duty(uint8_t tim, uint8_t ch, uint16_t duty) {
+    PWM_State_TypeDef *s;
+
+    if (tim < 2 || tim > 4 || ch < 1 || ch > PWM_CHANNELS) {
+        return;
+    }
+    s = &pwm_state[tim - 2];
+    if (duty > PWM_DUTY_MAX) {
+        duty = PWM_DUTY_MAX;
+    }
+    s->duty[ch - 1] = duty;
+    PWM_Write_Compare(&pwm_timer[tim - 2], ch, PWM_Compare(s->steps, duty));
+}
+
+/**
+ * @brief Ends a one-shot playback from the DMA interrupt.
+ *
+ * The manager has already dropped the descriptor, so the channel can be released here.
+ *
+ * @param desc The playback descriptor.
+ * @param event DMA_EVT_TC or DMA_EVT_TE.
+ *
+ * @return void
+ */
+static void PWM_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event) {
+    PWM_State_TypeDef *s = (PWM_State_TypeDef *)desc->arg;
+    uint8_t i = (uint8_t)(s - pwm_state);
+
+    (void)event;
+    TIM_DMACmd(pwm_timer[i].tim, TIM_DMA_Update, DISABLE);
+    DMA_Mgr_Free(pwm_timer[i].dma);
+    s->dma_owned = 0;
+    if (s->done) {
+        s->done(i + 2);  // May start the next playback
+    }
+}
+
+/**
+ * @brief Streams a table of compare values into consecutive channels, one frame per PWM period.
+ *
+ * A frame holds one compare value for each of the chans channels starting at ch, in channel order, so the table
+ * holds frames * chans values. On every update event the timer requests a DMA burst that writes the next frame
+ * into the preloaded compare registers, which take effect at the following update. The channels must have been
+ * started with PWM_Channel_Start(); PWM_Set_Duty() takes over again after the playback. A running playback on
+ * the same timer is replaced.
+ *
+ * @param tim The timer, 2-4, started with PWM_Init().
+ * @param ch The first channel, 1-4.
+ * @param chans The number of channels, 1 to 5 - ch.
+ * @param table The compare values, 0 to PWM_Steps(); must stay valid during the playback.
+ * @param frames The number of frames, 1 to 65535 / chans.
+ * @param loop 1 to repeat the table until PWM_Play_Stop(), 0 to play it once.
+ * @param done Called at the end of a one-shot playback; may be NULL.
+ *
+ * @return 1 if playing, 0 if the arguments are invalid, the timer is not initialized or the DMA channel is owned
+ *         by another driver.
+ */
+uint8_t PWM_Play(uint8_t tim, uint8_t ch, uint8_t chans, const uint16_t *table, uint16_t frames, uint8_t loop,
+                 PWM_Callback done) {
+    const PWM_Timer_TypeDef *t;
+    PWM_State_TypeDef *s;
+
+    if (tim < 2 || tim > 4 || ch < 1 || chans < 1 || ch + chans - 1 > PWM_CHANNELS || frames == 0 ||
+        (uint32_t)frames * chans > 0xffff || !pwm_state[tim - 2].steps) {
+        return 0;
+    }
+    t = &pwm_timer[tim - 2];
+    s = &pwm_state[tim - 2];
+
+    PWM_Play_Stop(tim);
+    if (!DMA_Mgr_Alloc(t->dma, 3, 3)) {
+        return 0;
+    }
+    s->dma_owned = 1;
+    s->done = done;
+
+    s->desc.init.DMA_PeripheralBaseAddr = (uint32_t)&t->tim->DMAR;  // Each access moves the next burst register
+    s->desc.init.DMA_MemoryBaseAddr = (uint32_t)table;
+    s->desc.init.DMA_DIR = DMA_DIR_PeripheralDST;  // Memory to peripheral
+    s->desc.init.DMA_BufferSize = (uint16_t)(frames * chans);
+    s->desc.init.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    s->desc.init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    s->desc.init.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    s->desc.init.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    s->desc.init.DMA_Mode = loop ? DMA_Mode_Circular : DMA_Mode_Normal;
+    s->desc.init.DMA_Priority = DMA_Priority_High;  // A burst must end before the next update
+    s->desc.init.DMA_M2M = DMA_M2M_Disable;
+    s->desc.half = 0;
+    s->desc.cb = loop ? 0 : PWM_DMA_Event;
+    s->desc.arg = s;
+
+    TIM_DMAConfig(t->tim, pwm_dma_base[ch - 1], pwm_dma_burst[chans - 1]);  // CCRch to CCRch+chans-1 per request
+    DMA_Mgr_Submit(t->dma, &s->desc);
+    TIM_DMACmd(t->tim, TIM_DMA_Update, ENABLE);  // TIMx_UP starts one burst per period
+    return 1;
+}
+
+/**
+ * @brief Stops a playback and releases its DMA channel. The compare registers keep the last frame written.
+ *
+ * @param tim The timer, 2-4.
+ *
+ * @return void
+ */
+void PWM_Play_Stop(uint8_t tim) {
+    PWM_State_TypeDef *s;
+
+    if (tim < 2 || tim > 4) {
+        return;
+    }
+    s = &pwm_state[tim - 2];
+    TIM_DMACmd(pwm_timer[tim - 2].tim, TIM_DMA_Update, DISABLE);
+    if (s->dma_owned) {
+        DMA_Mgr_Free(pwm_timer[tim - 2].dma);
+        s->dma_owned = 0;
+    }
+}
+
+/**
+ * @brief Returns the sine of an angle in Q15.
+ *
+ * Interpolates a quarter-wave table of 64 segments; the error is at most 3.2 LSB (0.01 %).
+ *
+ * @param angle The angle in 1/65536 turns.
+ *
+ * @return The sine, -32767 to 32767.
+ */
+int16_t PWM_Sin_Q15(uint16_t angle) {
+    uint16_t a = angle & 0x3fff;  // Angle within the quadrant
+    uint16_t i;
+    uint16_t frac;
+    int32_t v;
+
+    if (angle & 0x4000) {
+        a = 0x4000 - a;  // Second and fourth quadrants mirror the first
+    }
+    i = a >> 8;
+    frac = a & 0xff;
+    v = pwm_sin_q15[i];
+    if (frac) {
+        v += ((pwm_sin_q15[i + 1] - v) * frac + 128) >> 8;
+    }
+    return (int16_t)((angle & 0x8000) ? -v : v);
+}
+
+/**
+ * @brief Fills a table with one period of a sine wave between 0 and top.
+ *
+ * @param table Receives frames values, stride entries apart.
+ * @param frames The number of values, at least 1.
+ * @param stride The distance between two values, the chans of PWM_Play() for interleaved channels.
+ * @param phase The angle of the first value in 1/65536 turns, e.g. 21845 and 43691 for three phases.
+ * @param top The peak value, usually PWM_Steps().
+ *
+ * @return void
+ */
+void PWM_Table_Sine(uint16_t *table, uint16_t frames, uint8_t stride, uint16_t phase, uint16_t top) {
+    uint16_t k;
+    uint16_t angle;
+
+    for (k = 0; k < frames; ++k) {
+        angle = (uint16_t)(phase + (((uint32_t)k << 16) + frames / 2) / frames);  // Rounded to 1/65536 turn
+        table[(uint32_t)k * stride] = (uint16_t)(((uint32_t)top * (32767 + PWM_Sin_Q15(angle)) + 32767) / 65534);
+    }
+}
+
+/**
+ * @brief Fills a table with a ramp from one value to another, both included.
+ *
+ * A squared ramp follows a parabola that is flat at the lower end; on an LED it is perceived as a linear fade.
+ *
+ * @param table Receives frames values, stride entries apart.
+ * @param frames The number of values, at least 1; a single value is set to to.
+ * @param stride The distance between two values, the chans of PWM_Play() for interleaved channels.
+ * @param from The first value.
+ * @param to The last value.
+ * @param squared 1 for a squared ramp, 0 for a linear one.
+ *
+ * @return void
+ */
+void PWM_Table_Ramp(uint16_t *table, uint16_t frames, uint8_t stride, uint16_t from, uint16_t to, uint8_t squared) {
+    uint16_t low = from < to ? from : to;
+    uint16_t span = from < to ? to - from : from - to;
+    uint32_t last = frames > 1 ? frames - 1 : 1;
+    uint64_t den = squared ? (uint64_t)last * last : last;
+    uint64_t d;
+    uint16_t k;
+
+    for (k = 0; k < frames; ++k) {
+        d = frames > 1 ? k : 1;  // Position from 0 to last
+        if (from > to) {
+            d = last - d;  // Distance from the lower end
+        }
+        if (squared) {
+            d *= d;
+        }
+        table[(uint32_t)k * stride] = (uint16_t)(low + (span * d + den / 2) / den);  // Rounded exactly
+    }
+}
@@ -1,15 +1,34 @@
 /**
  * @file pwm.h
- * @brief This file contains the declarations and definitions for the PWM initialization function for TIM3 channel 1.
+ * @brief This file contains the declarations and definitions for the PWM initialization function for TIM3 channel 1
+ *        and the multi-channel PWM generator on TIM2-TIM4.
  * @author Yixiang Fan
  * @date 2024-08-02
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The generator drives all four channels of TIM2 (PA0-PA3), TIM3 (fully remapped to PC6-PC9, like
+ * TIM3_CH1_PWM_Init()) and TIM4 (PB6-PB9). Frequencies are given in Hz and duty cycles in 0.01 % steps; the
+ * prescaler is kept as small as possible so that the period has the most counter steps. PWM_Play() streams a
+ * table of compare values into one or more channels with a DMA burst through TIMx_DMAR on every update event
+ * (TIM2_UP -> DMA1 Channel2, TIM3_UP -> Channel3, TIM4_UP -> Channel7), so sine, fade and ramp profiles cost
+ * no CPU time per period.
  */
 
 #ifndef PWM_PWM_H_
 #define PWM_PWM_H_
 
 #include "system.h"
+#include "dma.h"
+
+#define PWM_CHANNELS 4      // CH1-CH4 of each timer
+#define PWM_DUTY_MAX 10000  // 100 % in the 0.01 % steps of the duty cycle
+
+/**
+ * @brief Callback type for the end of a one-shot playback, called from the DMA interrupt.
+ *
+ * @param tim The timer, 2-4.
+ */
+typedef void (*PWM_Callback)(uint8_t tim);
 
 /**
  * @brief Initializes the PWM for TIM3 channel 1 using the provided period and prescaler values.
@@ -25,4 +44,149 @@
  */
 void TIM3_CH1_PWM_Init(uint16_t per, uint16_t psc);
 
+/**
+ * @brief Computes the prescaler and period for a PWM frequency with the most counter steps per period.
+ *
+ * The prescaler is the smallest one that fits the period into at most 65535 steps, so that a compare value of
+ * steps (100 %) still fits the 16-bit compare registers. The steps are rounded to the nearest integer.
+ *
+ * @param clk The timer clock in Hz.
+ * @param freq The wanted PWM frequency in Hz, from clk / 2^32 up to clk / 2.
+ * @param steps Receives the counter steps per period (ARR + 1), 2 to 65535.
+ * @param psc Receives the prescaler value (PSC).
+ *
+ * @return The achieved frequency in Hz, rounded to the nearest integer, or 0 if the frequency is out of range.
+ */
+uint32_t PWM_Timing(uint32_t clk, uint32_t freq, uint16_t *steps, uint16_t *psc);
+
+/**
+ * @brief Starts the counter of a timer at the given PWM frequency.
+ *
+ * May be called again to change the frequency: the counter restarts and the running channels keep their duty
+ * cycles. Stop a playback first, since its table holds compare values for the old period.
+ *
+ * @param tim The timer, 2-4.
+ * @param freq The PWM frequency in Hz.
+ *
+ * @return The achieved frequency in Hz, or 0 if the timer or frequency is invalid (the timer is then left
+ *         untouched).
+ */
+uint32_t PWM_Init(uint8_t tim, uint32_t freq);
+
+/**
+ * @brief Returns the counter steps per period of a timer, the compare value for a duty cycle of 100 %.
+ *
+ * The duty cycle resolution is one step, and PWM_Play() tables hold compare values from 0 to this value.
+ *
+ * @param tim The timer, 2-4.
+ *
+ * @return The steps, or 0 if the timer is invalid or not initialized.
+ */
+uint16_t PWM_Steps(uint8_t tim);
+
+/**
+ * @brief Configures the pin of a channel and starts its output.
+ *
+ * @param tim The timer, 2-4, started with PWM_Init().
+ * @param ch The channel, 1-4.
+ * @param duty The duty cycle in 0.01 % steps, 0 to PWM_DUTY_MAX.
+ * @param active_low 1 to drive the pin low during the duty cycle, 0 to drive it high.
+ *
+ * @return 1 if running, 0 if the arguments are invalid or the timer is not initialized.
+ */
+uint8_t PWM_Channel_Start(uint8_t tim, uint8_t ch, uint16_t duty, uint8_t active_low);
+
+/**
+ * @brief Stops the output of a channel and releases its pin as a floating input.
+ *
+ * @param tim The timer, 2-4.
+ * @param ch The channel, 1-4.
+ *
+ * @return void
+ */
+void PWM_Channel_Stop(uint8_t tim, uint8_t ch);
+
+/**
+ * @brief Sets the duty cycle of a channel; it takes effect at the start of the next period.
+ *
+ * @param tim The timer, 2-4.
+ * @param ch The channel, 1-4.
+ * @param duty The duty cycle in 0.01 % steps; values above PWM_DUTY_MAX are clipped.
+ *
+ * @return void
+ */
+void PWM_Set_Duty(uint8_t tim, uint8_t ch, uint16_t duty);
+
+/**
+ * @brief Streams a table of compare values into consecutive channels, one frame per PWM period.
+ *
+ * A frame holds one compare value for each of the chans channels starting at ch, in channel order, so the table
+ * holds frames * chans values. On every update event the timer requests a DMA burst that writes the next frame
+ * into the preloaded compare registers, which take effect at the following update. The channels must have been
+ * started with PWM_Channel_Start(); PWM_Set_Duty() takes over again after the playback. A running playback on
+ * the same timer is replaced.
+ *
+ * @param tim The timer, 2-4, started with PWM_Init().
+ * @param ch The first channel, 1-4.
+ * @param chans The number of channels, 1 to 5 - ch.
+ * @param table The compare values, 0 to PWM_Steps(); must stay valid during the playback.
+ * @param frames The number of frames, 1 to 65535 / chans.
+ * @param loop 1 to repeat the table until PWM_Play_Stop(), 0 to play it once.
+ * @param done Called at the end of a one-shot playback; may be NULL.
+ *
+ * @return 1 if playing, 0 if the arguments are invalid, the timer is not initialized or the DMA channel is owned
+ *         by another driver.
+ */
+uint8_t PWM_Play(uint8_t tim, uint8_t ch, uint8_t chans, const uint16_t *table, uint16_t frames, uint8_t loop,
+                 PWM_Callback done);
+
+/**
+ * @brief Stops a playback and releases its DMA channel. The compare registers keep the last frame written.
+ *
+ * @param tim The timer, 2-4.
+ *
+ * @return void
+ */
+void PWM_Play_Stop(uint8_t tim);
+
+/**
+ * @brief Returns the sine of an angle in Q15.
+ *
+ * Interpolates a quarter-wave table of 64 segments; the error is at most 3.2 LSB (0.01 %).
+ *
+ * @param angle The angle in 1/65536 turns.
+ *
+ * @return The sine, -32767 to 32767.
+ */
+int16_t PWM_Sin_Q15(uint16_t angle);
+
+/**
+ * @brief Fills a table with one period of a sine wave between 0 and top.
+ *
+ * @param table Receives frames values, stride entries apart.
+ * @param frames The number of values, at least 1.
+ * @param stride The distance between two values, the chans of PWM_Play() for interleaved channels.
+ * @param phase The angle of the first value in 1/65536 turns, e.g. 21845 and 43691 for three phases.
+ * @param top The peak value, usually PWM_Steps().
+ *
+ * @return void
+ */
+void PWM_Table_Sine(uint16_t *table, uint16_t frames, uint8_t stride, uint16_t phase, uint16_t top);
+
+/**
+ * @brief Fills a table with a ramp from one value to another, both included.
+ *
+ * A squared ramp follows a parabola that is flat at the lower end; on an LED it is perceived as a linear fade.
+ *
+ * @param table Receives frames values, stride entries apart.
+ * @param frames The number of values, at least 1; a single value is set to to.
+ * @param stride The distance between two values, the chans of PWM_Play() for interleaved channels.
+ * @param from The first value.
+ * @param to The last value.
+ * @param squared 1 for a squared ramp, 0 for a linear one.
+ *
+ * @return void
+ */
+void PWM_Table_Ramp(uint16_t *table, uint16_t frames, uint8_t stride, uint16_t from, uint16_t to, uint8_t squared);
+
 #endif  // PWM_PWM_H_
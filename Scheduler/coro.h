@@ -0,0 +1,102 @@
+/**
+ * @file coro.h
+ * @brief Stackless coroutines (protothreads) for driver operations that would otherwise block.
+ * @author Yixiang Fan
+ * @date 2024-08-11
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * A coroutine is an ordinary function that takes a Coro_TypeDef and returns CORO_WAITING until it has finished,
+ * then CORO_DONE. Its body sits between CORO_BEGIN() and CORO_END(); every wait saves the resume point in the
+ * context and returns, so the caller can run other coroutines in the meantime and simply call it again later.
+ * Any number of operations can therefore be in flight at once from a plain main loop or scheduler task, without
+ * an RTOS and without a stack per coroutine.
+ *
+ * The resume points are case labels of a switch on the context, which brings three rules:
+ * - local variables are not kept across a wait; keep state in the context, in statics or in the caller;
+ * - no switch statement may contain a wait;
+ * - at most one wait per source line, since the line number is the resume point.
+ *
+ * Awaitable driver operations follow the same form, e.g. ADC_Read_Async(), Touch_Get_Val_Async(),
+ * USART1_Write_Async() and RCC_HSE_Config_Async(); each needs its own context, which it leaves ready for reuse
+ * when it finishes. Delays need the SysTick clock (see SysTick_Clock_Init()). Driver headers only forward-declare
+ * struct Coro_TypeDef, so including them does not pull in this file or SysTick.h; code that runs or awaits
+ * coroutines includes coro.h itself.
+ */
+
+#ifndef SCHEDULER_CORO_H_
+#define SCHEDULER_CORO_H_
+
+#include "system.h"
+#include "SysTick.h"
+
+#define CORO_WAITING 0  // The coroutine is waiting, call it again
+#define CORO_DONE 1     // The coroutine has finished; the next call starts it over
+
+/**
+ * @brief Coroutine context.
+ */
+typedef struct Coro_TypeDef {
+    uint16_t lc;     // Resume point, 0 to start from the beginning
+    uint16_t n;      // Loop counter free for the coroutine body
+    uint64_t until;  // Deadline of the running delay or timeout in SysTick ticks
+} Coro_TypeDef;
+
+// Resets a context so that the next call starts the coroutine from the beginning
+#define CORO_INIT(c) ((c)->lc = 0)
+
+// Opens the body of a coroutine
+#define CORO_BEGIN(c)  \
+    switch ((c)->lc) { \
+        case 0:
+
+// Closes the body of a coroutine and reports it finished
+#define CORO_END(c)  \
+    }                \
+    (c)->lc = 0;     \
+    return CORO_DONE
+
+// Returns CORO_WAITING until cond is true, then goes on
+#define CORO_WAIT_UNTIL(c, cond)     \
+    do {                             \
+        (c)->lc = __LINE__;          \
+        case __LINE__:               \
+            if (!(cond)) {           \
+                return CORO_WAITING; \
+            }                        \
+    } while (0)
+
+// Gives the other coroutines one turn
+#define CORO_YIELD(c)        \
+    do {                     \
+        (c)->lc = __LINE__;  \
+        return CORO_WAITING; \
+        case __LINE__:;      \
+    } while (0)
+
+// Runs a child coroutine call, such as an awaitable driver operation, until it is done
+#define CORO_AWAIT(c, call) CORO_WAIT_UNTIL(c, (call) == CORO_DONE)
+
+// Finishes the coroutine early
+#define CORO_EXIT(c)      \
+    do {                  \
+        (c)->lc = 0;      \
+        return CORO_DONE; \
+    } while (0)
+
+// Starts a timeout of ticks SysTick ticks, checked with CORO_TIMED_OUT()
+#define CORO_TIMEOUT(c, ticks) ((c)->until = SysTick_Get_Ticks() + (ticks))
+
+// Whether the timeout started with CORO_TIMEOUT() or the last delay has expired
+#define CORO_TIMED_OUT(c) (SysTick_Get_Ticks() >= (c)->until)
+
+// Waits for ticks SysTick ticks without blocking the other coroutines
+#define CORO_DELAY(c, ticks)                   \
+    do {                                       \
+        CORO_TIMEOUT(c, ticks);                \
+        CORO_WAIT_UNTIL(c, CORO_TIMED_OUT(c)); \
+    } while (0)
+
+// Waits for at least ms milliseconds: whole ticks rounded up, plus one for the part of the current tick already gone
+#define CORO_DELAY_MS(c, ms) CORO_DELAY(c, ((uint64_t)(ms) * 1000 + SYSTICK_TICK_US - 1) / SYSTICK_TICK_US + 1)
+
+#endif  // SCHEDULER_CORO_H_
@@ -0,0 +1,104 @@
+/**
+ * @file main.c
+ * @brief Runs ADC sampling, touch scanning and UART reporting at the same time with coroutines.
+ * @author Yixiang Fan
+ * @date 2024-08-11
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Each activity is a coroutine built on the awaitable driver operations; the main loop just gives every coroutine
+ * a turn, so a slow conversion, a full TX ring or a charging touch pad never holds up the others.
+ */
+
+#include "SysTick.h"
+#include "adc.h"
+#include "coro.h"
+#include "led.h"
+#include "system.h"
+#include "touch_key.h"
+#include "usart.h"
+
+#include <string.h>
+
+static uint16_t adc_val;      // Latest averaged temperature sensor reading
+static uint8_t adc_ready;     // 1 when adc_val has not been reported yet
+static uint16_t touch_count;  // Touches seen so far
+static char report[48];       // Line being sent by Report_Task
+
+/**
+ * @brief Samples the internal temperature sensor every 100 ms.
+ *
+ * The sensor is used because PA1, the pin of ADC channel 1, is the touch pad.
+ */
+static uint8_t ADC_Task(Coro_TypeDef *c) {
+    static Coro_TypeDef read;
+
+    CORO_BEGIN(c);
+    for (;;) {
+        CORO_AWAIT(c, ADC_Read_Async(&read, ADC_Channel_16, 8, &adc_val));
+        adc_ready = 1;
+        CORO_DELAY_MS(c, 100);
+    }
+    CORO_END(c);
+}
+
+/**
+ * @brief Measures the touch pad continuously and counts touches, toggling LED2 on each.
+ */
+static uint8_t Touch_Task(Coro_TypeDef *c) {
+    static Coro_TypeDef read;
+    static uint16_t val;
+    static uint8_t holdoff;  // Measurements left before a new touch is counted
+
+    CORO_BEGIN(c);
+    for (;;) {
+        CORO_AWAIT(c, Touch_Get_Val_Async(&read, &val));
+        if (Touch_Is_Touched(val)) {
+            if (holdoff == 0) {
+                touch_count++;
+                led2 = !led2;
+            }
+            holdoff = 3;
+        }
+        if (holdoff) {
+            holdoff--;
+        }
+    }
+    CORO_END(c);
+}
+
+/**
+ * @brief Sends a report line for every new ADC reading.
+ */
+static uint8_t Report_Task(Coro_TypeDef *c) {
+    static Coro_TypeDef write;
+
+    CORO_BEGIN(c);
+    for (;;) {
+        CORO_WAIT_UNTIL(c, adc_ready);
+        adc_ready = 0;
+        sprintf(report, "temp adc=%u touches=%u\r\n", adc_val, touch_count);
+        CORO_AWAIT(c, USART1_Write_Async(&write, (const uint8_t *)report, strlen(report)));
+    }
+    CORO_END(c);
+}
+
+int main() {
+    static Coro_TypeDef adc_co;
+    static Coro_TypeDef touch_co;
+    static Coro_TypeDef report_co;
+
+    SysTick_Init(72);
+    NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
+    LED_Init();
+    USART1_Init(115200);
+    ADCx_Init();
+    ADC_TempSensorVrefintCmd(ENABLE);  // Channel 16 is the internal temperature sensor
+    Touch_Key_Init(6);                 // Takes PA1 back from ADCx_Init() for the touch pad
+    SysTick_Clock_Init();              // Coroutine delays run on the SysTick clock
+
+    while (1) {
+        ADC_Task(&adc_co);
+        Touch_Task(&touch_co);
+        Report_Task(&report_co);
+    }
+}
@@ -0,0 +1,288 @@
+/**
+ * @file sched.c
+ * @brief Source file for the cooperative run-to-completion scheduler.
+ * @author Yixiang Fan
+ * @date 2024-08-10
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Each priority queue is a bounded ring in which every cell carries a sequence number. A producer claims a
+ * position by advancing enq with LDREX/STREX, fills the cell and then publishes it by setting its sequence to
+ * position + 1; the single consumer (Sched_Run) only takes a cell whose sequence says it is published, and frees
+ * it by setting the sequence one lap ahead. A producer interrupted between claiming and publishing only delays
+ * the events behind it until it resumes.
+ */
+
+#include "sched.h"
+#include "SysTick.h"
+
+#define SCHED_QUEUE_MASK (SCHED_QUEUE_SIZE - 1)
+
+/**
+ * @brief One cell of a priority queue.
+ */
+typedef struct {
+    volatile uint32_t seq;   // Position + 1 when published, position when free
+    Sched_Event_TypeDef ev;  // The event
+} Sched_Cell_TypeDef;
+
+/**
+ * @brief One priority queue.
+ */
+typedef struct {
+    volatile uint32_t enq;                      // Next position to claim, shared by all producers
+    uint32_t deq;                               // Next position to take, owned by the consumer
+    Sched_Cell_TypeDef cell[SCHED_QUEUE_SIZE];  // Ring storage
+} Sched_Queue_TypeDef;
+
+/**
+ * @brief One entry of the task table.
+ */
+typedef struct {
+    Sched_Handler handler;  // Event handler, NULL for a free entry
+    uint8_t prio;           // Priority
+} Sched_Task_TypeDef;
+
+static Sched_Queue_TypeDef sched_queue[SCHED_PRIORITIES];
+static Sched_Task_TypeDef sched_task[SCHED_MAX_TASKS + 1];  // Index 0 is never used
+static volatile uint32_t sched_dropped;                     // Events lost to full queues
+
+typedef char sched_queue_size_must_be_a_power_of_two[(SCHED_QUEUE_SIZE & (SCHED_QUEUE_SIZE - 1)) ? -1 : 1];
+
+/**
+ * @brief Initializes the scheduler, the SysTick clock and the software timers.
+ *
+ * SysTick_Init() must have been called first.
+ *
+ * @return void
+ */
+void Sched_Init(void) {
+    uint8_t p;
+    uint8_t i;
+
+    for (p = 0; p < SCHED_PRIORITIES; ++p) {
+        sched_queue[p].enq = 0;
+        sched_queue[p].deq = 0;
+        for (i = 0; i < SCHED_QUEUE_SIZE; ++i) {
+            sched_queue[p].cell[i].seq = i;
+        }
+    }
+    for (i = 0; i <= SCHED_MAX_TASKS; ++i) {
+        sched_task[i].handler = 0;
+    }
+    sched_dropped = 0;
+
+    SysTick_Clock_Init();
+    Soft_Timer_Init();
+}
+
+/**
+ * @brief Adds a task.
+ *
+ * @param handler The event handler.
+ * @param prio The priority, 0 (highest) to SCHED_PRIORITIES - 1.
+ *
+ * @return The task id, or 0 if the task table is full or the priority is invalid.
+ */
+uint8_t Sched_Task_Add(Sched_Handler handler, uint8_t prio) {
+    uint8_t i;
+
+    if (prio >= SCHED_PRIORITIES) {
+        return 0;
+    }
+    for (i = 1; i <= SCHED_MAX_TASKS; ++i) {
+        if (!sched_task[i].handler) {
+            sched_task[i].prio = prio;
+            sched_task[i].handler = handler;
+            return i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Posts an event to a task. Safe to call from interrupts and never blocks.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ * @param data The signal-specific data.
+ *
+ * @return 1 if queued, 0 if the queue of the task's priority is full (the event is counted as dropped).
+ */
+uint8_t Sched_Post(uint8_t task, uint8_t sig, uint32_t data) {
+    Sched_Queue_TypeDef *q;
+    Sched_Cell_TypeDef *c;
+    uint32_t pos;
+    int32_t diff;
+
+    if (task == 0 || task > SCHED_MAX_TASKS || !sched_task[task].handler) {
+        return 0;
+    }
+    q = &sched_queue[sched_task[task].prio];
+
+    for (;;) {
+        pos = __LDREXW(&q->enq);
+        c = &q->cell[pos & SCHED_QUEUE_MASK];
+        diff = (int32_t)(c->seq - pos);
+        if (diff < 0) {  // The cell of this position is still in use one lap behind: full
+            __CLREX();
+            do {
+                pos = __LDREXW(&sched_dropped);
+            } while (__STREXW(pos + 1, &sched_dropped));
+            return 0;
+        }
+        if (diff == 0 && __STREXW(pos + 1, &q->enq) == 0) {
+            break;  // Position claimed
+        }
+        if (diff > 0) {
+            __CLREX();  // Another producer claimed it first, retry with the new enq
+        }
+    }
+
+    c->ev.task = task;
+    c->ev.sig = sig;
+    c->ev.data = data;
+    __DMB();  // The event must be visible before the cell is published
+    c->seq = pos + 1;
+    return 1;
+}
+
+/**
+ * @brief Returns the number of events dropped because a queue was full.
+ *
+ * @return The number of dropped events.
+ */
+uint32_t Sched_Dropped(void) {
+    return sched_dropped;
+}
+
+/**
+ * @brief Soft timer callback of a Sched_Timer_TypeDef, posts its event.
+ *
+ * @param timer The expired software timer.
+ *
+ * @return void
+ */
+static void Sched_Timer_Expired(Soft_Timer_TypeDef *timer) {
+    Sched_Timer_TypeDef *t = (Sched_Timer_TypeDef *)timer->arg;
+
+    Sched_Post(t->task, t->sig, (uint32_t)(timer->expires - timer->period));
+}
+
+/**
+ * @brief Starts a timer that posts sig to task after delay ticks, then every period ticks.
+ *
+ * @param t The timer, zero-initialized before first use.
+ * @param task The task id.
+ * @param sig The signal.
+ * @param delay Ticks until the first event.
+ * @param period Ticks between later events, 0 for a single event.
+ *
+ * @return void
+ */
+void Sched_Timer_Start(Sched_Timer_TypeDef *t, uint8_t task, uint8_t sig, uint32_t delay, uint32_t period) {
+    t->task = task;
+    t->sig = sig;
+    Soft_Timer_Start(&t->timer, delay, period, Sched_Timer_Expired, t);
+}
+
+/**
+ * @brief Stops a timer.
+ *
+ * @param t The timer.
+ *
+ * @return void
+ */
+void Sched_Timer_Stop(Sched_Timer_TypeDef *t) {
+    Soft_Timer_Stop(&t->timer);
+}
+
+/**
+ * @brief Returns whether a timer is waiting to post.
+ *
+ * @param t The timer.
+ *
+ * @return 1 if active, 0 if not.
+ */
+uint8_t Sched_Timer_Active(const Sched_Timer_TypeDef *t) {
+    return Soft_Timer_Active(&t->timer);
+}
+
+/**
+ * @brief Takes the oldest event of the highest non-empty priority.
+ *
+ * @param ev Receives the event.
+ *
+ * @return 1 if an event was taken, 0 if all queues are empty.
+ */
+static uint8_t Sched_Take(Sched_Event_TypeDef *ev) {
+    Sched_Queue_TypeDef *q;
+    Sched_Cell_TypeDef *c;
+    uint8_t p;
+
+    for (p = 0; p < SCHED_PRIORITIES; ++p) {
+        q = &sched_queue[p];
+        c = &q->cell[q->deq & SCHED_QUEUE_MASK];
+        if (c->seq == q->deq + 1) {  // Published
+            __DMB();
+            *ev = c->ev;
+            __DMB();  // Read the event before the cell can be reused
+            c->seq = q->deq + SCHED_QUEUE_SIZE;
+            q->deq++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns whether any queue has a published event, without taking it.
+ *
+ * @return 1 if an event is waiting, 0 if not.
+ */
+static uint8_t Sched_Pending(void) {
+    uint8_t p;
+
+    for (p = 0; p < SCHED_PRIORITIES; ++p) {
+        if (sched_queue[p].cell[sched_queue[p].deq & SCHED_QUEUE_MASK].seq == sched_queue[p].deq + 1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the due timers and dispatches at most one event.
+ *
+ * @return 1 if an event was dispatched, 0 if all queues were empty.
+ */
+uint8_t Sched_Run_Once(void) {
+    Sched_Event_TypeDef ev;
+
+    Soft_Timer_Process();
+    if (!Sched_Take(&ev)) {
+        return 0;
+    }
+    sched_task[ev.task].handler(&ev);
+    return 1;
+}
+
+/**
+ * @brief Runs the scheduler forever, sleeping with WFI whenever there is nothing to do.
+ *
+ * Interrupts are masked from the last check to WFI so an event posted in between still wakes the core: WFI
+ * returns on a pending interrupt even while PRIMASK is set, and the interrupt runs once PRIMASK is cleared.
+ * The SysTick interrupt wakes the core at least once per tick for the timers.
+ *
+ * @return Never returns.
+ */
+void Sched_Run(void) {
+    for (;;) {
+        if (!Sched_Run_Once()) {
+            __disable_irq();
+            if (!Sched_Pending()) {
+                __WFI();
+            }
+            __enable_irq();
+        }
+    }
+}
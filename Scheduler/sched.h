@@ -0,0 +1,133 @@
+/**
+ * @file sched.h
+ * @brief Header file for the cooperative run-to-completion scheduler.
+ * @author Yixiang Fan
+ * @date 2024-08-10
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Tasks are event handlers that run to completion, one event at a time, from Sched_Run(). Every task has a
+ * priority; events wait in one queue per priority and the highest non-empty queue is always served first.
+ * Events can be posted from any context, including interrupt handlers: the queues are lock-free multi-producer
+ * rings built on LDREX/STREX, so posting never masks interrupts. Timed events come from the SysTick software
+ * timers (see soft_timer.h), which fire in deadline order. When there is nothing to do the core sleeps with WFI
+ * until the next interrupt.
+ */
+
+#ifndef SCHEDULER_SCHED_H_
+#define SCHEDULER_SCHED_H_
+
+#include "system.h"
+#include "soft_timer.h"
+
+#define SCHED_PRIORITIES 4   // Priority levels, 0 is the highest
+#define SCHED_QUEUE_SIZE 16  // Events per priority queue, must be a power of two
+#define SCHED_MAX_TASKS 16   // Task table size
+
+/**
+ * @brief An event delivered to a task.
+ */
+typedef struct {
+    uint8_t task;   // Receiving task
+    uint8_t sig;    // Signal, defined by the application
+    uint32_t data;  // Signal-specific data
+} Sched_Event_TypeDef;
+
+/**
+ * @brief Task handler type, runs to completion for every event of the task.
+ *
+ * @param ev The event.
+ */
+typedef void (*Sched_Handler)(const Sched_Event_TypeDef *ev);
+
+/**
+ * @brief A timer that posts an event to a task on every expiry.
+ */
+typedef struct {
+    Soft_Timer_TypeDef timer;  // Underlying software timer
+    uint8_t task;              // Receiving task
+    uint8_t sig;               // Posted signal; the data is the low 32 bits of the expiry tick
+} Sched_Timer_TypeDef;
+
+/**
+ * @brief Initializes the scheduler, the SysTick clock and the software timers.
+ *
+ * SysTick_Init() must have been called first.
+ *
+ * @return void
+ */
+void Sched_Init(void);
+
+/**
+ * @brief Adds a task.
+ *
+ * @param handler The event handler.
+ * @param prio The priority, 0 (highest) to SCHED_PRIORITIES - 1.
+ *
+ * @return The task id, or 0 if the task table is full or the priority is invalid.
+ */
+uint8_t Sched_Task_Add(Sched_Handler handler, uint8_t prio);
+
+/**
+ * @brief Posts an event to a task. Safe to call from interrupts and never blocks.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ * @param data The signal-specific data.
+ *
+ * @return 1 if queued, 0 if the queue of the task's priority is full (the event is counted as dropped).
+ */
+uint8_t Sched_Post(uint8_t task, uint8_t sig, uint32_t data);
+
+/**
+ * @brief Returns the number of events dropped because a queue was full.
+ *
+ * @return The number of dropped events.
+ */
+uint32_t Sched_Dropped(void);
+
+/**
+ * @brief Starts a timer that posts sig to task after delay ticks, then every period ticks.
+ *
+ * @param t The timer, zero-initialized before first use.
+ * @param task The task id.
+ * @param sig The signal.
+ * @param delay Ticks until the first event.
+ * @param period Ticks between later events, 0 for a single event.
+ *
+ * @return void
+ */
+void Sched_Timer_Start(Sched_Timer_TypeDef *t, uint8_t task, uint8_t sig, uint32_t delay, uint32_t period);
+
+/**
+ * @brief Stops a timer.
+ *
+ * @param t The timer.
+ *
+ * @return void
+ */
+void Sched_Timer_Stop(Sched_Timer_TypeDef *t);
+
+/**
+ * @brief Returns whether a timer is waiting to post.
+ *
+ * @param t The timer.
+ *
+ * @return 1 if active, 0 if not.
+ */
+uint8_t Sched_Timer_Active(const Sched_Timer_TypeDef *t);
+
+/**
+ * @brief Runs the due timers and dispatches at most one event.
+ *
+ * @return 1 if an event was dispatched, 0 if all queues were empty.
+ */
+uint8_t Sched_Run_Once(void);
+
+/**
+ * @brief Runs the scheduler forever, sleeping with WFI whenever there is nothing to do.
+ *
+ * @return Never returns.
+ */
+void Sched_Run(void);
+
+#endif  // SCHEDULER_SCHED_H_
@@ -0,0 +1,183 @@
+/**
+ * @file sched_src.c
+ * @brief Source file for the scheduler event sources of the board drivers.
+ * @author Yixiang Fan
+ * @date 2024-08-10
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "sched_src.h"
+#include "sched.h"
+#include "key.h"
+#include "touch_key.h"
+#include "input.h"
+#include "usart.h"
+
+/**
+ * @brief Receiver of one event source.
+ */
+typedef struct {
+    uint8_t task;  // Task id, 0 while the source is not started
+    uint8_t sig;   // Posted signal
+} Sched_Src_TypeDef;
+
+static Sched_Src_TypeDef key_src;
+static Soft_Timer_TypeDef key_timer;
+static uint8_t key_last;    // Previous raw sample
+static uint8_t key_stable;  // Debounced key, 0 for none
+
+static Sched_Src_TypeDef touch_src;
+static Soft_Timer_TypeDef touch_timer;
+static uint8_t touch_state;    // 0: discharging, 1: charging
+static uint8_t touch_holdoff;  // Measurements left before a new touch is reported, as in Touch_Key_Scan()
+
+static Sched_Src_TypeDef capture_src;
+static Sched_Src_TypeDef usart_rx_src;
+
+/**
+ * @brief Key sampling timer callback, reports a key once it has read the same in two samples.
+ *
+ * @param timer The key timer.
+ *
+ * @return void
+ */
+static void Sched_Src_Key_Sample(Soft_Timer_TypeDef *timer) {
+    uint8_t key = KEY_Read();
+
+    (void)timer;
+    if (key == key_last && key != key_stable) {
+        key_stable = key;
+        if (key) {
+            Sched_Post(key_src.task, key_src.sig, key);
+        }
+    }
+    key_last = key;
+}
+
+/**
+ * @brief Posts sig to task on every debounced key press, with the key value (KEY_UP ... KEY_RIGHT) as data.
+ *
+ * KEY_Init() and Sched_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_Key(uint8_t task, uint8_t sig) {
+    key_src.task = task;
+    key_src.sig = sig;
+    key_last = 0;
+    key_stable = 0;
+    Soft_Timer_Start(&key_timer, SCHED_SRC_KEY_PERIOD, SCHED_SRC_KEY_PERIOD, Sched_Src_Key_Sample, 0);
+}
+
+/**
+ * @brief Touch timer callback, advances the measurement by one step.
+ *
+ * @param timer The touch timer.
+ *
+ * @return void
+ */
+static void Sched_Src_Touch_Step(Soft_Timer_TypeDef *timer) {
+    uint16_t val;
+
+    if (touch_state == 0) {  // Discharged, start charging
+        Touch_Charge_Start();
+        touch_state = 1;
+        Soft_Timer_Start(timer, SCHED_SRC_TOUCH_POLL, 0, Sched_Src_Touch_Step, 0);
+        return;
+    }
+    if (!Touch_Charge_Done(&val)) {
+        Soft_Timer_Start(timer, SCHED_SRC_TOUCH_POLL, 0, Sched_Src_Touch_Step, 0);
+        return;
+    }
+
+    if (Touch_Is_Touched(val)) {
+        if (touch_holdoff == 0) {
+            Sched_Post(touch_src.task, touch_src.sig, val);
+        }
+        touch_holdoff = 3;
+    }
+    if (touch_holdoff) {
+        touch_holdoff--;
+    }
+
+    Touch_Discharge();  // Next measurement
+    touch_state = 0;
+    Soft_Timer_Start(timer, SCHED_SRC_TOUCH_DISCHARGE, 0, Sched_Src_Touch_Step, 0);
+}
+
+/**
+ * @brief Posts sig to task on every touch, with the charging time as data.
+ *
+ * The measurement runs as a state machine on software timers instead of waiting in Touch_Get_Val().
+ * Touch_Key_Init() and Sched_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_Touch(uint8_t task, uint8_t sig) {
+    touch_src.task = task;
+    touch_src.sig = sig;
+    touch_holdoff = 0;
+    Touch_Discharge();
+    touch_state = 0;
+    Soft_Timer_Start(&touch_timer, SCHED_SRC_TOUCH_DISCHARGE, 0, Sched_Src_Touch_Step, 0);
+}
+
+/**
+ * @brief Input capture callback, posts the captured time.
+ *
+ * @param ticks The high-level time in timer counts.
+ *
+ * @return void
+ */
+static void Sched_Src_Capture_Done(unit32_t ticks) {
+    Sched_Post(capture_src.task, capture_src.sig, ticks);
+}
+
+/**
+ * @brief Posts sig to task from the TIM5 interrupt on every completed capture, with the high-level time in timer
+ *        counts as data.
+ *
+ * TIM5_CH1_Input_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_Capture(uint8_t task, uint8_t sig) {
+    capture_src.task = task;
+    capture_src.sig = sig;
+    TIM5_CH1_Set_Callback(Sched_Src_Capture_Done);
+}
+
+/**
+ * @brief USART1 RX callback, posts the frame notification.
+ *
+ * @return void
+ */
+static void Sched_Src_USART_RX_Frame(void) {
+    Sched_Post(usart_rx_src.task, usart_rx_src.sig, 0);
+}
+
+/**
+ * @brief Posts sig to task from the USART1 interrupt every time a frame is queued; the task then takes the frames
+ *        with USART1_RX_Get_Frame().
+ *
+ * USART1_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_USART_RX(uint8_t task, uint8_t sig) {
+    usart_rx_src.task = task;
+    usart_rx_src.sig = sig;
+    USART1_RX_Set_Callback(Sched_Src_USART_RX_Frame);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file sched_src.h
+ * @brief Header file for the scheduler event sources of the board drivers.
+ * @author Yixiang Fan
+ * @date 2024-08-10
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Each source turns a driver into events for a scheduler task, so the application no longer polls it with
+ * delays. Polled inputs (keys, touch key) are sampled from software timers in the scheduler loop; interrupt-driven
+ * ones (input capture, USART1 RX) post straight from their interrupt handlers.
+ */
+
+#ifndef SCHEDULER_SCHED_SRC_H_
+#define SCHEDULER_SCHED_SRC_H_
+
+#include "system.h"
+
+#define SCHED_SRC_KEY_PERIOD 10      // Ticks between key samples; a key must read the same twice in a row
+#define SCHED_SRC_TOUCH_DISCHARGE 5  // Ticks the touch capacitor is discharged before each measurement
+#define SCHED_SRC_TOUCH_POLL 1       // Ticks between checks of a running touch measurement
+
+/**
+ * @brief Posts sig to task on every debounced key press, with the key value (KEY_UP ... KEY_RIGHT) as data.
+ *
+ * KEY_Init() and Sched_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_Key(uint8_t task, uint8_t sig);
+
+/**
+ * @brief Posts sig to task on every touch, with the charging time as data.
+ *
+ * The measurement runs as a state machine on software timers instead of waiting in Touch_Get_Val().
+ * Touch_Key_Init() and Sched_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_Touch(uint8_t task, uint8_t sig);
+
+/**
+ * @brief Posts sig to task from the TIM5 interrupt on every completed capture, with the high-level time in timer
+ *        counts as data.
+ *
+ * TIM5_CH1_Input_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_Capture(uint8_t task, uint8_t sig);
+
+/**
+ * @brief Posts sig to task from the USART1 interrupt every time a frame is queued; the task then takes the frames
+ *        with USART1_RX_Get_Frame().
+ *
+ * USART1_Init() must have been called first.
+ *
+ * @param task The task id.
+ * @param sig The signal.
+ *
+ * @return void
+ */
+void Sched_Src_USART_RX(uint8_t task, uint8_t sig);
+
+#endif  // SCHEDULER_SCHED_SRC_H_
@@ -5,65 +5,257 @@
  * @date 2024-08-01
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
  *
- * This file contains the implementation of the SysTick delay functions.
+ * This file contains the implementation of the SysTick delay functions and of the free-running SysTick clock.
+ * Once SysTick_Clock_Init() has been called, SysTick never stops: its interrupt counts ticks of SYSTICK_TICK_US
+ * microseconds into a 64-bit counter, and the delay functions measure elapsed counter values instead of
+ * reprogramming the peripheral. Without the clock, each delay programs SysTick itself, in chunks of at most
+ * 2^24 counts so that any length is exact.
+ *
+ * All factors come from the RCC clock tree at run time. Delays can optionally sleep with WFI between SysTick
+ * interrupts instead of spinning (see SysTick_Set_Sleep()).
  */
 
 #include "SysTick.h"
 
-static u8 fac_us = 0;  // Multiplier for microsecond delay
-static u16 fac_ms = 0;  // Multiplier for millisecond delay
+static u32 fac_us = 0;  // SysTick counts per microsecond in Q16
+static u32 fac_ms = 0;  // SysTick counts per millisecond
+static volatile uint64_t systick_ticks;  // Ticks since SysTick_Clock_Init()
+static uint8_t systick_clock;            // 1 while SysTick runs as the free-running clock
+static uint8_t systick_sleep;            // 1 to wait with WFI instead of spinning
 
 /**
  * @brief Initializes the delay functions using SysTick.
  *
  * The SysTick clock source is set to AHB clock divided by 8.
- * The us and ms delay multipliers are calculated based on the system clock frequency.
+ * The us and ms delay multipliers are calculated from the HCLK frequency that RCC reports, so they stay right
+ * whatever the PLL and AHB prescaler settings are. Call it again after changing the clock tree.
  *
- * @param sysclk System clock frequency in MHz.
+ * @param sysclk System clock frequency in MHz. Not used any more, the frequency is read from RCC.
  */
 void SysTick_Init(u8 sysclk) {
+    RCC_ClocksTypeDef clocks;
+    u32 hz;
+
+    (void)sysclk;
     SysTick_CLKSourceConfig(SysTick_CLKSource_HCLK_Div8);
-    fac_us = SYSCLK / 8;
-    fac_ms = (u16)fac_us * 1000;
+    RCC_GetClocksFreq(&clocks);
+    hz = clocks.HCLK_Frequency / 8;                             // SysTick count rate
+    fac_us = (u32)((((uint64_t)hz << 16) + 999999) / 1000000);  // Rounded up so delays are never short
+    fac_ms = (hz + 999) / 1000;
+}
+
+/**
+ * @brief Chooses whether delays sleep with WFI or spin.
+ *
+ * When sleeping, the core stops between interrupts and SysTick interrupts wake it up, which saves power in
+ * long delays. Delays called with interrupts masked (PRIMASK set) always spin.
+ *
+ * @param enable 1 to sleep, 0 to spin.
+ */
+void SysTick_Set_Sleep(uint8_t enable) {
+    systick_sleep = enable;
+}
+
+/**
+ * @brief Converts microseconds to SysTick counts.
+ *
+ * @param nus Number of microseconds.
+ *
+ * @return The number of counts, rounded up.
+ */
+static uint64_t SysTick_Us_To_Counts(u32 nus) {
+    return ((uint64_t)nus * fac_us + 0xffff) >> 16;
+}
+
+/**
+ * @brief Waits for a number of SysTick counts by programming SysTick, for use while the clock is not running.
+ *
+ * SysTick->LOAD has 24 bits, so long waits are split into reloads of at most 2^24 counts.
+ *
+ * @param counts Number of SysTick counts to wait.
+ */
+static void SysTick_Wait(uint64_t counts) {
+    u32 chunk;
+    u32 temp;
+    u32 ctrl = SysTick_CTRL_ENABLE_Msk;
+    uint8_t sleep = systick_sleep && !__get_PRIMASK();
+
+    if (sleep) {
+        ctrl |= SysTick_CTRL_TICKINT_Msk;  // The interrupt is what wakes the core
+    }
+    while (counts) {
+        chunk = counts > SysTick_LOAD_RELOAD_Msk + 1 ? SysTick_LOAD_RELOAD_Msk + 1 : (u32)counts;
+        if (chunk < 2) {
+            chunk = 2;  // A reload value of 0 never sets COUNTFLAG
+        }
+        SysTick->LOAD = chunk - 1;  // Counts from chunk - 1 down to 0, then sets COUNTFLAG
+        SysTick->VAL = 0x00;        // Clear the counter
+        SysTick->CTRL |= ctrl;      // Start counting
+        if (sleep) {
+            do {
+                __disable_irq();  // No interrupt between the check and WFI, or the wake-up could be lost
+                temp = SysTick->CTRL;
+                if (!(temp & SysTick_CTRL_COUNTFLAG_Msk)) {
+                    __WFI();  // A pending interrupt still wakes the core
+                }
+                __enable_irq();
+            } while (!(temp & SysTick_CTRL_COUNTFLAG_Msk));
+        } else {
+            do {
+                temp = SysTick->CTRL;
+            } while (!(temp & SysTick_CTRL_COUNTFLAG_Msk));  // Wait for the count to reach zero
+        }
+        SysTick->CTRL &= ~ctrl;  // Stop counting
+        counts -= counts > chunk ? chunk : counts;
+    }
+    SysTick->VAL = 0X00;  // Clear the counter
+}
+
+static uint64_t SysTick_Clock_Read(u32 *val);
+
+/**
+ * @brief Busy-waits for a number of SysTick counts while the clock is running.
+ *
+ * Elapsed counts are summed from successive reads of the down-counter, so the wait does not depend on the SysTick
+ * interrupt and also works in interrupt handlers and with interrupts disabled. With sleeping enabled the core
+ * sleeps until the next interrupt while more than a tick is left, then spins for the rest; a sleep can last a
+ * whole reload and end on the counter value it started from, so then the time is read from the tick count and
+ * the counter together.
+ *
+ * @param counts Number of SysTick counts to wait.
+ */
+static void SysTick_Clock_Wait(uint64_t counts) {
+    u32 reload = SysTick->LOAD + 1;
+    u32 last;
+    u32 now;
+    uint64_t elapsed = 0;
+    uint64_t pos;  // Counts since SysTick_Clock_Init()
+    uint64_t end;
+
+    if (systick_sleep && !__get_PRIMASK()) {
+        end = SysTick_Clock_Read(&now) * reload + (now ? reload - now : 0) + counts;
+        while ((pos = SysTick_Clock_Read(&now) * reload + (now ? reload - now : 0)) < end) {
+            if (end - pos > reload) {
+                __WFI();  // The tick interrupt wakes the core within one reload
+            }
+        }
+        return;
+    }
+
+    last = SysTick->VAL;
+    while (elapsed < counts) {
+        now = SysTick->VAL;
+        elapsed += now <= last ? last - now : last + reload - now;  // The counter reloaded in between
+        last = now;
+    }
+}
+
+/**
+ * @brief Starts SysTick as a free-running clock with a tick of SYSTICK_TICK_US microseconds.
+ *
+ * SysTick_Init() must have been called first. The SysTick interrupt gets the highest priority so the tick count
+ * stays exact even while other handlers run for longer than a tick; it only increments the counter.
+ */
+void SysTick_Clock_Init(void) {
+    systick_ticks = 0;
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = fac_ms * SYSTICK_TICK_US / 1000 - 1;
+    SysTick->VAL = 0x00;
+    NVIC_SetPriority(SysTick_IRQn, 0);
+    systick_clock = 1;
+    SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;  // Count and interrupt on every reload
+}
+
+/**
+ * @brief Reads the tick count and the down-counter as one consistent pair.
+ *
+ * If the counter has reloaded but the interrupt has not run yet (because interrupts are masked or a handler of
+ * the same priority is running), the pending tick is added so time never goes backwards.
+ *
+ * @param val Receives the down-counter value that belongs to the returned tick count.
+ *
+ * @return The tick count.
+ */
+static uint64_t SysTick_Clock_Read(u32 *val) {
+    uint64_t t;
+    u32 v;
+
+    do {
+        t = systick_ticks;
+        v = SysTick->VAL;
+        if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {  // Reloaded before or just after v was read
+            v = SysTick->VAL;
+            t++;
+        }
+    } while (t != systick_ticks && t != systick_ticks + 1);  // The interrupt ran in between
+    *val = v;
+    return t;
+}
+
+/**
+ * @brief Returns the number of ticks since SysTick_Clock_Init().
+ *
+ * @return The 64-bit tick count, which never wraps in practice.
+ */
+uint64_t SysTick_Get_Ticks(void) {
+    u32 v;
+
+    return SysTick_Clock_Read(&v);
+}
+
+/**
+ * @brief Returns the microseconds elapsed since SysTick_Clock_Init().
+ *
+ * The resolution is one SysTick count, 1 / 9 us at 72 MHz.
+ *
+ * @return The 64-bit monotonic timestamp in microseconds.
+ */
+uint64_t SysTick_Get_Us(void) {
+    u32 v;
+    uint64_t t = SysTick_Clock_Read(&v);
+
+    // The tick is counted when the counter reaches 0, one count before it reloads, so 0 starts the new tick
+    return t * SYSTICK_TICK_US + (v ? SysTick->LOAD + 1 - v : 0) * 1000 / fac_ms;
+}
+
+/**
+ * @brief SysTick interrupt handler, counts one tick.
+ */
+void SysTick_Handler(void) {
+    systick_ticks++;
 }
 
 /**
  * @brief Delays the program execution for a specified number of milliseconds.
  *
  * Uses SysTick to delay the program execution for the specified number of milliseconds.
- * The maximum delay is limited by the SysTick counter size (24 bits) and the system clock frequency.
+ * Long delays are split into several SysTick reloads, so every value is exact. While the SysTick clock runs
+ * (see SysTick_Clock_Init()), the delay measures time on the running counter and SysTick keeps running.
  *
- * @param nms Number of milliseconds to delay. Maximum value depends on the system clock frequency.
- * For a 72MHz system clock, the maximum delay is approximately 1864ms.
+ * @param nms Number of milliseconds to delay, any value.
  */
 void delay_ms(u16 nms) {
-    u32 temp;
-    SysTick->LOAD = (u32)nms * fac_ms;  // Time to load (SysTick->LOAD is a 24-bit register)
-    SysTick->VAL = 0x00;  // Clear the counter
-    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;  // Start counting
-    do {
-        temp = SysTick->CTRL;
-    } while ((temp & 0x01) && !(temp & (1 << 16)));  // Wait for the count to reach zero
-    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;  // Stop counting
-    SysTick->VAL = 0X00;  // Clear the counter
+    if (systick_clock) {
+        SysTick_Clock_Wait((uint64_t)nms * fac_ms);
+    } else {
+        SysTick_Wait((uint64_t)nms * fac_ms);
+    }
 }
 
 /**
  * @brief Delays the program execution for a specified number of microseconds.
  *
  * Uses SysTick to delay the program execution for the specified number of microseconds.
- * The maximum delay is limited by the SysTick counter size (24 bits) and the system clock frequency.
+ * Long delays are split into several SysTick reloads, so every value is exact. While the SysTick clock runs,
+ * the delay measures time on the running counter and SysTick keeps running. The resolution is one SysTick count
+ * (1 / 9 us at 72 MHz); use DWT_Delay_Ns() for cycle resolution.
  *
- * @param nus Number of microseconds to delay. Maximum value is 798915us (2^24/fac_us@fac_us=21).
+ * @param nus Number of microseconds to delay, any value.
  */
 void delay_us(u32 nus) {
-    u32 temp;
-    SysTick->LOAD = nus * fac_us;  // Time to load
-    SysTick->VAL = 0x00;  // Clear the counter
-    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;  // Start counting
-    do {
-        temp = SysTick->CTRL;
-    } while ((temp & 0x01) && !(temp & (1 << 16)));  // Wait for the count to reach zero
-    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;  // Stop counting
-    SysTick->VAL = 0X00;  // Clear the counter
+    if (systick_clock) {
+        SysTick_Clock_Wait(SysTick_Us_To_Counts(nus));
+    } else {
+        SysTick_Wait(SysTick_Us_To_Counts(nus));
+    }
 }
@@ -5,7 +5,8 @@
  * @date 2024-08-01
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
  *
- * This file contains the implementation of the SysTick timer initialization and delay functions.
+ * This file contains the implementation of the SysTick timer initialization and delay functions, and of the
+ * free-running SysTick clock that provides 64-bit tick and microsecond timestamps.
  */
 
 #ifndef SYSTICK_SYSTICK_H_
@@ -13,24 +14,61 @@
 
 #include "system.h"
 
+#define SYSTICK_TICK_US 1000  // Tick length of the free-running clock in microseconds
+
 /**
  * @brief Initializes the delay functions using SysTick.
  *
  * The SysTick clock source is set to AHB clock divided by 8.
- * The us and ms delay multipliers are calculated based on the system clock frequency.
+ * The us and ms delay multipliers are calculated from the HCLK frequency that RCC reports, so they stay right
+ * whatever the PLL and AHB prescaler settings are. Call it again after changing the clock tree.
  *
- * @param sysclk System clock frequency in MHz.
+ * @param sysclk System clock frequency in MHz. Not used any more, the frequency is read from RCC.
  */
 void SysTick_Init(uint8_t sysclk);
 
+/**
+ * @brief Chooses whether delays sleep with WFI or spin.
+ *
+ * When sleeping, the core stops between interrupts and SysTick interrupts wake it up, which saves power in
+ * long delays. Delays called with interrupts masked (PRIMASK set) always spin.
+ *
+ * @param enable 1 to sleep, 0 to spin.
+ */
+void SysTick_Set_Sleep(uint8_t enable);
+
+/**
+ * @brief Starts SysTick as a free-running clock with a tick of SYSTICK_TICK_US microseconds.
+ *
+ * SysTick_Init() must have been called first. From then on SysTick is never stopped: delay_ms() and delay_us()
+ * measure time on the running counter instead of reprogramming it.
+ */
+void SysTick_Clock_Init(void);
+
+/**
+ * @brief Returns the number of ticks since SysTick_Clock_Init().
+ *
+ * @return The 64-bit tick count, which never wraps in practice.
+ */
+uint64_t SysTick_Get_Ticks(void);
+
+/**
+ * @brief Returns the microseconds elapsed since SysTick_Clock_Init().
+ *
+ * The resolution is one SysTick count, 1 / 9 us at 72 MHz.
+ *
+ * @return The 64-bit monotonic timestamp in microseconds.
+ */
+uint64_t SysTick_Get_Us(void);
+
 /**
  * @brief Delays the program execution for a specified number of milliseconds.
  *
  * Uses SysTick to delay the program execution for the specified number of milliseconds.
- * The maximum delay is limited by the SysTick counter size (24 bits) and the system clock frequency.
+ * Long delays are split into several SysTick reloads, so every value is exact. While the SysTick clock runs
+ * (see SysTick_Clock_Init()), the delay measures time on the running counter and SysTick keeps running.
  *
- * @param nms Number of milliseconds to delay. Maximum value depends on the system clock frequency.
- * For a 72MHz system clock, the maximum delay is approximately 1864ms.
+ * @param nms Number of milliseconds to delay, any value.
  */
 void delay_ms(uint16_t nms);
 
@@ -38,9 +76,11 @@ void delay_ms(uint16_t nms);
  * @brief Delays the program execution for a specified number of microseconds.
  *
  * Uses SysTick to delay the program execution for the specified number of microseconds.
- * The maximum delay is limited by the SysTick counter size (24 bits) and the system clock frequency.
+ * Long delays are split into several SysTick reloads, so every value is exact. While the SysTick clock runs,
+ * the delay measures time on the running counter and SysTick keeps running. The resolution is one SysTick count
+ * (1 / 9 us at 72 MHz); use DWT_Delay_Ns() for cycle resolution.
  *
- * @param nus Number of microseconds to delay. Maximum value is 798915us (2^24/fac_us@fac_us=21).
+ * @param nus Number of microseconds to delay, any value.
  */
 void delay_us(uint32_t nus);
 
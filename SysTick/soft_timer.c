@@ -0,0 +1,211 @@
+/**
+ * @file soft_timer.c
+ * @brief Source file for the software timers driven by the SysTick clock.
+ * @author Yixiang Fan
+ * @date 2024-08-01
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "soft_timer.h"
+#include "SysTick.h"
+
+#define SOFT_TIMER_MASK (SOFT_TIMER_SLOTS - 1)
+#define SOFT_TIMER_SPAN ((uint64_t)1 << (SOFT_TIMER_SLOT_BITS * SOFT_TIMER_LEVELS))  // Ticks covered directly
+
+static Soft_Timer_TypeDef *soft_timer_wheel[SOFT_TIMER_LEVELS][SOFT_TIMER_SLOTS];  // Slot lists
+static uint64_t soft_timer_base;                                                   // Next tick to process
+
+/**
+ * @brief Links a timer into the head of a list.
+ *
+ * @param head The list.
+ * @param timer The timer.
+ *
+ * @return void
+ */
+static void Soft_Timer_Link(Soft_Timer_TypeDef **head, Soft_Timer_TypeDef *timer) {
+    timer->next = *head;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+}
+
+/**
+ * @brief Unlinks a timer from whatever list it is in.
+ *
+ * @param timer The timer, which must be linked.
+ *
+ * @return void
+ */
+static void Soft_Timer_Unlink(Soft_Timer_TypeDef *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->pprev = 0;
+}
+
+/**
+ * @brief Files a timer into the slot that the wheel reaches first at or after its expiry.
+ *
+ * A timer that is already due goes into the slot of the next tick to process.
+ *
+ * @param timer The timer.
+ *
+ * @return void
+ */
+static void Soft_Timer_Insert(Soft_Timer_TypeDef *timer) {
+    uint64_t e = timer->expires;
+    uint64_t delta;
+    uint8_t level;
+
+    if (e < soft_timer_base) {
+        e = soft_timer_base;
+    }
+    delta = e - soft_timer_base;
+    if (delta >= SOFT_TIMER_SPAN) {
+        e = soft_timer_base + SOFT_TIMER_SPAN - 1;  // Park in the farthest slot, re-filed when reached
+        delta = SOFT_TIMER_SPAN - 1;
+    }
+    for (level = 0; level < SOFT_TIMER_LEVELS - 1; ++level) {
+        if (delta < (uint64_t)1 << (SOFT_TIMER_SLOT_BITS * (level + 1))) {
+            break;
+        }
+    }
+    Soft_Timer_Link(&soft_timer_wheel[level][(e >> (SOFT_TIMER_SLOT_BITS * level)) & SOFT_TIMER_MASK], timer);
+}
+
+/**
+ * @brief Re-files every timer of a higher-level slot into the levels below.
+ *
+ * @param level The level, 1 or more.
+ * @param slot The slot.
+ *
+ * @return void
+ */
+static void Soft_Timer_Cascade(uint8_t level, uint8_t slot) {
+    Soft_Timer_TypeDef *list = soft_timer_wheel[level][slot];
+    Soft_Timer_TypeDef *timer;
+
+    soft_timer_wheel[level][slot] = 0;
+    while (list) {
+        timer = list;
+        list = timer->next;
+        Soft_Timer_Insert(timer);
+    }
+}
+
+/**
+ * @brief Initializes the wheel at the current SysTick tick.
+ *
+ * The SysTick clock must be running (see SysTick_Clock_Init()).
+ *
+ * @return void
+ */
+void Soft_Timer_Init(void) {
+    uint8_t level;
+    uint8_t slot;
+
+    for (level = 0; level < SOFT_TIMER_LEVELS; ++level) {
+        for (slot = 0; slot < SOFT_TIMER_SLOTS; ++slot) {
+            soft_timer_wheel[level][slot] = 0;
+        }
+    }
+    soft_timer_base = SysTick_Get_Ticks() + 1;
+}
+
+/**
+ * @brief Starts or restarts a timer.
+ *
+ * Periodic timers are reloaded from their previous expiry, not from the time their callback ran, so they do not
+ * drift even if Soft_Timer_Process() is called late.
+ *
+ * @param timer The timer.
+ * @param delay The ticks until the first expiry; 0 fires at the next tick.
+ * @param period The ticks between later expiries, 0 for a one-shot timer.
+ * @param cb Called on expiry.
+ * @param arg User data for the callback.
+ *
+ * @return void
+ */
+void Soft_Timer_Start(Soft_Timer_TypeDef *timer, uint32_t delay, uint32_t period, Soft_Timer_Callback cb,
+                      void *arg) {
+    Soft_Timer_Stop(timer);
+    timer->expires = SysTick_Get_Ticks() + (delay ? delay : 1);
+    timer->period = period;
+    timer->cb = cb;
+    timer->arg = arg;
+    Soft_Timer_Insert(timer);
+}
+
+/**
+ * @brief Stops a timer. Stopping an inactive timer does nothing.
+ *
+ * @param timer The timer.
+ *
+ * @return void
+ */
+void Soft_Timer_Stop(Soft_Timer_TypeDef *timer) {
+    if (timer->pprev) {
+        Soft_Timer_Unlink(timer);
+    }
+}
+
+/**
+ * @brief Returns whether a timer is waiting to fire.
+ *
+ * @param timer The timer.
+ *
+ * @return 1 if active, 0 if not.
+ */
+uint8_t Soft_Timer_Active(const Soft_Timer_TypeDef *timer) {
+    return timer->pprev != 0;
+}
+
+/**
+ * @brief Advances the wheel to the current tick and calls the callbacks of the expired timers.
+ *
+ * Call it from the main loop at least once per tick for on-time callbacks; after a longer gap the missed ticks
+ * are processed in order and each timer still fires once per expiry.
+ *
+ * @return void
+ */
+void Soft_Timer_Process(void) {
+    uint64_t now = SysTick_Get_Ticks();
+    Soft_Timer_TypeDef *list;
+    Soft_Timer_TypeDef *timer;
+    uint8_t level;
+    uint8_t slot;
+
+    while (soft_timer_base <= now) {
+        // At the start of every block of a level, redistribute the matching slot of the level above, lowest level
+        // first. Timers due exactly now land in the level 0 slot that is run below.
+        for (level = 1; level < SOFT_TIMER_LEVELS; ++level) {
+            if (soft_timer_base & (((uint64_t)1 << (SOFT_TIMER_SLOT_BITS * level)) - 1)) {
+                break;  // Not at a block boundary of this level
+            }
+            Soft_Timer_Cascade(level, (soft_timer_base >> (SOFT_TIMER_SLOT_BITS * level)) & SOFT_TIMER_MASK);
+        }
+
+        // Detach the due slot and move on to the next tick first, so callbacks can start and stop timers freely,
+        // including the ones still in the detached list
+        slot = soft_timer_base & SOFT_TIMER_MASK;
+        list = soft_timer_wheel[0][slot];
+        soft_timer_wheel[0][slot] = 0;
+        soft_timer_base++;
+        if (list) {
+            list->pprev = &list;
+        }
+        while (list) {
+            timer = list;
+            Soft_Timer_Unlink(timer);
+            if (timer->period) {
+                timer->expires += timer->period;
+                Soft_Timer_Insert(timer);
+            }
+            timer->cb(timer);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+/**
+ * @file soft_timer.h
+ * @brief Header file for the software timers driven by the SysTick clock.
+ * @author Yixiang Fan
+ * @date 2024-08-01
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Timers are kept in a hierarchical timing wheel of SOFT_TIMER_LEVELS levels of SOFT_TIMER_SLOTS slots. Level 0
+ * holds the timers due within SOFT_TIMER_SLOTS ticks, one slot per tick; every higher level covers
+ * SOFT_TIMER_SLOTS times the span of the level below, and a slot of it is redistributed to the lower levels when
+ * the wheel reaches it. Starting and stopping a timer is O(1) whatever the number of timers, and each tick only
+ * visits the timers that are due. Expiry times beyond the top level are parked in its farthest slot and
+ * re-filed when reached.
+ *
+ * Callbacks run from Soft_Timer_Process() in the main loop, not in the SysTick interrupt. The timer functions must
+ * only be called from thread context.
+ */
+
+#ifndef SYSTICK_SOFT_TIMER_H_
+#define SYSTICK_SOFT_TIMER_H_
+
+#include "system.h"
+
+#define SOFT_TIMER_SLOT_BITS 6                        // log2 of the slots per level
+#define SOFT_TIMER_SLOTS (1 << SOFT_TIMER_SLOT_BITS)  // Slots per level
+#define SOFT_TIMER_LEVELS 4                           // Levels, covering 2^24 ticks (4.6 h at 1 ms) directly
+
+typedef struct Soft_Timer_TypeDef Soft_Timer_TypeDef;
+
+/**
+ * @brief Callback type for an expired timer.
+ *
+ * The callback may start or stop any timer, including its own.
+ *
+ * @param timer The expired timer.
+ */
+typedef void (*Soft_Timer_Callback)(Soft_Timer_TypeDef *timer);
+
+/**
+ * @brief A software timer. The links are owned by the wheel while the timer is active.
+ *
+ * A timer must be zero-initialized (static storage is) before it is first started or stopped.
+ */
+struct Soft_Timer_TypeDef {
+    Soft_Timer_TypeDef *next;    // Next timer in the same slot
+    Soft_Timer_TypeDef **pprev;  // Link that points to this timer, NULL while inactive
+    uint64_t expires;            // Tick at which the timer fires
+    uint32_t period;             // Reload in ticks, 0 for a one-shot timer
+    Soft_Timer_Callback cb;      // Called on expiry
+    void *arg;                   // User data for the callback
+};
+
+/**
+ * @brief Initializes the wheel at the current SysTick tick.
+ *
+ * The SysTick clock must be running (see SysTick_Clock_Init()).
+ *
+ * @return void
+ */
+void Soft_Timer_Init(void);
+
+/**
+ * @brief Starts or restarts a timer.
+ *
+ * Periodic timers are reloaded from their previous expiry, not from the time their callback ran, so they do not
+ * drift even if Soft_Timer_Process() is called late.
+ *
+ * @param timer The timer.
+ * @param delay The ticks until the first expiry; 0 fires at the next tick.
+ * @param period The ticks between later expiries, 0 for a one-shot timer.
+ * @param cb Called on expiry.
+ * @param arg User data for the callback.
+ *
+ * @return void
+ */
+void Soft_Timer_Start(Soft_Timer_TypeDef *timer, uint32_t delay, uint32_t period, Soft_Timer_Callback cb,
+                      void *arg);
+
+/**
+ * @brief Stops a timer. Stopping an inactive timer does nothing.
+ *
+ * @param timer The timer.
+ *
+ * @return void
+ */
+void Soft_Timer_Stop(Soft_Timer_TypeDef *timer);
+
+/**
+ * @brief Returns whether a timer is waiting to fire.
+ *
+ * @param timer The timer.
+ *
+ * @return 1 if active, 0 if not.
+ */
+uint8_t Soft_Timer_Active(const Soft_Timer_TypeDef *timer);
+
+/**
+ * @brief Advances the wheel to the current tick and calls the callbacks of the expired timers.
+ *
+ * Call it from the main loop at least once per tick for on-time callbacks; after a longer gap the missed ticks
+ * are processed in order and each timer still fires once per expiry.
+ *
+ * @return void
+ */
+void Soft_Timer_Process(void);
+
+#endif  // SYSTICK_SOFT_TIMER_H_
@@ -0,0 +1,301 @@
+/**
+ * @file bench_adc_filter.c
+ * @brief Host test and benchmark of the fixed-point ADC sample filters against straightforward references.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Every filter runs on noisy 12-bit samples taken from an interleaved block with a stride, in blocks of uneven
+ * length, and its outputs must equal a reference that recomputes each output from scratch: the sum of the group
+ * for oversampling, the window sum for the moving average, a sort of the window for the median and a
+ * floating-point recursion, within one LSB, for the IIR. Then the time per sample of each filter is printed.
+ * The host times are only relative; on the target DWT_PROF_BEGIN/END around a call give the cycles.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh bench_adc_filter
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+#include "adc_filter.c"
+
+#define BENCH_CHANNELS 3  // Interleaved channels of the input block, the filters read rank 1
+#define BENCH_LEN 4096u   // Samples per channel
+#define BENCH_RUNS 200    // Passes over the block for the timing
+
+static uint16_t bench_in[BENCH_LEN * BENCH_CHANNELS];
+static uint16_t bench_out[BENCH_LEN];
+
+/**
+ * @brief Fills the block with a slow ramp plus noise and occasional spikes, clipped to 12 bits.
+ *
+ * @param void
+ * @return void
+ */
+static void Bench_Fill(void) {
+    int32_t v;
+    uint32_t i;
+
+    for (i = 0; i < BENCH_LEN * BENCH_CHANNELS; ++i) {
+        v = (int32_t)(i / BENCH_CHANNELS % 2048) + 1000 + rand() % 64 - 32;
+        if (rand() % 50 == 0) {
+            v = rand() % 2 ? 4095 : 0;  // Spike
+        }
+        bench_in[i] = (uint16_t)(v < 0 ? 0 : v > 4095 ? 4095 : v);
+    }
+}
+
+/**
+ * @brief Returns sample i of the channel the filters read.
+ *
+ * @param i The sample.
+ * @return The sample.
+ */
+static uint16_t Bench_X(uint32_t i) { return bench_in[i * BENCH_CHANNELS + 1]; }
+
+/**
+ * @brief Returns the length of the next block, so that blocks of 1 to 97 samples alternate.
+ *
+ * @param done Samples processed so far.
+ * @return The block length, at most what is left.
+ */
+static uint16_t Bench_Block(uint32_t done) {
+    uint16_t len = (uint16_t)(1 + rand() % 97);
+
+    return done + len > BENCH_LEN ? (uint16_t)(BENCH_LEN - done) : len;
+}
+
+/**
+ * @brief qsort() order of samples.
+ *
+ * @param a The first sample.
+ * @param b The second sample.
+ * @return Negative, zero or positive as a is below, equal to or above b.
+ */
+static int Bench_Cmp(const void *a, const void *b) { return *(const uint16_t *)a - *(const uint16_t *)b; }
+
+/**
+ * @brief Oversampling gives the sum of every group of 4^bits samples shifted right by bits.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Oversample(void) {
+    ADC_Oversample_TypeDef f;
+    static uint16_t full[256];
+    uint32_t mismatches = 0;
+    uint32_t nout = 0;
+    uint32_t done;
+    uint32_t sum;
+    uint32_t k;
+    uint16_t len;
+    uint16_t n;
+    uint16_t i;
+    uint8_t bits;
+
+    for (bits = 1; bits <= 4; ++bits) {
+        ADC_Oversample_Init(&f, bits);
+        nout = 0;
+        for (done = 0; done < BENCH_LEN; done += len) {
+            len = Bench_Block(done);
+            n = ADC_Oversample_Process(&f, &bench_in[done * BENCH_CHANNELS + 1], len, BENCH_CHANNELS, bench_out);
+            for (i = 0; i < n; ++i, ++nout) {
+                for (sum = 0, k = 0; k < 1u << (2 * bits); ++k) {
+                    sum += Bench_X(nout * (1u << (2 * bits)) + k);
+                }
+                mismatches += bench_out[i] != sum >> bits;
+            }
+        }
+        CHECK(nout == BENCH_LEN >> (2 * bits));
+    }
+    CHECK(mismatches == 0);
+
+    for (i = 0; i < 256; ++i) {
+        full[i] = 4095;
+    }
+    ADC_Oversample_Init(&f, 4);  // Full scale stays in 16 bits
+    CHECK(ADC_Oversample_Process(&f, full, 256, 1, bench_out) == 1 && bench_out[0] == 65520);
+}
+
+/**
+ * @brief The moving average is the window sum shifted right, with the window pre-filled by the initial value.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_MovAvg(void) {
+    ADC_MovAvg_TypeDef f;
+    uint32_t mismatches = 0;
+    uint32_t done;
+    uint32_t sum;
+    uint32_t j;
+    uint32_t k;
+    uint16_t len;
+    uint16_t last = 0;
+    uint8_t shift;
+
+    for (shift = 0; shift <= ADC_FILTER_MAVG_MAX_SHIFT; ++shift) {
+        ADC_MovAvg_Init(&f, shift, 777);
+        for (done = 0; done < BENCH_LEN; done += len) {
+            len = Bench_Block(done);
+            last = ADC_MovAvg_Process(&f, &bench_in[done * BENCH_CHANNELS + 1], len, BENCH_CHANNELS, bench_out);
+            for (j = 0; j < len; ++j) {
+                for (sum = 0, k = 0; k < 1u << shift; ++k) {
+                    sum += done + j >= k ? Bench_X(done + j - k) : 777;
+                }
+                mismatches += bench_out[j] != sum >> shift;
+            }
+        }
+        mismatches += last != bench_out[len - 1];
+    }
+    CHECK(mismatches == 0);
+}
+
+/**
+ * @brief The IIR follows y += alpha * (x - y) within one LSB and settles on a constant input.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_IIR(void) {
+    static const int16_t alphas[] = {1, 100, 3277, 16384, 32767};
+    static const uint16_t full[1] = {4095};
+    ADC_IIR_TypeDef f;
+    uint32_t errors = 0;
+    uint32_t done;
+    uint32_t j;
+    uint16_t len;
+    double y;
+    uint8_t a;
+
+    for (a = 0; a < sizeof(alphas) / sizeof(alphas[0]); ++a) {
+        ADC_IIR_Init(&f, alphas[a], 2000);
+        y = 2000;
+        for (done = 0; done < BENCH_LEN; done += len) {
+            len = Bench_Block(done);
+            ADC_IIR_Process(&f, &bench_in[done * BENCH_CHANNELS + 1], len, BENCH_CHANNELS, bench_out);
+            for (j = 0; j < len; ++j) {
+                y += alphas[a] / 32768.0 * (Bench_X(done + j) - y);
+                errors += bench_out[j] + 1 < y || bench_out[j] > y + 1;
+            }
+        }
+    }
+    CHECK(errors == 0);
+
+    ADC_IIR_Init(&f, 3277, 0);  // Time constant of 10 samples
+    for (j = 0; j < 200; ++j) {
+        ADC_IIR_Process(&f, full, 1, 1, 0);
+    }
+    CHECK(ADC_IIR_Process(&f, full, 1, 1, 0) == 4095);
+}
+
+/**
+ * @brief The median is the middle of the sorted window, or the upper middle of the samples while it fills.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Median(void) {
+    ADC_Median_TypeDef f;
+    uint16_t win[ADC_FILTER_MEDIAN_MAX_N];
+    uint32_t mismatches = 0;
+    uint32_t done;
+    uint32_t j;
+    uint32_t k;
+    uint32_t m;
+    uint16_t len;
+    uint8_t n;
+
+    for (n = 3; n <= ADC_FILTER_MEDIAN_MAX_N; n += 2) {
+        ADC_Median_Init(&f, n);
+        for (done = 0; done < BENCH_LEN; done += len) {
+            len = Bench_Block(done);
+            ADC_Median_Process(&f, &bench_in[done * BENCH_CHANNELS + 1], len, BENCH_CHANNELS, bench_out);
+            for (j = 0; j < len; ++j) {
+                m = done + j + 1 < n ? done + j + 1 : n;  // Samples in the window
+                for (k = 0; k < m; ++k) {
+                    win[k] = Bench_X(done + j - k);
+                }
+                qsort(win, m, sizeof(win[0]), Bench_Cmp);
+                mismatches += bench_out[j] != win[m / 2];
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+/**
+ * @brief Prints the time per sample of one filter run over the block.
+ *
+ * @param name The filter.
+ * @param t0 The clock at the start of the runs.
+ * @return void
+ */
+static void Bench_Report(const char *name, clock_t t0) {
+    printf("%-22s %6.2f ns per sample\n", name,
+           (double)(clock() - t0) / CLOCKS_PER_SEC * 1e9 / ((double)BENCH_RUNS * BENCH_LEN));
+}
+
+/**
+ * @brief Times every filter over the block, one call per block as a DMA half-buffer callback would make it.
+ *
+ * @param void
+ * @return void
+ */
+static void Bench_Filters(void) {
+    ADC_Oversample_TypeDef os;
+    ADC_MovAvg_TypeDef mavg;
+    ADC_IIR_TypeDef iir;
+    ADC_Median_TypeDef med;
+    volatile uint16_t sink = 0;
+    clock_t t0;
+    uint16_t r;
+
+    ADC_Oversample_Init(&os, 2);
+    t0 = clock();
+    for (r = 0; r < BENCH_RUNS; ++r) {
+        sink += ADC_Oversample_Process(&os, &bench_in[1], BENCH_LEN, BENCH_CHANNELS, bench_out);
+    }
+    Bench_Report("oversample, 2 bits", t0);
+
+    ADC_MovAvg_Init(&mavg, 4, 0);
+    t0 = clock();
+    for (r = 0; r < BENCH_RUNS; ++r) {
+        sink += ADC_MovAvg_Process(&mavg, &bench_in[1], BENCH_LEN, BENCH_CHANNELS, bench_out);
+    }
+    Bench_Report("moving average, 16", t0);
+
+    ADC_IIR_Init(&iir, 3277, 0);
+    t0 = clock();
+    for (r = 0; r < BENCH_RUNS; ++r) {
+        sink += ADC_IIR_Process(&iir, &bench_in[1], BENCH_LEN, BENCH_CHANNELS, bench_out);
+    }
+    Bench_Report("IIR", t0);
+
+    ADC_Median_Init(&med, 5);
+    t0 = clock();
+    for (r = 0; r < BENCH_RUNS; ++r) {
+        sink += ADC_Median_Process(&med, &bench_in[1], BENCH_LEN, BENCH_CHANNELS, bench_out);
+    }
+    Bench_Report("median of 5", t0);
+
+    ADC_Median_Init(&med, 9);
+    t0 = clock();
+    for (r = 0; r < BENCH_RUNS; ++r) {
+        sink += ADC_Median_Process(&med, &bench_in[1], BENCH_LEN, BENCH_CHANNELS, bench_out);
+    }
+    Bench_Report("median of 9", t0);
+    (void)sink;
+}
+
+int main(void) {
+    srand(1);
+    Bench_Fill();
+    Test_Oversample();
+    Test_MovAvg();
+    Test_IIR();
+    Test_Median();
+    Bench_Filters();
+    return TEST_EXIT("bench_adc_filter");
+}
@@ -0,0 +1,386 @@
+/**
+ * @file bench_blog.c
+ * @brief Host test of the binary log through the decoder, and benchmark of it against printf() per message.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Messages of the repository's printf() calls are logged with BLOG() and sent by the TXE interrupt into a
+ * capture, which blog_decode.c turns back into text; it must match snprintf() of the same format and arguments,
+ * with the right timestamps. On a full TX ring whole records are dropped and the rest still decode, and a
+ * capture cut at any byte decodes only the records before the cut. Then the bytes and the time per message of
+ * both paths are printed, the send interrupts included: printf() formats and queues every character through
+ * fputc(), BLOG() encodes a record. The host times are only relative; on the target DWT_PROF_BEGIN/END give the
+ * cycles.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh bench_blog
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test.h"
+#include "host.h"
+#include "usart.c"
+#include "dma.c"
+#include "blog.c"
+#define BLOG_DECODE_NO_MAIN
+#include "blog_decode.c"
+
+#define SIM_CAP_LEN 2000000u  // Bytes of the capture
+#define SIM_TEXT_LEN 4000000u
+#define BENCH_MSGS 200000u
+
+// Messages of the printf() calls in Input_Capture/main.c, Scheduler/main.c, touch_key.c and DMA/main.c
+#define SIM_FMT_CAPTURE "High-level duration: %d us\r\n"
+#define SIM_FMT_REPORT "temp adc=%u touches=%u\r\n"
+#define SIM_FMT_TOUCH "touch_default_val=%d \r\n"
+#define SIM_FMT_CROSSOVER "DMA copy crossover: %lu bytes\r\n"
+#define SIM_FMT_NONE "DMA1 Channel4 is in use, KEY_UP send disabled\r\n"
+#define SIM_FMT_MIX "%s at %p: %c%c %x %X %o %i %+5d|%-4u|%08x %%\r\n"
+#define SIM_FMT_MAX "%u %u %u %u %u %u %u %u %u %u %u %u %u %u %u\r\n"
+
+static uint8_t sim_cap[SIM_CAP_LEN];  // Bytes written to DR
+static uint32_t sim_cap_len;
+static char sim_dict[0x20000];  // Format strings at their IDs, room for one that crosses 64 KiB
+static char sim_expect[SIM_TEXT_LEN];
+static uint32_t sim_expect_len;
+static uint32_t sim_now;      // Clock of the records
+static uint64_t sim_elapsed;  // The same clock without the wraps, as the decoder sums it
+
+void USART_SendData(USART_TypeDef *USARTx, uint16_t Data) {
+    USARTx->DR = Data & 0x1ff;
+    sim_cap[sim_cap_len++ % SIM_CAP_LEN] = (uint8_t)Data;
+}
+
+/**
+ * @brief Timestamp source of the records.
+ *
+ * @param void
+ * @return The simulated time.
+ */
+static uint32_t Sim_Clock(void) { return sim_now; }
+
+/**
+ * @brief Advances the clock of the records.
+ *
+ * @param ticks The time to add.
+ * @return void
+ */
+static void Sim_Tick(uint32_t ticks) {
+    sim_now += ticks;
+    sim_elapsed += ticks;
+}
+
+/**
+ * @brief Runs the TXE interrupt until the TX ring is empty.
+ *
+ * @param void
+ * @return The number of interrupts.
+ */
+static uint32_t Sim_Drain(void) {
+    uint32_t n = 0;
+
+    while (USART1->CR1 & USART_CR1_TXEIE) {
+        USART1->SR |= USART_FLAG_TXE;
+        USART1_IRQHandler();
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Adds the format of the record that starts at a capture position to the dictionary, at the record's ID.
+ *
+ * @param at The capture position of the record.
+ * @param fmt The format string the record was logged with.
+ * @return void
+ */
+static void Sim_Learn(uint32_t at, const char *fmt) {
+    uint16_t id = (uint16_t)(sim_cap[at + 1] | sim_cap[at + 2] << 8);
+
+    memcpy(&sim_dict[id], fmt, strlen(fmt) + 1);
+}
+
+/**
+ * @brief Appends the text the decoder must print for a record: its timestamp and the formatted message.
+ *
+ * @param fmt The format string, with the arguments after it.
+ * @return void
+ */
+static void Sim_Expect(const char *fmt, ...) {
+    va_list args;
+
+    sim_expect_len += (uint32_t)sprintf(&sim_expect[sim_expect_len], "[%llu] ", (unsigned long long)sim_elapsed);
+    va_start(args, fmt);
+    sim_expect_len += (uint32_t)vsprintf(&sim_expect[sim_expect_len], fmt, args);
+    va_end(args);
+}
+
+/**
+ * @brief Runs the decoder on the capture.
+ *
+ * @param len The number of capture bytes to decode.
+ * @param text Receives the text, SIM_TEXT_LEN bytes.
+ * @return The number of records decoded.
+ */
+static long Sim_Decode(uint32_t len, char *text) {
+    FILE *in = fmemopen(sim_cap, len ? len : 1, "rb");
+    FILE *out = fmemopen(text, SIM_TEXT_LEN, "wb");
+    long records;
+
+    memset(text, 0, SIM_TEXT_LEN);
+    if (len == 0) {
+        fgetc(in);  // Nothing to decode, fmemopen() wants a buffer
+    }
+    records = Decode(in, out, sim_dict, sizeof(sim_dict) - 1);
+    fclose(in);
+    fclose(out);
+    return records;
+}
+
+/**
+ * @brief Logs every kind of message with random arguments and delays; the decoded text matches printf().
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Round_Trip(void) {
+    static char text[SIM_TEXT_LEN];
+    static const char name[] = "adc";
+    uint32_t at;
+    uint32_t i;
+    uint32_t v;
+    long records;
+
+    srand(8);
+    BLog_Init(Sim_Clock);
+    for (i = 0; i < 20000; ++i) {
+        Sim_Tick(rand() % 4 ? (uint32_t)(rand() % 100) : (uint32_t)rand() * 3u);  // Deltas of one to five bytes, and wraps
+        v = (uint32_t)rand() * 2654435761u;
+        at = sim_cap_len;
+        switch (i % 7) {
+        case 0:
+            BLOG(SIM_FMT_CAPTURE, (int)v);
+            Sim_Expect(SIM_FMT_CAPTURE, (int)v);
+            break;
+        case 1:
+            BLOG(SIM_FMT_REPORT, v & 0xfff, v >> 20);
+            Sim_Expect(SIM_FMT_REPORT, v & 0xfff, v >> 20);
+            break;
+        case 2:
+            BLOG(SIM_FMT_TOUCH, (int16_t)v);
+            Sim_Expect(SIM_FMT_TOUCH, (int16_t)v);
+            break;
+        case 3:
+            BLOG(SIM_FMT_CROSSOVER, (unsigned long)v);
+            Sim_Expect(SIM_FMT_CROSSOVER, (unsigned long)v);
+            break;
+        case 4:
+            BLOG(SIM_FMT_NONE);
+            Sim_Expect(SIM_FMT_NONE);
+            break;
+        case 5:  // Pointers print as their address
+            BLOG(SIM_FMT_MIX, name, &name[1], 'o', 'k', v, v, v & 0777, (int)v, (int)(v % 1000) - 500, v % 10000,
+                 v);
+            Sim_Expect("<0x%08x> at <0x%08x>: ok %x %X %o %i %+5d|%-4u|%08x %%\r\n", (uint32_t)(uintptr_t)name,
+                       (uint32_t)(uintptr_t)&name[1], v, v, v & 0777, (int)v, (int)(v % 1000) - 500, v % 10000, v);
+            break;
+        default:
+            BLOG(SIM_FMT_MAX, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, v);
+            Sim_Expect(SIM_FMT_MAX, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, v);
+            break;
+        }
+        Sim_Drain();
+        Sim_Learn(at, i % 7 == 0   ? SIM_FMT_CAPTURE
+                      : i % 7 == 1 ? SIM_FMT_REPORT
+                      : i % 7 == 2 ? SIM_FMT_TOUCH
+                      : i % 7 == 3 ? SIM_FMT_CROSSOVER
+                      : i % 7 == 4 ? SIM_FMT_NONE
+                      : i % 7 == 5 ? SIM_FMT_MIX
+                                   : SIM_FMT_MAX);
+    }
+    records = Sim_Decode(sim_cap_len, text);
+    CHECK(records == 20000);
+    CHECK(strlen(text) == sim_expect_len && memcmp(text, sim_expect, sim_expect_len) == 0);
+}
+
+/**
+ * @brief With the TX ring full whole records are dropped: the capture holds only complete records, and the
+ *        timestamps of those after a drop are still right.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Drop(void) {
+    static char text[SIM_TEXT_LEN];
+    uint32_t dropped0;
+    uint32_t queued = 0;
+    uint32_t sent = 0;
+    uint32_t i;
+    uint16_t head;
+    uint8_t partial = 0;
+
+    sim_cap_len = 0;
+    sim_expect_len = 0;
+    BLog_Init(Sim_Clock);
+    sim_elapsed = 0;
+    USART1_TX_Set_Policy(USART_TX_Drop_Oldest);  // Never discards queued bytes of a record either
+    for (i = 0; i < 200; ++i) {
+        Sim_Tick(1000);
+        dropped0 = USART1_TX_Dropped();
+        head = usart1_tx_head;
+        BLOG(SIM_FMT_REPORT, 100000u + i, 2000000u);
+        if (USART1_TX_Dropped() == dropped0) {
+            Sim_Expect(SIM_FMT_REPORT, 100000u + i, 2000000u);
+            queued += (uint16_t)(usart1_tx_head - head);
+            sent++;
+        } else {
+            partial |= usart1_tx_head != head;  // Not a byte of a dropped record
+        }
+        if (i % 50 == 49) {  // The line catches up now and then
+            Sim_Drain();
+        }
+    }
+    Sim_Drain();
+    Sim_Learn(0, SIM_FMT_REPORT);  // Every BLOG() has a format string, and an ID, of its own
+    CHECK(!partial && sent > 40 && sent < 200);
+    CHECK(Sim_Decode(sim_cap_len, text) == (long)sent && sim_cap_len == queued);
+    CHECK(strlen(text) == sim_expect_len && memcmp(text, sim_expect, sim_expect_len) == 0);
+    USART1_TX_Set_Policy(USART_TX_Block);
+}
+
+/**
+ * @brief A capture cut at any byte decodes the records before the cut and nothing else.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Truncated(void) {
+    static char text[SIM_TEXT_LEN];
+    static const uint32_t args[3] = {0, 300, 70000};
+    uint32_t ends[3];
+    uint32_t cut;
+    uint8_t n;
+    uint8_t ok = 1;
+
+    sim_cap_len = 0;
+    BLog_Init(0);
+    for (n = 0; n < 3; ++n) {
+        BLog_Write(0x1234, args, n + 1);
+        Sim_Drain();
+        ends[n] = sim_cap_len;
+    }
+    for (cut = 0; cut <= sim_cap_len; ++cut) {
+        ok &= Sim_Decode(cut, text) == (cut >= ends[2] ? 3 : cut >= ends[1] ? 2 : cut >= ends[0] ? 1 : 0);
+    }
+    CHECK(ok && ends[0] == 5 && ends[2] == 5 + 7 + 10);  // 300 and 70000 take two and three bytes
+}
+
+/**
+ * @brief printf() as the C library runs it on the target: formats, then calls fputc() for every character.
+ *
+ * @param fmt The format string.
+ * @return The number of characters written.
+ */
+static int Bench_Printf(const char *fmt, ...) {
+    char buf[128];
+    va_list args;
+    int n;
+    int i;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    for (i = 0; i < n; ++i) {
+        fputc(buf[i], stdout);  // The fputc() of usart.c
+    }
+    return n;
+}
+
+/**
+ * @brief Returns the time between two clock readings in ns.
+ *
+ * @param t0 The first reading.
+ * @param t1 The second reading.
+ * @return t1 - t0 in ns.
+ */
+static double Bench_Ns(const struct timespec *t0, const struct timespec *t1) {
+    return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+/**
+ * @brief Prints the bytes and the time per message of one message kind through both paths.
+ *
+ * @param name The message kind.
+ * @param kind 0 to 3, the format.
+ * @return void
+ */
+static void Bench_Message(const char *name, uint8_t kind) {
+    struct timespec t0;
+    struct timespec t1;
+    uint32_t cap0;
+    uint32_t i;
+    double printf_bytes;
+    double printf_ns;
+    double blog_bytes;
+    double blog_ns;
+
+    cap0 = sim_cap_len;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_MSGS; ++i) {
+        if (kind == 0) {
+            Bench_Printf(SIM_FMT_CAPTURE, (int)(i % 20000));
+        } else if (kind == 1) {
+            Bench_Printf(SIM_FMT_REPORT, i & 0xfff, i & 0xff);
+        } else if (kind == 2) {
+            Bench_Printf(SIM_FMT_TOUCH, (int)(i % 100));
+        } else {
+            Bench_Printf(SIM_FMT_CROSSOVER, (unsigned long)(i % 4096));
+        }
+        Sim_Drain();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf_bytes = (double)(sim_cap_len - cap0) / BENCH_MSGS;
+    printf_ns = Bench_Ns(&t0, &t1) / BENCH_MSGS;
+
+    cap0 = sim_cap_len;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_MSGS; ++i) {
+        Sim_Tick(1000);  // 1 ms ticks
+        if (kind == 0) {
+            BLOG(SIM_FMT_CAPTURE, (int)(i % 20000));
+        } else if (kind == 1) {
+            BLOG(SIM_FMT_REPORT, i & 0xfff, i & 0xff);
+        } else if (kind == 2) {
+            BLOG(SIM_FMT_TOUCH, (int)(i % 100));
+        } else {
+            BLOG(SIM_FMT_CROSSOVER, (unsigned long)(i % 4096));
+        }
+        Sim_Drain();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    blog_bytes = (double)(sim_cap_len - cap0) / BENCH_MSGS;
+    blog_ns = Bench_Ns(&t0, &t1) / BENCH_MSGS;
+
+    CHECK(blog_bytes < printf_bytes / 3);
+    printf("%-10s printf(): %5.1f bytes %6.1f ns   BLOG(): %4.1f bytes %6.1f ns   %.1fx fewer bytes, %.1fx faster\n",
+           name, printf_bytes, printf_ns, blog_bytes, blog_ns, printf_bytes / blog_bytes, printf_ns / blog_ns);
+}
+
+int main(void) {
+    USART1_Init(115200);
+    Test_Round_Trip();
+    Test_Drop();
+    Test_Truncated();
+    BLog_Init(Sim_Clock);
+    Bench_Message("capture", 0);
+    Bench_Message("report", 1);
+    Bench_Message("touch", 2);
+    Bench_Message("crossover", 3);
+    return TEST_EXIT("bench_blog");
+}
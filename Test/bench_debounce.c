@@ -0,0 +1,194 @@
+/**
+ * @file bench_debounce.c
+ * @brief Host benchmark of the bitwise port debouncer against per-key debouncing at 4, 16, 64 and 256 pins.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The per-key debouncer is the approach of key.c, one branchy counter per pin with the same rule: a pin flips
+ * after DEBOUNCE_SAMPLES samples in a row that differ from its debounced state. Both run on the same bouncing
+ * samples; their states and edges must agree at every step, and the time per update of all pins is printed.
+ * 256 pins are four banks of four ports.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * gcc -std=c99 -O2 -no-pie -iquote Test/host -iquote Bit-band -iquote Key
+ *     -o bench_debounce Test/bench_debounce.c Test/host/host.c && ./bench_debounce
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test.h"
+#include "debounce.c"
+
+#define BENCH_PORTS 16      // 256 pins
+#define BENCH_SAMPLES 4096  // Precomputed sample sets, reused round-robin
+#define BENCH_UPDATES 200000
+
+/**
+ * @brief Per-key debounce state of one pin.
+ */
+typedef struct {
+    uint8_t state;  // Debounced level, 1 = pressed
+    uint8_t cnt;    // Samples in a row that differ from state
+} Bench_Key_TypeDef;
+
+static uint16_t bench_raw[BENCH_SAMPLES][BENCH_PORTS];
+static Bench_Key_TypeDef bench_key[BENCH_PORTS * 16];
+static uint8_t bench_key_edge[BENCH_PORTS * 16];  // 1 pressed, 2 released in the last update
+static Debounce_TypeDef bench_bank[BENCH_PORTS / DEBOUNCE_MAX_PORTS];
+
+/**
+ * @brief Debounces one pin the per-key way.
+ *
+ * @param k The pin.
+ * @param level The raw level, 1 = pressed.
+ * @return 1 if it became pressed, 2 if it became released, 0 otherwise.
+ */
+static uint8_t Bench_Key_Process(Bench_Key_TypeDef *k, uint8_t level) {
+    if (level == k->state) {
+        k->cnt = 0;
+        return 0;
+    }
+    if (++k->cnt < DEBOUNCE_SAMPLES) {
+        return 0;
+    }
+    k->cnt = 0;
+    k->state = level;
+    return level ? 1 : 2;
+}
+
+/**
+ * @brief Debounces one sample set of the first pins the per-key way.
+ *
+ * @param raw The port samples.
+ * @param pins The number of pins.
+ * @return void
+ */
+static void Bench_Keys(const uint16_t *raw, uint16_t pins) {
+    uint16_t p;
+
+    for (p = 0; p < pins; ++p) {
+        bench_key_edge[p] = Bench_Key_Process(&bench_key[p], (raw[p >> 4] >> (p & 15)) & 1);
+    }
+}
+
+/**
+ * @brief Debounces one sample set of the first pins with the banks.
+ *
+ * @param raw The port samples.
+ * @param pins The number of pins.
+ * @return void
+ */
+static void Bench_Banks(const uint16_t *raw, uint16_t pins) {
+    uint8_t b;
+
+    for (b = 0; b * DEBOUNCE_MAX_PORTS * 16 < pins; ++b) {
+        Debounce_Process(&bench_bank[b], raw + b * DEBOUNCE_MAX_PORTS);
+    }
+}
+
+/**
+ * @brief Fills the samples with keys that are pressed and released now and then and bounce at every change.
+ *
+ * @param void
+ * @return void
+ */
+static void Bench_Fill(void) {
+    static uint8_t level[BENCH_PORTS * 16];
+    static uint8_t bounce[BENCH_PORTS * 16];
+    uint16_t p;
+    uint16_t s;
+
+    for (s = 0; s < BENCH_SAMPLES; ++s) {
+        for (p = 0; p < BENCH_PORTS * 16; ++p) {
+            if (bounce[p]) {
+                bounce[p]--;
+                if (rand() % 2) {
+                    bench_raw[s][p >> 4] |= 1u << (p & 15);  // Random level while it bounces
+                }
+                continue;
+            }
+            if (rand() % 200 == 0) {
+                level[p] = !level[p];
+                bounce[p] = rand() % 8;
+            }
+            if (level[p]) {
+                bench_raw[s][p >> 4] |= 1u << (p & 15);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Checks that both debouncers agree over all the samples, then times them.
+ *
+ * @param pins The number of pins, a multiple of 4.
+ * @return void
+ */
+static void Bench_Run(uint16_t pins) {
+    uint8_t nports = (pins + 15) / 16;
+    uint8_t nbanks = (nports + DEBOUNCE_MAX_PORTS - 1) / DEBOUNCE_MAX_PORTS;
+    uint32_t mismatches = 0;
+    uint16_t raw[BENCH_PORTS];
+    uint16_t state;
+    uint16_t pressed;
+    uint16_t released;
+    uint16_t p;
+    uint32_t u;
+    uint8_t b;
+    uint8_t bit;
+    clock_t t0;
+    double key_ns;
+    double bank_ns;
+
+    for (b = 0; b < nbanks; ++b) {
+        Debounce_Init(&bench_bank[b], NULL, NULL,
+                      nports - b * DEBOUNCE_MAX_PORTS < DEBOUNCE_MAX_PORTS ? nports - b * DEBOUNCE_MAX_PORTS
+                                                                             : DEBOUNCE_MAX_PORTS);
+    }
+    memset(bench_key, 0, sizeof(bench_key));
+    for (u = 0; u < BENCH_SAMPLES; ++u) {
+        for (p = 0; p < BENCH_PORTS; ++p) {
+            raw[p] = p * 16 < pins ? bench_raw[u][p] & (pins - p * 16 >= 16 ? 0xffff : (1u << (pins - p * 16)) - 1)
+                                   : 0;
+        }
+        Bench_Keys(raw, pins);
+        Bench_Banks(raw, pins);
+        for (p = 0; p < pins; p += 16) {
+            b = p / 16 / DEBOUNCE_MAX_PORTS;
+            state = Debounce_Get_State(&bench_bank[b], p / 16 % DEBOUNCE_MAX_PORTS);
+            pressed = Debounce_Get_Pressed(&bench_bank[b], p / 16 % DEBOUNCE_MAX_PORTS);
+            released = Debounce_Get_Released(&bench_bank[b], p / 16 % DEBOUNCE_MAX_PORTS);
+            for (bit = 0; bit < 16 && p + bit < pins; ++bit) {
+                mismatches += ((state >> bit) & 1) != bench_key[p + bit].state;
+                mismatches += ((pressed >> bit) & 1) != (bench_key_edge[p + bit] == 1);
+                mismatches += ((released >> bit) & 1) != (bench_key_edge[p + bit] == 2);
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+
+    t0 = clock();
+    for (u = 0; u < BENCH_UPDATES; ++u) {
+        Bench_Keys(bench_raw[u % BENCH_SAMPLES], pins);
+    }
+    key_ns = (double)(clock() - t0) / CLOCKS_PER_SEC * 1e9 / BENCH_UPDATES;
+    t0 = clock();
+    for (u = 0; u < BENCH_UPDATES; ++u) {
+        Bench_Banks(bench_raw[u % BENCH_SAMPLES], pins);
+    }
+    bank_ns = (double)(clock() - t0) / CLOCKS_PER_SEC * 1e9 / BENCH_UPDATES;
+    printf("%3u pins: per-key %8.1f ns, bitwise %6.1f ns per update, %5.1fx\n", pins, key_ns, bank_ns,
+           bank_ns > 0 ? key_ns / bank_ns : 0);
+}
+
+int main(void) {
+    srand(1);
+    Bench_Fill();
+    Bench_Run(4);
+    Bench_Run(16);
+    Bench_Run(64);
+    Bench_Run(256);
+    return TEST_EXIT("bench_debounce");
+}
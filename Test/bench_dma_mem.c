@@ -0,0 +1,373 @@
+/**
+ * @file bench_dma_mem.c
+ * @brief Host test of the DMA memory copy and fill, and of the crossover search of DMA_Mem_Calibrate().
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The simulated controller runs a memory-to-memory channel to the end as soon as PRIMASK is clear, and its
+ * interrupt chains the next chunk. Copies and fills of every length up to 260 bytes at every source and
+ * destination alignment, and a copy longer than one 0xffff item chunk, must leave exactly the target bytes
+ * changed, through the CPU below the threshold and through the DMA above it, with the widest item size the
+ * alignment allows. An asynchronous operation started with interrupts masked stays busy until they are unmasked
+ * and calls back once.
+ *
+ * DMA_Mem_Calibrate() runs against a fake DWT cycle counter that charges by the bytes moved, not by its reads: the
+ * scratch buffer is poisoned, and a read charges a Cortex-M3 cost model of the CPU copy for the bytes the CPU wrote
+ * since the previous read; the controller adds a setup cost plus a per-item bus cost for every chunk it moves. The
+ * threshold found must be the crossover of the model for several bus costs, every size tried must be copied once
+ * by the CPU, and the search must give up, and say so, when the DMA never wins. The host speed of the CPU copy,
+ * word path against byte loop, is printed.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh bench_dma_mem
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+
+static uint32_t Sim_Cycles(void);
+
+#define DWT_CYCCNT() Sim_Cycles()  // dwt.h reads this counter instead of DWT->CYCCNT
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test.h"
+#include "host.h"
+#include "dma_mem.c"
+#include "dma.c"
+#include "dwt.c"
+
+#define SIM_BIG 300001u     // Longer than a 0xffff byte chunk
+#define SIM_GUARD 8         // Bytes checked on each side of a target
+#define SIM_DMA_SETUP 300   // Cycles to submit, start, interrupt and call back, assumed for the model
+#define SIM_CALIB_MAX 16384
+
+static uint8_t sim_src[SIM_BIG + 2 * SIM_GUARD];
+static uint8_t sim_dst[SIM_BIG + 2 * SIM_GUARD];
+static uint8_t sim_ref[SIM_BIG + 2 * SIM_GUARD];
+static DMA_Mem_TypeDef sim_h;  // Static: a fill reads its pattern from the handle through the DMA
+static uint32_t sim_primask;
+static uint8_t sim_running;      // 1 while the controller runs, the chained submits must not start it again
+static uint32_t sim_chunks;      // Chunks moved by the controller
+static uint8_t sim_width;        // Item size of the last chunk
+static uint32_t sim_callbacks;
+static uint32_t sim_cycles;      // The fake cycle counter
+static uint32_t sim_item_cost;   // Bus cycles per DMA item in the model
+static uint8_t sim_calib;        // 1 while DMA_Mem_Calibrate() runs
+static uint32_t sim_cpu_bytes;   // Bytes charged to the CPU copy since it started
+
+/**
+ * @brief Cycles of the word-aligned CPU copy of len bytes on a Cortex-M3 with zero wait-state SRAM: the call,
+ *        13 cycles per unrolled 16-byte step, 4 per remaining word and 5 per remaining byte.
+ *
+ * @param len The number of bytes.
+ * @return The cycles.
+ */
+static uint32_t Sim_CPU_Cost(uint32_t len) { return 30 + len / 16 * 13 + len % 16 / 4 * 4 + len % 4 * 5; }
+
+/**
+ * @brief Counts the bytes written to the poisoned scratch buffer since the last call and poisons them again.
+ *
+ * A poisoned byte is the complement of its source byte, and every copy of DMA_Mem_Calibrate() writes from the
+ * start of the buffer, so the written bytes are the prefix that matches the source.
+ *
+ * @param void
+ * @return The number of bytes written.
+ */
+static uint32_t Sim_Written(void) {
+    uint32_t n = 0;
+
+    while (n < SIM_CALIB_MAX && sim_dst[n] == sim_src[n]) {
+        sim_dst[n] = (uint8_t)~sim_src[n];
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief The fake DWT counter: a cycle per read, plus the CPU copy cost of the bytes the CPU wrote since the
+ *        previous read while DMA_Mem_Calibrate() runs.
+ *
+ * @param void
+ * @return The cycle count.
+ */
+static uint32_t Sim_Cycles(void) {
+    uint32_t n = sim_calib ? Sim_Written() : 0;
+
+    if (n) {
+        sim_cpu_bytes += n;
+        sim_cycles += Sim_CPU_Cost(n);
+    }
+    return ++sim_cycles;
+}
+
+/**
+ * @brief Runs the memory channel to the end of its queue, as the controller does once interrupts are unmasked.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Run(void) {
+    DMA_Channel_TypeDef *regs = DMA_Mgr_Channel(dma_mem_ch);
+
+    if (sim_running || sim_primask || !regs) {
+        return;
+    }
+    sim_running = 1;
+    while ((regs->CCR & DMA_CCR1_EN) && regs->CNDTR) {
+        sim_chunks++;
+        sim_width = 1u << ((regs->CCR >> 10) & 3);
+        sim_cycles += SIM_DMA_SETUP + regs->CNDTR * sim_item_cost;
+        Host_DMA_Request(regs);  // The whole chunk, and the interrupt that queues the next
+        if (sim_calib) {
+            Sim_Written();  // Charged above, not to the CPU
+        }
+    }
+    sim_running = 0;
+}
+
+uint32_t __get_PRIMASK(void) { return sim_primask; }
+
+void __set_PRIMASK(uint32_t primask) {
+    sim_primask = primask & 1;
+    Sim_Run();
+}
+
+void __disable_irq(void) { __set_PRIMASK(1); }
+void __enable_irq(void) { __set_PRIMASK(0); }
+
+/**
+ * @brief Counts the completion callbacks.
+ *
+ * @param h The finished operation.
+ * @return void
+ */
+static void Sim_Done(DMA_Mem_TypeDef *h) { sim_callbacks++; }
+
+/**
+ * @brief Copies or fills one target, with sim_ref as the expected result; checks every byte around it.
+ *
+ * @param fill 1 for a fill, 0 for a copy.
+ * @param doff The destination offset from the guard.
+ * @param soff The source offset from the guard.
+ * @param len The number of bytes.
+ * @return 1 if the result is right.
+ */
+static uint8_t Sim_Check(uint8_t fill, uint32_t doff, uint32_t soff, uint32_t len) {
+    uint8_t c = (uint8_t)rand();
+    uint32_t callbacks = sim_callbacks;
+
+    memset(sim_dst, 0xee, SIM_GUARD * 2 + len + 4);
+    memcpy(sim_ref, sim_dst, SIM_GUARD * 2 + len + 4);
+    if (fill) {
+        memset(&sim_ref[SIM_GUARD + doff], c, len);
+        DMA_Memset_Async(&sim_h, &sim_dst[SIM_GUARD + doff], c, len, Sim_Done);
+    } else {
+        memcpy(&sim_ref[SIM_GUARD + doff], &sim_src[SIM_GUARD + soff], len);
+        DMA_Memcpy_Async(&sim_h, &sim_dst[SIM_GUARD + doff], &sim_src[SIM_GUARD + soff], len, Sim_Done);
+    }
+    return DMA_Mem_Done(&sim_h) && sim_callbacks == callbacks + 1 &&
+           memcmp(sim_dst, sim_ref, SIM_GUARD * 2 + len + 4) == 0;
+}
+
+/**
+ * @brief Every length and alignment through the CPU and through the DMA, and the item size the DMA uses.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Copy_Fill(void) {
+    uint32_t wrong = 0;
+    uint32_t width_wrong = 0;
+    uint32_t chunks0;
+    uint32_t len;
+    uint32_t i;
+    uint8_t doff;
+    uint8_t soff;
+    uint8_t fill;
+    uint8_t width;
+
+    for (i = 0; i < sizeof(sim_src); ++i) {
+        sim_src[i] = (uint8_t)(i * 131 + (i >> 9));
+    }
+
+    chunks0 = sim_chunks;
+    for (len = 0; len < 260; ++len) {  // No channel yet: the CPU does it all
+        wrong += !Sim_Check(0, len % 4, len / 4 % 4, len) + !Sim_Check(1, len % 4, 0, len);
+    }
+    CHECK(wrong == 0 && sim_chunks == chunks0);
+
+    CHECK(DMA_Mem_Init() == 7 && DMA_Mem_Init() == 7);
+    for (fill = 0; fill < 2; ++fill) {
+        DMA_Mem_Set_Threshold(0);  // Everything through the DMA
+        for (doff = 0; doff < 4; ++doff) {
+            for (soff = 0; soff < 4; ++soff) {
+                for (len = 0; len < 260; ++len) {
+                    chunks0 = sim_chunks;
+                    wrong += !Sim_Check(fill, doff, soff, len);
+                    width = fill || ((doff ^ soff) & 3) == 0 ? 4 : ((doff ^ soff) & 1) == 0 ? 2 : 1;
+                    width_wrong += sim_chunks != chunks0 && sim_width != width;
+                }
+            }
+        }
+        DMA_Mem_Set_Threshold(0xffffffffu);  // Everything through the CPU
+        chunks0 = sim_chunks;
+        for (len = 0; len < 260; ++len) {
+            wrong += !Sim_Check(fill, len % 4, len / 4 % 4, len);
+        }
+        wrong += sim_chunks != chunks0;
+    }
+    CHECK(wrong == 0 && width_wrong == 0);
+
+    DMA_Mem_Set_Threshold(DMA_MEM_THRESHOLD);
+    chunks0 = sim_chunks;
+    CHECK(Sim_Check(0, 0, 1, SIM_BIG - 4) && sim_chunks - chunks0 == (SIM_BIG - 4 + 0xfffe) / 0xffff);
+    CHECK(Sim_Check(0, 0, 0, SIM_BIG - 4) && Sim_Check(1, 3, 0, SIM_BIG - 4));
+    chunks0 = sim_chunks;
+    CHECK(Sim_Check(0, 1, 2, DMA_MEM_THRESHOLD - 1) && sim_chunks == chunks0);
+    CHECK(Sim_Check(0, 1, 2, DMA_MEM_THRESHOLD) && sim_chunks == chunks0 + 1);
+    CHECK(DMA_Memcpy(&sim_dst[1], &sim_src[5], 1000) == &sim_dst[1] && memcmp(&sim_dst[1], &sim_src[5], 1000) == 0);
+}
+
+/**
+ * @brief An operation started with interrupts masked runs once they are unmasked, and calls back once.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Async(void) {
+    uint32_t callbacks = sim_callbacks;
+
+    memset(sim_dst, 0, 4096);
+    __disable_irq();
+    DMA_Memcpy_Async(&sim_h, sim_dst, sim_src, 4096, Sim_Done);
+    CHECK(!DMA_Mem_Done(&sim_h) && sim_callbacks == callbacks && DMA_Mgr_Busy(dma_mem_ch));
+    __enable_irq();
+    CHECK(DMA_Mem_Done(&sim_h) && sim_callbacks == callbacks + 1 && memcmp(sim_dst, sim_src, 4096) == 0);
+    CHECK(!DMA_Mgr_Busy(dma_mem_ch));
+
+    __disable_irq();
+    DMA_Memset_Async(&sim_h, sim_dst, 0x5a, 16, Sim_Done);  // Below the threshold: done before returning
+    CHECK(DMA_Mem_Done(&sim_h) && sim_callbacks == callbacks + 2 && sim_dst[15] == 0x5a);
+    __enable_irq();
+}
+
+/**
+ * @brief The first doubling size from 8 bytes at which the model's DMA copy beats its CPU copy.
+ *
+ * @param item_cost The bus cycles per DMA word.
+ * @return The crossover in bytes, or 0 if the DMA never wins up to SIM_CALIB_MAX.
+ */
+static uint32_t Sim_Crossover(uint32_t item_cost) {
+    uint32_t len;
+
+    for (len = 8; len <= SIM_CALIB_MAX; len <<= 1) {
+        if (SIM_DMA_SETUP + len / 4 * item_cost < Sim_CPU_Cost(len)) {
+            return len;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief DMA_Mem_Calibrate() finds the crossover of the model for several bus costs per word.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Calibrate(void) {
+    uint32_t found;
+    uint32_t chunks0;
+    uint32_t tried;
+    uint32_t i;
+    uint32_t wrong = 0;
+
+    DMA_Mem_Set_Threshold(DMA_MEM_THRESHOLD);
+    for (sim_item_cost = 1; sim_item_cost <= 5; ++sim_item_cost) {
+        for (i = 0; i < SIM_CALIB_MAX; ++i) {
+            sim_dst[i] = (uint8_t)~sim_src[i];  // Poisoned
+        }
+        sim_calib = 1;
+        sim_cpu_bytes = 0;
+        found = DMA_Mem_Calibrate(sim_dst, sim_src, SIM_CALIB_MAX);
+        sim_calib = 0;
+        tried = found ? found : SIM_CALIB_MAX;
+        wrong += found != Sim_Crossover(sim_item_cost) || sim_cpu_bytes != 2 * tried - 8;  // 8 + 16 + ... + tried
+        wrong += dma_mem_threshold != (found ? found : DMA_MEM_THRESHOLD);
+        if (found) {
+            printf("%u bus cycles per DMA word: threshold %5u bytes (CPU %5u, DMA %5u cycles there)\n",
+                   sim_item_cost, found, Sim_CPU_Cost(found), SIM_DMA_SETUP + found / 4 * sim_item_cost);
+            chunks0 = sim_chunks;
+            DMA_Memcpy(sim_dst, sim_src, found - 1);
+            wrong += sim_chunks != chunks0;
+            DMA_Memcpy(sim_dst, sim_src, found);
+            wrong += sim_chunks != chunks0 + 1;
+            DMA_Mem_Set_Threshold(DMA_MEM_THRESHOLD);
+        } else {
+            printf("%u bus cycles per DMA word: DMA never faster up to %u bytes (CPU %5u, DMA %5u cycles there)\n",
+                   sim_item_cost, SIM_CALIB_MAX, Sim_CPU_Cost(SIM_CALIB_MAX),
+                   SIM_DMA_SETUP + SIM_CALIB_MAX / 4 * sim_item_cost);
+        }
+    }
+    CHECK(wrong == 0);
+    CHECK(Sim_Crossover(1) != 0 && Sim_Crossover(5) == 0);  // The model has a crossover and a DMA that never wins
+    sim_item_cost = 0;
+}
+
+/**
+ * @brief Prints the host speed of the CPU copy: the word path against a byte loop, aligned and not.
+ *
+ * @param void
+ * @return void
+ */
+static void Bench_CPU_Copy(void) {
+    static const uint32_t sizes[] = {16, 64, 256, 1024, 4096};
+    struct timespec t0;
+    struct timespec t1;
+    volatile uint8_t *d = sim_dst;
+    uint32_t reps;
+    uint32_t i;
+    uint32_t j;
+    uint8_t s;
+    double word;
+    double byte;
+    double mis;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        reps = 4000000 / sizes[s];
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < reps; ++i) {
+            DMA_Mem_CPU_Copy(sim_dst, sim_src + (i & 4), sizes[s]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        word = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / reps;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < reps; ++i) {
+            DMA_Mem_CPU_Copy(sim_dst, sim_src + 1 + (i & 4), sizes[s]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        mis = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / reps;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < reps; ++i) {
+            for (j = 0; j < sizes[s]; ++j) {
+                d[j] = sim_src[j + (i & 4)];
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        byte = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / reps;
+        printf("CPU copy of %4u bytes on the host: %7.1f ns by words, %7.1f ns misaligned, %7.1f ns by bytes\n",
+               sizes[s], word, mis, byte);
+    }
+}
+
+int main(void) {
+    srand(5);
+    Test_Copy_Fill();
+    Test_Async();
+    Test_Calibrate();
+    Bench_CPU_Copy();
+    return TEST_EXIT("bench_dma_mem");
+}
@@ -0,0 +1,227 @@
+/**
+ * @file bench_usart_log.c
+ * @brief Host test of the DMA log sink and benchmark of it against printf() through fputc() and the TX ring.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The fake DMA1 Channel4 moves one byte into USART1->DR per request and raises the transfer-complete interrupt
+ * that chains the next buffer. Messages of random length are logged while the line drains a random number of
+ * bytes in between; what reaches DR must be the accepted messages in order, truncated to LOG_BUF_SIZE - 1 bytes,
+ * and every other message must be counted as dropped. Then the CPU time per log line of both paths is printed:
+ * the sink pays the formatting and one interrupt per pool buffer, the fputc() path the formatting, a
+ * USART1_TX_Put() and a TXE interrupt per byte. The host times are only relative; on the target
+ * DWT_PROF_BEGIN/END give the cycles.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh bench_usart_log
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test.h"
+#include "host.h"
+#include "usart.c"
+#include "usart_log.c"
+#include "dma.c"
+
+#define SIM_OUT_LEN 4000000u  // Bytes kept of what the sink sent
+#define BENCH_BATCH 16        // Lines logged between two drains, the pool holds them all
+#define BENCH_LINES 200000u
+
+static uint8_t sim_out[SIM_OUT_LEN];  // Bytes written to USART1->DR by the DMA
+static uint32_t sim_out_len;
+static uint32_t sim_transfers;  // Transfers completed
+
+/**
+ * @brief Lets the line take up to max bytes from the DMA.
+ *
+ * @param max The number of byte times.
+ * @return The number of bytes sent.
+ */
+static uint32_t Sim_Drain(uint32_t max) {
+    uint32_t i;
+    uint8_t last;
+
+    for (i = 0; i < max; ++i) {
+        last = DMA1_Channel4->CNDTR == 1;
+        if (!Host_DMA_Request(DMA1_Channel4)) {
+            break;
+        }
+        sim_out[sim_out_len++ % SIM_OUT_LEN] = (uint8_t)USART1->DR;
+        sim_transfers += last;
+    }
+    return i;
+}
+
+/**
+ * @brief Logs random messages between random drains: the output is every accepted message in order and the
+ *        rest is counted as dropped.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Stream(void) {
+    static char expect[SIM_OUT_LEN];
+    static char text[3 * LOG_BUF_SIZE];
+    uint32_t expect_len = 0;
+    uint32_t msgs = 0;
+    uint32_t rejected = 0;
+    uint32_t dropped0 = Log_Dropped();
+    uint32_t transfers0 = sim_transfers;
+    uint32_t len;
+    uint32_t i;
+    uint8_t ok;
+
+    sim_out_len = 0;
+    memset(text, 'x', sizeof(text));
+    srand(7);
+    for (i = 0; i < 60000; ++i, ++msgs) {
+        len = rand() % 8 ? rand() % 40 : rand() % (2 * LOG_BUF_SIZE);  // Mostly short, some truncated
+        if (i % 5 == 0) {
+            ok = Log_Write(text, (uint16_t)len);
+            len = len > LOG_BUF_SIZE ? LOG_BUF_SIZE : len;
+            memcpy(&expect[expect_len], text, ok ? len : 0);
+        } else {
+            ok = Log_Printf("%u:%.*s\n", i, (int)len, text);
+            len = (uint32_t)snprintf(&expect[expect_len], LOG_BUF_SIZE, "%u:%.*s\n", i, (int)len, text);
+            len = len >= LOG_BUF_SIZE ? LOG_BUF_SIZE - 1 : len;
+        }
+        expect_len += ok ? len : 0;
+        rejected += !ok;
+        Sim_Drain(rand() % 4 ? rand() % 128 : 0);  // The line is slower than the producer now and then
+    }
+    while (Sim_Drain(1000)) {
+    }
+    CHECK(sim_out_len == expect_len && memcmp(sim_out, expect, expect_len) == 0);
+    CHECK(Log_Dropped() - dropped0 == rejected && rejected > 0 && rejected < msgs / 10);
+    CHECK(sim_transfers - transfers0 < msgs);  // Messages logged while a transfer runs share the next one
+    CHECK(!log_busy && log_len[log_fill & (LOG_BUF_COUNT - 1)] == 0);
+    printf("stream: %u messages in %u transfers, %u dropped\n", msgs, sim_transfers - transfers0, rejected);
+}
+
+/**
+ * @brief With the line stopped the pool fills, later messages are dropped, and logging resumes once it drains.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Pool_Full(void) {
+    static const char line[] = "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz\n";
+    uint32_t dropped0 = Log_Dropped();
+    uint32_t queued = 0;
+    uint32_t i;
+
+    sim_out_len = 0;
+    for (i = 0; i < 4 * LOG_BUF_COUNT; ++i) {
+        queued += Log_Write(line, sizeof(line) - 1);
+    }
+    CHECK(queued == LOG_BUF_COUNT && Log_Dropped() - dropped0 == 4 * LOG_BUF_COUNT - queued);
+    while (Sim_Drain(1000)) {
+    }
+    CHECK(sim_out_len == queued * (sizeof(line) - 1));
+    CHECK(Log_Printf("%s", line) && Sim_Drain(1000) == sizeof(line) - 1);
+}
+
+/**
+ * @brief printf() as the C library runs it on the target: formats, then calls fputc() for every character.
+ *
+ * @param fmt The format string.
+ * @return The number of characters written.
+ */
+static int Bench_Printf(const char *fmt, ...) {
+    char buf[LOG_BUF_SIZE];
+    va_list args;
+    int n;
+    int i;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    for (i = 0; i < n && i < LOG_BUF_SIZE - 1; ++i) {
+        fputc(buf[i], stdout);  // The fputc() of usart.c
+    }
+    return n;
+}
+
+/**
+ * @brief Returns the time between two clock readings in ns.
+ *
+ * @param t0 The first reading.
+ * @param t1 The second reading.
+ * @return t1 - t0 in ns.
+ */
+static double Bench_Ns(const struct timespec *t0, const struct timespec *t1) {
+    return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+/**
+ * @brief Times a typical log line through both paths, counting the interrupts each one takes.
+ *
+ * The DMA moving the bytes costs no CPU, so only the Log_Printf() calls are timed; the fputc() path is timed
+ * with the TXE interrupts that send its bytes.
+ *
+ * @param void
+ * @return void
+ */
+static void Bench_Lines(void) {
+    struct timespec t0;
+    struct timespec t1;
+    uint32_t transfers0 = sim_transfers;
+    uint32_t dropped0 = Log_Dropped();
+    uint32_t irqs = 0;
+    uint32_t bytes = 0;
+    uint32_t i;
+    uint8_t b;
+    double sink_ns = 0;
+    double fputc_ns;
+
+    for (i = 0; i < BENCH_LINES; i += BENCH_BATCH) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (b = 0; b < BENCH_BATCH; ++b) {
+            Log_Printf("t=%u adc=%4u state=%s\n", i + b, (i + b) & 0xfff, b & 1 ? "run" : "idle");
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        sink_ns += Bench_Ns(&t0, &t1);
+        while (Sim_Drain(1000)) {
+        }
+    }
+    sink_ns /= BENCH_LINES;
+    CHECK(Log_Dropped() == dropped0);
+    CHECK(sim_transfers - transfers0 < BENCH_LINES / 2);  // A batch fills few buffers
+
+    USART1_TX_Set_Policy(USART_TX_Block);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_LINES; ++i) {
+        bytes += (uint32_t)Bench_Printf("t=%u adc=%4u state=%s\n", i, i & 0xfff, i & 1 ? "run" : "idle");
+        while (USART1->CR1 & USART_CR1_TXEIE) {  // The TXE interrupt of every byte
+            USART1->SR |= USART_FLAG_TXE;
+            USART1_IRQHandler();
+            irqs++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fputc_ns = Bench_Ns(&t0, &t1) / BENCH_LINES;
+    CHECK(irqs == bytes + BENCH_LINES);  // One per byte, and one that finds the ring empty
+
+    printf("log sink: %6.1f ns per line, %.3f interrupts per line\n", sink_ns,
+           (double)(sim_transfers - transfers0) / BENCH_LINES);
+    printf("fputc():  %6.1f ns per line, %.3f interrupts per line, %.1fx the sink\n", fputc_ns,
+           (double)irqs / BENCH_LINES, fputc_ns / sink_ns);
+    printf("blocking fputc() at 115200 baud: %.0f ns per line of %.1f bytes\n", bytes * 86806.0 / BENCH_LINES,
+           (double)bytes / BENCH_LINES);
+}
+
+int main(void) {
+    USART1_Init(115200);
+    CHECK(Log_Init() == 1);
+    CHECK(log_desc.init.DMA_PeripheralBaseAddr == (uint32_t)&USART1->DR && (USART1->CR3 & USART_DMAReq_Tx));
+    Test_Stream();
+    Test_Pool_Full();
+    Bench_Lines();
+    return TEST_EXIT("bench_usart_log");
+}
@@ -0,0 +1,727 @@
+/**
+ * @file host.c
+ * @brief Host stand-ins for the peripherals, the core intrinsics and the Standard Peripheral Library.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The library functions act on the register variables the way the library acts on the hardware, and nothing
+ * else happens by itself: counters do not count and flags do not rise until a test sets them. Every function is
+ * weak, so a test can replace one with a model of the hardware behind it.
+ */
+
+#include "host.h"
+
+#define HOST_WEAK __attribute__((weak))
+
+uint8_t host_gpio_mem[7][HOST_GPIO_SIZE] __attribute__((aligned(HOST_GPIO_SIZE)));
+ADC_TypeDef host_adc1;
+DMA_TypeDef host_dma1, host_dma2;
+DMA_Channel_TypeDef host_dma1_ch[7], host_dma2_ch[5];
+EXTI_TypeDef host_exti;
+RCC_TypeDef host_rcc = {.CR = 0x00000083u};  // HSI on, as after reset
+TIM_TypeDef host_tim[9];
+USART_TypeDef host_usart1, host_usart2, host_usart3;
+SysTick_Type host_systick;
+DWT_Type host_dwt;
+CoreDebug_Type host_coredebug;
+SCB_Type host_scb;
+RCC_ClocksTypeDef host_clocks = {72000000, 72000000, 36000000, 72000000, 12000000};
+
+static uint32_t host_primask;
+static uint8_t host_adc_rank;         // Rank of the next ADC1 conversion, 0-based
+static uint16_t host_dma_reload[12];  // CNDTR latched when a channel was enabled, its circular reload value
+static uint8_t host_dma_enabled[12];  // 1 once the latch is taken, until the channel is disabled
+
+// Core intrinsics
+HOST_WEAK uint32_t __get_PRIMASK(void) { return host_primask; }
+HOST_WEAK void __set_PRIMASK(uint32_t primask) { host_primask = primask & 1; }
+HOST_WEAK void __disable_irq(void) { host_primask = 1; }
+HOST_WEAK void __enable_irq(void) { host_primask = 0; }
+HOST_WEAK void __DMB(void) {}
+HOST_WEAK void __DSB(void) {}
+HOST_WEAK void __NOP(void) {}
+HOST_WEAK void __WFI(void) {}
+HOST_WEAK uint32_t __CLZ(uint32_t v) { return v ? (uint32_t)__builtin_clz(v) : 32; }
+HOST_WEAK uint32_t __LDREXW(volatile uint32_t *addr) { return *addr; }
+HOST_WEAK void __CLREX(void) {}
+
+HOST_WEAK uint32_t __STREXW(uint32_t value, volatile uint32_t *addr) {
+    *addr = value;
+    return 0;  // Nothing else runs between the load and the store on the host
+}
+
+// GPIO
+HOST_WEAK void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct) {
+    uint32_t mode = GPIO_InitStruct->GPIO_Mode & 0x0f;
+    __IO uint32_t *cr;
+    uint8_t shift;
+    uint8_t pin;
+
+    if (GPIO_InitStruct->GPIO_Mode & 0x10) {
+        mode |= GPIO_InitStruct->GPIO_Speed;  // Output modes
+    }
+    for (pin = 0; pin < 16; ++pin) {
+        if (!(GPIO_InitStruct->GPIO_Pin & (1u << pin))) {
+            continue;
+        }
+        cr = pin < 8 ? &GPIOx->CRL : &GPIOx->CRH;
+        shift = (pin & 7) * 4;
+        *cr = (*cr & ~(0xfu << shift)) | (mode << shift);
+        if (GPIO_InitStruct->GPIO_Mode == GPIO_Mode_IPD) {
+            GPIOx->ODR &= ~(1u << pin);
+        }
+        if (GPIO_InitStruct->GPIO_Mode == GPIO_Mode_IPU) {
+            GPIOx->ODR |= 1u << pin;
+        }
+    }
+}
+
+HOST_WEAK uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+    return (GPIOx->IDR & GPIO_Pin) ? 1 : 0;
+}
+
+HOST_WEAK uint16_t GPIO_ReadInputData(GPIO_TypeDef *GPIOx) { return (uint16_t)GPIOx->IDR; }
+HOST_WEAK void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) { GPIOx->ODR |= GPIO_Pin; }
+HOST_WEAK void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) { GPIOx->ODR &= ~(uint32_t)GPIO_Pin; }
+HOST_WEAK void GPIO_EXTILineConfig(uint8_t GPIO_PortSource, uint8_t GPIO_PinSource) {}
+HOST_WEAK void GPIO_PinRemapConfig(uint32_t GPIO_Remap, FunctionalState NewState) {}
+
+// RCC, NVIC, EXTI
+HOST_WEAK void RCC_AHBPeriphClockCmd(uint32_t RCC_AHBPeriph, FunctionalState NewState) {}
+HOST_WEAK void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState) {}
+HOST_WEAK void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState) {}
+HOST_WEAK void RCC_GetClocksFreq(RCC_ClocksTypeDef *RCC_Clocks) { *RCC_Clocks = host_clocks; }
+HOST_WEAK void RCC_ADCCLKConfig(uint32_t RCC_PCLK2) {}
+
+// The ready flags of the oscillators and of the clock switch rise only when a test sets them
+HOST_WEAK void RCC_DeInit(void) {
+    RCC->CR = (RCC->CR & ~(RCC_CR_HSEON | RCC_CR_HSERDY | RCC_CR_PLLON | RCC_CR_PLLRDY)) | 0x00000001u;
+    RCC->CFGR = 0;
+}
+
+HOST_WEAK void RCC_HSEConfig(uint32_t RCC_HSE) {
+    RCC->CR = (RCC->CR & ~(RCC_CR_HSEON | RCC_CR_HSERDY)) | (RCC_HSE & RCC_CR_HSEON);
+}
+
+HOST_WEAK ErrorStatus RCC_WaitForHSEStartUp(void) { return (RCC->CR & RCC_CR_HSERDY) ? SUCCESS : ERROR; }
+
+HOST_WEAK FlagStatus RCC_GetFlagStatus(uint8_t RCC_FLAG) {
+    uint32_t reg = (RCC_FLAG >> 5) == 1 ? RCC->CR : (RCC_FLAG >> 5) == 2 ? RCC->BDCR : RCC->CSR;
+
+    return (reg & (1u << (RCC_FLAG & 0x1f))) ? SET : RESET;
+}
+
+HOST_WEAK void RCC_HCLKConfig(uint32_t RCC_SYSCLK) { RCC->CFGR = (RCC->CFGR & ~0x000000f0u) | RCC_SYSCLK; }
+HOST_WEAK void RCC_PCLK1Config(uint32_t RCC_HCLK) { RCC->CFGR = (RCC->CFGR & ~0x00000700u) | RCC_HCLK; }
+HOST_WEAK void RCC_PCLK2Config(uint32_t RCC_HCLK) { RCC->CFGR = (RCC->CFGR & ~0x00003800u) | (RCC_HCLK << 3); }
+
+HOST_WEAK void RCC_PLLConfig(uint32_t RCC_PLLSource, uint32_t RCC_PLLMul) {
+    RCC->CFGR = (RCC->CFGR & ~0x003f0000u) | RCC_PLLSource | RCC_PLLMul;
+}
+
+HOST_WEAK void RCC_PLLCmd(FunctionalState NewState) {
+    if (NewState) {
+        RCC->CR |= RCC_CR_PLLON;
+    } else {
+        RCC->CR &= ~(RCC_CR_PLLON | RCC_CR_PLLRDY);
+    }
+}
+
+HOST_WEAK void RCC_SYSCLKConfig(uint32_t RCC_SYSCLKSource) {
+    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_SYSCLKSource;
+}
+
+HOST_WEAK uint8_t RCC_GetSYSCLKSource(void) { return (uint8_t)(RCC->CFGR & RCC_CFGR_SWS); }
+
+HOST_WEAK void SysTick_CLKSourceConfig(uint32_t SysTick_CLKSource) {
+    if (SysTick_CLKSource == SysTick_CLKSource_HCLK) {
+        SysTick->CTRL |= SysTick_CLKSource_HCLK;
+    } else {
+        SysTick->CTRL &= SysTick_CLKSource_HCLK_Div8;
+    }
+}
+
+HOST_WEAK void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct) {}
+HOST_WEAK void NVIC_PriorityGroupConfig(uint32_t NVIC_PriorityGroup) {}
+HOST_WEAK void NVIC_EnableIRQ(IRQn_Type IRQn) {}
+HOST_WEAK void NVIC_DisableIRQ(IRQn_Type IRQn) {}
+HOST_WEAK void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {}
+
+HOST_WEAK void EXTI_Init(EXTI_InitTypeDef *EXTI_InitStruct) {
+    uint32_t line = EXTI_InitStruct->EXTI_Line;
+
+    EXTI->IMR &= ~line;
+    EXTI->EMR &= ~line;
+    EXTI->RTSR &= ~line;
+    EXTI->FTSR &= ~line;
+    if (!EXTI_InitStruct->EXTI_LineCmd) {
+        return;
+    }
+    if (EXTI_InitStruct->EXTI_Mode == EXTI_Mode_Interrupt) {
+        EXTI->IMR |= line;
+    } else {
+        EXTI->EMR |= line;
+    }
+    if (EXTI_InitStruct->EXTI_Trigger != EXTI_Trigger_Falling) {
+        EXTI->RTSR |= line;
+    }
+    if (EXTI_InitStruct->EXTI_Trigger != EXTI_Trigger_Rising) {
+        EXTI->FTSR |= line;
+    }
+}
+
+// ADC, calibration finishes at once
+HOST_WEAK void ADC_Init(ADC_TypeDef *ADCx, ADC_InitTypeDef *ADC_InitStruct) {
+    ADCx->CR1 = (ADCx->CR1 & ~0x000f0100u) | ADC_InitStruct->ADC_Mode | (ADC_InitStruct->ADC_ScanConvMode ? 0x100u : 0);
+    ADCx->CR2 = (ADCx->CR2 & ~0x000e0802u) | ADC_InitStruct->ADC_DataAlign | ADC_InitStruct->ADC_ExternalTrigConv |
+                (ADC_InitStruct->ADC_ContinuousConvMode ? 0x2u : 0);
+    ADCx->SQR1 = (ADCx->SQR1 & ~0x00f00000u) | (uint32_t)(ADC_InitStruct->ADC_NbrOfChannel - 1) << 20;
+    host_adc_rank = 0;
+}
+
+HOST_WEAK void ADC_Cmd(ADC_TypeDef *ADCx, FunctionalState NewState) {
+    if (NewState) {
+        ADCx->CR2 |= ADC_CR2_ADON;
+    } else {
+        ADCx->CR2 &= ~ADC_CR2_ADON;
+        host_adc_rank = 0;
+    }
+}
+
+HOST_WEAK void ADC_DMACmd(ADC_TypeDef *ADCx, FunctionalState NewState) {
+    if (NewState) {
+        ADCx->CR2 |= 0x100u;
+    } else {
+        ADCx->CR2 &= ~0x100u;
+    }
+}
+
+HOST_WEAK void ADC_ITConfig(ADC_TypeDef *ADCx, uint16_t ADC_IT, FunctionalState NewState) {
+    if (NewState) {
+        ADCx->CR1 |= (uint8_t)ADC_IT;
+    } else {
+        ADCx->CR1 &= ~(uint32_t)(uint8_t)ADC_IT;
+    }
+}
+
+HOST_WEAK ITStatus ADC_GetITStatus(ADC_TypeDef *ADCx, uint16_t ADC_IT) {
+    return ((ADCx->SR & (ADC_IT >> 8)) && (ADCx->CR1 & (uint8_t)ADC_IT)) ? SET : RESET;
+}
+
+HOST_WEAK void ADC_ClearITPendingBit(ADC_TypeDef *ADCx, uint16_t ADC_IT) { ADCx->SR &= ~(uint32_t)(ADC_IT >> 8); }
+
+HOST_WEAK FlagStatus ADC_GetFlagStatus(ADC_TypeDef *ADCx, uint8_t ADC_FLAG) {
+    return (ADCx->SR & ADC_FLAG) ? SET : RESET;
+}
+
+HOST_WEAK void ADC_ResetCalibration(ADC_TypeDef *ADCx) {}
+HOST_WEAK FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef *ADCx) { return RESET; }
+HOST_WEAK void ADC_StartCalibration(ADC_TypeDef *ADCx) {}
+HOST_WEAK FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef *ADCx) { return RESET; }
+
+HOST_WEAK void ADC_SoftwareStartConvCmd(ADC_TypeDef *ADCx, FunctionalState NewState) {
+    if (NewState) {
+        ADCx->CR2 |= 0x00500000u;  // EXTTRIG and SWSTART
+    } else {
+        ADCx->CR2 &= ~0x00500000u;
+    }
+}
+
+HOST_WEAK void ADC_ExternalTrigConvCmd(ADC_TypeDef *ADCx, FunctionalState NewState) {
+    if (NewState) {
+        ADCx->CR2 |= ADC_CR2_EXTTRIG;
+    } else {
+        ADCx->CR2 &= ~ADC_CR2_EXTTRIG;
+    }
+}
+
+HOST_WEAK void ADC_RegularChannelConfig(ADC_TypeDef *ADCx, uint8_t ADC_Channel, uint8_t Rank, uint8_t ADC_SampleTime) {
+    __IO uint32_t *smpr = ADC_Channel > 9 ? &ADCx->SMPR1 : &ADCx->SMPR2;
+    __IO uint32_t *sqr = Rank > 12 ? &ADCx->SQR1 : Rank > 6 ? &ADCx->SQR2 : &ADCx->SQR3;
+    uint8_t shift = 3 * (ADC_Channel % 10);
+
+    *smpr = (*smpr & ~(0x7u << shift)) | (uint32_t)ADC_SampleTime << shift;
+    shift = 5 * ((Rank - 1) % 6);
+    *sqr = (*sqr & ~(0x1fu << shift)) | (uint32_t)ADC_Channel << shift;
+}
+
+HOST_WEAK uint16_t ADC_GetConversionValue(ADC_TypeDef *ADCx) {
+    ADCx->SR &= ~ADC_SR_EOC;  // Reading DR clears EOC
+    return (uint16_t)ADCx->DR;
+}
+HOST_WEAK void ADC_TempSensorVrefintCmd(FunctionalState NewState) {}
+
+HOST_WEAK void ADC_AnalogWatchdogCmd(ADC_TypeDef *ADCx, uint32_t ADC_AnalogWatchdog) {
+    ADCx->CR1 = (ADCx->CR1 & ~0x00c00200u) | ADC_AnalogWatchdog;
+}
+
+HOST_WEAK void ADC_AnalogWatchdogThresholdsConfig(ADC_TypeDef *ADCx, uint16_t HighThreshold, uint16_t LowThreshold) {
+    ADCx->HTR = HighThreshold;
+    ADCx->LTR = LowThreshold;
+}
+
+HOST_WEAK void ADC_AnalogWatchdogSingleChannelConfig(ADC_TypeDef *ADCx, uint8_t ADC_Channel) {
+    ADCx->CR1 = (ADCx->CR1 & ~ADC_CR1_AWDCH) | ADC_Channel;
+}
+
+// DMA
+static uint8_t Host_DMA_Index(DMA_Channel_TypeDef *ch) {
+    if (ch >= DMA2_Channel1 && ch <= DMA2_Channel5) {
+        return 7 + (uint8_t)(ch - DMA2_Channel1);
+    }
+    return (uint8_t)(ch - DMA1_Channel1);
+}
+
+HOST_WEAK void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx) {
+    DMAy_Channelx->CCR = 0;
+    DMAy_Channelx->CNDTR = 0;
+    DMAy_Channelx->CPAR = 0;
+    DMAy_Channelx->CMAR = 0;
+}
+
+HOST_WEAK void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct) {
+    DMAy_Channelx->CCR = (DMAy_Channelx->CCR & 0x000f) | DMA_InitStruct->DMA_DIR | DMA_InitStruct->DMA_Mode |
+                         DMA_InitStruct->DMA_PeripheralInc | DMA_InitStruct->DMA_MemoryInc |
+                         DMA_InitStruct->DMA_PeripheralDataSize | DMA_InitStruct->DMA_MemoryDataSize |
+                         DMA_InitStruct->DMA_Priority | DMA_InitStruct->DMA_M2M;
+    DMAy_Channelx->CNDTR = DMA_InitStruct->DMA_BufferSize;
+    DMAy_Channelx->CPAR = DMA_InitStruct->DMA_PeripheralBaseAddr;
+    DMAy_Channelx->CMAR = DMA_InitStruct->DMA_MemoryBaseAddr;
+}
+
+HOST_WEAK void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState) {
+    uint8_t idx = Host_DMA_Index(DMAy_Channelx);
+
+    if (NewState) {
+        DMAy_Channelx->CCR |= DMA_CCR1_EN;
+        host_dma_reload[idx] = (uint16_t)DMAy_Channelx->CNDTR;
+    } else {
+        DMAy_Channelx->CCR &= ~DMA_CCR1_EN;
+    }
+    host_dma_enabled[idx] = NewState ? 1 : 0;
+}
+
+HOST_WEAK void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState) {
+    if (NewState) {
+        DMAy_Channelx->CCR |= DMA_IT;
+    } else {
+        DMAy_Channelx->CCR &= ~DMA_IT;
+    }
+}
+
+HOST_WEAK void DMA_SetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t DataNumber) {
+    DMAy_Channelx->CNDTR = DataNumber;
+}
+
+HOST_WEAK uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx) {
+    return (uint16_t)DMAy_Channelx->CNDTR;
+}
+
+HOST_WEAK FlagStatus DMA_GetFlagStatus(uint32_t DMAy_FLAG) {
+    DMA_TypeDef *dma = (DMAy_FLAG & 0x10000000u) ? DMA2 : DMA1;
+    return (dma->ISR & DMAy_FLAG & 0x0fffffffu) ? SET : RESET;
+}
+
+HOST_WEAK void DMA_ClearFlag(uint32_t DMAy_FLAG) {
+    DMA_TypeDef *dma = (DMAy_FLAG & 0x10000000u) ? DMA2 : DMA1;
+    uint32_t flags = DMAy_FLAG & 0x0fffffffu;
+
+    dma->ISR &= ~(flags | (flags & 0x01111111u) * 0xfu);  // Clearing a global flag clears all flags of its channel
+}
+
+// TIM
+static __IO uint16_t *Host_TIM_CCMR(TIM_TypeDef *TIMx, uint8_t ch) { return ch < 2 ? &TIMx->CCMR1 : &TIMx->CCMR2; }
+static __IO uint16_t *Host_TIM_CCR(TIM_TypeDef *TIMx, uint8_t ch) { return &TIMx->CCR1 + 2 * ch; }
+
+static void Host_TIM_OCInit(TIM_TypeDef *TIMx, uint8_t ch, TIM_OCInitTypeDef *TIM_OCInitStruct) {
+    uint8_t shift = (ch & 1) * 8;
+
+    TIMx->CCER &= ~(0xfu << (4 * ch));
+    *Host_TIM_CCMR(TIMx, ch) = (*Host_TIM_CCMR(TIMx, ch) & ~(0xffu << shift)) | (TIM_OCInitStruct->TIM_OCMode << shift);
+    TIMx->CCER |= (TIM_OCInitStruct->TIM_OutputState | TIM_OCInitStruct->TIM_OCPolarity |
+                   TIM_OCInitStruct->TIM_OutputNState | TIM_OCInitStruct->TIM_OCNPolarity)
+                  << (4 * ch);
+    *Host_TIM_CCR(TIMx, ch) = TIM_OCInitStruct->TIM_Pulse;
+}
+
+static void Host_TIM_OCPreload(TIM_TypeDef *TIMx, uint8_t ch, uint16_t TIM_OCPreload) {
+    uint8_t shift = (ch & 1) * 8;
+
+    *Host_TIM_CCMR(TIMx, ch) = (*Host_TIM_CCMR(TIMx, ch) & ~(TIM_OCPreload_Enable << shift)) | (TIM_OCPreload << shift);
+}
+
+HOST_WEAK void TIM_DeInit(TIM_TypeDef *TIMx) {
+    __IO uint16_t *r;
+
+    for (r = &TIMx->CR1; r <= &TIMx->DMAR; r += 2) {
+        *r = 0;
+    }
+}
+
+HOST_WEAK void TIM_TimeBaseInit(TIM_TypeDef *TIMx, TIM_TimeBaseInitTypeDef *TIM_TimeBaseInitStruct) {
+    TIMx->CR1 = (TIMx->CR1 & ~0x0370u) | TIM_TimeBaseInitStruct->TIM_CounterMode |
+                TIM_TimeBaseInitStruct->TIM_ClockDivision;
+    TIMx->ARR = TIM_TimeBaseInitStruct->TIM_Period;
+    TIMx->PSC = TIM_TimeBaseInitStruct->TIM_Prescaler;
+    TIMx->RCR = TIM_TimeBaseInitStruct->TIM_RepetitionCounter;
+    TIMx->EGR = TIM_EventSource_Update;
+}
+
+HOST_WEAK void TIM_Cmd(TIM_TypeDef *TIMx, FunctionalState NewState) {
+    if (NewState) {
+        TIMx->CR1 |= TIM_CR1_CEN;
+    } else {
+        TIMx->CR1 &= ~TIM_CR1_CEN;
+    }
+}
+
+HOST_WEAK void TIM_ITConfig(TIM_TypeDef *TIMx, uint16_t TIM_IT, FunctionalState NewState) {
+    if (NewState) {
+        TIMx->DIER |= TIM_IT;
+    } else {
+        TIMx->DIER &= ~TIM_IT;
+    }
+}
+
+HOST_WEAK ITStatus TIM_GetITStatus(TIM_TypeDef *TIMx, uint16_t TIM_IT) {
+    return ((TIMx->SR & TIM_IT) && (TIMx->DIER & TIM_IT)) ? SET : RESET;
+}
+
+HOST_WEAK void TIM_ClearITPendingBit(TIM_TypeDef *TIMx, uint16_t TIM_IT) { TIMx->SR &= ~TIM_IT; }
+
+HOST_WEAK FlagStatus TIM_GetFlagStatus(TIM_TypeDef *TIMx, uint16_t TIM_FLAG) {
+    return (TIMx->SR & TIM_FLAG) ? SET : RESET;
+}
+
+HOST_WEAK void TIM_ClearFlag(TIM_TypeDef *TIMx, uint16_t TIM_FLAG) { TIMx->SR &= ~TIM_FLAG; }
+HOST_WEAK void TIM_SetCounter(TIM_TypeDef *TIMx, uint16_t Counter) { TIMx->CNT = Counter; }
+HOST_WEAK uint16_t TIM_GetCounter(TIM_TypeDef *TIMx) { return TIMx->CNT; }
+HOST_WEAK void TIM_SetAutoreload(TIM_TypeDef *TIMx, uint16_t Autoreload) { TIMx->ARR = Autoreload; }
+HOST_WEAK void TIM_SetCompare1(TIM_TypeDef *TIMx, uint16_t Compare1) { TIMx->CCR1 = Compare1; }
+HOST_WEAK void TIM_SetCompare2(TIM_TypeDef *TIMx, uint16_t Compare2) { TIMx->CCR2 = Compare2; }
+HOST_WEAK void TIM_SetCompare3(TIM_TypeDef *TIMx, uint16_t Compare3) { TIMx->CCR3 = Compare3; }
+HOST_WEAK void TIM_SetCompare4(TIM_TypeDef *TIMx, uint16_t Compare4) { TIMx->CCR4 = Compare4; }
+HOST_WEAK uint16_t TIM_GetCapture1(TIM_TypeDef *TIMx) { return TIMx->CCR1; }
+HOST_WEAK uint16_t TIM_GetCapture2(TIM_TypeDef *TIMx) { return TIMx->CCR2; }
+HOST_WEAK uint16_t TIM_GetCapture3(TIM_TypeDef *TIMx) { return TIMx->CCR3; }
+HOST_WEAK uint16_t TIM_GetCapture4(TIM_TypeDef *TIMx) { return TIMx->CCR4; }
+
+HOST_WEAK void TIM_OCStructInit(TIM_OCInitTypeDef *TIM_OCInitStruct) {
+    TIM_OCInitStruct->TIM_OCMode = TIM_OCMode_Timing;
+    TIM_OCInitStruct->TIM_OutputState = TIM_OutputState_Disable;
+    TIM_OCInitStruct->TIM_OutputNState = TIM_OutputNState_Disable;
+    TIM_OCInitStruct->TIM_Pulse = 0;
+    TIM_OCInitStruct->TIM_OCPolarity = TIM_OCPolarity_High;
+    TIM_OCInitStruct->TIM_OCNPolarity = TIM_OCNPolarity_High;
+    TIM_OCInitStruct->TIM_OCIdleState = TIM_OCIdleState_Reset;
+    TIM_OCInitStruct->TIM_OCNIdleState = TIM_OCNIdleState_Reset;
+}
+
+HOST_WEAK void TIM_OC1Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct) {
+    Host_TIM_OCInit(TIMx, 0, TIM_OCInitStruct);
+}
+
+HOST_WEAK void TIM_OC2Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct) {
+    Host_TIM_OCInit(TIMx, 1, TIM_OCInitStruct);
+}
+
+HOST_WEAK void TIM_OC3Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct) {
+    Host_TIM_OCInit(TIMx, 2, TIM_OCInitStruct);
+}
+
+HOST_WEAK void TIM_OC4Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct) {
+    Host_TIM_OCInit(TIMx, 3, TIM_OCInitStruct);
+}
+
+HOST_WEAK void TIM_OC1PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) {
+    Host_TIM_OCPreload(TIMx, 0, TIM_OCPreload);
+}
+
+HOST_WEAK void TIM_OC2PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) {
+    Host_TIM_OCPreload(TIMx, 1, TIM_OCPreload);
+}
+
+HOST_WEAK void TIM_OC3PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) {
+    Host_TIM_OCPreload(TIMx, 2, TIM_OCPreload);
+}
+
+HOST_WEAK void TIM_OC4PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) {
+    Host_TIM_OCPreload(TIMx, 3, TIM_OCPreload);
+}
+
+HOST_WEAK void TIM_OC1PolarityConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPolarity) {
+    TIMx->CCER = (TIMx->CCER & ~TIM_OCPolarity_Low) | TIM_OCPolarity;
+}
+
+HOST_WEAK void TIM_ARRPreloadConfig(TIM_TypeDef *TIMx, FunctionalState NewState) {
+    if (NewState) {
+        TIMx->CR1 |= 0x0080u;
+    } else {
+        TIMx->CR1 &= ~0x0080u;
+    }
+}
+
+HOST_WEAK void TIM_ICInit(TIM_TypeDef *TIMx, TIM_ICInitTypeDef *TIM_ICInitStruct) {
+    uint8_t ch = TIM_ICInitStruct->TIM_Channel / 4;
+    uint8_t shift = (ch & 1) * 8;
+    uint16_t ccmr = TIM_ICInitStruct->TIM_ICSelection | TIM_ICInitStruct->TIM_ICPrescaler |
+                    (uint16_t)(TIM_ICInitStruct->TIM_ICFilter << 4);
+
+    TIMx->CCER &= ~(0xfu << (4 * ch));
+    *Host_TIM_CCMR(TIMx, ch) = (*Host_TIM_CCMR(TIMx, ch) & ~(0xffu << shift)) | (ccmr << shift);
+    TIMx->CCER |= (TIM_ICInitStruct->TIM_ICPolarity | TIM_CCx_Enable) << (4 * ch);
+}
+
+HOST_WEAK void TIM_PWMIConfig(TIM_TypeDef *TIMx, TIM_ICInitTypeDef *TIM_ICInitStruct) {
+    TIM_ICInitTypeDef other = *TIM_ICInitStruct;
+
+    other.TIM_Channel = TIM_ICInitStruct->TIM_Channel == TIM_Channel_1 ? TIM_Channel_2 : TIM_Channel_1;
+    other.TIM_ICPolarity = TIM_ICInitStruct->TIM_ICPolarity == TIM_ICPolarity_Rising ? TIM_ICPolarity_Falling
+                                                                                     : TIM_ICPolarity_Rising;
+    other.TIM_ICSelection = TIM_ICInitStruct->TIM_ICSelection == TIM_ICSelection_DirectTI
+                                ? TIM_ICSelection_IndirectTI
+                                : TIM_ICSelection_DirectTI;
+    TIM_ICInit(TIMx, TIM_ICInitStruct);
+    TIM_ICInit(TIMx, &other);
+}
+
+HOST_WEAK void TIM_CCxCmd(TIM_TypeDef *TIMx, uint16_t TIM_Channel, uint16_t TIM_CCx) {
+    TIMx->CCER = (TIMx->CCER & ~(TIM_CCx_Enable << TIM_Channel)) | (TIM_CCx << TIM_Channel);
+}
+
+HOST_WEAK void TIM_DMACmd(TIM_TypeDef *TIMx, uint16_t TIM_DMASource, FunctionalState NewState) {
+    if (NewState) {
+        TIMx->DIER |= TIM_DMASource;
+    } else {
+        TIMx->DIER &= ~TIM_DMASource;
+    }
+}
+
+HOST_WEAK void TIM_DMAConfig(TIM_TypeDef *TIMx, uint16_t TIM_DMABase, uint16_t TIM_DMABurstLength) {
+    TIMx->DCR = TIM_DMABase | TIM_DMABurstLength;
+}
+
+HOST_WEAK void TIM_SelectOutputTrigger(TIM_TypeDef *TIMx, uint16_t TIM_TRGOSource) {
+    TIMx->CR2 = (TIMx->CR2 & ~0x0070u) | TIM_TRGOSource;
+}
+
+HOST_WEAK void TIM_SelectInputTrigger(TIM_TypeDef *TIMx, uint16_t TIM_InputTriggerSource) {
+    TIMx->SMCR = (TIMx->SMCR & ~0x0070u) | TIM_InputTriggerSource;
+}
+
+HOST_WEAK void TIM_SelectSlaveMode(TIM_TypeDef *TIMx, uint16_t TIM_SlaveMode) {
+    TIMx->SMCR = (TIMx->SMCR & ~0x0007u) | TIM_SlaveMode;
+}
+
+HOST_WEAK void TIM_SelectMasterSlaveMode(TIM_TypeDef *TIMx, uint16_t TIM_MasterSlaveMode) {
+    TIMx->SMCR = (TIMx->SMCR & ~0x0080u) | TIM_MasterSlaveMode;
+}
+
+HOST_WEAK void TIM_UpdateRequestConfig(TIM_TypeDef *TIMx, uint16_t TIM_UpdateSource) {
+    if (TIM_UpdateSource) {
+        TIMx->CR1 |= 0x0004u;
+    } else {
+        TIMx->CR1 &= ~0x0004u;
+    }
+}
+
+HOST_WEAK void TIM_GenerateEvent(TIM_TypeDef *TIMx, uint16_t TIM_EventSource) { TIMx->EGR = TIM_EventSource; }
+
+HOST_WEAK void TIM_BDTRConfig(TIM_TypeDef *TIMx, TIM_BDTRInitTypeDef *TIM_BDTRInitStruct) {
+    TIMx->BDTR = TIM_BDTRInitStruct->TIM_OSSRState | TIM_BDTRInitStruct->TIM_OSSIState |
+                 TIM_BDTRInitStruct->TIM_LOCKLevel | TIM_BDTRInitStruct->TIM_DeadTime |
+                 TIM_BDTRInitStruct->TIM_Break | TIM_BDTRInitStruct->TIM_BreakPolarity |
+                 TIM_BDTRInitStruct->TIM_AutomaticOutput;
+}
+
+HOST_WEAK void TIM_CtrlPWMOutputs(TIM_TypeDef *TIMx, FunctionalState NewState) {
+    if (NewState) {
+        TIMx->BDTR |= TIM_BDTR_MOE;
+    } else {
+        TIMx->BDTR &= ~TIM_BDTR_MOE;
+    }
+}
+
+// USART
+static uint16_t USART_IT_Mask(uint16_t USART_IT) { return (uint16_t)(1u << (USART_IT & 0x1f)); }
+
+HOST_WEAK void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct) {
+    uint32_t pclk = USARTx == USART1 ? host_clocks.PCLK2_Frequency : host_clocks.PCLK1_Frequency;
+
+    USARTx->CR1 = (USARTx->CR1 & ~0x160cu) | USART_InitStruct->USART_WordLength | USART_InitStruct->USART_Parity |
+                  USART_InitStruct->USART_Mode;
+    USARTx->BRR = (uint16_t)((pclk + USART_InitStruct->USART_BaudRate / 2) / USART_InitStruct->USART_BaudRate);
+}
+
+HOST_WEAK void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState) {
+    if (NewState) {
+        USARTx->CR1 |= USART_CR1_UE;
+    } else {
+        USARTx->CR1 &= ~USART_CR1_UE;
+    }
+}
+
+HOST_WEAK void USART_ITConfig(USART_TypeDef *USARTx, uint16_t USART_IT, FunctionalState NewState) {
+    uint8_t reg = (USART_IT >> 5) & 0x7;
+    __IO uint16_t *cr = reg == 1 ? &USARTx->CR1 : reg == 2 ? &USARTx->CR2 : &USARTx->CR3;
+
+    if (NewState) {
+        *cr |= USART_IT_Mask(USART_IT);
+    } else {
+        *cr &= ~USART_IT_Mask(USART_IT);
+    }
+}
+
+HOST_WEAK ITStatus USART_GetITStatus(USART_TypeDef *USARTx, uint16_t USART_IT) {
+    uint8_t reg = (USART_IT >> 5) & 0x7;
+    __IO uint16_t *cr = reg == 1 ? &USARTx->CR1 : reg == 2 ? &USARTx->CR2 : &USARTx->CR3;
+    uint16_t flag = (uint16_t)(1u << (USART_IT >> 8));
+
+    return ((*cr & USART_IT_Mask(USART_IT)) && (USARTx->SR & flag)) ? SET : RESET;
+}
+
+HOST_WEAK FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG) {
+    return (USARTx->SR & USART_FLAG) ? SET : RESET;
+}
+
+HOST_WEAK void USART_ClearFlag(USART_TypeDef *USARTx, uint16_t USART_FLAG) { USARTx->SR &= ~USART_FLAG; }
+HOST_WEAK void USART_SendData(USART_TypeDef *USARTx, uint16_t Data) { USARTx->DR = Data & 0x1ff; }
+
+// Reading DR after SR clears RXNE and the IDLE, ORE, NE, FE and PE flags
+HOST_WEAK uint16_t USART_ReceiveData(USART_TypeDef *USARTx) {
+    USARTx->SR &= ~(USART_FLAG_RXNE | USART_FLAG_IDLE | USART_FLAG_ORE | USART_FLAG_NE | USART_FLAG_FE | USART_FLAG_PE);
+    return USARTx->DR & 0x1ff;
+}
+
+HOST_WEAK void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState) {
+    if (NewState) {
+        USARTx->CR3 |= USART_DMAReq;
+    } else {
+        USARTx->CR3 &= ~USART_DMAReq;
+    }
+}
+
+// Interrupt handlers, replaced by the drivers that define them
+HOST_WEAK void ADC1_2_IRQHandler(void) {}
+HOST_WEAK void DMA1_Channel1_IRQHandler(void) {}
+HOST_WEAK void DMA1_Channel2_IRQHandler(void) {}
+HOST_WEAK void DMA1_Channel3_IRQHandler(void) {}
+HOST_WEAK void DMA1_Channel4_IRQHandler(void) {}
+HOST_WEAK void DMA1_Channel5_IRQHandler(void) {}
+HOST_WEAK void DMA1_Channel6_IRQHandler(void) {}
+HOST_WEAK void DMA1_Channel7_IRQHandler(void) {}
+HOST_WEAK void DMA2_Channel1_IRQHandler(void) {}
+HOST_WEAK void DMA2_Channel2_IRQHandler(void) {}
+HOST_WEAK void DMA2_Channel3_IRQHandler(void) {}
+HOST_WEAK void DMA2_Channel4_5_IRQHandler(void) {}
+
+// Hardware models
+static void (*const host_dma_irq[12])(void) = {
+    DMA1_Channel1_IRQHandler, DMA1_Channel2_IRQHandler, DMA1_Channel3_IRQHandler,   DMA1_Channel4_IRQHandler,
+    DMA1_Channel5_IRQHandler, DMA1_Channel6_IRQHandler, DMA1_Channel7_IRQHandler,   DMA2_Channel1_IRQHandler,
+    DMA2_Channel2_IRQHandler, DMA2_Channel3_IRQHandler, DMA2_Channel4_5_IRQHandler, DMA2_Channel4_5_IRQHandler};
+
+/**
+ * @brief Moves one item of a DMA channel, as the controller does for one request.
+ *
+ * @param ch The channel.
+ * @param n The index of the item.
+ * @return void
+ */
+static void Host_DMA_Move(DMA_Channel_TypeDef *ch, uint16_t n) {
+    uint8_t psize = 1u << ((ch->CCR >> 8) & 3);
+    uint8_t msize = 1u << ((ch->CCR >> 10) & 3);
+    uintptr_t per = ch->CPAR + ((ch->CCR & DMA_PeripheralInc_Enable) ? n * psize : 0);
+    uintptr_t mem = ch->CMAR + ((ch->CCR & DMA_MemoryInc_Enable) ? n * msize : 0);
+    uintptr_t src = (ch->CCR & DMA_DIR_PeripheralDST) ? mem : per;
+    uintptr_t dst = (ch->CCR & DMA_DIR_PeripheralDST) ? per : mem;
+    uint8_t ssize = (ch->CCR & DMA_DIR_PeripheralDST) ? msize : psize;
+    uint8_t dsize = (ch->CCR & DMA_DIR_PeripheralDST) ? psize : msize;
+    uint32_t v;
+
+    v = ssize == 1 ? *(volatile uint8_t *)src : ssize == 2 ? *(volatile uint16_t *)src : *(volatile uint32_t *)src;
+    if (dsize == 1) {
+        *(volatile uint8_t *)dst = (uint8_t)v;
+    } else if (dsize == 2) {
+        *(volatile uint16_t *)dst = (uint16_t)v;
+    } else {
+        *(volatile uint32_t *)dst = v;
+    }
+}
+
+uint8_t Host_DMA_Request(DMA_Channel_TypeDef *ch) {
+    uint8_t idx = Host_DMA_Index(ch);
+    DMA_TypeDef *dma = idx < 7 ? DMA1 : DMA2;
+    uint8_t shift = 4 * (idx < 7 ? idx : idx - 7);
+    uint32_t flags = 0;
+    uint32_t ie;
+
+    if (!(ch->CCR & DMA_CCR1_EN)) {
+        host_dma_enabled[idx] = 0;
+        return 0;
+    }
+    if (!host_dma_enabled[idx]) {  // Enabled by a register write rather than DMA_Cmd()
+        host_dma_enabled[idx] = 1;
+        host_dma_reload[idx] = (uint16_t)ch->CNDTR;
+    }
+    if (ch->CNDTR == 0) {
+        return 0;
+    }
+    do {
+        Host_DMA_Move(ch, host_dma_reload[idx] - (uint16_t)ch->CNDTR);
+        ch->CNDTR--;
+        if (host_dma_reload[idx] - ch->CNDTR == host_dma_reload[idx] / 2u) {
+            flags |= DMA_ISR_HTIF1;
+        }
+    } while ((ch->CCR & DMA_M2M_Enable) && ch->CNDTR);
+    if (ch->CNDTR == 0) {
+        flags |= DMA_ISR_TCIF1;
+        if (ch->CCR & DMA_Mode_Circular) {
+            ch->CNDTR = host_dma_reload[idx];
+        }
+    }
+    dma->ISR |= (flags | DMA_ISR_GIF1) << shift;
+    ie = ((ch->CCR & DMA_CCR1_TCIE) ? DMA_ISR_TCIF1 : 0) | ((ch->CCR & DMA_CCR1_HTIE) ? DMA_ISR_HTIF1 : 0);
+    if ((flags & ie) && !host_primask) {
+        dma->IFCR = 0;
+        host_dma_irq[idx]();
+        dma->ISR &= ~dma->IFCR;  // The flags the handler cleared
+        if (!(dma->ISR & (0xeu << shift))) {
+            dma->ISR &= ~(DMA_ISR_GIF1 << shift);
+        }
+    }
+    return 1;
+}
+
+uint8_t Host_ADC_Channel(void) {
+    __IO uint32_t *sqr = host_adc_rank >= 12 ? &ADC1->SQR1 : host_adc_rank >= 6 ? &ADC1->SQR2 : &ADC1->SQR3;
+
+    return (*sqr >> (5 * (host_adc_rank % 6))) & 0x1f;
+}
+
+uint8_t Host_ADC_Convert(uint16_t value) {
+    uint8_t ch = Host_ADC_Channel();
+
+    if (!(ADC1->CR2 & ADC_CR2_ADON)) {
+        return 0;
+    }
+    ADC1->DR = value;
+    ADC1->SR |= ADC_SR_EOC;
+    if ((ADC1->CR1 & 0x00800000u) && (!(ADC1->CR1 & 0x200u) || ch == (ADC1->CR1 & ADC_CR1_AWDCH)) &&
+        (value > ADC1->HTR || value < ADC1->LTR)) {
+        ADC1->SR |= ADC_SR_AWD;
+    }
+    host_adc_rank = (ADC1->CR1 & 0x100u) && host_adc_rank < ((ADC1->SQR1 >> 20) & 0xf) ? host_adc_rank + 1 : 0;
+    if (ADC1->CR2 & 0x100u) {
+        Host_DMA_Request(DMA1_Channel1);
+        ADC1->SR &= ~ADC_SR_EOC;  // DMA read DR
+    }
+    if (host_primask) {
+        return 1;
+    }
+    if (((ADC1->SR & ADC_SR_AWD) && (ADC1->CR1 & 0x40u)) || ((ADC1->SR & ADC_SR_EOC) && (ADC1->CR1 & 0x20u))) {
+        ADC1_2_IRQHandler();
+    }
+    return 1;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file host.h
+ * @brief Hardware models of the host stand-ins, for the tests in Test/ to drive the peripherals.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The registers of stm32f10x.h do nothing by themselves; these functions do what the hardware does on an event,
+ * including calling the interrupt handler when the event's interrupt is enabled. host.c defines every handler
+ * weak and empty, as the startup file does, so a test links only the drivers it checks. While PRIMASK is set
+ * the flags rise but no handler is called; a test that masks interrupts calls the handler itself afterwards.
+ *
+ * The drivers keep buffer addresses in 32-bit registers, so a buffer that DMA reaches must be static, not on the
+ * stack or the heap, and the test must be built with -no-pie.
+ */
+
+#ifndef TEST_HOST_HOST_H_
+#define TEST_HOST_HOST_H_
+
+#include "stm32f10x.h"
+
+/**
+ * @brief Serves one request of the peripheral on a DMA channel: moves one item, counts it down and raises the
+ *        half-transfer and transfer-complete flags and interrupts. A circular channel reloads its count.
+ *
+ * Memory-to-memory channels move their whole count in one call.
+ *
+ * @param ch The channel, DMA1_Channel1 to DMA2_Channel5.
+ * @return 1 if an item was moved, 0 if the channel is disabled or its count is 0.
+ */
+uint8_t Host_DMA_Request(DMA_Channel_TypeDef *ch);
+
+/**
+ * @brief Returns the channel of the rank ADC1 converts next.
+ *
+ * @param void
+ * @return The channel, 0-17.
+ */
+uint8_t Host_ADC_Channel(void);
+
+/**
+ * @brief Ends one ADC1 regular conversion: stores the result, sets EOC, checks the analog watchdog and requests
+ *        DMA, then moves to the next rank of the sequence.
+ *
+ * @param value The result, 0 to 4095.
+ * @return 1 if converted, 0 if ADC1 is off.
+ */
+uint8_t Host_ADC_Convert(uint16_t value);
+
+#endif  // TEST_HOST_HOST_H_
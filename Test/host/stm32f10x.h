@@ -0,0 +1,706 @@
+/**
+ * @file stm32f10x.h
+ * @brief Host stand-in for the device header and the Standard Peripheral Library, used by the tests in Test/.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Only the part of the library that the drivers use is declared. Register blocks have the layout of the
+ * STM32F10x and every constant has its library value, so flag masks combine as on the target. The peripherals
+ * are ordinary variables defined in host.c; build with -no-pie so that their addresses fit the 32-bit address
+ * arithmetic some drivers do. host.c also implements the library functions on these registers, as weak symbols a
+ * test can replace with its own model of the hardware.
+ */
+
+#ifndef TEST_HOST_STM32F10X_H_
+#define TEST_HOST_STM32F10X_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint8_t unit8_t;  // Spellings the drivers use, from the project headers of the board
+typedef uint16_t unit16_t;
+typedef uint32_t unit32_t;
+
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+typedef enum { ERROR = 0, SUCCESS = !ERROR } ErrorStatus;
+
+#define __IO volatile
+#define __I volatile const
+
+// Interrupt numbers
+typedef enum {
+    SysTick_IRQn = -1,
+    WWDG_IRQn = 0,
+    EXTI0_IRQn = 6,
+    EXTI1_IRQn = 7,
+    EXTI2_IRQn = 8,
+    EXTI3_IRQn = 9,
+    EXTI4_IRQn = 10,
+    DMA1_Channel1_IRQn = 11,
+    DMA1_Channel2_IRQn = 12,
+    DMA1_Channel3_IRQn = 13,
+    DMA1_Channel4_IRQn = 14,
+    DMA1_Channel5_IRQn = 15,
+    DMA1_Channel6_IRQn = 16,
+    DMA1_Channel7_IRQn = 17,
+    ADC1_2_IRQn = 18,
+    EXTI9_5_IRQn = 23,
+    TIM1_BRK_IRQn = 24,
+    TIM1_UP_IRQn = 25,
+    TIM1_TRG_COM_IRQn = 26,
+    TIM1_CC_IRQn = 27,
+    TIM2_IRQn = 28,
+    TIM3_IRQn = 29,
+    TIM4_IRQn = 30,
+    USART1_IRQn = 37,
+    EXTI15_10_IRQn = 40,
+    TIM8_BRK_IRQn = 43,
+    TIM8_UP_IRQn = 44,
+    TIM5_IRQn = 50,
+    TIM6_IRQn = 54,
+    TIM7_IRQn = 55,
+    DMA2_Channel1_IRQn = 56,
+    DMA2_Channel2_IRQn = 57,
+    DMA2_Channel3_IRQn = 58,
+    DMA2_Channel4_5_IRQn = 59
+} IRQn_Type;
+
+// Register blocks
+typedef struct {
+    __IO uint32_t SR, CR1, CR2, SMPR1, SMPR2, JOFR1, JOFR2, JOFR3, JOFR4, HTR, LTR, SQR1, SQR2, SQR3, JSQR, JDR1, JDR2,
+        JDR3, JDR4, DR;
+} ADC_TypeDef;
+
+typedef struct {
+    __IO uint32_t CCR, CNDTR, CPAR, CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+    __IO uint32_t ISR, IFCR;
+} DMA_TypeDef;
+
+typedef struct {
+    __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR;
+} EXTI_TypeDef;
+
+typedef struct {
+    __IO uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR;
+} GPIO_TypeDef;
+
+typedef struct {
+    __IO uint16_t CR1, RESERVED0, CR2, RESERVED1, SMCR, RESERVED2, DIER, RESERVED3, SR, RESERVED4, EGR, RESERVED5,
+        CCMR1, RESERVED6, CCMR2, RESERVED7, CCER, RESERVED8, CNT, RESERVED9, PSC, RESERVED10, ARR, RESERVED11, RCR,
+        RESERVED12, CCR1, RESERVED13, CCR2, RESERVED14, CCR3, RESERVED15, CCR4, RESERVED16, BDTR, RESERVED17, DCR,
+        RESERVED18, DMAR, RESERVED19;
+} TIM_TypeDef;
+
+typedef struct {
+    __IO uint16_t SR, RESERVED0, DR, RESERVED1, BRR, RESERVED2, CR1, RESERVED3, CR2, RESERVED4, CR3, RESERVED5, GTPR,
+        RESERVED6;
+} USART_TypeDef;
+
+typedef struct {
+    __IO uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR, BDCR, CSR;
+} RCC_TypeDef;
+
+typedef struct {
+    __IO uint32_t CTRL, LOAD, VAL;
+    __I uint32_t CALIB;
+} SysTick_Type;
+
+typedef struct {
+    __IO uint32_t CTRL, CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+    __IO uint32_t CPUID, ICSR, VTOR, AIRCR, SCR, CCR;
+} SCB_Type;
+
+// Peripherals, defined in host.c
+#define HOST_GPIO_SIZE 0x400  // Distance between two GPIO ports, as on the target
+
+extern uint8_t host_gpio_mem[7][HOST_GPIO_SIZE];
+extern ADC_TypeDef host_adc1;
+extern DMA_TypeDef host_dma1, host_dma2;
+extern DMA_Channel_TypeDef host_dma1_ch[7], host_dma2_ch[5];
+extern EXTI_TypeDef host_exti;
+extern RCC_TypeDef host_rcc;
+extern TIM_TypeDef host_tim[9];  // Index = timer number
+extern USART_TypeDef host_usart1, host_usart2, host_usart3;
+extern SysTick_Type host_systick;
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_coredebug;
+extern SCB_Type host_scb;
+
+#define GPIOA_BASE ((uint32_t)(uintptr_t)host_gpio_mem[0])
+#define GPIOB_BASE ((uint32_t)(uintptr_t)host_gpio_mem[1])
+#define GPIOC_BASE ((uint32_t)(uintptr_t)host_gpio_mem[2])
+#define GPIOD_BASE ((uint32_t)(uintptr_t)host_gpio_mem[3])
+#define GPIOE_BASE ((uint32_t)(uintptr_t)host_gpio_mem[4])
+#define GPIOF_BASE ((uint32_t)(uintptr_t)host_gpio_mem[5])
+#define GPIOG_BASE ((uint32_t)(uintptr_t)host_gpio_mem[6])
+#define GPIOA ((GPIO_TypeDef *)host_gpio_mem[0])
+#define GPIOB ((GPIO_TypeDef *)host_gpio_mem[1])
+#define GPIOC ((GPIO_TypeDef *)host_gpio_mem[2])
+#define GPIOD ((GPIO_TypeDef *)host_gpio_mem[3])
+#define GPIOE ((GPIO_TypeDef *)host_gpio_mem[4])
+#define GPIOF ((GPIO_TypeDef *)host_gpio_mem[5])
+#define GPIOG ((GPIO_TypeDef *)host_gpio_mem[6])
+
+#define ADC1 (&host_adc1)
+#define DMA1 (&host_dma1)
+#define DMA2 (&host_dma2)
+#define DMA1_Channel1 (&host_dma1_ch[0])
+#define DMA1_Channel2 (&host_dma1_ch[1])
+#define DMA1_Channel3 (&host_dma1_ch[2])
+#define DMA1_Channel4 (&host_dma1_ch[3])
+#define DMA1_Channel5 (&host_dma1_ch[4])
+#define DMA1_Channel6 (&host_dma1_ch[5])
+#define DMA1_Channel7 (&host_dma1_ch[6])
+#define DMA2_Channel1 (&host_dma2_ch[0])
+#define DMA2_Channel2 (&host_dma2_ch[1])
+#define DMA2_Channel3 (&host_dma2_ch[2])
+#define DMA2_Channel4 (&host_dma2_ch[3])
+#define DMA2_Channel5 (&host_dma2_ch[4])
+#define EXTI (&host_exti)
+#define RCC (&host_rcc)
+#define TIM1 (&host_tim[1])
+#define TIM2 (&host_tim[2])
+#define TIM3 (&host_tim[3])
+#define TIM4 (&host_tim[4])
+#define TIM5 (&host_tim[5])
+#define TIM6 (&host_tim[6])
+#define TIM7 (&host_tim[7])
+#define TIM8 (&host_tim[8])
+#define USART1 (&host_usart1)
+#define USART2 (&host_usart2)
+#define USART3 (&host_usart3)
+#define SysTick (&host_systick)
+#define DWT (&host_dwt)
+#define CoreDebug (&host_coredebug)
+#define SCB (&host_scb)
+
+// Core register bits
+#define SysTick_CTRL_ENABLE_Msk 0x00000001u
+#define SysTick_CTRL_TICKINT_Msk 0x00000002u
+#define SysTick_CTRL_CLKSOURCE_Msk 0x00000004u
+#define SysTick_CTRL_COUNTFLAG_Msk 0x00010000u
+#define SysTick_LOAD_RELOAD_Msk 0x00ffffffu
+#define DWT_CTRL_CYCCNTENA_Msk 0x00000001u
+#define CoreDebug_DEMCR_TRCENA_Msk 0x01000000u
+#define SCB_ICSR_VECTACTIVE_Msk 0x000001ffu
+#define SCB_ICSR_PENDSTSET_Msk 0x04000000u
+#define SCB_SCR_SLEEPDEEP_Msk 0x00000004u
+
+// Device register bits
+#define ADC_SR_AWD 0x01u
+#define ADC_SR_EOC 0x02u
+#define ADC_CR1_AWDCH 0x1fu
+#define ADC_CR2_ADON 0x00000001u
+#define ADC_CR2_EXTTRIG 0x00100000u
+#define RCC_CR_HSEON 0x00010000u
+#define RCC_CR_HSERDY 0x00020000u
+#define RCC_CR_PLLON 0x01000000u
+#define RCC_CR_PLLRDY 0x02000000u
+#define RCC_CFGR_SW 0x00000003u
+#define RCC_CFGR_SWS 0x0000000cu
+#define DMA_CCR1_EN 0x0001u
+#define DMA_CCR1_TCIE 0x0002u
+#define DMA_CCR1_HTIE 0x0004u
+#define DMA_CCR1_TEIE 0x0008u
+#define DMA_ISR_GIF1 0x00000001u
+#define DMA_ISR_TCIF1 0x00000002u
+#define DMA_ISR_HTIF1 0x00000004u
+#define DMA_ISR_TEIF1 0x00000008u
+#define TIM_CR1_CEN 0x0001u
+#define TIM_CCER_CC3E 0x0100u
+#define TIM_BDTR_MOE 0x8000u
+#define USART_SR_TXE 0x0080u
+#define USART_SR_IDLE 0x0010u
+#define USART_CR1_UE 0x2000u
+#define USART_CR1_TXEIE 0x0080u
+
+// RCC
+typedef struct {
+    uint32_t SYSCLK_Frequency, HCLK_Frequency, PCLK1_Frequency, PCLK2_Frequency, ADCCLK_Frequency;
+} RCC_ClocksTypeDef;
+
+#define RCC_AHBPeriph_DMA1 0x0001u
+#define RCC_AHBPeriph_DMA2 0x0002u
+#define RCC_APB1Periph_TIM2 0x0001u
+#define RCC_APB1Periph_TIM3 0x0002u
+#define RCC_APB1Periph_TIM4 0x0004u
+#define RCC_APB1Periph_TIM5 0x0008u
+#define RCC_APB1Periph_TIM6 0x0010u
+#define RCC_APB1Periph_TIM7 0x0020u
+#define RCC_APB1Periph_WWDG 0x0800u
+#define RCC_APB1Periph_PWR 0x10000000u
+#define RCC_APB2Periph_AFIO 0x0001u
+#define RCC_APB2Periph_GPIOA 0x0004u
+#define RCC_APB2Periph_GPIOB 0x0008u
+#define RCC_APB2Periph_GPIOC 0x0010u
+#define RCC_APB2Periph_GPIOD 0x0020u
+#define RCC_APB2Periph_GPIOE 0x0040u
+#define RCC_APB2Periph_GPIOF 0x0080u
+#define RCC_APB2Periph_GPIOG 0x0100u
+#define RCC_APB2Periph_ADC1 0x0200u
+#define RCC_APB2Periph_TIM1 0x0800u
+#define RCC_APB2Periph_TIM8 0x2000u
+#define RCC_APB2Periph_USART1 0x4000u
+#define RCC_PCLK2_Div6 0x00008000u
+#define RCC_HSE_OFF 0x00000000u
+#define RCC_HSE_ON 0x00010000u
+#define RCC_FLAG_HSERDY 0x31u
+#define RCC_FLAG_PLLRDY 0x39u
+#define RCC_SYSCLK_Div1 0x00000000u
+#define RCC_HCLK_Div1 0x00000000u
+#define RCC_HCLK_Div2 0x00000400u
+#define RCC_PLLSource_HSI_Div2 0x00000000u
+#define RCC_PLLSource_HSE_Div1 0x00010000u
+#define RCC_PLLSource_HSE_Div2 0x00030000u
+#define RCC_PLLMul_2 0x00000000u
+#define RCC_PLLMul_9 0x001c0000u
+#define RCC_PLLMul_16 0x00380000u
+#define RCC_SYSCLKSource_HSI 0x00000000u
+#define RCC_SYSCLKSource_HSE 0x00000001u
+#define RCC_SYSCLKSource_PLLCLK 0x00000002u
+#define SysTick_CLKSource_HCLK_Div8 0xFFFFFFFBu
+#define SysTick_CLKSource_HCLK 0x00000004u
+
+// ADC
+typedef struct {
+    uint32_t ADC_Mode;
+    FunctionalState ADC_ScanConvMode;
+    FunctionalState ADC_ContinuousConvMode;
+    uint32_t ADC_ExternalTrigConv;
+    uint32_t ADC_DataAlign;
+    uint8_t ADC_NbrOfChannel;
+} ADC_InitTypeDef;
+
+#define ADC_Mode_Independent 0x00000000u
+#define ADC_ExternalTrigConv_T1_CC1 0x00000000u
+#define ADC_ExternalTrigConv_T3_TRGO 0x00080000u
+#define ADC_ExternalTrigConv_None 0x000E0000u
+#define ADC_ExternalTrigInjecConv_T1_TRGO 0x00000000u
+#define ADC_ExternalTrigInjecConv_Ext_IT15_TIM8_CC4 0x00007000u
+#define ADC_DataAlign_Right 0x00000000u
+#define ADC_Channel_0 0x00u
+#define ADC_Channel_1 0x01u
+#define ADC_Channel_2 0x02u
+#define ADC_Channel_3 0x03u
+#define ADC_Channel_4 0x04u
+#define ADC_Channel_5 0x05u
+#define ADC_Channel_6 0x06u
+#define ADC_Channel_7 0x07u
+#define ADC_Channel_8 0x08u
+#define ADC_Channel_9 0x09u
+#define ADC_Channel_10 0x0Au
+#define ADC_Channel_11 0x0Bu
+#define ADC_Channel_12 0x0Cu
+#define ADC_Channel_13 0x0Du
+#define ADC_Channel_14 0x0Eu
+#define ADC_Channel_15 0x0Fu
+#define ADC_Channel_16 0x10u
+#define ADC_Channel_17 0x11u
+#define ADC_SampleTime_1Cycles5 0x00u
+#define ADC_SampleTime_55Cycles5 0x05u
+#define ADC_SampleTime_239Cycles5 0x07u
+#define ADC_IT_EOC 0x0220u
+#define ADC_IT_AWD 0x0140u
+#define ADC_FLAG_AWD 0x01u
+#define ADC_FLAG_EOC 0x02u
+#define ADC_AnalogWatchdog_SingleRegEnable 0x00800200u
+#define ADC_AnalogWatchdog_AllRegEnable 0x00800000u
+#define ADC_AnalogWatchdog_None 0x00000000u
+
+// GPIO
+typedef enum { GPIO_Speed_10MHz = 1, GPIO_Speed_2MHz, GPIO_Speed_50MHz } GPIOSpeed_TypeDef;
+typedef enum {
+    GPIO_Mode_AIN = 0x0,
+    GPIO_Mode_IN_FLOATING = 0x04,
+    GPIO_Mode_IPD = 0x28,
+    GPIO_Mode_IPU = 0x48,
+    GPIO_Mode_Out_OD = 0x14,
+    GPIO_Mode_Out_PP = 0x10,
+    GPIO_Mode_AF_OD = 0x1C,
+    GPIO_Mode_AF_PP = 0x18
+} GPIOMode_TypeDef;
+
+typedef struct {
+    uint16_t GPIO_Pin;
+    GPIOSpeed_TypeDef GPIO_Speed;
+    GPIOMode_TypeDef GPIO_Mode;
+} GPIO_InitTypeDef;
+
+#define GPIO_Pin_0 0x0001u
+#define GPIO_Pin_1 0x0002u
+#define GPIO_Pin_2 0x0004u
+#define GPIO_Pin_3 0x0008u
+#define GPIO_Pin_4 0x0010u
+#define GPIO_Pin_5 0x0020u
+#define GPIO_Pin_6 0x0040u
+#define GPIO_Pin_7 0x0080u
+#define GPIO_Pin_8 0x0100u
+#define GPIO_Pin_9 0x0200u
+#define GPIO_Pin_10 0x0400u
+#define GPIO_Pin_11 0x0800u
+#define GPIO_Pin_12 0x1000u
+#define GPIO_Pin_13 0x2000u
+#define GPIO_Pin_14 0x4000u
+#define GPIO_Pin_15 0x8000u
+#define GPIO_Pin_All 0xffffu
+#define GPIO_PortSourceGPIOA 0x00u
+#define GPIO_PortSourceGPIOB 0x01u
+#define GPIO_PortSourceGPIOC 0x02u
+#define GPIO_PortSourceGPIOD 0x03u
+#define GPIO_PortSourceGPIOE 0x04u
+#define GPIO_PortSourceGPIOF 0x05u
+#define GPIO_PortSourceGPIOG 0x06u
+#define GPIO_FullRemap_TIM3 0x001A0C00u
+
+// EXTI
+typedef enum { EXTI_Mode_Interrupt = 0x00, EXTI_Mode_Event = 0x04 } EXTIMode_TypeDef;
+typedef enum {
+    EXTI_Trigger_Rising = 0x08,
+    EXTI_Trigger_Falling = 0x0C,
+    EXTI_Trigger_Rising_Falling = 0x10
+} EXTITrigger_TypeDef;
+
+typedef struct {
+    uint32_t EXTI_Line;
+    EXTIMode_TypeDef EXTI_Mode;
+    EXTITrigger_TypeDef EXTI_Trigger;
+    FunctionalState EXTI_LineCmd;
+} EXTI_InitTypeDef;
+
+#define EXTI_Line0 0x00001u
+#define EXTI_Line1 0x00002u
+#define EXTI_Line2 0x00004u
+#define EXTI_Line3 0x00008u
+#define EXTI_Line4 0x00010u
+
+// NVIC
+typedef struct {
+    uint8_t NVIC_IRQChannel;
+    uint8_t NVIC_IRQChannelPreemptionPriority;
+    uint8_t NVIC_IRQChannelSubPriority;
+    FunctionalState NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+#define NVIC_PriorityGroup_2 0x500u
+
+// DMA
+typedef struct {
+    uint32_t DMA_PeripheralBaseAddr, DMA_MemoryBaseAddr, DMA_DIR, DMA_BufferSize, DMA_PeripheralInc, DMA_MemoryInc,
+        DMA_PeripheralDataSize, DMA_MemoryDataSize, DMA_Mode, DMA_Priority, DMA_M2M;
+} DMA_InitTypeDef;
+
+#define DMA_DIR_PeripheralDST 0x0010u
+#define DMA_DIR_PeripheralSRC 0x0000u
+#define DMA_PeripheralInc_Enable 0x0040u
+#define DMA_PeripheralInc_Disable 0x0000u
+#define DMA_MemoryInc_Enable 0x0080u
+#define DMA_MemoryInc_Disable 0x0000u
+#define DMA_PeripheralDataSize_Byte 0x0000u
+#define DMA_PeripheralDataSize_HalfWord 0x0100u
+#define DMA_PeripheralDataSize_Word 0x0200u
+#define DMA_MemoryDataSize_Byte 0x0000u
+#define DMA_MemoryDataSize_HalfWord 0x0400u
+#define DMA_MemoryDataSize_Word 0x0800u
+#define DMA_Mode_Circular 0x0020u
+#define DMA_Mode_Normal 0x0000u
+#define DMA_Priority_VeryHigh 0x3000u
+#define DMA_Priority_High 0x2000u
+#define DMA_Priority_Medium 0x1000u
+#define DMA_Priority_Low 0x0000u
+#define DMA_M2M_Enable 0x4000u
+#define DMA_M2M_Disable 0x0000u
+#define DMA_IT_TC 0x02u
+#define DMA_IT_HT 0x04u
+#define DMA_IT_TE 0x08u
+#define DMA2_FLAG_GL5 0x10010000u
+#define DMA2_FLAG_TC5 0x10020000u
+#define DMA2_FLAG_HT5 0x10040000u
+
+// TIM
+typedef struct {
+    uint16_t TIM_Prescaler, TIM_CounterMode, TIM_Period, TIM_ClockDivision;
+    uint8_t TIM_RepetitionCounter;
+} TIM_TimeBaseInitTypeDef;
+
+typedef struct {
+    uint16_t TIM_OCMode, TIM_OutputState, TIM_OutputNState, TIM_Pulse, TIM_OCPolarity, TIM_OCNPolarity,
+        TIM_OCIdleState, TIM_OCNIdleState;
+} TIM_OCInitTypeDef;
+
+typedef struct {
+    uint16_t TIM_Channel, TIM_ICPolarity, TIM_ICSelection, TIM_ICPrescaler, TIM_ICFilter;
+} TIM_ICInitTypeDef;
+
+typedef struct {
+    uint16_t TIM_OSSRState, TIM_OSSIState, TIM_LOCKLevel, TIM_DeadTime, TIM_Break, TIM_BreakPolarity,
+        TIM_AutomaticOutput;
+} TIM_BDTRInitTypeDef;
+
+#define TIM_CKD_DIV1 0x0000u
+#define TIM_CounterMode_Up 0x0000u
+#define TIM_CounterMode_Down 0x0010u
+#define TIM_CounterMode_CenterAligned1 0x0020u
+#define TIM_CounterMode_CenterAligned2 0x0040u
+#define TIM_CounterMode_CenterAligned3 0x0060u
+#define TIM_IT_Update 0x0001u
+#define TIM_IT_CC1 0x0002u
+#define TIM_IT_CC2 0x0004u
+#define TIM_IT_CC3 0x0008u
+#define TIM_IT_CC4 0x0010u
+#define TIM_IT_Break 0x0080u
+#define TIM_FLAG_Update 0x0001u
+#define TIM_FLAG_CC1 0x0002u
+#define TIM_FLAG_CC2 0x0004u
+#define TIM_FLAG_CC3 0x0008u
+#define TIM_FLAG_CC4 0x0010u
+#define TIM_FLAG_Break 0x0080u
+#define TIM_FLAG_CC1OF 0x0200u
+#define TIM_FLAG_CC2OF 0x0400u
+#define TIM_FLAG_CC3OF 0x0800u
+#define TIM_FLAG_CC4OF 0x1000u
+#define TIM_Channel_1 0x0000u
+#define TIM_Channel_2 0x0004u
+#define TIM_Channel_3 0x0008u
+#define TIM_Channel_4 0x000Cu
+#define TIM_CCx_Enable 0x0001u
+#define TIM_CCx_Disable 0x0000u
+#define TIM_CCxN_Enable 0x0004u
+#define TIM_CCxN_Disable 0x0000u
+#define TIM_ICPolarity_Rising 0x0000u
+#define TIM_ICPolarity_Falling 0x0002u
+#define TIM_ICSelection_DirectTI 0x0001u
+#define TIM_ICSelection_IndirectTI 0x0002u
+#define TIM_ICSelection_TRC 0x0003u
+#define TIM_ICPSC_DIV1 0x0000u
+#define TIM_OCMode_Timing 0x0000u
+#define TIM_OCMode_Toggle 0x0030u
+#define TIM_OCMode_PWM1 0x0060u
+#define TIM_OCMode_PWM2 0x0070u
+#define TIM_OutputState_Disable 0x0000u
+#define TIM_OutputState_Enable 0x0001u
+#define TIM_OutputNState_Disable 0x0000u
+#define TIM_OutputNState_Enable 0x0004u
+#define TIM_OCPolarity_High 0x0000u
+#define TIM_OCPolarity_Low 0x0002u
+#define TIM_OCNPolarity_High 0x0000u
+#define TIM_OCNPolarity_Low 0x0008u
+#define TIM_OCIdleState_Set 0x0100u
+#define TIM_OCIdleState_Reset 0x0000u
+#define TIM_OCNIdleState_Set 0x0200u
+#define TIM_OCNIdleState_Reset 0x0000u
+#define TIM_OCPreload_Enable 0x0008u
+#define TIM_OCPreload_Disable 0x0000u
+#define TIM_OSSRState_Enable 0x0800u
+#define TIM_OSSRState_Disable 0x0000u
+#define TIM_OSSIState_Enable 0x0400u
+#define TIM_OSSIState_Disable 0x0000u
+#define TIM_LOCKLevel_OFF 0x0000u
+#define TIM_Break_Enable 0x1000u
+#define TIM_Break_Disable 0x0000u
+#define TIM_BreakPolarity_Low 0x0000u
+#define TIM_BreakPolarity_High 0x2000u
+#define TIM_AutomaticOutput_Enable 0x4000u
+#define TIM_AutomaticOutput_Disable 0x0000u
+#define TIM_TRGOSource_Reset 0x0000u
+#define TIM_TRGOSource_Update 0x0020u
+#define TIM_TRGOSource_OC1Ref 0x0040u
+#define TIM_TRGOSource_OC4Ref 0x0070u
+#define TIM_SlaveMode_Reset 0x0004u
+#define TIM_TS_TI1FP1 0x0050u
+#define TIM_MasterSlaveMode_Enable 0x0080u
+#define TIM_DMA_Update 0x0100u
+#define TIM_DMA_CC1 0x0200u
+#define TIM_DMA_CC2 0x0400u
+#define TIM_DMA_CC3 0x0800u
+#define TIM_DMA_CC4 0x1000u
+#define TIM_DMABase_CCR1 0x000Du
+#define TIM_DMABase_CCR2 0x000Eu
+#define TIM_DMABase_CCR3 0x000Fu
+#define TIM_DMABase_CCR4 0x0010u
+#define TIM_DMABurstLength_1Transfer 0x0000u
+#define TIM_DMABurstLength_2Transfers 0x0100u
+#define TIM_DMABurstLength_3Transfers 0x0200u
+#define TIM_DMABurstLength_4Transfers 0x0300u
+#define TIM_EventSource_Update 0x0001u
+#define TIM_UpdateSource_Global 0x0000u
+#define TIM_UpdateSource_Regular 0x0001u
+
+// USART
+typedef struct {
+    uint32_t USART_BaudRate;
+    uint16_t USART_WordLength, USART_StopBits, USART_Parity, USART_Mode, USART_HardwareFlowControl;
+} USART_InitTypeDef;
+
+#define USART_WordLength_8b 0x0000u
+#define USART_StopBits_1 0x0000u
+#define USART_Parity_No 0x0000u
+#define USART_Mode_Rx 0x0004u
+#define USART_Mode_Tx 0x0008u
+#define USART_HardwareFlowControl_None 0x0000u
+#define USART_FLAG_PE 0x0001u
+#define USART_FLAG_FE 0x0002u
+#define USART_FLAG_NE 0x0004u
+#define USART_FLAG_ORE 0x0008u
+#define USART_FLAG_IDLE 0x0010u
+#define USART_FLAG_RXNE 0x0020u
+#define USART_FLAG_TC 0x0040u
+#define USART_FLAG_TXE 0x0080u
+#define USART_IT_PE 0x0028u
+#define USART_IT_TXE 0x0727u
+#define USART_IT_TC 0x0626u
+#define USART_IT_RXNE 0x0525u
+#define USART_IT_IDLE 0x0424u
+#define USART_IT_ERR 0x0060u
+#define USART_IT_ORE 0x0360u
+#define USART_DMAReq_Tx 0x0080u
+#define USART_DMAReq_Rx 0x0040u
+
+// Core intrinsics, host.c keeps PRIMASK in a variable
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+void __DMB(void);
+void __DSB(void);
+void __NOP(void);
+void __WFI(void);
+uint32_t __CLZ(uint32_t v);
+uint32_t __LDREXW(volatile uint32_t *addr);
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr);
+void __CLREX(void);
+
+// Library functions, implemented on the registers above in host.c
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct);
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+uint16_t GPIO_ReadInputData(GPIO_TypeDef *GPIOx);
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_EXTILineConfig(uint8_t GPIO_PortSource, uint8_t GPIO_PinSource);
+void GPIO_PinRemapConfig(uint32_t GPIO_Remap, FunctionalState NewState);
+
+void RCC_AHBPeriphClockCmd(uint32_t RCC_AHBPeriph, FunctionalState NewState);
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState);
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState);
+void RCC_GetClocksFreq(RCC_ClocksTypeDef *RCC_Clocks);
+void RCC_ADCCLKConfig(uint32_t RCC_PCLK2);
+void RCC_DeInit(void);
+void RCC_HSEConfig(uint32_t RCC_HSE);
+ErrorStatus RCC_WaitForHSEStartUp(void);
+FlagStatus RCC_GetFlagStatus(uint8_t RCC_FLAG);
+void RCC_HCLKConfig(uint32_t RCC_SYSCLK);
+void RCC_PCLK1Config(uint32_t RCC_HCLK);
+void RCC_PCLK2Config(uint32_t RCC_HCLK);
+void RCC_PLLConfig(uint32_t RCC_PLLSource, uint32_t RCC_PLLMul);
+void RCC_PLLCmd(FunctionalState NewState);
+void RCC_SYSCLKConfig(uint32_t RCC_SYSCLKSource);
+uint8_t RCC_GetSYSCLKSource(void);
+void SysTick_CLKSourceConfig(uint32_t SysTick_CLKSource);
+extern RCC_ClocksTypeDef host_clocks;  // What RCC_GetClocksFreq() reports, 72 MHz with APB1 at 36 MHz by default
+
+void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct);
+void NVIC_PriorityGroupConfig(uint32_t NVIC_PriorityGroup);
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+
+void ADC_Init(ADC_TypeDef *ADCx, ADC_InitTypeDef *ADC_InitStruct);
+void ADC_Cmd(ADC_TypeDef *ADCx, FunctionalState NewState);
+void ADC_DMACmd(ADC_TypeDef *ADCx, FunctionalState NewState);
+void ADC_ITConfig(ADC_TypeDef *ADCx, uint16_t ADC_IT, FunctionalState NewState);
+ITStatus ADC_GetITStatus(ADC_TypeDef *ADCx, uint16_t ADC_IT);
+void ADC_ClearITPendingBit(ADC_TypeDef *ADCx, uint16_t ADC_IT);
+FlagStatus ADC_GetFlagStatus(ADC_TypeDef *ADCx, uint8_t ADC_FLAG);
+void ADC_ResetCalibration(ADC_TypeDef *ADCx);
+FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef *ADCx);
+void ADC_StartCalibration(ADC_TypeDef *ADCx);
+FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef *ADCx);
+void ADC_SoftwareStartConvCmd(ADC_TypeDef *ADCx, FunctionalState NewState);
+void ADC_ExternalTrigConvCmd(ADC_TypeDef *ADCx, FunctionalState NewState);
+void ADC_RegularChannelConfig(ADC_TypeDef *ADCx, uint8_t ADC_Channel, uint8_t Rank, uint8_t ADC_SampleTime);
+uint16_t ADC_GetConversionValue(ADC_TypeDef *ADCx);
+void ADC_TempSensorVrefintCmd(FunctionalState NewState);
+void ADC_AnalogWatchdogCmd(ADC_TypeDef *ADCx, uint32_t ADC_AnalogWatchdog);
+void ADC_AnalogWatchdogThresholdsConfig(ADC_TypeDef *ADCx, uint16_t HighThreshold, uint16_t LowThreshold);
+void ADC_AnalogWatchdogSingleChannelConfig(ADC_TypeDef *ADCx, uint8_t ADC_Channel);
+
+void EXTI_Init(EXTI_InitTypeDef *EXTI_InitStruct);
+
+void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx);
+void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct);
+void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState);
+void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState);
+void DMA_SetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t DataNumber);
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx);
+FlagStatus DMA_GetFlagStatus(uint32_t DMAy_FLAG);
+void DMA_ClearFlag(uint32_t DMAy_FLAG);
+
+void TIM_DeInit(TIM_TypeDef *TIMx);
+void TIM_TimeBaseInit(TIM_TypeDef *TIMx, TIM_TimeBaseInitTypeDef *TIM_TimeBaseInitStruct);
+void TIM_Cmd(TIM_TypeDef *TIMx, FunctionalState NewState);
+void TIM_ITConfig(TIM_TypeDef *TIMx, uint16_t TIM_IT, FunctionalState NewState);
+ITStatus TIM_GetITStatus(TIM_TypeDef *TIMx, uint16_t TIM_IT);
+void TIM_ClearITPendingBit(TIM_TypeDef *TIMx, uint16_t TIM_IT);
+FlagStatus TIM_GetFlagStatus(TIM_TypeDef *TIMx, uint16_t TIM_FLAG);
+void TIM_ClearFlag(TIM_TypeDef *TIMx, uint16_t TIM_FLAG);
+void TIM_SetCounter(TIM_TypeDef *TIMx, uint16_t Counter);
+uint16_t TIM_GetCounter(TIM_TypeDef *TIMx);
+void TIM_SetAutoreload(TIM_TypeDef *TIMx, uint16_t Autoreload);
+void TIM_SetCompare1(TIM_TypeDef *TIMx, uint16_t Compare1);
+void TIM_SetCompare2(TIM_TypeDef *TIMx, uint16_t Compare2);
+void TIM_SetCompare3(TIM_TypeDef *TIMx, uint16_t Compare3);
+void TIM_SetCompare4(TIM_TypeDef *TIMx, uint16_t Compare4);
+uint16_t TIM_GetCapture1(TIM_TypeDef *TIMx);
+uint16_t TIM_GetCapture2(TIM_TypeDef *TIMx);
+uint16_t TIM_GetCapture3(TIM_TypeDef *TIMx);
+uint16_t TIM_GetCapture4(TIM_TypeDef *TIMx);
+void TIM_OCStructInit(TIM_OCInitTypeDef *TIM_OCInitStruct);
+void TIM_OC1Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct);
+void TIM_OC2Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct);
+void TIM_OC3Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct);
+void TIM_OC4Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct);
+void TIM_OC1PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload);
+void TIM_OC2PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload);
+void TIM_OC3PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload);
+void TIM_OC4PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload);
+void TIM_OC1PolarityConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPolarity);
+void TIM_ARRPreloadConfig(TIM_TypeDef *TIMx, FunctionalState NewState);
+void TIM_ICInit(TIM_TypeDef *TIMx, TIM_ICInitTypeDef *TIM_ICInitStruct);
+void TIM_PWMIConfig(TIM_TypeDef *TIMx, TIM_ICInitTypeDef *TIM_ICInitStruct);
+void TIM_CCxCmd(TIM_TypeDef *TIMx, uint16_t TIM_Channel, uint16_t TIM_CCx);
+void TIM_DMACmd(TIM_TypeDef *TIMx, uint16_t TIM_DMASource, FunctionalState NewState);
+void TIM_DMAConfig(TIM_TypeDef *TIMx, uint16_t TIM_DMABase, uint16_t TIM_DMABurstLength);
+void TIM_SelectOutputTrigger(TIM_TypeDef *TIMx, uint16_t TIM_TRGOSource);
+void TIM_SelectInputTrigger(TIM_TypeDef *TIMx, uint16_t TIM_InputTriggerSource);
+void TIM_SelectSlaveMode(TIM_TypeDef *TIMx, uint16_t TIM_SlaveMode);
+void TIM_SelectMasterSlaveMode(TIM_TypeDef *TIMx, uint16_t TIM_MasterSlaveMode);
+void TIM_UpdateRequestConfig(TIM_TypeDef *TIMx, uint16_t TIM_UpdateSource);
+void TIM_GenerateEvent(TIM_TypeDef *TIMx, uint16_t TIM_EventSource);
+void TIM_BDTRConfig(TIM_TypeDef *TIMx, TIM_BDTRInitTypeDef *TIM_BDTRInitStruct);
+void TIM_CtrlPWMOutputs(TIM_TypeDef *TIMx, FunctionalState NewState);
+
+void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct);
+void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState);
+void USART_ITConfig(USART_TypeDef *USARTx, uint16_t USART_IT, FunctionalState NewState);
+ITStatus USART_GetITStatus(USART_TypeDef *USARTx, uint16_t USART_IT);
+FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG);
+void USART_ClearFlag(USART_TypeDef *USARTx, uint16_t USART_FLAG);
+void USART_SendData(USART_TypeDef *USARTx, uint16_t Data);
+uint16_t USART_ReceiveData(USART_TypeDef *USARTx);
+void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState);
+
+#endif  // TEST_HOST_STM32F10X_H_
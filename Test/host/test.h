@@ -0,0 +1,32 @@
+/**
+ * @file test.h
+ * @brief Checks shared by the host tests in Test/.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * A failed CHECK() prints its location and condition and the test goes on; TEST_EXIT() prints a summary and
+ * returns the exit status, 0 if every check passed.
+ */
+
+#ifndef TEST_HOST_TEST_H_
+#define TEST_HOST_TEST_H_
+
+#include <stdio.h>
+
+static unsigned test_checks;
+static unsigned test_failures;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        test_checks++;                                                       \
+        if (!(cond)) {                                                       \
+            test_failures++;                                                 \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        }                                                                    \
+    } while (0)
+
+#define TEST_EXIT(name) \
+    (printf("%s: %u checks, %u failed\n", name, test_checks, test_failures), test_failures != 0)
+
+#endif  // TEST_HOST_TEST_H_
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Builds and runs the host tests and benchmarks of Test/ (not part of the firmware).
+#
+# Every Test/test_*.c and Test/bench_*.c includes the module source it checks and is linked with the host
+# stand-ins of Test/host/. The drivers do 32-bit address arithmetic, so the programs are built with -no-pie.
+#
+# Usage, from any directory: Test/run_tests.sh [name ...], e.g. Test/run_tests.sh test_capture; all by default.
+
+cd "$(dirname "$0")/.." || exit 1
+
+out=Test/build
+mkdir -p "$out" || exit 1
+
+inc="-iquote Test/host"
+for d in */; do
+    inc="$inc -iquote ${d%/}"  # -iquote, so that <time.h> is not Timer/time.h
+done
+flags="-std=c99 -O2 -no-pie -Wall -Wextra -Wno-unused-parameter -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast"
+flags="$flags -Wno-implicit-fallthrough -pthread"  # The coroutine switch of coro.h falls through on purpose
+
+if [ $# -eq 0 ]; then
+    set -- $(cd Test && ls test_*.c bench_*.c 2>/dev/null | sed 's/\.c$//')
+fi
+
+failed=""
+for t in "$@"; do
+    echo "== $t"
+    if ! gcc $flags $inc -o "$out/$t" "Test/$t.c" Test/host/host.c -lm; then
+        failed="$failed $t"
+        continue
+    fi
+    "$out/$t" || failed="$failed $t"
+done
+
+if [ -n "$failed" ]; then
+    echo "FAILED:$failed"
+    exit 1
+fi
+echo "All passed"
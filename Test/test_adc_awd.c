@@ -0,0 +1,321 @@
+/**
+ * @file test_adc_awd.c
+ * @brief Host test of the ADC1 analog watchdog and its hysteresis against a fake ADC that trips the window.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The fake ADC compares every conversion of the guarded channel with the programmed window and raises the ADC
+ * interrupt when a sample falls outside it, as the hardware does. Stepped and noisy inputs are injected; the
+ * state after every sample must match a reference of the low / normal / high states with hysteresis, and the
+ * interrupt must only run on a state change. During a scan the interrupt is held back for a few conversions, so
+ * the data register holds another rank, and the state must still come from the guarded channel's sample. With
+ * every channel of a scan guarded, a channel that stays out of range must not interrupt again, and every channel
+ * must report its own changes, against its own limits.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_adc_awd
+ */
+
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#define ADC1_2_IRQHandler Drv_ADC1_2_IRQHandler  // Wrapped below to count the interrupts
+#include "adc.c"
+#undef ADC1_2_IRQHandler
+#include "dma.c"
+#include "time.c"
+#include "SysTick.c"
+#include "dwt.c"
+
+#define SIM_LOW 1000
+#define SIM_HIGH 3000
+#define SIM_HYST 100
+
+static uint16_t sim_buf[2 * 4 * 4];  // Static, the DMA model reaches it through a 32-bit address
+static uint32_t sim_calls;           // Callback calls
+static uint32_t sim_irqs;            // ADC interrupts
+static uint8_t sim_cb_ch;            // Arguments of the last callback
+static ADC_AWD_State sim_cb_state;
+static uint16_t sim_cb_value;
+
+/**
+ * @brief ADC interrupt as the host sees it: counts the call and runs the driver's handler.
+ *
+ * @param void
+ * @return void
+ */
+void ADC1_2_IRQHandler(void) {
+    sim_irqs++;
+    Drv_ADC1_2_IRQHandler();
+}
+
+/**
+ * @brief Watchdog callback, records its arguments.
+ *
+ * @param ch The channel whose state changed.
+ * @param state The new state.
+ * @param value The conversion result that caused the change.
+ * @return void
+ */
+static void Sim_AWD_Cb(uint8_t ch, ADC_AWD_State state, uint16_t value) {
+    sim_calls++;
+    sim_cb_ch = ch;
+    sim_cb_state = state;
+    sim_cb_value = value;
+}
+
+/**
+ * @brief Converts whole scan frames of the four channels 5 to 8, starting at rank 1.
+ *
+ * @param frame The result of every rank.
+ * @param n The number of frames.
+ * @return void
+ */
+static void Sim_Frames(const uint16_t *frame, uint8_t n) {
+    uint8_t f;
+    uint8_t k;
+
+    for (f = 0; f < n; ++f) {
+        for (k = 0; k < 4; ++k) {
+            Host_ADC_Convert(frame[k]);
+        }
+    }
+}
+
+/**
+ * @brief Reference state machine: leaves the normal range beyond the limits and comes back only by the
+ *        hysteresis.
+ *
+ * @param state The current state.
+ * @param v The sample.
+ * @return The next state.
+ */
+static ADC_AWD_State Sim_Ref(ADC_AWD_State state, uint16_t v) {
+    if (state == ADC_AWD_High && v >= SIM_HIGH - SIM_HYST) {
+        return ADC_AWD_High;
+    }
+    if (state == ADC_AWD_Low && v <= SIM_LOW + SIM_HYST) {
+        return ADC_AWD_Low;
+    }
+    return v > SIM_HIGH ? ADC_AWD_High : v < SIM_LOW ? ADC_AWD_Low : ADC_AWD_Normal;
+}
+
+/**
+ * @brief Single conversions of one channel: steps across every edge of the window and its hysteresis.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Steps(void) {
+    static const struct {
+        uint16_t v;
+        ADC_AWD_State state;
+        uint32_t calls;
+    } steps[] = {
+        {2000, ADC_AWD_Normal, 0}, {3000, ADC_AWD_Normal, 0}, {3001, ADC_AWD_High, 1}, {4095, ADC_AWD_High, 1},
+        {2900, ADC_AWD_High, 1},   {2899, ADC_AWD_Normal, 2}, {1000, ADC_AWD_Normal, 2}, {999, ADC_AWD_Low, 3},
+        {0, ADC_AWD_Low, 3},       {1100, ADC_AWD_Low, 3},    {1101, ADC_AWD_Normal, 4}, {4000, ADC_AWD_High, 5},
+        {500, ADC_AWD_Low, 6},     {3500, ADC_AWD_High, 7},
+    };
+    uint8_t i;
+    uint8_t ok = 1;
+
+    ADCx_Init();
+    ADC_RegularChannelConfig(ADC1, ADC_Channel_1, 1, ADC_SampleTime_239Cycles5);
+    ADC_AWD_Init(ADC_Channel_1, SIM_LOW, SIM_HIGH, SIM_HYST, Sim_AWD_Cb);
+    CHECK(ADC1->HTR == SIM_HIGH && ADC1->LTR == SIM_LOW);
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+        Host_ADC_Convert(steps[i].v);
+        ok &= ADC_AWD_Get_State() == steps[i].state && sim_calls == steps[i].calls;
+        ok &= sim_calls == 0 || sim_cb_state == ADC_AWD_Get_State();
+        ok &= (i > 0 && steps[i - 1].calls == sim_calls) || sim_calls == 0 || sim_cb_value == steps[i].v;
+    }
+    CHECK(ok);
+    CHECK(sim_cb_value == 3500 && !(ADC1->SR & ADC_SR_AWD));
+    CHECK(ADC1->HTR == 0xfff && ADC1->LTR == SIM_HIGH - SIM_HYST);  // Armed for the way back from high
+}
+
+/**
+ * @brief A noisy input wandering across the window: the state follows the reference after every sample and the
+ *        interrupt runs once per change only.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Noise(void) {
+    ADC_AWD_State ref = ADC_AWD_Normal;
+    uint32_t changes = 0;
+    uint32_t mismatches = 0;
+    uint32_t i;
+    int32_t v = 2000;
+    int32_t x;
+
+    sim_calls = 0;
+    ADC_AWD_Init(ADC_Channel_1, SIM_LOW, SIM_HIGH, SIM_HYST, Sim_AWD_Cb);
+    srand(4);
+    for (i = 0; i < 200000; ++i) {
+        v += rand() % 41 - 20 + (i / 5000 % 2 ? 3 : -3);  // Drifts up and down across the window
+        v = v < 0 ? 0 : v > 4095 ? 4095 : v;
+        x = v + rand() % 61 - 30;  // Noise on top
+        Host_ADC_Convert((uint16_t)(x < 0 ? 0 : x > 4095 ? 4095 : x));
+        if (Sim_Ref(ref, (uint16_t)ADC1->DR) != ref) {
+            ref = Sim_Ref(ref, (uint16_t)ADC1->DR);
+            changes++;
+        }
+        mismatches += ADC_AWD_Get_State() != ref;
+    }
+    CHECK(mismatches == 0);
+    CHECK(changes > 50 && sim_calls == changes);
+    printf("noise: %u samples, %u state changes, %u interrupts\n", i, changes, sim_calls);
+}
+
+/**
+ * @brief During a scan the interrupt runs a few conversions late and the guarded channel's sample decides.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Scan_Latency(void) {
+    static const uint8_t channels[4] = {5, 6, 7, 8};
+    uint16_t frame[4] = {2000, 2000, 2000, 4095};  // Channel 8 is outside the window but not guarded
+    uint8_t k;
+    uint8_t f;
+
+    CHECK(ADC_Scan_Init(channels, 4, sim_buf, 4) == 1);
+    sim_calls = 0;
+    ADC_AWD_Init(ADC_Channel_7, SIM_LOW, SIM_HIGH, SIM_HYST, Sim_AWD_Cb);
+    for (f = 0; f < 10; ++f) {
+        for (k = 0; k < 4; ++k) {
+            Host_ADC_Convert(frame[k]);
+        }
+    }
+    CHECK(sim_calls == 0 && ADC_AWD_Get_State() == ADC_AWD_Normal);
+
+    frame[2] = 3333;
+    __disable_irq();  // Hold the interrupt back while ranks 4 and 1 convert
+    Host_ADC_Convert(frame[0]);
+    Host_ADC_Convert(frame[1]);
+    Host_ADC_Convert(frame[2]);
+    Host_ADC_Convert(frame[3]);
+    Host_ADC_Convert(frame[0]);
+    __enable_irq();
+    CHECK(ADC1->SR & ADC_SR_AWD);
+    ADC1_2_IRQHandler();
+    CHECK(sim_calls == 1 && sim_cb_value == 3333 && ADC_AWD_Get_State() == ADC_AWD_High);
+
+    frame[2] = 500;
+    __disable_irq();
+    Host_ADC_Convert(frame[1]);
+    Host_ADC_Convert(frame[2]);
+    Host_ADC_Convert(frame[3]);
+    __enable_irq();
+    ADC1_2_IRQHandler();
+    CHECK(sim_calls == 2 && sim_cb_value == 500 && ADC_AWD_Get_State() == ADC_AWD_Low);
+
+    // Every channel guarded: the out-of-range sample of the newest frame decides, not the data register
+    frame[2] = 2000;
+    frame[3] = 2000;
+    ADC_AWD_Init(ADC_AWD_ALL_CHANNELS, SIM_LOW, SIM_HIGH, SIM_HYST, Sim_AWD_Cb);
+    for (k = 0; k < 4; ++k) {
+        Host_ADC_Convert(frame[(k + 1) % 4]);  // Back to rank 1
+    }
+    CHECK(sim_calls == 2 && ADC_AWD_Get_State() == ADC_AWD_Normal);
+    __disable_irq();
+    Host_ADC_Convert(2000);
+    Host_ADC_Convert(3900);
+    Host_ADC_Convert(2000);
+    __enable_irq();
+    ADC1_2_IRQHandler();
+    CHECK(sim_calls == 3 && sim_cb_ch == 6 && sim_cb_value == 3900 && ADC_AWD_Get_State() == ADC_AWD_High);
+    ADC_AWD_Disable();
+    for (k = 0; k < 8; ++k) {
+        Host_ADC_Convert(k % 2 ? 0 : 4095);
+    }
+    CHECK(sim_calls == 3);
+    ADC_Scan_Stop();
+}
+
+/**
+ * @brief Every channel of a scan guarded: each channel keeps its own state and limits, a channel that stays out
+ *        of range costs no further interrupts, and the callback only runs on changes.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_All_Channels(void) {
+    static const uint8_t channels[4] = {5, 6, 7, 8};
+    uint16_t frame[4] = {2000, 2000, 2000, 2000};
+    uint32_t irqs;
+
+    CHECK(ADC_Scan_Init(channels, 4, sim_buf, 4) == 1);
+    CHECK(ADC_AWD_Set_Channel_Limits(5, 0, 4095) == 0);  // Not guarding all channels yet
+    ADC_AWD_Init(ADC_AWD_ALL_CHANNELS, SIM_LOW, SIM_HIGH, SIM_HYST, Sim_AWD_Cb);
+    sim_calls = 0;
+    sim_irqs = 0;
+    Sim_Frames(frame, 10);
+    CHECK(sim_calls == 0 && sim_irqs == 0 && ADC_AWD_Get_State() == ADC_AWD_Normal);
+
+    // Channel 6 trips and stays high: one interrupt and one callback over ten frames
+    frame[1] = 3900;
+    Sim_Frames(frame, 10);
+    CHECK(sim_irqs == 1 && sim_calls == 1);
+    CHECK(sim_cb_ch == 6 && sim_cb_state == ADC_AWD_High && sim_cb_value == 3900);
+    CHECK(ADC_AWD_Get_Channel_State(6) == ADC_AWD_High && ADC_AWD_Get_Channel_State(5) == ADC_AWD_Normal);
+    CHECK(ADC_AWD_Get_State() == ADC_AWD_High);
+
+    // Channel 8 drops low meanwhile: reported from the scan buffer, still without interrupts
+    frame[3] = 500;
+    Sim_Frames(frame, 8);
+    CHECK(sim_irqs == 1 && sim_calls == 2 && sim_cb_ch == 8 && sim_cb_state == ADC_AWD_Low);
+    CHECK(ADC_AWD_Get_Channel_State(8) == ADC_AWD_Low && ADC_AWD_Get_State() == ADC_AWD_High);
+
+    // Channel 6 inside the hysteresis band keeps its state, below it returns to normal
+    frame[1] = SIM_HIGH - SIM_HYST / 2;
+    Sim_Frames(frame, 8);
+    CHECK(sim_calls == 2 && ADC_AWD_Get_Channel_State(6) == ADC_AWD_High);
+    frame[1] = SIM_HIGH - 2 * SIM_HYST;
+    Sim_Frames(frame, 8);
+    CHECK(sim_calls == 3 && sim_cb_ch == 6 && sim_cb_state == ADC_AWD_Normal);
+    CHECK(ADC_AWD_Get_State() == ADC_AWD_Low);
+    frame[3] = 2000;
+    Sim_Frames(frame, 8);
+    CHECK(sim_calls == 4 && sim_cb_ch == 8 && sim_cb_state == ADC_AWD_Normal);
+    CHECK(ADC_AWD_Get_State() == ADC_AWD_Normal && (ADC1->CR1 & 0x40u));  // AWDIE, hardware guards again
+    CHECK(sim_irqs == 1);
+
+    // A single out-of-range result of channel 7 interrupts once, trips and comes back
+    irqs = sim_irqs;
+    Host_ADC_Convert(frame[0]);
+    Host_ADC_Convert(frame[1]);
+    Host_ADC_Convert(4000);
+    Host_ADC_Convert(frame[3]);
+    Sim_Frames(frame, 8);
+    CHECK(sim_irqs == irqs + 1 && sim_calls == 6 && sim_cb_ch == 7 && sim_cb_state == ADC_AWD_Normal);
+
+    // Channel 5 gets a range of its own; its state is decided again right away
+    CHECK(ADC_AWD_Set_Channel_Limits(9, 0, 4095) == 0);
+    CHECK(ADC_AWD_Set_Channel_Limits(5, 2500, 3500) == 1);
+    CHECK(sim_calls == 7 && sim_cb_ch == 5 && sim_cb_state == ADC_AWD_Low && sim_cb_value == 2000);
+    irqs = sim_irqs;
+    frame[0] = 3200;  // Normal for channel 5, outside the range of the others
+    frame[2] = 3200;
+    Sim_Frames(frame, 8);
+    CHECK(sim_calls == 9 && ADC_AWD_Get_Channel_State(5) == ADC_AWD_Normal);
+    CHECK(ADC_AWD_Get_Channel_State(7) == ADC_AWD_High && sim_irqs == irqs);
+    CHECK(ADC_AWD_Get_Channel_State(6) == ADC_AWD_Normal);
+
+    ADC_AWD_Disable();
+    ADC_Scan_Stop();
+}
+
+int main(void) {
+    Test_Steps();
+    Test_Noise();
+    Test_Scan_Latency();
+    Test_All_Channels();
+    return TEST_EXIT("test_adc_awd");
+}
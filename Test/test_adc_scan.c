@@ -0,0 +1,247 @@
+/**
+ * @file test_adc_scan.c
+ * @brief Host test of the ADC1 DMA scan against a fake ADC1 and DMA1 Channel1 fed with sample streams.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The fake ADC converts the ranks of the programmed sequence in turn and the fake DMA moves every result into
+ * the buffer, raising the half-transfer and transfer-complete interrupts that drive the DMA manager. Every
+ * injected sample carries its channel and frame number, so the blocks handed to the application show where
+ * each one landed.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_adc_scan
+ */
+
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "adc.c"
+#include "dma.c"
+#include "time.c"
+#include "SysTick.c"
+#include "dwt.c"
+
+#define SIM_BUF_LEN 1024
+
+static uint16_t sim_buf[SIM_BUF_LEN];  // Static, the DMA model reaches it through a 32-bit address
+static uint32_t sim_frame;             // Frame of the next conversion
+static uint8_t sim_rank;               // Rank of the next conversion, 0-based
+static const uint16_t *sim_cb_block;   // Arguments of the last callback
+static uint16_t sim_cb_len;
+static uint32_t sim_half_calls;
+static uint32_t sim_full_calls;
+
+/**
+ * @brief Returns the sample the fake input of a channel gives in a frame: the channel in the top four bits and
+ *        the frame below.
+ *
+ * @param ch The ADC channel, only the low four bits are kept.
+ * @param frame The frame.
+ * @return The 12-bit sample.
+ */
+static uint16_t Sim_Sample(uint8_t ch, uint32_t frame) { return (uint16_t)((ch & 0xf) << 8 | (frame & 0xff)); }
+
+/**
+ * @brief Runs the fake ADC for a number of conversions, counting frames at the first rank.
+ *
+ * @param n The number of conversions.
+ * @param nbr The number of ranks of the sequence.
+ * @return The number of conversions made; fewer if ADC1 is off.
+ */
+static uint32_t Sim_Convert(uint32_t n, uint8_t nbr) {
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (!Host_ADC_Convert(Sim_Sample(Host_ADC_Channel(), sim_frame))) {
+            break;
+        }
+        if (++sim_rank >= nbr) {
+            sim_rank = 0;
+            sim_frame++;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief Half-buffer callback, records its arguments.
+ *
+ * @param block The completed half.
+ * @param len The number of samples in block.
+ * @return void
+ */
+static void Sim_Half_Cb(const uint16_t *block, uint16_t len) {
+    sim_half_calls++;
+    sim_cb_block = block;
+    sim_cb_len = len;
+}
+
+/**
+ * @brief Full-buffer callback, records its arguments.
+ *
+ * @param block The completed half.
+ * @param len The number of samples in block.
+ * @return void
+ */
+static void Sim_Full_Cb(const uint16_t *block, uint16_t len) {
+    sim_full_calls++;
+    sim_cb_block = block;
+    sim_cb_len = len;
+}
+
+/**
+ * @brief Checks that a block holds the frames from first on in rank order.
+ *
+ * @param block The block.
+ * @param channels The channel of every rank.
+ * @param nbr The number of ranks.
+ * @param frames The number of frames in the block.
+ * @param first The frame of the first sample.
+ * @return 1 if every sample is where it belongs.
+ */
+static uint8_t Sim_Block_Ok(const uint16_t *block, const uint8_t *channels, uint8_t nbr, uint16_t frames,
+                            uint32_t first) {
+    uint16_t f;
+    uint8_t k;
+
+    for (f = 0; f < frames; ++f) {
+        for (k = 0; k < nbr; ++k) {
+            if (block[f * nbr + k] != Sim_Sample(channels[k], first + f)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Invalid arguments start nothing and leave DMA1 Channel1 free.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Arguments(void) {
+    static const uint8_t channels[ADC_SCAN_MAX_CHANNELS + 1] = {0};
+
+    CHECK(ADC_Scan_Init(channels, 0, sim_buf, 1) == 0);
+    CHECK(ADC_Scan_Init(channels, ADC_SCAN_MAX_CHANNELS + 1, sim_buf, 1) == 0);
+    CHECK(ADC_Scan_Init(channels, 1, sim_buf, 0) == 0);
+    CHECK(ADC_Scan_Init(channels, 16, sim_buf, ADC_SCAN_MAX_HALF / 16 + 1) == 0);
+    CHECK(!(ADC1->CR2 & ADC_CR2_ADON));
+    CHECK(DMA_Mgr_Alloc(1, 1, 1) == 1);
+    DMA_Mgr_Free(1);
+}
+
+/**
+ * @brief A scan of four channels delivers both halves in frame order, over several wraps of the buffer.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Scan(void) {
+    static const uint8_t channels[4] = {3, 0, 17, 10};
+    const uint16_t frames = 5;
+    const uint16_t half = 4 * 5;
+    const uint16_t *block;
+    uint32_t seq = 99;
+    uint32_t h;
+    uint8_t ok = 1;
+
+    sim_frame = 0;
+    ADC_Scan_Set_Callback(Sim_Half_Cb, Sim_Full_Cb);
+    CHECK(ADC_Scan_Init(channels, 4, sim_buf, frames) == 1);
+    CHECK((ADC1->CR1 & 0x100u) && (ADC1->CR2 & 0x103u) == 0x103u);  // SCAN, DMA, CONT, ADON
+    CHECK(((ADC1->SQR1 >> 20) & 0xf) == 3);
+    CHECK(ADC1->SQR3 == (3u | 0u << 5 | 17u << 10 | 10u << 15));
+    CHECK(DMA1_Channel1->CNDTR == 2u * half && DMA1_Channel1->CMAR == (uint32_t)sim_buf);
+    CHECK(DMA1_Channel1->CPAR == (uint32_t)&ADC1->DR && (DMA1_Channel1->CCR & DMA_Mode_Circular));
+    CHECK(ADC_Scan_Get_Latest(&seq) == 0 && seq == 0);
+    CHECK(DMA_Mgr_Alloc(1, 1, 1) == 0);  // Owned by the scan
+
+    Sim_Convert(half - 1, 4);
+    CHECK(sim_half_calls == 0 && ADC_Scan_Get_Latest(0) == 0);
+    Sim_Convert(1, 4);
+    CHECK(sim_half_calls == 1 && sim_cb_block == sim_buf && sim_cb_len == half);
+    block = ADC_Scan_Get_Latest(&seq);
+    CHECK(block == sim_buf && seq == 1);
+    CHECK(Sim_Block_Ok(block, channels, 4, frames, 0));
+
+    Sim_Convert(half, 4);
+    CHECK(sim_full_calls == 1 && sim_cb_block == sim_buf + half && sim_cb_len == half);
+    block = ADC_Scan_Get_Latest(&seq);
+    CHECK(block == sim_buf + half && seq == 2);
+    CHECK(Sim_Block_Ok(block, channels, 4, frames, frames));
+
+    for (h = 2; h < 41; ++h) {  // The callbacks alternate and every block is complete
+        Sim_Convert(half, 4);
+        block = ADC_Scan_Get_Latest(&seq);
+        ok &= seq == h + 1 && block == sim_buf + (h & 1) * half && sim_cb_block == block;
+        ok &= Sim_Block_Ok(block, channels, 4, frames, h * frames);
+    }
+    CHECK(ok);
+    CHECK(sim_half_calls == 21 && sim_full_calls == 20);
+    CHECK((DMA1->ISR & 0xfu) == 0);  // The manager cleared every flag it handled
+}
+
+/**
+ * @brief Restarting with another sequence frees the channel of the old scan and starts at rank 1 of buf.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Restart(void) {
+    static const uint8_t channels[ADC_SCAN_MAX_CHANNELS] = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+    const uint16_t frames = 32;
+    uint32_t seq;
+
+    Sim_Convert(7, 4);  // Stop the old scan in the middle of a frame
+    sim_frame = 0;
+    sim_rank = 0;
+    sim_half_calls = 0;
+    sim_full_calls = 0;
+    CHECK(ADC_Scan_Init(channels, ADC_SCAN_MAX_CHANNELS, sim_buf, frames) == 1);
+    CHECK(ADC_Scan_Get_Latest(&seq) == 0 && seq == 0);
+    CHECK(ADC1->SQR1 == (15u << 20 | 3u | 2u << 5 | 1u << 10 | 0u << 15));  // L and ranks 13-16
+    Sim_Convert(2 * ADC_SCAN_MAX_CHANNELS * frames, ADC_SCAN_MAX_CHANNELS);
+    CHECK(sim_half_calls == 1 && sim_full_calls == 1);
+    CHECK(Sim_Block_Ok(sim_buf, channels, ADC_SCAN_MAX_CHANNELS, 2 * frames, 0));
+
+    ADC_Scan_Set_Callback(0, 0);  // No callbacks, the blocks are still published
+    Sim_Convert(ADC_SCAN_MAX_CHANNELS * frames, ADC_SCAN_MAX_CHANNELS);
+    CHECK(ADC_Scan_Get_Latest(&seq) == sim_buf && seq == 3);
+    CHECK(sim_half_calls == 1);
+}
+
+/**
+ * @brief Stop turns the ADC off and releases the channel; a channel owned by another driver blocks a start.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Stop(void) {
+    static const uint8_t channels[2] = {1, 2};
+    uint32_t seq;
+
+    ADC_Scan_Stop();
+    CHECK(!(ADC1->CR2 & ADC_CR2_ADON) && !(ADC1->CR2 & 0x100u));
+    CHECK(Sim_Convert(10, 2) == 0);
+    CHECK(ADC_Scan_Get_Latest(&seq) == sim_buf && seq == 3);
+
+    CHECK(DMA_Mgr_Alloc(1, 1, 1) == 1);  // Another driver takes the channel
+    CHECK(ADC_Scan_Init(channels, 2, sim_buf, 8) == 0);
+    DMA_Mgr_Free(1);
+    CHECK(ADC_Scan_Init(channels, 2, sim_buf, 8) == 1);
+    ADC_Scan_Stop();
+}
+
+int main(void) {
+    Test_Arguments();
+    Test_Scan();
+    Test_Restart();
+    Test_Stop();
+    return TEST_EXIT("test_adc_scan");
+}
@@ -0,0 +1,216 @@
+/**
+ * @file test_adc_timer.c
+ * @brief Host test of the timer-paced ADC scan: the TIM3 rate calculation and a model of the triggered sequence.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * TIM_Rate_Calc() is checked for every rate from 1 Hz to 1 MHz and for rates spread up to clk / 2, at three timer
+ * clocks. The rate the registers give, clk / ((PSC + 1) * (ARR + 1)), must be within the stated tolerance of the
+ * wanted rate: 0.5 / N with N = clk / rate when the prescaler is 1, and 1 / 65536 otherwise. The value returned
+ * must be that rate rounded.
+ *
+ * Then ADC_Scan_Timer_Init() runs against a model in which every TIM3 update converts the whole sequence once,
+ * which only happens if TIM3, its TRGO and the ADC trigger are all set up; the frames must arrive one update
+ * period apart and in order.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_adc_timer
+ */
+
+#include <math.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "adc.c"
+#include "dma.c"
+#include "time.c"
+#include "SysTick.c"
+#include "dwt.c"
+
+static uint16_t sim_buf[2 * 8 * 16];  // Static, the DMA model reaches it through a 32-bit address
+static uint32_t sim_blocks;           // Halves completed
+static uint8_t sim_order_ok = 1;      // 1 while every block holds the frames that follow the previous block
+
+/**
+ * @brief Checks one rate at one clock.
+ *
+ * @param clk The timer clock in Hz.
+ * @param rate The wanted rate in Hz.
+ * @param worst Updated with the largest relative error so far.
+ * @return 1 if the rate is within the tolerance and the returned rate is the achieved one rounded.
+ */
+static uint8_t Sim_Rate_Ok(uint32_t clk, uint32_t rate, double *worst) {
+    uint16_t per;
+    uint16_t psc;
+    uint32_t ret;
+    double n;
+    double actual;
+    double err;
+    double tol;
+
+    ret = TIM_Rate_Calc(clk, rate, &per, &psc);
+    if (ret == 0) {
+        return 0;
+    }
+    n = floor((double)clk / rate + 0.5);
+    actual = (double)clk / ((psc + 1.0) * (per + 1.0));
+    err = fabs(actual - rate) / rate;
+    tol = psc == 0 ? 0.5 / n : 1.0 / 65536;
+    if (err > *worst) {
+        *worst = err;
+    }
+    return err <= tol * (1 + 1e-9) && ret == (uint32_t)floor(actual + 0.5);
+}
+
+/**
+ * @brief Checks TIM_Rate_Calc() over the whole range at several clocks, and its limits.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Rate_Calc(void) {
+    static const uint32_t clks[] = {72000000, 36000000, 8000000};
+    uint32_t failures;
+    uint32_t rate;
+    uint16_t per;
+    uint16_t psc;
+    double worst;
+    double r;
+    uint8_t c;
+
+    for (c = 0; c < sizeof(clks) / sizeof(clks[0]); ++c) {
+        failures = 0;
+        worst = 0;
+        for (rate = 1; rate <= 1000000; ++rate) {
+            failures += !Sim_Rate_Ok(clks[c], rate, &worst);
+        }
+        for (r = 1e6; r <= clks[c] / 2; r *= 1.001) {
+            failures += !Sim_Rate_Ok(clks[c], (uint32_t)r, &worst);
+        }
+        failures += !Sim_Rate_Ok(clks[c], clks[c] / 2, &worst);
+        CHECK(failures == 0);
+        printf("%8u Hz clock: worst rate error %.3g\n", clks[c], worst);
+    }
+
+    CHECK(TIM_Rate_Calc(72000000, 0, &per, &psc) == 0);
+    CHECK(TIM_Rate_Calc(72000000, 36000001, &per, &psc) == 0);
+    CHECK(TIM_Rate_Calc(72000000, 36000000, &per, &psc) == 36000000 && psc == 0 && per == 1);
+    CHECK(TIM_Rate_Calc(72000000, 1, &per, &psc) == 1 && psc == 1098 && per == 65513);
+}
+
+/**
+ * @brief The timer clock is PCLK1, or twice PCLK1 when the APB1 prescaler divides.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_APB1_Clock(void) {
+    CHECK(TIM_APB1_Clock() == 72000000);  // 36 MHz APB1 of the default clocks
+    host_clocks.PCLK1_Frequency = host_clocks.HCLK_Frequency;
+    CHECK(TIM_APB1_Clock() == 72000000);
+    host_clocks.HCLK_Frequency = 8000000;
+    host_clocks.PCLK1_Frequency = 8000000;
+    CHECK(TIM_APB1_Clock() == 8000000);
+    host_clocks.HCLK_Frequency = 72000000;
+    host_clocks.PCLK1_Frequency = 36000000;
+}
+
+/**
+ * @brief Half-buffer callback, checks that the block holds the frames after the previous block.
+ *
+ * Every sample of frame f is f modulo 4096.
+ *
+ * @param block The completed half.
+ * @param len The number of samples in block.
+ * @return void
+ */
+static void Sim_Block_Cb(const uint16_t *block, uint16_t len) {
+    static uint32_t frame;
+    uint16_t i;
+
+    if (sim_blocks == 0) {
+        frame = 0;
+    }
+    for (i = 0; i < len; ++i) {
+        sim_order_ok &= block[i] == ((frame + i / 2) & 0xfff);
+    }
+    frame += len / 2;
+    sim_blocks++;
+}
+
+/**
+ * @brief Runs TIM3 for a number of update events, converting the sequence on each one the ADC is set up for.
+ *
+ * @param updates The number of update events.
+ * @param nbr The number of ranks.
+ * @param frames Receives the number of sequences converted.
+ * @return The time of the updates in timer clocks.
+ */
+static uint64_t Sim_Run(uint32_t updates, uint8_t nbr, uint32_t *frames) {
+    uint64_t t = 0;
+    uint32_t u;
+    uint8_t k;
+
+    *frames = 0;
+    for (u = 0; u < updates; ++u) {
+        if (!(TIM3->CR1 & TIM_CR1_CEN)) {
+            break;
+        }
+        t += (TIM3->PSC + 1u) * (TIM3->ARR + 1u);
+        if ((TIM3->CR2 & 0x70u) != TIM_TRGOSource_Update || !(ADC1->CR2 & ADC_CR2_EXTTRIG) ||
+            (ADC1->CR2 & 0x000e0000u) != ADC_ExternalTrigConv_T3_TRGO) {
+            continue;
+        }
+        for (k = 0; k < nbr; ++k) {
+            Host_ADC_Convert((uint16_t)(*frames & 0xfff));
+        }
+        ++*frames;
+    }
+    return t;
+}
+
+/**
+ * @brief The paced scan starts only at supported rates and converts one frame per update of TIM3.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Timer_Scan(void) {
+    static const uint8_t channels[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    static const uint32_t rates[] = {1, 50, 1000, 8000, 44100, 88235};
+    uint32_t actual;
+    uint32_t frames;
+    uint64_t t;
+    uint8_t r;
+
+    ADC_Scan_Set_Callback(Sim_Block_Cb, Sim_Block_Cb);
+    CHECK(ADC_Scan_Timer_Init(channels, 1, sim_buf, 8, 12000000 / 68 + 1) == 0);  // Faster than ADCCLK allows
+    CHECK(!(TIM3->CR1 & TIM_CR1_CEN) && !(ADC1->CR2 & ADC_CR2_ADON));
+    CHECK(ADC_Scan_Timer_Init(channels, 16, sim_buf, 8, 12000000 / (68 * 16) + 1) == 0);
+    CHECK(ADC_Scan_Timer_Init(channels, 16, sim_buf, 8, 12000000 / (68 * 16)) != 0);
+    CHECK(ADC_Scan_Timer_Init(channels, 1, sim_buf, 8, 12000000 / 68) != 0);
+    CHECK(ADC_Scan_Timer_Init(channels, 1, sim_buf, 8, 0) == 0);
+
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+        sim_blocks = 0;
+        actual = ADC_Scan_Timer_Init(channels, 2, sim_buf, 8, rates[r]);
+        CHECK(actual != 0 && !(ADC1->CR2 & 0x2u));  // One sequence per trigger, not continuous
+        t = Sim_Run(160, 2, &frames);
+        CHECK(frames == 160 && sim_blocks == 20 && sim_order_ok);
+        CHECK(fabs(72e6 * frames / t - actual) <= 0.5);
+        CHECK(fabs(72e6 * frames / t - rates[r]) <= rates[r] / 65536.0 + 0.5 * rates[r] * rates[r] / 72e6);
+    }
+
+    ADC_Scan_Stop();
+    CHECK(!(TIM3->CR1 & TIM_CR1_CEN) && Sim_Run(10, 2, &frames) == 0 && frames == 0);
+}
+
+int main(void) {
+    Test_Rate_Calc();
+    Test_APB1_Clock();
+    Test_Timer_Scan();
+    return TEST_EXIT("test_adc_timer");
+}
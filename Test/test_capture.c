@@ -0,0 +1,360 @@
+/**
+ * @file test_capture.c
+ * @brief Host test of the TIM5 capture engine against a model of the counters and the DMA rings.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The model advances TIM5 and TIM7 one tick at a time: a counter wraps and sets its update flag, and a capture
+ * copies the TIM5 counter into the CCR and its DMA ring. Each interrupt runs a random latency after its flag rises
+ * and every counter read inside it takes a tick. Edges come on all four channels at every phase of the counter
+ * period, around both interrupts, across long silences and on a CAPTURE_BOTH pair, and every timestamp read back
+ * must equal the tick the edge came at.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * gcc -std=c99 -no-pie -iquote Test/host -iquote Bit-band -iquote DWT -iquote Timer -iquote Capture_Engine
+ *     -o test_capture Test/test_capture.c Test/host/host.c && ./test_capture
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "capture.c"
+
+#define SIM_EDGES 16384
+
+/**
+ * @brief An edge on one ring, and the channel and level it is read back as.
+ */
+typedef struct {
+    uint64_t t;     // Tick of the capture
+    uint8_t ring;   // Channel index that captures it
+    uint8_t ch;     // Channel it is read from, 1-4
+    uint8_t level;  // Level after the edge
+} Sim_Edge_TypeDef;
+
+static uint64_t sim_t;           // Ticks since Capture_Init()
+static uint8_t sim_in_isr;     // 1 while an interrupt handler runs
+static uint32_t sim_jitter;    // Random extra interrupt latency, 0 to sim_jitter ticks
+static uint32_t sim_mid_irqs;  // TIM7 interrupts entered with the update flag pending
+static uint32_t sim_updates;   // TIM5 interrupts entered with the update flag pending
+static Sim_Edge_TypeDef sim_edge[SIM_EDGES];
+static uint32_t sim_edges;    // Edges in sim_edge, sorted by tick
+static uint32_t sim_next;                                     // Next edge to capture
+static Sim_Edge_TypeDef sim_want[CAPTURE_CHANNELS][SIM_EDGES];  // Edges of each channel in the order read back
+static uint32_t sim_wants[CAPTURE_CHANNELS];
+static uint32_t sim_read[CAPTURE_CHANNELS];  // Edges of each channel read or counted as dropped
+static uint32_t sim_seen_dropped[CAPTURE_CHANNELS];
+static uint32_t sim_errors;
+
+/**
+ * @brief The engine's counter rate is derived from this clock, 72 MHz as after the usual clock setup.
+ */
+uint32_t TIM_APB1_Clock(void) { return 72000000; }
+
+/**
+ * @brief Captures the due edges: copies the counter into the CCR and, if enabled, into the DMA ring.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Capture(void) {
+    while (sim_next < sim_edges && sim_edge[sim_next].t <= sim_t) {
+        uint8_t i = sim_edge[sim_next].ring;
+        DMA_Channel_TypeDef *d = capture_dma[i];
+        uint16_t v = (uint16_t)sim_edge[sim_next].t;
+
+        sim_next++;
+        if (!(TIM5->CCER & (TIM_CCx_Enable << (4 * i)))) {
+            continue;  // Not capturing
+        }
+        (&TIM5->CCR1)[2 * i] = v;
+        TIM5->SR |= TIM_IT_CC1 << i;
+        if ((TIM5->DIER & capture_dma_req[i]) && (d->CCR & DMA_CCR1_EN)) {
+            *(uint16_t *)(uintptr_t)(d->CMAR + 2 * (CAPTURE_RAW_SIZE - d->CNDTR)) = v;
+            if (--d->CNDTR == 0) {
+                d->CNDTR = CAPTURE_RAW_SIZE;  // Circular
+            }
+        }
+    }
+}
+
+/**
+ * @brief Advances the counter by one tick.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Tick(void) {
+    sim_t++;
+    TIM5->CNT = (uint16_t)sim_t;
+    if (TIM5->CNT == 0) {
+        TIM5->SR |= TIM_FLAG_Update;
+    }
+    if (TIM7->CR1 & TIM_CR1_CEN) {
+        TIM7->CNT = (uint16_t)(TIM7->CNT + 1);  // Same prescaler as TIM5
+        if (TIM7->CNT == 0) {
+            TIM7->SR |= TIM_FLAG_Update;
+        }
+    }
+    Sim_Capture();
+}
+
+/**
+ * @brief Every counter read inside the interrupt takes a tick, so edges can come while it converts.
+ */
+uint16_t TIM_GetCounter(TIM_TypeDef *TIMx) {
+    if (sim_in_isr) {
+        Sim_Tick();
+    }
+    return TIMx->CNT;
+}
+
+/**
+ * @brief Runs the counters to a tick, entering each interrupt a random latency after its flag rises.
+ *
+ * The two interrupts have the same priority, so one never runs inside the other.
+ *
+ * @param t The tick to stop at.
+ * @return void
+ */
+static void Sim_Run(uint64_t t) {
+    TIM_TypeDef *const tim[2] = {TIM5, TIM7};
+    uint64_t due[2] = {0, 0};
+    uint8_t pending[2] = {0, 0};
+    uint8_t k;
+
+    while (sim_t < t || pending[0] || pending[1]) {
+        Sim_Tick();
+        for (k = 0; k < 2; ++k) {
+            if (!pending[k] && (tim[k]->SR & tim[k]->DIER & TIM_IT_Update)) {
+                pending[k] = 1;
+                due[k] = sim_t + 2 + (sim_jitter ? (uint32_t)rand() % (sim_jitter + 1) : 0);
+            }
+        }
+        for (k = 0; k < 2; ++k) {
+            if (pending[k] && sim_t >= due[k]) {
+                pending[k] = 0;
+                sim_in_isr = 1;
+                if (k == 0) {
+                    sim_updates += (TIM5->SR & TIM5->DIER & TIM_IT_Update) != 0;
+                    TIM5_IRQHandler();
+                } else {
+                    sim_mid_irqs += (TIM7->SR & TIM7->DIER & TIM_IT_Update) != 0;
+                    TIM7_IRQHandler();
+                }
+                sim_in_isr = 0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Adds an edge.
+ *
+ * @param t The tick of the capture.
+ * @param ring The channel index that captures it.
+ * @param ch The channel it is read from, 1-4.
+ * @param level The level after the edge.
+ * @return void
+ */
+static void Sim_Add(uint64_t t, uint8_t ring, uint8_t ch, uint8_t level) {
+    Sim_Edge_TypeDef e = {t, ring, ch, level};
+    uint32_t k = sim_edges++;
+
+    sim_want[ch - 1][sim_wants[ch - 1]++] = e;
+    while (k > 0 && sim_edge[k - 1].t > t) {
+        sim_edge[k] = sim_edge[k - 1];
+        k--;
+    }
+    sim_edge[k] = e;
+}
+
+/**
+ * @brief Reads the edges of a channel and compares them with the ones added.
+ *
+ * @param ch The channel, 1-4.
+ * @return void
+ */
+static void Sim_Check(uint8_t ch) {
+    Capture_Edge_TypeDef e[16];
+    uint16_t n;
+    uint16_t k;
+    uint32_t dropped;
+    Sim_Edge_TypeDef *w;
+
+    while ((n = Capture_Read(ch, e, 16)) > 0) {
+        dropped = Capture_Dropped(ch);
+        sim_read[ch - 1] += dropped - sim_seen_dropped[ch - 1];
+        sim_seen_dropped[ch - 1] = dropped;
+        for (k = 0; k < n; ++k) {
+            w = &sim_want[ch - 1][sim_read[ch - 1]++];
+            if (sim_read[ch - 1] > sim_wants[ch - 1] || e[k].stamp != (uint32_t)w->t || e[k].level != w->level) {
+                if (sim_errors++ < 10) {
+                    printf("ch%u edge %u: got %u/%u, want %u/%u\n", ch, (unsigned)sim_read[ch - 1] - 1, e[k].stamp,
+                           e[k].level, (uint32_t)w->t, w->level);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Clears the registers and the model.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Reset(void) {
+    memset(TIM5, 0, sizeof(*TIM5));
+    memset(TIM7, 0, sizeof(*TIM7));
+    memset(host_dma2_ch, 0, sizeof(host_dma2_ch));
+    sim_t = 0;
+    sim_updates = 0;
+    sim_mid_irqs = 0;
+    sim_edges = 0;
+    sim_next = 0;
+    sim_errors = 0;
+    memset(sim_wants, 0, sizeof(sim_wants));
+    memset(sim_read, 0, sizeof(sim_read));
+    memset(sim_seen_dropped, 0, sizeof(sim_seen_dropped));
+}
+
+/**
+ * @brief Checks the channel limits: all four channels can capture, a CAPTURE_BOTH pair counting as two.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Start_Limits(void) {
+    Sim_Reset();
+    sim_jitter = 0;
+    CHECK(Capture_Init(1000000, 0, 0) == 1000000);
+    CHECK(Capture_Start(0, CAPTURE_RISING, 0) == 0);
+    CHECK(Capture_Start(1, 0, 0) == 0);
+    CHECK(Capture_Start(1, CAPTURE_RISING, 0x10) == 0);
+    CHECK(TIM7->CNT == CAPTURE_MID_PERIOD && (TIM7->CR1 & TIM_CR1_CEN) && (TIM7->DIER & TIM_IT_Update));
+
+    Sim_Run(0x10000 + 4);
+    CHECK(Capture_Start(1, CAPTURE_RISING, 0) == 1);
+    CHECK(Capture_Start(3, CAPTURE_BOTH, 0) == 1);
+    CHECK(Capture_Start(4, CAPTURE_RISING, 0) == 0);  // Partner of CH3
+    CHECK(Capture_Start(2, CAPTURE_BOTH, 0) == 0);    // Its partner CH1 captures
+    CHECK(Capture_Start(2, CAPTURE_FALLING, 0) == 1);  // The last channel
+    CHECK(Capture_Start(2, CAPTURE_FALLING, 0) == 0);
+    CHECK(!(TIM5->DIER & (TIM_IT_CC1 | TIM_IT_CC2 | TIM_IT_CC3 | TIM_IT_CC4)));  // Only DMA requests
+
+    sim_mid_irqs = 0;
+    Sim_Run(sim_t + 0x10000);
+    CHECK(sim_mid_irqs == 1);  // One mid-period conversion per period
+
+    Capture_Stop(4);  // Partner, ignored
+    CHECK(capture_ch[3].mode == CAPTURE_PARTNER);
+    Capture_Stop(3);
+    CHECK(capture_ch[2].mode == 0 && capture_ch[3].mode == 0);
+    CHECK(Capture_Start(4, CAPTURE_FALLING, 0) == 1);
+    Capture_Stop(1);
+    Capture_Stop(2);
+    Capture_Stop(4);
+}
+
+/**
+ * @brief Captures edges on all four channels at every phase of the counter period and compares every timestamp.
+ *
+ * @param tick_hz The counter rate.
+ * @param jitter The random extra interrupt latency in ticks.
+ * @param seed The random seed.
+ * @return void
+ */
+static void Test_Stamps(uint32_t tick_hz, uint32_t jitter, unsigned seed) {
+    const int32_t offs[] = {-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 15, 20, 32768, 65535 - 3, 65534};
+    uint32_t span;
+    Capture_Result_TypeDef r;
+    uint64_t t = 0;
+    uint64_t p;
+    uint64_t end;
+    int32_t o;
+    uint32_t k;
+    uint32_t periods;
+
+    Sim_Reset();
+    srand(seed);
+    sim_jitter = jitter;
+    CHECK(Capture_Init(tick_hz, 0, 0) == tick_hz);
+    CHECK(Capture_Start(1, CAPTURE_RISING, 0) == 1);
+    CHECK(Capture_Start(2, CAPTURE_FALLING, 0) == 1);
+    CHECK(Capture_Start(3, CAPTURE_BOTH, 0) == 1);
+    span = capture_slack + 2 * jitter + 4;  // Phases around the two conversions of every period
+
+    // CH1: one edge per period near the wrap and the two conversions, some a period late, and long silences.
+    for (k = 2; k < 400; ++k) {
+        o = rand() % 2 ? offs[rand() % 16] : (int32_t)(rand() % span + (rand() % 2 ? CAPTURE_MID_PERIOD : 0));
+        if (k % 50 == 0) {
+            k += 37;
+        }
+        p = (uint64_t)k * 0x10000 + o + (rand() % 3 == 0 ? 0x10000 : 0);
+        if (p > t) {
+            t = p;
+            Sim_Add(t, 0, 1, 1);
+        }
+    }
+    // CH2: a burst of edges in every period, at phases of their own.
+    t = 0x10000;
+    for (k = 0; k < 600; ++k) {
+        t += 1 + (rand() % 4 ? (uint32_t)rand() % 400 : (uint32_t)rand() % 0x18000);
+        Sim_Add(t, 1, 2, 0);
+    }
+    // CH3/CH4: pulses straddling the wraps with silences, then a 10000-tick period at 25 % duty.
+    p = (uint64_t)450 * 0x10000 - 100;
+    for (k = 0; k < 1000; ++k) {
+        Sim_Add(p, 2, 3, 1);
+        Sim_Add(p + 7000 + (k % 5) * 13, 3, 3, 0);
+        p += 20000 + (k % 100 == 0 ? 300000 : 0);
+    }
+    for (k = 0; k < 300; ++k) {
+        Sim_Add(p, 2, 3, 1);
+        Sim_Add(p + 2500, 3, 3, 0);
+        p += 10000;
+    }
+
+    end = sim_edge[sim_edges - 1].t + 10;
+    while (sim_t < end) {
+        Sim_Run(sim_t + 1 + rand() % 200000);
+        if (rand() % 2) {
+            Sim_Check(1);
+        }
+        if (rand() % 2) {
+            Sim_Check(2);
+        }
+        if (rand() % 2) {
+            Sim_Check(3);
+        }
+    }
+    CHECK(Capture_Measure(3, 8, &r) == 1);
+    CHECK(r.period == 10000 && r.width == 2500 && r.duty == 2500 && r.freq_mhz == tick_hz / 10);
+    CHECK(r.periods == 8);
+    Sim_Check(1);
+    Sim_Check(2);
+    Sim_Check(3);
+
+    periods = (uint32_t)(sim_t >> 16);
+    CHECK(sim_errors == 0);
+    CHECK(sim_updates == periods);
+    CHECK(sim_mid_irqs == periods || sim_mid_irqs == periods + 1);  // Once per period, half a period after TIM5
+    CHECK(sim_read[0] == sim_wants[0] && sim_read[1] == sim_wants[1] && sim_read[2] == sim_wants[2]);
+    printf("%u Hz, jitter %u ticks: %u edges, %u dropped\n", tick_hz, jitter, sim_edges,
+           Capture_Dropped(1) + Capture_Dropped(2) + Capture_Dropped(3));
+    Capture_Stop(1);
+    Capture_Stop(2);
+    Capture_Stop(3);
+}
+
+int main(void) {
+    Test_Start_Limits();
+    Test_Stamps(1000000, 0, 1);
+    Test_Stamps(1000000, 10, 2);
+    Test_Stamps(72000000, 720, 3);
+    Test_Stamps(72000000, 100, 4);
+    Test_Stamps(72000000, 20000, 5);  // Interrupts up to 20000 ticks late, far beyond a 64-tick slack
+    return TEST_EXIT("test_capture");
+}
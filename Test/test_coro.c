@@ -0,0 +1,356 @@
+/**
+ * @file test_coro.c
+ * @brief Host test of the coroutines and the awaitable driver operations against simulated peripherals.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Time runs in steps of 10 us with a SysTick tick every 100 steps. In every step the models of ADC1, TIM5 with
+ * the touch pad on PA1, the USART1 line at 115200 baud and the RCC oscillators move on, then the main loop gives
+ * each coroutine one turn, as a plain main loop on the board does.
+ *
+ * The coroutine primitives must yield, exit, restart and delay for at least the time asked. An ADC read, a touch
+ * measurement and a UART write longer than the TX ring, run at the same time, must each return exactly what the
+ * peripherals produced and must all be done in about the time of the longest one, not of the three together.
+ * Two ADC reads started together must convert one after the other, each on its own channel. The touch pad must
+ * be discharged for at least 5 ms, and a pad that never charges must end on the counter timeout. The clock switch
+ * must reach the PLL when the HSE starts and give up after HSE_STARTUP_TICKS when it does not.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_coro
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "adc.c"
+#include "dma.c"
+#include "time.c"
+#include "SysTick.c"
+#include "dwt.c"
+#include "touch_key.c"
+#include "usart.c"
+#include "hse.c"
+
+#define SIM_STEP_US 10  // Simulated time per step
+#define SIM_TICK_STEPS (SYSTICK_TICK_US / SIM_STEP_US)
+#define SIM_ADC_STEPS 3      // 239.5 + 12.5 cycles at 12 MHz: 21 us
+#define SIM_UART_STEPS 9     // One byte at 115200 baud: 87 us
+#define SIM_TIM_PER_STEP 10  // TIM5 counts at 1 MHz
+#define SIM_MSG_LEN 1000     // Longer than the TX ring
+#define SIM_NEVER 0xffffffffu
+
+static uint64_t sim_step;         // Steps since the start
+static uint32_t sim_adc_busy;     // Steps left of the running conversion, 0 when idle
+static uint8_t sim_adc_ch[64];    // Channel of every conversion, in order
+static uint16_t sim_adc_val[64];  // Result of every conversion
+static uint32_t sim_adc_n;
+static uint32_t sim_touch_charge;  // TIM5 counts the pad needs to charge, SIM_NEVER if it never does
+static uint64_t sim_touch_low;     // Step the pad was driven low
+static uint64_t sim_touch_float;   // Step the pad was released
+static uint8_t sim_touch_out;      // 1 while PA1 drives the pad
+static uint32_t sim_uart_busy;     // Steps left of the byte on the line
+static uint8_t sim_uart_log[SIM_MSG_LEN * 2];
+static uint32_t sim_uart_len;
+static uint32_t sim_hse_steps;  // Steps the HSE takes to start once enabled, SIM_NEVER if it never does
+static uint64_t sim_hse_on;     // Step HSEON was seen set
+static uint8_t sim_hse_seen;
+
+/**
+ * @brief Takes the byte off DR into the log; TXE rises again once the byte has left the shift register.
+ *
+ * @param USARTx The USART.
+ * @param Data The byte.
+ * @return void
+ */
+void USART_SendData(USART_TypeDef *USARTx, uint16_t Data) {
+    USARTx->DR = Data & 0x1ff;
+    USARTx->SR &= ~USART_FLAG_TXE;
+    sim_uart_log[sim_uart_len++ % sizeof(sim_uart_log)] = (uint8_t)Data;
+    sim_uart_busy = SIM_UART_STEPS;
+}
+
+/**
+ * @brief Moves every peripheral model on by one step and runs the interrupts that become due.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Step(void) {
+    uint8_t floating = ((GPIOA->CRL >> 4) & 0xf) == GPIO_Mode_IN_FLOATING;
+    uint16_t v;
+
+    sim_step++;
+    if (sim_step % SIM_TICK_STEPS == 0) {
+        SysTick_Handler();
+    }
+
+    if (!sim_adc_busy && (ADC1->CR2 & 0x00400000u)) {  // SWSTART
+        ADC1->CR2 &= ~0x00400000u;
+        sim_adc_busy = SIM_ADC_STEPS;
+    }
+    if (sim_adc_busy && --sim_adc_busy == 0) {
+        v = (uint16_t)(rand() % 4096);
+        if (sim_adc_n < sizeof(sim_adc_ch)) {
+            sim_adc_ch[sim_adc_n] = Host_ADC_Channel();
+            sim_adc_val[sim_adc_n++] = v;
+        }
+        Host_ADC_Convert(v);
+    }
+
+    if (!floating && !sim_touch_out) {
+        sim_touch_out = 1;
+        sim_touch_low = sim_step;
+    } else if (floating && sim_touch_out) {
+        sim_touch_out = 0;
+        sim_touch_float = sim_step;
+    }
+    if (TIM5->CR1 & TIM_CR1_CEN) {
+        TIM5->CNT = (uint16_t)(TIM5->CNT + SIM_TIM_PER_STEP);
+        if (floating && !(TIM5->SR & TIM_FLAG_CC2) && sim_touch_charge != SIM_NEVER &&
+            (sim_step - sim_touch_float) * SIM_TIM_PER_STEP >= sim_touch_charge) {
+            TIM5->CCR2 = TIM5->CNT;
+            TIM5->SR |= TIM_FLAG_CC2;  // The pad reached the rising threshold
+        }
+    }
+
+    if (sim_uart_busy && --sim_uart_busy == 0) {
+        USART1->SR |= USART_FLAG_TXE;
+    }
+    if ((USART1->SR & USART_FLAG_TXE) && (USART1->CR1 & USART_CR1_TXEIE)) {
+        USART1_IRQHandler();
+    }
+
+    if (!(RCC->CR & RCC_CR_HSEON)) {
+        sim_hse_seen = 0;
+    } else if (!sim_hse_seen) {
+        sim_hse_seen = 1;
+        sim_hse_on = sim_step;
+    } else if (sim_hse_steps != SIM_NEVER && sim_step - sim_hse_on >= sim_hse_steps) {
+        RCC->CR |= RCC_CR_HSERDY;
+    }
+    if (RCC->CR & RCC_CR_PLLON) {
+        RCC->CR |= RCC_CR_PLLRDY;
+    }
+    if ((RCC->CFGR & RCC_CFGR_SW) == RCC_SYSCLKSource_PLLCLK && (RCC->CR & RCC_CR_PLLRDY)) {
+        RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SWS) | 0x08u;
+    }
+}
+
+static uint8_t sim_yields;  // Turns the primitive coroutine has had
+static uint8_t sim_exit;    // 1 makes the primitive coroutine exit early
+
+/**
+ * @brief Yields twice, exits early on request, then delays 3 ms.
+ *
+ * @param c The coroutine context.
+ * @return CORO_WAITING or CORO_DONE.
+ */
+static uint8_t Sim_Primitives(Coro_TypeDef *c) {
+    sim_yields++;
+    CORO_BEGIN(c);
+    CORO_YIELD(c);
+    CORO_YIELD(c);
+    if (sim_exit) {
+        CORO_EXIT(c);
+    }
+    CORO_DELAY_MS(c, 3);
+    CORO_END(c);
+}
+
+/**
+ * @brief Yield, exit, restart after done and CORO_INIT(), and delays that never end early.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Primitives(void) {
+    Coro_TypeDef c = {0};
+    uint64_t start;
+    uint32_t i;
+    uint32_t short_delays = 0;
+
+    sim_yields = 0;
+    sim_exit = 1;
+    CHECK(Sim_Primitives(&c) == CORO_WAITING && Sim_Primitives(&c) == CORO_WAITING);
+    CHECK(Sim_Primitives(&c) == CORO_DONE && sim_yields == 3 && c.lc == 0);
+
+    sim_exit = 0;
+    CHECK(Sim_Primitives(&c) == CORO_WAITING);  // Starts over after done
+    CORO_INIT(&c);
+    sim_yields = 0;
+    CHECK(Sim_Primitives(&c) == CORO_WAITING && Sim_Primitives(&c) == CORO_WAITING && sim_yields == 2);
+
+    for (i = 0; i < 300; ++i) {
+        CORO_INIT(&c);
+        Sim_Step();
+        while (rand() % 50) {
+            Sim_Step();  // Start anywhere within a tick
+        }
+        start = sim_step;
+        while (Sim_Primitives(&c) == CORO_WAITING) {
+            Sim_Step();
+        }
+        short_delays += (sim_step - start) * SIM_STEP_US < 3000;
+    }
+    CHECK(short_delays == 0);
+}
+
+/**
+ * @brief Runs an ADC read, a touch measurement and a UART write side by side and checks each result and the time.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Concurrent(void) {
+    static uint8_t msg[SIM_MSG_LEN];
+    Coro_TypeDef adc = {0};
+    Coro_TypeDef touch = {0};
+    Coro_TypeDef uart = {0};
+    uint8_t adc_done = 0;
+    uint8_t touch_done = 0;
+    uint8_t uart_done = 0;
+    uint64_t start;
+    uint64_t adc_end = 0;
+    uint64_t touch_end = 0;
+    uint64_t uart_end = 0;
+    uint64_t longest;
+    uint16_t adc_val = 0;
+    uint16_t touch_val = 0;
+    uint32_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < SIM_MSG_LEN; ++i) {
+        msg[i] = (uint8_t)rand();
+    }
+    sim_adc_n = 0;
+    sim_uart_len = 0;
+    sim_touch_charge = 700;
+    start = sim_step;
+    while (!adc_done || !touch_done || !uart_done) {
+        Sim_Step();
+        if (!adc_done && ADC_Read_Async(&adc, ADC_Channel_16, 8, &adc_val) == CORO_DONE) {
+            adc_done = 1;
+            adc_end = sim_step;
+        }
+        if (!touch_done && Touch_Get_Val_Async(&touch, &touch_val) == CORO_DONE) {
+            touch_done = 1;
+            touch_end = sim_step;
+        }
+        if (!uart_done && USART1_Write_Async(&uart, msg, SIM_MSG_LEN) == CORO_DONE) {
+            uart_done = 1;
+            uart_end = sim_step;
+        }
+    }
+    while (USART1->CR1 & USART_CR1_TXEIE) {
+        Sim_Step();  // Drain the ring
+    }
+
+    for (i = 0; i < sim_adc_n; ++i) {
+        sum += sim_adc_val[i];
+    }
+    CHECK(sim_adc_n == 8 && sim_adc_ch[0] == ADC_Channel_16 && sim_adc_ch[7] == ADC_Channel_16);
+    CHECK(adc_val == sum / 8);
+    CHECK(touch_val >= 700 && touch_val < 700 + 2 * SIM_TIM_PER_STEP);
+    CHECK((sim_touch_float - sim_touch_low) * SIM_STEP_US >= 5000);
+    CHECK(sim_uart_len == SIM_MSG_LEN && memcmp(sim_uart_log, msg, SIM_MSG_LEN) == 0);
+
+    longest = adc_end > uart_end ? adc_end : uart_end;
+    longest = longest > touch_end ? longest : touch_end;
+    CHECK((adc_end - start) * SIM_STEP_US >= 7 * 5000);  // Seven 5 ms gaps between the eight conversions
+    CHECK((uart_end - start) >= (uint64_t)(SIM_MSG_LEN - USART1_TX_BUF_SIZE - 1) * SIM_UART_STEPS);
+    CHECK(longest - start < (uart_end - start) + (adc_end - start) / 2);  // Overlapped, not one after another
+    printf("ADC read %llu us, touch %llu us, UART write %llu us, all three %llu us\n",
+           (unsigned long long)(adc_end - start) * SIM_STEP_US, (unsigned long long)(touch_end - start) * SIM_STEP_US,
+           (unsigned long long)(uart_end - start) * SIM_STEP_US, (unsigned long long)(longest - start) * SIM_STEP_US);
+}
+
+/**
+ * @brief Two ADC reads started together convert one after the other; a pad that never charges times out.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Serialize(void) {
+    Coro_TypeDef a = {0};
+    Coro_TypeDef b = {0};
+    Coro_TypeDef touch = {0};
+    uint8_t a_done = 0;
+    uint8_t b_done = 0;
+    uint16_t a_val = 0;
+    uint16_t b_val = 0;
+    uint16_t touch_val = 0;
+    uint32_t sum_a = 0;
+    uint32_t sum_b = 0;
+    uint32_t i;
+
+    sim_adc_n = 0;
+    while (!a_done || !b_done) {
+        Sim_Step();
+        if (!b_done && ADC_Read_Async(&b, ADC_Channel_5, 4, &b_val) == CORO_DONE) {
+            b_done = 1;
+        }
+        if (!a_done && ADC_Read_Async(&a, ADC_Channel_3, 4, &a_val) == CORO_DONE) {
+            a_done = 1;
+        }
+    }
+    for (i = 0; i < 4; ++i) {
+        sum_b += sim_adc_val[i];
+        sum_a += sim_adc_val[4 + i];
+        CHECK(sim_adc_ch[i] == ADC_Channel_5 && sim_adc_ch[4 + i] == ADC_Channel_3);
+    }
+    CHECK(sim_adc_n == 8 && b_val == sum_b / 4 && a_val == sum_a / 4);
+
+    sim_touch_charge = SIM_NEVER;
+    while (Touch_Get_Val_Async(&touch, &touch_val) == CORO_WAITING) {
+        Sim_Step();
+    }
+    CHECK(touch_val > TOUCH_ARR_MAX_VAL - 500);
+}
+
+/**
+ * @brief The clock switch reaches the PLL when the HSE starts and gives up after HSE_STARTUP_TICKS otherwise.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_HSE(void) {
+    Coro_TypeDef c = {0};
+    uint8_t ok = 0xff;
+    uint64_t start;
+
+    sim_hse_steps = 150;
+    while (RCC_HSE_Config_Async(&c, RCC_PLLSource_HSE_Div1, RCC_PLLMul_9, &ok) == CORO_WAITING) {
+        Sim_Step();
+    }
+    CHECK(ok == 1 && RCC_GetSYSCLKSource() == 0x08);
+    CHECK((RCC->CFGR & 0x003f0000u) == (RCC_PLLSource_HSE_Div1 | RCC_PLLMul_9));
+
+    sim_hse_steps = SIM_NEVER;
+    start = sim_step;
+    while (RCC_HSE_Config_Async(&c, RCC_PLLSource_HSE_Div2, RCC_PLLMul_16, &ok) == CORO_WAITING) {
+        Sim_Step();
+    }
+    CHECK(ok == 0 && RCC_GetSYSCLKSource() == 0x00 && !(RCC->CR & RCC_CR_PLLON));
+    CHECK(sim_step - start >= (uint64_t)(HSE_STARTUP_TICKS - 1) * SIM_TICK_STEPS &&
+          sim_step - start <= (uint64_t)(HSE_STARTUP_TICKS + 1) * SIM_TICK_STEPS);
+}
+
+int main(void) {
+    srand(16);
+    SysTick_Init(72);
+    SysTick_Clock_Init();
+    ADC1->CR2 = ADC_CR2_ADON;
+    TIM5_CH2_Input_Init(TOUCH_ARR_MAX_VAL, 71);
+    USART1->SR = USART_FLAG_TXE;
+
+    Test_Primitives();
+    Test_Concurrent();
+    Test_Serialize();
+    Test_HSE();
+    return TEST_EXIT("test_coro");
+}
@@ -0,0 +1,414 @@
+/**
+ * @file test_dma_mgr.c
+ * @brief Host test of the DMA1 channel manager against the simulated DMA controller of Test/host.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * All seven channels run queues of descriptors with random direction, width, memory increment, priority and
+ * half-transfer events, some memory-to-memory. The controller serves one request of a random busy channel at a
+ * time, each channel's peripheral being a data register of its own, and descriptors are submitted both from the
+ * thread between requests and from the transfer-complete callback of the one before. Every descriptor must be
+ * started with its own settings, move its data, and call back in submission order exactly once, with a
+ * half-transfer event only if it asked for one. Allocation, circular descriptors, transfer errors and releasing
+ * a busy channel are checked on their own.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_dma_mgr
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "host.h"
+#include "dma.c"
+
+#define SIM_DESCS 200  // Descriptors per channel
+#define SIM_ITEMS 40   // Largest transfer
+
+/**
+ * @brief A descriptor of the run and what it has seen.
+ */
+typedef struct {
+    DMA_Desc_TypeDef d;
+    uint8_t ch;      // Channel, 1-7
+    uint16_t idx;    // Submission order on the channel
+    uint16_t moved;  // Items moved so far
+    uint8_t ht;      // DMA_EVT_HT callbacks
+    uint8_t tc;      // DMA_EVT_TC callbacks
+    uint8_t te;      // DMA_EVT_TE callbacks
+} Sim_Desc_TypeDef;
+
+static Sim_Desc_TypeDef sim_desc[DMA_MGR_CHANNELS][SIM_DESCS];
+static uint32_t sim_mem[DMA_MGR_CHANNELS][SIM_DESCS][SIM_ITEMS];  // Memory side of each descriptor
+static uint32_t sim_src[DMA_MGR_CHANNELS][SIM_DESCS][SIM_ITEMS];  // Source of the memory-to-memory ones
+static uint32_t sim_per[DMA_MGR_CHANNELS];                       // Data register of each channel's peripheral
+static uint16_t sim_submitted[DMA_MGR_CHANNELS];
+static uint16_t sim_done[DMA_MGR_CHANNELS];  // Descriptors called back with DMA_EVT_TC
+static uint32_t sim_chained;                 // Descriptors submitted from a callback
+static uint32_t sim_errors;
+
+/**
+ * @brief The value item n of a descriptor carries.
+ *
+ * @param ch The channel, 1-7.
+ * @param idx The descriptor.
+ * @param n The item.
+ * @return The value.
+ */
+static uint32_t Sim_Value(uint8_t ch, uint16_t idx, uint16_t n) {
+    return (ch * 0x9e3779b1u) ^ (idx * 0x85ebca6bu) ^ (n * 0xc2b2ae35u);
+}
+
+/**
+ * @brief Reads item n of a buffer as the DMA wrote it.
+ *
+ * @param buf The buffer.
+ * @param size The item size in bytes.
+ * @param n The item.
+ * @return The item.
+ */
+static uint32_t Sim_Item(const uint32_t *buf, uint8_t size, uint16_t n) {
+    return size == 1 ? ((const uint8_t *)buf)[n] : size == 2 ? ((const uint16_t *)buf)[n] : buf[n];
+}
+
+/**
+ * @brief Cuts a value to the item size.
+ *
+ * @param v The value.
+ * @param size The item size in bytes.
+ * @return The value as an item.
+ */
+static uint32_t Sim_Trunc(uint32_t v, uint8_t size) { return size == 1 ? v & 0xff : size == 2 ? v & 0xffff : v; }
+
+static void Sim_Submit(uint8_t ch);
+
+/**
+ * @brief Counts the events of a descriptor; the transfer-complete callback must come in submission order and may
+ *        queue the next descriptor.
+ *
+ * @param desc The descriptor.
+ * @param event The event.
+ * @return void
+ */
+static void Sim_Callback(DMA_Desc_TypeDef *desc, uint8_t event) {
+    Sim_Desc_TypeDef *s = desc->arg;
+    uint16_t count = (uint16_t)desc->init.DMA_BufferSize;
+
+    if (event == DMA_EVT_HT) {
+        s->ht++;
+        sim_errors += !desc->half || (desc->init.DMA_M2M == DMA_M2M_Disable && s->moved != count / 2);
+    } else if (event == DMA_EVT_TC) {
+        s->tc++;
+        sim_errors += s->idx != sim_done[s->ch - 1]++ || s->moved != count || s->ht != (desc->half && count > 1);
+        sim_errors += dma_mgr[s->ch - 1].head == desc;  // Already replaced by the next one
+        if (sim_submitted[s->ch - 1] < SIM_DESCS && rand() % 2) {
+            Sim_Submit(s->ch);
+            sim_chained++;
+        }
+    } else {
+        s->te++;
+    }
+}
+
+/**
+ * @brief Sets up and submits the next descriptor of a channel with random settings.
+ *
+ * @param ch The channel, 1-7.
+ * @return void
+ */
+static void Sim_Submit(uint8_t ch) {
+    static const uint32_t prio[] = {DMA_Priority_Low, DMA_Priority_Medium, DMA_Priority_High,
+                                    DMA_Priority_VeryHigh};
+    static const uint32_t psize[] = {DMA_PeripheralDataSize_Byte, DMA_PeripheralDataSize_HalfWord,
+                                     DMA_PeripheralDataSize_Word};
+    static const uint32_t msize[] = {DMA_MemoryDataSize_Byte, DMA_MemoryDataSize_HalfWord, DMA_MemoryDataSize_Word};
+    uint16_t idx = sim_submitted[ch - 1]++;
+    Sim_Desc_TypeDef *s = &sim_desc[ch - 1][idx];
+    DMA_InitTypeDef *init = &s->d.init;
+    uint8_t w = rand() % 3;
+    uint8_t kind = rand() % 8;  // 0: memory-to-memory, 1-3: peripheral to memory, 4-7: memory to peripheral
+    uint16_t n;
+
+    memset(s, 0, sizeof(*s));
+    s->ch = ch;
+    s->idx = idx;
+    init->DMA_BufferSize = 1 + rand() % SIM_ITEMS;
+    init->DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&sim_per[ch - 1];
+    init->DMA_MemoryBaseAddr = (uint32_t)(uintptr_t)sim_mem[ch - 1][idx];
+    init->DMA_DIR = kind >= 4 ? DMA_DIR_PeripheralDST : DMA_DIR_PeripheralSRC;
+    init->DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    init->DMA_MemoryInc = kind == 0 || rand() % 8 ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+    init->DMA_PeripheralDataSize = psize[w];
+    init->DMA_MemoryDataSize = msize[w];
+    init->DMA_Mode = DMA_Mode_Normal;
+    init->DMA_Priority = prio[rand() % 4];
+    init->DMA_M2M = DMA_M2M_Disable;
+    if (kind == 0) {
+        init->DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)sim_src[ch - 1][idx];
+        init->DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+        init->DMA_M2M = DMA_M2M_Enable;
+    }
+    memset(sim_mem[ch - 1][idx], 0, sizeof(sim_mem[0][0]));
+    for (n = 0; n < init->DMA_BufferSize; ++n) {
+        if (kind == 0 && w == 0) {
+            ((uint8_t *)sim_src[ch - 1][idx])[n] = (uint8_t)Sim_Value(ch, idx, n);
+        } else if (kind == 0 && w == 1) {
+            ((uint16_t *)sim_src[ch - 1][idx])[n] = (uint16_t)Sim_Value(ch, idx, n);
+        } else if (kind == 0) {
+            sim_src[ch - 1][idx][n] = Sim_Value(ch, idx, n);
+        } else if (kind >= 4 && w == 0) {
+            ((uint8_t *)sim_mem[ch - 1][idx])[n] = (uint8_t)Sim_Value(ch, idx, n);
+        } else if (kind >= 4 && w == 1) {
+            ((uint16_t *)sim_mem[ch - 1][idx])[n] = (uint16_t)Sim_Value(ch, idx, n);
+        } else if (kind >= 4) {
+            sim_mem[ch - 1][idx][n] = Sim_Value(ch, idx, n);
+        }
+    }
+    s->d.half = rand() % 3 == 0;
+    s->d.cb = Sim_Callback;
+    s->d.arg = s;
+    DMA_Mgr_Submit(ch, &s->d);
+}
+
+/**
+ * @brief Serves one request of a channel and checks the item against its descriptor.
+ *
+ * The running descriptor must have been started with its own settings: CCR holds its widths, priority and
+ * direction, and the half-transfer interrupt is enabled only if it asked for it.
+ *
+ * @param ch The channel, 1-7.
+ * @return void
+ */
+static void Sim_Request(uint8_t ch) {
+    DMA_Channel_TypeDef *regs = DMA_Mgr_Channel(ch);
+    DMA_Desc_TypeDef *d = dma_mgr[ch - 1].head;
+    Sim_Desc_TypeDef *s = d->arg;
+    DMA_InitTypeDef *init = &d->init;
+    uint32_t cfg = init->DMA_DIR | init->DMA_MemoryInc | init->DMA_PeripheralInc | init->DMA_PeripheralDataSize |
+                   init->DMA_MemoryDataSize | init->DMA_Priority | init->DMA_M2M | DMA_IT_TC | DMA_IT_TE;
+    uint32_t v;
+    uint8_t size = 1u << (init->DMA_MemoryDataSize >> 10);
+    uint16_t n = s->moved;
+    uint16_t count = (uint16_t)init->DMA_BufferSize;
+
+    sim_errors += (regs->CCR & 0x7ffeu) != (cfg | (d->half ? DMA_IT_HT : 0));
+    sim_errors += regs->CMAR != init->DMA_MemoryBaseAddr || regs->CPAR != init->DMA_PeripheralBaseAddr;
+    if (init->DMA_M2M == DMA_M2M_Enable) {
+        s->moved = count;  // The whole block at once
+        Host_DMA_Request(regs);
+        for (n = 0; n < count; ++n) {
+            sim_errors += Sim_Item(sim_mem[ch - 1][s->idx], size, n) != Sim_Trunc(Sim_Value(ch, s->idx, n), size);
+        }
+        return;
+    }
+    if (init->DMA_DIR == DMA_DIR_PeripheralSRC) {
+        sim_per[ch - 1] = Sim_Value(ch, s->idx, n);
+    }
+    s->moved++;  // Before the request, whose interrupt may call back
+    Host_DMA_Request(regs);
+    if (init->DMA_DIR == DMA_DIR_PeripheralDST) {
+        n = init->DMA_MemoryInc == DMA_MemoryInc_Enable ? n : 0;  // Without increment item 0 every time
+        sim_errors += Sim_Trunc(sim_per[ch - 1], size) != Sim_Trunc(Sim_Value(ch, s->idx, n), size);
+    } else if (init->DMA_MemoryInc == DMA_MemoryInc_Enable || n == count - 1) {
+        v = Sim_Trunc(Sim_Value(ch, s->idx, n), size);
+        n = init->DMA_MemoryInc == DMA_MemoryInc_Enable ? n : 0;  // Without increment item 0 keeps the last one
+        sim_errors += Sim_Item(sim_mem[ch - 1][s->idx], size, n) != v;
+    }
+}
+
+/**
+ * @brief Channels are claimed once, by number or by the first free one from channel 7, and released.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Alloc(void) {
+    uint8_t ok = 1;
+    uint8_t ch;
+
+    CHECK(DMA_Mgr_Alloc(0, 1, 0) == 0 && DMA_Mgr_Alloc(DMA_MGR_CHANNELS + 1, 1, 0) == 0);
+    CHECK(DMA_Mgr_Channel(0) == NULL && DMA_Mgr_Channel(1) == DMA1_Channel1 && DMA_Mgr_Channel(7) == DMA1_Channel7);
+    for (ch = 1; ch <= DMA_MGR_CHANNELS; ++ch) {
+        ok &= DMA_Mgr_Alloc(ch, 1, 0) == 1 && DMA_Mgr_Alloc(ch, 1, 0) == 0 && !DMA_Mgr_Busy(ch);
+    }
+    CHECK(ok && DMA_Mgr_Alloc_Any(1, 0) == 0);
+    DMA_Mgr_Free(3);
+    DMA_Mgr_Free(5);
+    CHECK(DMA_Mgr_Alloc_Any(1, 0) == 5 && DMA_Mgr_Alloc_Any(1, 0) == 3 && DMA_Mgr_Alloc_Any(1, 0) == 0);
+    for (ch = 1; ch <= DMA_MGR_CHANNELS; ++ch) {
+        DMA_Mgr_Free(ch);
+    }
+    CHECK(DMA_Mgr_Alloc_Any(1, 0) == 7 && DMA_Mgr_Alloc_Any(1, 0) == 6);
+    DMA_Mgr_Free(7);
+    DMA_Mgr_Free(6);
+    DMA_Mgr_Free(0);  // Ignored
+    DMA_Mgr_Submit(8, &sim_desc[0][0].d);
+    CHECK(!DMA_Mgr_Busy(0) && !DMA_Mgr_Busy(8));
+}
+
+/**
+ * @brief Runs queues on all seven channels at once, the controller serving random channels.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Queues(void) {
+    uint32_t done = 0;
+    uint32_t requests = 0;
+    uint32_t ht = 0;
+    uint8_t ch;
+    uint16_t i;
+
+    sim_errors = 0;
+    for (ch = 1; ch <= DMA_MGR_CHANNELS; ++ch) {
+        CHECK(DMA_Mgr_Alloc(ch, 1, 0));
+        sim_submitted[ch - 1] = 0;
+        sim_done[ch - 1] = 0;
+        Sim_Submit(ch);
+    }
+    while (done < DMA_MGR_CHANNELS * SIM_DESCS) {
+        ch = 1 + rand() % DMA_MGR_CHANNELS;
+        if (DMA_Mgr_Busy(ch)) {
+            Sim_Request(ch);
+            requests++;
+        }
+        if (rand() % 16 == 0 && sim_submitted[ch - 1] < SIM_DESCS) {
+            Sim_Submit(ch);  // From the thread, with the channel busy or idle
+        }
+        for (done = 0, ch = 1; ch <= DMA_MGR_CHANNELS; ++ch) {
+            done += sim_done[ch - 1];
+        }
+    }
+    CHECK(sim_errors == 0);
+    for (done = 0, ch = 1; ch <= DMA_MGR_CHANNELS; ++ch) {
+        for (i = 0; i < SIM_DESCS; ++i) {
+            done += sim_desc[ch - 1][i].tc == 1 && sim_desc[ch - 1][i].te == 0;
+            ht += sim_desc[ch - 1][i].ht;
+        }
+        CHECK(!DMA_Mgr_Busy(ch) && !(DMA_Mgr_Channel(ch)->CCR & DMA_CCR1_EN));
+        DMA_Mgr_Free(ch);
+    }
+    CHECK(done == DMA_MGR_CHANNELS * SIM_DESCS);
+    CHECK(ht > 0 && sim_chained > 0 && sim_chained < done);
+    printf("queues: %u descriptors on 7 channels, %u requests, %u chained from a callback, %u half events\n", done,
+           requests, sim_chained, ht);
+}
+
+/**
+ * @brief Only counts the events of a descriptor.
+ *
+ * @param desc The descriptor.
+ * @param event The event.
+ * @return void
+ */
+static void Sim_Count(DMA_Desc_TypeDef *desc, uint8_t event) {
+    Sim_Desc_TypeDef *s = desc->arg;
+
+    s->ht += event == DMA_EVT_HT;
+    s->tc += event == DMA_EVT_TC;
+    s->te += event == DMA_EVT_TE;
+}
+
+/**
+ * @brief Sets up a byte transfer from the channel's peripheral into a buffer of the run, counted by Sim_Count().
+ *
+ * @param s The descriptor.
+ * @param ch The channel, 1-7.
+ * @param count The number of bytes.
+ * @param mode DMA_Mode_Normal or DMA_Mode_Circular.
+ * @param half 1 for half-transfer events.
+ * @return void
+ */
+static void Sim_Setup(Sim_Desc_TypeDef *s, uint8_t ch, uint16_t count, uint32_t mode, uint8_t half) {
+    memset(s, 0, sizeof(*s));
+    s->ch = ch;
+    s->idx = (uint16_t)(s - sim_desc[ch - 1]);
+    s->d.init.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&sim_per[ch - 1];
+    s->d.init.DMA_MemoryBaseAddr = (uint32_t)(uintptr_t)sim_mem[ch - 1][s->idx];
+    s->d.init.DMA_DIR = DMA_DIR_PeripheralSRC;
+    s->d.init.DMA_BufferSize = count;
+    s->d.init.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    s->d.init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    s->d.init.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    s->d.init.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    s->d.init.DMA_Mode = mode;
+    s->d.init.DMA_Priority = DMA_Priority_Medium;
+    s->d.init.DMA_M2M = DMA_M2M_Disable;
+    s->d.half = half;
+    s->d.cb = Sim_Count;
+    s->d.arg = s;
+}
+
+/**
+ * @brief A circular descriptor calls back at every half and end of cycle and never completes; the one queued
+ *        behind it waits, and releasing the channel stops it without callbacks.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Circular(void) {
+    Sim_Desc_TypeDef *c = &sim_desc[1][0];
+    Sim_Desc_TypeDef *n = &sim_desc[1][1];
+    uint16_t i;
+
+    CHECK(DMA_Mgr_Alloc(2, 1, 0));
+    Sim_Setup(c, 2, 8, DMA_Mode_Circular, 1);
+    Sim_Setup(n, 2, 8, DMA_Mode_Normal, 0);
+    DMA_Mgr_Submit(2, &c->d);
+    DMA_Mgr_Submit(2, &n->d);
+    for (i = 0; i < 5 * 8; ++i) {
+        sim_per[1] = i;
+        Host_DMA_Request(DMA1_Channel2);
+    }
+    CHECK(c->ht == 5 && c->tc == 5 && n->ht == 0 && n->tc == 0);
+    CHECK(((uint8_t *)sim_mem[1][0])[0] == 32 && ((uint8_t *)sim_mem[1][0])[7] == 39);  // The last cycle
+    CHECK(dma_mgr[1].head == &c->d && DMA_Mgr_Busy(2) && DMA1_Channel2->CNDTR == 8);
+    DMA_Mgr_Free(2);
+    CHECK(!DMA_Mgr_Busy(2) && !(DMA1_Channel2->CCR & DMA_CCR1_EN) && Host_DMA_Request(DMA1_Channel2) == 0);
+    CHECK(c->tc == 5 && n->tc == 0 && DMA_Mgr_Alloc(2, 1, 0));
+    DMA_Mgr_Free(2);
+}
+
+/**
+ * @brief A transfer error drops the running descriptor with DMA_EVT_TE and starts the next one.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Error(void) {
+    Sim_Desc_TypeDef *a = &sim_desc[3][0];
+    Sim_Desc_TypeDef *b = &sim_desc[3][1];
+    uint8_t i;
+
+    CHECK(DMA_Mgr_Alloc(4, 1, 0));
+    Sim_Setup(a, 4, 10, DMA_Mode_Normal, 1);
+    Sim_Setup(b, 4, 6, DMA_Mode_Normal, 0);
+    DMA_Mgr_Submit(4, &a->d);
+    DMA_Mgr_Submit(4, &b->d);
+    for (i = 0; i < 3; ++i) {
+        Host_DMA_Request(DMA1_Channel4);
+    }
+    DMA1->ISR |= (DMA_ISR_TEIF1 | DMA_ISR_GIF1) << 12;  // A bus error, the controller disables the channel
+    DMA1_Channel4->CCR &= ~DMA_CCR1_EN;
+    DMA1->IFCR = 0;
+    DMA1_Channel4_IRQHandler();
+    DMA1->ISR &= ~DMA1->IFCR;  // The flags the handler cleared
+    CHECK(a->te == 1 && a->tc == 0 && a->ht == 0 && !(DMA1->ISR & (0xfu << 12)));
+    CHECK(dma_mgr[3].head == &b->d && DMA1_Channel4->CNDTR == 6 && (DMA1_Channel4->CCR & DMA_CCR1_EN));
+    CHECK(DMA1_Channel4->CMAR == b->d.init.DMA_MemoryBaseAddr && !(DMA1_Channel4->CCR & DMA_IT_HT));
+    for (i = 0; i < 6; ++i) {
+        Host_DMA_Request(DMA1_Channel4);
+    }
+    CHECK(b->tc == 1 && b->ht == 0 && a->te == 1 && !DMA_Mgr_Busy(4));
+    DMA_Mgr_Free(4);
+}
+
+int main(void) {
+    srand(11);
+    Test_Alloc();
+    Test_Queues();
+    Test_Circular();
+    Test_Error();
+    return TEST_EXIT("test_dma_mgr");
+}
@@ -0,0 +1,260 @@
+/**
+ * @file test_dwt.c
+ * @brief Host test of the DWT delays, the nanosecond conversion and the region profiling statistics.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The cycle counter is a fake that advances a fixed number of cycles on every read, as the two loads and the
+ * compare of a read take on the core, and that the test moves forward to stand for the code between reads.
+ *
+ * DWT_Init() must clear and start the counter only the first time and measure the cost of a read. The nanosecond
+ * conversion must round up to whole cycles at every core clock, exactly for waits up to 2^24 ns and within one
+ * cycle beyond. The delays must end on the first read at or past the target, also across the 32-bit wrap of the
+ * counter. The profiled regions must report count, minimum, maximum and mean with the read cost removed, link
+ * into the dump table once, keep PRIMASK as it was, and DWT_Prof_Dump() must print exactly those numbers.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_dwt
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t Sim_Cycles(void);
+static int Sim_Printf(const char *format, ...);
+
+#define DWT_PROFILE
+#define DWT_CYCCNT() Sim_Cycles()  // dwt.h reads this counter instead of DWT->CYCCNT
+#define printf Sim_Printf          // DWT_Prof_Dump() prints into sim_out
+
+#include "dwt.c"
+
+#undef printf
+
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+
+#define SIM_READ 3  // Cycles taken by one counter read
+
+static uint32_t sim_cycles;  // The fake cycle counter
+static char sim_out[4096];  // What DWT_Prof_Dump() printed
+static size_t sim_out_len;
+
+/**
+ * @brief The fake cycle counter: returns the count, then charges the read to it.
+ *
+ * @param void
+ * @return The count before the read.
+ */
+static uint32_t Sim_Cycles(void) {
+    uint32_t c = sim_cycles;
+
+    sim_cycles += SIM_READ;
+    return c;
+}
+
+/**
+ * @brief Appends to sim_out what printf would send over USART1.
+ *
+ * @param format The printf format.
+ * @return The number of characters.
+ */
+static int Sim_Printf(const char *format, ...) {
+    va_list ap;
+    int n;
+
+    va_start(ap, format);
+    n = vsnprintf(sim_out + sim_out_len, sizeof(sim_out) - sim_out_len, format, ap);
+    va_end(ap);
+    if (n > 0) {
+        sim_out_len += (size_t)n;
+    }
+    return n;
+}
+
+/**
+ * @brief A profiled region that takes len cycles between its two counter reads.
+ *
+ * @param len The cycles of the region body.
+ * @return void
+ */
+static void Sim_Region_A(uint32_t len) {
+    DWT_PROF_BEGIN(region_a);
+    sim_cycles += len;
+    DWT_PROF_END(region_a);
+}
+
+/**
+ * @brief A second profiled region, recorded with interrupts masked as in a handler.
+ *
+ * @param len The cycles of the region body.
+ * @return void
+ */
+static void Sim_Region_B(uint32_t len) {
+    DWT_PROF_BEGIN(region_b);
+    sim_cycles += len;
+    DWT_PROF_END(region_b);
+}
+
+/**
+ * @brief DWT_Init() enables the counter once, leaves a running counter alone and measures the read cost.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Init(void) {
+    DWT->CTRL = 0;
+    DWT->CYCCNT = 1234;
+    CHECK(DWT_Init() == 1);
+    CHECK(DWT->CYCCNT == 0 && (DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk));
+    CHECK(CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk);
+    CHECK(dwt_overhead == SIM_READ && dwt_hclk == host_clocks.HCLK_Frequency);
+
+    DWT->CYCCNT = 5555;  // Another module's timestamps are running
+    CHECK(DWT_Init() == 1 && DWT->CYCCNT == 5555);
+}
+
+/**
+ * @brief DWT_Ns_To_Cycles() against the exact ceiling at every core clock the tree supports.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Ns_To_Cycles(void) {
+    static const uint32_t hclk[] = {8000000, 16000000, 24000000, 36000000, 48000000, 56000000, 64000000, 72000000};
+    uint32_t k;
+    uint32_t i;
+    uint32_t ns;
+    uint32_t c;
+    uint64_t exact;
+    uint32_t wrong = 0;
+    uint32_t far = 0;
+
+    for (k = 0; k < sizeof(hclk) / sizeof(hclk[0]); ++k) {
+        host_clocks.HCLK_Frequency = hclk[k];
+        DWT_Init();
+        for (i = 0; i < 200000; ++i) {
+            ns = i < 100000 ? i : (uint32_t)rand() * 2u + (uint32_t)(rand() & 1);  // All small, then random
+            c = DWT_Ns_To_Cycles(ns);
+            exact = ((uint64_t)ns * hclk[k] + 999999999u) / 1000000000u;
+            if (ns < (1u << 24)) {
+                wrong += c != exact;
+            } else {
+                far += c > exact || c + 1 < exact;
+            }
+        }
+        CHECK(DWT_Ns_To_Cycles(0xffffffff) + 1 >= (uint64_t)0xffffffff * hclk[k] / 1000000000u);
+    }
+    CHECK(wrong == 0);
+    CHECK(far == 0);
+    host_clocks.HCLK_Frequency = 72000000;
+    DWT_Init();
+}
+
+/**
+ * @brief The delays end on the first read at or past the target, across the counter wrap too.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Delay(void) {
+    static const uint32_t start[] = {0, 1000, 0xffffff00u, 0xfffffffeu};
+    static const uint32_t cycles[] = {0, 1, 2, 3, 4, 100, 255, 256, 1000, 123457, 10000000};
+    uint32_t s;
+    uint32_t i;
+    uint32_t t;
+    uint32_t wrong = 0;
+
+    for (s = 0; s < sizeof(start) / sizeof(start[0]); ++s) {
+        for (i = 0; i < sizeof(cycles) / sizeof(cycles[0]); ++i) {
+            sim_cycles = start[s];
+            DWT_Delay_Cycles(cycles[i]);
+            t = sim_cycles - start[s];  // Includes the read that ended the wait
+            wrong += t < cycles[i] + SIM_READ || t > cycles[i] + 2 * SIM_READ;
+        }
+    }
+    CHECK(wrong == 0);
+
+    sim_cycles = 0xfffff000u;
+    DWT_Delay_Us(1000);
+    CHECK(sim_cycles - 0xfffff000u >= 72000 + SIM_READ && sim_cycles - 0xfffff000u < 72000 + 3 * SIM_READ);
+    sim_cycles = 0;
+    DWT_Delay_Ns(1001);  // 72.072 cycles: 73
+    CHECK(sim_cycles >= 73 + SIM_READ && sim_cycles < 73 + 3 * SIM_READ);
+}
+
+/**
+ * @brief Region statistics: count, min, max, mean without the read cost, one link, reset, PRIMASK and the dump.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Prof(void) {
+    uint32_t i;
+    uint32_t len;
+    uint32_t count = 0;
+    uint32_t min = 0xffffffff;
+    uint32_t max = 0;
+    uint64_t total = 0;
+    char line[128];
+    DWT_Prof_TypeDef *p;
+    uint32_t linked = 0;
+    uint32_t masked = 0;
+
+    DWT_Init();
+    for (i = 0; i < 5000; ++i) {
+        len = i % 97 == 0 ? (uint32_t)rand() % 1000000 : 50 + (uint32_t)rand() % 200;
+        Sim_Region_A(len);
+        count++;
+        total += len;
+        min = len < min ? len : min;
+        max = len > max ? len : max;
+        if (i % 10 == 0) {
+            __disable_irq();
+            Sim_Region_B(i);
+            masked += __get_PRIMASK();
+            __enable_irq();
+        }
+    }
+    Sim_Region_A(0);  // A region as short as the two reads records 0, never a wrapped count
+    count++;
+    min = 0;
+    CHECK(masked == 500 && __get_PRIMASK() == 0);
+
+    for (p = dwt_prof_list; p; p = p->next) {
+        linked++;
+        if (strcmp(p->name, "region_a") == 0) {
+            CHECK(p->count == count && p->min == min && p->max == max && p->total == total);
+        } else if (strcmp(p->name, "region_b") == 0) {
+            CHECK(p->count == 500 && p->min == 0 && p->max == 4990 && p->total == 500ull * 4990 / 2);
+        }
+    }
+    CHECK(linked == 2);
+
+    sim_out_len = 0;
+    DWT_Prof_Dump();
+    snprintf(line, sizeof(line), "%-20s %10lu %10lu %10lu %10lu\r\n", "region_a", (unsigned long)count,
+             (unsigned long)min, (unsigned long)(total / count), (unsigned long)max);
+    CHECK(strstr(sim_out, line) != NULL);
+    CHECK(strstr(sim_out, "(cycles at 72 MHz)") != NULL);
+
+    DWT_Prof_Reset();
+    Sim_Region_B(7);
+    sim_out_len = 0;
+    DWT_Prof_Dump();
+    snprintf(line, sizeof(line), "%-20s %10lu %10lu %10lu %10lu\r\n", "region_b", 1ul, 7ul, 7ul, 7ul);
+    CHECK(strstr(sim_out, line) != NULL && strstr(sim_out, "region_a") == NULL);  // Reset regions are skipped
+}
+
+int main(void) {
+    srand(13);
+    Test_Init();
+    Test_Ns_To_Cycles();
+    Test_Delay();
+    Test_Prof();
+    return TEST_EXIT("test_dwt");
+}
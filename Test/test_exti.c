@@ -0,0 +1,526 @@
+/**
+ * @file test_exti.c
+ * @brief Host test of the EXTI dispatcher: interrupt path length, event ordering and deferred debouncing.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The cycle counter is a fake that the test moves forward between edges and that charges one cycle per read, so
+ * every read is counted. An edge sets the pin, raises the pending bit when the line's trigger and mask allow it,
+ * and runs the line's vector; PR is write-1-to-clear, which the test applies after the handler from what it wrote.
+ * The PRIMASK intrinsics count the critical sections and can run a higher-priority vector where one would preempt.
+ *
+ * Registration must check its arguments, start the cycle counter, program both edges for debounced lines and
+ * clamp long debounce times.
+ * Each of the seven vectors must acknowledge exactly its own pending lines, read the counter once, take one short
+ * critical section per line, restore PRIMASK, and neither call back nor delay; its time per edge on the host is
+ * printed. Edges on lines without debouncing must come back in the order they were queued, each with its own
+ * timestamp, also when a vector preempts another. A bouncing line must give one callback with the settled level
+ * and the last edge's timestamp, only once quiet for its debounce time and only for the wanted edge. A full queue
+ * must keep the oldest edges and count the rest, an unregistered line must drop what it had queued, and
+ * My_EXTI_Init() must drive the LEDs from the four keys.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_exti
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t Sim_Cycles(void);
+
+#define DWT_CYCCNT() Sim_Cycles()  // dwt.h reads this counter instead of DWT->CYCCNT
+
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LEDs of External_Interupt-EXIT/exti.c
+static uint8_t led3;
+
+#include "exti.c"
+#include "dwt.c"
+
+#define SIM_MS 72000u              // Cycles per millisecond at 72 MHz
+#define SIM_LOG 65536              // Callbacks kept
+#define SIM_UNWRITTEN 0x80000000u  // Bit of PR no line uses, cleared when a handler writes PR
+
+/**
+ * @brief One callback as the dispatcher made it.
+ */
+typedef struct {
+    uint8_t line;
+    uint8_t level;
+    uint32_t stamp;
+} Sim_Call;
+
+static uint32_t sim_cycles;        // The fake cycle counter
+static uint32_t sim_reads;         // Counter reads
+static uint32_t sim_primask;       // PRIMASK as the intrinsics keep it
+static uint32_t sim_masks;         // Critical sections entered
+static uint32_t sim_delays;        // delay_ms() calls
+static void (*sim_preempt)(void);  // Vector to run at the next PRIMASK read, as a preempting interrupt
+static Sim_Call sim_log[SIM_LOG];
+static uint32_t sim_calls;
+
+void delay_ms(u16 nms) { sim_delays++; }
+
+/**
+ * @brief The fake cycle counter: returns the count, then charges the read to it.
+ *
+ * @param void
+ * @return The count before the read.
+ */
+static uint32_t Sim_Cycles(void) {
+    sim_reads++;
+    return sim_cycles++;
+}
+
+/**
+ * @brief Reads PRIMASK; a pending preemption runs here, before the handler masks interrupts.
+ *
+ * @param void
+ * @return PRIMASK.
+ */
+uint32_t __get_PRIMASK(void) {
+    void (*vector)(void) = sim_preempt;
+
+    if (vector && !sim_primask) {
+        sim_preempt = 0;
+        vector();
+    }
+    return sim_primask;
+}
+
+void __set_PRIMASK(uint32_t primask) { sim_primask = primask & 1; }
+
+void __disable_irq(void) {
+    sim_masks++;
+    sim_primask = 1;
+}
+
+/**
+ * @brief Records a callback.
+ *
+ * @param line The EXTI line.
+ * @param level The settled level.
+ * @param stamp The timestamp of the edge.
+ * @return void
+ */
+static void Sim_Callback(uint8_t line, uint8_t level, uint32_t stamp) {
+    if (sim_calls < SIM_LOG) {
+        sim_log[sim_calls].line = line;
+        sim_log[sim_calls].level = level;
+        sim_log[sim_calls].stamp = stamp;
+    }
+    sim_calls++;
+}
+
+/**
+ * @brief Returns the interrupt handler of an EXTI line.
+ *
+ * @param line The EXTI line, 0-15.
+ * @return The handler.
+ */
+static void (*Sim_Vector(uint8_t line))(void) {
+    static void (*const vector[5])(void) = {EXTI0_IRQHandler, EXTI1_IRQHandler, EXTI2_IRQHandler, EXTI3_IRQHandler,
+                                            EXTI4_IRQHandler};
+
+    if (line <= 4) {
+        return vector[line];
+    }
+    return line <= 9 ? EXTI9_5_IRQHandler : EXTI15_10_IRQHandler;
+}
+
+/**
+ * @brief Returns the lines that share the vector of a line.
+ *
+ * @param line The EXTI line, 0-15.
+ * @return The lines of the vector.
+ */
+static uint32_t Sim_Vector_Lines(uint8_t line) {
+    if (line <= 4) {
+        return 1u << line;
+    }
+    return line <= 9 ? 0x03e0u : 0xfc00u;
+}
+
+/**
+ * @brief Runs the vector of a line and applies its write to PR as write-1-to-clear.
+ *
+ * @param line A line of the vector.
+ * @return The bits the handler wrote to PR, 0 if it did not write.
+ */
+static uint32_t Sim_Run(uint8_t line) {
+    uint32_t pending = EXTI->PR;
+    uint32_t written;
+
+    EXTI->PR = pending | SIM_UNWRITTEN;
+    Sim_Vector(line)();
+    written = EXTI->PR & SIM_UNWRITTEN ? 0 : EXTI->PR;
+    EXTI->PR = pending & ~written;
+    return written;
+}
+
+/**
+ * @brief Changes the level of a pin and raises its pending bit if the line's trigger and mask allow it.
+ *
+ * @param port The port of the pin.
+ * @param line The pin and EXTI line.
+ * @param level The new level.
+ * @return 1 if the line is pending.
+ */
+static uint8_t Sim_Pin(GPIO_TypeDef *port, uint8_t line, uint8_t level) {
+    uint32_t bit = 1u << line;
+    uint8_t old = (port->IDR & bit) != 0;
+
+    port->IDR = level ? port->IDR | bit : port->IDR & ~bit;
+    if (old != level && (EXTI->IMR & bit) && ((level ? EXTI->RTSR : EXTI->FTSR) & bit)) {
+        EXTI->PR |= bit;
+    }
+    return (EXTI->PR & bit) != 0;
+}
+
+/**
+ * @brief An edge on a pin, served at once by the line's vector.
+ *
+ * @param port The port of the pin.
+ * @param line The pin and EXTI line.
+ * @param level The new level.
+ * @return void
+ */
+static void Sim_Edge(GPIO_TypeDef *port, uint8_t line, uint8_t level) {
+    if (Sim_Pin(port, line, level)) {
+        Sim_Run(line);
+    }
+}
+
+/**
+ * @brief Unregisters every line and empties the queue and the logs.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Reset(void) {
+    uint8_t line;
+
+    for (line = 0; line < EXTI_LINES; ++line) {
+        EXTI_Line_Unregister(line);
+    }
+    EXTI_Process();
+    exti_settling = 0;
+    exti_queue_dropped = 0;
+    EXTI->PR = 0;
+    sim_calls = 0;
+}
+
+/**
+ * @brief Registration checks its arguments, programs the hardware triggers and clamps long debounce times.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Register(void) {
+    Sim_Reset();
+    CHECK(!EXTI_Line_Register(7, 0, EXTI_Trigger_Rising, 0, Sim_Callback, 2, 0));
+    CHECK(!EXTI_Line_Register(GPIO_PortSourceGPIOA, EXTI_LINES, EXTI_Trigger_Rising, 0, Sim_Callback, 2, 0));
+    CHECK(!EXTI_Line_Register(GPIO_PortSourceGPIOA, 0, EXTI_Trigger_Rising, 0, 0, 2, 0));
+    CHECK(EXTI->IMR == 0 && !(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk));
+
+    CHECK(EXTI_Line_Register(GPIO_PortSourceGPIOB, 6, EXTI_Trigger_Falling, 0, Sim_Callback, 2, 0));
+    CHECK((EXTI->IMR & 0x40) && !(EXTI->RTSR & 0x40) && (EXTI->FTSR & 0x40));
+    CHECK(EXTI_Line_Register(GPIO_PortSourceGPIOB, 13, EXTI_Trigger_Rising, 20, Sim_Callback, 2, 0));
+    CHECK((EXTI->IMR & 0x2000) && (EXTI->RTSR & 0x2000) && (EXTI->FTSR & 0x2000));  // Bounces need both edges
+    CHECK(exti_lines[13].debounce == 20 * SIM_MS && exti_lines[13].port == GPIOB);
+    CHECK(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk);  // Started by the registration, not left to the caller
+    CHECK(EXTI_Line_Register(GPIO_PortSourceGPIOG, 15, EXTI_Trigger_Rising, 65535, Sim_Callback, 2, 0));
+    CHECK(exti_lines[15].debounce == 0x7fffffffu);  // 65.5 s is past the counter's half period
+    EXTI_Line_Unregister(6);
+    CHECK(!(EXTI->IMR & 0x40) && !exti_lines[6].cb);
+}
+
+/**
+ * @brief Every vector acknowledges only its own lines, reads the counter once, masks interrupts once per line and
+ *        for no longer, and neither calls back nor delays; the time per edge on the host is printed.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_ISR_Path(void) {
+    struct timespec t0;
+    struct timespec t1;
+    uint32_t wrong = 0;
+    uint32_t reads;
+    uint32_t masks;
+    uint32_t lines;
+    uint32_t written;
+    uint32_t i;
+    double ns;
+    uint8_t line;
+
+    Sim_Reset();
+    for (line = 0; line < EXTI_LINES; ++line) {
+        EXTI_Line_Register(line % 7, line, EXTI_Trigger_Rising_Falling, line & 1 ? 10 : 0, Sim_Callback, 2, 0);
+    }
+    for (line = 0; line < EXTI_LINES; ++line) {
+        lines = Sim_Vector_Lines(line);
+        reads = sim_reads;
+        masks = sim_masks;
+        EXTI->PR = 0xffff;  // Every line pending, those of the other vectors must stay so
+        written = Sim_Run(line);
+        wrong += written != lines || EXTI->PR != (0xffffu & ~lines);
+        wrong += sim_reads - reads != 1 || sim_masks - masks != (uint32_t)__builtin_popcount(lines);
+        wrong += sim_primask != 0 || sim_calls != 0 || sim_delays != 0;
+        EXTI_Process();  // Lines without debouncing call back now, the others once quiet
+        wrong += sim_calls != (uint32_t)__builtin_popcount(lines & 0x5555);
+        for (i = 0; i < sim_calls; ++i) {
+            wrong += !(lines & (1u << sim_log[i].line)) || sim_log[i].stamp != sim_cycles - 2;
+        }
+        sim_calls = 0;
+        sim_cycles += 20 * SIM_MS;
+        EXTI_Process();
+        sim_calls = 0;
+    }
+    CHECK(wrong == 0);
+
+    sim_primask = 1;  // A handler must leave PRIMASK as it found it
+    EXTI->PR = 1;
+    Sim_Run(0);
+    CHECK(sim_primask == 1);
+    sim_primask = 0;
+
+    EXTI_Line_Register(GPIO_PortSourceGPIOA, 0, EXTI_Trigger_Rising, 0, Sim_Callback, 2, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < 1000000; ++i) {
+        EXTI->PR = 1;
+        EXTI0_IRQHandler();
+        exti_queue_tail = exti_queue_head;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e6;
+    printf("ISR path: %.1f ns per edge on the host\n", ns);
+    CHECK(ns < 1000 && sim_calls == 0 && EXTI_Dropped() == 0);
+}
+
+/**
+ * @brief Random edges on lines without debouncing across all vectors, taken at random intervals, come back in the
+ *        order they were queued with their own timestamps.
+ *
+ * @param edges The number of edges.
+ * @return void
+ */
+static void Test_Order(uint32_t edges) {
+    static uint8_t line_of[SIM_LOG];
+    static uint32_t stamp_of[SIM_LOG];
+    uint32_t queued = 0;
+    uint32_t wrong = 0;
+    uint32_t i;
+    uint8_t line;
+
+    Sim_Reset();
+    for (line = 0; line < EXTI_LINES; ++line) {
+        EXTI_Line_Register(GPIO_PortSourceGPIOC, line, EXTI_Trigger_Rising_Falling, 0, Sim_Callback, 2, 0);
+    }
+    while (queued < edges) {
+        line = (uint8_t)(rand() % EXTI_LINES);
+        sim_cycles += 1 + rand() % 500;
+        line_of[queued] = line;
+        stamp_of[queued] = sim_cycles;
+        queued++;
+        Sim_Edge(GPIOC, line, !(GPIOC->IDR & (1u << line)));
+        if (rand() % 16 == 0 || (uint8_t)(exti_queue_head - exti_queue_tail) == EXTI_QUEUE_SIZE) {
+            EXTI_Process();
+        }
+    }
+    EXTI_Process();
+    CHECK(sim_calls == edges && EXTI_Dropped() == 0);
+    for (i = 0; i < sim_calls && i < edges; ++i) {
+        wrong += sim_log[i].line != line_of[i] || sim_log[i].stamp != stamp_of[i];
+    }
+    CHECK(wrong == 0);
+}
+
+/**
+ * @brief Runs EXTI0 on top of a vector, as when line 0 fires while that vector claims its queue slot.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Preempt_EXTI0(void) {
+    uint32_t outer = EXTI->PR;  // What the preempted vector wrote, its lines are clear by now
+
+    sim_cycles += 100;
+    EXTI->PR = 1;
+    Sim_Run(0);
+    EXTI->PR = outer;
+}
+
+/**
+ * @brief A vector preempted while it queues keeps every edge and the queue stays consistent.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Preempt(void) {
+    uint8_t line;
+
+    Sim_Reset();
+    for (line = 0; line < EXTI_LINES; ++line) {
+        EXTI_Line_Register(GPIO_PortSourceGPIOD, line, EXTI_Trigger_Rising_Falling, 0, Sim_Callback, 2, 0);
+    }
+    sim_cycles += SIM_MS;
+    EXTI->PR = (1u << 5) | (1u << 7);
+    sim_preempt = Sim_Preempt_EXTI0;
+    Sim_Run(5);
+    CHECK(!sim_preempt && EXTI->PR == 0 && sim_primask == 0);
+    EXTI_Process();
+    CHECK(sim_calls == 3 && EXTI_Dropped() == 0);
+    CHECK(sim_log[0].line == 0 && sim_log[0].stamp > sim_log[1].stamp);  // Queued first, stamped later
+    CHECK(sim_log[1].stamp == sim_log[2].stamp && (1u << sim_log[1].line | 1u << sim_log[2].line) == 0xa0);
+
+    sim_calls = 0;
+    Sim_Edge(GPIOD, 9, 1);
+    EXTI_Process();
+    CHECK(sim_calls == 1 && sim_log[0].line == 9 && exti_queue_head == exti_queue_tail);
+}
+
+/**
+ * @brief A bouncing line calls back once with the settled level and the last edge's timestamp, once quiet for
+ *        its debounce time, and only for the wanted edge; a glitch that comes back gives nothing.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Debounce(void) {
+    uint32_t last = 0;
+    uint32_t early = 0;
+    uint8_t level = 1;
+    uint8_t i;
+
+    Sim_Reset();
+    GPIOE->IDR |= 1u << 11;  // Idle high
+    EXTI_Line_Register(GPIO_PortSourceGPIOE, 11, EXTI_Trigger_Falling, 10, Sim_Callback, 2, 0);
+
+    for (i = 0; i < 41; ++i) {  // Press: 41 edges over about 4 ms, ending low
+        sim_cycles += 1 + rand() % (SIM_MS / 5);
+        level = !level;
+        last = sim_cycles;
+        Sim_Edge(GPIOE, 11, level);
+        EXTI_Process();
+        early += sim_calls;
+    }
+    sim_cycles = last + 10 * SIM_MS - 10;
+    EXTI_Process();
+    early += sim_calls;
+    CHECK(early == 0 && sim_delays == 0);
+    sim_cycles = last + 10 * SIM_MS;
+    EXTI_Process();
+    CHECK(sim_calls == 1 && sim_log[0].line == 11 && sim_log[0].level == 0 && sim_log[0].stamp == last);
+
+    for (i = 0; i < 9; ++i) {  // Release: settles high, which the falling trigger does not want
+        sim_cycles += SIM_MS / 10;
+        Sim_Edge(GPIOE, 11, !(i & 1));
+    }
+    sim_cycles += 20 * SIM_MS;
+    EXTI_Process();
+    CHECK(sim_calls == 1 && exti_lines[11].level == 1);
+
+    Sim_Edge(GPIOE, 11, 0);  // Glitch that comes back before the debounce time
+    sim_cycles += SIM_MS;
+    Sim_Edge(GPIOE, 11, 1);
+    sim_cycles += 20 * SIM_MS;
+    EXTI_Process();
+    CHECK(sim_calls == 1);
+
+    Sim_Edge(GPIOE, 11, 0);
+    last = sim_cycles - 1;
+    sim_cycles += 20 * SIM_MS;
+    EXTI_Process();
+    CHECK(sim_calls == 2 && sim_log[1].level == 0 && sim_log[1].stamp == last);
+}
+
+/**
+ * @brief A full queue keeps the oldest edges and counts the rest; an unregistered line drops what it queued.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Overflow(void) {
+    uint32_t wrong = 0;
+    uint32_t first;
+    uint8_t i;
+
+    Sim_Reset();
+    EXTI_Line_Register(GPIO_PortSourceGPIOA, 1, EXTI_Trigger_Rising_Falling, 0, Sim_Callback, 2, 0);
+    first = sim_cycles;
+    for (i = 0; i < EXTI_QUEUE_SIZE + 8; ++i) {
+        Sim_Edge(GPIOA, 1, !(GPIOA->IDR & 2));
+    }
+    CHECK(EXTI_Dropped() == 8);
+    EXTI_Process();
+    CHECK(sim_calls == EXTI_QUEUE_SIZE);
+    for (i = 0; i < EXTI_QUEUE_SIZE; ++i) {
+        wrong += sim_log[i].stamp != first + i;
+    }
+    CHECK(wrong == 0);
+
+    sim_calls = 0;
+    EXTI_Line_Register(GPIO_PortSourceGPIOA, 8, EXTI_Trigger_Rising_Falling, 0, Sim_Callback, 2, 0);
+    Sim_Edge(GPIOA, 8, 1);
+    Sim_Edge(GPIOA, 1, !(GPIOA->IDR & 2));
+    EXTI->PR |= 1u << 8;  // Raised again before the line goes away
+    EXTI_Line_Unregister(8);
+    CHECK(!(EXTI->IMR & (1u << 8)) && EXTI->PR == 1u << 8);  // Written to clear the line only
+    EXTI->PR = 0;
+    Sim_Edge(GPIOA, 8, 0);
+    EXTI_Process();
+    CHECK(sim_calls == 1 && sim_log[0].line == 1);
+}
+
+/**
+ * @brief My_EXTI_Init() registers the four keys and drives the LEDs from the callbacks after 10 ms.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Keys(void) {
+    Sim_Reset();
+    GPIOE->IDR |= 0x1c;  // K_LEFT, K_DOWN and K_RIGHT idle high, K_UP idle low
+    GPIOA->IDR &= ~1u;
+    My_EXTI_Init();
+    led2 = 1;
+    led3 = 1;
+
+    Sim_Edge(GPIOA, 0, 1);
+    sim_cycles += 5 * SIM_MS;
+    EXTI_Process();
+    CHECK(led2 == 1);
+    sim_cycles += 5 * SIM_MS;
+    EXTI_Process();
+    CHECK(led2 == 0);
+
+    Sim_Edge(GPIOE, 4, 0);  // K_RIGHT
+    Sim_Edge(GPIOE, 3, 0);  // K_DOWN
+    sim_cycles += 10 * SIM_MS;
+    EXTI_Process();
+    CHECK(led2 == 1 && led3 == 0);
+    Sim_Edge(GPIOE, 2, 0);  // K_LEFT
+    sim_cycles += 10 * SIM_MS;
+    EXTI_Process();
+    CHECK(led3 == 1 && sim_delays == 0);
+}
+
+int main(void) {
+    srand(20);
+    Test_Register();
+    Test_ISR_Path();
+    Test_Order(SIM_LOG);
+    Test_Preempt();
+    Test_Debounce();
+    Test_Overflow();
+    Test_Keys();
+    return TEST_EXIT("test_exti");
+}
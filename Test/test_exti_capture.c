@@ -0,0 +1,483 @@
+/**
+ * @file test_exti_capture.c
+ * @brief Host test of the EXTI edge capture on simulated pulse trains at high edge rates.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Time runs in core cycles at 72 MHz and the cycle counter starts close to its wrap. Pins change at the edge
+ * times of the pulse trains; an edge the line's trigger wants raises the pending bit, and one that comes while
+ * the bit is still set merges into it, as the hardware does. A pending vector enters SIM_LATENCY cycles
+ * after it is raised or after the previous handler ends, its handler takes SIM_ISR cycles, and vectors of the
+ * same priority do not preempt each other. The model keeps what each line must have captured: one timestamp per
+ * handler run, the level the handler reads, and which timestamps a full ring must drop.
+ *
+ * Capture must check its arguments, start the cycle counter and stop on EXTI_Line_Unregister(). A steady 100 kHz square
+ * wave on both edges and a 1 MHz pulse train on the rising edge must be captured without a loss, with every interval
+ * exact and the edge rate exact. Random bursts on three lines, two of them sharing a vector, with pulses shorter than
+ * the interrupt latency and a reader that falls behind, must give exactly the timestamps, intervals, edge, missed and
+ * dropped counts of the model, also across the wrap of the counter. At 2 MHz, faster than the handler, every handler
+ * run must still be counted once.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_exti_capture
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static uint32_t Sim_Cycles(void);
+
+#define DWT_CYCCNT() Sim_Cycles()  // dwt.h reads this counter instead of DWT->CYCCNT
+
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LEDs of External_Interupt-EXIT/exti.c
+static uint8_t led3;
+
+#include "exti.c"
+#include "dwt.c"
+
+#define SIM_LATENCY 12  // Cycles from the pending bit to the handler's timestamp
+#define SIM_ISR 40      // Cycles a handler takes
+#define SIM_LINES 3
+#define SIM_EDGES 100000  // Edges per line at most
+#define SIM_RING 64       // Timestamps per capture ring
+
+/**
+ * @brief A line in capture mode and what the model expects of it.
+ */
+typedef struct {
+    uint8_t port_source;          // GPIO_PortSourceGPIOx of the pin
+    uint8_t line;                 // Pin and EXTI line
+    EXTITrigger_TypeDef trigger;  // Edges captured
+    uint8_t by_interval;          // 1 to take the timestamps with EXTI_Capture_Interval(), 0 with EXTI_Capture_Read()
+    EXTI_Capture_TypeDef cap;     // Capture handle
+    uint32_t buf[SIM_RING];       // Its ring
+    GPIO_TypeDef *port;           // The port itself
+    uint64_t edge[SIM_EDGES];     // Pin edge times, the pin starts low
+    uint32_t edges;               // Edges in edge
+    uint32_t next;                // Next edge to apply
+    uint64_t pend;                // When the pending bit rose
+    uint8_t read_level;           // Level the previous handler run read
+    uint32_t stamp[SIM_EDGES];    // Timestamps the ring must have kept, in order
+    uint32_t stored;              // Timestamps in stamp
+    uint32_t taken;               // Timestamps taken by the reader
+    uint32_t served;              // Handler runs
+    uint32_t missed;              // Handler runs that read the level of the previous one, in both-edge mode
+    uint32_t dropped;             // Handler runs that found the ring full
+    uint32_t wrong;               // Timestamps or intervals that differ from the model
+} Sim_Line;
+
+static uint64_t sim_now;   // Time in cycles
+static uint64_t sim_busy;  // End of the running handler
+static Sim_Line sim_line[SIM_LINES];
+
+/**
+ * @brief The cycle counter, the low 32 bits of the time.
+ *
+ * @param void
+ * @return The count.
+ */
+static uint32_t Sim_Cycles(void) { return (uint32_t)sim_now; }
+
+/**
+ * @brief Runs the handler of a vector and applies its write to PR as write-1-to-clear.
+ *
+ * @param irq The interrupt number.
+ * @return void
+ */
+static void Sim_Handler(uint8_t irq) {
+    uint32_t pending = EXTI->PR;
+
+    switch (irq) {
+        case EXTI0_IRQn:
+            EXTI0_IRQHandler();
+            break;
+        case EXTI1_IRQn:
+            EXTI1_IRQHandler();
+            break;
+        case EXTI2_IRQn:
+            EXTI2_IRQHandler();
+            break;
+        case EXTI3_IRQn:
+            EXTI3_IRQHandler();
+            break;
+        case EXTI4_IRQn:
+            EXTI4_IRQHandler();
+            break;
+        case EXTI9_5_IRQn:
+            EXTI9_5_IRQHandler();
+            break;
+        default:
+            EXTI15_10_IRQHandler();
+            break;
+    }
+    EXTI->PR = pending & ~EXTI->PR;
+}
+
+/**
+ * @brief Starts capturing on the simulated lines with empty models.
+ *
+ * @param n The number of lines in sim_line.
+ * @return 1 if every line captures.
+ */
+static uint8_t Sim_Start(uint8_t n) {
+    Sim_Line *s;
+    uint8_t ok = 1;
+    uint8_t i;
+
+    EXTI->PR = 0;
+    for (i = 0; i < n; ++i) {
+        s = &sim_line[i];
+        s->port = exti_ports[s->port_source];
+        s->port->IDR &= ~(1u << s->line);
+        s->next = 0;
+        s->read_level = 0;
+        s->stored = 0;
+        s->taken = 0;
+        s->served = 0;
+        s->missed = 0;
+        s->dropped = 0;
+        s->wrong = 0;
+        ok &= EXTI_Capture_Start(&s->cap, s->port_source, s->line, s->trigger, s->buf, SIM_RING, 1, 0);
+    }
+    return ok;
+}
+
+/**
+ * @brief Takes the waiting timestamps of a line, by timestamp or by interval, and checks them against the model.
+ *
+ * @param s The line.
+ * @return void
+ */
+static void Sim_Take(Sim_Line *s) {
+    uint32_t got[SIM_RING];
+    uint32_t cycles;
+    uint16_t n;
+    uint16_t i;
+
+    if (!s->by_interval) {
+        n = EXTI_Capture_Read(&s->cap, got, SIM_RING);
+        for (i = 0; i < n; ++i) {
+            s->wrong += s->taken >= s->stored || got[i] != s->stamp[s->taken];
+            s->taken++;
+        }
+        return;
+    }
+    while (EXTI_Capture_Interval(&s->cap, &cycles)) {
+        if (!s->taken) {
+            s->taken = 1;  // The first timestamp is the reference
+        }
+        s->wrong += s->taken >= s->stored || cycles != s->stamp[s->taken] - s->stamp[s->taken - 1];
+        s->taken++;
+    }
+    s->taken = s->stored;  // A lone first timestamp was taken as the reference
+}
+
+/**
+ * @brief Runs the pulse trains of the first n lines through the interrupt model.
+ *
+ * @param n The number of lines.
+ * @param take_every The mean number of handler runs between two readings, 0 to read only at the end.
+ * @return void
+ */
+static void Sim_Run(uint8_t n, uint32_t take_every) {
+    Sim_Line *s;
+    Sim_Line *e;
+    uint64_t start;
+    uint64_t ready;
+    uint32_t bit;
+    uint8_t irq;
+    uint8_t level;
+    uint8_t i;
+
+    for (;;) {
+        e = 0;
+        irq = 0xff;
+        ready = UINT64_MAX;
+        for (i = 0; i < n; ++i) {
+            s = &sim_line[i];
+            if (s->next < s->edges && (!e || s->edge[s->next] < e->edge[e->next])) {
+                e = s;
+            }
+            if (EXTI->PR & (1u << s->line)) {
+                start = s->pend > sim_busy ? s->pend : sim_busy;
+                if (start < ready || (start == ready && EXTI_Line_IRQn(s->line) < irq)) {
+                    ready = start;
+                    irq = EXTI_Line_IRQn(s->line);
+                }
+            }
+        }
+        if (!e && irq == 0xff) {
+            break;
+        }
+
+        if (e && (irq == 0xff || e->edge[e->next] < ready + SIM_LATENCY)) {  // The pin changes first
+            sim_now = e->edge[e->next++];
+            bit = 1u << e->line;
+            e->port->IDR ^= bit;
+            level = (e->port->IDR & bit) != 0;
+            if ((EXTI->IMR & bit) && ((level ? EXTI->RTSR : EXTI->FTSR) & bit) && !(EXTI->PR & bit)) {
+                EXTI->PR |= bit;
+                e->pend = sim_now;
+            }
+            continue;
+        }
+
+        sim_now = ready + SIM_LATENCY;  // The handler timestamps every line its vector finds pending
+        for (i = 0; i < n; ++i) {
+            s = &sim_line[i];
+            bit = 1u << s->line;
+            if (!(EXTI->PR & bit) || EXTI_Line_IRQn(s->line) != irq) {
+                continue;
+            }
+            s->served++;
+            if (s->trigger == EXTI_Trigger_Rising_Falling) {
+                level = (s->port->IDR & bit) != 0;
+                s->missed += level == s->read_level;
+                s->read_level = level;
+            }
+            if (s->stored - s->taken >= SIM_RING) {
+                s->dropped++;
+            } else {
+                s->stamp[s->stored++] = (uint32_t)sim_now;
+            }
+        }
+        Sim_Handler(irq);
+        sim_busy = sim_now + SIM_ISR;
+        for (i = 0; i < n; ++i) {
+            if (take_every && rand() % take_every == 0) {
+                Sim_Take(&sim_line[i]);
+            }
+        }
+    }
+    sim_now = sim_busy;
+    for (i = 0; i < n; ++i) {
+        Sim_Take(&sim_line[i]);
+    }
+}
+
+/**
+ * @brief Checks one line against its model after a run.
+ *
+ * @param s The line.
+ * @return 1 if the timestamps, intervals and counts match.
+ */
+static uint8_t Sim_Matches(const Sim_Line *s) {
+    return s->wrong == 0 && s->taken == s->stored && s->cap.edges == s->served && s->cap.missed == s->missed &&
+           s->cap.dropped == s->dropped && s->cap.head == s->cap.tail;
+}
+
+/**
+ * @brief Sets the edges of a line to a square wave.
+ *
+ * @param s The line.
+ * @param t The time of the first edge.
+ * @param half The half period in cycles.
+ * @param edges The number of edges.
+ * @return void
+ */
+static void Sim_Square(Sim_Line *s, uint64_t t, uint32_t half, uint32_t edges) {
+    uint32_t i;
+
+    for (i = 0; i < edges; ++i) {
+        s->edge[i] = t + (uint64_t)i * half;
+    }
+    s->edges = edges;
+}
+
+/**
+ * @brief Capture checks its arguments and stops on EXTI_Line_Unregister().
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Start(void) {
+    Sim_Line *s = &sim_line[0];
+
+    CHECK(!EXTI_Capture_Start(&s->cap, 7, 3, EXTI_Trigger_Rising, s->buf, SIM_RING, 1, 0));
+    CHECK(!EXTI_Capture_Start(&s->cap, GPIO_PortSourceGPIOA, 16, EXTI_Trigger_Rising, s->buf, SIM_RING, 1, 0));
+    CHECK(!EXTI_Capture_Start(&s->cap, GPIO_PortSourceGPIOA, 3, EXTI_Trigger_Rising, s->buf, 48, 1, 0));
+    CHECK(!EXTI_Capture_Start(&s->cap, GPIO_PortSourceGPIOA, 3, EXTI_Trigger_Rising, s->buf, 1, 1, 0));
+    CHECK(EXTI->IMR == 0 && !(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk));
+
+    s->port_source = GPIO_PortSourceGPIOA;
+    s->line = 3;
+    s->trigger = EXTI_Trigger_Rising;
+    Sim_Square(s, sim_now + 100, 500, 8);
+    CHECK(Sim_Start(1));
+    CHECK((EXTI->IMR & 8) && (EXTI->RTSR & 8) && !(EXTI->FTSR & 8) && exti_lines[3].cap == &s->cap);
+    CHECK(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk);  // Started by the capture, not left to the caller
+    Sim_Run(1, 0);
+    CHECK(Sim_Matches(s) && s->served == 4 && EXTI_Capture_Rate(&s->cap) == 0);
+
+    EXTI_Line_Unregister(3);
+    EXTI->PR = 0;
+    Sim_Square(s, sim_now + 100, 500, 8);
+    s->next = 0;
+    Sim_Run(1, 0);
+    CHECK(s->served == 4 && s->cap.edges == 4 && EXTI->PR == 0 && !exti_lines[3].cap);
+}
+
+/**
+ * @brief A 100 kHz square wave on both edges and a 1 MHz pulse train on the rising edge, each alone: nothing is
+ *        lost, every interval and the rate are exact.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Steady(void) {
+    Sim_Line *s = &sim_line[0];
+    uint32_t cycles;
+    uint32_t wrong = 0;
+    uint32_t i;
+
+    s->port_source = GPIO_PortSourceGPIOB;
+    s->line = 7;
+    s->trigger = EXTI_Trigger_Rising_Falling;
+    s->by_interval = 0;
+    Sim_Square(s, sim_now + 1000, 360, SIM_EDGES);
+    CHECK(Sim_Start(1));
+    Sim_Run(1, 4);
+    CHECK(Sim_Matches(s) && s->served == SIM_EDGES && s->missed == 0 && s->dropped == 0);
+    for (i = 1; i < s->stored; ++i) {
+        wrong += s->stamp[i] - s->stamp[i - 1] != 360;
+    }
+    CHECK(wrong == 0);
+
+    s->line = 12;
+    s->trigger = EXTI_Trigger_Rising;
+    s->by_interval = 1;
+    Sim_Square(s, sim_now + 1000, 36, 2 * SIM_RING + 1);  // Rising edges 72 cycles apart, 1 MHz
+    CHECK(Sim_Start(1));
+    EXTI_Line_Unregister(7);
+    s->next = 0;
+    while (s->next < s->edges) {
+        sim_now = s->edge[s->next++];
+        GPIOB->IDR ^= 1u << 12;
+        if (GPIOB->IDR & (1u << 12)) {
+            EXTI->PR = 1u << 12;
+            sim_now += SIM_LATENCY;
+            Sim_Handler(EXTI15_10_IRQn);
+        }
+    }
+    CHECK(s->cap.edges == SIM_RING + 1 && s->cap.dropped == 1);
+    CHECK(EXTI_Capture_Rate(&s->cap) == 1000000);
+    wrong = 0;
+    for (i = 0; i < SIM_RING - 1; ++i) {
+        wrong += !EXTI_Capture_Interval(&s->cap, &cycles) || cycles != 72;
+    }
+    CHECK(wrong == 0 && !EXTI_Capture_Interval(&s->cap, &cycles) && EXTI_Capture_Rate(&s->cap) == 0);
+    EXTI_Line_Unregister(12);
+}
+
+/**
+ * @brief Builds a random pulse train: pulses and gaps from shorter than the interrupt latency to 100 us.
+ *
+ * @param s The line.
+ * @param t The time of the first edge.
+ * @param edges The number of edges.
+ * @return void
+ */
+static void Sim_Burst(Sim_Line *s, uint64_t t, uint32_t edges) {
+    uint32_t i;
+
+    for (i = 0; i < edges; ++i) {
+        switch (rand() % 4) {
+            case 0:  // Glitch the handler cannot see apart
+                t += 1 + rand() % SIM_LATENCY;
+                break;
+            case 1:
+                t += 1 + rand() % (SIM_LATENCY + SIM_ISR);
+                break;
+            case 2:
+                t += 1 + rand() % 720;
+                break;
+            default:
+                t += 1 + rand() % 7200;
+                break;
+        }
+        s->edge[i] = t;
+    }
+    s->edges = edges;
+}
+
+/**
+ * @brief Random bursts on three lines, two of them on the shared EXTI15_10 vector, across the counter wrap and
+ *        with a reader that sometimes falls behind: everything matches the model.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Burst(void) {
+    uint8_t i;
+
+    sim_line[0].port_source = GPIO_PortSourceGPIOA;
+    sim_line[0].line = 2;
+    sim_line[0].trigger = EXTI_Trigger_Rising_Falling;
+    sim_line[0].by_interval = 1;
+    sim_line[1].port_source = GPIO_PortSourceGPIOB;
+    sim_line[1].line = 11;
+    sim_line[1].trigger = EXTI_Trigger_Rising_Falling;
+    sim_line[1].by_interval = 0;
+    sim_line[2].port_source = GPIO_PortSourceGPIOC;
+    sim_line[2].line = 14;
+    sim_line[2].trigger = EXTI_Trigger_Falling;
+    sim_line[2].by_interval = 0;
+
+    sim_now = 0xffffffffu - 3000000u;  // Wraps within the first second
+    sim_busy = 0;
+    for (i = 0; i < SIM_LINES; ++i) {
+        Sim_Burst(&sim_line[i], sim_now + 100, SIM_EDGES);
+    }
+    CHECK(Sim_Start(SIM_LINES));
+    Sim_Run(SIM_LINES, 80);
+    CHECK(sim_now > 0xffffffffu);
+    for (i = 0; i < SIM_LINES; ++i) {
+        CHECK(Sim_Matches(&sim_line[i]));
+        CHECK(sim_line[i].served < SIM_EDGES / (i == 2 ? 2 : 1) && sim_line[i].dropped > 0);
+    }
+    CHECK(sim_line[0].missed > 0 && sim_line[1].missed > 0 && sim_line[2].missed == 0);
+    for (i = 0; i < SIM_LINES; ++i) {
+        EXTI_Line_Unregister(sim_line[i].line);
+    }
+}
+
+/**
+ * @brief Rising edges at 2 MHz, faster than the handler: the handler runs back to back and each run is counted
+ *        and timestamped once.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Overrun(void) {
+    Sim_Line *s = &sim_line[0];
+    uint32_t wrong = 0;
+    uint32_t i;
+
+    s->port_source = GPIO_PortSourceGPIOC;
+    s->line = 0;
+    s->trigger = EXTI_Trigger_Rising;
+    s->by_interval = 0;
+    Sim_Square(s, sim_now + 1000, 18, SIM_EDGES);
+    CHECK(Sim_Start(1));
+    Sim_Run(1, 1);
+    CHECK(Sim_Matches(s) && s->dropped == 0 && s->served < SIM_EDGES / 2 && s->served > SIM_EDGES / 4);
+    for (i = 1; i < s->stored; ++i) {
+        wrong += s->stamp[i] - s->stamp[i - 1] != SIM_LATENCY + SIM_ISR;  // Back to back
+    }
+    CHECK(wrong == 0);
+    EXTI_Line_Unregister(0);
+}
+
+int main(void) {
+    srand(21);
+    sim_now = 0xffffffffu - 72000000u;
+    Test_Start();
+    Test_Steady();
+    Test_Burst();
+    Test_Overrun();
+    return TEST_EXIT("test_exti_capture");
+}
@@ -0,0 +1,373 @@
+/**
+ * @file test_key_scan.c
+ * @brief Host test of the timer-driven key scanner on bouncing key waveforms.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Each of the four keys gets a contact waveform at 10 us resolution over ten minutes: presses and releases that
+ * bounce for up to 15 ms with edges 20 us to 1 ms apart, holds from a tap to several seconds, idle gaps, and short
+ * spikes in between as a noisy line gives. The keys are independent, so they overlap into chords. Every
+ * KEY_SCAN_TICK_MS the pins of GPIOA and GPIOE take the contact levels, with each key's polarity, and the TIM6
+ * update interrupt runs; the application takes the events at random intervals.
+ *
+ * Every contact press must give exactly one press and one release, each within the integrator time of the contact
+ * settling, with as many long-press and repeat events as the hold lasted and none for the spikes. A press that
+ * leaves two or more keys down must end its tick with a chord event. No event may be lost and nothing may call
+ * delay_ms(). When the application stops taking events the queue must keep the oldest ones and count the rest.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_key_scan
+ */
+
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "key.c"
+#include "key_scan.c"
+#include "time.c"
+
+#define SIM_US 10  // Time unit of the waveforms
+#define SIM_MS (1000 / SIM_US)
+#define SIM_TICK (KEY_SCAN_TICK_MS * SIM_MS)
+#define SIM_END (600000 * SIM_MS)  // Ten minutes
+#define SIM_TICKS (SIM_END / SIM_TICK)
+#define SIM_EDGES 200000  // Contact edges per key at most
+#define SIM_PRESSES 4000  // Presses per key at most
+#define SIM_EVENTS 100000
+
+/**
+ * @brief One press of a key contact, in SIM_US units.
+ */
+typedef struct {
+    uint32_t down;     // First edge of the press bounce
+    uint32_t settled;  // Contact closed for good
+    uint32_t up;       // First edge of the release bounce
+    uint32_t open;     // Contact open for good
+} Sim_Press;
+
+/**
+ * @brief An event as the application took it, with the tick it was queued in.
+ */
+typedef struct {
+    KEY_Event_TypeDef ev;
+    uint32_t tick;
+} Sim_Event;
+
+static uint32_t sim_edge[KEY_SCAN_KEYS][SIM_EDGES];  // Contact edge times, the contact starts open
+static uint32_t sim_edges[KEY_SCAN_KEYS];
+static Sim_Press sim_press[KEY_SCAN_KEYS][SIM_PRESSES];
+static uint32_t sim_presses[KEY_SCAN_KEYS];
+static uint32_t sim_ev_tick[SIM_EVENTS];  // Tick each queued event was queued in
+static uint32_t sim_queued;
+static Sim_Event sim_log[SIM_EVENTS];
+static uint32_t sim_taken;
+static uint8_t sim_state[SIM_TICKS];  // Debounced keys down after each tick
+static uint32_t sim_delays;           // delay_ms() calls
+
+void delay_ms(u16 nms) { sim_delays++; }
+
+/**
+ * @brief Adds a bouncing edge of a key contact: random edges for up to 15 ms that end in the new level.
+ *
+ * @param k The key index.
+ * @param t The time of the first edge.
+ * @return The time the contact settles.
+ */
+static uint32_t Sim_Bounce(uint8_t k, uint32_t t) {
+    uint32_t end = t + (uint32_t)(rand() % (15 * SIM_MS));
+    uint32_t parity = sim_edges[k] & 1;
+
+    sim_edge[k][sim_edges[k]++] = t;
+    while (rand() % 4) {
+        t += 2 + (uint32_t)(rand() % (SIM_MS - 1));
+        if (t >= end) {
+            break;
+        }
+        sim_edge[k][sim_edges[k]++] = t;
+    }
+    if ((sim_edges[k] & 1) == parity) {
+        sim_edge[k][sim_edges[k]++] = t < end ? end : t;  // Ends in the new level
+    }
+    return sim_edge[k][sim_edges[k] - 1];
+}
+
+/**
+ * @brief Adds spikes to a stable stretch of a contact, each up to 3 ms and clear of the integrator time of either
+ *        end, so that the edges are seen on time.
+ *
+ * @param k The key index.
+ * @param from The start of the stretch.
+ * @param to The end of the stretch.
+ * @return void
+ */
+static void Sim_Spikes(uint8_t k, uint32_t from, uint32_t to) {
+    uint32_t t = from + (KEY_DEBOUNCE_MS + KEY_SCAN_TICK_MS) * SIM_MS;
+
+    while (rand() % 3 == 0) {
+        t += (uint32_t)(rand() % (200 * SIM_MS));
+        if (t + (3 + KEY_DEBOUNCE_MS + KEY_SCAN_TICK_MS) * SIM_MS > to) {
+            return;
+        }
+        sim_edge[k][sim_edges[k]++] = t;
+        t += 1 + (uint32_t)(rand() % (3 * SIM_MS));
+        sim_edge[k][sim_edges[k]++] = t;
+        t += 10 * SIM_MS;
+    }
+}
+
+/**
+ * @brief Builds the contact waveform of one key: idle gaps, bouncing presses, holds and bouncing releases.
+ *
+ * @param k The key index.
+ * @return void
+ */
+static void Sim_Waveform(uint8_t k) {
+    uint32_t t = (uint32_t)(rand() % (500 * SIM_MS));
+    uint32_t gap;
+    uint32_t hold;
+    Sim_Press *p;
+
+    for (;;) {
+        gap = (30 + (uint32_t)(rand() % 1000)) * SIM_MS;
+        hold = rand() % 10 < 6 ? 30 + (uint32_t)(rand() % 370) : rand() % 4 ? 1000 + (uint32_t)(rand() % 2000)
+                                                                          : 400 + (uint32_t)(rand() % 600);
+        hold *= SIM_MS;
+        if (t + gap + hold + 100 * SIM_MS > SIM_END - 5000 * SIM_MS) {
+            return;
+        }
+        Sim_Spikes(k, t, t + gap);
+        p = &sim_press[k][sim_presses[k]++];
+        p->down = t + gap;
+        p->settled = Sim_Bounce(k, p->down);
+        Sim_Spikes(k, p->settled, p->settled + hold);
+        p->up = p->settled + hold;
+        p->open = Sim_Bounce(k, p->up);
+        t = p->open;
+    }
+}
+
+/**
+ * @brief Runs the scan ticks over the waveforms and takes the events at random intervals.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Run(void) {
+    static const uint16_t pin[KEY_SCAN_KEYS] = {KEY_UP_Pin, KEY_DOWN_Pin, KEY_LEFT_Pin, KEY_RIGHT_Pin};
+    uint32_t next[KEY_SCAN_KEYS] = {0};
+    uint8_t head = key_queue_head;
+    uint32_t tick;
+    uint32_t t;
+    uint32_t take_at = 0;
+    uint8_t k;
+    uint8_t closed;
+
+    for (tick = 0; tick < SIM_TICKS; ++tick) {
+        t = tick * SIM_TICK;
+        GPIOA->IDR = 0;
+        GPIOE->IDR = 0xffff;
+        for (k = 0; k < KEY_SCAN_KEYS; ++k) {
+            while (next[k] < sim_edges[k] && sim_edge[k][next[k]] <= t) {
+                next[k]++;
+            }
+            closed = next[k] & 1;
+            if (k == KEY_UP - 1) {
+                GPIOA->IDR |= closed ? pin[k] : 0;  // K_UP is active high
+            } else {
+                GPIOE->IDR &= closed ? ~(uint32_t)pin[k] : 0xffff;
+            }
+        }
+        TIM6->SR |= TIM_IT_Update;
+        TIM6_IRQHandler();
+        while (head != key_queue_head) {
+            sim_ev_tick[sim_queued++] = tick;
+            head++;
+        }
+        sim_state[tick] = KEY_Get_State();
+
+        if (tick >= take_at) {
+            while (KEY_Get_Event(&sim_log[sim_taken].ev)) {
+                sim_log[sim_taken].tick = sim_ev_tick[sim_taken];
+                sim_taken++;
+            }
+            take_at = tick + 1 + (uint32_t)(rand() % 8);
+        }
+    }
+    while (KEY_Get_Event(&sim_log[sim_taken].ev)) {
+        sim_log[sim_taken].tick = sim_ev_tick[sim_taken];
+        sim_taken++;
+    }
+}
+
+/**
+ * @brief Whether an edge event came outside the integrator time of its contact edge: not before as many clean
+ *        samples as the integrator counts could have been taken, and no later than that after the contact settled.
+ *
+ * @param tick The tick the event was queued in.
+ * @param first The first edge of the bounce.
+ * @param settled The time the contact settled.
+ * @return 1 if off time.
+ */
+static uint8_t Sim_Off_Time(uint32_t tick, uint32_t first, uint32_t settled) {
+    uint32_t t = tick * SIM_TICK;
+
+    return t < first + (KEY_DEBOUNCE_MS - KEY_SCAN_TICK_MS) * SIM_MS || t > settled + KEY_DEBOUNCE_MS * SIM_MS;
+}
+
+/**
+ * @brief Checks the events of one key against its contact presses.
+ *
+ * @param k The key index.
+ * @param longs Incremented per long-press event.
+ * @param repeats Incremented per repeat event.
+ * @return The number of wrong or missing events.
+ */
+static uint32_t Sim_Check_Key(uint8_t k, uint32_t *longs, uint32_t *repeats) {
+    uint32_t wrong = 0;
+    uint32_t i = 0;
+    uint32_t j;
+    uint32_t press = 0;
+    uint32_t held;
+    uint32_t want_repeats;
+    uint32_t got_repeats;
+    uint8_t got_long;
+    Sim_Press *p;
+    uint8_t bit = KEY_MASK(k + 1);
+
+    for (j = 0; j < sim_presses[k]; ++j) {
+        p = &sim_press[k][j];
+        while (i < sim_taken && sim_log[i].ev.key != k + 1) {
+            i++;
+        }
+        if (i == sim_taken || sim_log[i].ev.type != KEY_EVT_PRESS || !(sim_log[i].ev.mask & bit)) {
+            return wrong + 1;
+        }
+        press = sim_log[i++].tick;
+        wrong += Sim_Off_Time(press, p->down, p->settled);
+        got_long = 0;
+        got_repeats = 0;
+        for (;;) {
+            while (i < sim_taken && sim_log[i].ev.key != k + 1) {
+                i++;
+            }
+            if (i == sim_taken || sim_log[i].ev.type == KEY_EVT_PRESS) {
+                return wrong + 1;
+            }
+            if (sim_log[i].ev.type == KEY_EVT_RELEASE) {
+                break;
+            }
+            if (sim_log[i].ev.type == KEY_EVT_LONG) {
+                wrong += got_long || got_repeats;
+                got_long = 1;
+            } else {
+                wrong += !got_long;
+                got_repeats++;
+            }
+            i++;
+        }
+        wrong += (sim_log[i].ev.mask & bit) != 0;
+        wrong += Sim_Off_Time(sim_log[i].tick, p->up, p->open);
+        held = sim_log[i++].tick - press - 1;  // Ticks counted towards the long press
+        want_repeats = held >= KEY_LONG_TICKS ? (held - KEY_LONG_TICKS) / KEY_REPEAT_TICKS : 0;
+        wrong += got_long != (held >= KEY_LONG_TICKS) || got_repeats != want_repeats;
+        *longs += got_long;
+        *repeats += got_repeats;
+    }
+    while (i < sim_taken) {
+        wrong += sim_log[i++].ev.key == k + 1;  // Nothing after the last release
+    }
+    return wrong;
+}
+
+/**
+ * @brief Ten minutes of bouncing presses on four keys: every event, on time, in order, none lost.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Waveforms(void) {
+    uint32_t wrong = 0;
+    uint32_t longs = 0;
+    uint32_t repeats = 0;
+    uint32_t chords = 0;
+    uint32_t chord_ticks = 0;
+    uint32_t presses = 0;
+    uint32_t edges = 0;
+    uint32_t i;
+    uint32_t j;
+    uint8_t k;
+    uint8_t s;
+
+    KEY_Scan_Init();
+    for (k = 0; k < KEY_SCAN_KEYS; ++k) {
+        Sim_Waveform(k);
+        presses += sim_presses[k];
+        edges += sim_edges[k];
+    }
+    Sim_Run();
+
+    for (k = 0; k < KEY_SCAN_KEYS; ++k) {
+        wrong += Sim_Check_Key(k, &longs, &repeats);
+    }
+    for (i = 0; i < sim_taken; i = j) {
+        s = 0;
+        for (j = i; j < sim_taken && sim_log[j].tick == sim_log[i].tick; ++j) {
+            s |= sim_log[j].ev.type == KEY_EVT_PRESS;
+        }
+        s = s && (sim_state[sim_log[i].tick] & (sim_state[sim_log[i].tick] - 1));  // A press left several down
+        chord_ticks += s;
+        if (s) {
+            wrong += sim_log[j - 1].ev.type != KEY_EVT_CHORD || sim_log[j - 1].ev.key != 0 ||
+                     sim_log[j - 1].ev.mask != sim_state[sim_log[i].tick];
+        }
+    }
+    for (i = 0; i < sim_taken; ++i) {
+        chords += sim_log[i].ev.type == KEY_EVT_CHORD;
+    }
+
+    CHECK(wrong == 0);
+    CHECK(chords == chord_ticks && chords > 10);
+    CHECK(sim_taken == sim_queued && KEY_Events_Dropped() == 0);
+    CHECK(longs > 50 && repeats > 1000);
+    CHECK(sim_delays == 0 && KEY_Get_State() == 0);
+    printf("%lu contact edges, %lu presses: %lu events, %lu long presses, %lu repeats, %lu chords\n",
+           (unsigned long)edges, (unsigned long)presses, (unsigned long)sim_taken, (unsigned long)longs,
+           (unsigned long)repeats, (unsigned long)chords);
+}
+
+/**
+ * @brief A full queue keeps the oldest events and counts every dropped one.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Overflow(void) {
+    static const uint8_t want[KEY_EVENT_QUEUE] = {
+        KEY_EVT_PRESS,   KEY_EVT_PRESS,   KEY_EVT_PRESS,   KEY_EVT_PRESS,   KEY_EVT_CHORD, KEY_EVT_RELEASE,
+        KEY_EVT_RELEASE, KEY_EVT_RELEASE, KEY_EVT_RELEASE, KEY_EVT_PRESS,   KEY_EVT_PRESS, KEY_EVT_PRESS,
+        KEY_EVT_PRESS,   KEY_EVT_CHORD,   KEY_EVT_RELEASE, KEY_EVT_RELEASE};
+    KEY_Event_TypeDef ev;
+    uint32_t dropped = KEY_Events_Dropped();
+    uint32_t i;
+    uint32_t wrong = 0;
+
+    for (i = 0; i < 3 * 2 * KEY_INTEGRATOR_MAX; ++i) {
+        KEY_Scan_Process((i / KEY_INTEGRATOR_MAX) % 2 ? 0 : 0x0f);  // 27 events: four presses, chord, four releases
+    }
+    for (i = 0; KEY_Get_Event(&ev); ++i) {
+        wrong += i >= KEY_EVENT_QUEUE || ev.type != want[i];
+    }
+    CHECK(wrong == 0 && i == KEY_EVENT_QUEUE);
+    CHECK(KEY_Events_Dropped() - dropped == 27 - KEY_EVENT_QUEUE);
+}
+
+int main(void) {
+    srand(17);
+    Test_Waveforms();
+    Test_Overflow();
+    return TEST_EXIT("test_key_scan");
+}
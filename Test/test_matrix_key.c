@@ -0,0 +1,438 @@
+/**
+ * @file test_matrix_key.c
+ * @brief Host simulation of a matrix keypad scanned by TIM3 and DMA, with bouncing and ghosting keys.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The keypad is a grid of contacts without diodes: every column is pulled up and reads low when any row driven
+ * low reaches it through closed contacts, over as many keys as it takes, which is how ghost keys appear. A key
+ * bounces for up to two and a half frames after each change. TIM3 runs as configured: every row period its
+ * compare 1 makes DMA1 Channel6 copy the column IDR and its update makes DMA1 Channel3 write the next pattern into
+ * the row port's BSRR, which then drives the rows; the CPU only sees the DMA interrupts.
+ *
+ * On a 4x4 and an 8x8 keypad with scattered pins, the row period must match the asked rate, compare 1 must drive no
+ * output even over a dirty stack, and no DMA interrupt may come per row. Every single key must be reported at its own
+ * row and column. With at most two keys down, when no ghosting is possible, every change must be reported once and
+ * within the debounce time after the contact settled, and no bounce may get through. With three or four keys down a
+ * ghost key must never be reported, the third corner of a rectangle only once the rectangle is broken, and every key
+ * must come up after the release. Matrix_Key_Stop() must release the rows and the DMA channels.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_matrix_key
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "matrix_key.c"
+#include "debounce.c"
+#include "dma.c"
+#include "time.c"
+
+static Matrix_Key_Config_TypeDef sim_cfg;
+static uint32_t sim_now;                                              // Time in us
+static uint32_t sim_frame_us;                                         // Time of one frame
+static uint8_t sim_target[MATRIX_KEY_MAX_ROWS][MATRIX_KEY_MAX_COLS];  // Contacts as pressed, after the bounce
+static uint32_t sim_bounce[MATRIX_KEY_MAX_ROWS][MATRIX_KEY_MAX_COLS];  // End of the bounce of each contact
+static uint32_t sim_change[MATRIX_KEY_MAX_ROWS][MATRIX_KEY_MAX_COLS];  // Time of the last pressed change
+static uint8_t sim_down[MATRIX_KEY_MAX_ROWS][MATRIX_KEY_MAX_COLS];    // Keys down as the callbacks reported them
+static uint8_t sim_allowed[MATRIX_KEY_MAX_ROWS][MATRIX_KEY_MAX_COLS];  // Keys that may be reported down
+static uint32_t sim_events;                                           // Callbacks
+static uint32_t sim_wrong;                                            // Callbacks that should not have come
+static uint8_t sim_exact;                                             // 1 when every callback must match the keys
+
+/**
+ * @brief Records a debounced key change and checks it against the keypad.
+ *
+ * @param row The row of the key.
+ * @param col The column of the key.
+ * @param pressed 1 when the key went down.
+ * @return void
+ */
+static void Sim_Callback(uint8_t row, uint8_t col, uint8_t pressed) {
+    sim_events++;
+    sim_wrong += sim_down[row][col] == pressed;  // Changes alternate
+    sim_wrong += pressed && !sim_allowed[row][col];
+    sim_wrong += sim_exact && pressed != sim_target[row][col];  // No bounce gets through
+    sim_wrong += Matrix_Key_Is_Down(row, col) != pressed;
+    sim_down[row][col] = pressed;
+}
+
+/**
+ * @brief Presses or releases a key; its contact bounces for up to two and a half frames.
+ *
+ * @param row The row of the key.
+ * @param col The column of the key.
+ * @param pressed 1 to press.
+ * @return void
+ */
+static void Sim_Key(uint8_t row, uint8_t col, uint8_t pressed) {
+    sim_target[row][col] = pressed;
+    sim_bounce[row][col] = sim_now + (uint32_t)rand() % (sim_frame_us * 5 / 2);
+    sim_change[row][col] = sim_now;
+    if (pressed) {
+        sim_allowed[row][col] = 1;
+    }
+}
+
+/**
+ * @brief Returns the root of a node in the union-find of rows and columns.
+ *
+ * @param parent The parents.
+ * @param n The node.
+ * @return The root.
+ */
+static uint8_t Sim_Root(uint8_t *parent, uint8_t n) {
+    while (parent[n] != n) {
+        n = parent[n];
+    }
+    return n;
+}
+
+/**
+ * @brief The column port as the keypad drives it: a column is low if a row driven low reaches it through any
+ *        chain of closed contacts.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Columns(void) {
+    uint8_t parent[MATRIX_KEY_MAX_ROWS + MATRIX_KEY_MAX_COLS];
+    uint8_t low[MATRIX_KEY_MAX_ROWS + MATRIX_KEY_MAX_COLS] = {0};
+    uint8_t closed;
+    uint8_t r;
+    uint8_t c;
+
+    for (r = 0; r < MATRIX_KEY_MAX_ROWS + MATRIX_KEY_MAX_COLS; ++r) {
+        parent[r] = r;
+    }
+    for (r = 0; r < sim_cfg.rows; ++r) {
+        for (c = 0; c < sim_cfg.cols; ++c) {
+            closed = sim_now < sim_bounce[r][c] ? rand() & 1 : sim_target[r][c];
+            if (closed) {
+                parent[Sim_Root(parent, r)] = Sim_Root(parent, MATRIX_KEY_MAX_ROWS + c);
+            }
+        }
+    }
+    for (r = 0; r < sim_cfg.rows; ++r) {
+        if (!(sim_cfg.row_port->ODR & sim_cfg.row_pins[r])) {
+            low[Sim_Root(parent, r)] = 1;
+        }
+    }
+    sim_cfg.col_port->IDR = 0xffff;  // Pulled up
+    for (c = 0; c < sim_cfg.cols; ++c) {
+        if (low[Sim_Root(parent, MATRIX_KEY_MAX_ROWS + c)]) {
+            sim_cfg.col_port->IDR &= ~(uint32_t)sim_cfg.col_pins[c];
+        }
+    }
+}
+
+/**
+ * @brief Drives the row port from what was written to its BSRR.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Rows(void) {
+    GPIO_TypeDef *port = sim_cfg.row_port;
+
+    port->ODR = (port->ODR | (port->BSRR & 0xffff)) & ~(port->BSRR >> 16);
+    port->BSRR = 0;
+}
+
+/**
+ * @brief Runs TIM3 for a number of frames: compare 1 in the middle of each row period, the update at its end.
+ *
+ * @param frames The number of frames.
+ * @return void
+ */
+static void Sim_Frames(uint32_t frames) {
+    uint32_t n = frames * sim_cfg.rows;
+    uint32_t half = sim_frame_us / sim_cfg.rows / 2;
+
+    while (n--) {
+        if (!(TIM3->CR1 & TIM_CR1_CEN)) {
+            return;
+        }
+        sim_now += half;
+        Sim_Columns();
+        if (TIM3->DIER & TIM_DMA_CC1) {
+            Host_DMA_Request(DMA1_Channel6);
+        }
+        sim_now += half;
+        if (TIM3->DIER & TIM_DMA_Update) {
+            Host_DMA_Request(DMA1_Channel3);
+            Sim_Rows();
+        }
+    }
+}
+
+/**
+ * @brief Fills the stack below the caller with ones, so that fields a driver leaves unset in its stack structures
+ *        show up in the registers.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Dirty_Stack(void) {
+    volatile uint8_t junk[4096];
+    uint32_t i;
+
+    for (i = 0; i < sizeof(junk); ++i) {
+        junk[i] = 0xff;
+    }
+}
+
+/**
+ * @brief Starts scanning a keypad and checks the row rate and that no DMA interrupt comes per row.
+ *
+ * @param cfg The keypad.
+ * @return 1 if scanning as asked.
+ */
+static uint8_t Sim_Start(const Matrix_Key_Config_TypeDef *cfg) {
+    double row_us;
+
+    memset(sim_target, 0, sizeof(sim_target));
+    memset(sim_bounce, 0, sizeof(sim_bounce));
+    memset(sim_down, 0, sizeof(sim_down));
+    memset(sim_allowed, 0, sizeof(sim_allowed));
+    sim_cfg = *cfg;
+    Sim_Dirty_Stack();
+    if (!Matrix_Key_Init(cfg, Sim_Callback)) {
+        return 0;
+    }
+    Sim_Rows();
+    row_us = (TIM3->PSC + 1.0) * (TIM3->ARR + 1.0) * 1e6 / TIM_APB1_Clock();
+    sim_frame_us = (uint32_t)(row_us * cfg->rows + 0.5);
+    return row_us * cfg->row_rate > 0.999e6 && row_us * cfg->row_rate < 1.001e6 && TIM3->CCR1 < TIM3->ARR &&
+           (TIM3->CCER & 0xf) == 0 && !(DMA1_Channel3->CCR & DMA_CCR1_HTIE) && !(DMA1_Channel6->CCR & DMA_CCR1_HTIE);
+}
+
+/**
+ * @brief Frames for a change to be reported: the longest bounce, then the debounce samples, one frame to spare.
+ *
+ * @param void
+ * @return The frames.
+ */
+static uint32_t Sim_Settle(void) { return 3 + DEBOUNCE_SAMPLES + 1; }
+
+/**
+ * @brief Presses and releases every key alone; each must be reported once, at its own row and column.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Sweep(void) {
+    uint32_t wrong = 0;
+    uint32_t events = sim_events;
+    uint8_t r;
+    uint8_t c;
+
+    sim_exact = 1;
+    for (r = 0; r < sim_cfg.rows; ++r) {
+        for (c = 0; c < sim_cfg.cols; ++c) {
+            Sim_Key(r, c, 1);
+            Sim_Frames(Sim_Settle());
+            wrong += !sim_down[r][c] || !Matrix_Key_Is_Down(r, c);
+            Sim_Key(r, c, 0);
+            Sim_Frames(Sim_Settle());
+            wrong += sim_down[r][c] || Matrix_Key_Is_Down(r, c);
+        }
+    }
+    CHECK(wrong == 0 && sim_wrong == 0);
+    CHECK(sim_events - events == 2u * sim_cfg.rows * sim_cfg.cols);
+}
+
+/**
+ * @brief At most two keys down at a time, each held long enough to be debounced: every change is reported exactly,
+ *        once, within the debounce time.
+ *
+ * @param frames The frames to run.
+ * @return void
+ */
+static void Sim_Two_Keys(uint32_t frames) {
+    uint8_t down = 0;
+    uint32_t late = 0;
+    uint32_t ghosts = Matrix_Key_Ghost_Frames();
+    uint32_t f;
+    uint8_t r;
+    uint8_t c;
+
+    sim_exact = 1;
+    memset(sim_allowed, 1, sizeof(sim_allowed));
+    for (f = 0; f < frames; ++f) {
+        if (rand() % 8 == 0) {
+            r = (uint8_t)(rand() % sim_cfg.rows);
+            c = (uint8_t)(rand() % sim_cfg.cols);
+            if ((sim_target[r][c] || down < 2) && sim_now - sim_change[r][c] > Sim_Settle() * sim_frame_us) {
+                down += sim_target[r][c] ? -1 : 1;
+                Sim_Key(r, c, !sim_target[r][c]);
+            }
+        }
+        Sim_Frames(1);
+        for (r = 0; r < sim_cfg.rows; ++r) {
+            for (c = 0; c < sim_cfg.cols; ++c) {
+                late += sim_now - sim_change[r][c] > Sim_Settle() * sim_frame_us && sim_down[r][c] != sim_target[r][c];
+            }
+        }
+    }
+    for (r = 0; r < sim_cfg.rows; ++r) {
+        for (c = 0; c < sim_cfg.cols; ++c) {
+            if (sim_target[r][c]) {
+                Sim_Key(r, c, 0);
+            }
+        }
+    }
+    Sim_Frames(Sim_Settle());
+    CHECK(late == 0 && sim_wrong == 0 && Matrix_Key_Ghost_Frames() == ghosts);
+}
+
+/**
+ * @brief Groups of three and four keys pressed one by one and released in any order: a key outside the group is
+ *        never reported, and all come up at the end.
+ *
+ * @param groups The number of groups.
+ * @return void
+ */
+static void Sim_Groups(uint32_t groups) {
+    uint8_t key[4][2];
+    uint8_t n;
+    uint8_t i;
+    uint32_t left_down = 0;
+    uint32_t g;
+    uint8_t r;
+    uint8_t c;
+
+    sim_exact = 0;
+    for (g = 0; g < groups; ++g) {
+        memset(sim_allowed, 0, sizeof(sim_allowed));
+        n = 3 + rand() % 2;
+        for (i = 0; i < n; ++i) {
+            key[i][0] = (uint8_t)(rand() % sim_cfg.rows);
+            key[i][1] = (uint8_t)(rand() % sim_cfg.cols);
+            if (i == 2 && rand() % 2) {
+                key[2][0] = key[1][0];  // Often three corners of a rectangle
+                key[2][1] = key[0][1];
+            }
+            Sim_Key(key[i][0], key[i][1], 1);
+            Sim_Frames(1 + rand() % (2 * Sim_Settle()));
+        }
+        Sim_Frames(rand() % 50);
+        for (i = 0; i < n; ++i) {
+            Sim_Key(key[(i + g) % n][0], key[(i + g) % n][1], 0);
+            Sim_Frames(rand() % (2 * Sim_Settle()));
+        }
+        Sim_Frames(Sim_Settle());
+        for (r = 0; r < sim_cfg.rows; ++r) {
+            for (c = 0; c < sim_cfg.cols; ++c) {
+                left_down += sim_down[r][c] || Matrix_Key_Is_Down(r, c);
+            }
+        }
+    }
+    CHECK(sim_wrong == 0 && left_down == 0);
+    CHECK(Matrix_Key_Ghost_Frames() > 0);
+}
+
+/**
+ * @brief Three corners of a rectangle: the ghost at the fourth is never reported and the third key only once the
+ *        rectangle is broken.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Rectangle(void) {
+    sim_exact = 0;
+    memset(sim_allowed, 0, sizeof(sim_allowed));
+    Sim_Key(0, 0, 1);
+    Sim_Frames(Sim_Settle());
+    Sim_Key(0, 1, 1);
+    Sim_Frames(Sim_Settle());
+    Sim_Key(1, 0, 1);  // (1, 1) reads pressed too
+    Sim_Frames(10 * Sim_Settle());
+    CHECK(sim_down[0][0] && sim_down[0][1] && !sim_down[1][0] && !sim_down[1][1]);
+    Sim_Key(0, 1, 0);
+    Sim_Frames(Sim_Settle());
+    CHECK(sim_down[0][0] && !sim_down[0][1] && sim_down[1][0] && !sim_down[1][1]);
+    Sim_Key(0, 0, 0);
+    Sim_Key(1, 0, 0);
+    Sim_Frames(Sim_Settle());
+    CHECK(!sim_down[0][0] && !sim_down[1][0] && sim_wrong == 0);
+}
+
+/**
+ * @brief Matrix_Key_Stop() halts the scan, releases every row and frees both DMA channels.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Stop(void) {
+    uint16_t rows = 0;
+    uint8_t r;
+    uint8_t free_again;
+
+    Matrix_Key_Stop();
+    Sim_Rows();
+    for (r = 0; r < sim_cfg.rows; ++r) {
+        rows |= sim_cfg.row_pins[r];
+    }
+    CHECK((sim_cfg.row_port->ODR & rows) == rows && !(TIM3->CR1 & TIM_CR1_CEN));
+    free_again = DMA_Mgr_Alloc(3, 3, 3) && DMA_Mgr_Alloc(6, 3, 3);
+    DMA_Mgr_Free(3);
+    DMA_Mgr_Free(6);
+    CHECK(free_again);
+}
+
+/**
+ * @brief A 4x4 keypad on scattered pins of GPIOB and GPIOC.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_4x4(void) {
+    static const Matrix_Key_Config_TypeDef cfg = {
+        GPIOB, {GPIO_Pin_5, GPIO_Pin_0, GPIO_Pin_12, GPIO_Pin_1}, 4, GPIOC,
+        {GPIO_Pin_7, GPIO_Pin_0, GPIO_Pin_6, GPIO_Pin_3},         4, 1000};
+
+    CHECK(Sim_Start(&cfg));
+    Sim_Sweep();
+    Sim_Rectangle();
+    Sim_Two_Keys(20000);
+    Sim_Groups(500);
+    Sim_Stop();
+}
+
+/**
+ * @brief An 8x8 keypad with the rows on GPIOD and the columns on the high half of GPIOE, both out of order.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_8x8(void) {
+    static const Matrix_Key_Config_TypeDef cfg = {
+        GPIOD,
+        {GPIO_Pin_3, GPIO_Pin_7, GPIO_Pin_1, GPIO_Pin_0, GPIO_Pin_6, GPIO_Pin_2, GPIO_Pin_5, GPIO_Pin_4},
+        8,
+        GPIOE,
+        {GPIO_Pin_9, GPIO_Pin_15, GPIO_Pin_8, GPIO_Pin_12, GPIO_Pin_10, GPIO_Pin_14, GPIO_Pin_11, GPIO_Pin_13},
+        8,
+        2000};
+
+    CHECK(Sim_Start(&cfg));
+    Sim_Sweep();
+    Sim_Rectangle();
+    Sim_Two_Keys(20000);
+    Sim_Groups(500);
+    Sim_Stop();
+}
+
+int main(void) {
+    srand(19);
+    Test_4x4();
+    Test_8x8();
+    return TEST_EXIT("test_matrix_key");
+}
@@ -0,0 +1,291 @@
+/**
+ * @file test_motor_pwm.c
+ * @brief Host test of the space-vector modulation, the dead-time encoding and the duty cycles of the TIM1/TIM8
+ *        motor PWM.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Motor_PWM_SVM() must match a table of reference duty cycles, and over a grid of the whole input range plus
+ * random vectors it must agree with the sector-based space-vector modulation, with the zero vectors split evenly,
+ * inside the hexagon, and with the phase voltages centered and clipped to the rails outside it; both references
+ * are computed in double. The line-to-line voltages must be those of the vector inside the hexagon, and the
+ * duty cycles must stay within 0 to MOTOR_PWM_DUTY_ONE everywhere.
+ *
+ * Motor_PWM_Dead_Time() must, for every dead time at several clocks, give the shortest DTG value whose decoded
+ * dead time is not shorter than asked, and reject the ones beyond 1008 clocks. Motor_PWM_Set() must round the Q15
+ * duty cycles to compare values of the half period that Motor_PWM_Init() set.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_motor_pwm
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "motor_pwm.c"
+#include "pwm.c"
+#include "time.c"
+#include "dma.c"
+
+#define SIM_PI 3.14159265358979323846
+#define SIM_TOL 1.5  // Largest difference to the references in Q15 LSB: rounding and the Q15 constants
+
+/**
+ * @brief A reference vector and its duty cycles.
+ */
+typedef struct {
+    int16_t alpha;
+    int16_t beta;
+    uint16_t duty[MOTOR_PWM_PHASES];
+} Sim_Ref_TypeDef;
+
+/**
+ * @brief Reference duty cycles, to the nearest LSB; the last two vectors lie outside the hexagon.
+ */
+static const Sim_Ref_TypeDef sim_ref[] = {
+    {0, 0, {16384, 16384, 16384}},           {32767, 0, {30573, 2195, 2195}},
+    {0, 32767, {16384, 32768, 0}},           {-32768, 0, {2195, 30573, 30573}},
+    {0, -32768, {16384, 0, 32768}},          {16384, 16384, {27574, 21578, 5194}},
+    {23170, 23170, {32209, 23729, 559}},     {-20000, 5000, {6474, 26294, 21294}},
+    {32767, 32767, {32768, 26771, 0}},       {-32768, -32768, {0, 5997, 32768}},
+};
+
+/**
+ * @brief Switching states of the six active vectors, V1 (100) to V6 (101), by phase.
+ */
+static const uint8_t sim_state[6][MOTOR_PWM_PHASES] = {
+    {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0, 1, 1}, {0, 0, 1}, {1, 0, 1},
+};
+
+/**
+ * @brief Sector-based space-vector modulation: the two adjacent active vectors for their times and the zero
+ *        vectors split evenly at both ends.
+ *
+ * @param alpha The alpha component in Q15, 1.0 being Vdc / sqrt(3).
+ * @param beta The beta component in Q15.
+ * @param duty Receives the duty cycles in Q15 LSB.
+ * @return The time of the zero vectors as a fraction of the period, negative outside the hexagon.
+ */
+static double Sim_SVM_Sector(int16_t alpha, int16_t beta, double duty[MOTOR_PWM_PHASES]) {
+    double r = hypot(alpha, beta) / 32768;
+    double theta = atan2(beta, alpha);
+    double phi;
+    double t1;
+    double t2;
+    double t0;
+    int s;
+    int i;
+
+    if (theta < 0) {
+        theta += 2 * SIM_PI;
+    }
+    s = (int)(theta / (SIM_PI / 3)) % 6;
+    phi = theta - s * SIM_PI / 3;
+    t1 = r * sin(SIM_PI / 3 - phi);  // Time of V(s+1), the vector at the start of the sector
+    t2 = r * sin(phi);               // Time of V(s+2)
+    t0 = 1 - t1 - t2;
+    for (i = 0; i < MOTOR_PWM_PHASES; ++i) {
+        duty[i] = (t0 / 2 + t1 * sim_state[s][i] + t2 * sim_state[(s + 1) % 6][i]) * MOTOR_PWM_DUTY_ONE;
+    }
+    return t0;
+}
+
+/**
+ * @brief Phase voltages of the vector centered between the rails and clipped to them.
+ *
+ * @param alpha The alpha component in Q15.
+ * @param beta The beta component in Q15.
+ * @param duty Receives the duty cycles in Q15 LSB.
+ * @return void
+ */
+static void Sim_SVM_Clip(int16_t alpha, int16_t beta, double duty[MOTOR_PWM_PHASES]) {
+    double v[MOTOR_PWM_PHASES];
+    double mid;
+    double d;
+    int i;
+
+    v[0] = alpha / 32768.0;
+    v[1] = -alpha / 65536.0 + sqrt(3) / 2 * beta / 32768.0;
+    v[2] = -alpha / 65536.0 - sqrt(3) / 2 * beta / 32768.0;
+    mid = (fmax(v[0], fmax(v[1], v[2])) + fmin(v[0], fmin(v[1], v[2]))) / 2;
+    for (i = 0; i < MOTOR_PWM_PHASES; ++i) {
+        d = 0.5 + (v[i] - mid) / sqrt(3);
+        duty[i] = fmin(1, fmax(0, d)) * MOTOR_PWM_DUTY_ONE;
+    }
+}
+
+/**
+ * @brief Checks one vector against the references.
+ *
+ * @param alpha The alpha component in Q15.
+ * @param beta The beta component in Q15.
+ * @return 1 if the duty cycles are right.
+ */
+static uint8_t Sim_Check(int16_t alpha, int16_t beta) {
+    uint16_t duty[MOTOR_PWM_PHASES];
+    double sector[MOTOR_PWM_PHASES];
+    double clip[MOTOR_PWM_PHASES];
+    double t0;
+    double line;
+    uint8_t i;
+
+    Motor_PWM_SVM(alpha, beta, duty);
+    t0 = Sim_SVM_Sector(alpha, beta, sector);
+    Sim_SVM_Clip(alpha, beta, clip);
+    for (i = 0; i < MOTOR_PWM_PHASES; ++i) {
+        if (duty[i] > MOTOR_PWM_DUTY_ONE || fabs(duty[i] - clip[i]) > SIM_TOL) {
+            return 0;
+        }
+        if (t0 >= 0 && fabs(duty[i] - sector[i]) > SIM_TOL) {
+            return 0;
+        }
+    }
+    if (t0 >= 1e-3) {  // Inside the hexagon: duty(a) - duty(b) = (va - vb) / Vdc, with 1.0 = Vdc / sqrt(3)
+        line = 1.5 * alpha - sqrt(3) / 2 * beta;
+        if (fabs((double)duty[0] - duty[1] - line / sqrt(3)) > 2 * SIM_TOL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Motor_PWM_SVM() against the reference table, a grid of the whole input range and random vectors.
+ *
+ * @param randoms The number of random vectors.
+ * @return void
+ */
+static void Test_SVM(uint32_t randoms) {
+    uint16_t duty[MOTOR_PWM_PHASES];
+    uint32_t wrong = 0;
+    uint32_t inside = 0;
+    double sector[MOTOR_PWM_PHASES];
+    int32_t a;
+    int32_t b;
+    uint32_t i;
+    uint8_t k;
+
+    for (i = 0; i < sizeof(sim_ref) / sizeof(sim_ref[0]); ++i) {
+        Motor_PWM_SVM(sim_ref[i].alpha, sim_ref[i].beta, duty);
+        for (k = 0; k < MOTOR_PWM_PHASES; ++k) {
+            wrong += abs((int32_t)duty[k] - sim_ref[i].duty[k]) > 1;
+        }
+    }
+    CHECK(wrong == 0);
+
+    for (a = -32768; a <= 32767; a += 61) {
+        for (b = -32768; b <= 32767; b += 61) {
+            wrong += !Sim_Check((int16_t)a, (int16_t)b);
+            inside += Sim_SVM_Sector((int16_t)a, (int16_t)b, sector) >= 0;
+        }
+        wrong += !Sim_Check((int16_t)a, 32767);
+    }
+    for (i = 0; i < randoms; ++i) {
+        wrong += !Sim_Check((int16_t)(rand() & 0xffff), (int16_t)(rand() & 0xffff));
+    }
+    for (i = 0; i < 3600; ++i) {  // Around the inscribed circle, the largest undistorted amplitude
+        a = lround(32767 * cos(i * SIM_PI / 1800));
+        b = lround(32767 * sin(i * SIM_PI / 1800));
+        wrong += !Sim_Check((int16_t)a, (int16_t)b);
+    }
+    CHECK(wrong == 0 && inside > 500000);
+}
+
+/**
+ * @brief Motor_PWM_Dead_Time() for every dead time at several timer clocks, decoded back to clocks.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Dead_Time(void) {
+    static const uint32_t clocks[] = {72000000, 36000000, 8000000, 64000000};
+    uint32_t wrong = 0;
+    uint32_t c;
+    uint32_t ns;
+    uint32_t ticks;
+    uint32_t got;
+    uint32_t below;
+    uint8_t dtg;
+    uint8_t ok;
+
+    for (c = 0; c < sizeof(clocks) / sizeof(clocks[0]); ++c) {
+        for (ns = 0; ns <= 0xffff; ++ns) {
+            ticks = (uint32_t)ceil(ns * (clocks[c] / 1e9) - 1e-9);
+            dtg = 0xaa;
+            ok = Motor_PWM_Dead_Time(clocks[c], (uint16_t)ns, &dtg);
+            if (ticks > 1008) {
+                wrong += ok;
+                continue;
+            }
+            if (!(dtg & 0x80)) {
+                got = dtg;
+                below = got ? got - 1 : 0;
+            } else if ((dtg & 0xc0) == 0x80) {
+                got = (64 + (dtg & 0x3f)) * 2;
+                below = (dtg & 0x3f) ? got - 2 : 127;
+            } else if ((dtg & 0xe0) == 0xc0) {
+                got = (32 + (dtg & 0x1f)) * 8;
+                below = (dtg & 0x1f) ? got - 8 : 254;
+            } else {
+                got = (32 + (dtg & 0x1f)) * 16;
+                below = (dtg & 0x1f) ? got - 16 : 504;
+            }
+            wrong += !ok || got < ticks || (got > ticks && below >= ticks);  // Not shorter, and the shortest
+        }
+    }
+    CHECK(wrong == 0);
+    CHECK(Motor_PWM_Dead_Time(72000000, 1000, &dtg) && dtg == 72);
+    CHECK(Motor_PWM_Dead_Time(72000000, 14000, &dtg) && dtg == 0xff && !Motor_PWM_Dead_Time(72000000, 14001, &dtg));
+}
+
+/**
+ * @brief Motor_PWM_Init() timing and Motor_PWM_Set() compare values, with the duty cycles of Motor_PWM_SVM().
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Set(void) {
+    Motor_PWM_Config_TypeDef cfg = {20000, 500, 40, 0, 1, MOTOR_PWM_BREAK_LOW};
+    uint16_t duty[MOTOR_PWM_PHASES];
+    uint32_t wrong = 0;
+    uint32_t i;
+    uint32_t arr;
+    uint8_t k;
+
+    CHECK(Motor_PWM_Init(2, &cfg) == 0);
+    cfg.adc_lead = 1800;
+    CHECK(Motor_PWM_Init(1, &cfg) == 0);  // The lead must be shorter than the half period
+    cfg.adc_lead = 40;
+    CHECK(Motor_PWM_Init(1, &cfg) == 20000 && TIM1->ARR == 1800 && TIM1->PSC == 0 && TIM1->CCR1 == 900);
+    CHECK((TIM1->BDTR & 0xffu) == 36 && (TIM1->CR1 & 0x0060u) == TIM_CounterMode_CenterAligned1);
+    CHECK(TIM1->CCR4 == 1800 - 40 && !(TIM1->BDTR & TIM_BDTR_MOE));
+
+    arr = TIM1->ARR;
+    for (i = 0; i < 20000; ++i) {
+        Motor_PWM_SVM((int16_t)(rand() & 0xffff), (int16_t)(rand() & 0xffff), duty);
+        Motor_PWM_Set(1, duty);
+        for (k = 0; k < MOTOR_PWM_PHASES; ++k) {
+            wrong += fabs(*(&TIM1->CCR1 + 2 * k) - (double)duty[k] * arr / MOTOR_PWM_DUTY_ONE) > 0.5;
+        }
+    }
+    CHECK(wrong == 0);
+    duty[0] = 0;
+    duty[1] = MOTOR_PWM_DUTY_ONE;
+    duty[2] = 0xffff;  // Clipped
+    Motor_PWM_Set(1, duty);
+    CHECK(TIM1->CCR1 == 0 && TIM1->CCR2 == arr && TIM1->CCR3 == arr);
+    Motor_PWM_Stop(1);
+}
+
+int main(void) {
+    srand(25);
+    Test_SVM(1000000);
+    Test_Dead_Time();
+    Test_Set();
+    return TEST_EXIT("test_motor_pwm");
+}
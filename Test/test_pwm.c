@@ -0,0 +1,430 @@
+/**
+ * @file test_pwm.c
+ * @brief Host test of the TIM2-TIM4 PWM generator: timing, waveform tables and DMA burst playback.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * PWM_Timing() must pick, for every frequency from 1 Hz to half the timer clock, the smallest prescaler whose
+ * period fits 65535 steps, with the steps rounded so that the period is within half a prescaler step of the exact
+ * one, and report the achieved frequency rounded; out-of-range frequencies must return 0. PWM_Sin_Q15() must stay
+ * within its documented 3.2 LSB of the sine at every angle, and the sine and ramp tables must follow their exact
+ * curves to rounding, with the stride gaps untouched.
+ *
+ * The model of the timers runs update events: at each one the preloaded compare registers take effect, and when
+ * the update DMA request is enabled the DMA burst writes the next frame through DMAR into the compare registers
+ * named by DCR. A one-shot playback must put its frames into effect one per period in order and then hold the last
+ * one, call back once and release its DMA channel; a callback that starts the next playback must continue without a
+ * gap. A looping playback must repeat until stopped, and the other channels must keep their duty cycles.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_pwm
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "pwm.c"
+#include "time.c"
+#include "dma.c"
+
+#define SIM_FRAMES 50  // Frames of the one-shot tables
+#define SIM_PI 3.14159265358979323846
+
+static uint16_t sim_table_a[3 * SIM_FRAMES];  // Three-phase sine on CH2-CH4
+static uint16_t sim_table_b[3 * SIM_FRAMES];  // Ramps on CH2-CH4, chained after sim_table_a
+static uint16_t sim_ramp[37];                 // Looping table of one channel
+static uint16_t sim_active[5][PWM_CHANNELS];  // Compare values in effect, by timer
+static uint32_t sim_done;                     // One-shot callbacks
+static uint8_t sim_done_tim;                  // Timer of the last callback
+static uint8_t sim_chain;                     // 1 to start sim_table_b from the callback
+
+/**
+ * @brief The compare register of a channel.
+ *
+ * @param tim The timer registers.
+ * @param ch The channel, 1-4.
+ * @return The register.
+ */
+static __IO uint16_t *Sim_CCR(TIM_TypeDef *tim, uint8_t ch) {
+    return &tim->CCR1 + 2 * (ch - 1);
+}
+
+/**
+ * @brief An update event: the preloaded compare values take effect, then the update DMA request moves one burst
+ *        through DMAR.
+ *
+ * @param tim The timer, 2-4.
+ * @return void
+ */
+static void Sim_Update(uint8_t tim) {
+    TIM_TypeDef *t = pwm_timer[tim - 2].tim;
+    uint8_t base;
+    uint8_t len;
+    uint8_t ch;
+    uint8_t i;
+
+    for (ch = 1; ch <= PWM_CHANNELS; ++ch) {
+        if (*(ch < 3 ? &t->CCMR1 : &t->CCMR2) & (TIM_OCPreload_Enable << ((ch - 1) & 1) * 8)) {
+            sim_active[tim][ch - 1] = *Sim_CCR(t, ch);
+        }
+    }
+    if (!(t->DIER & TIM_DMA_Update)) {
+        return;
+    }
+    base = (uint8_t)(t->DCR & 0x1f) - TIM_DMABase_CCR1 + 1;
+    len = (uint8_t)((t->DCR >> 8) & 0x1f) + 1;
+    for (i = 0; i < len; ++i) {
+        if (!Host_DMA_Request(DMA_Mgr_Channel(pwm_timer[tim - 2].dma))) {
+            break;
+        }
+        *Sim_CCR(t, base + i) = t->DMAR;
+    }
+}
+
+/**
+ * @brief One-shot callback: counts the call and starts sim_table_b if asked to.
+ *
+ * @param tim The timer.
+ * @return void
+ */
+static void Sim_Done(uint8_t tim) {
+    sim_done++;
+    sim_done_tim = tim;
+    if (sim_chain) {
+        sim_chain = 0;
+        PWM_Play(tim, 2, 3, sim_table_b, SIM_FRAMES, 0, Sim_Done);
+    }
+}
+
+/**
+ * @brief PWM_Timing() over every frequency up to 200 kHz and random ones up to the limit, at several clocks.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Timing(void) {
+    static const uint32_t clocks[] = {72000000, 36000000, 64000000, 8000000, 1000000, 48000000, 71999999};
+    uint32_t wrong = 0;
+    uint32_t checked = 0;
+    uint32_t c;
+    uint32_t k;
+    uint32_t clk;
+    uint32_t freq;
+    uint32_t got;
+    uint16_t steps;
+    uint16_t psc;
+    double div;
+    double ratio;
+
+    for (c = 0; c < sizeof(clocks) / sizeof(clocks[0]); ++c) {
+        clk = clocks[c];
+        for (k = 0; k < 300000; ++k) {
+            if (k < 200000) {
+                freq = k;
+            } else if (k < 200004) {
+                freq = clk / 2 - 2 + (k - 200000);  // Around the upper limit
+            } else {
+                freq = (uint32_t)exp(log(clk / 2.0) * rand() / RAND_MAX);  // Log-uniform
+            }
+            ratio = (double)clk / freq;
+            steps = 0;
+            psc = 0;
+            got = PWM_Timing(clk, freq, &steps, &psc);
+            checked++;
+            if (freq == 0 || freq > clk / 2) {
+                wrong += got != 0;
+                continue;
+            }
+            if (got == 0) {
+                wrong += ratio < 65536.0 * 65535;  // Only periods beyond the largest prescaler are rejected
+                continue;
+            }
+            div = psc + 1.0;
+            wrong += steps < 2;
+            wrong += fabs(div * steps - ratio) > div / 2 + 1e-6;            // Steps rounded
+            wrong += div > 1 && ratio / (div - 1) < 65535.5 - 1e-6;         // Smallest prescaler that fits
+            wrong += div > 1 && steps < 0x8000;                             // So at least 15 bits of duty
+            wrong += fabs(got - (double)clk / (div * steps)) > 0.5 + 1e-6;  // Achieved frequency, rounded
+        }
+    }
+    CHECK(wrong == 0 && checked > 2000000);
+
+    CHECK(PWM_Timing(72000000, 1000, &steps, &psc) == 1000 && psc == 1 && steps == 36000);
+    CHECK(PWM_Timing(72000000, 20000, &steps, &psc) == 20000 && psc == 0 && steps == 3600);
+    CHECK(PWM_Timing(72000000, 1, &steps, &psc) == 1 && psc == 1098 && steps == 65514);
+    CHECK(PWM_Timing(72000000, 36000000, &steps, &psc) == 36000000 && psc == 0 && steps == 2);
+    CHECK(PWM_Timing(0xffffffffu / 2, 0, &steps, &psc) == 0 && PWM_Timing(72000000, 36000001, &steps, &psc) == 0);
+}
+
+/**
+ * @brief PWM_Sin_Q15() at every angle against the sine, and its symmetry.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Sin(void) {
+    double err;
+    double max_err = 0;
+    uint32_t a;
+    uint32_t wrong = 0;
+
+    for (a = 0; a < 0x10000; ++a) {
+        err = fabs(PWM_Sin_Q15((uint16_t)a) - 32767 * sin(a * 2 * SIM_PI / 65536));
+        if (err > max_err) {
+            max_err = err;
+        }
+        wrong += PWM_Sin_Q15((uint16_t)a) != -PWM_Sin_Q15((uint16_t)(0x10000 - a)) && a != 0;
+        wrong += PWM_Sin_Q15((uint16_t)a) != PWM_Sin_Q15((uint16_t)(0x8000 - a));
+    }
+    CHECK(max_err <= 3.2 && wrong == 0);
+    CHECK(PWM_Sin_Q15(0) == 0 && PWM_Sin_Q15(0x4000) == 32767 && PWM_Sin_Q15(0xc000) == -32767);
+}
+
+/**
+ * @brief Sine and ramp tables over random sizes, strides, phases and ranges against their exact curves.
+ *
+ * @param runs The number of random tables of each kind.
+ * @return void
+ */
+static void Test_Tables(uint32_t runs) {
+    static uint16_t table[4 * 1024 + 4];
+    uint32_t wrong = 0;
+    uint32_t r;
+    uint32_t k;
+    uint16_t frames;
+    uint8_t stride;
+    uint16_t phase;
+    uint16_t top;
+    uint16_t from;
+    uint16_t to;
+    uint8_t squared;
+    double exact;
+    double pos;
+    double bound;
+
+    for (r = 0; r < runs; ++r) {
+        frames = (uint16_t)(1 + rand() % 1024);
+        stride = (uint8_t)(1 + rand() % 4);
+        phase = (uint16_t)rand();
+        top = (uint16_t)(rand() % 2 ? 1 + rand() % 0xffff : 2 + rand() % 200);
+        memset(table, 0xa5, sizeof(table));
+        PWM_Table_Sine(table, frames, stride, phase, top);
+        bound = 0.5 + top * (3.2 / 65534 + SIM_PI / 131072) + 1e-9;  // Rounding, sine error and angle rounding
+        for (k = 0; k < (uint32_t)frames * stride; ++k) {
+            if (k % stride) {
+                wrong += table[k] != 0xa5a5;
+                continue;
+            }
+            exact = top * (1 + sin(2 * SIM_PI * (phase / 65536.0 + (double)(k / stride) / frames))) / 2;
+            wrong += table[k] > top || fabs(table[k] - exact) > bound;
+        }
+        wrong += table[(uint32_t)frames * stride] != 0xa5a5;
+
+        from = (uint16_t)rand();
+        to = (uint16_t)(rand() % 4 ? rand() : from);
+        squared = (uint8_t)(rand() % 2);
+        memset(table, 0xa5, sizeof(table));
+        PWM_Table_Ramp(table, frames, stride, from, to, squared);
+        for (k = 0; k < frames; ++k) {
+            pos = frames > 1 ? (double)k / (frames - 1) : 1;
+            if (from > to) {
+                pos = 1 - pos;  // From the lower end
+            }
+            exact = (from < to ? from : to) + fabs((double)to - from) * (squared ? pos * pos : pos);
+            wrong += fabs(table[k * stride] - exact) > 0.5 + 1e-9;
+            wrong += k > 0 && (from < to ? table[k * stride] < table[(k - 1) * stride]
+                                         : table[k * stride] > table[(k - 1) * stride]);
+        }
+        wrong += table[(frames - 1) * stride] != to || (frames > 1 && table[0] != from);
+        wrong += stride > 1 && table[1] != 0xa5a5;
+    }
+    CHECK(wrong == 0);
+}
+
+/**
+ * @brief PWM_Init(), PWM_Channel_Start(), PWM_Set_Duty() and PWM_Channel_Stop() on all timers and channels.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Channels(void) {
+    static GPIO_TypeDef *const port[3] = {GPIOA, GPIOC, GPIOB};
+    static const uint8_t pin0[3] = {0, 6, 6};
+    uint32_t wrong = 0;
+    uint32_t freq;
+    uint32_t got;
+    uint16_t steps;
+    uint16_t psc;
+    uint16_t duty[PWM_CHANNELS];
+    uint8_t low;
+    uint8_t tim;
+    uint8_t ch;
+    uint8_t pin;
+    TIM_TypeDef *t;
+    __IO uint32_t *cr;
+
+    CHECK(!PWM_Channel_Start(4, 1, 5000, 0) && PWM_Steps(4) == 0);  // Not initialized
+    CHECK(!PWM_Init(1, 1000) && !PWM_Init(5, 1000) && PWM_Steps(1) == 0 && PWM_Steps(5) == 0);
+    TIM2->ARR = 1234;
+    CHECK(!PWM_Init(2, 0) && !PWM_Init(2, 36000001) && TIM2->ARR == 1234 && PWM_Steps(2) == 0);
+
+    for (tim = 2; tim <= 4; ++tim) {
+        t = pwm_timer[tim - 2].tim;
+        freq = 1 + (uint32_t)exp(log(100000.0) * rand() / RAND_MAX);
+        got = PWM_Init(tim, freq);
+        wrong += got != PWM_Timing(72000000, freq, &steps, &psc) || PWM_Steps(tim) != steps;
+        wrong += t->ARR != steps - 1 || t->PSC != psc || !(t->CR1 & TIM_CR1_CEN) || !(t->CR1 & 0x0080u);
+        for (ch = 1; ch <= PWM_CHANNELS; ++ch) {
+            duty[ch - 1] = (uint16_t)(rand() % (PWM_DUTY_MAX + 1));
+            low = (uint8_t)(rand() % 2);
+            wrong += !PWM_Channel_Start(tim, ch, duty[ch - 1], low);
+            wrong += *Sim_CCR(t, ch) != (steps * duty[ch - 1] + PWM_DUTY_MAX / 2) / PWM_DUTY_MAX;
+            wrong += ((t->CCER >> 4 * (ch - 1)) & 0x3u) != (low ? 0x3u : 0x1u);
+            wrong += ((*(ch < 3 ? &t->CCMR1 : &t->CCMR2) >> ((ch - 1) & 1) * 8) & 0x78u) != 0x68u;  // PWM1, preload
+            pin = pin0[tim - 2] + ch - 1;
+            cr = pin < 8 ? &port[tim - 2]->CRL : &port[tim - 2]->CRH;
+            wrong += ((*cr >> (pin & 7) * 4) & 0xfu) != 0xbu;  // Alternate push-pull, 50 MHz
+        }
+        wrong += !PWM_Channel_Start(tim, 1, 0, 0) || *Sim_CCR(t, 1) != 0;
+        wrong += !PWM_Channel_Start(tim, 1, PWM_DUTY_MAX, 0) || *Sim_CCR(t, 1) != steps;
+        duty[0] = PWM_DUTY_MAX;
+        wrong += PWM_Channel_Start(tim, 0, 100, 0) || PWM_Channel_Start(tim, 5, 100, 0);
+        wrong += PWM_Channel_Start(tim, 2, PWM_DUTY_MAX + 1, 0);
+
+        got = PWM_Init(tim, freq * 3 + 7);  // Other period, same duty cycles
+        wrong += got != PWM_Timing(72000000, freq * 3 + 7, &steps, &psc) || t->ARR != steps - 1;
+        for (ch = 1; ch <= PWM_CHANNELS; ++ch) {
+            wrong += *Sim_CCR(t, ch) != (steps * duty[ch - 1] + PWM_DUTY_MAX / 2) / PWM_DUTY_MAX;
+        }
+        wrong += !(t->EGR & TIM_EventSource_Update);
+
+        PWM_Set_Duty(tim, 3, 2500);
+        wrong += *Sim_CCR(t, 3) != (steps * 2500u + PWM_DUTY_MAX / 2) / PWM_DUTY_MAX;
+        PWM_Set_Duty(tim, 3, 12000);  // Clipped
+        wrong += *Sim_CCR(t, 3) != steps;
+        PWM_Set_Duty(tim, 3, duty[2]);
+
+        PWM_Channel_Stop(tim, 4);
+        pin = pin0[tim - 2] + 3;
+        cr = pin < 8 ? &port[tim - 2]->CRL : &port[tim - 2]->CRH;
+        wrong += (t->CCER & 0x1000u) || ((*cr >> (pin & 7) * 4) & 0xfu) != 0x4u || !(t->CCER & 0x0100u);
+        wrong += !PWM_Channel_Start(tim, 4, duty[3], 0);
+    }
+    CHECK(wrong == 0);
+}
+
+/**
+ * @brief Checks the compare values in effect on CH2-CH4 of TIM3 against a frame, and CH1 against its duty cycle.
+ *
+ * @param frame The frame of three values.
+ * @param ch1 The compare value of CH1.
+ * @return 1 if they match.
+ */
+static uint8_t Sim_Frame(const uint16_t *frame, uint16_t ch1) {
+    return sim_active[3][0] == ch1 && sim_active[3][1] == frame[0] && sim_active[3][2] == frame[1] &&
+           sim_active[3][3] == frame[2];
+}
+
+/**
+ * @brief One-shot playbacks on TIM3, one chained from the callback of the other, then looping and replaced
+ *        playbacks on TIM2, and the argument and DMA channel checks of PWM_Play().
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Play(void) {
+    uint32_t wrong = 0;
+    uint32_t u;
+    uint32_t f;
+    uint16_t steps;
+    uint16_t ch1;
+    uint8_t ch;
+
+    PWM_Init(3, 20000);
+    steps = PWM_Steps(3);
+    for (ch = 1; ch <= PWM_CHANNELS; ++ch) {
+        PWM_Channel_Start(3, ch, 5000, 0);
+    }
+    ch1 = *Sim_CCR(TIM3, 1);
+    PWM_Table_Sine(sim_table_a, SIM_FRAMES, 3, 0, steps);
+    PWM_Table_Sine(sim_table_a + 1, SIM_FRAMES, 3, 21845, steps);
+    PWM_Table_Sine(sim_table_a + 2, SIM_FRAMES, 3, 43691, steps);
+    PWM_Table_Ramp(sim_table_b, SIM_FRAMES, 3, 0, steps, 0);
+    PWM_Table_Ramp(sim_table_b + 1, SIM_FRAMES, 3, steps, 0, 1);
+    PWM_Table_Ramp(sim_table_b + 2, SIM_FRAMES, 3, steps / 4, steps / 2, 1);
+
+    sim_chain = 1;
+    CHECK(PWM_Play(3, 2, 3, sim_table_a, SIM_FRAMES, 0, Sim_Done));
+    CHECK(TIM3->DCR == (TIM_DMABase_CCR2 | TIM_DMABurstLength_3Transfers) && (TIM3->DIER & TIM_DMA_Update));
+    for (u = 1; u <= 2 * SIM_FRAMES + 10; ++u) {
+        Sim_Update(3);
+        if (u < 2) {
+            continue;
+        }
+        f = u - 2;  // The frame written at an update takes effect at the next one
+        if (f < SIM_FRAMES) {
+            wrong += !Sim_Frame(&sim_table_a[3 * f], ch1);
+        } else if (f < 2 * SIM_FRAMES) {
+            wrong += !Sim_Frame(&sim_table_b[3 * (f - SIM_FRAMES)], ch1);
+        } else {
+            wrong += !Sim_Frame(&sim_table_b[3 * (SIM_FRAMES - 1)], ch1);  // The last frame holds
+        }
+        wrong += sim_done != (u < SIM_FRAMES ? 0u : u < 2 * SIM_FRAMES ? 1u : 2u);
+    }
+    CHECK(wrong == 0 && sim_done == 2 && sim_done_tim == 3 && !(TIM3->DIER & TIM_DMA_Update));
+    CHECK(DMA_Mgr_Alloc(3, 3, 3));                  // Released
+    CHECK(!PWM_Play(3, 1, 1, sim_ramp, 10, 1, 0));  // Owned by another driver
+    DMA_Mgr_Free(3);
+
+    PWM_Init(2, 1000);
+    steps = PWM_Steps(2);
+    for (ch = 1; ch <= PWM_CHANNELS; ++ch) {
+        PWM_Channel_Start(2, ch, 2000 * ch, 0);
+    }
+    PWM_Table_Ramp(sim_ramp, 37, 1, 0, steps, 1);
+    CHECK(PWM_Play(2, 1, 1, sim_table_a, SIM_FRAMES, 1, 0));
+    Sim_Update(2);
+    Sim_Update(2);
+    CHECK(sim_active[2][0] == sim_table_a[0]);
+    CHECK(PWM_Play(2, 1, 1, sim_ramp, 37, 1, 0));  // Replaces the running one from its first frame
+    for (u = 1; u <= 37 * 3 + 5; ++u) {
+        Sim_Update(2);
+        if (u >= 2) {
+            wrong += sim_active[2][0] != sim_ramp[(u - 2) % 37];
+        }
+        for (ch = 2; ch <= PWM_CHANNELS; ++ch) {
+            wrong += sim_active[2][ch - 1] != (steps * 2000u * ch + PWM_DUTY_MAX / 2) / PWM_DUTY_MAX;
+        }
+    }
+    CHECK(wrong == 0 && (TIM2->DIER & TIM_DMA_Update) && DMA_Mgr_Busy(2));
+    f = *Sim_CCR(TIM2, 1);
+    PWM_Play_Stop(2);
+    Sim_Update(2);
+    Sim_Update(2);
+    CHECK(!(TIM2->DIER & TIM_DMA_Update) && DMA_Mgr_Alloc(2, 3, 3) && sim_active[2][0] == f);  // The last frame holds
+    DMA_Mgr_Free(2);
+
+    PWM_Init(4, 50);
+    CHECK(!PWM_Play(4, 0, 1, sim_ramp, 10, 0, 0) && !PWM_Play(4, 2, 4, sim_ramp, 10, 0, 0));
+    CHECK(!PWM_Play(4, 1, 0, sim_ramp, 10, 0, 0) && !PWM_Play(4, 1, 1, sim_ramp, 0, 0, 0));
+    CHECK(!PWM_Play(4, 1, 4, sim_ramp, 16384, 0, 0) && !PWM_Play(5, 1, 1, sim_ramp, 10, 0, 0));
+    CHECK(PWM_Play(4, 1, 4, sim_ramp, 16383, 1, 0));  // Longest table of four channels, not played here
+    CHECK(TIM4->DCR == (TIM_DMABase_CCR1 | TIM_DMABurstLength_4Transfers) && DMA_Mgr_Channel(7)->CNDTR == 65532);
+    PWM_Play_Stop(4);
+}
+
+int main(void) {
+    srand(24);
+    Test_Timing();
+    Test_Sin();
+    Test_Tables(3000);
+    Test_Channels();
+    Test_Play();
+    return TEST_EXIT("test_pwm");
+}
@@ -0,0 +1,366 @@
+/**
+ * @file test_pwm_input.c
+ * @brief Host test of the TIM5 PWM-input meter across the prescaler and auto-reload range.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The model plays a pulse train on PA0 edge by edge in timer clock cycles and does what TIM5 does in PWM-input
+ * mode: a rising edge captures the ticks since the previous reset into CCR1, then resets the counter and its
+ * prescaler; a falling edge captures into CCR2; a count past the auto-reload value wraps and sets the update flag.
+ * Every CC1 capture requests the two transfers of the DMA burst, which read CCR1 and then CCR2 through DMAR.
+ *
+ * PWMI_Init() must check its arguments and set up the timer, the slave controller and the DMA ring as described.
+ * Over several hundred prescaler and auto-reload settings, from one clock cycle per tick to 65536 and from 2 to
+ * 65535 ticks, with jittered and with tick-aligned periods and any duty cycle, the mean period, high time, duty
+ * cycle and frequency over the newest 1 to 31 periods must lie within one tick per period of the true ones, and be
+ * exact up to rounding when the edges fall on ticks; a read between the two transfers of a burst must only use
+ * complete pairs. An overflow must read as no signal, and the measurement must resume without the first pair of
+ * the restarted ring. PWMI_Stop() must stop the timer and the DMA.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_pwm_input
+ */
+
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+
+static uint8_t led2;  // LED of Timer/time.c
+
+#include "pwm_input.c"
+#include "time.c"
+
+#define SIM_PERIODS 40  // Periods played per setting
+
+/**
+ * @brief A period as played, in timer clock cycles.
+ */
+typedef struct {
+    uint64_t period;  // Rising edge to rising edge
+    uint64_t high;    // Rising edge to falling edge
+} Sim_Period;
+
+static uint64_t sim_now;    // Time in timer clock cycles
+static uint64_t sim_reset;  // Last counter reset
+static uint64_t sim_wraps;  // Overflows since the last reset that have set the update flag
+static uint32_t sim_div;    // Cycles per tick
+static uint32_t sim_arr;    // Auto-reload value
+static Sim_Period sim_period[SIM_PERIODS * 2];
+static uint32_t sim_captures;  // CC1 captures since the ring (re)started, the first is not a period
+static uint64_t sim_rise;      // Time of the previous rising edge, 0 before the first
+
+/**
+ * @brief The counter at a time, setting the update flag on each overflow not seen before.
+ *
+ * @param t The time.
+ * @return The counter.
+ */
+static uint16_t Sim_Count(uint64_t t) {
+    uint64_t ticks = (t - sim_reset) / sim_div;
+
+    if (ticks / (sim_arr + 1) > sim_wraps) {
+        TIM5->SR |= TIM_FLAG_Update;
+        sim_wraps = ticks / (sim_arr + 1);
+    }
+    return (uint16_t)(ticks % (sim_arr + 1));
+}
+
+/**
+ * @brief Starts the meter and the model.
+ *
+ * @param arr The auto-reload value.
+ * @param psc The prescaler value.
+ * @return The tick rate PWMI_Init() returned.
+ */
+static uint32_t Sim_Start(uint16_t arr, uint16_t psc) {
+    uint32_t hz;
+
+    TIM5->CCR1 = 0;
+    TIM5->CCR2 = 0;
+    hz = PWMI_Init(arr, psc, 0);
+    sim_div = (uint32_t)psc + 1;
+    sim_arr = arr;
+    sim_reset = sim_now;
+    sim_wraps = 0;
+    sim_captures = 0;
+    sim_rise = 0;
+    return hz;
+}
+
+/**
+ * @brief A rising edge: CCR1 takes the count, the counter resets and the DMA burst copies CCR1 and CCR2.
+ *
+ * @param half_burst 1 to stop after the first transfer of the burst; Sim_Burst_End() does the second.
+ * @return void
+ */
+static void Sim_Rise(uint8_t half_burst) {
+    TIM5->CCR1 = Sim_Count(sim_now);
+    sim_reset = sim_now;
+    sim_wraps = 0;
+    if (sim_rise && sim_captures < SIM_PERIODS * 2) {
+        sim_period[sim_captures].period = sim_now - sim_rise;
+    }
+    sim_rise = sim_now;
+    TIM5->DMAR = TIM5->CCR1;
+    Host_DMA_Request(DMA2_Channel5);
+    if (!half_burst) {
+        TIM5->DMAR = TIM5->CCR2;
+        Host_DMA_Request(DMA2_Channel5);
+        sim_captures++;
+    }
+}
+
+/**
+ * @brief The second transfer of a burst that Sim_Rise() left half done.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Burst_End(void) {
+    TIM5->DMAR = TIM5->CCR2;
+    Host_DMA_Request(DMA2_Channel5);
+    sim_captures++;
+}
+
+/**
+ * @brief A falling edge: CCR2 takes the count since the last rising edge.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Fall(void) {
+    TIM5->CCR2 = Sim_Count(sim_now);
+    if (sim_captures < SIM_PERIODS * 2) {
+        sim_period[sim_captures].high = sim_now - sim_rise;
+    }
+}
+
+/**
+ * @brief Plays periods of a pulse train, each jittered by up to jitter cycles; the last rising edge ends them.
+ *
+ * @param periods The number of periods.
+ * @param period The mean period in cycles.
+ * @param high The mean high time in cycles, below period.
+ * @param jitter The largest change of a period and its high time in cycles.
+ * @return void
+ */
+static void Sim_Play(uint32_t periods, uint64_t period, uint64_t high, uint32_t jitter) {
+    uint64_t p;
+    uint64_t h;
+    uint32_t i;
+
+    if (!sim_rise) {
+        Sim_Rise(0);
+    }
+    for (i = 0; i < periods; ++i) {
+        p = period + (jitter ? (uint64_t)(rand() % (2 * jitter + 1)) - jitter : 0);
+        h = high + (jitter ? (uint64_t)(rand() % (2 * jitter + 1)) - jitter : 0);
+        if (h < 1) {
+            h = 1;
+        }
+        if (h >= p) {
+            h = p - 1;
+        }
+        sim_now += h;
+        Sim_Fall();
+        sim_now += p - h;
+        Sim_Rise(0);
+    }
+}
+
+/**
+ * @brief Reads the meter and checks it against the periods played: within one tick per period, exact up to
+ *        rounding when aligned.
+ *
+ * @param n The periods to average.
+ * @param aligned 1 if every edge fell on a tick.
+ * @return 1 if the result is right.
+ */
+static uint8_t Sim_Check(uint16_t n, uint8_t aligned) {
+    Capture_Result_TypeDef res;
+    uint32_t want = sim_captures > 1 ? sim_captures - 1 : 0;
+    uint64_t period = 0;
+    uint64_t high = 0;
+    double clk = TIM_APB1_Clock();
+    double f_lo;
+    double f_hi;
+    double d_lo;
+    double d_hi;
+    double p_ticks;
+    double h_ticks;
+    uint32_t k;
+
+    if (want > PWMI_RING - 1) {
+        want = PWMI_RING - 1;
+    }
+    if (want > n) {
+        want = n;
+    }
+    if (!PWMI_Read(n, &res)) {
+        return want == 0;
+    }
+    if (res.periods != want || want == 0) {
+        return 0;
+    }
+    for (k = sim_captures - want; k < sim_captures; ++k) {
+        period += sim_period[k].period;
+        high += sim_period[k].high;
+    }
+    p_ticks = (double)period / sim_div;  // The captures sum to within want ticks below
+    h_ticks = (double)high / sim_div;
+    if (aligned) {
+        f_lo = f_hi = want * clk * 1000 / (double)period;
+        d_lo = d_hi = 10000 * h_ticks / p_ticks;
+    } else {
+        f_lo = want * clk * 1000 / (double)period;
+        f_hi = p_ticks > want ? want * clk * 1000 / ((p_ticks - want) * sim_div) : 1e30;
+        d_lo = h_ticks > want ? 10000 * (h_ticks - want) / p_ticks : 0;
+        d_hi = p_ticks > want ? 10000 * h_ticks / (p_ticks - want) : 10000;
+    }
+    f_lo = f_lo > 0xffffffffu ? 0xffffffffu : f_lo - 0.5;
+    f_hi = f_hi > 0xffffffffu ? 0xffffffffu : f_hi + 0.5;
+    return res.freq_mhz >= f_lo && res.freq_mhz <= f_hi && res.duty >= d_lo - 0.5 && res.duty <= d_hi + 0.5 &&
+           res.period >= (p_ticks - want) / want - 0.5 && res.period <= p_ticks / want + 0.5 &&
+           res.width + 0.5 >= (h_ticks - want) / want && res.width <= h_ticks / want + 0.5;
+}
+
+/**
+ * @brief PWMI_Init() checks its arguments and sets up TIM5 in PWM-input mode with the DMA burst ring;
+ *        PWMI_Stop() stops both.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Init(void) {
+    CHECK(PWMI_Init(1, 71, 0) == 0);
+    CHECK(PWMI_Init(1000, 71, 0x10) == 0);
+    CHECK(Sim_Start(0xffff, 71) == 1000000);
+    CHECK(Sim_Start(1000, 65535) == 1099);  // 1098.6 Hz, rounded
+    CHECK(Sim_Start(999, 71) == 1000000);
+    CHECK(TIM5->ARR == 999 && TIM5->PSC == 71 && (TIM5->CR1 & TIM_CR1_CEN) && (TIM5->CR1 & 0x0004u));
+    CHECK((TIM5->SMCR & 0x0077u) == (TIM_TS_TI1FP1 | TIM_SlaveMode_Reset));
+    CHECK((TIM5->CCMR1 & 0x0303u) == 0x0201u && (TIM5->CCER & 0x00ffu) == 0x0031u);  // CH1 direct, CH2 indirect
+    CHECK(TIM5->DCR == (TIM_DMABase_CCR1 | TIM_DMABurstLength_2Transfers) && (TIM5->DIER & TIM_DMA_CC1));
+    CHECK(!(TIM5->DIER & ~TIM_DMA_CC1) && !(TIM5->SR & TIM_FLAG_Update));  // No interrupt at all
+    CHECK(DMA2_Channel5->CPAR == (uint32_t)&TIM5->DMAR && DMA2_Channel5->CMAR == (uint32_t)pwmi_ring);
+    CHECK(DMA2_Channel5->CNDTR == 2 * PWMI_RING && (DMA2_Channel5->CCR & DMA_CCR1_EN) &&
+          (DMA2_Channel5->CCR & DMA_Mode_Circular) && !(DMA2_Channel5->CCR & DMA_DIR_PeripheralDST));
+
+    PWMI_Stop();
+    CHECK(!(TIM5->CR1 & TIM_CR1_CEN) && !(TIM5->DIER & TIM_DMA_CC1) && !(DMA2_Channel5->CCR & DMA_CCR1_EN));
+}
+
+/**
+ * @brief Pulse trains over random and extreme prescaler and auto-reload settings, read over 1 to 31 periods,
+ *        also in the middle of a burst.
+ *
+ * @param settings The number of random settings.
+ * @return void
+ */
+static void Test_Sweep(uint32_t settings) {
+    static const uint16_t psc_edge[] = {0, 0, 1, 71, 719, 7199, 65535, 65535};
+    static const uint16_t arr_edge[] = {2, 0xffff, 3, 999, 0xffff, 2, 2, 0xffff};
+    static const uint16_t reads[] = {1, 2, 7, 31, 40};
+    uint32_t wrong = 0;
+    uint32_t aligned_runs = 0;
+    uint32_t s;
+    uint32_t i;
+    uint16_t arr;
+    uint16_t psc;
+    uint32_t ticks;
+    uint64_t period;
+    uint64_t high;
+    uint8_t aligned;
+
+    for (s = 0; s < settings; ++s) {
+        if (s < sizeof(psc_edge) / sizeof(psc_edge[0])) {
+            psc = psc_edge[s];
+            arr = arr_edge[s];
+        } else {
+            psc = (uint16_t)(rand() % 4 ? rand() % 1000 : rand() % 65536);
+            arr = (uint16_t)(2 + rand() % 65534);
+        }
+        aligned = s % 2;
+        Sim_Start(arr, psc);
+
+        ticks = 2 + (uint32_t)((arr - 2) * ((double)rand() / RAND_MAX) * ((double)rand() / RAND_MAX));
+        period = (uint64_t)ticks * sim_div;
+        if (!aligned && ticks < arr) {
+            period += rand() % sim_div;  // Anywhere within the last tick
+        }
+        high = 1 + (uint64_t)((period - 1) * ((double)rand() / RAND_MAX));
+        if (high >= period) {
+            high = period - 1;
+        }
+        if (aligned) {
+            high = high / sim_div * sim_div;
+            if (high == 0) {
+                high = sim_div;
+            }
+        }
+
+        Sim_Play(SIM_PERIODS - 1, period, high, 0);
+        for (i = 0; i < sizeof(reads) / sizeof(reads[0]); ++i) {
+            wrong += !Sim_Check(reads[i], aligned);
+        }
+        aligned_runs += aligned;
+
+        if (!aligned && ticks + 1 < arr && period > 2 * sim_div) {  // Jittered by up to a tick
+            Sim_Play(PWMI_RING, period, high, sim_div);
+            wrong += !Sim_Check(PWMI_RING - 1, 0);
+        }
+
+        sim_now += high;  // A read between the two transfers of a burst only uses complete pairs
+        Sim_Fall();
+        sim_now += period - high;
+        Sim_Rise(1);
+        wrong += !Sim_Check(7, aligned);
+        Sim_Burst_End();
+        wrong += !Sim_Check(7, aligned);
+    }
+    CHECK(wrong == 0 && aligned_runs == settings / 2);
+}
+
+/**
+ * @brief A signal that stops or slows down past the auto-reload value reads as no signal once, and the measurement
+ *        resumes from the next periods without the first pair of the restarted ring.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Overflow(void) {
+    Capture_Result_TypeDef res;
+
+    Sim_Start(1000, 71);
+    Sim_Play(10, 500 * 72, 125 * 72, 0);
+    CHECK(Sim_Check(7, 1));
+
+    sim_now += 1001 * 72;  // The signal stops
+    Sim_Count(sim_now);
+    CHECK(!PWMI_Read(7, &res) && !(TIM5->SR & TIM_FLAG_Update));
+    sim_captures = 0;
+    sim_rise = 0;
+    CHECK(!PWMI_Read(7, &res));
+    Sim_Play(1, 400 * 72, 100 * 72, 0);  // The first pair after the restart is not a period
+    CHECK(Sim_Check(7, 1) && PWMI_Read(7, &res) && res.periods == 1 && res.period == 400 && res.duty == 2500);
+    Sim_Play(PWMI_RING + 3, 400 * 72, 300 * 72, 0);
+    CHECK(Sim_Check(40, 1) && PWMI_Read(40, &res) && res.periods == PWMI_RING - 1 && res.freq_mhz == 2500000);
+
+    Sim_Play(5, 800 * 72, 400 * 72, 0);  // One slow period, then the signal is back before the read
+    Sim_Play(1, 1500 * 72, 700 * 72, 0);
+    Sim_Play(5, 800 * 72, 400 * 72, 0);
+    CHECK(!PWMI_Read(7, &res));
+    sim_captures = 0;
+    Sim_Play(3, 600 * 72, 150 * 72, 0);
+    CHECK(Sim_Check(7, 1) && PWMI_Read(7, &res) && res.periods == 2 && res.width == 150);
+    PWMI_Stop();
+}
+
+int main(void) {
+    srand(23);
+    Test_Init();
+    Test_Sweep(400);
+    Test_Overflow();
+    return TEST_EXIT("test_pwm_input");
+}
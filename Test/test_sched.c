@@ -0,0 +1,588 @@
+/**
+ * @file test_sched.c
+ * @brief Host test of the run-to-completion scheduler, and a host port of it on threads with a latency benchmark.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * The deterministic part runs on one thread. A reference model of the priority queues must predict every
+ * dispatch and every drop of a long random sequence of posts and runs. Then interrupts that post are injected at
+ * every LDREX, STREX, CLREX and DMB the queues execute, nested two deep, with the exclusive monitor cleared on
+ * exception return as on the core: every accepted event must be dispatched once, in the order its position was
+ * claimed, and every refused one counted as dropped. Scheduler timers must post in deadline order with their
+ * expiry tick as data, also when the loop runs late. Sched_Run() must only ever sleep with interrupts masked and
+ * nothing queued, also when an interrupt posts just before it masks them.
+ *
+ * The host port runs Sched_Run() on its own thread with LDREX/STREX as compare-and-swap, while three producer
+ * threads post numbered events to tasks of three priorities. Every event must arrive once and in order, and the
+ * latency from post to dispatch is printed.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_sched
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+#include "host.h"
+#include "sched.c"
+#include "soft_timer.c"
+#include "SysTick.c"
+
+#define SIM_IDS 400000u    // Events of the single-thread tests
+#define SIM_EVENTS 200000  // Events per producer thread
+#define SIM_PRODUCERS 3
+
+static __thread uint32_t sim_primask;
+static __thread volatile uint32_t *sim_resv;           // Address held by the exclusive monitor of this thread
+static __thread uint32_t sim_resv_val;                 // Value the reservation was taken on
+static uint8_t sim_inject;                             // 1 to inject interrupts at the core hooks
+static uint8_t sim_threads;                            // 1 while the host port runs
+static uint32_t sim_depth;                             // Interrupt nesting depth
+static uint32_t sim_isrs;                              // Injected interrupts
+static uint32_t sim_ctx[3];                            // Id of the post in progress at each depth
+static uint32_t sim_next_id;
+static uint8_t sim_state[SIM_IDS];                     // 1 accepted, 2 dispatched
+static uint32_t sim_claim[SCHED_PRIORITIES][SIM_IDS];  // Ids in the order their positions were claimed
+static uint32_t sim_claims[SCHED_PRIORITIES];
+static uint32_t sim_taken[SCHED_PRIORITIES];
+static uint32_t sim_dropped;                           // Posts refused for a full queue
+static uint32_t sim_errors;
+static uint8_t sim_task[8];
+static Sched_Event_TypeDef sim_last;                   // Last dispatched event
+
+static void Sim_Interrupt(void);
+
+uint32_t __get_PRIMASK(void) { return sim_primask; }
+void __set_PRIMASK(uint32_t primask) { sim_primask = primask & 1; }
+
+/**
+ * @brief Loads and reserves a word; an interrupt may come right after.
+ *
+ * @param addr The word.
+ * @return The value.
+ */
+uint32_t __LDREXW(volatile uint32_t *addr) {
+    sim_resv_val = __atomic_load_n(addr, __ATOMIC_SEQ_CST);
+    sim_resv = addr;
+    Sim_Interrupt();
+    return sim_resv_val;
+}
+
+/**
+ * @brief Stores a word if the reservation still holds; an interrupt may come right before. On threads the
+ *        reservation is a compare-and-swap on the reserved value, which the monotonic counters make safe.
+ *
+ * @param value The value.
+ * @param addr The word.
+ * @return 0 if stored, 1 if the reservation was lost.
+ */
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr) {
+    uint32_t expect = sim_resv_val;
+    uint8_t p;
+
+    Sim_Interrupt();
+    if (sim_resv != addr) {
+        return 1;
+    }
+    sim_resv = 0;
+    if (!__atomic_compare_exchange_n(addr, &expect, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return 1;
+    }
+    for (p = 0; p < SCHED_PRIORITIES && sim_inject; ++p) {
+        if (addr == &sched_queue[p].enq) {
+            sim_claim[p][sim_claims[p]++] = sim_ctx[sim_depth];  // The post in progress claimed a position
+        }
+    }
+    return 0;
+}
+
+void __CLREX(void) {
+    sim_resv = 0;
+    Sim_Interrupt();
+}
+
+void __DMB(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    Sim_Interrupt();
+}
+
+/**
+ * @brief Posts event id to a random task and records whether it was accepted.
+ *
+ * @param id The event id, also its data.
+ * @return void
+ */
+static void Sim_Post(uint32_t id) {
+    uint8_t task = sim_task[rand() % 8];
+
+    sim_ctx[sim_depth] = id;
+    if (Sched_Post(task, 1, id)) {
+        sim_state[id] = 1;
+    } else {
+        sim_dropped++;
+    }
+}
+
+/**
+ * @brief Now and then takes an interrupt that posts one to three events, up to two deep; exception return
+ *        clears the exclusive monitor.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Interrupt(void) {
+    uint32_t n;
+
+    if (!sim_inject || sim_depth >= 2 || rand() % 6) {
+        return;
+    }
+    sim_depth++;
+    sim_isrs++;
+    for (n = 1 + rand() % 3; n && sim_next_id < SIM_IDS; --n) {
+        Sim_Post(sim_next_id++);
+    }
+    sim_depth--;
+    sim_resv = 0;
+}
+
+/**
+ * @brief Handler of the single-thread tests: records the event and checks it against the claim order.
+ *
+ * @param ev The event.
+ * @return void
+ */
+static void Sim_Handler(const Sched_Event_TypeDef *ev) {
+    uint8_t p = sched_task[ev->task].prio;
+
+    sim_last = *ev;
+    if (!sim_inject) {
+        return;
+    }
+    sim_errors += ev->data >= SIM_IDS || sim_state[ev->data] != 1;
+    sim_errors += sim_taken[p] >= sim_claims[p] || sim_claim[p][sim_taken[p]] != ev->data;
+    sim_taken[p]++;
+    if (ev->data < SIM_IDS) {
+        sim_state[ev->data] = 2;
+    }
+}
+
+/**
+ * @brief Clears the scheduler and adds eight tasks, two at each priority.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Setup(void) {
+    uint8_t i;
+
+    SysTick_Init(72);
+    Sched_Init();
+    for (i = 0; i < 8; ++i) {
+        sim_task[i] = Sched_Task_Add(Sim_Handler, i % SCHED_PRIORITIES);
+    }
+}
+
+/**
+ * @brief The task table and the refused posts.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Tasks(void) {
+    uint8_t i;
+    uint8_t ok = 1;
+
+    Sim_Setup();
+    for (i = 8; i < SCHED_MAX_TASKS; ++i) {
+        ok &= Sched_Task_Add(Sim_Handler, 3) == i + 1;
+    }
+    CHECK(ok && Sched_Task_Add(Sim_Handler, 0) == 0);  // Table full
+    Sim_Setup();
+    CHECK(Sched_Task_Add(Sim_Handler, SCHED_PRIORITIES) == 0);
+    CHECK(Sched_Post(0, 1, 0) == 0 && Sched_Post(9, 1, 0) == 0 && Sched_Post(SCHED_MAX_TASKS + 1, 1, 0) == 0);
+    CHECK(Sched_Dropped() == 0 && Sched_Run_Once() == 0);  // A bad task id is refused but not a drop
+}
+
+/**
+ * @brief A reference model of the queues predicts every dispatch and drop of random posts and runs.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Order(void) {
+    static uint32_t model[SCHED_PRIORITIES][SCHED_QUEUE_SIZE];
+    uint32_t head[SCHED_PRIORITIES] = {0};
+    uint32_t len[SCHED_PRIORITIES] = {0};
+    uint32_t op;
+    uint32_t data = 0;
+    uint32_t drops = 0;
+    uint32_t wrong = 0;
+    uint8_t task;
+    uint8_t p;
+    uint8_t r;
+
+    Sim_Setup();
+    for (op = 0; op < 300000; ++op) {
+        if (rand() % 5 < 3) {
+            task = sim_task[rand() % 8];
+            p = sched_task[task].prio;
+            r = Sched_Post(task, (uint8_t)task, ++data);
+            wrong += r != (len[p] < SCHED_QUEUE_SIZE);
+            if (r) {
+                model[p][(head[p] + len[p]++) % SCHED_QUEUE_SIZE] = data;
+            } else {
+                drops++;
+            }
+            continue;
+        }
+        for (p = 0; p < SCHED_PRIORITIES && !len[p]; ++p) {
+        }
+        sim_last.data = 0;
+        r = Sched_Run_Once();
+        if (p == SCHED_PRIORITIES) {
+            wrong += r != 0;
+            continue;
+        }
+        wrong += r != 1 || sim_last.data != model[p][head[p]] || sched_task[sim_last.task].prio != p;
+        wrong += sim_last.sig != sim_last.task;
+        head[p] = (head[p] + 1) % SCHED_QUEUE_SIZE;
+        len[p]--;
+    }
+    CHECK(wrong == 0);
+    CHECK(drops > 1000 && Sched_Dropped() == drops);
+}
+
+/**
+ * @brief Interrupts posting at every exclusive access and barrier of the posts and the runs.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Interrupted(void) {
+    uint32_t i;
+    uint32_t lost = 0;
+    uint32_t accepted = 0;
+
+    Sim_Setup();
+    sim_inject = 1;
+    while (sim_next_id < SIM_IDS) {
+        if (rand() % 2) {
+            Sim_Post(sim_next_id++);
+        } else {
+            Sched_Run_Once();
+        }
+    }
+    while (Sched_Run_Once()) {
+    }
+    sim_inject = 0;
+
+    for (i = 0; i < SIM_IDS; ++i) {
+        lost += sim_state[i] == 1;  // Accepted but never dispatched
+        accepted += sim_state[i] != 0;
+    }
+    CHECK(sim_errors == 0 && lost == 0);
+    CHECK(accepted + sim_dropped == SIM_IDS && Sched_Dropped() == sim_dropped);
+    CHECK(sim_isrs > 100000 && sim_dropped > 1000);
+}
+
+static const uint32_t sim_delay[6] = {1, 2, 5, 13, 100, 999};
+static const uint32_t sim_period[6] = {3, 0, 7, 10, 0, 250};
+static uint32_t sim_tick_bad;  // Events out of deadline order or not at an expiry tick
+static uint32_t sim_tick_last;
+static uint32_t sim_tick_count[6];
+
+/**
+ * @brief Handler of the timer test: the data must be the expiry tick, in deadline order.
+ *
+ * @param ev The event, sig = timer index.
+ * @return void
+ */
+static void Sim_Tick_Handler(const Sched_Event_TypeDef *ev) {
+    uint32_t k = sim_tick_count[ev->sig]++;
+
+    sim_tick_bad += ev->data < sim_tick_last || ev->data > (uint32_t)SysTick_Get_Ticks();
+    sim_tick_bad += ev->data != sim_delay[ev->sig] + k * sim_period[ev->sig];
+    sim_tick_last = ev->data;
+}
+
+/**
+ * @brief Scheduler timers post in deadline order with their expiry tick, on time and after a late loop.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Timers(void) {
+    static Sched_Timer_TypeDef timer[6];
+    uint8_t task;
+    uint32_t t;
+    uint32_t i;
+    uint32_t wrong = 0;
+
+    SysTick_Init(72);
+    Sched_Init();
+    task = Sched_Task_Add(Sim_Tick_Handler, 1);
+    for (i = 0; i < 6; ++i) {
+        Sched_Timer_Start(&timer[i], task, (uint8_t)i, sim_delay[i], sim_period[i]);
+    }
+    for (t = 1; t <= 5000; ++t) {
+        SysTick_Handler();
+        if (t % 97 > 12) {
+            while (Sched_Run_Once()) {  // On time, except for 12 ticks in every 97
+            }
+        }
+        if (t == 3000) {
+            Sched_Timer_Stop(&timer[2]);
+        }
+    }
+    while (Sched_Run_Once()) {
+    }
+    for (i = 0; i < 6; ++i) {
+        if (sim_period[i] == 0) {
+            wrong += sim_tick_count[i] != 1 || Sched_Timer_Active(&timer[i]);
+        } else if (i == 2) {
+            wrong += sim_tick_count[i] != (3000 - sim_delay[i]) / sim_period[i] + 1 || Sched_Timer_Active(&timer[i]);
+        } else {
+            wrong += sim_tick_count[i] != (5000 - sim_delay[i]) / sim_period[i] + 1 || !Sched_Timer_Active(&timer[i]);
+        }
+    }
+    CHECK(sim_tick_bad == 0 && wrong == 0 && Sched_Dropped() == 0);
+}
+
+static jmp_buf sim_exit;
+static uint8_t sim_sleep;         // 1 while Sched_Run() runs on this thread
+static uint32_t sim_wfi;
+static uint32_t sim_wfi_bad;      // Sleeps with interrupts unmasked or an event waiting
+static uint8_t sim_tick_pending;  // The SysTick interrupt that ends the sleep, run on unmasking
+static uint32_t sim_sleep_events;
+
+/**
+ * @brief Masks interrupts; one time in three an interrupt posts an event just before.
+ *
+ * @param void
+ * @return void
+ */
+void __disable_irq(void) {
+    if (sim_sleep && rand() % 3 == 0) {
+        Sched_Post(sim_task[rand() % 8], 2, 0);
+    }
+    sim_primask = 1;
+}
+
+/**
+ * @brief Unmasks interrupts and runs the pending SysTick interrupt.
+ *
+ * @param void
+ * @return void
+ */
+void __enable_irq(void) {
+    sim_primask = 0;
+    if (sim_tick_pending) {
+        sim_tick_pending = 0;
+        SysTick_Handler();
+    }
+}
+
+/**
+ * @brief Sleeps until the SysTick interrupt, which runs once Sched_Run() unmasks. On threads it yields.
+ *
+ * @param void
+ * @return void
+ */
+void __WFI(void) {
+    if (sim_threads) {
+        sched_yield();
+        return;
+    }
+    sim_wfi++;
+    sim_wfi_bad += !sim_primask || Sched_Pending();
+    sim_tick_pending = 1;
+}
+
+/**
+ * @brief Handler of the sleep test; leaves Sched_Run() after enough events.
+ *
+ * @param ev The event.
+ * @return void
+ */
+static void Sim_Sleep_Handler(const Sched_Event_TypeDef *ev) {
+    if (++sim_sleep_events == 20000) {
+        longjmp(sim_exit, 1);
+    }
+}
+
+/**
+ * @brief Sched_Run() sleeps only with interrupts masked and nothing queued, also when an interrupt posts right
+ *        before the mask.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Sleep(void) {
+    static Sched_Timer_TypeDef timer;
+    uint8_t i;
+
+    SysTick_Init(72);
+    Sched_Init();
+    for (i = 0; i < 8; ++i) {
+        sim_task[i] = Sched_Task_Add(Sim_Sleep_Handler, i % SCHED_PRIORITIES);
+    }
+    Sched_Timer_Start(&timer, sim_task[0], 1, 1, 1);
+    sim_sleep = 1;
+    if (setjmp(sim_exit) == 0) {
+        Sched_Run();
+    }
+    sim_sleep = 0;
+    CHECK(sim_wfi > 1000 && sim_wfi_bad == 0);
+    printf("Sched_Run(): %lu events, %lu sleeps\n", (unsigned long)sim_sleep_events, (unsigned long)sim_wfi);
+}
+
+static volatile uint32_t sim_next[SIM_PRODUCERS];  // Next number each producer's task expects
+static uint32_t sim_thread_bad;
+static uint64_t sim_post_ns[SIM_PRODUCERS][SIM_EVENTS];
+static uint32_t sim_latency[SIM_PRODUCERS * SIM_EVENTS];
+static uint32_t sim_latencies;
+static uint32_t sim_full[SIM_PRODUCERS];           // Posts refused for a full queue and retried
+static uint8_t sim_thread_task[SIM_PRODUCERS + 1];
+
+/**
+ * @brief Nanoseconds of the monotonic clock.
+ *
+ * @param void
+ * @return The time.
+ */
+static uint64_t Sim_Now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Handler of the producer tasks: numbers must come in order; records the latency.
+ *
+ * @param ev The event, sig = producer, data = number.
+ * @return void
+ */
+static void Sim_Thread_Handler(const Sched_Event_TypeDef *ev) {
+    uint64_t now = Sim_Now();
+
+    sim_thread_bad += ev->data != sim_next[ev->sig];
+    sim_latency[sim_latencies++] = (uint32_t)(now - __atomic_load_n(&sim_post_ns[ev->sig][ev->data], __ATOMIC_ACQUIRE));
+    sim_next[ev->sig] = ev->data + 1;
+}
+
+/**
+ * @brief Handler of the lowest priority task, ends the scheduler thread.
+ *
+ * @param ev The event.
+ * @return void
+ */
+static void Sim_Stop_Handler(const Sched_Event_TypeDef *ev) {
+    pthread_exit(NULL);
+}
+
+/**
+ * @brief The scheduler thread.
+ *
+ * @param arg Unused.
+ * @return NULL
+ */
+static void *Sim_Sched_Thread(void *arg) {
+    Sched_Run();
+    return NULL;
+}
+
+/**
+ * @brief A producer thread: posts its numbers to its task, retrying while the queue is full.
+ *
+ * @param arg The producer index.
+ * @return NULL
+ */
+static void *Sim_Producer_Thread(void *arg) {
+    uint32_t k = (uint32_t)(uintptr_t)arg;
+    uint32_t i;
+
+    for (i = 0; i < SIM_EVENTS; ++i) {
+        __atomic_store_n(&sim_post_ns[k][i], Sim_Now(), __ATOMIC_RELEASE);
+        while (!Sched_Post(sim_thread_task[k], (uint8_t)k, i)) {
+            sim_full[k]++;
+            sched_yield();
+            __atomic_store_n(&sim_post_ns[k][i], Sim_Now(), __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Compares two latencies for qsort.
+ *
+ * @param a The first.
+ * @param b The second.
+ * @return The order.
+ */
+static int Sim_Cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief The host port: Sched_Run() on a thread, three producer threads, the order and the latency.
+ *
+ * @param void
+ * @return void
+ */
+static void Bench_Threads(void) {
+    pthread_t sched;
+    pthread_t prod[SIM_PRODUCERS];
+    uint32_t k;
+    uint32_t full = 0;
+
+    SysTick_Init(72);
+    Sched_Init();
+    sim_threads = 1;
+    for (k = 0; k < SIM_PRODUCERS; ++k) {
+        sim_thread_task[k] = Sched_Task_Add(Sim_Thread_Handler, (uint8_t)k);
+    }
+    sim_thread_task[SIM_PRODUCERS] = Sched_Task_Add(Sim_Stop_Handler, SCHED_PRIORITIES - 1);
+
+    pthread_create(&sched, NULL, Sim_Sched_Thread, NULL);
+    for (k = 0; k < SIM_PRODUCERS; ++k) {
+        pthread_create(&prod[k], NULL, Sim_Producer_Thread, (void *)(uintptr_t)k);
+    }
+    for (k = 0; k < SIM_PRODUCERS; ++k) {
+        pthread_join(prod[k], NULL);
+        full += sim_full[k];
+    }
+    Sched_Post(sim_thread_task[SIM_PRODUCERS], 0, 0);  // Served after everything above it
+    pthread_join(sched, NULL);
+    sim_threads = 0;
+
+    CHECK(sim_thread_bad == 0 && sim_latencies == SIM_PRODUCERS * SIM_EVENTS);
+    CHECK(sim_next[0] == SIM_EVENTS && sim_next[1] == SIM_EVENTS && sim_next[2] == SIM_EVENTS);
+    CHECK(Sched_Dropped() == full);
+    qsort(sim_latency, sim_latencies, sizeof(sim_latency[0]), Sim_Cmp);
+    printf("Host port, %u producer threads: %u events, %lu retried on a full queue, post to dispatch "
+           "median %lu ns, 99%% %lu ns, max %lu ns\n",
+           SIM_PRODUCERS, (unsigned)sim_latencies, (unsigned long)full,
+           (unsigned long)sim_latency[sim_latencies / 2], (unsigned long)sim_latency[sim_latencies / 100 * 99],
+           (unsigned long)sim_latency[sim_latencies - 1]);
+}
+
+int main(void) {
+    srand(15);
+    Test_Tasks();
+    Test_Order();
+    Test_Interrupted();
+    Test_Timers();
+    Test_Sleep();
+    Bench_Threads();
+    return TEST_EXIT("test_sched");
+}
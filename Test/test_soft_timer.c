@@ -0,0 +1,257 @@
+/**
+ * @file test_soft_timer.c
+ * @brief Host simulation of the software timer wheel over hours of SysTick ticks, and of the SysTick clock reads.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Six simulated hours of 1 ms ticks run through the wheel with thousands of timers: one-shot and periodic, with
+ * delays from one tick to beyond the 2^24 ticks the wheel covers directly, started and stopped both from the
+ * main loop and from the callbacks, including timers already due in the same tick. A reference model keeps the
+ * expiry of every timer; each callback must come at exactly that tick, in tick order, and no expiry may be
+ * missed, also when Soft_Timer_Process() is called hundreds of ticks late. A set of periodic timers nobody
+ * touches must show no drift after the six hours.
+ *
+ * The clock reads are checked by stepping the SysTick down-counter through many reloads, with the reload
+ * interrupt held pending for a while as when interrupts are masked: SysTick_Get_Us() and SysTick_Get_Ticks()
+ * must follow the counter exactly and never go backwards.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_soft_timer
+ */
+
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+#include "SysTick.c"
+#include "soft_timer.c"
+
+#define SIM_TIMERS 3000
+#define SIM_HOURS 6
+#define SIM_TICKS ((uint64_t)SIM_HOURS * 3600 * 1000000 / SYSTICK_TICK_US)
+#define SIM_STEADY 6  // Periodic timers left alone to measure drift
+
+static Soft_Timer_TypeDef sim_timer[SIM_TIMERS];
+static uint64_t sim_expect[SIM_TIMERS];  // Expiry tick the model expects, 0 while inactive
+static uint32_t sim_period[SIM_TIMERS];
+static uint64_t sim_fired[SIM_TIMERS];  // Callbacks of each timer
+static uint64_t sim_first[SIM_TIMERS];  // First expiry of the steady timers
+static uint64_t sim_last;               // Expiry of the last callback
+static uint64_t sim_fires;
+static uint64_t sim_missed;             // Callbacks not at the expected tick, or out of order
+static uint64_t sim_from_cb;            // Starts and stops done by callbacks
+
+/**
+ * @brief A random delay: mostly short, some up to a day, a few beyond the span of the wheel.
+ *
+ * @param void
+ * @return The delay in ticks.
+ */
+static uint32_t Sim_Delay(void) {
+    uint32_t r = (uint32_t)rand();
+
+    switch (r % 16) {
+        case 0:
+            return r % 4;  // 0 fires at the next tick
+        case 1:
+            return (uint32_t)(SOFT_TIMER_SPAN + r % (3 * SOFT_TIMER_SPAN));  // Parked and re-filed
+        case 2:
+        case 3:
+            return r % (1u << 24);
+        default:
+            return 1 + r % 5000;
+    }
+}
+
+/**
+ * @brief A random period: half the timers are one-shot, periodic ones fire at most every 10 ticks.
+ *
+ * @param void
+ * @return The period in ticks.
+ */
+static uint32_t Sim_Period(void) { return rand() % 2 ? 0 : 10 + (uint32_t)rand() % 100000; }
+
+static void Sim_Callback(Soft_Timer_TypeDef *timer);
+
+/**
+ * @brief Starts a timer and records its expiry in the model.
+ *
+ * @param i The timer.
+ * @param delay The delay in ticks.
+ * @param period The period in ticks.
+ * @return void
+ */
+static void Sim_Start(uint32_t i, uint32_t delay, uint32_t period) {
+    Soft_Timer_Start(&sim_timer[i], delay, period, Sim_Callback, (void *)(uintptr_t)i);
+    sim_expect[i] = SysTick_Get_Ticks() + (delay ? delay : 1);
+    sim_period[i] = period;
+}
+
+/**
+ * @brief Stops a timer in the wheel and in the model.
+ *
+ * @param i The timer.
+ * @return void
+ */
+static void Sim_Stop(uint32_t i) {
+    Soft_Timer_Stop(&sim_timer[i]);
+    sim_expect[i] = 0;
+}
+
+/**
+ * @brief Checks the expiry against the model, then starts or stops random timers, sometimes itself.
+ *
+ * @param timer The expired timer.
+ * @return void
+ */
+static void Sim_Callback(Soft_Timer_TypeDef *timer) {
+    uint32_t i = (uint32_t)(uintptr_t)timer->arg;
+    uint64_t e = soft_timer_base - 1;  // The tick being processed
+    uint32_t j;
+
+    sim_missed += e != sim_expect[i] || e < sim_last || e > SysTick_Get_Ticks();
+    sim_missed += Soft_Timer_Active(timer) != (sim_period[i] != 0);
+    sim_last = e;
+    sim_fired[i]++;
+    sim_fires++;
+    sim_expect[i] = sim_period[i] ? e + sim_period[i] : 0;  // Reloaded from the expiry, not from now
+    if (i < SIM_STEADY) {
+        return;
+    }
+
+    switch (rand() % 8) {
+        case 0:
+            Sim_Start(i, Sim_Delay(), Sim_Period());
+            break;
+        case 1:
+            Sim_Stop(i);
+            break;
+        case 2:
+            j = SIM_STEADY + rand() % (SIM_TIMERS - SIM_STEADY);
+            Sim_Stop(j);  // Maybe one due in this same tick
+            break;
+        case 3:
+            j = SIM_STEADY + rand() % (SIM_TIMERS - SIM_STEADY);
+            Sim_Start(j, Sim_Delay(), Sim_Period());
+            break;
+        default:
+            return;
+    }
+    sim_from_cb++;
+}
+
+/**
+ * @brief Runs the timers over SIM_HOURS of ticks, processing on time mostly and late now and then.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Wheel(void) {
+    static const uint32_t steady[SIM_STEADY] = {1, 7, 1000, 60000, 3600000, 20000000};
+    uint64_t t;
+    uint64_t late_until = 0;
+    uint64_t missed = 0;
+    uint64_t drift = 0;
+    uint32_t i;
+
+    SysTick_Init(72);
+    SysTick_Clock_Init();
+    Soft_Timer_Init();
+    for (i = 0; i < SIM_STEADY; ++i) {
+        Sim_Start(i, 1 + i, steady[i]);
+        sim_first[i] = sim_expect[i];
+    }
+    for (i = SIM_STEADY; i < SIM_TIMERS; ++i) {
+        Sim_Start(i, Sim_Delay(), Sim_Period());
+    }
+
+    for (t = 0; t < SIM_TICKS; ++t) {
+        SysTick_Handler();
+        if (t >= late_until) {
+            Soft_Timer_Process();
+            if (rand() % 4096 == 0) {
+                late_until = t + 1 + rand() % 500;  // The main loop is busy for a while
+            }
+        }
+        if (rand() % 64 == 0) {
+            i = SIM_STEADY + rand() % (SIM_TIMERS - SIM_STEADY);
+            if (rand() % 4) {
+                Sim_Start(i, Sim_Delay(), Sim_Period());
+            } else {
+                Sim_Stop(i);
+            }
+        }
+    }
+    Soft_Timer_Process();
+
+    for (i = 0; i < SIM_TIMERS; ++i) {
+        missed += sim_expect[i] && sim_expect[i] <= SysTick_Get_Ticks();  // Due but never called
+        missed += (sim_expect[i] != 0) != Soft_Timer_Active(&sim_timer[i]);
+    }
+    for (i = 0; i < SIM_STEADY; ++i) {
+        drift += sim_fired[i] != (SysTick_Get_Ticks() - sim_first[i]) / steady[i] + 1;
+        drift += sim_expect[i] != sim_first[i] + sim_fired[i] * steady[i];
+        printf("period %8u ticks: %9llu callbacks, next at tick %llu\n", steady[i], (unsigned long long)sim_fired[i],
+               (unsigned long long)sim_expect[i]);
+    }
+    CHECK(sim_missed == 0 && missed == 0);
+    CHECK(drift == 0);
+    CHECK(sim_fires > SIM_TICKS && sim_from_cb > 10000);
+    printf("%u timers over %u simulated hours: %llu callbacks, %llu starts and stops from callbacks\n", SIM_TIMERS,
+           SIM_HOURS, (unsigned long long)sim_fires, (unsigned long long)sim_from_cb);
+}
+
+/**
+ * @brief Steps the SysTick down-counter through reloads; the reads must follow it and never go back.
+ *
+ * As on the core, the counter pends the interrupt when it reaches 0 and reloads one count later; the interrupt
+ * runs a random number of counts later, as with interrupts masked.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Clock_Read(void) {
+    uint32_t reload;
+    uint32_t counts;
+    uint32_t pend = 0;  // Counts until the pending interrupt runs
+    uint64_t total = 0;
+    uint64_t last_us = 0;
+    uint64_t us;
+    uint32_t wrong = 0;
+    uint32_t backwards = 0;
+
+    SysTick_Init(72);
+    SysTick_Clock_Init();
+    reload = SysTick->LOAD + 1;
+    CHECK(reload == 9000 && SysTick_Get_Ticks() == 0 && SysTick_Get_Us() == 0);
+
+    while (total < 500ull * reload) {
+        counts = 1 + rand() % 700;
+        while (counts--) {
+            total++;
+            if (SysTick->VAL == 0) {
+                SysTick->VAL = SysTick->LOAD;  // The count after reaching 0 reloads
+            } else if (--SysTick->VAL == 0) {
+                SCB->ICSR |= SCB_ICSR_PENDSTSET_Msk;  // Reaching 0 pends the interrupt
+                pend = rand() % 3 ? 0 : 1 + rand() % 2000;
+            }
+            if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) && pend-- == 0) {
+                SCB->ICSR &= ~SCB_ICSR_PENDSTSET_Msk;
+                SysTick_Handler();
+            }
+        }
+        us = SysTick_Get_Us();
+        wrong += us != total * 1000 / 9000 || SysTick_Get_Ticks() != total / reload;
+        backwards += us < last_us;
+        last_us = us;
+    }
+    CHECK(wrong == 0 && backwards == 0);
+    SCB->ICSR &= ~SCB_ICSR_PENDSTSET_Msk;
+}
+
+int main(void) {
+    srand(12);
+    Test_Clock_Read();
+    Test_Wheel();
+    return TEST_EXIT("test_soft_timer");
+}
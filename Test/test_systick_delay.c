@@ -0,0 +1,278 @@
+/**
+ * @file test_systick_delay.c
+ * @brief Host test of delay_ms() and delay_us() against the core clock cycles they take, at every clock setting.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * SysTick is simulated in core clock cycles: every access to a SysTick register costs the core a few cycles,
+ * during which the down-counter counts at HCLK / 8 as on the part. It sets COUNTFLAG when it reaches 0, which
+ * the next read of CTRL clears, pends its interrupt when TICKINT is set and reloads on the following count. WFI
+ * sleeps until the next SysTick interrupt, or wakes early as other interrupts would.
+ *
+ * For every HCLK from the AHB prescaler range and every delay from 0 to the largest argument, both with SysTick
+ * programmed per delay and as the free-running clock, spinning and sleeping, the delay must never be shorter than
+ * asked by more than the one count a free-running prescaler can steal, and no longer than the rounding up of
+ * the SysTick factors plus the cost of the register accesses. Sleeping with interrupts masked must spin, and the
+ * clock must keep the tick count while delays run on it.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_systick_delay
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+
+static SysTick_Type *Sim_SysTick(void);
+
+#undef SysTick
+#define SysTick (Sim_SysTick())  // Every SysTick register access in SysTick.c runs the model first
+
+#include "SysTick.c"
+
+static uint64_t sim_cycles;    // Core clock cycles since the start
+static uint32_t sim_access;    // Cycles charged to each SysTick register access
+static uint32_t sim_prescale;  // Cycles towards the next count at HCLK / 8
+static uint32_t sim_primask;
+static uint8_t sim_flag_seen;  // COUNTFLAG was set at the last access, which may have read it
+static uint32_t sim_wfi;
+static uint32_t sim_stuck;     // WFI with no interrupt that could ever wake the core
+static uint64_t sim_handled;   // SysTick interrupts taken
+
+/**
+ * @brief Runs the pending SysTick interrupt if interrupts are unmasked.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Interrupt(void) {
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) && !sim_primask) {
+        SCB->ICSR &= ~SCB_ICSR_PENDSTSET_Msk;
+        sim_handled++;
+        SysTick_Handler();
+    }
+}
+
+/**
+ * @brief Advances the core clock and counts SysTick down, a whole stretch to the next 0 at a time.
+ *
+ * @param cycles The core clock cycles.
+ * @return void
+ */
+static void Sim_Run(uint64_t cycles) {
+    SysTick_Type *st = &host_systick;
+    uint64_t n;
+    uint32_t k;
+
+    sim_cycles += cycles;
+    if (!(st->CTRL & SysTick_CTRL_ENABLE_Msk)) {
+        return;
+    }
+    if (st->CTRL & SysTick_CTRL_CLKSOURCE_Msk) {
+        n = cycles;
+    } else {
+        n = (sim_prescale + cycles) / 8;
+        sim_prescale = (uint32_t)((sim_prescale + cycles) % 8);  // The divider runs on between delays
+    }
+    while (n) {
+        if (st->VAL == 0) {
+            if (st->LOAD == 0) {
+                break;  // A reload value of 0 stops the counter
+            }
+            st->VAL = st->LOAD;
+            n--;
+            continue;
+        }
+        k = n < st->VAL ? (uint32_t)n : st->VAL;
+        st->VAL -= k;
+        n -= k;
+        if (st->VAL == 0) {
+            st->CTRL |= SysTick_CTRL_COUNTFLAG_Msk;
+            if (st->CTRL & SysTick_CTRL_TICKINT_Msk) {
+                SCB->ICSR |= SCB_ICSR_PENDSTSET_Msk;
+                Sim_Interrupt();  // Taken at once, unless masked; a second reload while masked is lost
+            }
+        }
+    }
+}
+
+/**
+ * @brief The SysTick register block, reached through the model: clears COUNTFLAG if the last access read it,
+ *        then charges the access to the clock.
+ *
+ * @param void
+ * @return The registers.
+ */
+static SysTick_Type *Sim_SysTick(void) {
+    if (sim_flag_seen) {
+        host_systick.CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+    }
+    Sim_Run(sim_access);
+    sim_flag_seen = (host_systick.CTRL & SysTick_CTRL_COUNTFLAG_Msk) != 0;
+    return &host_systick;
+}
+
+uint32_t __get_PRIMASK(void) { return sim_primask; }
+void __set_PRIMASK(uint32_t primask) {
+    sim_primask = primask & 1;
+    Sim_Interrupt();
+}
+void __disable_irq(void) { sim_primask = 1; }
+void __enable_irq(void) {
+    sim_primask = 0;
+    Sim_Interrupt();
+}
+
+/**
+ * @brief Sleeps until the next SysTick interrupt; one time in four another interrupt wakes the core earlier.
+ *
+ * @param void
+ * @return void
+ */
+void __WFI(void) {
+    SysTick_Type *st = &host_systick;
+    uint64_t counts;
+    uint32_t per = st->CTRL & SysTick_CTRL_CLKSOURCE_Msk ? 1 : 8;
+
+    sim_wfi++;
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+        return;  // A pending interrupt wakes the core at once, even while masked
+    }
+    if (!(st->CTRL & SysTick_CTRL_ENABLE_Msk) || !(st->CTRL & SysTick_CTRL_TICKINT_Msk) || st->LOAD == 0) {
+        sim_stuck++;
+        return;
+    }
+    counts = st->VAL ? st->VAL : (uint64_t)st->LOAD + 1;
+    if (rand() % 4 == 0) {
+        counts = 1 + (uint64_t)rand() % counts;
+    }
+    Sim_Run(counts * per - (per == 8 ? sim_prescale : 0));
+}
+
+/**
+ * @brief Runs one delay and checks its length in core clock cycles.
+ *
+ * @param hclk The core clock in Hz.
+ * @param us 1 for delay_us(), 0 for delay_ms().
+ * @param n The delay argument.
+ * @return 1 if the length is right.
+ */
+static uint8_t Sim_Delay(uint32_t hclk, uint8_t us, uint32_t n) {
+    uint64_t unit = us ? 1000000 : 1000;
+    uint64_t want = ((uint64_t)n * hclk + unit - 1) / unit;  // The asked time in cycles, rounded up
+    uint64_t round;                                          // Counts the factors may add
+    uint64_t chunks = want / 8 / (SysTick_LOAD_RELOAD_Msk + 1) + 2;
+    uint64_t slack;
+    uint64_t start;
+    uint64_t took;
+
+    sim_access = want / 20000 > 4 ? (uint32_t)(want / 20000) : 4;  // Coarser accesses keep long delays quick
+    if (systick_clock && sim_access > hclk / 1000 / 4) {
+        sim_access = hclk / 1000 / 4;  // The clock needs a read in every tick
+    }
+    round = us ? (uint64_t)n / 65536 + 2 : (uint64_t)n + 1;
+    slack = chunks * (8u * sim_access + 8) + 8 * round;
+
+    start = sim_cycles;
+    if (us) {
+        delay_us(n);
+    } else {
+        delay_ms((uint16_t)n);
+    }
+    took = sim_cycles - start;
+    return took + 8 >= want && took <= want + slack;
+}
+
+/**
+ * @brief Every clock, delay, mode and sleep setting.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Delays(void) {
+    static const uint32_t hclk[] = {72000000, 64000000, 56000000, 48000000, 36000000, 24000000,
+                                    16000000, 8000000,  9000000,  4500000,  1125000,  140625};
+    static const uint32_t ms[] = {0, 1, 2, 3, 10, 100, 1000, 1864, 1865, 1999, 5000, 30000, 65535};
+    static const uint32_t us[] = {0,       1,        2,        7,        10,         100,       999,
+                                  1000,    1001,     65536,    1864135,  1864136,    2000000,   10000000,
+                                  3000000, 60000000, 99999999, 0x7fffffff, 0xffffffffu};
+    uint32_t c;
+    uint32_t i;
+    uint32_t mode;
+    uint32_t wrong_ms = 0;
+    uint32_t wrong_us = 0;
+    uint32_t wfi;
+
+    for (mode = 0; mode < 4; ++mode) {
+        for (c = 0; c < sizeof(hclk) / sizeof(hclk[0]); ++c) {
+            host_clocks.HCLK_Frequency = hclk[c];
+            host_systick.CTRL = 0;
+            SysTick_Init(72);  // The argument is ignored, the clock comes from RCC
+            systick_clock = 0;
+            SysTick_Set_Sleep(mode & 1);
+            if (mode & 2) {
+                SysTick_Clock_Init();
+            }
+            for (i = 0; i < sizeof(ms) / sizeof(ms[0]); ++i) {
+                if (!Sim_Delay(hclk[c], 0, ms[i])) {
+                    wrong_ms++;
+                    printf("HCLK %lu Hz, %s, %s: delay_ms(%lu) wrong\n", (unsigned long)hclk[c],
+                           mode & 2 ? "clock" : "reload", mode & 1 ? "sleep" : "spin", (unsigned long)ms[i]);
+                }
+            }
+            for (i = 0; i < sizeof(us) / sizeof(us[0]); ++i) {
+                if ((mode & 2) && us[i] > 100000000 && hclk[c] != 72000000) {
+                    continue;  // The longest waits on the clock are read every quarter tick; once is enough
+                }
+                if (!Sim_Delay(hclk[c], 1, us[i])) {
+                    wrong_us++;
+                    printf("HCLK %lu Hz, %s, %s: delay_us(%lu) wrong\n", (unsigned long)hclk[c],
+                           mode & 2 ? "clock" : "reload", mode & 1 ? "sleep" : "spin", (unsigned long)us[i]);
+                }
+            }
+        }
+    }
+    CHECK(wrong_ms == 0);
+    CHECK(wrong_us == 0);
+    CHECK(sim_stuck == 0);
+
+    sim_wfi = 0;
+    SysTick_Set_Sleep(1);
+    __disable_irq();
+    wfi = Sim_Delay(host_clocks.HCLK_Frequency, 0, 50);  // Masked: must spin, no reload is lost
+    __enable_irq();
+    CHECK(wfi && sim_wfi == 0);
+    SysTick_Set_Sleep(0);
+    host_clocks.HCLK_Frequency = 72000000;
+}
+
+/**
+ * @brief The free-running clock keeps every tick while delays, spinning or sleeping, run on it.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Clock_Ticks(void) {
+    uint32_t i;
+
+    host_systick.CTRL = 0;
+    SysTick_Init(72);
+    SysTick_Clock_Init();
+    sim_handled = 0;
+    for (i = 0; i < 200; ++i) {
+        SysTick_Set_Sleep(i & 1);
+        delay_ms((uint16_t)(1 + rand() % 50));
+        delay_us((uint32_t)rand() % 5000);
+    }
+    CHECK(sim_handled > 5000 && SysTick_Get_Ticks() == sim_handled);
+    SysTick_Set_Sleep(0);
+}
+
+int main(void) {
+    srand(14);
+    Test_Delays();
+    Test_Clock_Ticks();
+    return TEST_EXIT("test_systick_delay");
+}
@@ -0,0 +1,332 @@
+/**
+ * @file test_usart_baud.c
+ * @brief Host test of the USART1 BRR arithmetic, the high-speed rate choice and the 0x55 auto-baud measurement.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * USART_BRR_Calc() is checked over every pair of a PCLK from 1 to 72 MHz and a standard rate from 300 baud to
+ * 4.5 Mbaud: BRR must be pclk / baud rounded, the achieved rate and the ppm error must match a reference in double
+ * precision, rates outside BRR 16..0xffff must be refused, and the 36 and 72 MHz errors must agree with the baud
+ * rate table of the reference manual (RM0008). USART1_High_Speed() must pick the fastest rate within the limit.
+ * For USART1_Auto_Baud() a model of TIM1 advances the counter on every flag read, sets the update flag on a wrap
+ * and latches CCR3 on each falling edge of the bytes on the line; the measured rate and BRR must follow from the
+ * edge ticks at every rate and start phase, with jitter, and a byte other than 0x55 or a silent line must leave
+ * BRR unchanged.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_usart_baud
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "test.h"
+#include "host.h"
+#include "usart.c"
+#include "dma.c"
+
+#define SIM_EDGES 32  // Falling edges per line
+#define SIM_STEP 7    // Timer ticks per flag read, below the 32 ticks between edges at 4.5 Mbaud
+
+static const uint32_t sim_pclk[] = {72000000, 64000000, 56000000, 48000000, 36000000, 32000000,
+                                    24000000, 16000000, 11059200, 8000000,  4000000,  1000000};
+static const uint32_t sim_baud[] = {300,    1200,   2400,   4800,   9600,    14400,   19200,   38400,
+                                    57600,  115200, 230400, 250000, 460800,  500000,  576000,  921600,
+                                    1000000, 1500000, 2000000, 2250000, 4500000};
+
+static uint64_t sim_now;               // TIM1 ticks since it was started
+static uint64_t sim_edge[SIM_EDGES];  // Ticks of the falling edges on PA10
+static uint8_t sim_edges;
+static uint8_t sim_next;  // Next edge to capture
+
+/**
+ * @brief TIM1 runs SIM_STEP ticks per flag read: a wrap sets the update flag and an edge latches CCR3.
+ *
+ * @param TIMx The timer.
+ * @param TIM_FLAG The flag to read.
+ * @return SET or RESET.
+ */
+FlagStatus TIM_GetFlagStatus(TIM_TypeDef *TIMx, uint16_t TIM_FLAG) {
+    uint64_t next = sim_now + SIM_STEP;
+
+    if (TIMx == TIM1 && (TIMx->CR1 & TIM_CR1_CEN)) {
+        for (; sim_next < sim_edges && sim_edge[sim_next] <= next; ++sim_next) {
+            if ((sim_edge[sim_next] >> 16) != (sim_now >> 16)) {
+                TIMx->SR |= TIM_FLAG_Update;
+            }
+            TIMx->SR |= TIMx->SR & TIM_FLAG_CC3 ? TIM_FLAG_CC3OF : TIM_FLAG_CC3;
+            TIMx->CCR3 = (uint16_t)sim_edge[sim_next];
+            sim_now = sim_edge[sim_next];
+        }
+        if ((next >> 16) != (sim_now >> 16)) {
+            TIMx->SR |= TIM_FLAG_Update;
+        }
+        sim_now = next;
+    }
+    return (TIMx->SR & TIM_FLAG) ? SET : RESET;
+}
+
+// Reading CCR3 clears the capture flag
+uint16_t TIM_GetCapture3(TIM_TypeDef *TIMx) {
+    TIMx->SR &= ~TIM_FLAG_CC3;
+    return TIMx->CCR3;
+}
+
+/**
+ * @brief Puts bytes on the idle-high line, 8N1 LSB first, and records their falling edges.
+ *
+ * @param bytes The bytes.
+ * @param count The number of bytes.
+ * @param tim_clk The TIM1 clock in Hz.
+ * @param baud The baud rate of the sender.
+ * @param t0 The tick of the first start bit.
+ * @param jitter The largest random offset of an edge in ticks.
+ * @return void
+ */
+static void Sim_Line(const uint8_t *bytes, uint8_t count, uint32_t tim_clk, uint32_t baud, uint64_t t0,
+                     uint32_t jitter) {
+    uint8_t level = 1;
+    uint8_t bit;
+    uint8_t b;
+    uint8_t i;
+    double t;
+
+    sim_now = 0;
+    sim_edges = 0;
+    sim_next = 0;
+    for (b = 0; b < count; ++b) {
+        for (i = 0; i < 10; ++i) {
+            bit = i == 0 ? 0 : i == 9 ? 1 : (bytes[b] >> (i - 1)) & 1;
+            if (level && !bit && sim_edges < SIM_EDGES) {
+                t = t0 + (b * 10 + i) * (double)tim_clk / baud;
+                t += jitter ? (int32_t)(rand() % (2 * jitter + 1)) - (int32_t)jitter : 0;
+                sim_edge[sim_edges++] = (uint64_t)(t + 0.5);
+            }
+            level = bit;
+        }
+    }
+}
+
+/**
+ * @brief USART_BRR_Calc() over every clock and rate against a double precision reference.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_BRR_Table(void) {
+    uint32_t p;
+    uint32_t b;
+    uint32_t div;
+    uint32_t actual;
+    uint32_t wrong = 0;
+    uint32_t refused = 0;
+    uint16_t brr;
+    int32_t err;
+    double ref;
+
+    for (p = 0; p < sizeof(sim_pclk) / sizeof(sim_pclk[0]); ++p) {
+        for (b = 0; b < sizeof(sim_baud) / sizeof(sim_baud[0]); ++b) {
+            div = (uint32_t)floor((double)sim_pclk[p] / sim_baud[b] + 0.5);
+            brr = 0;
+            err = 0x7fffffff;
+            actual = USART_BRR_Calc(sim_pclk[p], sim_baud[b], &brr, &err);
+            if (div < 16 || div > 0xffff) {
+                wrong += actual != 0 || brr != 0 || err != 0x7fffffff;  // Nothing written
+                refused++;
+                continue;
+            }
+            ref = ((double)sim_pclk[p] / div - sim_baud[b]) / sim_baud[b] * 1e6;
+            wrong += brr != div;
+            wrong += actual != (uint32_t)floor((double)sim_pclk[p] / div + 0.5);
+            wrong += fabs(err - ref) >= 1.0;              // Truncated towards zero
+            wrong += fabs(ref) > 1e6 / (2.0 * div) + 1;  // Half a BRR step at most
+            wrong += USART_BRR_Calc(sim_pclk[p], sim_baud[b], &brr, NULL) != actual;
+        }
+    }
+    CHECK(wrong == 0);
+    CHECK(refused > 0 && USART_BRR_Calc(72000000, 0, &brr, &err) == 0);
+    CHECK(USART_BRR_Calc(72000000, 4500000, &brr, &err) == 4500000 && brr == 16 && err == 0);
+    CHECK(USART_BRR_Calc(72000000, 4500001, &brr, &err) == 4500000);  // Still rounds to 16
+    CHECK(USART_BRR_Calc(72000000, 4800000, &brr, &err) == 0);         // Rounds to 15
+    CHECK(USART_BRR_Calc(72000000, 1098, &brr, &err) == 0 && USART_BRR_Calc(72000000, 1099, &brr, &err) != 0);
+}
+
+/**
+ * @brief The errors at 36 and 72 MHz against the baud rate table of RM0008, given there in hundredths of a percent.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_BRR_Manual(void) {
+    static const uint32_t baud[] = {2400, 9600, 19200, 57600, 115200, 230400, 460800, 921600, 2250000, 4500000};
+    static const int16_t err36[] = {0, 0, 0, 0, 15, 16, 16, 16, 0, -1};  // -1: not possible
+    static const int16_t err72[] = {0, 0, 0, 0, 0, 16, 16, 16, 0, 0};
+    uint32_t wrong = 0;
+    uint16_t brr = 0;
+    int32_t err = 0;
+    uint8_t i;
+
+    printf("%8s %14s %14s\n", "baud", "36 MHz", "72 MHz");
+    for (i = 0; i < sizeof(baud) / sizeof(baud[0]); ++i) {
+        if (err36[i] < 0) {
+            wrong += USART_BRR_Calc(36000000, baud[i], &brr, &err) != 0;
+            printf("%8u %14s", baud[i], "-");
+        } else {
+            wrong += USART_BRR_Calc(36000000, baud[i], &brr, &err) == 0 || abs(abs(err) - err36[i] * 100) > 100;
+            printf("%8u %5u %+6.2f %%", baud[i], brr, err / 1e4);
+        }
+        wrong += USART_BRR_Calc(72000000, baud[i], &brr, &err) == 0 || abs(abs(err) - err72[i] * 100) > 100;
+        printf(" %5u %+6.2f %%\n", brr, err / 1e4);
+    }
+    CHECK(wrong == 0);
+}
+
+/**
+ * @brief USART1_High_Speed() picks the fastest standard rate within the limit, or changes nothing.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_High_Speed(void) {
+    int32_t err;
+
+    host_clocks.PCLK2_Frequency = 72000000;
+    CHECK(USART1_High_Speed(0, &err) == 4500000 && USART1->BRR == 16 && err == 0 && (USART1->CR1 & USART_CR1_UE));
+    host_clocks.PCLK2_Frequency = 36000000;
+    CHECK(USART1_High_Speed(0, &err) == 2250000 && USART1->BRR == 16 && err == 0);
+    host_clocks.PCLK2_Frequency = 64000000;
+    CHECK(USART1_High_Speed(1000, &err) == 2000000 && USART1->BRR == 32 && err == 0);
+    CHECK(USART1_High_Speed(20000, &err) == 2250000 && USART1->BRR == 28 && err > 15000 && err < 16000);
+    host_clocks.PCLK2_Frequency = 8000000;
+    CHECK(USART1_High_Speed(0, NULL) == 500000 && USART1->BRR == 16);
+    host_clocks.PCLK2_Frequency = 1000000;
+    CHECK(USART1_High_Speed(0, &err) == 0 && USART1->BRR == 16);  // 1 MHz makes no standard rate exactly
+    CHECK(USART1_High_Speed(2000, &err) == 38400 && USART1->BRR == 26 && err > 1500 && err < 1700);
+    host_clocks.PCLK2_Frequency = 72000000;
+    CHECK(USART1_Set_Baud(115200, &err) == 115200 && USART1->BRR == 625 && err == 0);
+}
+
+/**
+ * @brief USART1_Auto_Baud() on a 0x55 at every rate and start phase, clean and with jitter.
+ *
+ * @param pclk2 The PCLK2 frequency; TIM1 runs at twice it if APB2 is divided.
+ * @param jitter The largest edge jitter as a fraction of a bit time.
+ * @return void
+ */
+static void Test_Auto_Baud(uint32_t pclk2, double jitter) {
+    static const uint8_t sync = 0x55;
+    uint32_t tim_clk;
+    uint32_t span;
+    uint32_t b;
+    uint32_t rep;
+    uint32_t baud;
+    uint32_t expect_brr;
+    uint32_t wrong = 0;
+    uint32_t runs = 0;
+    int32_t err;
+    double off;
+    double worst = 0;
+
+    host_clocks.PCLK2_Frequency = pclk2;
+    tim_clk = pclk2 == host_clocks.HCLK_Frequency ? pclk2 : 2 * pclk2;
+    for (b = 0; b < sizeof(sim_baud) / sizeof(sim_baud[0]); ++b) {
+        if (pclk2 / sim_baud[b] < 16 || pclk2 / sim_baud[b] > 0xffff) {
+            continue;  // See Test_Auto_Baud_Reject()
+        }
+        for (rep = 0; rep < 20; ++rep) {
+            Sim_Line(&sync, 1, tim_clk, sim_baud[b], rand() % 0x30000,
+                     (uint32_t)(jitter * tim_clk / sim_baud[b]));
+            span = (uint32_t)(sim_edge[4] - sim_edge[0]);
+            baud = USART1_Auto_Baud(100, &err);
+            expect_brr = (uint32_t)(((uint64_t)pclk2 * span + 4ull * tim_clk) / (8ull * tim_clk));
+            wrong += baud != (uint32_t)(((uint64_t)tim_clk * 8 + span / 2) / span);
+            wrong += USART1->BRR != expect_brr;
+            wrong += fabs(err - (((double)pclk2 * span) / (expect_brr * 8.0 * tim_clk) - 1) * 1e6) >= 1.0;
+            wrong += !(USART1->CR1 & USART_CR1_UE) || (TIM1->CR1 & TIM_CR1_CEN);
+            off = fabs((double)baud - sim_baud[b]) / sim_baud[b];
+            wrong += off > (2.0 * jitter * tim_clk / sim_baud[b] + 1.5) / span;  // Edge jitter and rounding
+            worst = off > worst ? off : worst;
+            runs++;
+        }
+    }
+    CHECK(wrong == 0);
+    printf("auto-baud at %u MHz PCLK2, jitter %.3f bit: %u runs, worst %.0f ppm off the sender\n", pclk2 / 1000000,
+           jitter, runs, worst * 1e6);
+    host_clocks.PCLK2_Frequency = 72000000;
+}
+
+/**
+ * @brief A byte other than 0x55 first, or no byte at all, returns 0 and keeps BRR; the timeout is kept.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Auto_Baud_Reject(void) {
+    static const uint8_t not_sync[] = {0x33, 0x55};
+    static const uint8_t sync = 0x55;
+    int32_t err = 12345;
+
+    USART1->BRR = 625;
+    Sim_Line(not_sync, 2, 72000000, 115200, 1000, 0);
+    CHECK(USART1_Auto_Baud(100, &err) == 0 && USART1->BRR == 625 && err == 12345);
+    CHECK(sim_next >= 5 && (USART1->CR1 & USART_CR1_UE));
+
+    Sim_Line(&sync, 1, 72000000, 115200, 1000, 0);
+    sim_edges = 4;  // The line stops after the fourth edge
+    CHECK(USART1_Auto_Baud(100, &err) == 0 && USART1->BRR == 625);
+    CHECK(sim_now >= 7200000 && sim_now < 7200000 + 2 * 0x10000);  // 100 ms of 72 MHz, rounded up to a wrap
+
+    Sim_Line(&sync, 1, 72000000, 115200, 8000000, 0);  // Starts after the timeout
+    CHECK(USART1_Auto_Baud(100, &err) == 0 && sim_next == 0);
+
+    Sim_Line(&sync, 1, 72000000, 300, 1000, 0);  // BRR would be 240000
+    CHECK(USART1_Auto_Baud(100, &err) == 0 && USART1->BRR == 625 && sim_next == 5);
+    host_clocks.PCLK2_Frequency = 8000000;  // TIM1 at 16 MHz
+    Sim_Line(&sync, 1, 16000000, 300, 1000, 0);
+    CHECK(USART1_Auto_Baud(100, &err) == 300 && USART1->BRR == 26667 && err < 0 && err > -20);
+    host_clocks.PCLK2_Frequency = 72000000;
+}
+
+/**
+ * @brief USART1_Auto_Baud() leaves a running TIM1 alone and hands a stopped one back as it found it.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Auto_Baud_TIM1(void) {
+    static const uint8_t sync = 0x55;
+    int32_t err = 12345;
+
+    USART1->BRR = 625;
+    TIM1->CR1 = TIM_CR1_CEN | 0x0080u;  // Counting, with ARR preload, as the motor PWM leaves it
+    TIM1->PSC = 3;
+    TIM1->ARR = 1799;
+    TIM1->RCR = 1;
+    TIM1->CCMR2 = 0x0068u;  // CH3 in PWM mode 1 with preload
+    TIM1->CCER = 0x0500u;   // CH3 and CH3N enabled
+    Sim_Line(&sync, 1, 72000000, 115200, 1000, 0);
+    CHECK(USART1_Auto_Baud(100, &err) == 0 && USART1->BRR == 625 && err == 12345);
+    CHECK(TIM1->CR1 == (TIM_CR1_CEN | 0x0080u) && TIM1->PSC == 3 && TIM1->ARR == 1799 && TIM1->CCER == 0x0500u);
+    CHECK(TIM1->CCMR2 == 0x0068u && (USART1->CR1 & USART_CR1_UE));
+
+    TIM1->CR1 = 0x0080u;  // Stopped
+    CHECK(USART1_Auto_Baud(100, &err) == 115200 && USART1->BRR == 625);
+    CHECK(TIM1->CR1 == 0x0080u && TIM1->PSC == 3 && TIM1->ARR == 1799 && TIM1->RCR == 1);
+    CHECK(TIM1->CCMR2 == 0x0068u && TIM1->CCER == 0x0500u);
+}
+
+int main(void) {
+    USART1_Init(115200);
+    USART1->SR |= USART_FLAG_TC;  // The line is idle, USART1_TX_Flush() returns at once
+    Test_BRR_Table();
+    Test_BRR_Manual();
+    Test_High_Speed();
+    srand(9);
+    Test_Auto_Baud(72000000, 0);
+    Test_Auto_Baud(72000000, 1.0 / 20);
+    Test_Auto_Baud(36000000, 0);
+    Test_Auto_Baud(36000000, 1.0 / 20);
+    Test_Auto_Baud_Reject();
+    Test_Auto_Baud_TIM1();
+    return TEST_EXIT("test_usart_baud");
+}
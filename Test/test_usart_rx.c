@@ -0,0 +1,291 @@
+/**
+ * @file test_usart_rx.c
+ * @brief Host test of the USART1 DMA receive ring and idle-line frames, replaying recorded byte streams.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * Every received byte is put in USART1->DR and moved by the fake DMA1 Channel5 into the RX ring, which raises
+ * the half and full ring interrupts of the DMA manager; an idle line sets IDLE and runs the USART1 interrupt.
+ * A stream is a recording of bursts, each followed by an idle line. Every byte sent is also kept in a log, so a
+ * frame handed to the application must be the bytes of the log from its start count on, and its length must be
+ * that of one of the bursts. The frames lost to a full frame queue, to a frame longer than the ring and to an
+ * application that is too slow must all be counted.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_usart_rx
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "host.h"
+#include "usart.c"
+#include "dma.c"
+
+#define SIM_LOG_LEN 400000u  // Bytes kept of the stream
+
+// An NMEA receiver at 1 Hz, one burst per sentence, as logged from a module
+static const char *const sim_nmea[] = {
+    "$GPGGA,092750.000,5321.6802,N,00630.3372,W,1,8,1.03,61.7,M,55.2,M,,*76\r\n",
+    "$GPGSA,A,3,10,07,05,02,29,04,08,13,,,,,1.72,1.03,1.38*0A\r\n",
+    "$GPGSV,3,1,11,10,63,137,17,07,61,098,15,05,59,290,20,08,54,157,30*70\r\n",
+    "$GPGSV,3,2,11,02,39,223,19,13,28,070,17,26,23,252,,04,14,186,14*79\r\n",
+    "$GPGSV,3,3,11,29,09,301,24,16,09,020,,36,,,*76\r\n",
+    "$GPRMC,092750.000,A,5321.6802,N,00630.3372,W,0.02,31.66,280511,,,A*43\r\n",
+};
+
+static uint8_t sim_log[SIM_LOG_LEN];  // Every byte sent, by RX byte count
+static uint32_t sim_sent;             // Bytes sent
+static uint32_t sim_cb_calls;         // Frame callback calls
+
+/**
+ * @brief Frame callback, counts the calls.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Frame_Cb(void) { sim_cb_calls++; }
+
+/**
+ * @brief Receives one byte: it lands in DR and the DMA request moves it into the RX ring.
+ *
+ * @param b The byte.
+ * @return void
+ */
+static void Sim_Byte(uint8_t b) {
+    USART1->DR = b;
+    USART1->SR |= USART_FLAG_RXNE;
+    if (USART1->CR3 & USART_DMAReq_Rx) {
+        Host_DMA_Request(DMA1_Channel5);  // Reading DR clears RXNE
+        USART1->SR &= ~USART_FLAG_RXNE;
+    }
+    sim_log[sim_sent++ % SIM_LOG_LEN] = b;
+}
+
+/**
+ * @brief The line stays idle for one frame time: IDLE is set and the USART1 interrupt runs.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Idle(void) {
+    USART1->SR |= USART_FLAG_IDLE;
+    USART1_IRQHandler();
+}
+
+/**
+ * @brief Receives a burst followed by an idle line.
+ *
+ * @param buf The bytes.
+ * @param len The number of bytes.
+ * @return void
+ */
+static void Sim_Burst(const uint8_t *buf, uint32_t len) {
+    uint32_t i;
+
+    for (i = 0; i < len; ++i) {
+        Sim_Byte(buf[i]);
+    }
+    Sim_Idle();
+}
+
+/**
+ * @brief Checks a frame against the log: both spans together are the bytes sent from its start count on.
+ *
+ * @param f The frame.
+ * @return The frame length, or 0 if a byte differs or the spans are malformed.
+ */
+static uint32_t Sim_Frame_Ok(const USART_RX_Frame *f) {
+    uint32_t i;
+
+    if ((f->data2 == 0) != (f->len2 == 0) || f->data != &usart1_rx_buf[f->start & (USART1_RX_BUF_SIZE - 1)]) {
+        return 0;
+    }
+    for (i = 0; i < f->len; ++i) {
+        if (f->data[i] != sim_log[(f->start + i) % SIM_LOG_LEN]) {
+            return 0;
+        }
+    }
+    for (i = 0; i < f->len2; ++i) {
+        if (f->data2[i] != sim_log[(f->start + f->len + i) % SIM_LOG_LEN]) {
+            return 0;
+        }
+    }
+    return (uint32_t)f->len + f->len2;
+}
+
+/**
+ * @brief Replays the NMEA recording many times, reading the frames after every sentence: every sentence comes out
+ *        whole, including those that wrap around the ring, and nothing is lost.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_NMEA(void) {
+    USART_RX_Frame f;
+    USART_RX_Stats stats;
+    uint32_t bad = 0;
+    uint32_t wraps = 0;
+    uint32_t n = 0;
+    uint32_t len;
+    uint16_t rep;
+    uint8_t s;
+
+    for (rep = 0; rep < 200; ++rep) {
+        for (s = 0; s < sizeof(sim_nmea) / sizeof(sim_nmea[0]); ++s, ++n) {
+            len = (uint32_t)strlen(sim_nmea[s]);
+            Sim_Burst((const uint8_t *)sim_nmea[s], len);
+            if (!USART1_RX_Get_Frame(&f)) {
+                bad++;
+                continue;
+            }
+            bad += Sim_Frame_Ok(&f) != len || f.start != sim_sent - len || !USART1_RX_Frame_Valid(&f);
+            wraps += f.data2 != 0;
+        }
+    }
+    USART1_RX_Get_Stats(&stats);
+    CHECK(bad == 0 && wraps > 0);
+    CHECK(!USART1_RX_Get_Frame(&f));
+    CHECK(stats.frames == n && stats.lost_frames == 0 && stats.bytes == sim_sent && stats.hw_overruns == 0);
+    CHECK(sim_cb_calls == n);
+}
+
+/**
+ * @brief Replays random bursts of 1 to 2 * USART1_RX_BUF_SIZE bytes while the application reads at random
+ *        moments: every frame it gets is a whole burst and every burst is either returned or counted as lost.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Random(void) {
+    static uint32_t lens[20000];  // Length of every burst, in order
+    USART_RX_Frame f;
+    USART_RX_Stats before;
+    USART_RX_Stats after;
+    uint32_t b;
+    uint32_t i;
+    uint32_t next = 0;  // Next burst a returned frame can be
+    uint32_t got = 0;
+    uint32_t bad = 0;
+    uint32_t start0 = sim_sent;
+    uint32_t starts = sim_sent;
+
+    USART1_RX_Get_Stats(&before);
+    srand(6);
+    for (b = 0; b < sizeof(lens) / sizeof(lens[0]); ++b) {
+        lens[b] = 1 + (rand() % 8 ? rand() % 64 : rand() % (2 * USART1_RX_BUF_SIZE));
+        for (i = 0; i < lens[b]; ++i) {
+            Sim_Byte((uint8_t)rand());
+        }
+        Sim_Idle();
+        while (rand() % 4 != 0 && USART1_RX_Get_Frame(&f)) {
+            for (; next <= b && starts != f.start; starts += lens[next++]) {  // Skip the lost bursts
+            }
+            bad += next > b || Sim_Frame_Ok(&f) != lens[next] || !USART1_RX_Frame_Valid(&f);
+            starts += lens[next++];
+            got++;
+        }
+    }
+    while (USART1_RX_Get_Frame(&f)) {
+        got++;
+    }
+    USART1_RX_Get_Stats(&after);
+    CHECK(bad == 0);
+    CHECK(after.bytes - before.bytes == sim_sent - start0);
+    CHECK(got + after.lost_frames - before.lost_frames == b);  // Every burst returned or counted as lost
+    CHECK(after.lost_frames > before.lost_frames && got > b / 2);
+    printf("random: %u bursts, %u frames returned, %u lost\n", b, got, after.lost_frames - before.lost_frames);
+}
+
+/**
+ * @brief Each way of losing a frame is counted once: a full frame queue, a frame longer than the ring, a frame
+ *        lapped before the application gets to it, one lapped while it is processed, and a hardware overrun.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Overruns(void) {
+    static uint8_t buf[USART1_RX_BUF_SIZE + 1];
+    USART_RX_Frame f;
+    USART_RX_Frame g;
+    USART_RX_Stats s0;
+    USART_RX_Stats s;
+    uint8_t i;
+
+    memset(buf, 0xa5, sizeof(buf));
+    while (USART1_RX_Get_Frame(&f)) {
+    }
+    USART1_RX_Get_Stats(&s0);
+
+    for (i = 0; i < USART1_RX_FRAMES + 1; ++i) {  // One more than the queue holds
+        Sim_Burst(buf, 4);
+    }
+    USART1_RX_Get_Stats(&s);
+    CHECK(s.frames - s0.frames == USART1_RX_FRAMES && s.lost_frames - s0.lost_frames == 1);
+    for (i = 0; USART1_RX_Get_Frame(&f); ++i) {
+    }
+    CHECK(i == USART1_RX_FRAMES);
+
+    Sim_Burst(buf, USART1_RX_BUF_SIZE + 1);  // Its start is overwritten before it ends
+    Sim_Burst(buf, USART1_RX_BUF_SIZE);      // Exactly the ring still fits
+    USART1_RX_Get_Stats(&s);
+    CHECK(s.lost_frames - s0.lost_frames == 2 && USART1_RX_Get_Frame(&f) && f.len + f.len2 == USART1_RX_BUF_SIZE);
+    CHECK(USART1_RX_Frame_Valid(&f));
+    Sim_Byte(0);  // One byte more laps the first byte of the frame
+    CHECK(!USART1_RX_Frame_Valid(&f));
+    Sim_Idle();
+    CHECK(USART1_RX_Get_Frame(&f) && f.len == 1 && !f.data2);  // The byte that lapped it is a frame of its own
+
+    Sim_Burst(buf, 10);  // Lapped before the application reads it: skipped, the next one is returned
+    Sim_Burst(buf, 230);
+    Sim_Burst(buf, 20);
+    CHECK(USART1_RX_Get_Frame(&g) && g.len + g.len2 == 230 && Sim_Frame_Ok(&g));
+    USART1_RX_Get_Stats(&s);
+    CHECK(s.lost_frames - s0.lost_frames == 3);
+    CHECK(USART1_RX_Get_Frame(&g) && g.len + g.len2 == 20 && !USART1_RX_Get_Frame(&g));
+
+    USART1->SR |= USART_FLAG_ORE;  // A byte lost in the USART itself, the error interrupt
+    USART1_IRQHandler();
+    USART1_RX_Get_Stats(&s);
+    CHECK(s.hw_overruns - s0.hw_overruns == 1 && !(USART1->SR & USART_FLAG_ORE));
+    CHECK(s.frames - s0.frames == USART1_RX_FRAMES + 5 && !USART1_RX_Get_Frame(&g));
+}
+
+/**
+ * @brief A long frame is counted exactly through the half and full ring interrupts alone, and an idle line with
+ *        no new bytes queues nothing.
+ *
+ * @param void
+ * @return void
+ */
+static void Test_Long_Frame(void) {
+    USART_RX_Frame f;
+    USART_RX_Stats s0;
+    USART_RX_Stats s;
+    uint16_t i;
+
+    USART1_RX_Get_Stats(&s0);
+    for (i = 0; i < USART1_RX_BUF_SIZE - 1; ++i) {
+        Sim_Byte((uint8_t)i);
+    }
+    USART1_RX_Get_Stats(&s);
+    CHECK(s.bytes - s0.bytes >= USART1_RX_BUF_SIZE / 2 && s.frames == s0.frames);  // Seen at the ring events
+    Sim_Idle();
+    Sim_Idle();
+    USART1_RX_Get_Stats(&s);
+    CHECK(s.bytes - s0.bytes == USART1_RX_BUF_SIZE - 1 && s.frames - s0.frames == 1);
+    CHECK(USART1_RX_Get_Frame(&f) && Sim_Frame_Ok(&f) == USART1_RX_BUF_SIZE - 1 && !USART1_RX_Get_Frame(&f));
+}
+
+int main(void) {
+    USART1_Init(115200);
+    CHECK(usart1_rx_dma && (USART1->CR3 & USART_DMAReq_Rx));
+    USART1_RX_Set_Callback(Sim_Frame_Cb);
+    Test_NMEA();
+    USART1_RX_Set_Callback(0);
+    Test_Random();
+    Test_Overruns();
+    Test_Long_Frame();
+    return TEST_EXIT("test_usart_rx");
+}
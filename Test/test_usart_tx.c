@@ -0,0 +1,214 @@
+/**
+ * @file test_usart_tx.c
+ * @brief Host stress test and throughput benchmark of the USART1 TX ring, with the TXE interrupt on its own thread.
+ * @author Yixiang Fan
+ * @date 2024-08-15
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ *
+ * One thread is the application and queues a numbered byte stream with USART1_TX_Put(); another thread is the
+ * core taking the USART1 interrupt whenever TXE is enabled and interrupts are not masked, and logs every byte
+ * written to DR. PRIMASK is a spinlock here: masking interrupts on the producer thread keeps the interrupt thread
+ * out, as on the single core. With the blocking policy the log must be the stream exactly; with the drop
+ * policies it must be the stream with only whole bytes missing, as many as USART1_TX_Dropped() counts.
+ * The rate of bytes through the ring and the cost of one USART1_TX_Put() are printed.
+ *
+ * Build and run it on the host (not part of the firmware), from the repository root:
+ * Test/run_tests.sh test_usart_tx
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+#include "host.h"
+#include "usart.c"
+#include "dma.c"
+
+#define SIM_BYTES 200000u  // Bytes per stress run
+
+static volatile uint8_t sim_irq_lock;    // Held while interrupts are masked
+static volatile uint8_t sim_irq_wait;    // 1 while the other thread waits for the lock
+static __thread uint32_t sim_primask;    // PRIMASK as seen by this thread
+static __thread uint8_t sim_producer;    // 1 on the application thread
+static volatile uint8_t sim_stop;        // Ends the interrupt thread
+static volatile uint32_t sim_irq_delay;  // Spins between interrupts, a slow line
+static uint8_t *sim_log;                 // Bytes written to DR
+static volatile uint32_t sim_log_len;
+
+/**
+ * @brief Takes the interrupt lock; a futex hand-off per byte would dominate the run time, so it spins and gives
+ *        the core to the holder while it waits.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Lock(void) {
+    while (__atomic_test_and_set(&sim_irq_lock, __ATOMIC_ACQUIRE)) {
+        sim_irq_wait = 1;
+        while (sim_irq_lock) {
+            sched_yield();
+        }
+    }
+    sim_irq_wait = 0;
+}
+
+/**
+ * @brief Releases the interrupt lock and lets a waiting thread run, as a pended interrupt runs at once on unmasking.
+ *
+ * With one host CPU the threads only interleave where one yields, so the producer also yields at random unmasks:
+ * the interrupt then takes a varying number of bytes, and a producer waiting for room does not spin out its time
+ * slice.
+ *
+ * @param void
+ * @return void
+ */
+static void Sim_Unlock(void) {
+    __atomic_clear(&sim_irq_lock, __ATOMIC_RELEASE);
+    if (sim_irq_wait || (sim_producer && rand() % 64 == 0)) {
+        sched_yield();
+    }
+}
+
+// PRIMASK on two threads: the producer masks by taking the lock the interrupt thread runs the handler under
+uint32_t __get_PRIMASK(void) { return sim_primask; }
+
+void __set_PRIMASK(uint32_t primask) {
+    if ((primask & 1) && !sim_primask) {
+        Sim_Lock();
+    } else if (!(primask & 1) && sim_primask) {
+        Sim_Unlock();
+    }
+    sim_primask = primask & 1;
+}
+
+void __disable_irq(void) { __set_PRIMASK(1); }
+void __enable_irq(void) { __set_PRIMASK(0); }
+
+void USART_SendData(USART_TypeDef *USARTx, uint16_t Data) {
+    USARTx->DR = Data & 0x1ff;
+    sim_log[sim_log_len++] = (uint8_t)Data;
+}
+
+/**
+ * @brief The core taking USART1 interrupts: runs the handler whenever TXE is enabled and nothing masks it.
+ *
+ * TXE is always set, as if the shift register took every byte at once, unless sim_irq_delay slows it down.
+ *
+ * @param arg Unused.
+ * @return NULL
+ */
+static void *Sim_IRQ_Thread(void *arg) {
+    volatile uint32_t d;
+
+    sim_primask = 1;  // The handler runs with the lock held; it must not take it again
+    while (!sim_stop) {
+        Sim_Lock();
+        USART1->SR |= USART_FLAG_TXE;
+        if (USART1->CR1 & USART_CR1_TXEIE) {
+            USART1_IRQHandler();
+        }
+        Sim_Unlock();
+        for (d = 0; d < sim_irq_delay; ++d) {
+        }
+        if (!(USART1->CR1 & USART_CR1_TXEIE)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Queues the numbered stream from this thread while the interrupt thread drains it, then checks the log.
+ *
+ * @param policy The overflow policy.
+ * @param delay Spins between interrupts.
+ * @return void
+ */
+static void Test_Stress(USART_TX_Policy policy, uint32_t delay) {
+    pthread_t irq;
+    struct timespec t0;
+    struct timespec t1;
+    uint32_t dropped0 = USART1_TX_Dropped();
+    uint32_t queued = 0;
+    uint32_t i;
+    uint32_t j = 0;
+    uint32_t order_errors = 0;
+    double s;
+
+    sim_log_len = 0;
+    sim_stop = 0;
+    sim_irq_delay = delay;
+    sim_producer = 1;
+    USART1_TX_Set_Policy(policy);
+    pthread_create(&irq, NULL, Sim_IRQ_Thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < SIM_BYTES; ++i) {
+        queued += USART1_TX_Put((uint8_t)(i * 7 + (i >> 8)));
+    }
+    while (usart1_tx_head != usart1_tx_tail) {
+        sched_yield();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sim_stop = 1;
+    pthread_join(irq, NULL);
+    sim_producer = 0;
+
+    for (i = 0; i < sim_log_len; ++i, ++j) {  // The log is the stream with bytes left out, in order
+        while (j < SIM_BYTES && sim_log[i] != (uint8_t)(j * 7 + (j >> 8))) {
+            ++j;
+        }
+        order_errors += j >= SIM_BYTES;
+    }
+    CHECK(order_errors == 0);
+    CHECK(sim_log_len + USART1_TX_Dropped() - dropped0 == SIM_BYTES);
+    if (policy == USART_TX_Block) {
+        CHECK(sim_log_len == SIM_BYTES && USART1_TX_Dropped() == dropped0);
+    } else if (policy == USART_TX_Drop_Newest) {
+        CHECK(sim_log_len == queued);
+    } else {
+        CHECK(queued == SIM_BYTES);  // Always queued, older bytes make room
+    }
+    s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("policy %u, delay %4u: %7u bytes sent, %7u dropped, %6.2f MB/s through the ring\n", policy, delay,
+           sim_log_len, USART1_TX_Dropped() - dropped0, sim_log_len / s / 1e6);
+}
+
+/**
+ * @brief Times USART1_TX_Put() alone, the cost printf() now pays per byte, against a blocking send at 115200 baud.
+ *
+ * @param void
+ * @return void
+ */
+static void Bench_Put(void) {
+    struct timespec t0;
+    struct timespec t1;
+    uint32_t i;
+    double ns;
+
+    USART1_TX_Set_Policy(USART_TX_Drop_Oldest);  // Never waits, the ring stays full
+    sim_log_len = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < SIM_BYTES; ++i) {
+        USART1_TX_Put((uint8_t)i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / SIM_BYTES;
+    printf("USART1_TX_Put(): %.1f ns per byte on the host; a blocking fputc() waits 86806 ns per byte at 115200 "
+           "baud\n", ns);
+    CHECK(USART1_TX_Free() == 0);
+}
+
+int main(void) {
+    sim_log = malloc(SIM_BYTES);
+    USART1_Init(115200);
+    Test_Stress(USART_TX_Block, 0);
+    Test_Stress(USART_TX_Block, 200);
+    Test_Stress(USART_TX_Drop_Newest, 200);
+    Test_Stress(USART_TX_Drop_Oldest, 200);
+    Bench_Put();
+    free(sim_log);
+    return TEST_EXIT("test_usart_tx");
+}
@@ -2,6 +2,7 @@
  * @file    timer.c
  * @brief   This file contains the implementation of the TIM4 timer initialization and interrupt handler.
  *          The TIM4 timer is configured to generate an interrupt on update event and toggle the LED2 state.
+ *          TIM3 can be set up as a trigger source (TRGO) at a given rate for other peripherals such as the ADC.
  * @author  Yixiang Fan
  * @date    2024-08-02
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
@@ -9,6 +10,7 @@
 
 #include "time.h"
 #include "led.h"
+#include "dwt.h"
 
 /**
  * @brief Initializes the TIM4 timer with the given period and prescaler values.
@@ -50,8 +52,113 @@ void TIM4_Init(uint16_t per, uint16_t psc) {
  * @return void
  */
 void TIM4_IRQHandler(void) {
+    DWT_PROF_BEGIN(tim4_irq);
     if (TIM_GetITStatus(TIM4, TIM_IT_Update)) {
         led2 = !led2;
     }
     TIM_ClearITPendingBit(TIM4, TIM_IT_Update);
+    DWT_PROF_END(tim4_irq);
+}
+
+/**
+ * @brief Returns the clock that drives the APB1 timers (TIM2-TIM7).
+ *
+ * The APB1 timers run at PCLK1 when the APB1 prescaler is 1, otherwise at twice PCLK1.
+ *
+ * @return The timer clock in Hz.
+ */
+uint32_t TIM_APB1_Clock(void) {
+    RCC_ClocksTypeDef clocks;
+
+    RCC_GetClocksFreq(&clocks);
+    if (clocks.PCLK1_Frequency == clocks.HCLK_Frequency) {
+        return clocks.PCLK1_Frequency;
+    }
+    return clocks.PCLK1_Frequency * 2;
+}
+
+/**
+ * @brief Returns the clock that drives the APB2 timers (TIM1 and TIM8).
+ *
+ * The APB2 timers run at PCLK2 when the APB2 prescaler is 1, otherwise at twice PCLK2.
+ *
+ * @return The timer clock in Hz.
+ */
+uint32_t TIM_APB2_Clock(void) {
+    RCC_ClocksTypeDef clocks;
+
+    RCC_GetClocksFreq(&clocks);
+    if (clocks.PCLK2_Frequency == clocks.HCLK_Frequency) {
+        return clocks.PCLK2_Frequency;
+    }
+    return clocks.PCLK2_Frequency * 2;
+}
+
+/**
+ * @brief Computes the prescaler and auto-reload values for a given update rate.
+ *
+ * The total divider N = clk / rate is rounded to the nearest integer and split into the smallest prescaler that
+ * lets the auto-reload value fit in 16 bits, which keeps the auto-reload value (and the resolution) as large as
+ * possible. The relative rate error is at most 0.5 / N when the prescaler is 1 and at most 1 / 65536 otherwise.
+ *
+ * @param clk The timer clock in Hz.
+ * @param rate The wanted update rate in Hz, from clk / 2^32 up to clk / 2.
+ * @param per Receives the auto-reload value (ARR).
+ * @param psc Receives the prescaler value (PSC).
+ *
+ * @return The achieved rate in Hz, rounded to the nearest integer, or 0 if the rate is out of range.
+ */
+uint32_t TIM_Rate_Calc(uint32_t clk, uint32_t rate, uint16_t *per, uint16_t *psc) {
+    uint32_t n;
+    uint32_t div;
+    uint32_t arr;
+
+    if (rate == 0 || rate > clk / 2) {
+        return 0;
+    }
+    n = (clk + rate / 2) / rate;                  // Total divider, rounded
+    div = (n + 0xffff) >> 16;                     // Smallest prescaler so that ARR + 1 <= 65536
+    arr = (clk + rate * div / 2) / (rate * div);  // ARR + 1, rounded from the exact ratio
+    if (div > 0x10000 || arr > 0x10000) {
+        return 0;  // Slower than clk / 2^32
+    }
+    *psc = (uint16_t)(div - 1);
+    *per = (uint16_t)(arr - 1);
+    return (clk + div * arr / 2) / (div * arr);
+}
+
+/**
+ * @brief Initializes TIM3 as a trigger source that emits TRGO on every update event at the given rate.
+ *
+ * No interrupt is enabled; the update event itself drives the peripheral that selects TIM3_TRGO as its
+ * external trigger (for example ADC_ExternalTrigConv_T3_TRGO), so the CPU is not involved per event.
+ *
+ * @param rate The trigger rate in Hz.
+ *
+ * @return The achieved rate in Hz, or 0 if the rate cannot be generated (TIM3 is then left untouched).
+ */
+uint32_t TIM3_TRGO_Init(uint32_t rate) {
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    uint16_t per;
+    uint16_t psc;
+    uint32_t actual;
+
+    actual = TIM_Rate_Calc(TIM_APB1_Clock(), rate, &per, &psc);
+    if (actual == 0) {
+        return 0;
+    }
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);  // Enable TIM3 clock
+
+    TIM_Cmd(TIM3, DISABLE);
+    TIM_TimeBaseInitStructure.TIM_Period = per;   // Auto-reload value
+    TIM_TimeBaseInitStructure.TIM_Prescaler = psc;  // Prescaler factor
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;  // Set up count mode
+    TIM_TimeBaseInit(TIM3, &TIM_TimeBaseInitStructure);
+
+    TIM_SelectOutputTrigger(TIM3, TIM_TRGOSource_Update);  // TRGO on every update event
+
+    TIM_Cmd(TIM3, ENABLE);  // Enable timer
+    return actual;
 }
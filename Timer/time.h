@@ -1,6 +1,7 @@
 /**
  * @file timer_time.h
- * @brief This file declares the function prototypes for the Timer 4 initialization in the timer_time.c file.
+ * @brief This file declares the function prototypes for the Timer 4 initialization and the TIM3 trigger source
+ *        in the timer_time.c file.
  * @author Yixiang Fan
  * @date 2024-08-02
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
@@ -12,5 +13,9 @@
 #include "system.h"
 
 void TIM4_Init(uint16_t per, uint16_t psc);
+uint32_t TIM_APB1_Clock(void);
+uint32_t TIM_APB2_Clock(void);
+uint32_t TIM_Rate_Calc(uint32_t clk, uint32_t rate, uint16_t *per, uint16_t *psc);
+uint32_t TIM3_TRGO_Init(uint32_t rate);
 
 #endif  // TIMER_TIME_H_
@@ -0,0 +1,87 @@
+/**
+ * @file blog.c
+ * @brief Implements the deferred binary logging API.
+ *
+ * A record is
+ *
+ *     BLOG_SYNC | nargs, id (2 bytes, little endian), timestamp delta (varint), nargs arguments (varint each)
+ *
+ * where a varint stores 7 bits per byte, least significant first, with bit 7 set on every byte but the last.
+ * Small values such as counters, flags and short time deltas therefore take one byte instead of four.
+ * Records are queued on the USART1 TX ring whole (see USART1_TX_Write()), so a full ring drops a record rather
+ * than sending part of it.
+ *
+ * @author Yixiang Fan
+ * @date 2024-08-02
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "blog.h"
+#include "usart.h"
+
+static BLog_Clock blog_clock;  // Timestamp source, NULL for none
+static uint32_t blog_last_ts;  // Timestamp of the previous record
+
+/**
+ * @brief Appends a value as a varint.
+ *
+ * @param p Where to write, at least 5 bytes.
+ * @param v The value.
+ *
+ * @return The position after the varint.
+ */
+static uint8_t *BLog_Varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/**
+ * @brief Sets the timestamp source of the binary log.
+ *
+ * @param clock The function returning the current time, or NULL to send a zero delta in every record.
+ *
+ * @return void
+ */
+void BLog_Init(BLog_Clock clock) {
+    blog_clock = clock;
+    blog_last_ts = clock ? clock() : 0;
+}
+
+/**
+ * @brief Encodes one record and queues it for transmission. Normally called through BLOG().
+ *
+ * @param id The format string ID.
+ * @param args The raw arguments.
+ * @param nargs The number of arguments, at most BLOG_MAX_ARGS (extra arguments are not sent).
+ *
+ * @return void
+ */
+void BLog_Write(uint16_t id, const uint32_t *args, uint8_t nargs) {
+    uint8_t rec[3 + 5 * (BLOG_MAX_ARGS + 1)];
+    uint8_t *p = rec;
+    uint32_t ts = 0;
+    uint8_t i;
+
+    if (nargs > BLOG_MAX_ARGS) {
+        nargs = BLOG_MAX_ARGS;
+    }
+    if (blog_clock) {
+        ts = blog_clock();
+    }
+
+    *p++ = BLOG_SYNC | nargs;
+    *p++ = (uint8_t)id;
+    *p++ = (uint8_t)(id >> 8);
+    p = BLog_Varint(p, ts - blog_last_ts);
+    for (i = 0; i < nargs; ++i) {
+        p = BLog_Varint(p, args[i]);
+    }
+
+    if (USART1_TX_Write(rec, (uint16_t)(p - rec))) {
+        blog_last_ts = ts;  // A dropped record's delta moves to the next one, so the decoded times stay right
+    }
+}
@@ -0,0 +1,103 @@
+/**
+ * @file blog.h
+ * @brief Declares the deferred binary logging API.
+ *
+ * BLOG() sends a compact record (format string ID, timestamp, raw 32-bit arguments) instead of formatted text.
+ * The format strings are placed in the .blog_fmt section, which is not loaded on the target, and the host tool
+ * blog_decode.c rebuilds the text from a dump of that section. The address of every format string must be its
+ * offset in the section, which becomes its ID; the ID is sent in 16 bits, so the section must stay within 64 KiB.
+ *
+ * GNU ld (arm-none-eabi-gcc), in the linker script:
+ *
+ *     .blog_fmt 0 (INFO) : { KEEP(*(.blog_fmt)) }
+ *     ASSERT(SIZEOF(.blog_fmt) <= 0x10000, "blog: .blog_fmt exceeds the 16-bit format ID")
+ *
+ * and after linking:
+ *
+ *     arm-none-eabi-objcopy -O binary --only-section=.blog_fmt --set-section-flags .blog_fmt=alloc fw.elf blog_fmt.bin
+ *
+ * armlink (Keil MDK, armcc or armclang), in the scatter file, a load region of its own at address 0:
+ *
+ *     LR_BLOG 0x00000000 0x10000 {
+ *         ER_BLOG 0x00000000 0x10000 { *(.blog_fmt) }
+ *     }
+ *
+ * where the region size makes armlink reject more than 64 KiB, and after linking:
+ *
+ *     fromelf --bin --output=bin fw.axf
+ *
+ * which writes one file per load region: bin/ER_BLOG is the dictionary, and the file of the flash region is the
+ * image to program, since the .axf also holds LR_BLOG.
+ *
+ * Arguments are sent as 32-bit integers, so %d, %i, %u, %x, %X, %o and %c are supported; %s and %p send the
+ * address, which the decoder prints. Floating-point conversions are not supported.
+ *
+ * @author Yixiang Fan
+ * @date 2024-08-02
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#ifndef USART_BLOG_H_
+#define USART_BLOG_H_
+
+#include "system.h"
+
+#define BLOG_MAX_ARGS 15  // Arguments per record
+#define BLOG_SYNC 0xA0    // High nibble of the first record byte, the low nibble is the argument count
+
+#if defined(__GNUC__) || defined(__clang__) || defined(__CC_ARM)
+#define BLOG_SECTION_ __attribute__((section(".blog_fmt"), used))  // GCC, clang, armclang and armcc alike
+#else
+#error "blog.h: place the BLOG() format strings in the .blog_fmt section for this compiler"
+#endif
+
+/**
+ * @brief Logs a message as a binary record. The format string never reaches the target's flash.
+ *
+ * Standard C99: the empty argument added after the arguments lets BLOG() take a format alone, and every argument
+ * is converted through uintptr_t, so pointers for %s and %p convert as well as integers.
+ *
+ * @param ... A string literal, printf-style with integer conversions only, and up to BLOG_MAX_ARGS arguments.
+ */
+#define BLOG(...) BLOG_RECORD_(BLOG_PICK_(__VA_ARGS__, BLOG_L15_, BLOG_L14_, BLOG_L13_, BLOG_L12_, BLOG_L11_, \
+                                          BLOG_L10_, BLOG_L9_, BLOG_L8_, BLOG_L7_, BLOG_L6_, BLOG_L5_, BLOG_L4_,  \
+                                          BLOG_L3_, BLOG_L2_, BLOG_L1_, BLOG_L0_, ),                            \
+                               __VA_ARGS__, )
+
+#define BLOG_RECORD_(list, fmt, ...)                                            \
+    do {                                                                        \
+        static const char blog_fmt_[] BLOG_SECTION_ = fmt;                      \
+        const uint32_t blog_args_[] = {0, list(__VA_ARGS__)};                   \
+        BLog_Write((uint16_t)(uintptr_t)blog_fmt_, blog_args_ + 1,              \
+                   (uint8_t)(sizeof(blog_args_) / sizeof(blog_args_[0]) - 1));  \
+    } while (0)
+
+// The argument list macro for the number of arguments, and the list itself with every argument converted
+#define BLOG_PICK_(f, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, list, ...) list
+#define BLOG_ARG_(a) (uint32_t)(uintptr_t)(a)
+#define BLOG_L0_(...)
+#define BLOG_L1_(a, ...) BLOG_ARG_(a)
+#define BLOG_L2_(a, ...) BLOG_ARG_(a), BLOG_L1_(__VA_ARGS__)
+#define BLOG_L3_(a, ...) BLOG_ARG_(a), BLOG_L2_(__VA_ARGS__)
+#define BLOG_L4_(a, ...) BLOG_ARG_(a), BLOG_L3_(__VA_ARGS__)
+#define BLOG_L5_(a, ...) BLOG_ARG_(a), BLOG_L4_(__VA_ARGS__)
+#define BLOG_L6_(a, ...) BLOG_ARG_(a), BLOG_L5_(__VA_ARGS__)
+#define BLOG_L7_(a, ...) BLOG_ARG_(a), BLOG_L6_(__VA_ARGS__)
+#define BLOG_L8_(a, ...) BLOG_ARG_(a), BLOG_L7_(__VA_ARGS__)
+#define BLOG_L9_(a, ...) BLOG_ARG_(a), BLOG_L8_(__VA_ARGS__)
+#define BLOG_L10_(a, ...) BLOG_ARG_(a), BLOG_L9_(__VA_ARGS__)
+#define BLOG_L11_(a, ...) BLOG_ARG_(a), BLOG_L10_(__VA_ARGS__)
+#define BLOG_L12_(a, ...) BLOG_ARG_(a), BLOG_L11_(__VA_ARGS__)
+#define BLOG_L13_(a, ...) BLOG_ARG_(a), BLOG_L12_(__VA_ARGS__)
+#define BLOG_L14_(a, ...) BLOG_ARG_(a), BLOG_L13_(__VA_ARGS__)
+#define BLOG_L15_(a, ...) BLOG_ARG_(a), BLOG_L14_(__VA_ARGS__)
+
+/**
+ * @brief Timestamp source type, for example a free-running tick counter.
+ */
+typedef uint32_t (*BLog_Clock)(void);
+
+void BLog_Init(BLog_Clock clock);
+void BLog_Write(uint16_t id, const uint32_t *args, uint8_t nargs);
+
+#endif  // USART_BLOG_H_
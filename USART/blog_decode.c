@@ -0,0 +1,231 @@
+/**
+ * @file blog_decode.c
+ * @brief Host tool that turns a binary log captured from the target back into text.
+ *
+ * Build and run it on the host (not part of the firmware):
+ *
+ *     gcc -o blog_decode blog_decode.c
+ *     ./blog_decode blog_fmt.bin capture.bin
+ *
+ * blog_fmt.bin is the .blog_fmt section dumped from the firmware ELF (see blog.h) and capture.bin the raw bytes
+ * received from USART1; with no capture file the log is read from stdin. Every record is printed as
+ * "[timestamp] message", the timestamp being the sum of the deltas in the clock units given to BLog_Init().
+ * Dictionaries over 64 KiB are refused, since the 16-bit IDs cannot address them. Define BLOG_DECODE_NO_MAIN to
+ * use Decode() from another program, as Test/bench_blog.c does.
+ *
+ * @author Yixiang Fan
+ * @date 2024-08-02
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOG_SYNC 0xA0  // Must match blog.h
+
+/**
+ * @brief Reads a varint from the capture.
+ *
+ * @param in The capture stream.
+ * @param v Receives the value.
+ *
+ * @return 1 on success, 0 at the end of the stream.
+ */
+static int Read_Varint(FILE *in, uint32_t *v) {
+    int c;
+    int shift = 0;
+
+    *v = 0;
+    do {
+        c = fgetc(in);
+        if (c == EOF) {
+            return 0;
+        }
+        *v |= (uint32_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while ((c & 0x80) && shift < 35);
+    return 1;
+}
+
+/**
+ * @brief Prints a format string, taking each conversion's value from the argument list.
+ *
+ * Every conversion specification is copied to a small format string of its own and printed with the argument
+ * converted to the type the conversion expects.
+ *
+ * @param out Where to print.
+ * @param fmt The format string from the dictionary.
+ * @param args The arguments of the record.
+ * @param nargs The number of arguments.
+ *
+ * @return void
+ */
+static void Print_Record(FILE *out, const char *fmt, const uint32_t *args, int nargs) {
+    char spec[32];
+    int n;
+    int a = 0;
+    uint32_t v;
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            putc(*fmt++, out);
+            continue;
+        }
+        if (fmt[1] == '%') {
+            putc('%', out);
+            fmt += 2;
+            continue;
+        }
+
+        n = 0;
+        spec[n++] = *fmt++;
+        while (*fmt && strchr("-+ #0123456789.", *fmt) && n < (int)sizeof(spec) - 2) {
+            spec[n++] = *fmt++;
+        }
+        while (*fmt && strchr("hlLqjzt", *fmt)) {  // Length modifiers: every argument is 32 bits on the wire
+            fmt++;
+        }
+        if (!*fmt) {
+            break;
+        }
+        spec[n++] = *fmt;
+        spec[n] = '\0';
+        v = a < nargs ? args[a] : 0;
+        a++;
+
+        switch (*fmt++) {
+        case 'd':
+        case 'i':
+            fprintf(out, spec, (int32_t)v);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            fprintf(out, spec, v);
+            break;
+        case 'c':
+            fprintf(out, spec, (int)(v & 0xff));
+            break;
+        case 'p':
+        case 's':
+            fprintf(out, "<0x%08x>", v);
+            break;
+        default:
+            fprintf(out, "<%s?>", spec);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Decodes the records of a capture until its end, skipping bytes that cannot start a record.
+ *
+ * @param in The capture stream.
+ * @param out Where to print the text.
+ * @param dict The format string dictionary, terminated by a zero byte after its end.
+ * @param dict_len The dictionary length in bytes.
+ *
+ * @return The number of records decoded; a record cut short by the end of the capture is not counted.
+ */
+static long Decode(FILE *in, FILE *out, const char *dict, uint32_t dict_len) {
+    long records = 0;
+    int c;
+    int hi;
+    int nargs;
+    int i;
+    uint32_t id;
+    uint32_t delta;
+    uint32_t args[16];
+    uint64_t ts = 0;
+
+    while ((c = fgetc(in)) != EOF) {
+        if ((c & 0xf0) != BLOG_SYNC) {  // Not a record start, resynchronize
+            continue;
+        }
+        nargs = c & 0x0f;
+        c = fgetc(in);
+        hi = fgetc(in);
+        if (c == EOF || hi == EOF || !Read_Varint(in, &delta)) {
+            break;  // Truncated record at the end of the capture
+        }
+        id = (uint32_t)c | (uint32_t)hi << 8;
+        for (i = 0; i < nargs; ++i) {
+            if (!Read_Varint(in, &args[i])) {
+                break;
+            }
+        }
+        if (i < nargs) {
+            break;
+        }
+
+        ts += delta;
+        fprintf(out, "[%llu] ", (unsigned long long)ts);
+        if (id < dict_len) {
+            Print_Record(out, dict + id, args, nargs);
+        } else {
+            fprintf(out, "<unknown id %u>", id);
+        }
+        if (id >= dict_len || strlen(dict + id) == 0 || dict[id + strlen(dict + id) - 1] != '\n') {
+            putc('\n', out);
+        }
+        records++;
+    }
+    return records;
+}
+
+#ifndef BLOG_DECODE_NO_MAIN
+/**
+ * @brief Decodes a capture file with a format string dictionary.
+ *
+ * @param argc The argument count.
+ * @param argv The dictionary path and the optional capture path.
+ *
+ * @return 0 on success, 1 on a usage or file error.
+ */
+int main(int argc, char *argv[]) {
+    FILE *dict_file;
+    FILE *in = stdin;
+    char *dict;
+    long dict_len;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s blog_fmt.bin [capture.bin]\n", argv[0]);
+        return 1;
+    }
+
+    dict_file = fopen(argv[1], "rb");
+    if (!dict_file) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(dict_file, 0, SEEK_END);
+    dict_len = ftell(dict_file);
+    fseek(dict_file, 0, SEEK_SET);
+    if (dict_len > 0x10000) {  // The IDs of strings past 64 KiB would alias those at the start
+        fprintf(stderr, "%s: %ld bytes, the 16-bit format IDs only reach 65536\n", argv[1], dict_len);
+        return 1;
+    }
+    dict = malloc(dict_len + 1);
+    if (!dict || fread(dict, 1, dict_len, dict_file) != (size_t)dict_len) {
+        perror(argv[1]);
+        return 1;
+    }
+    dict[dict_len] = '\0';
+    fclose(dict_file);
+
+    if (argc > 2) {
+        in = fopen(argv[2], "rb");
+        if (!in) {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+
+    Decode(in, stdout, dict, (uint32_t)dict_len);
+    free(dict);
+    return 0;
+}
+#endif  // BLOG_DECODE_NO_MAIN
@@ -3,6 +3,8 @@
  * @brief Initializes USART1 with the given baud rate.
  *
  * This file contains the implementation of the USART1 initialization function and the corresponding interrupt handler.
+ * printf output is queued in a TX ring buffer that the USART1 TXE interrupt drains, and received data is written
+ * by DMA into an RX ring and handed out as frames delimited by the IDLE interrupt.
  *
  * @author Yixiang Fan
  * @date 2024-08-02
@@ -10,34 +12,234 @@
  */
 
 #include "usart.h"
+#include "coro.h"
+#include "dma.h"
+#include "dwt.h"
+
+static volatile u8 usart1_tx_buf[USART1_TX_BUF_SIZE];  // TX ring storage
+static volatile uint16_t usart1_tx_head;                // Next free slot, written only by the producer
+static volatile uint16_t usart1_tx_tail;                // Next byte to send, written only by the TXE interrupt
+static volatile uint32_t usart1_tx_dropped;             // Bytes lost to the overflow policy
+static USART_TX_Policy usart1_tx_policy = USART_TX_Block;
+
+static u8 usart1_rx_buf[USART1_RX_BUF_SIZE];              // RX ring, written by DMA1 Channel5 in circular mode
+static uint16_t usart1_rx_pos;                           // DMA write position at the last RX event
+static volatile uint32_t usart1_rx_count;                // Bytes received up to usart1_rx_pos
+static uint32_t usart1_rx_frame_start;                   // usart1_rx_count at the start of the open frame
+static uint32_t usart1_rx_frame_q[USART1_RX_FRAMES][2];  // Completed frames: start count and length
+static volatile uint8_t usart1_rx_q_head;                // Next free frame slot, written only by the interrupts
+static volatile uint8_t usart1_rx_q_tail;                // Next frame to return, written only by the application
+static USART_RX_Stats usart1_rx_stats;                   // Frame and overrun accounting
+static uint8_t usart1_rx_dma;                            // 1 while DMA1 Channel5 is allocated to RX
+static DMA_Desc_TypeDef usart1_rx_desc;                  // Circular transfer from USART1->DR into the RX ring
+static USART_RX_Callback usart1_rx_cb;                   // Called when a frame is queued, NULL to poll
+
+typedef char usart1_tx_buf_size_must_be_a_power_of_two[(USART1_TX_BUF_SIZE & (USART1_TX_BUF_SIZE - 1)) ? -1 : 1];
+typedef char usart1_rx_buf_size_must_be_a_power_of_two[(USART1_RX_BUF_SIZE & (USART1_RX_BUF_SIZE - 1)) ? -1 : 1];
+
+static void USART1_RX_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event);
 
 /**
  * @brief This function is called by default when using printf function.
- *        It sends a character to the USART1 and waits until the transmission is complete.
+ *        It queues a character in the USART1 TX ring buffer and returns at once; the TXE interrupt sends it.
  *
  * @param ch The character to be sent.
  * @param p  Pointer to a FILE object. This parameter is not used in this function.
  *
- * @return The character that was sent.
+ * @return The character that was queued (also when the overflow policy dropped it).
  *
  * @note This function is intended to be used with the printf function.
  *       It assumes that the USART1 has already been initialized and configured.
  *
- * @see USART_SendData()
- * @see USART_GetFlagStatus()
+ * @see USART1_TX_Put()
  */
 int fputc(int ch, FILE *p) {  // This function is called by default when using printf function
-    USART_SendData(USART1, (u8)ch);
-    while (USART_GetFlagStatus(USART1, USART_FLAG_TXE) == RESET) {
-    }
+    USART1_TX_Put((u8)ch);
     return ch;
 }
 
+/**
+ * @brief Queues one byte for transmission on USART1.
+ *
+ * The consumer is the TXE interrupt; producers may be thread code and interrupts at any priority, so the slot
+ * is claimed and the head advanced with interrupts masked for a few instructions. When the ring is full the
+ * overflow policy decides: USART_TX_Block waits with interrupts enabled for the TXE interrupt to make room,
+ * USART_TX_Drop_Newest discards ch and USART_TX_Drop_Oldest discards the oldest queued byte. Blocking falls back
+ * to dropping the newest byte when called with interrupts disabled or from an interrupt, where waiting could
+ * never end.
+ *
+ * @param ch The byte to be sent.
+ *
+ * @return 1 if ch was queued, 0 if it was dropped.
+ */
+uint8_t USART1_TX_Put(uint8_t ch) {
+    uint32_t primask = __get_PRIMASK();
+    uint8_t can_wait = !primask && !(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk);
+    uint16_t head;
+
+    for (;;) {
+        __disable_irq();
+        head = usart1_tx_head;
+        if ((uint16_t)(head - usart1_tx_tail) < USART1_TX_BUF_SIZE) {
+            break;
+        }
+        if (usart1_tx_policy == USART_TX_Drop_Oldest) {  // Ring full
+            usart1_tx_tail++;
+            usart1_tx_dropped++;
+            break;
+        }
+        if (usart1_tx_policy == USART_TX_Drop_Newest || !can_wait) {
+            usart1_tx_dropped++;
+            __set_PRIMASK(primask);
+            return 0;
+        }
+        __set_PRIMASK(primask);  // Let the TXE interrupt make room
+    }
+
+    usart1_tx_buf[head & (USART1_TX_BUF_SIZE - 1)] = ch;
+    usart1_tx_head = head + 1;
+    __set_PRIMASK(primask);
+    USART_ITConfig(USART1, USART_IT_TXE, ENABLE);  // Start or keep draining
+    return 1;
+}
+
+/**
+ * @brief Queues a block of bytes for transmission on USART1 as a whole: either all of them are queued, in one
+ *        piece, or none.
+ *
+ * For records that must not reach the line cut short, such as those of the binary log. The free space is checked
+ * for the whole block and the bytes are copied with interrupts masked, so bytes of other producers cannot land in
+ * between. When the block does not fit, USART_TX_Block waits for the TXE interrupt to make room as
+ * USART1_TX_Put() does; both drop policies drop the block, since discarding queued bytes would cut an earlier
+ * block short.
+ *
+ * @param buf The bytes to send.
+ * @param len The number of bytes, at most USART1_TX_BUF_SIZE.
+ *
+ * @return 1 if the block was queued, 0 if it was dropped (its bytes are counted by USART1_TX_Dropped()).
+ */
+uint8_t USART1_TX_Write(const uint8_t *buf, uint16_t len) {
+    uint32_t primask = __get_PRIMASK();
+    uint8_t can_wait = !primask && !(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk);
+    uint16_t head;
+    uint16_t i;
+
+    if (len > USART1_TX_BUF_SIZE) {
+        __disable_irq();
+        usart1_tx_dropped += len;
+        __set_PRIMASK(primask);
+        return 0;
+    }
+
+    for (;;) {
+        __disable_irq();
+        head = usart1_tx_head;
+        if ((uint16_t)(head - usart1_tx_tail) <= USART1_TX_BUF_SIZE - len) {
+            break;
+        }
+        if (usart1_tx_policy != USART_TX_Block || !can_wait) {
+            usart1_tx_dropped += len;
+            __set_PRIMASK(primask);
+            return 0;
+        }
+        __set_PRIMASK(primask);  // Let the TXE interrupt make room
+    }
+
+    for (i = 0; i < len; ++i) {
+        usart1_tx_buf[(uint16_t)(head + i) & (USART1_TX_BUF_SIZE - 1)] = buf[i];
+    }
+    usart1_tx_head = head + len;
+    __set_PRIMASK(primask);
+    USART_ITConfig(USART1, USART_IT_TXE, ENABLE);  // Start or keep draining
+    return 1;
+}
+
+/**
+ * @brief Returns the number of bytes that USART1_TX_Put() can queue right now without waiting or dropping.
+ *
+ * @return The free space in the TX ring.
+ */
+uint16_t USART1_TX_Free(void) {
+    return USART1_TX_BUF_SIZE - (uint16_t)(usart1_tx_head - usart1_tx_tail);
+}
+
+/**
+ * @brief Awaitable write: queues a buffer for transmission on USART1 without blocking.
+ *
+ * Whatever fits in the TX ring is queued on each call; the coroutine then waits for the TXE interrupt to make
+ * room instead of spinning. The buffer must stay valid until the write is done. Bytes of writes in flight at the
+ * same time can interleave.
+ *
+ * @param c The coroutine context of this write.
+ * @param buf The bytes to send.
+ * @param len The number of bytes.
+ *
+ * @return CORO_WAITING while bytes are left, CORO_DONE when all bytes are queued.
+ */
+uint8_t USART1_Write_Async(Coro_TypeDef *c, const uint8_t *buf, uint16_t len) {
+    CORO_BEGIN(c);
+    for (c->n = 0; c->n < len;) {
+        CORO_WAIT_UNTIL(c, USART1_TX_Free());
+        while (c->n < len && USART1_TX_Free()) {
+            USART1_TX_Put(buf[c->n++]);
+        }
+    }
+    CORO_END(c);
+}
+
+/**
+ * @brief Selects what USART1_TX_Put() does when the TX ring is full.
+ *
+ * @param policy USART_TX_Block, USART_TX_Drop_Newest or USART_TX_Drop_Oldest.
+ *
+ * @return void
+ */
+void USART1_TX_Set_Policy(USART_TX_Policy policy) {
+    usart1_tx_policy = policy;
+}
+
+/**
+ * @brief Returns the number of bytes dropped because the TX ring was full.
+ *
+ * @return The dropped byte count since start-up.
+ */
+uint32_t USART1_TX_Dropped(void) {
+    return usart1_tx_dropped;
+}
+
+/**
+ * @brief Waits until every queued byte, including the last stop bit, has left USART1.
+ *
+ * Use this before entering a low-power mode or reconfiguring the USART.
+ *
+ * @return void
+ */
+void USART1_TX_Flush(void) {
+    while (usart1_tx_head != usart1_tx_tail) {
+    }
+    while (USART_GetFlagStatus(USART1, USART_FLAG_TC) == RESET) {
+    }
+}
+
+/**
+ * @brief Initializes USART1 with the given baud rate.
+ *
+ * Transmission goes through the TX ring (see USART1_TX_Put()). Reception is handled by DMA1 Channel5, which
+ * writes every received byte into a circular RX ring without any CPU work; the IDLE interrupt marks the end
+ * of a frame and the DMA half/full events only keep track of the write position during long frames.
+ * Completed frames are returned by USART1_RX_Get_Frame(). If another driver owns DMA1 Channel5, reception stays
+ * off.
+ *
+ * @param bound The baud rate.
+ *
+ * @return void
+ */
 void USART1_Init(u32 bound) {
     // GPIO port settings
     GPIO_InitTypeDef GPIO_InitStructure;
     USART_InitTypeDef USART_InitStructure;
     NVIC_InitTypeDef NVIC_InitStructure;
+    DMA_InitTypeDef *DMA_InitStructure = &usart1_rx_desc.init;
 
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1, ENABLE);
@@ -65,7 +267,32 @@ void USART1_Init(u32 bound) {
 
     USART_ClearFlag(USART1, USART_FLAG_TC);
 
-    USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);  // Enable relevant interrupts
+    // RX DMA: USART1_RX is on DMA1 Channel5, at the same priority as USART1 so the two RX handlers never preempt
+    // each other
+    if (usart1_rx_dma) {
+        DMA_Mgr_Free(5);  // Restart the ring on re-initialization
+    }
+    usart1_rx_dma = DMA_Mgr_Alloc(5, 3, 3);
+    if (usart1_rx_dma) {
+        DMA_InitStructure->DMA_PeripheralBaseAddr = (uint32_t)&USART1->DR;
+        DMA_InitStructure->DMA_MemoryBaseAddr = (uint32_t)usart1_rx_buf;
+        DMA_InitStructure->DMA_DIR = DMA_DIR_PeripheralSRC;  // Peripheral to memory mode
+        DMA_InitStructure->DMA_BufferSize = USART1_RX_BUF_SIZE;
+        DMA_InitStructure->DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+        DMA_InitStructure->DMA_MemoryInc = DMA_MemoryInc_Enable;
+        DMA_InitStructure->DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+        DMA_InitStructure->DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+        DMA_InitStructure->DMA_Mode = DMA_Mode_Circular;  // Never stops, the ring just wraps
+        DMA_InitStructure->DMA_Priority = DMA_Priority_High;
+        DMA_InitStructure->DMA_M2M = DMA_M2M_Disable;
+        usart1_rx_desc.half = 1;
+        usart1_rx_desc.cb = USART1_RX_DMA_Event;
+        DMA_Mgr_Submit(5, &usart1_rx_desc);
+        USART_DMACmd(USART1, USART_DMAReq_Rx, ENABLE);
+
+        USART_ITConfig(USART1, USART_IT_IDLE, ENABLE);  // End of frame
+        USART_ITConfig(USART1, USART_IT_ERR, ENABLE);   // Overrun, noise and framing errors of DMA reception
+    }
 
     // Usart1 NVIC configuration
     NVIC_InitStructure.NVIC_IRQChannel = USART1_IRQn;          // USART1 interrupt channel
@@ -75,13 +302,425 @@ void USART1_Init(u32 bound) {
     NVIC_Init(&NVIC_InitStructure);                            // Initialize VIC registers
 }
 
+/**
+ * @brief Computes the BRR value for a baud rate and the error of the rate it really gives.
+ *
+ * On the STM32F1 the 16x oversampled divider is USARTDIV = pclk / (16 * baud), stored as a 12-bit mantissa and a
+ * 4-bit fraction, so BRR = mantissa << 4 | fraction is simply pclk / baud rounded to the nearest integer.
+ *
+ * @param pclk The USART kernel clock in Hz (PCLK2 for USART1, PCLK1 for the others).
+ * @param baud The wanted baud rate.
+ * @param brr Receives the BRR value.
+ * @param err_ppm Receives the error of the achieved rate in parts per million (positive means too fast); may be
+ *                NULL.
+ *
+ * @return The achieved baud rate rounded to the nearest integer, or 0 if baud is out of range (BRR must be
+ *         between 16 and 0xffff).
+ */
+uint32_t USART_BRR_Calc(uint32_t pclk, uint32_t baud, uint16_t *brr, int32_t *err_ppm) {
+    uint32_t div;
+    uint32_t actual;
+
+    if (baud == 0) {
+        return 0;
+    }
+    div = (pclk + baud / 2) / baud;
+    if (div < 16 || div > 0xffff) {
+        return 0;
+    }
+
+    *brr = (uint16_t)div;
+    actual = (pclk + div / 2) / div;
+    if (err_ppm) {
+        // (pclk / div - baud) / baud, kept exact in 64 bits
+        *err_ppm = (int32_t)(((int64_t)pclk * 1000000 - (int64_t)baud * div * 1000000) / ((int64_t)baud * div));
+    }
+    return actual;
+}
+
+/**
+ * @brief Changes the USART1 baud rate without reinitializing the port.
+ *
+ * Queued bytes are sent at the old rate first: the port is disabled only after the TX ring has drained and the
+ * last stop bit has left (see USART1_TX_Flush()), so call it from thread code.
+ *
+ * @param baud The new baud rate.
+ * @param err_ppm Receives the error of the achieved rate in ppm; may be NULL.
+ *
+ * @return The achieved baud rate, or 0 if baud cannot be reached with the current PCLK2 (nothing is changed).
+ */
+uint32_t USART1_Set_Baud(uint32_t baud, int32_t *err_ppm) {
+    RCC_ClocksTypeDef clocks;
+    uint16_t brr;
+    uint32_t actual;
+
+    RCC_GetClocksFreq(&clocks);
+    actual = USART_BRR_Calc(clocks.PCLK2_Frequency, baud, &brr, err_ppm);
+    if (actual) {
+        USART1_TX_Flush();  // Do not cut off a byte in flight
+        USART_Cmd(USART1, DISABLE);
+        USART1->BRR = brr;
+        USART_Cmd(USART1, ENABLE);
+    }
+    return actual;
+}
+
+/**
+ * @brief Switches USART1 to the fastest standard baud rate whose error is within the given limit.
+ *
+ * The candidates are the standard rates from 4.5 Mbaud (PCLK2 / 16 at 72 MHz) down to 9600; the first one that
+ * the current PCLK2 can generate within max_err_ppm is applied.
+ *
+ * @param max_err_ppm The largest acceptable error in ppm, e.g. 10000 for 1 %.
+ * @param err_ppm Receives the error of the chosen rate in ppm; may be NULL.
+ *
+ * @return The chosen nominal baud rate, or 0 if none qualifies (nothing is changed).
+ */
+uint32_t USART1_High_Speed(uint32_t max_err_ppm, int32_t *err_ppm) {
+    static const uint32_t rates[] = {4500000, 2250000, 2000000, 1500000, 1000000, 921600, 576000, 500000,
+                                     460800,  250000,  230400,  115200,  57600,   38400,  19200,  9600};
+    RCC_ClocksTypeDef clocks;
+    uint16_t brr;
+    int32_t err;
+    uint8_t i;
+
+    RCC_GetClocksFreq(&clocks);
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+        if (USART_BRR_Calc(clocks.PCLK2_Frequency, rates[i], &brr, &err) &&
+            (uint32_t)(err < 0 ? -err : err) <= max_err_ppm) {
+            USART1_Set_Baud(rates[i], err_ppm);
+            return rates[i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Measures the baud rate of a 0x55 sync byte on PA10 and configures USART1 for it.
+ *
+ * PA10 (USART1_RX) is also TIM1_CH3, so TIM1 captures the falling edges of the sync byte while USART1 is
+ * disabled. 0x55 sent LSB first gives five falling edges exactly two bits apart, at the start bit and at bits
+ * 1, 3, 5 and 7, so the first and last edge are eight bit times apart. The intervals must agree within 1/8 of
+ * their mean, otherwise the byte is rejected. TIM1 runs undivided and overflows are counted in software, so the
+ * measurement resolution is one timer clock at any baud rate. Call it after USART1_Init(); it blocks until the
+ * sync byte has been seen or the timeout expires. Queued TX bytes are sent at the old rate first.
+ *
+ * TIM1 is shared with the motor PWM (Motor_PWM_Init()), so the measurement refuses to start while TIM1 is
+ * counting, and hands a stopped TIM1 back with the time base and channel 3 setup it found.
+ *
+ * @param timeout_ms How long to wait for the sync byte.
+ * @param err_ppm Receives the error of the programmed rate against the measured one in ppm; may be NULL.
+ *
+ * @return The measured baud rate, or 0 on timeout, if no valid sync byte was seen, if PCLK2 cannot generate the
+ *         rate or if TIM1 is running (the baud rate is unchanged).
+ */
+uint32_t USART1_Auto_Baud(uint32_t timeout_ms, int32_t *err_ppm) {
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    TIM_ICInitTypeDef TIM_ICInitStructure;
+    RCC_ClocksTypeDef clocks;
+    uint32_t tim_clk;
+    uint32_t timeout;
+    uint32_t high = 0;  // Software extension of the 16-bit counter
+    uint32_t edge[5];
+    uint32_t span;
+    uint32_t div;
+    uint32_t baud = 0;
+    uint16_t cap;
+    uint16_t brr;
+    uint16_t tim_cr1;
+    uint16_t tim_psc;
+    uint16_t tim_arr;
+    uint16_t tim_rcr;
+    uint16_t tim_ccmr2;
+    uint16_t tim_ccer;
+    uint8_t n = 0;
+    uint8_t i;
+
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+    if (TIM1->CR1 & TIM_CR1_CEN) {
+        return 0;  // Another driver owns TIM1 right now
+    }
+    tim_cr1 = TIM1->CR1;  // Restored below for a driver that stopped TIM1 and will start it again
+    tim_psc = TIM1->PSC;
+    tim_arr = TIM1->ARR;
+    tim_rcr = TIM1->RCR;
+    tim_ccmr2 = TIM1->CCMR2;
+    tim_ccer = TIM1->CCER;
+
+    RCC_GetClocksFreq(&clocks);
+    tim_clk = clocks.PCLK2_Frequency == clocks.HCLK_Frequency ? clocks.PCLK2_Frequency : clocks.PCLK2_Frequency * 2;
+    timeout = (uint32_t)((uint64_t)timeout_ms * tim_clk / 65536000) + 1;  // In counter overflows
+
+    TIM_TimeBaseInitStructure.TIM_Period = 0xffff;
+    TIM_TimeBaseInitStructure.TIM_Prescaler = 0;  // Full resolution
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInitStructure.TIM_RepetitionCounter = 0;
+    TIM_TimeBaseInit(TIM1, &TIM_TimeBaseInitStructure);
+
+    TIM_ICInitStructure.TIM_Channel = TIM_Channel_3;  // PA10
+    TIM_ICInitStructure.TIM_ICFilter = 0x00;
+    TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_Falling;
+    TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+    TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+    TIM_ICInit(TIM1, &TIM_ICInitStructure);
+
+    USART1_TX_Flush();           // Do not cut off a byte in flight
+    USART_Cmd(USART1, DISABLE);  // Do not receive the sync byte as data
+    TIM_ClearFlag(TIM1, TIM_FLAG_CC3 | TIM_FLAG_Update);
+    TIM_Cmd(TIM1, ENABLE);
+
+    while (n < 5 && timeout) {
+        if (TIM_GetFlagStatus(TIM1, TIM_FLAG_CC3) != RESET) {
+            cap = TIM_GetCapture3(TIM1);  // Reading CCR3 clears the flag
+            // An overflow that is still pending belongs before this edge if the capture is in the lower half
+            if (TIM_GetFlagStatus(TIM1, TIM_FLAG_Update) != RESET && cap < 0x8000) {
+                TIM_ClearFlag(TIM1, TIM_FLAG_Update);
+                high += 0x10000;
+                timeout--;
+            }
+            edge[n++] = high + cap;
+        } else if (TIM_GetFlagStatus(TIM1, TIM_FLAG_Update) != RESET) {
+            TIM_ClearFlag(TIM1, TIM_FLAG_Update);
+            high += 0x10000;
+            timeout--;
+        }
+    }
+
+    TIM_Cmd(TIM1, DISABLE);
+    TIM1->CCER = tim_ccer & ~TIM_CCER_CC3E;  // CC3S is only writable while the channel is off
+    TIM1->CCMR2 = tim_ccmr2;
+    TIM1->CCER = tim_ccer;
+    TIM1->PSC = tim_psc;  // Preloaded, they apply from the owner's next update event
+    TIM1->ARR = tim_arr;
+    TIM1->RCR = tim_rcr;
+    TIM1->CR1 = tim_cr1;
+
+    if (n == 5) {
+        span = edge[4] - edge[0];
+        for (i = 1; i < 5; ++i) {  // Each interval is two bit times, span / 4
+            if ((edge[i] - edge[i - 1]) * 4 * 8 < span * 7 || (edge[i] - edge[i - 1]) * 4 * 8 > span * 9) {
+                span = 0;  // Not a 0x55
+            }
+        }
+        if (span) {
+            baud = (uint32_t)(((uint64_t)tim_clk * 8 + span / 2) / span);
+            // BRR = pclk2 / baud = pclk2 * span / (8 * tim_clk), computed from the measurement itself
+            div = (uint32_t)(((uint64_t)clocks.PCLK2_Frequency * span + 4 * (uint64_t)tim_clk) /
+                             (8 * (uint64_t)tim_clk));
+            if (div >= 16 && div <= 0xffff) {  // Too slow a sender would not fit the 16-bit BRR
+                brr = (uint16_t)div;
+                USART1->BRR = brr;
+                if (err_ppm) {
+                    // (pclk2 / brr) / (8 * tim_clk / span) - 1
+                    *err_ppm = (int32_t)(((int64_t)clocks.PCLK2_Frequency * span - (int64_t)brr * 8 * tim_clk) *
+                                         1000000 / ((int64_t)brr * 8 * tim_clk));
+                }
+            } else {
+                baud = 0;
+            }
+        }
+    }
+
+    USART_Cmd(USART1, ENABLE);
+    return baud;
+}
+
+/**
+ * @brief Brings the RX byte count up to the current DMA write position and optionally closes the open frame.
+ *
+ * Called only from the USART1 and DMA1 Channel5 interrupts, which share a priority. The DMA interrupts fire
+ * at least twice per ring, so the position never moves by a whole ring between two calls.
+ *
+ * @param frame_end 1 to close the open frame (line idle), 0 to only update the position.
+ *
+ * @return void
+ */
+static void USART1_RX_Update(uint8_t frame_end) {
+    uint16_t pos = (USART1_RX_BUF_SIZE - DMA_GetCurrDataCounter(DMA1_Channel5)) & (USART1_RX_BUF_SIZE - 1);
+    uint32_t len;
+    uint8_t head;
+
+    usart1_rx_count += (uint16_t)(pos - usart1_rx_pos) & (USART1_RX_BUF_SIZE - 1);
+    usart1_rx_pos = pos;
+    usart1_rx_stats.bytes = usart1_rx_count;
+
+    len = usart1_rx_count - usart1_rx_frame_start;
+    if (!frame_end || len == 0) {
+        return;
+    }
+
+    head = usart1_rx_q_head;
+    if (len > USART1_RX_BUF_SIZE) {  // Frame longer than the ring, its start is already overwritten
+        usart1_rx_stats.lost_frames++;
+    } else if ((uint8_t)(head - usart1_rx_q_tail) >= USART1_RX_FRAMES) {  // Frame queue full
+        usart1_rx_stats.lost_frames++;
+    } else {
+        usart1_rx_frame_q[head & (USART1_RX_FRAMES - 1)][0] = usart1_rx_frame_start;
+        usart1_rx_frame_q[head & (USART1_RX_FRAMES - 1)][1] = len;
+        usart1_rx_q_head = head + 1;
+        usart1_rx_stats.frames++;
+        if (usart1_rx_cb) {
+            usart1_rx_cb();
+        }
+    }
+    usart1_rx_frame_start = usart1_rx_count;
+}
+
+/**
+ * @brief Returns the number of bytes received so far, including bytes not yet seen by an interrupt.
+ *
+ * @return The running RX byte count.
+ */
+static uint32_t USART1_RX_Received(void) {
+    uint32_t count;
+    uint16_t pos;
+
+    do {  // Re-read if an RX interrupt updated the count in between
+        count = usart1_rx_count;
+        pos = usart1_rx_pos;
+    } while (count != usart1_rx_count);
+    return count + ((uint16_t)(USART1_RX_BUF_SIZE - DMA_GetCurrDataCounter(DMA1_Channel5) - pos) &
+                    (USART1_RX_BUF_SIZE - 1));
+}
+
+/**
+ * @brief Fills the spans of a frame from its position in the RX ring.
+ *
+ * @param f The frame to fill; f->start and the total length are given.
+ * @param len The frame length.
+ *
+ * @return void
+ */
+static void USART1_RX_Make_Spans(USART_RX_Frame *f, uint32_t len) {
+    uint16_t off = f->start & (USART1_RX_BUF_SIZE - 1);
+
+    f->data = &usart1_rx_buf[off];
+    if (off + len <= USART1_RX_BUF_SIZE) {
+        f->len = (uint16_t)len;
+        f->data2 = 0;
+        f->len2 = 0;
+    } else {  // Frame wraps around the end of the ring
+        f->len = USART1_RX_BUF_SIZE - off;
+        f->data2 = usart1_rx_buf;
+        f->len2 = (uint16_t)(len - f->len);
+    }
+}
+
+/**
+ * @brief Returns the oldest completed RX frame as spans over the RX ring, without copying.
+ *
+ * A frame that wraps around the end of the ring is returned as two spans, data/len followed by data2/len2;
+ * otherwise data2 is NULL and len2 is 0. The bytes stay valid until the DMA has written another
+ * USART1_RX_BUF_SIZE bytes after the start of the frame; call USART1_RX_Frame_Valid() after processing to
+ * confirm nothing was overwritten in the meantime. Frames that were already overwritten are skipped and
+ * counted as lost.
+ *
+ * @param f Receives the frame.
+ *
+ * @return 1 if a frame was returned, 0 if none is pending.
+ */
+uint8_t USART1_RX_Get_Frame(USART_RX_Frame *f) {
+    uint32_t primask;
+    uint8_t tail;
+    uint32_t len;
+
+    while ((tail = usart1_rx_q_tail) != usart1_rx_q_head) {
+        f->start = usart1_rx_frame_q[tail & (USART1_RX_FRAMES - 1)][0];
+        len = usart1_rx_frame_q[tail & (USART1_RX_FRAMES - 1)][1];
+        usart1_rx_q_tail = tail + 1;
+        if (USART1_RX_Frame_Valid(f)) {
+            USART1_RX_Make_Spans(f, len);
+            return 1;
+        }
+        primask = __get_PRIMASK();
+        __disable_irq();                // The RX interrupts update the same counter
+        usart1_rx_stats.lost_frames++;  // Overwritten before the application got to it
+        __set_PRIMASK(primask);
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks that the bytes of a frame returned by USART1_RX_Get_Frame() have not been overwritten.
+ *
+ * @param f The frame.
+ *
+ * @return 1 if the frame is still intact, 0 if the DMA has lapped it.
+ */
+uint8_t USART1_RX_Frame_Valid(const USART_RX_Frame *f) {
+    return USART1_RX_Received() - f->start <= USART1_RX_BUF_SIZE;
+}
+
+/**
+ * @brief Copies the RX accounting counters.
+ *
+ * @param stats Receives the counters.
+ *
+ * @return void
+ */
+void USART1_RX_Get_Stats(USART_RX_Stats *stats) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *stats = usart1_rx_stats;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Registers a callback for queued frames, so the application can wait for an event instead of polling
+ *        USART1_RX_Get_Frame().
+ *
+ * @param cb Called from the USART1 interrupt every time a frame is queued; NULL to poll instead.
+ *
+ * @return void
+ */
+void USART1_RX_Set_Callback(USART_RX_Callback cb) {
+    usart1_rx_cb = cb;
+}
+
 void USART1_IRQHandler(void) {  // USART1 interrupt service program
-    unit8_t r;
-    if (USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) {  // Receive interrupt
-        r = USART_ReceiveData(USART1);                        // USART1->DR: Read the received data
-        USART_SendData(USART1, r);
-        while (USART_GetFlagStatus(USART1, USART_FLAG_TC) != SET) {
+    uint16_t tail;
+    uint16_t err;
+    uint8_t idle;
+    DWT_PROF_BEGIN(usart1_irq);
+
+    if (USART_GetITStatus(USART1, USART_IT_TXE) != RESET) {  // Transmit data register empty
+        tail = usart1_tx_tail;
+        if (tail != usart1_tx_head) {
+            USART_SendData(USART1, usart1_tx_buf[tail & (USART1_TX_BUF_SIZE - 1)]);
+            usart1_tx_tail = tail + 1;
+        } else {
+            USART_ITConfig(USART1, USART_IT_TXE, DISABLE);  // Ring drained
         }
     }
-    USART_ClearFlag(USART1, USART_FLAG_TC);
+    idle = USART_GetITStatus(USART1, USART_IT_IDLE) != RESET;  // Line idle, end of frame
+    err = USART1->SR & (USART_FLAG_ORE | USART_FLAG_NE | USART_FLAG_FE);  // Error interrupt, with or without IDLE
+    if (err & USART_FLAG_ORE) {
+        usart1_rx_stats.hw_overruns++;  // A byte arrived before the DMA could take the previous one
+    }
+    if (idle || err) {
+        USART_ReceiveData(USART1);  // Reading SR then DR clears IDLE, ORE, NE and FE
+    }
+    if (idle) {
+        USART1_RX_Update(1);
+    }
+    DWT_PROF_END(usart1_irq);
+}
+
+/**
+ * @brief DMA manager callback for DMA1 Channel5, the USART1 RX DMA.
+ *
+ * The half and full ring events do not end a frame; they only keep the RX byte count exact during frames
+ * longer than half the ring.
+ *
+ * @param desc The RX descriptor.
+ * @param event DMA_EVT_HT or DMA_EVT_TC.
+ *
+ * @return void
+ */
+static void USART1_RX_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event) {
+    (void)desc;
+    (void)event;
+    USART1_RX_Update(0);
 }
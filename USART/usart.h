@@ -1,10 +1,13 @@
 /**
  * @file usart_init.h
- * @brief Declares the USART1 initialization function.
+ * @brief Declares the USART1 initialization function the TX/RX ring buffer API and the baud rate helpers.
  *
  * This file contains the declaration of the USART1 initialization function, which is defined in the corresponding
  * source file.
  *
+ * USART1_Auto_Baud() borrows TIM1 (CH3 on PA10) for the measurement, which the motor PWM (Motor_PWM_Init()) also
+ * uses: it returns 0 while TIM1 is running and restores the time base and channel 3 of a stopped TIM1.
+ *
  * @author Yixiang Fan
  * @date 2024-08-02
  * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
@@ -16,7 +19,62 @@
 #include "stdio.h"
 #include "system.h"
 
+struct Coro_TypeDef;  // Coroutine context, see coro.h
+
+#define USART1_TX_BUF_SIZE 256  // TX ring size in bytes, must be a power of two
+#define USART1_RX_BUF_SIZE 256  // RX ring size in bytes, must be a power of two
+#define USART1_RX_FRAMES 8      // Completed frames that can wait for the application, must be a power of two
+
+/**
+ * @brief What USART1_TX_Put() does when the TX ring is full.
+ */
+typedef enum {
+    USART_TX_Block = 0,    // Wait until the TXE interrupt makes room
+    USART_TX_Drop_Newest,  // Discard the byte being queued
+    USART_TX_Drop_Oldest   // Discard the oldest queued byte
+} USART_TX_Policy;
+
+/**
+ * @brief A received frame as up to two (pointer, length) spans over the RX ring.
+ */
+typedef struct {
+    const uint8_t *data;   // First span
+    uint16_t len;          // Length of the first span
+    const uint8_t *data2;  // Second span when the frame wraps around the ring, otherwise NULL
+    uint16_t len2;         // Length of the second span
+    uint32_t start;        // RX byte count at the first byte of the frame
+} USART_RX_Frame;
+
+/**
+ * @brief RX accounting counters.
+ */
+typedef struct {
+    uint32_t bytes;        // Bytes received
+    uint32_t frames;       // Frames queued for the application
+    uint32_t lost_frames;  // Frames lost because the ring or the frame queue overflowed
+    uint32_t hw_overruns;  // USART overrun errors (ORE)
+} USART_RX_Stats;
+
+/**
+ * @brief Callback type for a frame queued by the RX path, called from the USART1 interrupt.
+ */
+typedef void (*USART_RX_Callback)(void);
 
 void USART1_Init(unit32_t bound);
+uint32_t USART_BRR_Calc(uint32_t pclk, uint32_t baud, uint16_t *brr, int32_t *err_ppm);
+uint32_t USART1_Set_Baud(uint32_t baud, int32_t *err_ppm);
+uint32_t USART1_High_Speed(uint32_t max_err_ppm, int32_t *err_ppm);
+uint32_t USART1_Auto_Baud(uint32_t timeout_ms, int32_t *err_ppm);
+uint8_t USART1_TX_Put(uint8_t ch);
+uint8_t USART1_TX_Write(const uint8_t *buf, uint16_t len);
+uint16_t USART1_TX_Free(void);
+uint8_t USART1_Write_Async(struct Coro_TypeDef *c, const uint8_t *buf, uint16_t len);
+void USART1_TX_Set_Policy(USART_TX_Policy policy);
+uint32_t USART1_TX_Dropped(void);
+void USART1_TX_Flush(void);
+uint8_t USART1_RX_Get_Frame(USART_RX_Frame *f);
+uint8_t USART1_RX_Frame_Valid(const USART_RX_Frame *f);
+void USART1_RX_Get_Stats(USART_RX_Stats *stats);
+void USART1_RX_Set_Callback(USART_RX_Callback cb);
 
 #endif  // USART_USART_H_
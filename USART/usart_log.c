@@ -0,0 +1,246 @@
+/**
+ * @file usart_log.c
+ * @brief Implements the DMA-driven log sink for USART1.
+ *
+ * Buffers are used in ring order. Buffers from log_done up to log_fill - 1 are closed and waiting for (or in)
+ * the DMA; buffer log_fill is open and receives new messages. Only the producer appends to the open buffer and
+ * only the transfer-complete interrupt releases sent buffers. Either side may close the open buffer and start
+ * the DMA, the producer with the DMA interrupt masked and the interrupt only while the producer is not writing.
+ * The sink has a single producer: do not log from interrupts and the main loop at the same time, and do not
+ * use printf on USART1 while the sink is sending.
+ *
+ * @author Yixiang Fan
+ * @date 2024-08-02
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#include "usart_log.h"
+#include "dma.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static char log_buf[LOG_BUF_COUNT][LOG_BUF_SIZE];  // Buffer pool
+static uint16_t log_len[LOG_BUF_COUNT];            // Bytes used in each buffer
+static volatile uint8_t log_done;                  // Oldest buffer not yet released by the DMA interrupt
+static volatile uint8_t log_fill;                  // Open buffer
+static volatile uint8_t log_busy;                  // 1 while a DMA transfer is running
+static volatile uint8_t log_writing;               // 1 while the producer appends to the open buffer
+static volatile uint32_t log_dropped;              // Messages dropped because the pool was full
+static uint8_t log_dma;                            // 1 while DMA1 Channel4 is allocated to the sink
+static DMA_Desc_TypeDef log_desc;                  // Transfer of the buffer being sent
+
+static void Log_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event);
+
+/**
+ * @brief Starts the DMA on the oldest closed buffer, closing the open one first if nothing else is waiting.
+ *
+ * Must run either in the DMA interrupt or with it masked.
+ *
+ * @return void
+ */
+static void Log_Start_Next(void) {
+    uint8_t i;
+
+    if (log_busy) {
+        return;
+    }
+    if (log_done == log_fill) {  // No closed buffer waiting
+        if (log_writing || log_len[log_fill & (LOG_BUF_COUNT - 1)] == 0) {
+            return;
+        }
+        log_fill++;  // Close the open buffer and send it
+        log_len[log_fill & (LOG_BUF_COUNT - 1)] = 0;
+    }
+
+    i = log_done & (LOG_BUF_COUNT - 1);
+    log_busy = 1;
+    log_desc.init.DMA_MemoryBaseAddr = (uint32_t)log_buf[i];
+    log_desc.init.DMA_BufferSize = log_len[i];
+    DMA_Mgr_Submit(4, &log_desc);
+}
+
+/**
+ * @brief Starts the DMA from thread context if it is idle.
+ *
+ * @return void
+ */
+static void Log_Kick(void) {
+    NVIC_DisableIRQ(DMA1_Channel4_IRQn);
+    Log_Start_Next();
+    NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+}
+
+/**
+ * @brief Makes room for len bytes, closing the open buffer if they do not fit.
+ *
+ * @param len The number of bytes needed.
+ *
+ * @return A pointer to the free space in the open buffer, or NULL if the pool is full.
+ */
+static char *Log_Reserve(uint16_t len) {
+    uint8_t fill = log_fill;
+
+    if (log_len[fill & (LOG_BUF_COUNT - 1)] + len > LOG_BUF_SIZE) {
+        if ((uint8_t)(fill + 1 - log_done) >= LOG_BUF_COUNT) {  // Every other buffer is still queued
+            return 0;
+        }
+        fill++;
+        log_len[fill & (LOG_BUF_COUNT - 1)] = 0;
+        log_fill = fill;
+    }
+    return &log_buf[fill & (LOG_BUF_COUNT - 1)][log_len[fill & (LOG_BUF_COUNT - 1)]];
+}
+
+/**
+ * @brief Initializes DMA1 Channel4 to send the log buffers to USART1.
+ *
+ * USART1 must already be initialized with USART1_Init().
+ *
+ * @return 1 on success, 0 if DMA1 Channel4 is owned by another driver.
+ */
+uint8_t Log_Init(void) {
+    DMA_InitTypeDef *DMA_InitStructure = &log_desc.init;
+
+    if (log_dma) {
+        DMA_Mgr_Free(4);  // Drop whatever the previous sink was sending
+    }
+    log_dma = DMA_Mgr_Alloc(4, 3, 2);
+    if (!log_dma) {
+        return 0;
+    }
+
+    DMA_InitStructure->DMA_PeripheralBaseAddr = (uint32_t)&USART1->DR;
+    DMA_InitStructure->DMA_MemoryBaseAddr = (uint32_t)log_buf[0];
+    DMA_InitStructure->DMA_DIR = DMA_DIR_PeripheralDST;  // Memory to peripheral mode
+    DMA_InitStructure->DMA_BufferSize = 0;
+    DMA_InitStructure->DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure->DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure->DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure->DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure->DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure->DMA_Priority = DMA_Priority_Medium;
+    DMA_InitStructure->DMA_M2M = DMA_M2M_Disable;
+    log_desc.half = 0;
+    log_desc.cb = Log_DMA_Event;
+
+    log_done = 0;
+    log_fill = 0;
+    log_len[0] = 0;
+    log_busy = 0;
+    USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
+    return 1;
+}
+
+/**
+ * @brief Queues raw bytes for the log.
+ *
+ * @param data The bytes to be sent.
+ * @param len The number of bytes, at most LOG_BUF_SIZE (longer data is truncated).
+ *
+ * @return 1 if the data was queued, 0 if it was dropped because the pool was full.
+ */
+uint8_t Log_Write(const char *data, uint16_t len) {
+    char *dst;
+
+    if (len > LOG_BUF_SIZE) {
+        len = LOG_BUF_SIZE;
+    }
+
+    log_writing = 1;
+    dst = Log_Reserve(len);
+    if (dst) {
+        memcpy(dst, data, len);
+        log_len[log_fill & (LOG_BUF_COUNT - 1)] += len;
+    } else {
+        log_dropped++;
+    }
+    log_writing = 0;
+
+    Log_Kick();
+    return dst != 0;
+}
+
+/**
+ * @brief Formats a message directly into the open pool buffer and queues it.
+ *
+ * The message is formatted into the free space of the open buffer; only if it does not fit is the buffer closed
+ * and the message formatted again into the next one. Messages are truncated to LOG_BUF_SIZE - 1 bytes.
+ *
+ * @param fmt The printf-style format string.
+ *
+ * @return 1 if the message was queued, 0 if it was dropped because the pool was full.
+ */
+uint8_t Log_Printf(const char *fmt, ...) {
+    va_list args;
+    char *dst;
+    uint16_t *used;
+    int n;
+
+    log_writing = 1;
+    used = &log_len[log_fill & (LOG_BUF_COUNT - 1)];
+    dst = &log_buf[log_fill & (LOG_BUF_COUNT - 1)][*used];
+    va_start(args, fmt);
+    n = vsnprintf(dst, LOG_BUF_SIZE - *used, fmt, args);  // Try the free space of the open buffer
+    va_end(args);
+
+    if (n >= 0 && *used + n >= LOG_BUF_SIZE) {  // Did not fit (the terminator needs a byte too)
+        dst = Log_Reserve(LOG_BUF_SIZE);         // Close the open buffer
+        if (dst) {
+            va_start(args, fmt);
+            n = vsnprintf(dst, LOG_BUF_SIZE, fmt, args);
+            va_end(args);
+            if (n >= LOG_BUF_SIZE) {
+                n = LOG_BUF_SIZE - 1;
+            }
+            used = &log_len[log_fill & (LOG_BUF_COUNT - 1)];
+        } else {
+            log_dropped++;
+        }
+    }
+    if (dst && n > 0) {
+        *used += (uint16_t)n;  // The terminator is overwritten by the next message
+    }
+    log_writing = 0;
+
+    Log_Kick();
+    return dst != 0 && n >= 0;
+}
+
+/**
+ * @brief Waits until every queued log byte has been handed to USART1.
+ *
+ * @return void
+ */
+void Log_Flush(void) {
+    while (log_busy || log_len[log_fill & (LOG_BUF_COUNT - 1)] != 0) {
+        Log_Kick();
+    }
+}
+
+/**
+ * @brief Returns the number of messages dropped because the pool was full.
+ *
+ * @return The dropped message count since start-up.
+ */
+uint32_t Log_Dropped(void) {
+    return log_dropped;
+}
+
+/**
+ * @brief DMA manager callback for DMA1 Channel4, the USART1 TX DMA.
+ *
+ * Releases the buffer that has just been sent (or failed) and chains the next one.
+ *
+ * @param desc The sink descriptor.
+ * @param event DMA_EVT_TC or DMA_EVT_TE.
+ *
+ * @return void
+ */
+static void Log_DMA_Event(DMA_Desc_TypeDef *desc, uint8_t event) {
+    (void)desc;
+    (void)event;
+    log_done++;
+    log_busy = 0;
+    Log_Start_Next();
+}
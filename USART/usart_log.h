@@ -0,0 +1,28 @@
+/**
+ * @file usart_log.h
+ * @brief Declares the DMA-driven log sink for USART1.
+ *
+ * Log messages are formatted straight into a pool of fixed-size buffers. Small messages are packed into the
+ * same buffer while the DMA is busy, and each full buffer is sent by DMA1 Channel4 in one transfer, the next one
+ * being started from the transfer-complete interrupt. The CPU cost of a log line is the formatting alone.
+ *
+ * @author Yixiang Fan
+ * @date 2024-08-02
+ * @copyright Copyright 2024 Yixiang Fan. All rights reserved.
+ */
+
+#ifndef USART_USART_LOG_H_
+#define USART_USART_LOG_H_
+
+#include "system.h"
+
+#define LOG_BUF_SIZE 128  // Bytes per pool buffer, also the longest message
+#define LOG_BUF_COUNT 8   // Buffers in the pool, must be a power of two
+
+uint8_t Log_Init(void);
+uint8_t Log_Write(const char *data, uint16_t len);
+uint8_t Log_Printf(const char *fmt, ...);
+void Log_Flush(void);
+uint32_t Log_Dropped(void);
+
+#endif  // USART_USART_LOG_H_
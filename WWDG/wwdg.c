@@ -9,6 +9,7 @@
 #include "wwdg.h"
 #include "SysTick.h"
 #include "led.h"
+#include "dwt.h"
 
 /**
  * @brief Initializes the Window Watchdog (WWDG) peripheral.
@@ -47,7 +48,9 @@ void WWDG_Init(void) {
  * @return None
  */
 void WWDG_IRQHandler(void) {
+    DWT_PROF_BEGIN(wwdg_irq);
     WWDG_SetCounter(0x7f);  // Reassign value
     WWDG_ClearFlag();       // Clear window watchdog status flag
     led2 = !led2;
+    DWT_PROF_END(wwdg_irq);
 }